@@ -8,6 +8,7 @@
 
 #include <stddef.h>
 #include "upb/msg.h"
+#include "upb/decode_fast.h"
 #include "google/protobuf/descriptor.upb.h"
 
 #include "upb/port_def.inc"
@@ -20,10 +21,18 @@ static const upb_msglayout_field google_protobuf_FileDescriptorSet__fields[1] =
   {1, UPB_SIZE(0, 0), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_FileDescriptorSet__fasttable[2] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_1bt, UPB_FASTDATA(0xa, 0, 0, UPB_SIZE(0, 0))},
+};
+
 const upb_msglayout google_protobuf_FileDescriptorSet_msginit = {
   &google_protobuf_FileDescriptorSet_submsgs[0],
   &google_protobuf_FileDescriptorSet__fields[0],
-  UPB_SIZE(4, 8), 1, false,
+  UPB_SIZE(4, 8), 1, false, 1,
+  &google_protobuf_FileDescriptorSet__fasttable[0], 0x8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_FileDescriptorProto_submsgs[6] = {
@@ -43,17 +52,45 @@ static const upb_msglayout_field google_protobuf_FileDescriptorProto__fields[12]
   {5, UPB_SIZE(44, 88), 0, 1, 11, 3},
   {6, UPB_SIZE(48, 96), 0, 4, 11, 3},
   {7, UPB_SIZE(52, 104), 0, 2, 11, 3},
-  {8, UPB_SIZE(28, 56), 4, 3, 11, 1},
-  {9, UPB_SIZE(32, 64), 5, 5, 11, 1},
+  {8, UPB_SIZE(28, 56), 3, 3, 11, 1},
+  {9, UPB_SIZE(32, 64), 4, 5, 11, 1},
   {10, UPB_SIZE(56, 112), 0, 0, 5, 3},
   {11, UPB_SIZE(60, 120), 0, 0, 5, 3},
-  {12, UPB_SIZE(20, 40), 3, 0, 9, 1},
+  {12, UPB_SIZE(20, 40), 5, 0, 9, 1},
+};
+
+static const _upb_fasttable_entry google_protobuf_FileDescriptorProto__fasttable[16] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x12, 0, 2, UPB_SIZE(12, 24))},
+  {&upb_prs_1bt, UPB_FASTDATA(0x1a, 0, 0, UPB_SIZE(36, 72))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x22, 0, 0, UPB_SIZE(40, 80))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x2a, 1, 0, UPB_SIZE(44, 88))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x32, 4, 0, UPB_SIZE(48, 96))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x3a, 2, 0, UPB_SIZE(52, 104))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x42, 3, 3, UPB_SIZE(28, 56))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x4a, 5, 4, UPB_SIZE(32, 64))},
+  {&upb_prv4_1bt, UPB_FASTDATA(0x50, 0, 0, UPB_SIZE(56, 112))},
+  {&upb_prv4_1bt, UPB_FASTDATA(0x58, 0, 0, UPB_SIZE(60, 120))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x62, 0, 5, UPB_SIZE(20, 40))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
+static const _upb_zerorange google_protobuf_FileDescriptorProto__zero[3] = {
+  {UPB_SIZE(0, 0), UPB_SIZE(1, 1)},
+  {UPB_SIZE(36, 72), UPB_SIZE(28, 56)},
+  {0, 0},
 };
 
 const upb_msglayout google_protobuf_FileDescriptorProto_msginit = {
   &google_protobuf_FileDescriptorProto_submsgs[0],
   &google_protobuf_FileDescriptorProto__fields[0],
-  UPB_SIZE(64, 128), 12, false,
+  UPB_SIZE(64, 128), 12, false, 12,
+  &google_protobuf_FileDescriptorProto__fasttable[0], 0x78,
+  NULL,
+  &google_protobuf_FileDescriptorProto__zero[0],
 };
 
 static const upb_msglayout *const google_protobuf_DescriptorProto_submsgs[8] = {
@@ -79,10 +116,32 @@ static const upb_msglayout_field google_protobuf_DescriptorProto__fields[10] = {
   {10, UPB_SIZE(44, 88), 0, 0, 9, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_DescriptorProto__fasttable[16] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x12, 4, 0, UPB_SIZE(16, 32))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x1a, 0, 0, UPB_SIZE(20, 40))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x22, 3, 0, UPB_SIZE(24, 48))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x2a, 1, 0, UPB_SIZE(28, 56))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x32, 4, 0, UPB_SIZE(32, 64))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x3a, 5, 2, UPB_SIZE(12, 24))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x42, 6, 0, UPB_SIZE(36, 72))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x4a, 2, 0, UPB_SIZE(40, 80))},
+  {&upb_prs_1bt, UPB_FASTDATA(0x52, 0, 0, UPB_SIZE(44, 88))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_DescriptorProto_msginit = {
   &google_protobuf_DescriptorProto_submsgs[0],
   &google_protobuf_DescriptorProto__fields[0],
-  UPB_SIZE(48, 96), 10, false,
+  UPB_SIZE(48, 96), 10, false, 10,
+  &google_protobuf_DescriptorProto__fasttable[0], 0x78,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_DescriptorProto_ExtensionRange_submsgs[1] = {
@@ -95,10 +154,20 @@ static const upb_msglayout_field google_protobuf_DescriptorProto_ExtensionRange_
   {3, UPB_SIZE(12, 16), 3, 0, 11, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_DescriptorProto_ExtensionRange__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(4, 4))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(8, 8))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x1a, 0, 3, UPB_SIZE(12, 16))},
+};
+
 const upb_msglayout google_protobuf_DescriptorProto_ExtensionRange_msginit = {
   &google_protobuf_DescriptorProto_ExtensionRange_submsgs[0],
   &google_protobuf_DescriptorProto_ExtensionRange__fields[0],
-  UPB_SIZE(16, 24), 3, false,
+  UPB_SIZE(16, 24), 3, false, 3,
+  &google_protobuf_DescriptorProto_ExtensionRange__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout_field google_protobuf_DescriptorProto_ReservedRange__fields[2] = {
@@ -106,10 +175,20 @@ static const upb_msglayout_field google_protobuf_DescriptorProto_ReservedRange__
   {2, UPB_SIZE(8, 8), 2, 0, 5, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_DescriptorProto_ReservedRange__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(4, 4))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(8, 8))},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_DescriptorProto_ReservedRange_msginit = {
   NULL,
   &google_protobuf_DescriptorProto_ReservedRange__fields[0],
-  UPB_SIZE(12, 12), 2, false,
+  UPB_SIZE(12, 12), 2, false, 2,
+  &google_protobuf_DescriptorProto_ReservedRange__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_ExtensionRangeOptions_submsgs[1] = {
@@ -120,10 +199,48 @@ static const upb_msglayout_field google_protobuf_ExtensionRangeOptions__fields[1
   {999, UPB_SIZE(0, 0), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_ExtensionRangeOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(0, 0))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_ExtensionRangeOptions_msginit = {
   &google_protobuf_ExtensionRangeOptions_submsgs[0],
   &google_protobuf_ExtensionRangeOptions__fields[0],
-  UPB_SIZE(4, 8), 1, false,
+  UPB_SIZE(4, 8), 1, true, 0,
+  &google_protobuf_ExtensionRangeOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_FieldDescriptorProto_submsgs[1] = {
@@ -131,22 +248,49 @@ static const upb_msglayout *const google_protobuf_FieldDescriptorProto_submsgs[1
 };
 
 static const upb_msglayout_field google_protobuf_FieldDescriptorProto__fields[10] = {
-  {1, UPB_SIZE(32, 32), 5, 0, 9, 1},
-  {2, UPB_SIZE(40, 48), 6, 0, 9, 1},
+  {1, UPB_SIZE(32, 32), 1, 0, 9, 1},
+  {2, UPB_SIZE(40, 48), 2, 0, 9, 1},
   {3, UPB_SIZE(24, 24), 3, 0, 5, 1},
-  {4, UPB_SIZE(8, 8), 1, 0, 14, 1},
-  {5, UPB_SIZE(16, 16), 2, 0, 14, 1},
-  {6, UPB_SIZE(48, 64), 7, 0, 9, 1},
-  {7, UPB_SIZE(56, 80), 8, 0, 9, 1},
-  {8, UPB_SIZE(72, 112), 10, 0, 11, 1},
-  {9, UPB_SIZE(28, 28), 4, 0, 5, 1},
-  {10, UPB_SIZE(64, 96), 9, 0, 9, 1},
+  {4, UPB_SIZE(8, 8), 4, 0, 14, 1},
+  {5, UPB_SIZE(16, 16), 5, 0, 14, 1},
+  {6, UPB_SIZE(48, 64), 6, 0, 9, 1},
+  {7, UPB_SIZE(56, 80), 7, 0, 9, 1},
+  {8, UPB_SIZE(72, 112), 8, 0, 11, 1},
+  {9, UPB_SIZE(28, 28), 9, 0, 5, 1},
+  {10, UPB_SIZE(64, 96), 10, 0, 9, 1},
+};
+
+static const _upb_fasttable_entry google_protobuf_FieldDescriptorProto__fasttable[16] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(32, 32))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x12, 0, 2, UPB_SIZE(40, 48))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x18, 0, 3, UPB_SIZE(24, 24))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x20, 0, 4, UPB_SIZE(8, 8))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x28, 0, 5, UPB_SIZE(16, 16))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x32, 0, 6, UPB_SIZE(48, 64))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x3a, 0, 7, UPB_SIZE(56, 80))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x42, 0, 8, UPB_SIZE(72, 112))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x48, 0, 9, UPB_SIZE(28, 28))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x52, 0, 10, UPB_SIZE(64, 96))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
+static const _upb_zerorange google_protobuf_FieldDescriptorProto__zero[2] = {
+  {UPB_SIZE(0, 0), UPB_SIZE(2, 2)},
+  {0, 0},
 };
 
 const upb_msglayout google_protobuf_FieldDescriptorProto_msginit = {
   &google_protobuf_FieldDescriptorProto_submsgs[0],
   &google_protobuf_FieldDescriptorProto__fields[0],
-  UPB_SIZE(80, 128), 10, false,
+  UPB_SIZE(80, 128), 10, false, 10,
+  &google_protobuf_FieldDescriptorProto__fasttable[0], 0x78,
+  NULL,
+  &google_protobuf_FieldDescriptorProto__zero[0],
 };
 
 static const upb_msglayout *const google_protobuf_OneofDescriptorProto_submsgs[1] = {
@@ -158,10 +302,20 @@ static const upb_msglayout_field google_protobuf_OneofDescriptorProto__fields[2]
   {2, UPB_SIZE(12, 24), 2, 0, 11, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_OneofDescriptorProto__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x12, 0, 2, UPB_SIZE(12, 24))},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_OneofDescriptorProto_msginit = {
   &google_protobuf_OneofDescriptorProto_submsgs[0],
   &google_protobuf_OneofDescriptorProto__fields[0],
-  UPB_SIZE(16, 32), 2, false,
+  UPB_SIZE(16, 32), 2, false, 2,
+  &google_protobuf_OneofDescriptorProto__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_EnumDescriptorProto_submsgs[3] = {
@@ -178,10 +332,24 @@ static const upb_msglayout_field google_protobuf_EnumDescriptorProto__fields[5]
   {5, UPB_SIZE(24, 48), 0, 0, 9, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_EnumDescriptorProto__fasttable[8] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x12, 2, 0, UPB_SIZE(16, 32))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x1a, 1, 2, UPB_SIZE(12, 24))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x22, 0, 0, UPB_SIZE(20, 40))},
+  {&upb_prs_1bt, UPB_FASTDATA(0x2a, 0, 0, UPB_SIZE(24, 48))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_EnumDescriptorProto_msginit = {
   &google_protobuf_EnumDescriptorProto_submsgs[0],
   &google_protobuf_EnumDescriptorProto__fields[0],
-  UPB_SIZE(32, 64), 5, false,
+  UPB_SIZE(32, 64), 5, false, 5,
+  &google_protobuf_EnumDescriptorProto__fasttable[0], 0x38,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout_field google_protobuf_EnumDescriptorProto_EnumReservedRange__fields[2] = {
@@ -189,10 +357,20 @@ static const upb_msglayout_field google_protobuf_EnumDescriptorProto_EnumReserve
   {2, UPB_SIZE(8, 8), 2, 0, 5, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_EnumDescriptorProto_EnumReservedRange__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(4, 4))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(8, 8))},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_EnumDescriptorProto_EnumReservedRange_msginit = {
   NULL,
   &google_protobuf_EnumDescriptorProto_EnumReservedRange__fields[0],
-  UPB_SIZE(12, 12), 2, false,
+  UPB_SIZE(12, 12), 2, false, 2,
+  &google_protobuf_EnumDescriptorProto_EnumReservedRange__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_EnumValueDescriptorProto_submsgs[1] = {
@@ -200,15 +378,25 @@ static const upb_msglayout *const google_protobuf_EnumValueDescriptorProto_subms
 };
 
 static const upb_msglayout_field google_protobuf_EnumValueDescriptorProto__fields[3] = {
-  {1, UPB_SIZE(8, 8), 2, 0, 9, 1},
-  {2, UPB_SIZE(4, 4), 1, 0, 5, 1},
+  {1, UPB_SIZE(8, 8), 1, 0, 9, 1},
+  {2, UPB_SIZE(4, 4), 2, 0, 5, 1},
   {3, UPB_SIZE(16, 24), 3, 0, 11, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_EnumValueDescriptorProto__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(8, 8))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(4, 4))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x1a, 0, 3, UPB_SIZE(16, 24))},
+};
+
 const upb_msglayout google_protobuf_EnumValueDescriptorProto_msginit = {
   &google_protobuf_EnumValueDescriptorProto_submsgs[0],
   &google_protobuf_EnumValueDescriptorProto__fields[0],
-  UPB_SIZE(24, 32), 3, false,
+  UPB_SIZE(24, 32), 3, false, 3,
+  &google_protobuf_EnumValueDescriptorProto__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_ServiceDescriptorProto_submsgs[2] = {
@@ -222,10 +410,20 @@ static const upb_msglayout_field google_protobuf_ServiceDescriptorProto__fields[
   {3, UPB_SIZE(12, 24), 2, 1, 11, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_ServiceDescriptorProto__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_prm_1bt, UPB_FASTDATA(0x12, 0, 0, UPB_SIZE(16, 32))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x1a, 1, 2, UPB_SIZE(12, 24))},
+};
+
 const upb_msglayout google_protobuf_ServiceDescriptorProto_msginit = {
   &google_protobuf_ServiceDescriptorProto_submsgs[0],
   &google_protobuf_ServiceDescriptorProto__fields[0],
-  UPB_SIZE(24, 48), 3, false,
+  UPB_SIZE(24, 48), 3, false, 3,
+  &google_protobuf_ServiceDescriptorProto__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_MethodDescriptorProto_submsgs[1] = {
@@ -233,18 +431,32 @@ static const upb_msglayout *const google_protobuf_MethodDescriptorProto_submsgs[
 };
 
 static const upb_msglayout_field google_protobuf_MethodDescriptorProto__fields[6] = {
-  {1, UPB_SIZE(4, 8), 3, 0, 9, 1},
-  {2, UPB_SIZE(12, 24), 4, 0, 9, 1},
-  {3, UPB_SIZE(20, 40), 5, 0, 9, 1},
-  {4, UPB_SIZE(28, 56), 6, 0, 11, 1},
-  {5, UPB_SIZE(1, 1), 1, 0, 8, 1},
-  {6, UPB_SIZE(2, 2), 2, 0, 8, 1},
+  {1, UPB_SIZE(4, 8), 1, 0, 9, 1},
+  {2, UPB_SIZE(12, 24), 2, 0, 9, 1},
+  {3, UPB_SIZE(20, 40), 3, 0, 9, 1},
+  {4, UPB_SIZE(28, 56), 4, 0, 11, 1},
+  {5, UPB_SIZE(1, 1), 5, 0, 8, 1},
+  {6, UPB_SIZE(2, 2), 6, 0, 8, 1},
+};
+
+static const _upb_fasttable_entry google_protobuf_MethodDescriptorProto__fasttable[8] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x12, 0, 2, UPB_SIZE(12, 24))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x1a, 0, 3, UPB_SIZE(20, 40))},
+  {&upb_psm_1bt, UPB_FASTDATA(0x22, 0, 4, UPB_SIZE(28, 56))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x28, 0, 5, UPB_SIZE(1, 1))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x30, 0, 6, UPB_SIZE(2, 2))},
+  {&_upb_fastdecode_generic, 0},
 };
 
 const upb_msglayout google_protobuf_MethodDescriptorProto_msginit = {
   &google_protobuf_MethodDescriptorProto_submsgs[0],
   &google_protobuf_MethodDescriptorProto__fields[0],
-  UPB_SIZE(32, 64), 6, false,
+  UPB_SIZE(32, 64), 6, false, 6,
+  &google_protobuf_MethodDescriptorProto__fasttable[0], 0x38,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_FileOptions_submsgs[1] = {
@@ -252,33 +464,77 @@ static const upb_msglayout *const google_protobuf_FileOptions_submsgs[1] = {
 };
 
 static const upb_msglayout_field google_protobuf_FileOptions__fields[21] = {
-  {1, UPB_SIZE(28, 32), 11, 0, 9, 1},
-  {8, UPB_SIZE(36, 48), 12, 0, 9, 1},
-  {9, UPB_SIZE(8, 8), 1, 0, 14, 1},
-  {10, UPB_SIZE(16, 16), 2, 0, 8, 1},
-  {11, UPB_SIZE(44, 64), 13, 0, 9, 1},
-  {16, UPB_SIZE(17, 17), 3, 0, 8, 1},
-  {17, UPB_SIZE(18, 18), 4, 0, 8, 1},
-  {18, UPB_SIZE(19, 19), 5, 0, 8, 1},
-  {20, UPB_SIZE(20, 20), 6, 0, 8, 1},
-  {23, UPB_SIZE(21, 21), 7, 0, 8, 1},
-  {27, UPB_SIZE(22, 22), 8, 0, 8, 1},
-  {31, UPB_SIZE(23, 23), 9, 0, 8, 1},
-  {36, UPB_SIZE(52, 80), 14, 0, 9, 1},
-  {37, UPB_SIZE(60, 96), 15, 0, 9, 1},
-  {39, UPB_SIZE(68, 112), 16, 0, 9, 1},
-  {40, UPB_SIZE(76, 128), 17, 0, 9, 1},
-  {41, UPB_SIZE(84, 144), 18, 0, 9, 1},
-  {42, UPB_SIZE(24, 24), 10, 0, 8, 1},
+  {1, UPB_SIZE(28, 32), 1, 0, 9, 1},
+  {8, UPB_SIZE(36, 48), 2, 0, 9, 1},
+  {9, UPB_SIZE(8, 8), 3, 0, 14, 1},
+  {10, UPB_SIZE(16, 16), 4, 0, 8, 1},
+  {11, UPB_SIZE(44, 64), 5, 0, 9, 1},
+  {16, UPB_SIZE(17, 17), 6, 0, 8, 1},
+  {17, UPB_SIZE(18, 18), 7, 0, 8, 1},
+  {18, UPB_SIZE(19, 19), 8, 0, 8, 1},
+  {20, UPB_SIZE(20, 20), 9, 0, 8, 1},
+  {23, UPB_SIZE(21, 21), 10, 0, 8, 1},
+  {27, UPB_SIZE(22, 22), 11, 0, 8, 1},
+  {31, UPB_SIZE(23, 23), 12, 0, 8, 1},
+  {36, UPB_SIZE(52, 80), 13, 0, 9, 1},
+  {37, UPB_SIZE(60, 96), 14, 0, 9, 1},
+  {39, UPB_SIZE(68, 112), 15, 0, 9, 1},
+  {40, UPB_SIZE(76, 128), 16, 0, 9, 1},
+  {41, UPB_SIZE(84, 144), 17, 0, 9, 1},
+  {42, UPB_SIZE(24, 24), 18, 0, 8, 1},
   {44, UPB_SIZE(92, 160), 19, 0, 9, 1},
   {45, UPB_SIZE(100, 176), 20, 0, 9, 1},
   {999, UPB_SIZE(108, 192), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_FileOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(28, 32))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0x42, 0, 2, UPB_SIZE(36, 48))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x48, 0, 3, UPB_SIZE(8, 8))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x50, 0, 4, UPB_SIZE(16, 16))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x5a, 0, 5, UPB_SIZE(44, 64))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x180, 0, 6, UPB_SIZE(17, 17))},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x188, 0, 7, UPB_SIZE(18, 18))},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x190, 0, 8, UPB_SIZE(19, 19))},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x1a0, 0, 9, UPB_SIZE(20, 20))},
+  {&upb_pss_2bt, UPB_FASTDATA(0x2aa, 0, 14, UPB_SIZE(60, 96))},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x1b8, 0, 10, UPB_SIZE(21, 21))},
+  {&upb_pss_2bt, UPB_FASTDATA(0x2c2, 0, 16, UPB_SIZE(76, 128))},
+  {&upb_pss_2bt, UPB_FASTDATA(0x2ca, 0, 17, UPB_SIZE(84, 144))},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x2d0, 0, 18, UPB_SIZE(24, 24))},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x1d8, 0, 11, UPB_SIZE(22, 22))},
+  {&upb_pss_2bt, UPB_FASTDATA(0x2e2, 0, 19, UPB_SIZE(92, 160))},
+  {&upb_pss_2bt, UPB_FASTDATA(0x2ea, 0, 20, UPB_SIZE(100, 176))},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x1f8, 0, 12, UPB_SIZE(23, 23))},
+};
+
+static const _upb_zerorange google_protobuf_FileOptions__zero[3] = {
+  {UPB_SIZE(0, 0), UPB_SIZE(3, 3)},
+  {UPB_SIZE(108, 192), UPB_SIZE(4, 8)},
+  {0, 0},
+};
+
 const upb_msglayout google_protobuf_FileOptions_msginit = {
   &google_protobuf_FileOptions_submsgs[0],
   &google_protobuf_FileOptions__fields[0],
-  UPB_SIZE(112, 208), 21, false,
+  UPB_SIZE(112, 208), 21, true, 1,
+  &google_protobuf_FileOptions__fasttable[0], 0xf8,
+  NULL,
+  &google_protobuf_FileOptions__zero[0],
 };
 
 static const upb_msglayout *const google_protobuf_MessageOptions_submsgs[1] = {
@@ -293,10 +549,48 @@ static const upb_msglayout_field google_protobuf_MessageOptions__fields[5] = {
   {999, UPB_SIZE(8, 8), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_MessageOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(1, 1))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(2, 2))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x18, 0, 3, UPB_SIZE(3, 3))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x38, 0, 4, UPB_SIZE(4, 4))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(8, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_MessageOptions_msginit = {
   &google_protobuf_MessageOptions_submsgs[0],
   &google_protobuf_MessageOptions__fields[0],
-  UPB_SIZE(12, 16), 5, false,
+  UPB_SIZE(12, 16), 5, true, 3,
+  &google_protobuf_MessageOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_FieldOptions_submsgs[1] = {
@@ -305,18 +599,56 @@ static const upb_msglayout *const google_protobuf_FieldOptions_submsgs[1] = {
 
 static const upb_msglayout_field google_protobuf_FieldOptions__fields[7] = {
   {1, UPB_SIZE(8, 8), 1, 0, 14, 1},
-  {2, UPB_SIZE(24, 24), 3, 0, 8, 1},
-  {3, UPB_SIZE(25, 25), 4, 0, 8, 1},
-  {5, UPB_SIZE(26, 26), 5, 0, 8, 1},
-  {6, UPB_SIZE(16, 16), 2, 0, 14, 1},
+  {2, UPB_SIZE(24, 24), 2, 0, 8, 1},
+  {3, UPB_SIZE(25, 25), 3, 0, 8, 1},
+  {5, UPB_SIZE(26, 26), 4, 0, 8, 1},
+  {6, UPB_SIZE(16, 16), 5, 0, 14, 1},
   {10, UPB_SIZE(27, 27), 6, 0, 8, 1},
   {999, UPB_SIZE(28, 32), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_FieldOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(8, 8))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(24, 24))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x18, 0, 3, UPB_SIZE(25, 25))},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x28, 0, 4, UPB_SIZE(26, 26))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x30, 0, 5, UPB_SIZE(16, 16))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x50, 0, 6, UPB_SIZE(27, 27))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(28, 32))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_FieldOptions_msginit = {
   &google_protobuf_FieldOptions_submsgs[0],
   &google_protobuf_FieldOptions__fields[0],
-  UPB_SIZE(32, 40), 7, false,
+  UPB_SIZE(32, 40), 7, true, 3,
+  &google_protobuf_FieldOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_OneofOptions_submsgs[1] = {
@@ -327,10 +659,48 @@ static const upb_msglayout_field google_protobuf_OneofOptions__fields[1] = {
   {999, UPB_SIZE(0, 0), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_OneofOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(0, 0))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_OneofOptions_msginit = {
   &google_protobuf_OneofOptions_submsgs[0],
   &google_protobuf_OneofOptions__fields[0],
-  UPB_SIZE(4, 8), 1, false,
+  UPB_SIZE(4, 8), 1, true, 0,
+  &google_protobuf_OneofOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_EnumOptions_submsgs[1] = {
@@ -343,10 +713,48 @@ static const upb_msglayout_field google_protobuf_EnumOptions__fields[3] = {
   {999, UPB_SIZE(4, 8), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_EnumOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x10, 0, 1, UPB_SIZE(1, 1))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x18, 0, 2, UPB_SIZE(2, 2))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(4, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_EnumOptions_msginit = {
   &google_protobuf_EnumOptions_submsgs[0],
   &google_protobuf_EnumOptions__fields[0],
-  UPB_SIZE(8, 16), 3, false,
+  UPB_SIZE(8, 16), 3, true, 0,
+  &google_protobuf_EnumOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_EnumValueOptions_submsgs[1] = {
@@ -358,10 +766,48 @@ static const upb_msglayout_field google_protobuf_EnumValueOptions__fields[2] = {
   {999, UPB_SIZE(4, 8), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_EnumValueOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x8, 0, 1, UPB_SIZE(1, 1))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(4, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_EnumValueOptions_msginit = {
   &google_protobuf_EnumValueOptions_submsgs[0],
   &google_protobuf_EnumValueOptions__fields[0],
-  UPB_SIZE(8, 16), 2, false,
+  UPB_SIZE(8, 16), 2, true, 1,
+  &google_protobuf_EnumValueOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_ServiceOptions_submsgs[1] = {
@@ -373,10 +819,48 @@ static const upb_msglayout_field google_protobuf_ServiceOptions__fields[2] = {
   {999, UPB_SIZE(4, 8), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_ServiceOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x288, 0, 1, UPB_SIZE(1, 1))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(4, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_ServiceOptions_msginit = {
   &google_protobuf_ServiceOptions_submsgs[0],
   &google_protobuf_ServiceOptions__fields[0],
-  UPB_SIZE(8, 16), 2, false,
+  UPB_SIZE(8, 16), 2, true, 0,
+  &google_protobuf_ServiceOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_MethodOptions_submsgs[1] = {
@@ -384,15 +868,53 @@ static const upb_msglayout *const google_protobuf_MethodOptions_submsgs[1] = {
 };
 
 static const upb_msglayout_field google_protobuf_MethodOptions__fields[3] = {
-  {33, UPB_SIZE(16, 16), 2, 0, 8, 1},
-  {34, UPB_SIZE(8, 8), 1, 0, 14, 1},
+  {33, UPB_SIZE(16, 16), 1, 0, 8, 1},
+  {34, UPB_SIZE(8, 8), 2, 0, 14, 1},
   {999, UPB_SIZE(20, 24), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_MethodOptions__fasttable[32] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_psb1_2bt, UPB_FASTDATA(0x288, 0, 1, UPB_SIZE(16, 16))},
+  {&upb_psv4_2bt, UPB_FASTDATA(0x290, 0, 2, UPB_SIZE(8, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_2bt, UPB_FASTDATA(0x3eba, 0, 0, UPB_SIZE(20, 24))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_MethodOptions_msginit = {
   &google_protobuf_MethodOptions_submsgs[0],
   &google_protobuf_MethodOptions__fields[0],
-  UPB_SIZE(24, 32), 3, false,
+  UPB_SIZE(24, 32), 3, true, 0,
+  &google_protobuf_MethodOptions__fasttable[0], 0xf8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_UninterpretedOption_submsgs[1] = {
@@ -401,29 +923,61 @@ static const upb_msglayout *const google_protobuf_UninterpretedOption_submsgs[1]
 
 static const upb_msglayout_field google_protobuf_UninterpretedOption__fields[7] = {
   {2, UPB_SIZE(56, 80), 0, 0, 11, 3},
-  {3, UPB_SIZE(32, 32), 4, 0, 9, 1},
-  {4, UPB_SIZE(8, 8), 1, 0, 4, 1},
-  {5, UPB_SIZE(16, 16), 2, 0, 3, 1},
-  {6, UPB_SIZE(24, 24), 3, 0, 1, 1},
+  {3, UPB_SIZE(32, 32), 1, 0, 9, 1},
+  {4, UPB_SIZE(8, 8), 2, 0, 4, 1},
+  {5, UPB_SIZE(16, 16), 3, 0, 3, 1},
+  {6, UPB_SIZE(24, 24), 4, 0, 1, 1},
   {7, UPB_SIZE(40, 48), 5, 0, 12, 1},
   {8, UPB_SIZE(48, 64), 6, 0, 9, 1},
 };
 
+static const _upb_fasttable_entry google_protobuf_UninterpretedOption__fasttable[16] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_1bt, UPB_FASTDATA(0x12, 0, 0, UPB_SIZE(56, 80))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x1a, 0, 1, UPB_SIZE(32, 32))},
+  {&upb_psv8_1bt, UPB_FASTDATA(0x20, 0, 2, UPB_SIZE(8, 8))},
+  {&upb_psv8_1bt, UPB_FASTDATA(0x28, 0, 3, UPB_SIZE(16, 16))},
+  {&upb_psf8_1bt, UPB_FASTDATA(0x31, 0, 4, UPB_SIZE(24, 24))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x3a, 0, 5, UPB_SIZE(40, 48))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x42, 0, 6, UPB_SIZE(48, 64))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_UninterpretedOption_msginit = {
   &google_protobuf_UninterpretedOption_submsgs[0],
   &google_protobuf_UninterpretedOption__fields[0],
-  UPB_SIZE(64, 96), 7, false,
+  UPB_SIZE(64, 96), 7, false, 0,
+  &google_protobuf_UninterpretedOption__fasttable[0], 0x78,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout_field google_protobuf_UninterpretedOption_NamePart__fields[2] = {
-  {1, UPB_SIZE(4, 8), 2, 0, 9, 2},
-  {2, UPB_SIZE(1, 1), 1, 0, 8, 2},
+  {1, UPB_SIZE(4, 8), 1, 0, 9, 2},
+  {2, UPB_SIZE(1, 1), 2, 0, 8, 2},
+};
+
+static const _upb_fasttable_entry google_protobuf_UninterpretedOption_NamePart__fasttable[4] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0xa, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_psb1_1bt, UPB_FASTDATA(0x10, 0, 2, UPB_SIZE(1, 1))},
+  {&_upb_fastdecode_generic, 0},
 };
 
 const upb_msglayout google_protobuf_UninterpretedOption_NamePart_msginit = {
   NULL,
   &google_protobuf_UninterpretedOption_NamePart__fields[0],
-  UPB_SIZE(16, 32), 2, false,
+  UPB_SIZE(16, 32), 2, false, 2,
+  &google_protobuf_UninterpretedOption_NamePart__fasttable[0], 0x18,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_SourceCodeInfo_submsgs[1] = {
@@ -434,10 +988,18 @@ static const upb_msglayout_field google_protobuf_SourceCodeInfo__fields[1] = {
   {1, UPB_SIZE(0, 0), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_SourceCodeInfo__fasttable[2] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_1bt, UPB_FASTDATA(0xa, 0, 0, UPB_SIZE(0, 0))},
+};
+
 const upb_msglayout google_protobuf_SourceCodeInfo_msginit = {
   &google_protobuf_SourceCodeInfo_submsgs[0],
   &google_protobuf_SourceCodeInfo__fields[0],
-  UPB_SIZE(4, 8), 1, false,
+  UPB_SIZE(4, 8), 1, false, 1,
+  &google_protobuf_SourceCodeInfo__fasttable[0], 0x8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout_field google_protobuf_SourceCodeInfo_Location__fields[5] = {
@@ -448,10 +1010,24 @@ static const upb_msglayout_field google_protobuf_SourceCodeInfo_Location__fields
   {6, UPB_SIZE(28, 56), 0, 0, 9, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_SourceCodeInfo_Location__fasttable[8] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0x1a, 0, 1, UPB_SIZE(4, 8))},
+  {&upb_pss_1bt, UPB_FASTDATA(0x22, 0, 2, UPB_SIZE(12, 24))},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prs_1bt, UPB_FASTDATA(0x32, 0, 0, UPB_SIZE(28, 56))},
+  {&_upb_fastdecode_generic, 0},
+};
+
 const upb_msglayout google_protobuf_SourceCodeInfo_Location_msginit = {
   NULL,
   &google_protobuf_SourceCodeInfo_Location__fields[0],
-  UPB_SIZE(32, 64), 5, false,
+  UPB_SIZE(32, 64), 5, false, 4,
+  &google_protobuf_SourceCodeInfo_Location__fasttable[0], 0x38,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout *const google_protobuf_GeneratedCodeInfo_submsgs[1] = {
@@ -462,23 +1038,45 @@ static const upb_msglayout_field google_protobuf_GeneratedCodeInfo__fields[1] =
   {1, UPB_SIZE(0, 0), 0, 0, 11, 3},
 };
 
+static const _upb_fasttable_entry google_protobuf_GeneratedCodeInfo__fasttable[2] = {
+  {&_upb_fastdecode_generic, 0},
+  {&upb_prm_1bt, UPB_FASTDATA(0xa, 0, 0, UPB_SIZE(0, 0))},
+};
+
 const upb_msglayout google_protobuf_GeneratedCodeInfo_msginit = {
   &google_protobuf_GeneratedCodeInfo_submsgs[0],
   &google_protobuf_GeneratedCodeInfo__fields[0],
-  UPB_SIZE(4, 8), 1, false,
+  UPB_SIZE(4, 8), 1, false, 1,
+  &google_protobuf_GeneratedCodeInfo__fasttable[0], 0x8,
+  NULL,
+  NULL,
 };
 
 static const upb_msglayout_field google_protobuf_GeneratedCodeInfo_Annotation__fields[4] = {
   {1, UPB_SIZE(20, 32), 0, 0, 5, 3},
-  {2, UPB_SIZE(12, 16), 3, 0, 9, 1},
-  {3, UPB_SIZE(4, 4), 1, 0, 5, 1},
-  {4, UPB_SIZE(8, 8), 2, 0, 5, 1},
+  {2, UPB_SIZE(12, 16), 1, 0, 9, 1},
+  {3, UPB_SIZE(4, 4), 2, 0, 5, 1},
+  {4, UPB_SIZE(8, 8), 3, 0, 5, 1},
+};
+
+static const _upb_fasttable_entry google_protobuf_GeneratedCodeInfo_Annotation__fasttable[8] = {
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&upb_pss_1bt, UPB_FASTDATA(0x12, 0, 1, UPB_SIZE(12, 16))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x18, 0, 2, UPB_SIZE(4, 4))},
+  {&upb_psv4_1bt, UPB_FASTDATA(0x20, 0, 3, UPB_SIZE(8, 8))},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
+  {&_upb_fastdecode_generic, 0},
 };
 
 const upb_msglayout google_protobuf_GeneratedCodeInfo_Annotation_msginit = {
   NULL,
   &google_protobuf_GeneratedCodeInfo_Annotation__fields[0],
-  UPB_SIZE(24, 48), 4, false,
+  UPB_SIZE(24, 48), 4, false, 4,
+  &google_protobuf_GeneratedCodeInfo_Annotation__fasttable[0], 0x38,
+  NULL,
+  NULL,
 };
 
 #include "upb/port_undef.inc"
@@ -1,8 +1,26 @@
+#include <algorithm>
 
 #include <string.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <benchmark/benchmark.h>
 #include "google/protobuf/descriptor.upb.h"
 #include "google/protobuf/descriptor.upbdefs.h"
+#include "tests/google_messages.upb.h"
+#include "tests/google_messages.upbdefs.h"
+#include "upb/bindings/stdc++/string.h"
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/json/parser.h"
+#include "upb/json/printer.h"
+#include "upb/pb/decoder.h"
+#include "upb/pb/encoder.h"
+#include "upb/pb/textprinter.h"
+#include "upb/table.int.h"
+#include "upb/varint_decode.int.h"
 
 upb_strview descriptor = google_protobuf_descriptor_proto_upbdefinit.descriptor;
 
@@ -17,6 +35,14 @@ static void BM_CreateArena(benchmark::State& state) {
 }
 BENCHMARK(BM_CreateArena);
 
+static void BM_CreateInlinedArena(benchmark::State& state) {
+  for (auto _ : state) {
+    upb::InlinedArena<1024> arena;
+    benchmark::DoNotOptimize(upb_arena_malloc(arena.ptr(), 256));
+  }
+}
+BENCHMARK(BM_CreateInlinedArena);
+
 static void BM_ParseDescriptor(benchmark::State& state) {
   size_t bytes = 0;
   for (auto _ : state) {
@@ -34,3 +60,749 @@ static void BM_ParseDescriptor(benchmark::State& state) {
   state.SetBytesProcessed(state.iterations() * descriptor.size);
 }
 BENCHMARK(BM_ParseDescriptor);
+
+// Builds a symtab holding descriptor.proto, either building every def or
+// (when lazy) only indexing the names of its messages and enums.
+template <bool Lazy>
+static void BM_LoadDescriptor(benchmark::State& state) {
+  for (auto _ : state) {
+    upb_symtab* symtab = upb_symtab_new();
+    upb_status status;
+    upb_status_clear(&status);
+    bool ok;
+    if (Lazy) {
+      ok = upb_symtab_addfile_lazy(symtab, descriptor.data, descriptor.size,
+                                   &status);
+    } else {
+      upb_arena* arena = upb_arena_init(buf, sizeof(buf), NULL);
+      google_protobuf_FileDescriptorProto* file =
+          google_protobuf_FileDescriptorProto_parse(descriptor.data,
+                                                    descriptor.size, arena);
+      ok = file && upb_symtab_addfile(symtab, file, &status);
+      upb_arena_free(arena);
+    }
+    if (!ok) {
+      printf("Failed to load: %s\n", upb_status_errmsg(&status));
+      exit(1);
+    }
+    upb_symtab_free(symtab);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK_TEMPLATE(BM_LoadDescriptor, false);
+BENCHMARK_TEMPLATE(BM_LoadDescriptor, true);
+
+static void BM_ParseDescriptor_FastTable(benchmark::State& state) {
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(buf, sizeof(buf), NULL);
+    google_protobuf_FileDescriptorProto* set =
+        google_protobuf_FileDescriptorProto_new(arena);
+    if (!upb_decode_ex(descriptor.data, descriptor.size, set,
+                       &google_protobuf_FileDescriptorProto_msginit, arena,
+                       UPB_DECODE_FASTTABLE | UPB_DECODE_ALIAS)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK(BM_ParseDescriptor_FastTable);
+
+static void BM_ParseDescriptor_CopyStrings(benchmark::State& state) {
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(buf, sizeof(buf), NULL);
+    if (!google_protobuf_FileDescriptorProto_parse_ex(
+            descriptor.data, descriptor.size, arena, 0)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK(BM_ParseDescriptor_CopyStrings);
+
+/* Reads only the file name and the names of the top-level messages. */
+static void BM_ParseDescriptor_Masked(benchmark::State& state) {
+  upb_arena* mask_arena = upb_arena_new();
+  upb_decmask* mask = upb_decmask_new(
+      &google_protobuf_FileDescriptorProto_msginit, mask_arena);
+  upb_decmask_add(mask, 1);
+  upb_decmask_add(upb_decmask_addsub(mask, 4, mask_arena), 1);
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(buf, sizeof(buf), NULL);
+    google_protobuf_FileDescriptorProto* file =
+        google_protobuf_FileDescriptorProto_new(arena);
+    if (!upb_decode_masked(descriptor.data, descriptor.size, file,
+                           &google_protobuf_FileDescriptorProto_msginit, mask,
+                           arena, UPB_DECODE_ALIAS)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  upb_arena_free(mask_arena);
+}
+BENCHMARK(BM_ParseDescriptor_Masked);
+
+/* A FileDescriptorSet holding |copies| copies of descriptor.proto,
+ * around the size of google_message2.dat at 16 copies. */
+static std::string DescriptorSet(int copies) {
+  std::string set;
+  for (int i = 0; i < copies; i++) {
+    size_t len = descriptor.size;
+    set.push_back(0x0a);  /* FileDescriptorSet.file, length-delimited. */
+    do {
+      set.push_back((len & 0x7f) | (len > 0x7f ? 0x80 : 0));
+      len >>= 7;
+    } while (len);
+    set.append(descriptor.data, descriptor.size);
+  }
+  return set;
+}
+
+template <bool kLargeBlocks>
+static void BM_ParseDescriptorSet(benchmark::State& state) {
+  std::string set = DescriptorSet(state.range(0));
+  upb_arena_options opts = {0, 0, 0};
+  if (kLargeBlocks) opts.max_block_size = 1 << 20;
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_initopts(NULL, 0, &upb_alloc_global, &opts);
+    if (!google_protobuf_FileDescriptorSet_parse(set.data(), set.size(),
+                                                 arena)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * set.size());
+}
+BENCHMARK_TEMPLATE(BM_ParseDescriptorSet, false)->Arg(16)->Arg(256);
+BENCHMARK_TEMPLATE(BM_ParseDescriptorSet, true)->Arg(16)->Arg(256);
+
+/* The same set fed to a upb_decstream in chunks of range(0) bytes. */
+static void BM_ParseDescriptorSet_Stream(benchmark::State& state) {
+  std::string set = DescriptorSet(16);
+  size_t chunk = state.range(0);
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_new();
+    google_protobuf_FileDescriptorSet* msg =
+        google_protobuf_FileDescriptorSet_new(arena);
+    upb_decstream* s = upb_decstream_new(
+        msg, &google_protobuf_FileDescriptorSet_msginit, arena, 0);
+    for (size_t i = 0; i < set.size(); i += chunk) {
+      upb_decstream_feed(s, set.data() + i, std::min(chunk, set.size() - i));
+    }
+    if (!upb_decstream_finish(s)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * set.size());
+}
+BENCHMARK(BM_ParseDescriptorSet_Stream)->Arg(1 << 12)->Arg(1 << 16);
+
+/* The handler-based decoder, re-encoding as it goes. */
+template <bool kAllowJit>
+static void BM_ParseDescriptor_PbDecoder(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  decoder_cache.set_allow_jit(kAllowJit);
+  const upb::Handlers* handlers = encoder_cache.Get(md);
+  upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+  std::string input(descriptor.data, descriptor.size);
+  std::string output;
+
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    output.clear();
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder =
+        upb::pb::EncoderPtr::Create(&arena, handlers, string_sink.input());
+    upb::pb::DecoderPtr decoder =
+        upb::pb::DecoderPtr::Create(&arena, method, encoder.input(), &status);
+    if (!upb::PutBuffer(input, decoder.input())) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK_TEMPLATE(BM_ParseDescriptor_PbDecoder, false);
+BENCHMARK_TEMPLATE(BM_ParseDescriptor_PbDecoder, true);
+
+/* descriptor.proto as JSON, from upb_json_encode(). */
+static std::string DescriptorJson(upb::MessageDefPtr md) {
+  upb_arena* arena = upb_arena_new();
+  upb_jsonenccache* cache = upb_jsonenccache_new(0);
+  google_protobuf_FileDescriptorProto* file =
+      google_protobuf_FileDescriptorProto_parse(descriptor.data,
+                                                descriptor.size, arena);
+  size_t size;
+  char* json = file ? upb_json_encode(
+                          file, md.ptr(),
+                          &google_protobuf_FileDescriptorProto_msginit, cache,
+                          arena, &size, NULL)
+                    : NULL;
+  if (!json) {
+    printf("Failed to serialize.\n");
+    exit(1);
+  }
+  std::string ret(json, size);
+  upb_jsonenccache_free(cache);
+  upb_arena_free(arena);
+  return ret;
+}
+
+/* The handler-based JSON parser, encoding binary as it goes. */
+static void BM_ParseDescriptorJson_Parser(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::json::CodeCache parser_cache;
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  const upb::Handlers* handlers = encoder_cache.Get(md);
+  upb::json::ParserMethodPtr method = parser_cache.Get(md);
+  std::string json = DescriptorJson(md);
+  std::string output;
+
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    output.clear();
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder =
+        upb::pb::EncoderPtr::Create(&arena, handlers, string_sink.input());
+    upb::json::ParserPtr parser = upb::json::ParserPtr::Create(
+        &arena, method, NULL, encoder.input(), &status, false);
+    if (!upb::PutBuffer(json, parser.input())) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK(BM_ParseDescriptorJson_Parser);
+
+static void BM_ParseDescriptorJson_Decode(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  upb_jsondeccache* cache = upb_jsondeccache_new();
+  std::string json = DescriptorJson(md);
+
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_new();
+    google_protobuf_FileDescriptorProto* file =
+        google_protobuf_FileDescriptorProto_new(arena);
+    if (!upb_json_decode(json.data(), json.size(), file, md.ptr(),
+                         &google_protobuf_FileDescriptorProto_msginit, cache,
+                         arena, 0, NULL)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+  upb_jsondeccache_free(cache);
+}
+BENCHMARK(BM_ParseDescriptorJson_Decode);
+
+template <int kOptions>
+static void BM_SerializeDescriptor(benchmark::State& state) {
+  upb_arena* arena = upb_arena_new();
+  google_protobuf_FileDescriptorProto* set =
+      google_protobuf_FileDescriptorProto_parse(descriptor.data,
+                                                descriptor.size, arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    upb_arena* enc_arena = upb_arena_init(buf, sizeof(buf), NULL);
+    size_t size;
+    if (!upb_encode_ex(set, &google_protobuf_FileDescriptorProto_msginit,
+                       enc_arena, kOptions, &size)) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    upb_arena_free(enc_arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  upb_arena_free(arena);
+}
+BENCHMARK_TEMPLATE(BM_SerializeDescriptor, 0);
+BENCHMARK_TEMPLATE(BM_SerializeDescriptor, UPB_ENCODE_FORWARD);
+
+/* A FileDescriptorProto of range(0) messages of 16 fields, each with options,
+ * where every message is allocated apart from the others and they are linked
+ * in a shuffled order, as in a message that was built up over time.  With
+ * enough of them, encoding is bound by cache misses. */
+template <int kOptions>
+static void BM_SerializeScattered(benchmark::State& state) {
+  const size_t kFields = 16;
+  size_t count = state.range(0);
+  upb_arena* arena = upb_arena_new();
+  std::vector<google_protobuf_DescriptorProto*> msgs;
+  std::vector<google_protobuf_FieldDescriptorProto*> fields;
+  std::vector<google_protobuf_FieldOptions*> options;
+  std::mt19937 rng(0);
+
+  for (size_t i = 0; i < count * kFields; i++) {
+    if (i % kFields == 0) {
+      msgs.push_back(google_protobuf_DescriptorProto_new(arena));
+      upb_arena_malloc(arena, 256);
+    }
+    fields.push_back(google_protobuf_FieldDescriptorProto_new(arena));
+    upb_arena_malloc(arena, 256);
+    options.push_back(google_protobuf_FieldOptions_new(arena));
+    upb_arena_malloc(arena, 256);
+  }
+  std::shuffle(msgs.begin(), msgs.end(), rng);
+  std::shuffle(fields.begin(), fields.end(), rng);
+  std::shuffle(options.begin(), options.end(), rng);
+
+  google_protobuf_FileDescriptorProto* file =
+      google_protobuf_FileDescriptorProto_new(arena);
+  google_protobuf_DescriptorProto** msg_array =
+      google_protobuf_FileDescriptorProto_resize_message_type(file, count,
+                                                              arena);
+  for (size_t i = 0; i < count; i++) {
+    google_protobuf_FieldDescriptorProto** field_array =
+        google_protobuf_DescriptorProto_resize_field(msgs[i], kFields, arena);
+    msg_array[i] = msgs[i];
+    google_protobuf_DescriptorProto_set_name(msgs[i],
+                                             upb_strview_makez("Message"));
+    for (size_t j = 0; j < kFields; j++) {
+      google_protobuf_FieldDescriptorProto* f = fields[i * kFields + j];
+      google_protobuf_FieldOptions* o = options[i * kFields + j];
+      field_array[j] = f;
+      google_protobuf_FieldDescriptorProto_set_name(f,
+                                                    upb_strview_makez("field"));
+      google_protobuf_FieldDescriptorProto_set_number(f, j + 1);
+      google_protobuf_FieldDescriptorProto_set_type(f, 5);
+      google_protobuf_FieldOptions_set_packed(o, true);
+      google_protobuf_FieldDescriptorProto_set_options(f, o);
+    }
+  }
+
+  size_t size = 0;
+  for (auto _ : state) {
+    upb_arena* enc_arena = upb_arena_new();
+    if (!upb_encode_ex(file, &google_protobuf_FileDescriptorProto_msginit,
+                       enc_arena, kOptions, &size)) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    upb_arena_free(enc_arena);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  upb_arena_free(arena);
+}
+BENCHMARK_TEMPLATE(BM_SerializeScattered, 0)->Arg(64)->Arg(1 << 14);
+BENCHMARK_TEMPLATE(BM_SerializeScattered, UPB_ENCODE_FORWARD)
+    ->Arg(64)->Arg(1 << 14);
+
+static void BM_EncodedSize(benchmark::State& state) {
+  upb_arena* arena = upb_arena_new();
+  google_protobuf_FileDescriptorProto* set =
+      google_protobuf_FileDescriptorProto_parse(descriptor.data,
+                                                descriptor.size, arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        upb_encoded_size(set, &google_protobuf_FileDescriptorProto_msginit));
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  upb_arena_free(arena);
+}
+BENCHMARK(BM_EncodedSize);
+
+/* Copying a parsed descriptor.proto, compared with an encode and decode. */
+template <bool kCopy>
+static void BM_CopyDescriptor(benchmark::State& state) {
+  const upb_msglayout* l = &google_protobuf_FileDescriptorProto_msginit;
+  upb_arena* arena = upb_arena_new();
+  google_protobuf_FileDescriptorProto* set =
+      google_protobuf_FileDescriptorProto_parse(descriptor.data,
+                                                descriptor.size, arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    upb_arena* copy_arena = upb_arena_init(buf, sizeof(buf), NULL);
+    bool ok;
+    if (kCopy) {
+      ok = upb_msg_copy(set, l, copy_arena, 0) != NULL;
+    } else {
+      size_t size;
+      char* data = upb_encode(set, l, copy_arena, &size);
+      ok = data && google_protobuf_FileDescriptorProto_parse_ex(
+                       data, size, copy_arena, 0);
+    }
+    if (!ok) {
+      printf("Failed to copy.\n");
+      exit(1);
+    }
+    upb_arena_free(copy_arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  upb_arena_free(arena);
+}
+BENCHMARK_TEMPLATE(BM_CopyDescriptor, true);
+BENCHMARK_TEMPLATE(BM_CopyDescriptor, false);
+
+static void BM_DecodeVarint(benchmark::State& state) {
+  /* Varints of 1 to 10 bytes, the way they are spread in real data: mostly
+   * short ones. */
+  static const uint64_t vals[] = {1, 150, 3, 1 << 20, 27, 1ULL << 35, 5, 300,
+                                  UINT64_MAX, 42};
+  char varints[sizeof(vals) / sizeof(vals[0]) * 10];
+  char *end = varints;
+  for (uint64_t val : vals) {
+    do {
+      *end++ = (val & 0x7f) | (val > 0x7f ? 0x80 : 0);
+      val >>= 7;
+    } while (val);
+  }
+  for (auto _ : state) {
+    const char *p = varints;
+    uint64_t sum = 0;
+    while (p < end) {
+      uint64_t val;
+      p = _upb_vdecode(p, end, &val);
+      sum += val;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * (end - varints));
+}
+BENCHMARK(BM_DecodeVarint);
+
+/* Benchmarks over the messages in google_messages.proto ******************/
+
+/* Counts the calls that allocate, so benchmarks can report allocations per
+ * iteration next to their speed. */
+static size_t allocs = 0;
+
+static void* CountingAlloc(upb_alloc* alloc, void* ptr, size_t oldsize,
+                           size_t size) {
+  (void)alloc;
+  if (size) allocs++;
+  return upb_alloc_global.func(&upb_alloc_global, ptr, oldsize, size);
+}
+
+static upb_alloc counting_alloc = {&CountingAlloc};
+
+static void ReportAllocs(benchmark::State& state, size_t start) {
+  state.counters["allocs"] = benchmark::Counter(
+      allocs - start, benchmark::Counter::kAvgIterations);
+}
+
+static std::string ReadFile(const char* filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::stringstream data;
+  if (!file) {
+    printf("Failed to read %s.\n", filename);
+    exit(1);
+  }
+  data << file.rdbuf();
+  return data.str();
+}
+
+/* The two benchmark messages of the protobuf repo: a small one with mostly
+ * scalar fields, and a large one dominated by a repeated group. */
+struct GoogleMessage1 {
+  static const char* file() { return "tests/google_message1.dat"; }
+  static const upb_msglayout* layout() {
+    return &benchmarks_SpeedMessage1_msginit;
+  }
+  static upb::MessageDefPtr msgdef(upb::SymbolTable* symtab) {
+    return upb::MessageDefPtr(
+        benchmarks_SpeedMessage1_getmsgdef(symtab->ptr()));
+  }
+};
+
+struct GoogleMessage2 {
+  static const char* file() { return "tests/google_message2.dat"; }
+  static const upb_msglayout* layout() {
+    return &benchmarks_SpeedMessage2_msginit;
+  }
+  static upb::MessageDefPtr msgdef(upb::SymbolTable* symtab) {
+    return upb::MessageDefPtr(
+        benchmarks_SpeedMessage2_getmsgdef(symtab->ptr()));
+  }
+};
+
+template <class T>
+static void BM_Parse(benchmark::State& state) {
+  std::string input = ReadFile(T::file());
+  size_t start = allocs;
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(NULL, 0, &counting_alloc);
+    upb_msg* msg = upb_msg_new(T::layout(), arena);
+    if (!upb_decode(input.data(), input.size(), msg, T::layout(), arena)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  ReportAllocs(state, start);
+}
+BENCHMARK_TEMPLATE(BM_Parse, GoogleMessage1);
+BENCHMARK_TEMPLATE(BM_Parse, GoogleMessage2);
+
+template <class T>
+static void BM_Serialize(benchmark::State& state) {
+  std::string input = ReadFile(T::file());
+  upb_arena* arena = upb_arena_new();
+  upb_msg* msg = upb_msg_new(T::layout(), arena);
+  size_t size = 0;
+  if (!upb_decode(input.data(), input.size(), msg, T::layout(), arena)) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  size_t start = allocs;
+  for (auto _ : state) {
+    upb_arena* enc_arena = upb_arena_init(NULL, 0, &counting_alloc);
+    if (!upb_encode(msg, T::layout(), enc_arena, &size)) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    upb_arena_free(enc_arena);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  ReportAllocs(state, start);
+  upb_arena_free(arena);
+}
+BENCHMARK_TEMPLATE(BM_Serialize, GoogleMessage1);
+BENCHMARK_TEMPLATE(BM_Serialize, GoogleMessage2);
+
+/* Registers no handlers, so the decoder only has to skip over the input. */
+static void NoHandlers(const void* closure, upb_handlers* h) {
+  (void)closure;
+  (void)h;
+}
+
+/* The handler-based decoder into handlers that do nothing, or re-encoding.
+ * The first measures the bytecode VM by itself. */
+template <class T, bool kEncode>
+static void BM_PbDecoder(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::HandlerCache handler_cache =
+      kEncode ? upb::pb::EncoderPtr::NewCache()
+              : upb::HandlerCache(&NoHandlers, NULL);
+  upb::pb::CodeCache decoder_cache(&handler_cache);
+  upb::MessageDefPtr md = T::msgdef(&symtab);
+  const upb::Handlers* handlers = handler_cache.Get(md);
+  upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+  std::string input = ReadFile(T::file());
+  std::string output;
+  int closure;
+
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb::Sink sink(handlers, &closure);
+    output.clear();
+    upb::StringSink string_sink(&output);
+    if (kEncode) {
+      sink = upb::pb::EncoderPtr::Create(&arena, handlers, string_sink.input())
+                 .input();
+    }
+    upb::pb::DecoderPtr decoder =
+        upb::pb::DecoderPtr::Create(&arena, method, sink, &status);
+    if (!upb::PutBuffer(input, decoder.input())) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK_TEMPLATE(BM_PbDecoder, GoogleMessage1, false);
+BENCHMARK_TEMPLATE(BM_PbDecoder, GoogleMessage1, true);
+BENCHMARK_TEMPLATE(BM_PbDecoder, GoogleMessage2, false);
+BENCHMARK_TEMPLATE(BM_PbDecoder, GoogleMessage2, true);
+
+/* Binary input printed as JSON or as text format, through upb_pbdecoder.
+ * Reports the speed in input bytes. */
+template <class T, bool kJson>
+static void BM_Print(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::HandlerCache printer_cache =
+      kJson ? upb::json::PrinterPtr::NewCache(false)
+            : upb::pb::TextPrinterPtr::NewCache();
+  upb::pb::CodeCache decoder_cache(&printer_cache);
+  upb::MessageDefPtr md = T::msgdef(&symtab);
+  const upb::Handlers* handlers = printer_cache.Get(md);
+  upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+  std::string input = ReadFile(T::file());
+  std::string output;
+
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    output.clear();
+    upb::StringSink string_sink(&output);
+    upb::Sink sink =
+        kJson ? upb::json::PrinterPtr::Create(&arena, handlers,
+                                              string_sink.input())
+                    .input()
+              : upb::Sink(upb_textprinter_input(upb_textprinter_create(
+                    arena.ptr(), handlers, string_sink.input().sink())));
+    upb::pb::DecoderPtr decoder =
+        upb::pb::DecoderPtr::Create(&arena, method, sink, &status);
+    if (!upb::PutBuffer(input, decoder.input())) {
+      printf("Failed to print.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK_TEMPLATE(BM_Print, GoogleMessage1, true);
+BENCHMARK_TEMPLATE(BM_Print, GoogleMessage1, false);
+BENCHMARK_TEMPLATE(BM_Print, GoogleMessage2, true);
+BENCHMARK_TEMPLATE(BM_Print, GoogleMessage2, false);
+
+/* The same JSON from upb_json_transcode(), or with kDecode from upb_decode()
+ * followed by upb_json_encode(). */
+template <class T, bool kDecode>
+static void BM_TranscodeJson(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md = T::msgdef(&symtab);
+  upb_jsonenccache* cache = upb_jsonenccache_new(0);
+  std::string input = ReadFile(T::file());
+  size_t start = allocs;
+
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(NULL, 0, &counting_alloc);
+    size_t size;
+    char* json;
+    if (kDecode) {
+      upb_msg* msg = upb_msg_new(T::layout(), arena);
+      json = upb_decode(input.data(), input.size(), msg, T::layout(), arena)
+                 ? upb_json_encode(msg, md.ptr(), T::layout(), cache, arena,
+                                   &size, NULL)
+                 : NULL;
+    } else {
+      json = upb_json_transcode(input.data(), input.size(), md.ptr(),
+                                T::layout(), cache, arena, &size, NULL);
+    }
+    if (!json) {
+      printf("Failed to print.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  ReportAllocs(state, start);
+  upb_jsonenccache_free(cache);
+}
+BENCHMARK_TEMPLATE(BM_TranscodeJson, GoogleMessage1, false);
+BENCHMARK_TEMPLATE(BM_TranscodeJson, GoogleMessage1, true);
+BENCHMARK_TEMPLATE(BM_TranscodeJson, GoogleMessage2, false);
+BENCHMARK_TEMPLATE(BM_TranscodeJson, GoogleMessage2, true);
+
+/* descriptor.proto in text format, which is mostly strings. */
+static void BM_PrintDescriptorText(benchmark::State& state) {
+  upb::SymbolTable symtab;
+  upb::HandlerCache printer_cache(upb::pb::TextPrinterPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&printer_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  const upb::Handlers* handlers = printer_cache.Get(md);
+  upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+  std::string input(descriptor.data, descriptor.size);
+  std::string output;
+
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    output.clear();
+    upb::StringSink string_sink(&output);
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, method,
+        upb_textprinter_input(upb_textprinter_create(
+            arena.ptr(), handlers, string_sink.input().sink())),
+        &status);
+    if (!upb::PutBuffer(input, decoder.input())) {
+      printf("Failed to print.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_PrintDescriptorText);
+
+/* Builds a symtab holding descriptor.proto and google_messages.proto. */
+static void BM_LoadGoogleMessages(benchmark::State& state) {
+  for (auto _ : state) {
+    upb_symtab* symtab = upb_symtab_new();
+    if (!google_protobuf_FileDescriptorProto_getmsgdef(symtab) ||
+        !benchmarks_SpeedMessage2_getmsgdef(symtab)) {
+      printf("Failed to load.\n");
+      exit(1);
+    }
+    upb_symtab_free(symtab);
+  }
+  size_t bytes =
+      descriptor.size + tests_google_messages_proto_upbdefinit.descriptor.size;
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_LoadGoogleMessages);
+
+/* Other building blocks ***************************************************/
+
+/* Allocates 1MB in pieces of range(0) bytes, from an arena with no initial
+ * block, to show how the arena grows. */
+static void BM_ArenaAlloc(benchmark::State& state) {
+  size_t size = state.range(0);
+  size_t start = allocs;
+  for (auto _ : state) {
+    upb_arena* arena = upb_arena_init(NULL, 0, &counting_alloc);
+    for (size_t i = 0; i < (1 << 20) / size; i++) {
+      benchmark::DoNotOptimize(upb_arena_malloc(arena, size));
+    }
+    upb_arena_free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * (1 << 20));
+  ReportAllocs(state, start);
+}
+BENCHMARK(BM_ArenaAlloc)->Arg(16)->Arg(256)->Arg(4096);
+
+/* Looks up each of range(0) field-like names in a upb_strtable. */
+static void BM_StrtableLookup(benchmark::State& state) {
+  std::vector<std::string> keys;
+  upb_strtable table;
+  upb_strtable_init(&table, UPB_CTYPE_INT32);
+  for (int i = 0; i < state.range(0); i++) {
+    keys.push_back("optional_field_" + std::to_string(i));
+    upb_strtable_insert2(&table, keys.back().data(), keys.back().size(),
+                         upb_value_int32(i));
+  }
+  for (auto _ : state) {
+    for (const std::string& key : keys) {
+      upb_value val;
+      if (!upb_strtable_lookup2(&table, key.data(), key.size(), &val)) {
+        printf("Failed to look up.\n");
+        exit(1);
+      }
+      benchmark::DoNotOptimize(val);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  upb_strtable_uninit(&table);
+}
+BENCHMARK(BM_StrtableLookup)->Arg(16)->Arg(1024);
@@ -0,0 +1,252 @@
+/*
+** Parses and serializes the same inputs with upb and with protobuf C++, to
+** compare the two.  Every benchmark reports its throughput and the peak
+** number of bytes it had allocated at once during an iteration.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstddef>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <benchmark/benchmark.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/descriptor.pb.h>
+#include "google/protobuf/descriptor.upb.h"
+#include "google/protobuf/descriptor.upbdefs.h"
+#include "tests/google_messages.pb.h"
+#include "tests/google_messages.upb.h"
+
+/* Memory accounting *********************************************************/
+
+/* upb's arenas and protobuf's allocations (operator new, which its arenas also
+ * use for their blocks) both go through TrackedMalloc(), which keeps each
+ * block's size in front of it. */
+static size_t allocated = 0;
+static size_t peak = 0;
+
+static const size_t kHeader = alignof(std::max_align_t);
+
+static void* TrackedMalloc(size_t size) {
+  char* p = static_cast<char*>(malloc(size + kHeader));
+  if (!p) return NULL;
+  *reinterpret_cast<size_t*>(p) = size;
+  allocated += size;
+  if (allocated > peak) peak = allocated;
+  return p + kHeader;
+}
+
+static void TrackedFree(void* ptr) {
+  char* p;
+  if (!ptr) return;
+  p = static_cast<char*>(ptr) - kHeader;
+  allocated -= *reinterpret_cast<size_t*>(p);
+  free(p);
+}
+
+void* operator new(size_t size) {
+  void* p = TrackedMalloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* ptr) noexcept { TrackedFree(ptr); }
+
+static void* TrackedAlloc(upb_alloc* alloc, void* ptr, size_t oldsize,
+                          size_t size) {
+  void* ret;
+  (void)alloc;
+  if (size == 0) {
+    TrackedFree(ptr);
+    return NULL;
+  }
+  ret = TrackedMalloc(size);
+  if (ret && ptr) {
+    memcpy(ret, ptr, oldsize < size ? oldsize : size);
+    TrackedFree(ptr);
+  }
+  return ret;
+}
+
+static upb_alloc tracked_alloc = {&TrackedAlloc};
+
+/* Measures the peak allocation of each iteration between Start() and Stop(),
+ * and reports the largest. */
+class PeakMemory {
+ public:
+  PeakMemory() : max_(0) {}
+  void Start() {
+    base_ = allocated;
+    peak = allocated;
+  }
+  void Stop() {
+    if (peak - base_ > max_) max_ = peak - base_;
+  }
+  void Report(benchmark::State& state) {
+    state.counters["peak_bytes"] = max_;
+  }
+
+ private:
+  size_t base_;
+  size_t max_;
+};
+
+/* Inputs ********************************************************************/
+
+static std::string ReadFile(const char* filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::stringstream data;
+  if (!file) {
+    printf("Failed to read %s.\n", filename);
+    exit(1);
+  }
+  data << file.rdbuf();
+  return data.str();
+}
+
+struct GoogleMessage1 {
+  typedef benchmarks::SpeedMessage1 Proto2;
+  static std::string input() {
+    return ReadFile("tests/google_message1.dat");
+  }
+  static const upb_msglayout* layout() {
+    return &benchmarks_SpeedMessage1_msginit;
+  }
+};
+
+struct GoogleMessage2 {
+  typedef benchmarks::SpeedMessage2 Proto2;
+  static std::string input() {
+    return ReadFile("tests/google_message2.dat");
+  }
+  static const upb_msglayout* layout() {
+    return &benchmarks_SpeedMessage2_msginit;
+  }
+};
+
+struct Descriptor {
+  typedef google::protobuf::FileDescriptorProto Proto2;
+  static std::string input() {
+    upb_strview data = google_protobuf_descriptor_proto_upbdefinit.descriptor;
+    return std::string(data.data, data.size);
+  }
+  static const upb_msglayout* layout() {
+    return &google_protobuf_FileDescriptorProto_msginit;
+  }
+};
+
+/* Parsing *******************************************************************/
+
+template <class T>
+static void BM_Parse_Upb(benchmark::State& state) {
+  std::string input = T::input();
+  PeakMemory mem;
+  for (auto _ : state) {
+    mem.Start();
+    upb_arena* arena = upb_arena_init(NULL, 0, &tracked_alloc);
+    upb_msg* msg = upb_msg_new(T::layout(), arena);
+    if (!upb_decode(input.data(), input.size(), msg, T::layout(), arena)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_arena_free(arena);
+    mem.Stop();
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  mem.Report(state);
+}
+BENCHMARK_TEMPLATE(BM_Parse_Upb, GoogleMessage1);
+BENCHMARK_TEMPLATE(BM_Parse_Upb, GoogleMessage2);
+BENCHMARK_TEMPLATE(BM_Parse_Upb, Descriptor);
+
+template <class T, bool kArena>
+static void BM_Parse_Proto2(benchmark::State& state) {
+  std::string input = T::input();
+  PeakMemory mem;
+  for (auto _ : state) {
+    mem.Start();
+    bool ok;
+    if (kArena) {
+      google::protobuf::Arena arena;
+      typename T::Proto2* msg =
+          google::protobuf::Arena::CreateMessage<typename T::Proto2>(&arena);
+      ok = msg->ParseFromString(input);
+    } else {
+      typename T::Proto2 msg;
+      ok = msg.ParseFromString(input);
+    }
+    if (!ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    mem.Stop();
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  mem.Report(state);
+}
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, GoogleMessage1, false);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, GoogleMessage1, true);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, GoogleMessage2, false);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, GoogleMessage2, true);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, Descriptor, false);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, Descriptor, true);
+
+/* Serializing ***************************************************************/
+
+template <class T>
+static void BM_Serialize_Upb(benchmark::State& state) {
+  std::string input = T::input();
+  upb_arena* arena = upb_arena_new();
+  upb_msg* msg = upb_msg_new(T::layout(), arena);
+  size_t size = 0;
+  PeakMemory mem;
+  if (!upb_decode(input.data(), input.size(), msg, T::layout(), arena)) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    mem.Start();
+    upb_arena* enc_arena = upb_arena_init(NULL, 0, &tracked_alloc);
+    if (!upb_encode(msg, T::layout(), enc_arena, &size)) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    upb_arena_free(enc_arena);
+    mem.Stop();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  mem.Report(state);
+  upb_arena_free(arena);
+}
+BENCHMARK_TEMPLATE(BM_Serialize_Upb, GoogleMessage1);
+BENCHMARK_TEMPLATE(BM_Serialize_Upb, GoogleMessage2);
+BENCHMARK_TEMPLATE(BM_Serialize_Upb, Descriptor);
+
+template <class T>
+static void BM_Serialize_Proto2(benchmark::State& state) {
+  typename T::Proto2 msg;
+  std::string output;
+  PeakMemory mem;
+  if (!msg.ParseFromString(T::input())) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    mem.Start();
+    output.clear();
+    output.shrink_to_fit();
+    if (!msg.SerializeToString(&output)) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    mem.Stop();
+  }
+  state.SetBytesProcessed(state.iterations() * output.size());
+  mem.Report(state);
+}
+BENCHMARK_TEMPLATE(BM_Serialize_Proto2, GoogleMessage1);
+BENCHMARK_TEMPLATE(BM_Serialize_Proto2, GoogleMessage2);
+BENCHMARK_TEMPLATE(BM_Serialize_Proto2, Descriptor);
@@ -471,6 +471,40 @@ function test_numeric_array()
   test_for_numeric_type(upb.TYPE_DOUBLE, 10^101)
 end
 
+function test_array_bulk()
+  local array = upb.Array(upb.TYPE_INT32)
+  assert_equal(array, upb.fromtable(array, {1, 2, 3}))
+  assert_equal(3, #array)
+  assert_equal(2, array[2])
+
+  upb.fromtable(array, {4, 5})
+  assert_equal(5, #array)
+  assert_equal(5, array[5])
+
+  local t = upb.toarray(array)
+  assert_equal(5, #t)
+  for i = 1, 5 do
+    assert_equal(i, t[i])
+  end
+  assert_equal(0, #upb.toarray(upb.Array(upb.TYPE_DOUBLE)))
+
+  -- Elements are checked like in array[i] = val.
+  assert_error_match("not an integer or out of range",
+                     function() upb.fromtable(array, {6, 2^31}) end)
+  assert_equal(6, #array)
+  assert_error_match("number expected",
+                     function() upb.fromtable(array, {"abc"}) end)
+
+  -- Only numeric and bool arrays.
+  local strings = upb.Array(upb.TYPE_STRING)
+  assert_error_match("numeric or bool",
+                     function() upb.fromtable(strings, {"abc"}) end)
+  assert_error_match("numeric or bool", function() upb.toarray(strings) end)
+
+  local bools = upb.fromtable(upb.Array(upb.TYPE_BOOL), {true, false})
+  assert_equal(false, upb.toarray(bools)[2])
+end
+
 function test_string_array()
   local function test_for_string_type(upb_type)
     local array = upb.Array(upb_type)
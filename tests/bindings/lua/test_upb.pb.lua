@@ -72,6 +72,39 @@ function test_parse_string()
   -- assert_equal("Hello", msg.str)
 end
 
+function test_decode_msgclass()
+  local msg = pb.decode(TestMessage, "\008\005\056\001")
+  assert_equal(5, msg.i32)
+  assert_equal(true, msg.bool)
+
+  -- Decoding into an existing message merges.
+  assert_equal(msg, pb.decode(msg, "\016\007"))
+  assert_equal(5, msg.i32)
+  assert_equal(7, msg.u32)
+
+  local aliased = pb.decode(TestMessage, pb.encode(msg), {alias = true})
+  assert_equal(5, aliased.i32)
+  assert_equal(7, aliased.u32)
+
+  local discarded = pb.decode(TestMessage, "\008\005\160\006\001",
+                              {discard_unknown = true})
+  assert_equal("\008\005", pb.encode(discarded))
+
+  assert_error_match("Error decoding", function()
+    pb.decode(TestMessage, "\008")
+  end)
+end
+
+function test_encode_reuse()
+  local msg = TestMessage()
+  msg.i32 = 1
+  -- Results are copied out before the scratch arena is reused.
+  local first = pb.encode(msg)
+  msg.i32 = 2
+  local second = pb.encode(msg, {deterministic = true})
+  assert_equal("\008\001", first)
+  assert_equal("\008\002", second)
+end
 
 local stats = lunit.main()
 
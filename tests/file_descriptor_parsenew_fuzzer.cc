@@ -1,12 +1,54 @@
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 
 #include "google/protobuf/descriptor.upb.h"
+#include "upb/decode.h"
 #include "upb/upb.h"
 
+/* Inputs shorter than this are dominated by fixed costs, so their time per
+ * byte says little. */
+static const size_t kMinTimedSize = 64;
+
+/* The worst decode time per input byte seen so far, which is printed whenever
+ * it grows: a parse that is slow for its size is a latency bug even if it
+ * doesn't crash. */
+static double worst_ns_per_byte = 0;
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
-  upb::Arena arena;
-  google_protobuf_FileDescriptorProto_parse(reinterpret_cast<const char*>(data),
-                                            size, arena.ptr());
+  const char* buf = reinterpret_cast<const char*>(data);
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  {
+    upb::Arena arena;
+    google_protobuf_FileDescriptorProto_parse(buf, size, arena.ptr());
+  }
+
+  if (size >= kMinTimedSize) {
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start).count();
+    if (ns / size > worst_ns_per_byte) {
+      worst_ns_per_byte = ns / size;
+      fprintf(stderr, "new worst: %.1f ns/byte (%zu bytes)\n",
+              worst_ns_per_byte, size);
+    }
+  }
+
+  /* The same input again, within budgets proportional to its size. */
+  {
+    upb::Arena arena;
+    upb_declimits limits;
+    upb_msg* msg =
+        upb_msg_new(&google_protobuf_FileDescriptorProto_msginit, arena.ptr());
+    limits.max_arena_bytes = 16 * size + 4096;
+    limits.max_elements = size;
+    limits.max_unknown_bytes = size / 2;
+    upb_decode_limited(buf, size, msg,
+                       &google_protobuf_FileDescriptorProto_msginit, &limits,
+                       arena.ptr(), 0);
+  }
+
   return 0;
 }
 
@@ -7,9 +7,19 @@
 #include "tests/json/test.upb.h"   // Test that it compiles for C++.
 #include "tests/test_util.h"
 #include "tests/upb_test.h"
+#include "google/protobuf/descriptor.upb.h"
+#include "upb/bindings/stdc++/string.h"
+#include "upb/decode.h"
+#include "upb/encode.h"
 #include "upb/handlers.h"
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/json/escape.int.h"
 #include "upb/json/parser.h"
 #include "upb/json/printer.h"
+#include "upb/msgfactory.h"
+#include "upb/pb/decoder.h"
+#include "upb/pb/encoder.h"
 #include "upb/upb.h"
 
 #include <string>
@@ -56,6 +66,12 @@ static TestCase kTestRoundtripMessages[] = {
          "\"\uFFFF\"]}"),
     EXPECT_SAME
   },
+  // Escapes on either side of a 16-byte boundary, and in a long run.
+  {
+    TEST("{\"optionalString\":\"0123456789abcdefghijklm\\\"nopqrstuvwxyz"
+         "0123456789ABCDEFGHIJ\\\\\\u001fKLMNOPQRSTUVWXYZ!\\u0000\"}"),
+    EXPECT_SAME
+  },
   // Test enum symbolic names.
   {
     // The common case: parse and print the symbolic name.
@@ -191,7 +207,8 @@ void test_json_roundtrip_message(const char* json_src,
   ASSERT(ok);
   ASSERT(env.CheckConsistency());
 
-  if (memcmp(json_expected,
+  if (data_sink.Data().size() != strlen(json_expected) ||
+      memcmp(json_expected,
              data_sink.Data().data(),
              data_sink.Data().size())) {
     fprintf(stderr,
@@ -246,11 +263,700 @@ void test_json_roundtrip() {
   }
 }
 
+// Prints more than the printer buffers at once, with escapes spread through.
+void test_json_long_string() {
+  upb::SymbolTable symtab;
+  upb::HandlerCache serialize_handlercache(
+      upb::json::PrinterPtr::NewCache(false));
+  upb::json::CodeCache parse_codecache;
+
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb::Handlers* serialize_handlers = serialize_handlercache.Get(md);
+  const upb::json::ParserMethodPtr parser_method = parse_codecache.Get(md);
+
+  // |raw| has the control characters unescaped, which the parser accepts.
+  // They end its scan of a run of string text without ending the string.
+  std::string json("{\"repeatedString\":[");
+  std::string raw(json);
+  for (int i = 0; i < 100; i++) {
+    std::string text = std::string(i * 7, 'a' + i % 26);
+    if (i > 0) json += ",";
+    if (i > 0) raw += ",";
+    json += "\"" + text;
+    raw += "\"" + text;
+    json += (i % 3 == 0) ? "\\n" : (i % 3 == 1) ? "\\u0002" : "\\\"";
+    raw += (i % 3 == 0) ? "\\n" : (i % 3 == 1) ? "\x02" : "\\\"";
+    json += text + "\"";
+    raw += text + "\"";
+  }
+  json += "]}";
+  raw += "]}";
+  ASSERT(json.size() > 4096 * 4);
+
+  const size_t seams[] = {0, 1, 4095, 4096, 4097, json.size() / 2};
+  for (size_t i = 0; i < sizeof(seams) / sizeof(seams[0]); i++) {
+    test_json_roundtrip_message(json.c_str(), json.c_str(), serialize_handlers,
+                                parser_method, seams[i]);
+    test_json_roundtrip_message(raw.c_str(), json.c_str(), serialize_handlers,
+                                parser_method, seams[i]);
+  }
+}
+
+static std::string JsonEncode(const upb_msg *msg, upb::MessageDefPtr md,
+                              const upb_msglayout *layout,
+                              upb_jsonenccache *cache, bool *ok) {
+  upb::Arena arena;
+  upb::Status status;
+  size_t size;
+  char *json = upb_json_encode(msg, md.ptr(), layout, cache, arena.ptr(),
+                               &size, status.ptr());
+  *ok = json != NULL;
+  ASSERT(*ok != !status.ok());
+  return *ok ? std::string(json, size) : std::string();
+}
+
+static std::string JsonTranscode(const std::string& pb, upb::MessageDefPtr md,
+                                 const upb_msglayout *layout,
+                                 upb_jsonenccache *cache, bool *ok) {
+  upb::Arena arena;
+  upb::Status status;
+  size_t size;
+  char *json = upb_json_transcode(pb.data(), pb.size(), md.ptr(), layout,
+                                  cache, arena.ptr(), &size, status.ptr());
+  *ok = json != NULL;
+  ASSERT(*ok != !status.ok());
+  return *ok ? std::string(json, size) : std::string();
+}
+
+// upb_json_encode() gives the same JSON as the printer does, when the printer
+// gets the fields in the order upb_encode() writes them.
+void test_json_encode_cases(const TestCase* test_cases, bool preserve) {
+  upb::SymbolTable symtab;
+  upb::json::CodeCache parse_codecache;
+  upb::HandlerCache pb_handlercache(upb::pb::EncoderPtr::NewCache());
+  upb::HandlerCache print_handlercache(
+      upb::json::PrinterPtr::NewCache(preserve));
+  upb::pb::CodeCache pb_codecache(&print_handlercache);
+  upb_jsonenccache *cache =
+      upb_jsonenccache_new(preserve ? UPB_JSONENC_PROTONAMES : 0);
+  ASSERT(cache);
+
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb_msglayout *layout = &upb_test_json_TestMessage_msginit;
+
+  for (const TestCase* test_case = test_cases; test_case->input != NULL;
+       test_case++) {
+    upb::Arena arena;
+    upb::Status status;
+
+    // JSON -> binary.
+    std::string pb;
+    upb::StringSink pb_sink(&pb);
+    upb::pb::EncoderPtr pb_encoder = upb::pb::EncoderPtr::Create(
+        &arena, pb_handlercache.Get(md), pb_sink.input());
+    upb::json::ParserPtr parser = upb::json::ParserPtr::Create(
+        &arena, parse_codecache.Get(md), NULL, pb_encoder.input(),
+        &status, false);
+    ASSERT(upb::PutBuffer(std::string(test_case->input), parser.input()));
+
+    upb_msg *msg = upb_msg_new(layout, arena.ptr());
+    ASSERT(upb_decode(pb.data(), pb.size(), msg, layout, arena.ptr()));
+
+    // upb_msg -> binary -> printer.
+    size_t size;
+    char *encoded = upb_encode(msg, layout, arena.ptr(), &size);
+    ASSERT(encoded);
+    std::string printed;
+    upb::StringSink print_sink(&printed);
+    upb::json::PrinterPtr printer = upb::json::PrinterPtr::Create(
+        &arena, print_handlercache.Get(md), print_sink.input());
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, pb_codecache.Get(md), printer.input(), &status);
+    ASSERT(upb::PutBuffer(std::string(encoded, size), decoder.input()));
+
+    bool ok;
+    std::string json = JsonEncode(msg, md, layout, cache, &ok);
+    ASSERT(ok);
+    if (json != printed) {
+      fprintf(stderr,
+              "upb_json_encode() result differs from the printer's:\n"
+              "Printer:\n%s\nupb_json_encode():\n%s\n",
+              printed.c_str(), json.c_str());
+      abort();
+    }
+
+    // So does upb_json_transcode() from the binary form.
+    std::string transcoded =
+        JsonTranscode(std::string(encoded, size), md, layout, cache, &ok);
+    ASSERT(ok);
+    if (transcoded != json) {
+      fprintf(stderr,
+              "upb_json_transcode() result differs from upb_json_encode():\n"
+              "upb_json_encode():\n%s\nupb_json_transcode():\n%s\n",
+              json.c_str(), transcoded.c_str());
+      abort();
+    }
+  }
+
+  upb_jsonenccache_free(cache);
+}
+
+// Input that isn't in field number order, and broken input.  Each expected
+// result is the same as upb_json_encode() of the upb_decode()d message.
+struct TranscodeCase {
+  std::string pb;
+  const char *expected;  // NULL if the input can't be parsed.
+};
+
+#define PB(lit) std::string(lit, sizeof(lit) - 1)
+
+void test_json_transcode() {
+  const TranscodeCase cases[] = {
+    // Fields out of order.
+    {PB("\x10\x02\x08\x01"), "{\"optionalInt32\":1,\"optionalInt64\":\"2\"}"},
+    // A field that comes twice, and two members of a oneof.
+    {PB("\x08\x01\x08\x02"), "{\"optionalInt32\":2}"},
+    {PB("\xd0\x01\x01\xd8\x01\x02"), "{\"oneofInt64\":\"2\"}"},
+    // A repeated field on both sides of another field.
+    {PB("\x58\x01\x08\x05\x58\x02"),
+     "{\"optionalInt32\":5,\"repeatedInt32\":[1,2]}"},
+    // Packed and unpacked values of one field, in a row.
+    {PB("\x5a\x03\x01\x02\x03\x58\x04"), "{\"repeatedInt32\":[1,2,3,4]}"},
+    // A submessage in two parts, which are merged.
+    {PB("\x42\x02\x08\x01\x42\x00"), "{\"optionalMsg\":{\"foo\":1}}"},
+    // A zero without presence, an empty packed field and an unknown field.
+    {PB("\x08\x00\x5a\x00\xa0\x06\x01"), "{}"},
+    // A map entry without a value.
+    {PB("\xca\x01\x03\x0a\x01k"), "{\"mapStringMsg\":{\"k\":{}}}"},
+    // Truncated.
+    {PB("\x08"), NULL},
+    {PB("\x42\x05\x08"), NULL},
+  };
+
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb_msglayout *layout = &upb_test_json_TestMessage_msginit;
+  upb_jsonenccache *cache = upb_jsonenccache_new(0);
+  ASSERT(cache);
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    bool ok;
+    std::string json = JsonTranscode(cases[i].pb, md, layout, cache, &ok);
+    if (cases[i].expected) {
+      ASSERT(ok);
+      if (json != cases[i].expected) {
+        fprintf(stderr, "upb_json_transcode(): expected %s, got %s\n",
+                cases[i].expected, json.c_str());
+        abort();
+      }
+    } else {
+      ASSERT(!ok);
+    }
+  }
+
+  upb_jsonenccache_free(cache);
+}
+
+#undef PB
+
+void test_json_encode() {
+  test_json_encode_cases(kTestRoundtripMessages, false);
+  test_json_encode_cases(kTestRoundtripMessagesPreserve, true);
+}
+
+// Well-known types, with defs built at runtime and layouts from a
+// upb_msgfactory.
+
+static void AddField(google_protobuf_DescriptorProto *msg, const char *name,
+                     int number, int type, int label, upb::Arena *arena) {
+  google_protobuf_FieldDescriptorProto *f =
+      google_protobuf_DescriptorProto_add_field(msg, arena->ptr());
+  google_protobuf_FieldDescriptorProto_set_name(f, upb_strview_makez(name));
+  google_protobuf_FieldDescriptorProto_set_number(f, number);
+  google_protobuf_FieldDescriptorProto_set_type(f, type);
+  google_protobuf_FieldDescriptorProto_set_label(f, label);
+}
+
+static google_protobuf_DescriptorProto *AddMessage(
+    google_protobuf_FileDescriptorProto *file, const char *name,
+    upb::Arena *arena) {
+  google_protobuf_DescriptorProto *msg =
+      google_protobuf_FileDescriptorProto_add_message_type(file, arena->ptr());
+  google_protobuf_DescriptorProto_set_name(msg, upb_strview_makez(name));
+  return msg;
+}
+
+static std::string Varint(uint64_t val) {
+  std::string ret;
+  do {
+    ret += (char)((val & 0x7f) | (val > 0x7f ? 0x80 : 0));
+    val >>= 7;
+  } while (val);
+  return ret;
+}
+
+// The binary form of a Timestamp or Duration.
+static std::string Seconds(int64_t seconds, int32_t nanos) {
+  return "\x08" + Varint(seconds) + "\x10" + Varint((int64_t)nanos);
+}
+
+static void check_wkt(upb::SymbolTable *symtab, upb_msgfactory *factory,
+                      upb_jsonenccache *cache, const char *name,
+                      const std::string& pb, const char *expected) {
+  upb::Arena arena;
+  upb::MessageDefPtr md = symtab->LookupMessage(name);
+  ASSERT(md);
+  const upb_msglayout *layout = upb_msgfactory_getlayout(factory, md.ptr());
+  upb_msg *msg = upb_msg_new(layout, arena.ptr());
+  ASSERT(upb_decode(pb.data(), pb.size(), msg, layout, arena.ptr()));
+
+  bool ok;
+  std::string json = JsonEncode(msg, md, layout, cache, &ok);
+  bool transcode_ok;
+  std::string transcoded = JsonTranscode(pb, md, layout, cache, &transcode_ok);
+  ASSERT(transcode_ok == ok);
+  ASSERT(transcoded == json);
+  if (expected) {
+    ASSERT(ok);
+    if (json != expected) {
+      fprintf(stderr, "%s: expected %s, got %s\n", name, expected,
+              json.c_str());
+      abort();
+    }
+  } else {
+    ASSERT(!ok);
+  }
+}
+
+// Defines Timestamp, Duration, FieldMask, Int32Value, BytesValue and Any.
+static void BuildWkt(upb::SymbolTable *symtab) {
+  const int kOptional = google_protobuf_FieldDescriptorProto_LABEL_OPTIONAL;
+  const int kRepeated = google_protobuf_FieldDescriptorProto_LABEL_REPEATED;
+  upb::Arena arena;
+  google_protobuf_FileDescriptorProto *file =
+      google_protobuf_FileDescriptorProto_new(arena.ptr());
+  google_protobuf_FileDescriptorProto_set_name(
+      file, upb_strview_makez("wkt.proto"));
+  google_protobuf_FileDescriptorProto_set_package(
+      file, upb_strview_makez("google.protobuf"));
+  google_protobuf_FileDescriptorProto_set_syntax(
+      file, upb_strview_makez("proto3"));
+
+  const char *seconds_types[] = {"Timestamp", "Duration"};
+  for (int i = 0; i < 2; i++) {
+    google_protobuf_DescriptorProto *msg =
+        AddMessage(file, seconds_types[i], &arena);
+    AddField(msg, "seconds", 1, google_protobuf_FieldDescriptorProto_TYPE_INT64,
+             kOptional, &arena);
+    AddField(msg, "nanos", 2, google_protobuf_FieldDescriptorProto_TYPE_INT32,
+             kOptional, &arena);
+  }
+  AddField(AddMessage(file, "FieldMask", &arena), "paths", 1,
+           google_protobuf_FieldDescriptorProto_TYPE_STRING, kRepeated,
+           &arena);
+  AddField(AddMessage(file, "Int32Value", &arena), "value", 1,
+           google_protobuf_FieldDescriptorProto_TYPE_INT32, kOptional, &arena);
+  AddField(AddMessage(file, "BytesValue", &arena), "value", 1,
+           google_protobuf_FieldDescriptorProto_TYPE_BYTES, kOptional, &arena);
+  google_protobuf_DescriptorProto *any = AddMessage(file, "Any", &arena);
+  AddField(any, "type_url", 1, google_protobuf_FieldDescriptorProto_TYPE_STRING,
+           kOptional, &arena);
+  AddField(any, "value", 2, google_protobuf_FieldDescriptorProto_TYPE_BYTES,
+           kOptional, &arena);
+
+  upb::Status status;
+  ASSERT(upb_symtab_addfile(symtab->ptr(), file, status.ptr()));
+}
+
+void test_json_encode_wkt() {
+  upb::SymbolTable symtab;
+  BuildWkt(&symtab);
+  upb_msgfactory *factory = upb_msgfactory_new(symtab.ptr());
+  upb_jsonenccache *cache = upb_jsonenccache_new(0);
+
+  const char *ts = "google.protobuf.Timestamp";
+  check_wkt(&symtab, factory, cache, ts, "", "\"1970-01-01T00:00:00Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(1553036601, 500000000),
+            "\"2019-03-19T23:03:21.5Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(951825600, 1000),
+            "\"2000-02-29T12:00:00.000001Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(-1, 0),
+            "\"1969-12-31T23:59:59Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(-62135596800LL, 0),
+            "\"0001-01-01T00:00:00Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(253402300799LL, 999999999),
+            "\"9999-12-31T23:59:59.999999999Z\"");
+  check_wkt(&symtab, factory, cache, ts, Seconds(253402300800LL, 0), NULL);
+  check_wkt(&symtab, factory, cache, ts, Seconds(-62135596801LL, 0), NULL);
+  check_wkt(&symtab, factory, cache, ts, Seconds(0, -1), NULL);
+
+  const char *dur = "google.protobuf.Duration";
+  check_wkt(&symtab, factory, cache, dur, "", "\"0s\"");
+  check_wkt(&symtab, factory, cache, dur, Seconds(1, 10), "\"1.00000001s\"");
+  check_wkt(&symtab, factory, cache, dur, Seconds(-1, -500000000),
+            "\"-1.5s\"");
+  check_wkt(&symtab, factory, cache, dur, Seconds(0, -1000),
+            "\"-0.000001s\"");
+  check_wkt(&symtab, factory, cache, dur, Seconds(315576000000LL, 0),
+            "\"315576000000s\"");
+  check_wkt(&symtab, factory, cache, dur, Seconds(315576000001LL, 0), NULL);
+  check_wkt(&symtab, factory, cache, dur, Seconds(1, -1), NULL);
+
+  check_wkt(&symtab, factory, cache, "google.protobuf.FieldMask",
+            "\x0a\x07" "foo_bar" "\x0a\x0c" "baz.qux_quux",
+            "\"fooBar,baz.quxQuux\"");
+  check_wkt(&symtab, factory, cache, "google.protobuf.FieldMask", "", "\"\"");
+  check_wkt(&symtab, factory, cache, "google.protobuf.Int32Value", "", "0");
+  check_wkt(&symtab, factory, cache, "google.protobuf.Int32Value",
+            "\x08" + Varint((uint64_t)-5), "-5");
+  check_wkt(&symtab, factory, cache, "google.protobuf.BytesValue",
+            std::string("\x0a\x04" "\x00\xff" "ab", 6), "\"AP9hYg==\"");
+  check_wkt(&symtab, factory, cache, "google.protobuf.Any", "", NULL);
+
+  upb_jsonenccache_free(cache);
+  upb_msgfactory_free(factory);
+}
+
+// upb_json_decode() gives the same message as the parser does, as compared
+// by upb_encode().
+static std::string ParseToBinary(const char *json, upb::MessageDefPtr md,
+                                 const upb_msglayout *layout) {
+  upb::json::CodeCache parse_codecache;
+  upb::HandlerCache pb_handlercache(upb::pb::EncoderPtr::NewCache());
+  upb::Arena arena;
+  upb::Status status;
+  std::string pb;
+  upb::StringSink pb_sink(&pb);
+  upb::pb::EncoderPtr pb_encoder = upb::pb::EncoderPtr::Create(
+      &arena, pb_handlercache.Get(md), pb_sink.input());
+  upb::json::ParserPtr parser = upb::json::ParserPtr::Create(
+      &arena, parse_codecache.Get(md), NULL, pb_encoder.input(), &status,
+      false);
+  ASSERT(upb::PutBuffer(std::string(json), parser.input()));
+
+  upb_msg *msg = upb_msg_new(layout, arena.ptr());
+  ASSERT(upb_decode(pb.data(), pb.size(), msg, layout, arena.ptr()));
+  size_t size;
+  char *encoded = upb_encode(msg, layout, arena.ptr(), &size);
+  ASSERT(encoded);
+  return std::string(encoded, size);
+}
+
+// Returns upb_encode() of the parsed message, or sets |ok| to false.
+static std::string JsonDecode(const std::string& json, upb::MessageDefPtr md,
+                              const upb_msglayout *layout,
+                              upb_jsondeccache *cache, int options, bool *ok) {
+  upb::Arena arena;
+  upb::Status status;
+  upb_msg *msg = upb_msg_new(layout, arena.ptr());
+  *ok = upb_json_decode(json.data(), json.size(), msg, md.ptr(), layout,
+                        cache, arena.ptr(), options, status.ptr());
+  ASSERT(*ok != !status.ok());
+  if (!*ok) return std::string();
+  size_t size;
+  char *encoded = upb_encode(msg, layout, arena.ptr(), &size);
+  ASSERT(encoded);
+  return std::string(encoded, size);
+}
+
+void test_json_decode_cases(const TestCase* test_cases) {
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb_msglayout *layout = &upb_test_json_TestMessage_msginit;
+  upb_jsondeccache *cache = upb_jsondeccache_new();
+  ASSERT(cache);
+
+  for (const TestCase* test_case = test_cases; test_case->input != NULL;
+       test_case++) {
+    std::string expected = ParseToBinary(test_case->input, md, layout);
+    bool ok;
+    std::string pb = JsonDecode(test_case->input, md, layout, cache, 0, &ok);
+    ASSERT(ok);
+    if (pb != expected) {
+      fprintf(stderr, "upb_json_decode() result differs from the parser's "
+                      "for:\n%s\n", test_case->input);
+      abort();
+    }
+  }
+
+  upb_jsondeccache_free(cache);
+}
+
+static void check_decode(upb::MessageDefPtr md, upb_jsondeccache *cache,
+                         int options, const char *json, const char *same_as) {
+  const upb_msglayout *layout = &upb_test_json_TestMessage_msginit;
+  bool ok;
+  std::string pb = JsonDecode(json, md, layout, cache, options, &ok);
+  if (same_as) {
+    if (!ok || pb != ParseToBinary(same_as, md, layout)) {
+      fprintf(stderr, "%s: expected the same message as %s\n", json, same_as);
+      abort();
+    }
+  } else if (ok) {
+    fprintf(stderr, "%s: expected an error\n", json);
+    abort();
+  }
+}
+
+void test_json_decode() {
+  test_json_decode_cases(kTestRoundtripMessages);
+  test_json_decode_cases(kTestRoundtripMessagesPreserve);
+
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  upb_jsondeccache *cache = upb_jsondeccache_new();
+  ASSERT(cache);
+
+  // Forms the printer never writes.
+  check_decode(md, cache, 0,
+               " { \"optionalInt32\" : 1 , \"optionalInt64\":2 } ",
+               "{\"optionalInt32\":1,\"optionalInt64\":2}");
+  check_decode(md, cache, 0,
+               "{\"optionalInt32\":\"-7\",\"optionalUint64\":1e3}",
+               "{\"optionalInt32\":-7,\"optionalUint64\":1000}");
+  check_decode(md, cache, 0, "{\"optionalInt64\":\"-9223372036854775808\"}",
+               "{\"optionalInt64\":-9223372036854775808}");
+  check_decode(md, cache, 0,
+               "{\"optionalString\":\"\\ud83d\\ude00\",\"optionalMsg\":null}",
+               "{\"optionalString\":\"\xF0\x9F\x98\x80\"}");
+  check_decode(md, cache, 0,
+               "{\"optionalBytes\":\"-_8\",\"repeatedBytes\":[\"+/8=\"]}",
+               "{\"optionalBytes\":\"+/8=\",\"repeatedBytes\":[\"+/8=\"]}");
+  check_decode(md, cache, 0, "{\"oneofInt32\":1,\"oneofInt64\":2}",
+               "{\"oneofInt64\":2}");
+  check_decode(md, cache, 0, "{\"mapInt32String\":{\"-5\":\"a\",\"-5\":\"b\"}}",
+               "{\"mapInt32String\":{\"-5\":\"b\"}}");
+  check_decode(md, cache, 0,
+               "{\"optionalEnum\":\"C\",\"repeatedEnum\":[1,\"A\"]}",
+               "{\"optionalEnum\":2,\"repeatedEnum\":[\"B\",0]}");
+
+  // Unknown fields and enum names.
+  check_decode(md, cache, 0, "{\"unknown\":1}", NULL);
+  check_decode(md, cache, 0, "{\"optionalEnum\":\"D\"}", NULL);
+  check_decode(md, cache, UPB_JSONDEC_IGNOREUNKNOWN,
+               "{\"unknown\":[1,{\"a\":[null,\"\\\"\"]}],\"optionalInt32\":5,"
+               "\"optionalEnum\":\"D\",\"repeatedEnum\":[\"D\",\"B\"]}",
+               "{\"optionalInt32\":5,\"repeatedEnum\":[\"B\"]}");
+
+  // Malformed input and values out of range.
+  const char *errors[] = {
+    "",
+    "[]",
+    "{",
+    "{\"optionalInt32\":1,}",
+    "{\"optionalInt32\":1}}",
+    "{\"optionalInt32\" 1}",
+    "{\"optionalInt32\":01}",
+    "{\"optionalInt32\":1.5}",
+    "{\"optionalInt32\":2147483648}",
+    "{\"repeatedUint64\":[-1]}",
+    "{\"optionalInt64\":\"9223372036854775808\"}",
+    "{\"optionalInt32\":\"\"}",
+    "{\"optionalBool\":1}",
+    "{\"optionalString\":\"\x01\"}",
+    "{\"optionalString\":\"\\x\"}",
+    "{\"optionalString\":\"\\ud83d\"}",
+    "{\"optionalString\":\"abc}",
+    "{\"optionalBytes\":\"A\"}",
+    "{\"optionalBytes\":\"A*==\"}",
+    "{\"mapBoolString\":{\"1\":\"a\"}}",
+    "{\"mapInt32String\":{\"1.5\":\"a\"}}",
+    "{\"repeatedInt32\":[1,]}",
+    "{\"repeatedInt32\":[1 2]}",
+    NULL
+  };
+  for (const char **json = errors; *json; json++) {
+    check_decode(md, cache, 0, *json, NULL);
+  }
+
+  // Nesting limits.
+  std::string deep = "{\"unknown\":" + std::string(20, '[') +
+                     std::string(20, ']') + "}";
+  check_decode(md, cache, UPB_JSONDEC_IGNOREUNKNOWN, deep.c_str(), "{}");
+  deep = "{\"unknown\":" + std::string(100, '[') + std::string(100, ']') +
+         "}";
+  check_decode(md, cache, UPB_JSONDEC_IGNOREUNKNOWN, deep.c_str(), NULL);
+  std::string nested = "{\"mapStringMsg\":{\"a\":{\"foo\":1}}}";
+  check_decode(md, cache, 0, nested.c_str(), nested.c_str());
+
+  upb_jsondeccache_free(cache);
+}
+
+// Parses |json| as type |name|, and compares upb_encode() of the result with
+// that of |pb| parsed with upb_decode(), or expects an error if |pb| is NULL.
+static void check_wkt_decode(upb::SymbolTable *symtab,
+                             upb_msgfactory *factory, upb_jsondeccache *cache,
+                             const char *name, const char *json,
+                             const std::string *pb) {
+  upb::Arena arena;
+  upb::MessageDefPtr md = symtab->LookupMessage(name);
+  ASSERT(md);
+  const upb_msglayout *layout = upb_msgfactory_getlayout(factory, md.ptr());
+
+  bool ok;
+  std::string decoded = JsonDecode(json, md, layout, cache, 0, &ok);
+  if (!pb) {
+    if (ok) {
+      fprintf(stderr, "%s: expected an error for %s\n", name, json);
+      abort();
+    }
+    return;
+  }
+
+  upb_msg *msg = upb_msg_new(layout, arena.ptr());
+  ASSERT(upb_decode(pb->data(), pb->size(), msg, layout, arena.ptr()));
+  size_t size;
+  char *encoded = upb_encode(msg, layout, arena.ptr(), &size);
+  ASSERT(encoded);
+  if (!ok || decoded != std::string(encoded, size)) {
+    fprintf(stderr, "%s: unexpected result for %s\n", name, json);
+    abort();
+  }
+}
+
+void test_json_decode_wkt() {
+  upb::SymbolTable symtab;
+  BuildWkt(&symtab);
+  upb_msgfactory *factory = upb_msgfactory_new(symtab.ptr());
+  upb_jsondeccache *cache = upb_jsondeccache_new();
+
+  const char *ts = "google.protobuf.Timestamp";
+  std::string pb = Seconds(1553036601, 500000000);
+  check_wkt_decode(&symtab, factory, cache, ts, "\"2019-03-19T23:03:21.5Z\"",
+                   &pb);
+  check_wkt_decode(&symtab, factory, cache, ts,
+                   "\"2019-03-19T15:03:21.500-08:00\"", &pb);
+  pb = Seconds(951825600, 1000);
+  check_wkt_decode(&symtab, factory, cache, ts,
+                   "\"2000-02-29T12:00:00.000001Z\"", &pb);
+  pb = Seconds(-62135596800LL, 0);
+  check_wkt_decode(&symtab, factory, cache, ts, "\"0001-01-01T00:00:00Z\"",
+                   &pb);
+  pb = Seconds(253402300799LL, 999999999);
+  check_wkt_decode(&symtab, factory, cache, ts,
+                   "\"9999-12-31T23:59:59.999999999Z\"", &pb);
+  check_wkt_decode(&symtab, factory, cache, ts, "\"0001-01-01T00:00:00+00:01\"",
+                   NULL);
+  check_wkt_decode(&symtab, factory, cache, ts, "\"2019-03-19 23:03:21Z\"",
+                   NULL);
+  check_wkt_decode(&symtab, factory, cache, ts, "\"2019-03-19T23:03:21.Z\"",
+                   NULL);
+  check_wkt_decode(&symtab, factory, cache, ts, "1553036601", NULL);
+
+  const char *dur = "google.protobuf.Duration";
+  pb = Seconds(-1, -500000000);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"-1.5s\"", &pb);
+  pb = Seconds(0, -1000);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"-0.000001s\"", &pb);
+  pb = Seconds(315576000000LL, 0);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"315576000000s\"", &pb);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"315576000001s\"", NULL);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"1.5\"", NULL);
+  check_wkt_decode(&symtab, factory, cache, dur, "\"s\"", NULL);
+
+  pb = "\x0a\x07" "foo_bar" "\x0a\x0c" "baz.qux_quux";
+  check_wkt_decode(&symtab, factory, cache, "google.protobuf.FieldMask",
+                   "\"fooBar,baz.quxQuux\"", &pb);
+  pb = "\x08" + Varint((uint64_t)-5);
+  check_wkt_decode(&symtab, factory, cache, "google.protobuf.Int32Value",
+                   "-5", &pb);
+  pb = std::string("\x0a\x04" "\x00\xff" "ab", 6);
+  check_wkt_decode(&symtab, factory, cache, "google.protobuf.BytesValue",
+                   "\"AP9hYg==\"", &pb);
+  check_wkt_decode(&symtab, factory, cache, "google.protobuf.Any", "{}", NULL);
+
+  upb_jsondeccache_free(cache);
+  upb_msgfactory_free(factory);
+}
+
+static std::string SimpleBase64(const std::string& data) {
+  static const char kChars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string ret;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t val = (uint8_t)data[i] << 16;
+    if (i + 1 < data.size()) val |= (uint8_t)data[i + 1] << 8;
+    if (i + 2 < data.size()) val |= (uint8_t)data[i + 2];
+    ret += kChars[val >> 18];
+    ret += kChars[(val >> 12) & 0x3f];
+    ret += i + 1 < data.size() ? kChars[(val >> 6) & 0x3f] : '=';
+    ret += i + 2 < data.size() ? kChars[val & 0x3f] : '=';
+  }
+  return ret;
+}
+
+// The base64 codec, at lengths on either side of each vector size, through
+// the printer, the parser and upb_json_decode().
+void test_json_base64() {
+  upb::SymbolTable symtab;
+  upb::MessageDefPtr md(upb_test_json_TestMessage_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb_msglayout *layout = &upb_test_json_TestMessage_msginit;
+  upb_jsondeccache *cache = upb_jsondeccache_new();
+  ASSERT(cache);
+  uint32_t seed = 1;
+
+  for (size_t len = 0; len < 200; len++) {
+    std::string data;
+    for (size_t i = 0; i < len; i++) {
+      seed = seed * 1103515245 + 12345;
+      data += (char)(seed >> 16);
+    }
+
+    std::string b64(_upb_json_base64len(len), '\0');
+    ASSERT(_upb_json_base64(data.data(), len, &b64[0]) == b64.size());
+    ASSERT(b64 == SimpleBase64(data));
+
+    // The field's binary form, or nothing for the proto3 default.
+    std::string pb;
+    if (len > 0) pb = "\x32" + Varint(len) + data;
+
+    std::string json = "{\"optionalBytes\":\"" + b64 + "\"}";
+    ASSERT(ParseToBinary(json.c_str(), md, layout) == pb);
+    bool ok;
+    ASSERT(JsonDecode(json, md, layout, cache, 0, &ok) == pb);
+    ASSERT(ok);
+
+    // The "web-safe" alphabet, without padding.
+    std::string websafe = b64.substr(0, b64.find('='));
+    for (size_t i = 0; i < websafe.size(); i++) {
+      if (websafe[i] == '+') websafe[i] = '-';
+      if (websafe[i] == '/') websafe[i] = '_';
+    }
+    json = "{\"optionalBytes\":\"" + websafe + "\"}";
+    ASSERT(JsonDecode(json, md, layout, cache, 0, &ok) == pb);
+    ASSERT(ok);
+
+    // A bad character anywhere is an error.
+    if (len > 0) {
+      std::string bad = b64;
+      bad[seed % websafe.size()] = '*';
+      json = "{\"optionalBytes\":\"" + bad + "\"}";
+      JsonDecode(json, md, layout, cache, 0, &ok);
+      ASSERT(!ok);
+    }
+  }
+
+  upb_jsondeccache_free(cache);
+}
+
 extern "C" {
 int run_tests(int argc, char *argv[]) {
   UPB_UNUSED(argc);
   UPB_UNUSED(argv);
   test_json_roundtrip();
+  test_json_long_string();
+  test_json_encode();
+  test_json_encode_wkt();
+  test_json_transcode();
+  test_json_decode();
+  test_json_decode_wkt();
+  test_json_base64();
   return 0;
 }
 }
@@ -80,6 +80,12 @@ enum TestMode {
   ALL_HANDLERS = 3
 } test_mode;
 
+// Whether the decoder methods may be JIT-compiled.
+bool allow_jit;
+
+// Whether submessage methods are compiled when first called.
+bool on_demand;
+
 // Copied from decoder.c, since this is not a public interface.
 typedef struct {
   uint8_t native_wire_type;
@@ -342,6 +348,32 @@ void doreg(upb::HandlersPtr h, uint32_t num) {
   }
 }
 
+// Receives packed values a buffer at a time and passes them on one by one, so
+// the output is the same as with the per-value handler.
+template <class T, bool F(int*, const uint32_t*, T)>
+bool value_bulk(void* closure, const void* hd, const char* buf, size_t n) {
+  ASSERT(n % sizeof(T) == 0);
+  for (size_t i = 0; i < n; i += sizeof(T)) {
+    T val;
+    memcpy(&val, buf + i, sizeof(T));
+    if (!F(static_cast<int*>(closure), static_cast<const uint32_t*>(hd), val)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class T, bool F(int*, const uint32_t*, T)>
+void regbulk(upb::HandlersPtr h, uint32_t num) {
+  upb::FieldDefPtr f = h.message_def().FindFieldByNumber(num);
+  upb_handlerattr attr = UPB_HANDLERATTR_INIT;
+  uint32_t* data = new uint32_t(num);
+  ASSERT(f);
+  ASSERT(upb_handlers_addcleanup(h.ptr(), data, free_uint32));
+  attr.handler_data = data;
+  ASSERT(upb_handlers_setbulk(h.ptr(), f.ptr(), value_bulk<T, F>, &attr));
+}
+
 // The repeated field number to correspond to the given non-repeated field
 // number.
 uint32_t rep_fn(uint32_t fn) {
@@ -411,6 +443,12 @@ void callback(const void *closure, upb::Handlers* h_ptr) {
     reg<int32_t,  value_int32> (h, UPB_DESCRIPTOR_TYPE_SINT32);
     reg<int64_t,  value_int64> (h, UPB_DESCRIPTOR_TYPE_SINT64);
 
+    // Some of the fixed-width types also take packed values in bulk; the
+    // others keep testing the per-value path.
+    regbulk<double,   value_double>(h, rep_fn(UPB_DESCRIPTOR_TYPE_DOUBLE));
+    regbulk<uint32_t, value_uint32>(h, rep_fn(UPB_DESCRIPTOR_TYPE_FIXED32));
+    regbulk<int64_t,  value_int64> (h, rep_fn(UPB_DESCRIPTOR_TYPE_SFIXED64));
+
     reg_str(h, UPB_DESCRIPTOR_TYPE_STRING);
     reg_str(h, UPB_DESCRIPTOR_TYPE_BYTES);
     reg_str(h, rep_fn(UPB_DESCRIPTOR_TYPE_STRING));
@@ -1118,6 +1156,8 @@ void test_emptyhandlers(upb::SymbolTable* symtab) {
 
   upb::HandlerCache handler_cache(empty_callback, &handlerdata);
   upb::pb::CodeCache pb_code_cache(&handler_cache);
+  pb_code_cache.set_allow_jit(allow_jit);
+  pb_code_cache.set_on_demand(on_demand);
 
   upb::MessageDefPtr md = upb::MessageDefPtr(Empty_getmsgdef(symtab->ptr()));
   global_handlers = handler_cache.Get(md);
@@ -1160,6 +1200,8 @@ void run_tests() {
   upb::SymbolTable symtab;
   upb::HandlerCache handler_cache(callback, &handlerdata);
   upb::pb::CodeCache pb_code_cache(&handler_cache);
+  pb_code_cache.set_allow_jit(allow_jit);
+  pb_code_cache.set_on_demand(on_demand);
 
   upb::MessageDefPtr md(DecoderTest_getmsgdef(symtab.ptr()));
   global_handlers = handler_cache.Get(md);
@@ -1188,13 +1230,22 @@ int run_tests(int argc, char *argv[]) {
   run_tests();
   count = &completed;
 
-  total *= 2;  // NO_HANDLERS, ALL_HANDLERS.
+  // NO_HANDLERS, ALL_HANDLERS, each with and without the JIT, and with
+  // submessages compiled up front or on demand.
+  total *= 8;
 
-  test_mode = NO_HANDLERS;
-  run_tests();
+  for (int demand = 0; demand < 2; demand++) {
+    on_demand = demand;
+    for (int jit = 0; jit < 2; jit++) {
+      allow_jit = jit;
 
-  test_mode = ALL_HANDLERS;
-  run_tests();
+      test_mode = NO_HANDLERS;
+      run_tests();
+
+      test_mode = ALL_HANDLERS;
+      run_tests();
+    }
+  }
 
   printf("All tests passed, %d assertions.\n", num_assertions);
   return 0;
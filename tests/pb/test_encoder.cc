@@ -5,10 +5,14 @@
 #include "google/protobuf/descriptor.upb.h"
 #include "google/protobuf/descriptor.upbdefs.h"
 #include "upb/pb/decoder.h"
+#include "upb/pb/decoder.int.h"
 #include "upb/pb/encoder.h"
+#include "upb/pb/textprinter.h"
 
 #include "upb/port_def.inc"
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 void test_pb_roundtrip() {
   std::string input(
@@ -38,11 +42,352 @@ void test_pb_roundtrip() {
   ASSERT(input == output);
 }
 
+void test_pb_unpacked() {
+  // SourceCodeInfo.Location.path (1) is packed, so the decoder finds the code
+  // for unpacked values through the alternate wire type in its dispatch table.
+  std::string input("\x08\x05\x08\x07\x10\x01", 6);
+  std::string expected("\x0a\x02\x05\x07\x12\x01\x01", 7);
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::Arena arena;
+  upb::Status status;
+  upb::MessageDefPtr md(
+      google_protobuf_SourceCodeInfo_Location_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb::Handlers *encoder_handlers = encoder_cache.Get(md);
+  ASSERT(encoder_handlers);
+  const upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+
+  std::string output;
+  upb::StringSink string_sink(&output);
+  upb::pb::EncoderPtr encoder =
+      upb::pb::EncoderPtr::Create(&arena, encoder_handlers, string_sink.input());
+  upb::pb::DecoderPtr decoder =
+      upb::pb::DecoderPtr::Create(&arena, method, encoder.input(), &status);
+  bool ok = upb::PutBuffer(input, decoder.input());
+  ASSERT(ok);
+  ASSERT(output == expected);
+}
+
+void test_codecache() {
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr file(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  upb::MessageDefPtr msg(
+      google_protobuf_DescriptorProto_getmsgdef(symtab.ptr()));
+
+  const upb_pbdecodermethod *file_method =
+      upb_pbcodecache_get(decoder_cache.ptr(), file.ptr());
+  ASSERT(file_method);
+  ASSERT(upb_pbcodecache_get(decoder_cache.ptr(), file.ptr()) == file_method);
+
+  /* Compiled along with FileDescriptorProto, which has DescriptorProto
+   * fields, so this one is reused instead of being compiled again. */
+  const upb_pbdecodermethod *msg_method =
+      upb_pbcodecache_get(decoder_cache.ptr(), msg.ptr());
+  ASSERT(msg_method);
+  ASSERT(msg_method->group == file_method->group);
+  ASSERT(upb_pbdecodermethod_desthandlers(msg_method) ==
+         encoder_cache.Get(msg));
+}
+
+void test_decoder_rebind() {
+  std::string file_input(
+      google_protobuf_descriptor_proto_upbdefinit.descriptor.data,
+      google_protobuf_descriptor_proto_upbdefinit.descriptor.size);
+  std::string location_input("\x08\x05\x08\x07\x10\x01", 6);
+  std::string location_expected("\x0a\x02\x05\x07\x12\x01\x01", 7);
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr file(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  upb::MessageDefPtr location(
+      google_protobuf_SourceCodeInfo_Location_getmsgdef(symtab.ptr()));
+  const upb::Handlers *file_handlers = encoder_cache.Get(file);
+  const upb::Handlers *location_handlers = encoder_cache.Get(location);
+  const upb::pb::DecoderMethodPtr file_method = decoder_cache.Get(file);
+  const upb::pb::DecoderMethodPtr location_method =
+      decoder_cache.Get(location);
+
+  upb::Arena decoder_arena;
+  upb::Status status;
+  upb::pb::DecoderPtr decoder;
+  size_t allocated = 0;
+
+  for (int i = 0; i < 4; i++) {
+    bool is_file = i % 2 == 0;
+    upb::Arena arena;
+    std::string output;
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder = upb::pb::EncoderPtr::Create(
+        &arena, is_file ? file_handlers : location_handlers,
+        string_sink.input());
+    upb::pb::DecoderMethodPtr method = is_file ? file_method : location_method;
+
+    if (i == 0) {
+      decoder = upb::pb::DecoderPtr::Create(&decoder_arena, method,
+                                           encoder.input(), &status);
+      ASSERT(decoder.ptr());
+      allocated = upb_arena_bytesallocated(decoder_arena.ptr());
+    } else {
+      /* The sink has to match the method. */
+      ASSERT(!decoder.Rebind(is_file ? location_method : file_method,
+                             encoder.input(), &status));
+      ASSERT(decoder.Rebind(method, encoder.input(), &status));
+    }
+
+    bool ok = upb::PutBuffer(is_file ? file_input : location_input,
+                             decoder.input());
+    ASSERT(ok);
+    ASSERT(output == (is_file ? file_input : location_expected));
+  }
+
+  /* Nothing more was allocated for the decoder. */
+  ASSERT(upb_arena_bytesallocated(decoder_arena.ptr()) == allocated);
+}
+
+/* Keeps the strings it is given, without copying them if it can. */
+struct RetainedStrings {
+  upb_arena *arena;
+  std::vector<upb_strview> retained;
+  std::vector<std::string> copied;
+};
+
+static size_t retain_string(void *c, const void *hd, const char *buf,
+                            size_t n, const upb_bufhandle *handle) {
+  RetainedStrings *strings = static_cast<RetainedStrings*>(c);
+  UPB_UNUSED(hd);
+  if (upb_bufhandle_retain(handle, strings->arena)) {
+    strings->retained.push_back(upb_strview_make(buf, n));
+  } else {
+    strings->copied.push_back(std::string(buf, n));
+  }
+  return n;
+}
+
+static void add_retain_handlers(const void *closure, upb_handlers *h) {
+  upb_msg_field_iter i;
+  UPB_UNUSED(closure);
+  for (upb_msg_field_begin(&i, upb_handlers_msgdef(h));
+       !upb_msg_field_done(&i); upb_msg_field_next(&i)) {
+    const upb_fielddef *f = upb_msg_iter_field(&i);
+    if (upb_fielddef_isstring(f)) {
+      ASSERT(upb_handlers_setstring(h, f, retain_string, NULL));
+    }
+  }
+}
+
+void test_decoder_retain() {
+  const upb_strview input =
+      google_protobuf_descriptor_proto_upbdefinit.descriptor;
+  upb::SymbolTable symtab;
+  upb::HandlerCache handler_cache(add_retain_handlers, NULL);
+  upb::pb::CodeCache decoder_cache(&handler_cache);
+  upb::MessageDefPtr file(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  const upb::Handlers *handlers = handler_cache.Get(file);
+  const upb::pb::DecoderMethodPtr method = decoder_cache.Get(file);
+
+  for (int with_arena = 0; with_arena < 2; with_arena++) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_arena *input_arena = upb_arena_new();
+    char *buf = static_cast<char*>(upb_arena_malloc(input_arena, input.size));
+    RetainedStrings strings;
+    strings.arena = arena.ptr();
+    memcpy(buf, input.data, input.size);
+
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, method, upb::Sink(handlers, &strings), &status);
+    ASSERT(upb_bufsrc_putbuf_witharena(buf, input.size,
+                                       with_arena ? input_arena : NULL,
+                                       decoder.input().sink()));
+    upb_arena_free(input_arena);
+
+    /* Without an arena every string has to be copied.  With one, none is,
+     * and the strings are still there after the input's arena is freed. */
+    ASSERT(strings.retained.empty() != strings.copied.empty());
+    if (with_arena) {
+      upb_strview name = strings.retained[0];
+      ASSERT(name.data >= buf && name.data < buf + input.size);
+      ASSERT(std::string(name.data, name.size) ==
+             "google/protobuf/descriptor.proto");
+    } else {
+      ASSERT(strings.copied[0] == "google/protobuf/descriptor.proto");
+    }
+  }
+}
+
+/* Collects the encoder's output, keeping track of the largest buffer. */
+struct ChunkedOutput {
+  std::string data;
+  size_t max_chunk;
+};
+
+static size_t chunked_buf(void *c, const void *hd, const char *buf, size_t n,
+                          const upb_bufhandle *handle) {
+  ChunkedOutput *out = static_cast<ChunkedOutput*>(c);
+  UPB_UNUSED(hd);
+  UPB_UNUSED(handle);
+  out->data.append(buf, n);
+  out->max_chunk = std::max(out->max_chunk, n);
+  return n;
+}
+
+void test_pb_twopass() {
+  std::string input(
+      google_protobuf_descriptor_proto_upbdefinit.descriptor.data,
+      google_protobuf_descriptor_proto_upbdefinit.descriptor.size);
+  std::string location_input("\x08\x05\x08\x07\x10\x01", 6);
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  const upb::Handlers *encoder_handlers = encoder_cache.Get(md);
+  const upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+  upb_byteshandler handler;
+  upb_byteshandler_init(&handler);
+  upb_byteshandler_setstring(&handler, chunked_buf, NULL);
+  std::vector<size_t> lengths;
+
+  for (int i = 0; i < 3; i++) {
+    upb::Arena arena;
+    upb::Status status;
+    ChunkedOutput output;
+    output.max_chunk = 0;
+    upb::BytesSink sink(&handler, &output);
+    upb::pb::EncoderPtr encoder =
+        upb::pb::EncoderPtr::Create(&arena, encoder_handlers, sink);
+    upb::pb::DecoderPtr decoder =
+        upb::pb::DecoderPtr::Create(&arena, method, encoder.input(), &status);
+
+    if (i == 0) {
+      ASSERT(upb::PutBuffer(input, decoder.input()));
+    } else if (i == 1) {
+      /* Sizing pass, then writing pass. */
+      size_t count;
+      ASSERT(encoder.StartSizing());
+      ASSERT(upb::PutBuffer(input, decoder.input()));
+      ASSERT(output.data.empty());
+      const size_t *recorded = upb_pb_encoder_lengths(encoder.ptr(), &count);
+      lengths.assign(recorded, recorded + count);
+      ASSERT(count > 100);
+      decoder.Reset();
+      ASSERT(upb::PutBuffer(input, decoder.input()));
+      ASSERT(output.max_chunk < 100);
+    } else {
+      /* Another encoder, given the lengths. */
+      ASSERT(encoder.SetLengths(lengths.data(), lengths.size()));
+      ASSERT(upb::PutBuffer(input, decoder.input()));
+      ASSERT(output.max_chunk < 100);
+    }
+    ASSERT(output.data == input);
+  }
+
+  /* Lengths for a different message fail the encode. */
+  {
+    upb::MessageDefPtr location(
+        google_protobuf_SourceCodeInfo_Location_getmsgdef(symtab.ptr()));
+    upb::Arena arena;
+    upb::Status status;
+    std::string output;
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder = upb::pb::EncoderPtr::Create(
+        &arena, encoder_cache.Get(location), string_sink.input());
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, decoder_cache.Get(location), encoder.input(), &status);
+    ASSERT(encoder.SetLengths(lengths.data(), lengths.size()));
+    ASSERT(!upb::PutBuffer(location_input, decoder.input()));
+  }
+}
+
+/* Submessages nested deeper than the encoder's initial stack. */
+void test_pb_deep_nesting() {
+  std::string input;
+  for (int i = 0; i < 100; i++) {
+    /* DescriptorProto.nested_type (3), wrapping what we have so far. */
+    std::string wrapped("\x1a", 1);
+    size_t len = input.size();
+    do {
+      wrapped.push_back((len & 0x7f) | (len > 0x7f ? 0x80 : 0));
+      len >>= 7;
+    } while (len);
+    input = wrapped + input;
+  }
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_DescriptorProto_getmsgdef(symtab.ptr()));
+
+  for (int twopass = 0; twopass < 2; twopass++) {
+    upb::Arena arena;
+    upb::Status status;
+    std::string output;
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder = upb::pb::EncoderPtr::Create(
+        &arena, encoder_cache.Get(md), string_sink.input());
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, decoder_cache.Get(md), encoder.input(), &status);
+    /* The decoder takes a frame for each repeated field too. */
+    ASSERT(decoder.set_max_nesting(256));
+    if (twopass) {
+      ASSERT(encoder.StartSizing());
+      ASSERT(upb::PutBuffer(input, decoder.input()));
+      decoder.Reset();
+    }
+    ASSERT(upb::PutBuffer(input, decoder.input()));
+    ASSERT(output == input);
+  }
+}
+
+void test_textprinter() {
+  /* FileDescriptorProto { name: "a\n\"\001€" message_type { name: "M" } } */
+  std::string input("\x0a\x07" "a\n\"\x01\xe2\x82\xac" "\x22\x03\x0a\x01M", 14);
+  upb::SymbolTable symtab;
+  upb::HandlerCache printer_cache(upb::pb::TextPrinterPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&printer_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  const upb::Handlers *handlers = printer_cache.Get(md);
+  const upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+
+  for (int single_line = 0; single_line < 2; single_line++) {
+    upb::Arena arena;
+    upb::Status status;
+    std::string output;
+    upb::StringSink string_sink(&output);
+    upb_textprinter *printer = upb_textprinter_create(
+        arena.ptr(), handlers, string_sink.input().sink());
+    upb_textprinter_setsingleline(printer, single_line);
+    upb::pb::DecoderPtr decoder = upb::pb::DecoderPtr::Create(
+        &arena, method, upb_textprinter_input(printer), &status);
+    ASSERT(upb::PutBuffer(input, decoder.input()));
+    ASSERT(output == (single_line
+                          ? "name: \"a\\n\\\"\\001\xe2\x82\xac\" "
+                            "message_type { name: \"M\" } "
+                          : "name: \"a\\n\\\"\\001\xe2\x82\xac\"\n"
+                            "message_type {\n  name: \"M\"\n}\n"));
+  }
+}
+
 extern "C" {
 int run_tests(int argc, char *argv[]) {
   UPB_UNUSED(argc);
   UPB_UNUSED(argv);
   test_pb_roundtrip();
+  test_pb_unpacked();
+  test_pb_twopass();
+  test_pb_deep_nesting();
+  test_textprinter();
+  test_codecache();
+  test_decoder_rebind();
+  test_decoder_retain();
   return 0;
 }
 }
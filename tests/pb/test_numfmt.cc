@@ -0,0 +1,122 @@
+/* Tests for the number formatting shared by the text and JSON printers. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "tests/upb_test.h"
+#include "upb/pb/numfmt.int.h"
+
+#include "upb/port_def.inc"
+
+static std::string fmt_double(double val) {
+  char buf[UPB_NUMFMT_MAXLEN];
+  return std::string(buf, upb_fmt_double(val, buf));
+}
+
+static std::string fmt_float(float val) {
+  char buf[UPB_NUMFMT_MAXLEN];
+  return std::string(buf, upb_fmt_float(val, buf));
+}
+
+static std::string fmt_int64(int64_t val) {
+  char buf[UPB_NUMFMT_MAXLEN];
+  return std::string(buf, upb_fmt_int64(val, buf));
+}
+
+static std::string fmt_uint64(uint64_t val) {
+  char buf[UPB_NUMFMT_MAXLEN];
+  return std::string(buf, upb_fmt_uint64(val, buf));
+}
+
+void test_integers() {
+  ASSERT(fmt_int64(0) == "0");
+  ASSERT(fmt_int64(7) == "7");
+  ASSERT(fmt_int64(-10) == "-10");
+  ASSERT(fmt_int64(123456789) == "123456789");
+  ASSERT(fmt_int64(INT64_MAX) == "9223372036854775807");
+  ASSERT(fmt_int64(INT64_MIN) == "-9223372036854775808");
+  ASSERT(fmt_uint64(99) == "99");
+  ASSERT(fmt_uint64(100) == "100");
+  ASSERT(fmt_uint64(UINT64_MAX) == "18446744073709551615");
+}
+
+void test_layout() {
+  ASSERT(fmt_double(0) == "0");
+  ASSERT(fmt_double(-0.0) == "-0");
+  ASSERT(fmt_double(1) == "1");
+  ASSERT(fmt_double(-42.5) == "-42.5");
+  ASSERT(fmt_double(0.1) == "0.1");
+  ASSERT(fmt_double(0.0001) == "0.0001");
+  ASSERT(fmt_double(0.00001) == "1e-05");
+  ASSERT(fmt_double(1.5e-7) == "1.5e-07");
+  ASSERT(fmt_double(1e16) == "10000000000000000");
+  ASSERT(fmt_double(1e17) == "1e+17");
+  ASSERT(fmt_double(1.25e100) == "1.25e+100");
+  ASSERT(fmt_double(5e-324) == "5e-324");
+  ASSERT(fmt_double(1.7976931348623157e308) == "1.7976931348623157e+308");
+  ASSERT(fmt_double(UPB_INFINITY) == "inf");
+  ASSERT(fmt_double(-UPB_INFINITY) == "-inf");
+  ASSERT(fmt_double(NAN) == "nan");
+
+  ASSERT(fmt_float(0.1f) == "0.1");
+  ASSERT(fmt_float(16777216.0f) == "16777216");
+  ASSERT(fmt_float(1e9f) == "1e+09");
+  ASSERT(fmt_float(3.4028235e38f) == "3.4028235e+38");
+  ASSERT(fmt_float(1e-45f) == "1e-45");
+}
+
+/* Every value reads back as itself, in no more than the 17 (or 9) digits that
+ * are always enough. */
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static size_t count_digits(const std::string& str) {
+  size_t n = 0;
+  size_t i = str.find_first_not_of("-0.");
+  for (; i < str.size() && str[i] != 'e'; i++) {
+    if (str[i] != '.') n++;
+  }
+  return n;
+}
+
+void test_roundtrip() {
+  uint64_t state = 88172645463325252ULL;
+  for (int i = 0; i < 200000; i++) {
+    uint64_t bits = next_random(&state);
+    uint32_t bits32 = (uint32_t)bits;
+    double d;
+    float f;
+
+    if (i % 4 == 0) bits &= (1ULL << 52) - 1;  /* Subnormal. */
+    memcpy(&d, &bits, sizeof(d));
+    memcpy(&f, &bits32, sizeof(f));
+
+    if (!isnan(d) && !isinf(d)) {
+      std::string str = fmt_double(d);
+      ASSERT(strtod(str.c_str(), NULL) == d);
+      ASSERT(count_digits(str) <= 17);
+    }
+    if (!isnan(f) && !isinf(f)) {
+      std::string str = fmt_float(f);
+      ASSERT(strtof(str.c_str(), NULL) == f);
+      ASSERT(count_digits(str) <= 9);
+    }
+  }
+}
+
+extern "C" {
+int run_tests(int argc, char *argv[]) {
+  UPB_UNUSED(argc);
+  UPB_UNUSED(argv);
+  test_integers();
+  test_layout();
+  test_roundtrip();
+  return 0;
+}
+}
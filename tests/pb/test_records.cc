@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "tests/upb_test.h"
+#include "upb/bindings/stdc++/string.h"
+#include "google/protobuf/descriptor.upb.h"
+#include "google/protobuf/descriptor.upbdefs.h"
+#include "upb/pb/decoder.h"
+#include "upb/pb/encoder.h"
+#include "upb/pb/records.h"
+
+#include "upb/port_def.inc"
+
+static std::string TempPath(const char *name) {
+  const char *dir = getenv("TEST_TMPDIR");
+  return std::string(dir ? dir : ".") + "/" + name;
+}
+
+static const char *names[] = {"a.proto", "", "some/longer/name.proto"};
+static const size_t kRecords = sizeof(names) / sizeof(names[0]);
+
+static void WriteRecords(const std::string& path,
+                         const std::string& index_path) {
+  upb::Arena arena;
+  FILE *out = fopen(path.c_str(), "wb");
+  FILE *index = fopen(index_path.c_str(), "wb");
+  ASSERT(out && index);
+
+  upb_recordwriter w;
+  upb_recordwriter_init(&w, out, index);
+  for (size_t i = 0; i < kRecords; i++) {
+    google_protobuf_FileDescriptorProto *file =
+        google_protobuf_FileDescriptorProto_new(arena.ptr());
+    google_protobuf_FileDescriptorProto_set_name(file,
+                                                 upb_strview_makez(names[i]));
+    ASSERT(upb_recordwriter_putmsg(
+        &w, file, &google_protobuf_FileDescriptorProto_msginit, arena.ptr()));
+  }
+
+  fclose(out);
+  fclose(index);
+}
+
+void test_read() {
+  std::string path = TempPath("test_read.records");
+  std::string index_path = path + ".index";
+  WriteRecords(path, index_path);
+
+  upb_recordfile *f = upb_recordfile_open(path.c_str(),
+                                          UPB_RECORDFILE_SEQUENTIAL);
+  ASSERT(f);
+  upb_recordreader r;
+  upb_recordreader_init(&r, upb_recordfile_data(f), upb_recordfile_size(f));
+
+  upb::Arena arena;
+  for (size_t i = 0; i < kRecords; i++) {
+    google_protobuf_FileDescriptorProto *file =
+        google_protobuf_FileDescriptorProto_new(arena.ptr());
+    ASSERT(upb_recordreader_decode(
+        &r, file, &google_protobuf_FileDescriptorProto_msginit, arena.ptr()));
+    upb_strview name = google_protobuf_FileDescriptorProto_name(file);
+    ASSERT(std::string(name.data, name.size) == names[i]);
+    /* Decoded with aliasing. */
+    ASSERT(name.size == 0 ||
+           (name.data >= upb_recordfile_data(f) &&
+            name.data < upb_recordfile_data(f) + upb_recordfile_size(f)));
+  }
+
+  upb_strview rec;
+  ASSERT(!upb_recordreader_next(&r, &rec));
+  ASSERT(upb_recordreader_ok(&r));
+  ASSERT(upb_recordreader_offset(&r) == upb_recordfile_size(f));
+
+  /* Seek backwards through the index. */
+  upb_recordfile *index = upb_recordfile_open(index_path.c_str(),
+                                              UPB_RECORDFILE_RANDOM);
+  ASSERT(index);
+  ASSERT(upb_recordindex_count(upb_recordfile_size(index)) == kRecords);
+  for (size_t i = kRecords; i > 0; i--) {
+    uint64_t ofs = upb_recordindex_get(upb_recordfile_data(index), i - 1);
+    google_protobuf_FileDescriptorProto *file =
+        google_protobuf_FileDescriptorProto_new(arena.ptr());
+    ASSERT(upb_recordreader_seek(&r, ofs));
+    ASSERT(upb_recordreader_decode(
+        &r, file, &google_protobuf_FileDescriptorProto_msginit, arena.ptr()));
+    upb_strview name = google_protobuf_FileDescriptorProto_name(file);
+    ASSERT(std::string(name.data, name.size) == names[i - 1]);
+  }
+  ASSERT(!upb_recordreader_seek(&r, upb_recordfile_size(f) + 1));
+
+  upb_recordfile_close(index);
+  upb_recordfile_close(f);
+  remove(path.c_str());
+  remove(index_path.c_str());
+}
+
+void test_put() {
+  std::string path = TempPath("test_put.records");
+  std::string index_path = path + ".index";
+  WriteRecords(path, index_path);
+
+  upb::SymbolTable symtab;
+  upb::HandlerCache encoder_cache(upb::pb::EncoderPtr::NewCache());
+  upb::pb::CodeCache decoder_cache(&encoder_cache);
+  upb::MessageDefPtr md(
+      google_protobuf_FileDescriptorProto_getmsgdef(symtab.ptr()));
+  ASSERT(md);
+  const upb::Handlers *encoder_handlers = encoder_cache.Get(md);
+  const upb::pb::DecoderMethodPtr method = decoder_cache.Get(md);
+
+  upb_recordfile *f = upb_recordfile_open(path.c_str(), 0);
+  ASSERT(f);
+  upb_recordreader r;
+  upb_recordreader_init(&r, upb_recordfile_data(f), upb_recordfile_size(f));
+
+  /* Through upb_pbdecoder and back out of upb_pb_encoder unchanged. */
+  for (size_t i = 0; i < kRecords; i++) {
+    upb::Arena arena;
+    upb::Status status;
+    std::string output;
+    upb::StringSink string_sink(&output);
+    upb::pb::EncoderPtr encoder = upb::pb::EncoderPtr::Create(
+        &arena, encoder_handlers, string_sink.input());
+    upb::pb::DecoderPtr decoder =
+        upb::pb::DecoderPtr::Create(&arena, method, encoder.input(), &status);
+    size_t ofs = upb_recordreader_offset(&r);
+    upb_strview rec;
+    ASSERT(upb_recordreader_next(&r, &rec));
+    ASSERT(upb_recordreader_seek(&r, ofs));
+    ASSERT(upb_recordreader_put(&r, decoder.input().sink()));
+    ASSERT(output == std::string(rec.data, rec.size));
+  }
+  ASSERT(!upb_recordreader_put(&r, upb_bytessink()));
+  ASSERT(upb_recordreader_ok(&r));
+
+  upb_recordfile_close(f);
+  remove(path.c_str());
+  remove(index_path.c_str());
+}
+
+void test_malformed() {
+  upb_recordreader r;
+  upb_strview rec;
+
+  /* A record whose length runs past the end. */
+  upb_recordreader_init(&r, "\x01" "a" "\x05" "abc", 5);
+  ASSERT(upb_recordreader_next(&r, &rec));
+  ASSERT(rec.size == 1 && rec.data[0] == 'a');
+  ASSERT(!upb_recordreader_next(&r, &rec));
+  ASSERT(!upb_recordreader_ok(&r));
+
+  /* A truncated length. */
+  upb_recordreader_init(&r, "\x80", 1);
+  ASSERT(!upb_recordreader_next(&r, &rec));
+  ASSERT(!upb_recordreader_ok(&r));
+
+  /* An empty file. */
+  std::string path = TempPath("test_malformed.records");
+  FILE *out = fopen(path.c_str(), "wb");
+  ASSERT(out);
+  fclose(out);
+  upb_recordfile *f = upb_recordfile_open(path.c_str(), 0);
+  ASSERT(f && upb_recordfile_size(f) == 0);
+  upb_recordreader_init(&r, upb_recordfile_data(f), upb_recordfile_size(f));
+  ASSERT(!upb_recordreader_next(&r, &rec));
+  ASSERT(upb_recordreader_ok(&r));
+  upb_recordfile_close(f);
+  remove(path.c_str());
+
+  ASSERT(!upb_recordfile_open(TempPath("does_not_exist").c_str(), 0));
+}
+
+extern "C" {
+int run_tests(int argc, char *argv[]) {
+  UPB_UNUSED(argc);
+  UPB_UNUSED(argv);
+  test_read();
+  test_put();
+  test_malformed();
+  return 0;
+}
+}
@@ -107,11 +107,71 @@ static void test_varint_decoder(upb_decoderet (*decoder)(const char*)) {
 
 TEST_VARINT_DECODER(check2_branch32)
 TEST_VARINT_DECODER(check2_branch64)
+TEST_VARINT_DECODER(fast)
+
+/* Tests that _upb_vdecode() never reads past its limit, for every way of
+ * cutting the input short. */
+static void test_vdecode_limit_for_num(uint64_t num) {
+  char buf[32];
+  size_t bytes;
+  size_t avail;
+
+  memset(buf, 0xff, sizeof(buf));
+  bytes = upb_vencode64(num, buf);
+
+  for (avail = 0; avail < sizeof(buf); avail++) {
+    uint64_t val = 0;
+    const char *end = _upb_vdecode(buf, buf + avail, &val);
+    if (avail < bytes) {
+      ASSERT(end == NULL);
+    } else {
+      ASSERT(end == buf + bytes);
+      ASSERT(val == num);
+    }
+  }
+}
+
+static void test_vdecode_limit(void) {
+  uint64_t num;
+  char eleven[16] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1};
+  uint64_t val;
+
+  for (num = 5; num * 1.5 < UINT64_MAX; num *= 1.5) {
+    test_vdecode_limit_for_num(num);
+  }
+  test_vdecode_limit_for_num(0);
+  test_vdecode_limit_for_num(UINT64_MAX);
+
+  /* Varints longer than ten bytes are an error. */
+  ASSERT(_upb_vdecode(eleven, eleven + 11, &val) == NULL);
+  ASSERT(_upb_vdecode(eleven, eleven + sizeof(eleven), &val) == NULL);
+}
+
+static void test_vcount(void) {
+  char buf[64];
+  char *p = buf;
+  size_t i;
+
+  /* Varints of every length from 1 to 10 bytes, so they straddle the 8-byte
+   * words that _upb_vcount() reads at a time. */
+  for (i = 0; i < 10; i++) {
+    p += upb_vencode64(i == 0 ? 0 : (uint64_t)1 << (i * 7), p);
+    ASSERT(_upb_vcount(buf, p) == i + 1);
+  }
+
+  /* An unterminated varint at the end isn't counted. */
+  *p++ = (char)0x80;
+  ASSERT(_upb_vcount(buf, p) == 10);
+  ASSERT(_upb_vcount(buf, buf) == 0);
+}
 
 int run_tests(int argc, char *argv[]) {
   UPB_UNUSED(argc);
   UPB_UNUSED(argv);
   test_check2_branch32();
   test_check2_branch64();
+  test_fast();
+  test_vdecode_limit();
+  test_vcount();
   return 0;
 }
@@ -0,0 +1,153 @@
+/*
+ * Tests for upb_arena.
+ */
+
+#include <string.h>
+
+#include "tests/upb_test.h"
+#include "upb/upb.h"
+
+void TestArena() {
+  upb::Arena arena;
+  char *a = static_cast<char*>(upb_arena_malloc(arena.ptr(), 16));
+  char *b;
+
+  memset(a, 'x', 16);
+
+  /* The last allocation grows and shrinks in place. */
+  ASSERT(upb_arena_realloc(arena.ptr(), a, 16, 64) == a);
+  ASSERT(upb_arena_realloc(arena.ptr(), a, 64, 32) == a);
+  ASSERT(a[15] == 'x');
+
+  /* Once something else is allocated, realloc has to copy. */
+  b = static_cast<char*>(upb_arena_malloc(arena.ptr(), 16));
+  ASSERT(b != NULL);
+  b = static_cast<char*>(upb_arena_realloc(arena.ptr(), a, 32, 64));
+  ASSERT(b != a);
+  ASSERT(memcmp(b, a, 16) == 0);
+
+  /* Growing past the end of the block also has to move. */
+  a = static_cast<char*>(upb_arena_realloc(arena.ptr(), b, 64, 1 << 20));
+  ASSERT(a != NULL && a != b);
+  ASSERT(a[0] == 'x');
+
+  /* An arena without a block allocator can't grow. */
+  {
+    char mem[1024];
+    upb_arena *fixed = upb_arena_init(mem, sizeof(mem), NULL);
+    ASSERT(upb_arena_malloc(fixed, 16) != NULL);
+    ASSERT(upb_arena_malloc(fixed, 2048) == NULL);
+    upb_arena_free(fixed);
+  }
+}
+
+static void CountCleanup(void *ud) { (*static_cast<int*>(ud))++; }
+
+struct CountingAlloc {
+  upb_alloc alloc;  /* Must be first. */
+  int mallocs;
+};
+
+static void *CountingAllocFunc(upb_alloc *alloc, void *ptr, size_t oldsize,
+                               size_t size) {
+  CountingAlloc *counting = reinterpret_cast<CountingAlloc*>(alloc);
+  if (!ptr && size) counting->mallocs++;
+  return upb_alloc_global.func(&upb_alloc_global, ptr, oldsize, size);
+}
+
+void TestArenaReset() {
+  int cleanups = 0;
+  CountingAlloc alloc = {{&CountingAllocFunc}, 0};
+  upb_arena *arena = upb_arena_init(NULL, 0, &alloc.alloc);
+  int mallocs;
+
+  /* Grow the arena to size once. */
+  for (int i = 0; i < 100; i++) ASSERT(upb_arena_malloc(arena, 100) != NULL);
+  upb_arena_addcleanup(arena, &cleanups, &CountCleanup);
+  upb_arena_reset(arena);
+  ASSERT(cleanups == 1);
+  ASSERT(upb_arena_bytesallocated(arena) == 0);
+
+  /* Later rounds of the same work fit in the retained block. */
+  mallocs = alloc.mallocs;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 100; i++) ASSERT(upb_arena_malloc(arena, 100) != NULL);
+    upb_arena_reset(arena);
+  }
+  ASSERT(alloc.mallocs == mallocs);
+
+  /* Without retained blocks, the same work has to allocate again. */
+  upb_arena_setmaxretained(arena, 0);
+  upb_arena_reset(arena);
+  for (int i = 0; i < 100; i++) ASSERT(upb_arena_malloc(arena, 100) != NULL);
+  ASSERT(alloc.mallocs > mallocs);
+
+  upb_arena_free(arena);
+  ASSERT(cleanups == 1);
+}
+
+/* Returns how many blocks |arena| allocates for 1MB in 1kB pieces. */
+static int CountBlocks(const upb_arena_options *opts) {
+  CountingAlloc alloc = {{&CountingAllocFunc}, 0};
+  upb_arena *arena = upb_arena_initopts(NULL, 0, &alloc.alloc, opts);
+  for (int i = 0; i < 1024; i++) ASSERT(upb_arena_malloc(arena, 1024) != NULL);
+  upb_arena_free(arena);
+  return alloc.mallocs;
+}
+
+void TestArenaOptions() {
+  upb_arena_options opts = {0, 0, 0};
+  int defaults = CountBlocks(NULL);
+
+  ASSERT(CountBlocks(&opts) == defaults);
+
+  opts.max_block_size = 1 << 20;
+  ASSERT(CountBlocks(&opts) < defaults);
+
+  opts.initial_block_size = 1 << 20;
+  opts.growth_factor = 4;
+  ASSERT(CountBlocks(&opts) <= 2);
+}
+
+void TestArenaFuse() {
+  int cleanups = 0;
+  upb_arena *a = upb_arena_new();
+  upb_arena *b = upb_arena_new();
+  upb_arena *c = upb_arena_new();
+
+  upb_arena_addcleanup(a, &cleanups, &CountCleanup);
+  upb_arena_addcleanup(b, &cleanups, &CountCleanup);
+  ASSERT(upb_arena_fuse(a, b));
+  ASSERT(upb_arena_fuse(b, a));  /* Already fused. */
+  ASSERT(upb_arena_fuse(c, b));
+
+  /* Nothing is freed until every arena of the group is. */
+  upb_arena_free(a);
+  upb_arena_free(c);
+  ASSERT(cleanups == 0);
+  ASSERT(upb_arena_malloc(b, 16) != NULL);
+  upb_arena_free(b);
+  ASSERT(cleanups == 2);
+
+  /* Caller-supplied memory can't outlive its arena. */
+  {
+    char mem[1024];
+    upb::Arena arena;
+    upb_arena *fixed = upb_arena_init(mem, sizeof(mem), &upb_alloc_global);
+    ASSERT(!upb_arena_fuse(fixed, arena.ptr()));
+    upb_arena_free(fixed);
+  }
+}
+
+extern "C" {
+
+int run_tests(int argc, char *argv[]) {
+  TestArena();
+  TestArenaFuse();
+  TestArenaReset();
+  TestArenaOptions();
+
+  return 0;
+}
+
+}
@@ -10,11 +10,19 @@
 #include <iostream>
 #include <set>
 #include <sstream>
+#include <type_traits>
+#include <vector>
 
+#include "google/protobuf/descriptor.upb.h"
+#include "tests/test_cpp.upb.h"
 #include "tests/test_cpp.upbdefs.h"
 #include "tests/upb_test.h"
+#include "upb/bindings/stdc++/string.h"
+#include "upb/decode.h"
 #include "upb/def.h"
+#include "upb/encode.h"
 #include "upb/handlers.h"
+#include "upb/msgfactory.h"
 #include "upb/pb/decoder.h"
 #include "upb/pb/textprinter.h"
 #include "upb/port_def.inc"
@@ -894,6 +902,35 @@ void TestHandlerDataDestruction() {
   ASSERT(x == 0);
 }
 
+void CountHandlers(const void* closure, upb::Handlers* h) {
+  UPB_UNUSED(h);
+  (*const_cast<int*>(static_cast<const int*>(closure)))++;
+}
+
+void TestHandlerCacheFreeze() {
+  int built = 0;
+  upb::SymbolTable symtab;
+  upb::SymbolTable other;
+  upb::HandlerCache cache(&CountHandlers, &built);
+  upb::MessageDefPtr md(upb_test_TestMessage_getmsgdef(symtab.ptr()));
+  upb::MessageDefPtr other_md(upb_test_TestMessage_getmsgdef(other.ptr()));
+  upb::MessageDefPtr maps(upb_test_TestMaps_getmsgdef(symtab.ptr()));
+
+  /* Every message of test_cpp.proto, map entries included. */
+  ASSERT(cache.AddSymtab(symtab));
+  ASSERT(built > 3);
+  int count = built;
+  const upb_handlers *h = cache.Get(md);
+  ASSERT(h && cache.Get(maps) && built == count);
+
+  ASSERT(!cache.frozen());
+  cache.Freeze();
+  ASSERT(cache.frozen());
+  ASSERT(cache.Get(md) == h);
+  ASSERT(cache.Get(other_md) == NULL);
+  ASSERT(built == count);
+}
+
 void TestIteration() {
   upb::SymbolTable symtab;
   upb::MessageDefPtr md(upb_test_TestMessage_getmsgdef(symtab.ptr()));
@@ -914,8 +951,527 @@ void TestIteration() {
   ASSERT(oneof_count == md.oneof_count());
 }
 
+// Serializes a one-message file whose field "msg" has type |type_name|.
+static std::string MakeLazyFile(const char *name, const char *package,
+                                const char *dep, const char *type_name) {
+  upb::Arena arena;
+  google_protobuf_FileDescriptorProto *file =
+      google_protobuf_FileDescriptorProto_new(arena.ptr());
+  google_protobuf_FileDescriptorProto_set_name(file, upb_strview_makez(name));
+  google_protobuf_FileDescriptorProto_set_package(file,
+                                                  upb_strview_makez(package));
+  if (dep) {
+    google_protobuf_FileDescriptorProto_add_dependency(
+        file, upb_strview_makez(dep), arena.ptr());
+  }
+  google_protobuf_DescriptorProto *msg =
+      google_protobuf_FileDescriptorProto_add_message_type(file, arena.ptr());
+  google_protobuf_DescriptorProto_set_name(msg, upb_strview_makez("Holder"));
+  google_protobuf_FieldDescriptorProto *f =
+      google_protobuf_DescriptorProto_add_field(msg, arena.ptr());
+  google_protobuf_FieldDescriptorProto_set_name(f, upb_strview_makez("msg"));
+  google_protobuf_FieldDescriptorProto_set_number(f, 1);
+  google_protobuf_FieldDescriptorProto_set_label(
+      f, google_protobuf_FieldDescriptorProto_LABEL_OPTIONAL);
+  google_protobuf_FieldDescriptorProto_set_type(
+      f, google_protobuf_FieldDescriptorProto_TYPE_MESSAGE);
+  google_protobuf_FieldDescriptorProto_set_type_name(
+      f, upb_strview_makez(type_name));
+  size_t size;
+  char *buf =
+      google_protobuf_FileDescriptorProto_serialize(file, arena.ptr(), &size);
+  return std::string(buf, size);
+}
+
+// Appends |file| to a serialized FileDescriptorSet.
+static void AppendSetFile(std::string *set, const std::string &file) {
+  set->push_back('\x0a');
+  size_t len = file.size();
+  do {
+    set->push_back((char)((len & 0x7f) | (len > 0x7f ? 0x80 : 0)));
+    len >>= 7;
+  } while (len);
+  set->append(file);
+}
+
+void TestLazySymtab() {
+  // The set lists dep.proto before the file it depends on.
+  const upb_strview cpp = tests_test_cpp_proto_upbdefinit.descriptor;
+  std::string dep = MakeLazyFile("dep.proto", "upb.dep",
+                                 "tests/test_cpp.proto",
+                                 ".upb.test.TestMessage");
+  std::string broken =
+      MakeLazyFile("broken.proto", "upb.broken", NULL, ".upb.nowhere.Message");
+  std::string set;
+  AppendSetFile(&set, dep);
+  AppendSetFile(&set, std::string(cpp.data, cpp.size));
+
+  upb::SymbolTable symtab;
+  upb::Status status;
+  upb_symtab *s = symtab.ptr();
+  ASSERT(upb_symtab_addset_lazy(s, set.data(), set.size(), status.ptr()));
+  ASSERT(upb_symtab_lookupmsg(s, "upb.dep.Missing") == NULL);
+
+  // Looking up dep.proto's message builds it and, first, its dependency.
+  const upb_msgdef *holder = upb_symtab_lookupmsg(s, "upb.dep.Holder");
+  ASSERT(holder);
+  ASSERT(upb_msgdef_file(holder) == upb_symtab_lookupfile(s, "dep.proto"));
+  const upb_msgdef *test_msg = upb_symtab_lookupmsg(s, "upb.test.TestMessage");
+  ASSERT(test_msg);
+  ASSERT(upb_fielddef_msgsubdef(upb_msgdef_ntofz(holder, "msg")) == test_msg);
+  ASSERT(upb_symtab_lookupmsg(s, "upb.test.TestMaps.StrI32Entry"));
+
+  // Generated code finds its file already built.
+  ASSERT(upb_test_TestMessage_getmsgdef(s) == test_msg);
+
+  // Files and symbols can't be added twice, whether built yet or not.
+  ASSERT(!upb_symtab_addfile_lazy(s, dep.data(), dep.size(), status.ptr()));
+  std::string dup = MakeLazyFile("dup.proto", "upb.dep", NULL,
+                                 ".upb.dep.Holder");
+  ASSERT(!upb_symtab_addfile_lazy(s, dup.data(), dup.size(), status.ptr()));
+  ASSERT(!upb_symtab_addset_lazy(s, "\x0a\x05", 2, status.ptr()));
+
+  // A file whose errors only show when it is built fails its lookups.
+  ASSERT(upb_symtab_addfile_lazy(s, broken.data(), broken.size(),
+                                 status.ptr()));
+  ASSERT(upb_symtab_lookupmsg(s, "upb.broken.Holder") == NULL);
+  ASSERT(upb_symtab_lookupfile(s, "broken.proto") == NULL);
+}
+
+void TestFrozenFactory() {
+  const upb_strview cpp = tests_test_cpp_proto_upbdefinit.descriptor;
+  std::string dep = MakeLazyFile("dep.proto", "upb.dep",
+                                 "tests/test_cpp.proto",
+                                 ".upb.test.TestMessage");
+  std::string broken =
+      MakeLazyFile("broken.proto", "upb.broken", NULL, ".upb.nowhere.Message");
+  std::string later = MakeLazyFile("later.proto", "upb.later", NULL,
+                                   ".upb.later.Holder");
+  upb::Status status;
+  upb_symtab *s = upb_symtab_new();
+  ASSERT(upb_symtab_addfile_lazy(s, dep.data(), dep.size(), status.ptr()));
+  ASSERT(upb_symtab_addfile_lazy(s, cpp.data, cpp.size, status.ptr()));
+
+  // Nothing is built until buildall.
+  upb_symtab_iter i;
+  upb_symtab_begin(&i, s);
+  ASSERT(upb_symtab_done(&i));
+  ASSERT(upb_symtab_buildall(s, status.ptr()));
+  int files = 0;
+  for (upb_symtab_begin(&i, s); !upb_symtab_done(&i); upb_symtab_next(&i)) {
+    ASSERT(upb_symtab_lookupfile(
+               s, upb_filedef_name(upb_symtab_iter_file(&i))) ==
+           upb_symtab_iter_file(&i));
+    files++;
+  }
+  ASSERT(files == 2);
+
+  upb_msgfactory *factory = upb_msgfactory_new(s);
+  ASSERT(upb_msgfactory_freeze(factory));
+  const upb_msgdef *holder = upb_symtab_lookupmsg(s, "upb.dep.Holder");
+  const upb_msgdef *test_msg = upb_symtab_lookupmsg(s, "upb.test.TestMessage");
+  const upb_msglayout *l = upb_msgfactory_getlayout(factory, holder);
+  ASSERT(l && l->field_count == 1 && l->submsgs[0] ==
+         upb_msgfactory_getlayout(factory, test_msg));
+
+  // Files built after the factory was frozen have no layouts, and a failed
+  // build is reported by buildall.
+  ASSERT(upb_symtab_addfile_lazy(s, later.data(), later.size(), status.ptr()));
+  ASSERT(upb_symtab_addfile_lazy(s, broken.data(), broken.size(),
+                                 status.ptr()));
+  ASSERT(!upb_symtab_buildall(s, status.ptr()));
+  ASSERT(!status.ok());
+  ASSERT(upb_msgfactory_getlayout(
+             factory, upb_symtab_lookupmsg(s, "upb.later.Holder")) == NULL);
+
+  upb_msgfactory_free(factory);
+  upb_symtab_free(s);
+}
+
+// Adds message |name| to |file| with a message field of each type in |types|,
+// numbered from 1.
+static void AddCycleMessage(google_protobuf_FileDescriptorProto *file,
+                            const char *name,
+                            const std::vector<const char*> &types,
+                            upb_arena *arena) {
+  google_protobuf_DescriptorProto *msg =
+      google_protobuf_FileDescriptorProto_add_message_type(file, arena);
+  google_protobuf_DescriptorProto_set_name(msg, upb_strview_makez(name));
+  for (size_t i = 0; i < types.size(); i++) {
+    google_protobuf_FieldDescriptorProto *f =
+        google_protobuf_DescriptorProto_add_field(msg, arena);
+    google_protobuf_FieldDescriptorProto_set_name(
+        f, upb_strview_makez(i ? "f2" : "f1"));
+    google_protobuf_FieldDescriptorProto_set_number(f, i + 1);
+    google_protobuf_FieldDescriptorProto_set_label(
+        f, google_protobuf_FieldDescriptorProto_LABEL_OPTIONAL);
+    google_protobuf_FieldDescriptorProto_set_type(
+        f, google_protobuf_FieldDescriptorProto_TYPE_MESSAGE);
+    google_protobuf_FieldDescriptorProto_set_type_name(
+        f, upb_strview_makez(types[i]));
+  }
+}
+
+static upb_alloc_func *real_allocfunc;
+static int alloc_budget;
+
+// Fails the allocation after |alloc_budget| others.
+static void *FailingAlloc(upb_alloc *alloc, void *ptr, size_t oldsize,
+                          size_t size) {
+  if (size > 0 && alloc_budget-- == 0) return NULL;
+  return real_allocfunc(alloc, ptr, oldsize, size);
+}
+
+static const upb_msglayout *SubLayout(const upb_msglayout *l, int i) {
+  return l->submsgs[l->fields[i].submsg_index];
+}
+
+void TestFactoryAllocFailure() {
+  // A { B f1; C f2; }  B { A f1; }  C { C f1; }
+  upb::Arena arena;
+  google_protobuf_FileDescriptorProto *file =
+      google_protobuf_FileDescriptorProto_new(arena.ptr());
+  google_protobuf_FileDescriptorProto_set_name(
+      file, upb_strview_makez("cycle.proto"));
+  google_protobuf_FileDescriptorProto_set_package(
+      file, upb_strview_makez("upb.cycle"));
+  AddCycleMessage(file, "A", {".upb.cycle.B", ".upb.cycle.C"}, arena.ptr());
+  AddCycleMessage(file, "B", {".upb.cycle.A"}, arena.ptr());
+  AddCycleMessage(file, "C", {".upb.cycle.C"}, arena.ptr());
+  upb::Status status;
+  upb_symtab *s = upb_symtab_new();
+  ASSERT(upb_symtab_addfile(s, file, status.ptr()));
+  const upb_msgdef *a = upb_symtab_lookupmsg(s, "upb.cycle.A");
+
+  // Whichever allocation fails, the layouts built so far are dropped and a
+  // second try gives a complete set.
+  real_allocfunc = upb_alloc_global.func;
+  for (int budget = 0;; budget++) {
+    upb_msgfactory *factory = upb_msgfactory_new(s);
+    alloc_budget = budget;
+    upb_alloc_global.func = &FailingAlloc;
+    const upb_msglayout *l = upb_msgfactory_getlayout(factory, a);
+    upb_alloc_global.func = real_allocfunc;
+    bool failed = !l;
+    if (failed) l = upb_msgfactory_getlayout(factory, a);
+    ASSERT(l);
+    ASSERT(SubLayout(SubLayout(l, 0), 0) == l);
+    ASSERT(SubLayout(SubLayout(l, 1), 0) == SubLayout(l, 1));
+    upb_msgfactory_free(factory);
+    if (!failed) break;
+  }
+
+  upb_symtab_free(s);
+}
+
+void TestFactoryHasbits() {
+  // M { Sub s = 1; int32 a = 2; Sub t = 3; Sub u = 4; }, whose submessage
+  // fields come first in upb_fielddef_index() order.
+  upb::Arena arena;
+  google_protobuf_FileDescriptorProto *file =
+      google_protobuf_FileDescriptorProto_new(arena.ptr());
+  google_protobuf_FileDescriptorProto_set_name(
+      file, upb_strview_makez("hasbits.proto"));
+  google_protobuf_FileDescriptorProto_set_package(
+      file, upb_strview_makez("upb.hasbits"));
+  AddCycleMessage(file, "Sub", {}, arena.ptr());
+  google_protobuf_DescriptorProto *msg =
+      google_protobuf_FileDescriptorProto_add_message_type(file, arena.ptr());
+  google_protobuf_DescriptorProto_set_name(msg, upb_strview_makez("M"));
+  const char *names[] = {"s", "a", "t", "u"};
+  for (int i = 0; i < 4; i++) {
+    google_protobuf_FieldDescriptorProto *f =
+        google_protobuf_DescriptorProto_add_field(msg, arena.ptr());
+    google_protobuf_FieldDescriptorProto_set_name(f,
+                                                  upb_strview_makez(names[i]));
+    google_protobuf_FieldDescriptorProto_set_number(f, i + 1);
+    google_protobuf_FieldDescriptorProto_set_label(
+        f, google_protobuf_FieldDescriptorProto_LABEL_OPTIONAL);
+    if (i == 1) {
+      google_protobuf_FieldDescriptorProto_set_type(
+          f, google_protobuf_FieldDescriptorProto_TYPE_INT32);
+    } else {
+      google_protobuf_FieldDescriptorProto_set_type(
+          f, google_protobuf_FieldDescriptorProto_TYPE_MESSAGE);
+      google_protobuf_FieldDescriptorProto_set_type_name(
+          f, upb_strview_makez(".upb.hasbits.Sub"));
+    }
+  }
+  upb::Status status;
+  upb_symtab *s = upb_symtab_new();
+  ASSERT(upb_symtab_addfile(s, file, status.ptr()));
+  upb_msgfactory *factory = upb_msgfactory_new(s);
+  const upb_msgdef *m = upb_symtab_lookupmsg(s, "upb.hasbits.M");
+  const upb_msglayout *l = upb_msgfactory_getlayout(factory, m);
+  ASSERT(l);
+
+  // Hasbits follow field numbers, which the encoder relies on to skip runs of
+  // absent fields.
+  for (int i = 0; i < l->field_count; i++) {
+    ASSERT(l->fields[i].number == i + 1);
+    ASSERT(l->fields[i].presence == i + 1);
+  }
+
+  // Each field on its own, and all of them: {s {}}, {a: 5}, {t {}}, {u {}}.
+  const std::string fields[] = {std::string("\x0a\x00", 2), "\x10\x05",
+                                std::string("\x1a\x00", 2),
+                                std::string("\x22\x00", 2)};
+  std::string all;
+  for (int i = 0; i <= 4; i++) {
+    const std::string &input = i < 4 ? fields[i] : all;
+    upb_msg *parsed = upb_msg_new(l, arena.ptr());
+    ASSERT(upb_decode(input.data(), input.size(), parsed, l, arena.ptr()));
+    size_t size, fwd_size;
+    char *data = upb_encode(parsed, l, arena.ptr(), &size);
+    char *fwd = upb_encode_ex(parsed, l, arena.ptr(), UPB_ENCODE_FORWARD,
+                              &fwd_size);
+    ASSERT(std::string(data, size) == input);
+    ASSERT(std::string(fwd, fwd_size) == input);
+    if (i < 4) all += fields[i];
+  }
+
+  upb_msgfactory_free(factory);
+  upb_symtab_free(s);
+}
+
+void TestFactoryPacking() {
+  // TestMessage has four hasbits, a string, five pointers and an int32, which
+  // only fit without padding largest first.
+  upb::SymbolTable symtab;
+  upb_msgfactory *factory = upb_msgfactory_new(symtab.ptr());
+  const upb_msglayout *l = upb_msgfactory_getlayout(
+      factory, upb_test_TestMessage_getmsgdef(symtab.ptr()));
+  size_t end = sizeof(void*) + sizeof(upb_strview) + 5 * sizeof(void*) +
+               sizeof(int32_t);
+  ASSERT(l);
+  ASSERT(l->size == (end + 7) / 8 * 8);
+  ASSERT(l->fields[0].number == 1 && l->fields[0].offset == end - 4);
+  ASSERT(l->fields[2].number == 3 && l->fields[2].offset == sizeof(void*));
+  upb_msgfactory_free(factory);
+}
+
 extern "C" {
 
+static void CountCleanup(void *ud) { (*static_cast<int*>(ud))++; }
+
+static std::string BufferSinkContents(const upb::BufferSink& sink) {
+  std::string ret;
+  for (size_t i = 0; i < sink.chunk_count(); i++) {
+    upb_strview chunk = sink.chunk(i);
+    ret.append(chunk.data, chunk.size);
+  }
+  return ret;
+}
+
+void TestStringSinks() {
+  std::string data(40, 'x');
+  for (size_t i = 0; i < data.size(); i++) data[i] = 'a' + i % 26;
+
+  {
+    std::string str("old");
+    upb::StringSink sink(&str);
+    ASSERT(upb_bufsrc_putbuf(data.data(), data.size(), sink.input().sink()));
+    ASSERT(str == data);
+  }
+
+  {
+    upb::BufferSink sink(16);
+    upb::BytesSink input = sink.input();
+    void *subc;
+    const char *first;
+
+    ASSERT(input.Start(0, &subc));
+    ASSERT(input.PutBuffer(subc, data.data(), 10, NULL) == 10);
+    ASSERT(input.PutBuffer(subc, data.data() + 10, 30, NULL) == 30);
+    ASSERT(input.End());
+    ASSERT(sink.chunk_count() == 3);
+    ASSERT(sink.chunk(0).size == 16 && sink.chunk(2).size == 8);
+    ASSERT(sink.size() == 40);
+    ASSERT(BufferSinkContents(sink) == data);
+    first = sink.chunk(0).data;
+
+    /* The next string reuses the chunks. */
+    ASSERT(upb_bufsrc_putbuf(data.data(), 16, input.sink()));
+    ASSERT(sink.chunk_count() == 1 && sink.chunk(0).data == first);
+    ASSERT(BufferSinkContents(sink) == data.substr(0, 16));
+
+    sink.Clear();
+    ASSERT(sink.size() == 0 && sink.chunk_count() == 0);
+  }
+
+  {
+    upb::Arena arena;
+    upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+    std::string out(100, 'x');
+    upb_test_TestMessage_set_i32(msg, 42);
+    ASSERT(upb::EncodeToString(msg, &upb_test_TestMessage_msginit, &out));
+    ASSERT(out == "\x08\x2a");
+
+    out.clear();
+    out.shrink_to_fit();
+    upb_test_TestMessage_set_str(msg, upb_strview_make(data.data(),
+                                                       data.size()));
+    ASSERT(upb::EncodeToString(msg, &upb_test_TestMessage_msginit, &out));
+    ASSERT(out.size() == 2 + 2 + data.size());
+    ASSERT(out.substr(4) == data);
+  }
+}
+
+static upb::MessageHandle<upb_test_TestMessage> ParseHandle(
+    const std::string& data) {
+  upb::Arena arena;
+  upb_test_TestMessage *msg =
+      upb_test_TestMessage_parse(data.data(), data.size(), arena.ptr());
+  return upb::MessageHandle<upb_test_TestMessage>(msg, std::move(arena));
+}
+
+/* An InlinedArena's block goes away with the object, so the arena can't be
+ * moved out of it, into a handle or into a plain upb::Arena. */
+static_assert(!std::is_constructible<
+                  upb::MessageHandle<upb_test_TestMessage>,
+                  upb_test_TestMessage*, upb::InlinedArena<64>&&>::value,
+              "InlinedArena moved into a MessageHandle");
+static_assert(!std::is_constructible<upb::Arena,
+                                     upb::InlinedArena<64>&&>::value,
+              "InlinedArena moved into an Arena");
+static_assert(!std::is_move_constructible<upb::InlinedArena<64>>::value,
+              "InlinedArena moved");
+static_assert(std::is_constructible<upb::MessageHandle<upb_test_TestMessage>,
+                                    upb_test_TestMessage*,
+                                    upb::Arena&&>::value,
+              "Arena not moved into a MessageHandle");
+
+void TestInlinedArena() {
+  int cleanups = 0;
+
+  {
+    upb::InlinedArena<4096> arena;
+    const char *begin = reinterpret_cast<const char*>(&arena);
+    const char *end = begin + sizeof(arena);
+    char *p = static_cast<char*>(upb_arena_malloc(arena.ptr(), 1024));
+
+    /* The first allocations come from the block inside the object. */
+    ASSERT(p >= begin && p + 1024 <= end);
+    p = static_cast<char*>(upb_arena_malloc(arena.ptr(), 1024));
+    ASSERT(p >= begin && p + 1024 <= end);
+    ASSERT(upb_arena_malloc(arena.ptr(), 16 * 1024) != NULL);
+    ASSERT(arena.AddCleanup(&cleanups, &CountCleanup));
+  }
+  ASSERT(cleanups == 1);
+
+  upb::MessageHandle<upb_test_TestMessage> handle =
+      ParseHandle(std::string("\x08\x2a", 2));
+  ASSERT(handle);
+  ASSERT(upb_test_TestMessage_i32(handle.get()) == 42);
+  upb_test_TestMessage_set_i32(
+      upb_test_TestMessage_mutable_lazy_msg(handle.get(), handle.arena()->ptr()),
+      7);
+
+  upb::MessageHandle<upb_test_TestMessage> moved(std::move(handle));
+  ASSERT(!handle);
+  ASSERT(upb_test_TestMessage_i32(moved.get()) == 42);
+  ASSERT(upb_test_TestMessage_i32(upb_test_TestMessage_lazy_msg(moved.get())) ==
+         7);
+
+  handle = ParseHandle(std::string("\x08", 1));
+  ASSERT(!handle);
+  moved = std::move(handle);
+  ASSERT(!moved);
+}
+
+/* Decodes |input| with upb_pbdecoder straight into a message of layout |l|,
+ * |chunk| bytes at a time, and returns the message encoded again. */
+static std::string DecodeForMsg(upb::MessageDefPtr md, const upb_msglayout *l,
+                                const std::string& input, size_t chunk,
+                                bool *ok) {
+  upb::pb::CodeCache cache(nullptr);
+  upb::Arena arena;
+  upb::Status status;
+  upb_msg *msg = upb_msg_new(l, arena.ptr());
+  upb::pb::DecoderMethodPtr method = cache.GetForMsg(md, l);
+  ASSERT(method.ptr());
+  ASSERT(!method.dest_handlers());
+  upb::pb::DecoderPtr decoder =
+      upb::pb::DecoderPtr::CreateForMsg(&arena, method, msg, &status);
+  ASSERT(decoder.ptr());
+
+  upb_bytessink sink = decoder.input().sink();
+  void *subc;
+  *ok = upb_bytessink_start(sink, input.size(), &subc);
+  for (size_t ofs = 0; *ok && ofs < input.size(); ofs += chunk) {
+    size_t n = input.size() - ofs < chunk ? input.size() - ofs : chunk;
+    /* More than |n| says that the bytes after it are being skipped. */
+    *ok = upb_bytessink_putbuf(sink, subc, input.data() + ofs, n, NULL) >= n;
+  }
+  *ok = *ok && upb_bytessink_end(sink) && status.ok();
+
+  size_t size;
+  char *data = upb_encode(msg, l, arena.ptr(), &size);
+  return std::string(data, size);
+}
+
+void TestPbDecoderForMsg() {
+  upb::SymbolTable symtab;
+  upb::Arena arena;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_mutable_msg(msg, arena.ptr());
+  upb_test_TestMessage_set_i32(msg, -1);
+  upb_test_TestMessage_set_str(msg, upb_strview_makez("a string"));
+  upb_test_TestMessage_set_str(sub, upb_strview_makez(""));
+  for (int i = 0; i < 3; i++) {
+    upb_test_TestMessage *r = upb_test_TestMessage_add_r_msg(msg, arena.ptr());
+    ASSERT(r);
+    upb_test_TestMessage_set_i32(r, 1000 * i);
+    ASSERT(upb_test_TestMessage_add_r_i32(sub, i * 300, arena.ptr()));
+    ASSERT(upb_test_TestMessage_add_r_str(msg, upb_strview_makez("r"),
+                                          arena.ptr()));
+  }
+  upb_test_TestMessage_set_i32(
+      upb_test_TestMessage_mutable_lazy_msg(sub, arena.ptr()), 7);
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+  std::string expected(data, size);
+  upb::MessageDefPtr md(upb_test_TestMessage_getmsgdef(symtab.ptr()));
+
+  /* The unknown field 100 is skipped. */
+  std::string input = std::string("\xa2\x06\x03xyz", 6) + expected;
+  for (size_t chunk = 1; chunk <= input.size(); chunk++) {
+    bool ok;
+    ASSERT(DecodeForMsg(md, &upb_test_TestMessage_msginit, input, chunk,
+                        &ok) == expected);
+    ASSERT(ok);
+  }
+
+  bool ok;
+  DecodeForMsg(md, &upb_test_TestMessage_msginit,
+               input.substr(0, input.size() - 1), 5, &ok);
+  ASSERT(!ok);
+
+  /* Maps, with a repeated key and a missing message value. */
+  upb_test_TestMaps *maps = upb_test_TestMaps_new(arena.ptr());
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("a"), 1,
+                                       arena.ptr()));
+  ASSERT(upb_test_TestMaps_i32_msg_set(maps, -1, sub, arena.ptr()));
+  data = upb_test_TestMaps_serialize(maps, arena.ptr(), &size);
+  ASSERT(data);
+  input = std::string(data, size);
+  input += "\x0a\x05\x0a\x01\x61\x10\x02";  /* {"a": 2} */
+  input += "\x12\x02\x08\x07";              /* {7: {}} */
+  upb_test_TestMaps *parsed =
+      upb_test_TestMaps_parse(input.data(), input.size(), arena.ptr());
+  ASSERT(parsed);
+  data = upb_test_TestMaps_serialize(parsed, arena.ptr(), &size);
+  ASSERT(data);
+  md = upb::MessageDefPtr(upb_test_TestMaps_getmsgdef(symtab.ptr()));
+  for (size_t chunk = 1; chunk <= input.size(); chunk++) {
+    ASSERT(DecodeForMsg(md, &upb_test_TestMaps_msginit, input, chunk, &ok) ==
+           std::string(data, size));
+    ASSERT(ok);
+  }
+}
+
 int run_tests(int argc, char *argv[]) {
   TestHandler<ValueTesterInt32VoidFunctionNoHandlerData>();
   TestHandler<ValueTesterInt32BoolFunctionNoHandlerData>();
@@ -949,7 +1505,16 @@ int run_tests(int argc, char *argv[]) {
   TestMismatchedTypes();
 
   TestHandlerDataDestruction();
+  TestHandlerCacheFreeze();
   TestIteration();
+  TestLazySymtab();
+  TestFrozenFactory();
+  TestFactoryAllocFailure();
+  TestFactoryHasbits();
+  TestFactoryPacking();
+  TestInlinedArena();
+  TestStringSinks();
+  TestPbDecoderForMsg();
 
   return 0;
 }
@@ -0,0 +1,786 @@
+/*
+ * Tests for upb_decode() and the other decoders in upb/decode.h.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/descriptor.upb.h"
+#include "tests/test_cpp.upb.h"
+#include "tests/upb_test.h"
+#include "upb/decode.h"
+#include "upb/encode.h"
+#include "upb/stats.h"
+#include "upb/upb.h"
+
+void TestLazySubmsg() {
+  upb::Arena arena;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_mutable_lazy_msg(msg, arena.ptr());
+  upb_test_TestMessage_set_i32(sub, 42);
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+  std::string encoded(data, size);
+  ASSERT(encoded == "\x3a\x02\x08\x2a");
+
+  /* Sent twice, and decoded with strings copied out of the input. */
+  std::string input = encoded + encoded;
+  upb_test_TestMessage *parsed = upb_test_TestMessage_parse_ex(
+      input.data(), input.size(), arena.ptr(), 0);
+  ASSERT(parsed);
+  input.assign(input.size(), 'x');
+  ASSERT(upb_test_TestMessage_has_lazy_msg(parsed));
+
+  /* Untouched, the merged bytes are written back as they were read. */
+  data = upb_test_TestMessage_serialize(parsed, arena.ptr(), &size);
+  ASSERT(std::string(data, size) == "\x3a\x04\x08\x2a\x08\x2a");
+  data = upb_encode_ex(parsed, &upb_test_TestMessage_msginit, arena.ptr(),
+                       UPB_ENCODE_FORWARD, &size);
+  ASSERT(std::string(data, size) == "\x3a\x04\x08\x2a\x08\x2a");
+
+  const upb_test_TestMessage *lazy = upb_test_TestMessage_lazy_msg(parsed);
+  ASSERT(lazy);
+  ASSERT(upb_test_TestMessage_i32(lazy) == 42);
+  ASSERT(upb_test_TestMessage_lazy_msg(parsed) == lazy);
+
+  data = upb_test_TestMessage_serialize(parsed, arena.ptr(), &size);
+  ASSERT(std::string(data, size) == encoded);
+}
+
+void TestDecodeMask() {
+  upb::Arena arena;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_mutable_msg(msg, arena.ptr());
+  upb_test_TestMessage_set_i32(msg, 1);
+  upb_test_TestMessage_set_str(msg, upb_strview_makez("outer"));
+  upb_test_TestMessage_set_i32(sub, 2);
+  upb_test_TestMessage_set_str(sub, upb_strview_makez("inner"));
+  ASSERT(upb_test_TestMessage_add_r_msg(msg, arena.ptr()));
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+
+  /* i32 and msg.str only. */
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb_decmask *mask = upb_decmask_new(l, arena.ptr());
+  ASSERT(upb_decmask_add(mask, 1));
+  ASSERT(!upb_decmask_add(mask, 100));
+  upb_decmask *submask = upb_decmask_addsub(mask, 5, arena.ptr());
+  ASSERT(submask);
+  ASSERT(upb_decmask_add(submask, 3));
+  ASSERT(!upb_decmask_addsub(mask, 3, arena.ptr()));
+
+  upb_test_TestMessage *parsed = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_masked(data, size, parsed, l, mask, arena.ptr(),
+                           UPB_DECODE_FASTTABLE));
+  ASSERT(upb_test_TestMessage_i32(parsed) == 1);
+  ASSERT(!upb_test_TestMessage_has_str(parsed));
+  ASSERT(upb_test_TestMessage_r_msg(parsed, &size) == NULL);
+  sub = upb_test_TestMessage_mutable_msg(parsed, arena.ptr());
+  ASSERT(!upb_test_TestMessage_has_i32(sub));
+  ASSERT(upb_strview_eql(upb_test_TestMessage_str(sub),
+                         upb_strview_makez("inner")));
+  upb_msg_getunknown(parsed, &size);
+  ASSERT(size == 0);
+  upb_msg_getunknown(sub, &size);
+  ASSERT(size == 0);
+}
+
+void TestDecodeRepeatedSubmsg() {
+  upb::Arena arena;
+  size_t size;
+
+  /* DescriptorProto: field { type_name: "x" }, extension {}.  The field
+   * entry ends with tag 0x32, which is also the tag of extension. */
+  const std::string desc("\x12\x03\x32\x01x\x32\x00", 7);
+
+  /* TestMessage: r_msg { str: "a" }, str: "b". */
+  const std::string test("\x32\x03\x1a\x01" "a" "\x1a\x01" "b", 8);
+
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    google_protobuf_DescriptorProto *d =
+        google_protobuf_DescriptorProto_new(arena.ptr());
+    ASSERT(upb_decode_ex(desc.data(), desc.size(), d,
+                         &google_protobuf_DescriptorProto_msginit, arena.ptr(),
+                         options));
+    const google_protobuf_FieldDescriptorProto *const *fields =
+        google_protobuf_DescriptorProto_field(d, &size);
+    ASSERT(size == 1);
+    ASSERT(upb_strview_eql(
+        google_protobuf_FieldDescriptorProto_type_name(fields[0]),
+        upb_strview_makez("x")));
+    google_protobuf_DescriptorProto_extension(d, &size);
+    ASSERT(size == 1);
+
+    upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+    ASSERT(upb_decode_ex(test.data(), test.size(), msg,
+                         &upb_test_TestMessage_msginit, arena.ptr(), options));
+    const upb_test_TestMessage *const *r_msg =
+        upb_test_TestMessage_r_msg(msg, &size);
+    ASSERT(size == 1);
+    ASSERT(upb_strview_eql(upb_test_TestMessage_str(r_msg[0]),
+                           upb_strview_makez("a")));
+    ASSERT(upb_strview_eql(upb_test_TestMessage_str(msg),
+                           upb_strview_makez("b")));
+  }
+}
+
+void TestDecodeUnknown() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  /* i32 = 1, then field 100 twice, which the schema doesn't have. */
+  const std::string input("\x08\x01\xa0\x06\x01\xa0\x06\x02", 8);
+  upb_decstats stats;
+  size_t size;
+
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_withstats(input.data(), input.size(), msg, l, NULL,
+                              arena.ptr(), 0, &stats));
+  ASSERT(stats.unknown_fields == 2);
+  ASSERT(stats.unknown_bytes == 6);
+  const char *unknown = upb_msg_getunknown(msg, &size);
+  ASSERT(std::string(unknown, size) == input.substr(2));
+  ASSERT(unknown != input.data() + 2);
+
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_ex(input.data(), input.size(), msg, l, arena.ptr(),
+                       UPB_DECODE_ALIAS));
+  ASSERT(upb_msg_getunknown(msg, &size) == input.data() + 2);
+  ASSERT(size == 6);
+
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_withstats(input.data(), input.size(), msg, l, NULL,
+                              arena.ptr(), UPB_DECODE_DISCARDUNKNOWN, &stats));
+  ASSERT(stats.unknown_fields == 2);
+  upb_msg_getunknown(msg, &size);
+  ASSERT(size == 0);
+  ASSERT(upb_test_TestMessage_i32(msg) == 1);
+}
+
+void TestDecodeLimits() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  /* i32 = 1, two unknown fields of 3 bytes, then r_i32 = 1, 2, 3. */
+  const std::string input("\x08\x01\xa0\x06\x01\xa0\x06\x02"
+                          "\x10\x01\x10\x02\x10\x03", 14);
+  const std::string big(4096, 'x');
+  upb_declimits limits = {0, 0, 0};
+  upb_test_TestMessage *msg;
+  std::string str_input;
+  size_t len;
+
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(input.data(), input.size(), msg, l, &limits,
+                            arena.ptr(), 0) == UPB_DECSTATUS_OK);
+
+  limits.max_elements = 6;
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(input.data(), input.size(), msg, l, &limits,
+                            arena.ptr(), 0) == UPB_DECSTATUS_OK);
+  limits.max_elements = 5;
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(input.data(), input.size(), msg, l, &limits,
+                            arena.ptr(), 0) == UPB_DECSTATUS_ELEMENTLIMIT);
+  limits.max_elements = 0;
+
+  /* Stops at the second unknown field, before the repeated field. */
+  limits.max_unknown_bytes = 5;
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(input.data(), input.size(), msg, l, &limits,
+                            arena.ptr(), UPB_DECODE_DISCARDUNKNOWN) ==
+         UPB_DECSTATUS_UNKNOWNLIMIT);
+  ASSERT(upb_test_TestMessage_i32(msg) == 1);
+  upb_test_TestMessage_r_i32(msg, &len);
+  ASSERT(len == 0);
+  limits.max_unknown_bytes = 0;
+
+  /* str = 4096 bytes, copied into the arena. */
+  str_input = std::string("\x1a\x80\x20", 3) + big;
+  limits.max_arena_bytes = 1024;
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(str_input.data(), str_input.size(), msg, l,
+                            &limits, arena.ptr(), 0) ==
+         UPB_DECSTATUS_ARENALIMIT);
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(str_input.data(), str_input.size(), msg, l,
+                            &limits, arena.ptr(), UPB_DECODE_ALIAS) ==
+         UPB_DECSTATUS_OK);
+
+  msg = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_limited(input.data(), 1, msg, l, &limits, arena.ptr(),
+                            0) == UPB_DECSTATUS_MALFORMED);
+}
+
+void TestFieldLookup() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestFieldNumbers_msginit;
+  /* Every field in reverse order, with unknown fields 536870910, 1001, 999, 5
+   * and 3 in the gaps between them. */
+  const std::string input(
+      "\xf8\xff\xff\xff\x0f\x05" "\xf0\xff\xff\xff\x0f\x01"
+      "\xc8\x3e\x01" "\xc0\x3e\x04" "\xb8\x3e\x01" "\x28\x01"
+      "\x20\x03" "\x18\x01" "\x10\x02" "\x08\x01", 31);
+  size_t size;
+
+  /* Fields 1 and 2 are found by index, the rest by binary search. */
+  ASSERT(l->dense_below == 2);
+
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    upb_test_TestFieldNumbers *msg = upb_test_TestFieldNumbers_new(
+        arena.ptr());
+    ASSERT(upb_decode_ex(input.data(), input.size(), msg, l, arena.ptr(),
+                         options));
+    ASSERT(upb_test_TestFieldNumbers_f1(msg) == 1);
+    ASSERT(upb_test_TestFieldNumbers_f2(msg) == 2);
+    ASSERT(upb_test_TestFieldNumbers_f4(msg) == 3);
+    ASSERT(upb_test_TestFieldNumbers_f1000(msg) == 4);
+    ASSERT(upb_test_TestFieldNumbers_f_max(msg) == 5);
+    upb_msg_getunknown(msg, &size);
+    ASSERT(size == 16);
+
+    /* Field number 0 doesn't exist. */
+    ASSERT(!upb_decode_ex("\x00\x01", 2, msg, l, arena.ptr(), options));
+  }
+}
+
+void TestFieldOrder() {
+  upb::Arena arena;
+  /* i32, r_i32, str, msg {str, i32}, r_msg {i32} and unknown field 100. */
+  std::string fields[] = {std::string("\x08\x01", 2),
+                           std::string("\x10\x02", 2),
+                           std::string("\x1a\x01" "a", 3),
+                           std::string("\x2a\x05\x1a\x01" "b\x08\x03", 7),
+                           std::string("\x32\x02\x08\x04", 4),
+                           std::string("\xa0\x06\x05", 3)};
+  const size_t count = sizeof(fields) / sizeof(fields[0]);
+  std::string expected;
+  size_t size;
+
+  /* Every order decodes the same, whether or not each field is the one after
+   * the last. */
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    std::sort(fields, fields + count);
+    do {
+      std::string input;
+      for (size_t i = 0; i < count; i++) input += fields[i];
+      upb_test_TestMessage *msg = upb_test_TestMessage_parse_ex(
+          input.data(), input.size(), arena.ptr(), options);
+      ASSERT(msg);
+      char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+      if (expected.empty()) expected.assign(data, size);
+      ASSERT(std::string(data, size) == expected);
+    } while (std::next_permutation(fields, fields + count));
+  }
+
+  /* Unknown groups are skipped up to their own END_GROUP, past any nested
+   * group, and the fields after them are found again. */
+  const std::string group("\xa3\x06\x08\x01\x0b\x10\x02\x0c\xa4\x06", 10);
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    std::string input = "\x08\x07" + group + "\x10\x08";
+    upb_test_TestMessage *msg = upb_test_TestMessage_parse_ex(
+        input.data(), input.size(), arena.ptr(), options);
+    ASSERT(msg && upb_test_TestMessage_i32(msg) == 7);
+    upb_test_TestMessage_r_i32(msg, &size);
+    ASSERT(size == 1);
+    const char *unknown = upb_msg_getunknown(msg, &size);
+    ASSERT(std::string(unknown, size) == group);
+
+    /* A group ended by another field's END_GROUP, or not at all, and an
+     * END_GROUP outside of any group. */
+    input = std::string("\xa3\x06\x08\x01\xac\x06", 6);
+    ASSERT(!upb_test_TestMessage_parse_ex(input.data(), input.size(),
+                                          arena.ptr(), options));
+    input = std::string("\xa3\x06\x08\x01", 4);
+    ASSERT(!upb_test_TestMessage_parse_ex(input.data(), input.size(),
+                                          arena.ptr(), options));
+    input = std::string("\x08\x01\x0c", 3);
+    ASSERT(!upb_test_TestMessage_parse_ex(input.data(), input.size(),
+                                          arena.ptr(), options));
+  }
+}
+
+static std::string DecodeStream(const std::string& input, size_t chunk,
+                                bool *ok) {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_decstream *s = upb_decstream_new(msg, l, arena.ptr(), 0);
+  *ok = s != NULL;
+  for (size_t i = 0; *ok && i < input.size(); i += chunk) {
+    /* Each chunk is gone once it has been fed. */
+    std::string piece = input.substr(i, chunk);
+    *ok = upb_decstream_feed(s, piece.data(), piece.size());
+  }
+  *ok = *ok && upb_decstream_finish(s);
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  return std::string(data, size);
+}
+
+void TestDecodeStream() {
+  upb::Arena arena;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_mutable_msg(msg, arena.ptr());
+  upb_test_TestMessage_set_i32(msg, -1);
+  upb_test_TestMessage_set_str(msg, upb_strview_makez("a string"));
+  upb_test_TestMessage_set_str(sub, upb_strview_makez("in a submessage"));
+  for (int i = 0; i < 3; i++) {
+    upb_test_TestMessage *r = upb_test_TestMessage_add_r_msg(msg, arena.ptr());
+    ASSERT(r);
+    upb_test_TestMessage_set_i32(r, 1000 * i);
+    ASSERT(upb_test_TestMessage_add_r_i32(sub, i * 300, arena.ptr()));
+  }
+  upb_test_TestMessage_set_i32(
+      upb_test_TestMessage_mutable_lazy_msg(sub, arena.ptr()), 7);
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+  /* Unknown field 100 first, which is where it is encoded again. */
+  std::string input =
+      std::string("\xa2\x06\x03xyz", 6) + std::string(data, size);
+
+  for (size_t chunk = 1; chunk <= input.size(); chunk++) {
+    bool ok;
+    ASSERT(DecodeStream(input, chunk, &ok) == input);
+    ASSERT(ok);
+  }
+
+  /* Cut off, inside a submessage and inside a field. */
+  bool ok;
+  DecodeStream(input.substr(0, 12), 5, &ok);
+  ASSERT(!ok);
+  DecodeStream(input.substr(0, input.size() - 1), 5, &ok);
+  ASSERT(!ok);
+
+  /* A submessage overrunning its parent. */
+  DecodeStream(std::string("\x2a\x03\x2a\x05\x08\x01", 6), 1, &ok);
+  ASSERT(!ok);
+}
+
+/* Decodes |input| by splitting field r_msg into |runs| runs, decoded last
+ * first, and returns the message encoded again. */
+static std::string DecodeSplit(const std::string& input, size_t runs,
+                               bool *ok) {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb_decsplit *s = upb_decsplit_new(input.data(), input.size(), l, 6, runs,
+                                     arena.ptr());
+  *ok = s != NULL;
+  if (!*ok) return "";
+  std::vector<upb_arena*> arenas;
+  for (size_t i = upb_decsplit_runs(s); i > 0; i--) {
+    upb_arena *run_arena = upb_arena_new();
+    arenas.push_back(run_arena);
+    *ok = *ok && upb_decsplit_decode(s, i - 1, run_arena, 0);
+  }
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  *ok = *ok && upb_decsplit_finish(s, msg, arena.ptr(), 0);
+  for (size_t i = 0; i < arenas.size(); i++) {
+    upb_arena_free(arenas[i]);
+  }
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  return std::string(data, size);
+}
+
+void TestDecodeBatch() {
+  upb::Arena arena;
+  std::string inputs[] = {std::string("\x08\x01", 2), std::string("\x08", 1),
+                          std::string("\x08\x03\x1a\x03" "abc", 7)};
+  const char *bufs[3];
+  size_t sizes[3];
+  upb_msg *msgs[3];
+  upb_strview str;
+
+  for (int i = 0; i < 3; i++) {
+    bufs[i] = inputs[i].data();
+    sizes[i] = inputs[i].size();
+  }
+
+  ASSERT(upb_decode_batch(bufs, sizes, 3, &upb_test_TestMessage_msginit,
+                          arena.ptr(), 0, msgs) == 2);
+  ASSERT(msgs[1] == NULL);
+  inputs[2].assign(inputs[2].size(), 'x');
+
+  ASSERT(upb_test_TestMessage_i32((upb_test_TestMessage*)msgs[0]) == 1);
+  ASSERT(!upb_test_TestMessage_has_str((upb_test_TestMessage*)msgs[0]));
+  ASSERT(upb_test_TestMessage_i32((upb_test_TestMessage*)msgs[2]) == 3);
+  str = upb_test_TestMessage_str((upb_test_TestMessage*)msgs[2]);
+  ASSERT(std::string(str.data, str.size) == "abc");
+
+  ASSERT(upb_decode_batch(bufs, sizes, 0, &upb_test_TestMessage_msginit,
+                          arena.ptr(), 0, msgs) == 0);
+}
+
+void TestDecodeSplit() {
+  upb::Arena arena;
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage_set_i32(msg, 1);
+  upb_test_TestMessage_set_str(msg, upb_strview_makez("outer"));
+  for (int i = 0; i < 10; i++) {
+    upb_test_TestMessage *r = upb_test_TestMessage_add_r_msg(msg, arena.ptr());
+    ASSERT(r);
+    upb_test_TestMessage_set_i32(r, i);
+    upb_test_TestMessage_set_str(r, upb_strview_makez("element"));
+  }
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+  /* Another i32 and element after the others. */
+  std::string input =
+      std::string(data, size) + std::string("\x08\x02\x32\x02\x08\x0a", 6);
+
+  upb_test_TestMessage *expected = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_decode_ex(input.data(), input.size(), expected,
+                       &upb_test_TestMessage_msginit, arena.ptr(), 0));
+  data = upb_test_TestMessage_serialize(expected, arena.ptr(), &size);
+
+  for (size_t runs = 0; runs <= 12; runs++) {
+    bool ok;
+    ASSERT(DecodeSplit(input, runs, &ok) == std::string(data, size));
+    ASSERT(ok);
+  }
+
+  /* No elements at all. */
+  bool ok;
+  ASSERT(DecodeSplit("\x08\x02", 4, &ok) == "\x08\x02");
+  ASSERT(ok);
+
+  /* Not a repeated message field. */
+  ASSERT(!upb_decsplit_new(input.data(), input.size(),
+                           &upb_test_TestMessage_msginit, 5, 4, arena.ptr()));
+
+  /* An element as a group, and a malformed element. */
+  DecodeSplit(std::string("\x33\x08\x01\x34", 4), 4, &ok);
+  ASSERT(!ok);
+  DecodeSplit(std::string("\x32\x02\x08\x80", 4), 4, &ok);
+  ASSERT(!ok);
+
+  /* Every run has to be decoded. */
+  upb_decsplit *s = upb_decsplit_new(input.data(), input.size(),
+                                     &upb_test_TestMessage_msginit, 6, 2,
+                                     arena.ptr());
+  ASSERT(s);
+  ASSERT(upb_decsplit_runs(s) == 2);
+  ASSERT(upb_decsplit_decode(s, 0, arena.ptr(), 0));
+  ASSERT(!upb_decsplit_finish(s, upb_test_TestMessage_new(arena.ptr()),
+                              arena.ptr(), 0));
+}
+
+void TestScan() {
+  upb::Arena arena;
+  /* i32 = 1, str = "abc", an unknown group 9 holding a varint, the
+   * submessage msg { i32 = 3 }, then i32 = 300. */
+  std::string input("\x08\x01\x1a\x03" "abc" "\x4b\x08\x05\x4c"
+                    "\x2a\x02\x08\x03" "\x08\xac\x02", 18);
+  upb_scan *s = upb_scan_new(input.data(), input.size(), arena.ptr());
+  ASSERT(s);
+
+  size_t count;
+  const upb_scanfield *f = upb_scan_fields(s, &count);
+  ASSERT(count == 5);
+  ASSERT(f[0].number == 1 && f[1].number == 1 && f[2].number == 3 &&
+         f[3].number == 5 && f[4].number == 9);
+
+  f = upb_scan_find(s, 1, &count);
+  ASSERT(count == 2);
+  ASSERT(f[0].wire_type == UPB_WIRE_TYPE_VARINT);
+  ASSERT(f[0].field == input.data() && f[0].field_size == 2);
+  ASSERT(f[1].field == input.data() + 15 && f[1].field_size == 3);
+  ASSERT(std::string(f[1].data, f[1].size) == "\xac\x02");
+
+  f = upb_scan_find(s, 3, &count);
+  ASSERT(count == 1);
+  ASSERT(std::string(f->data, f->size) == "abc");
+
+  f = upb_scan_find(s, 9, &count);
+  ASSERT(count == 1);
+  ASSERT(f->wire_type == UPB_WIRE_TYPE_START_GROUP);
+  ASSERT(std::string(f->data, f->size) == "\x08\x05");
+  ASSERT(std::string(f->field, f->field_size) == "\x4b\x08\x05\x4c");
+
+  /* Decode just the submessage. */
+  f = upb_scan_find(s, 5, &count);
+  ASSERT(count == 1);
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_parse(f->data, f->size, arena.ptr());
+  ASSERT(sub && upb_test_TestMessage_i32(sub) == 3);
+
+  ASSERT(!upb_scan_find(s, 2, &count) && count == 0);
+  ASSERT(!upb_scan_find(s, 10, &count) && count == 0);
+
+  /* An empty message. */
+  s = upb_scan_new(NULL, 0, arena.ptr());
+  ASSERT(s && !upb_scan_find(s, 1, &count));
+
+  /* Malformed: truncated, field 0, unterminated group, stray end tag. */
+  ASSERT(!upb_scan_new("\x1a\x03" "ab", 4, arena.ptr()));
+  ASSERT(!upb_scan_new("\x00\x01", 2, arena.ptr()));
+  ASSERT(!upb_scan_new("\x4b\x08\x05", 3, arena.ptr()));
+  ASSERT(!upb_scan_new("\x4c", 1, arena.ptr()));
+}
+
+void TestMaps() {
+  upb::Arena arena;
+  upb_test_TestMaps *maps = upb_test_TestMaps_new(arena.ptr());
+  upb_test_TestMessage *sub = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage_set_i32(sub, 5);
+  int32_t i32;
+  const upb_test_TestMessage *msg;
+
+  ASSERT(upb_test_TestMaps_str_i32_size(maps) == 0);
+  ASSERT(!upb_test_TestMaps_str_i32_get(maps, upb_strview_makez("a"), &i32));
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("a"), 1,
+                                       arena.ptr()));
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("b"), 2,
+                                       arena.ptr()));
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("a"), 3,
+                                       arena.ptr()));
+  ASSERT(upb_test_TestMaps_i32_msg_set(maps, -1, sub, arena.ptr()));
+  ASSERT(upb_test_TestMaps_str_i32_size(maps) == 2);
+  ASSERT(upb_test_TestMaps_str_i32_get(maps, upb_strview_makez("a"), &i32));
+  ASSERT(i32 == 3);
+
+  size_t size;
+  char *data = upb_test_TestMaps_serialize(maps, arena.ptr(), &size);
+  ASSERT(data);
+  size_t fwd_size;
+  char *fwd = upb_encode_ex(maps, &upb_test_TestMaps_msginit, arena.ptr(),
+                            UPB_ENCODE_FORWARD, &fwd_size);
+  ASSERT(std::string(data, size) == std::string(fwd, fwd_size));
+
+  /* A repeated key replaces the value, and a missing value is the default. */
+  std::string input(data, size);
+  input += "\x0a\x03\x0a\x01\x62";  /* {"b": 0} */
+  input += "\x12\x02\x08\x07";      /* {7: {}} */
+  upb_test_TestMaps *parsed =
+      upb_test_TestMaps_parse(input.data(), input.size(), arena.ptr());
+  ASSERT(parsed);
+  ASSERT(upb_test_TestMaps_str_i32_size(parsed) == 2);
+  ASSERT(upb_test_TestMaps_str_i32_get(parsed, upb_strview_makez("a"), &i32));
+  ASSERT(i32 == 3);
+  ASSERT(upb_test_TestMaps_str_i32_get(parsed, upb_strview_makez("b"), &i32));
+  ASSERT(i32 == 0);
+  ASSERT(upb_test_TestMaps_i32_msg_get(parsed, -1, &msg));
+  ASSERT(upb_test_TestMessage_i32(msg) == 5);
+  ASSERT(upb_test_TestMaps_i32_msg_get(parsed, 7, &msg));
+  ASSERT(msg && !upb_test_TestMessage_has_i32(msg));
+
+  size_t iter = UPB_MAP_BEGIN;
+  int count = 0;
+  upb_strview key;
+  while (upb_test_TestMaps_str_i32_next(parsed, &iter, &key, &i32)) {
+    ASSERT(upb_strview_eql(key, upb_strview_makez(i32 ? "a" : "b")));
+    count++;
+  }
+  ASSERT(count == 2);
+
+  ASSERT(upb_test_TestMaps_str_i32_delete(parsed, upb_strview_makez("b")));
+  ASSERT(!upb_test_TestMaps_str_i32_delete(parsed, upb_strview_makez("b")));
+  ASSERT(upb_test_TestMaps_str_i32_size(parsed) == 1);
+
+  /* Unknown fields of the entry itself are dropped, but those of a message
+   * value are kept like in any other submessage (and written first). */
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    /* {1: {i32: 1, 100: 5}}, with field 3 in the entry as well. */
+    const std::string entry("\x12\x0b\x08\x01\x18\x07"
+                            "\x12\x05\x08\x01\xa0\x06\x05", 13);
+    const std::string kept("\x12\x09\x08\x01"
+                           "\x12\x05\xa0\x06\x05\x08\x01", 11);
+    parsed = upb_test_TestMaps_new(arena.ptr());
+    ASSERT(upb_decode_ex(entry.data(), entry.size(), parsed,
+                         &upb_test_TestMaps_msginit, arena.ptr(), options));
+    ASSERT(upb_test_TestMaps_i32_msg_get(parsed, 1, &msg));
+    upb_msg_getunknown(msg, &size);
+    ASSERT(size == 3);
+    data = upb_test_TestMaps_serialize(parsed, arena.ptr(), &size);
+    ASSERT(std::string(data, size) == kept);
+  }
+
+  /* An entry too big for the decoder's scratch entry fails the decode. */
+  const upb_msglayout *l = &upb_test_TestMaps_msginit;
+  upb_msglayout big_entry = *l->submsgs[l->fields[0].submsg_index];
+  const upb_msglayout *submsgs[] = {&big_entry, &big_entry};
+  upb_msglayout big = *l;
+  big_entry.size = 1024;
+  big.submsgs = submsgs;
+  big.fasttable = NULL;
+  parsed = upb_test_TestMaps_new(arena.ptr());
+  ASSERT(!upb_decode("\x0a\x03\x0a\x01\x62", 5, parsed, &big,
+                     arena.ptr()));
+}
+
+void TestExtensions() {
+  upb::Arena arena;
+  upb_test_TestExtendable *msg = upb_test_TestExtendable_new(arena.ptr());
+  upb_test_TestMessage *sub;
+  size_t len, size;
+
+  ASSERT(!upb_test_has_ext_i32(msg));
+  ASSERT(upb_test_ext_i32(msg) == 0);
+  ASSERT(upb_test_ext_r_i32(msg, &len) == NULL && len == 0);
+  ASSERT(upb_test_set_ext_i32(msg, 5, arena.ptr()));
+  ASSERT(upb_test_set_ext_str(msg, upb_strview_makez("abc"), arena.ptr()));
+  ASSERT(upb_test_add_ext_r_i32(msg, 1, arena.ptr()));
+  ASSERT(upb_test_add_ext_r_i32(msg, 2, arena.ptr()));
+  sub = upb_test_mutable_ext_msg(msg, arena.ptr());
+  ASSERT(sub && upb_test_mutable_ext_msg(msg, arena.ptr()) == sub);
+  upb_test_TestMessage_set_i32(sub, 7);
+  ASSERT(upb_test_add_ext_r_msg(msg, arena.ptr()));
+  /* Extensions have presence, so a zero value is still encoded. */
+  ASSERT(upb_test_TestExtensionScope_set_ext_bool(msg, false, arena.ptr()));
+  upb_test_TestExtendable_set_i32(
+      upb_test_TestExtendable_mutable_child(msg, arena.ptr()), 1);
+  ASSERT(upb_test_set_ext_i32(upb_test_TestExtendable_mutable_child(
+                                  msg, arena.ptr()),
+                              9, arena.ptr()));
+
+  ASSERT(upb_test_has_ext_i32(msg) && upb_test_ext_i32(msg) == 5);
+  ASSERT(upb_test_ext_r_i32(msg, &len)[1] == 2 && len == 2);
+  ASSERT(upb_test_TestExtensionScope_has_ext_bool(msg));
+
+  char *buf = upb_test_TestExtendable_serialize(msg, arena.ptr(), &size);
+  ASSERT(buf);
+  std::string data(buf, size);
+  buf = upb_encode_ex(msg, &upb_test_TestExtendable_msginit, arena.ptr(),
+                      UPB_ENCODE_FORWARD, &len);
+  ASSERT(len == data.size() && memcmp(buf, data.data(), len) == 0);
+  ASSERT(upb_encoded_size(msg, &upb_test_TestExtendable_msginit) == len);
+
+  /* Without a registry they are unknown fields, and survive as such. */
+  upb_test_TestExtendable *parsed =
+      upb_test_TestExtendable_parse(data.data(), data.size(), arena.ptr());
+  ASSERT(parsed && !upb_test_has_ext_i32(parsed));
+  upb_msg_getunknown(parsed, &len);
+  ASSERT(len > 0);
+  upb_test_TestExtendable_serialize(parsed, arena.ptr(), &len);
+  ASSERT(len == data.size());
+
+  upb_extreg *reg = upb_extreg_new(arena.ptr());
+  ASSERT(reg && tests_test_cpp_proto_addexts(reg));
+  ASSERT(tests_test_cpp_proto_addexts(reg));  /* The same ones again. */
+  ASSERT(_upb_extreg_get(reg, &upb_test_TestExtendable_msginit, 100) ==
+         &upb_test_ext_i32_ext);
+  ASSERT(!_upb_extreg_get(reg, &upb_test_TestExtendable_msginit, 1));
+  ASSERT(!_upb_extreg_get(reg, &upb_test_TestMessage_msginit, 100));
+
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    parsed = upb_test_TestExtendable_new(arena.ptr());
+    ASSERT(upb_decode_withexts(data.data(), data.size(), parsed,
+                               &upb_test_TestExtendable_msginit, reg,
+                               arena.ptr(), options));
+    upb_msg_getunknown(parsed, &len);
+    ASSERT(len == 0);
+    ASSERT(upb_test_ext_i32(parsed) == 5);
+    ASSERT(upb_strview_eql(upb_test_ext_str(parsed),
+                           upb_strview_makez("abc")));
+    ASSERT(upb_test_ext_r_i32(parsed, &len)[0] == 1 && len == 2);
+    ASSERT(upb_test_TestMessage_i32(upb_test_ext_msg(parsed)) == 7);
+    ASSERT(upb_test_ext_r_msg(parsed, &len) && len == 1);
+    ASSERT(upb_test_TestExtensionScope_has_ext_bool(parsed));
+    ASSERT(upb_test_ext_i32(upb_test_TestExtendable_child(parsed)) == 9);
+    buf = upb_test_TestExtendable_serialize(parsed, arena.ptr(), &len);
+    ASSERT(len == data.size() && memcmp(buf, data.data(), len) == 0);
+  }
+
+  /* A value of the wrong wire type is an unknown field. */
+  std::string fixed("\xa5\x06\x01\x00\x00\x00", 6);
+  parsed = upb_test_TestExtendable_new(arena.ptr());
+  ASSERT(upb_decode_withexts(fixed.data(), fixed.size(), parsed,
+                             &upb_test_TestExtendable_msginit, reg,
+                             arena.ptr(), 0));
+  ASSERT(!upb_test_has_ext_i32(parsed));
+  upb_msg_getunknown(parsed, &len);
+  ASSERT(len == fixed.size());
+
+  /* Copies and merges. */
+  upb_test_TestExtendable *copy = (upb_test_TestExtendable*)upb_msg_copy(
+      msg, &upb_test_TestExtendable_msginit, arena.ptr(), 0);
+  ASSERT(copy && upb_test_ext_i32(copy) == 5);
+  ASSERT(upb_test_ext_str(copy).data != upb_test_ext_str(msg).data);
+  ASSERT(upb_test_ext_msg(copy) != upb_test_ext_msg(msg));
+  buf = upb_test_TestExtendable_serialize(copy, arena.ptr(), &len);
+  ASSERT(len == data.size() && memcmp(buf, data.data(), len) == 0);
+  ASSERT(upb_msg_merge(copy, msg, &upb_test_TestExtendable_msginit,
+                       arena.ptr(), 0));
+  upb_test_ext_r_i32(copy, &len);
+  ASSERT(len == 4);
+
+  upb_test_clear_ext_i32(copy);
+  ASSERT(!upb_test_has_ext_i32(copy) && upb_test_has_ext_str(copy));
+  upb_msg_clear(copy, &upb_test_TestExtendable_msginit);
+  ASSERT(!upb_test_has_ext_str(copy));
+  upb_test_TestExtendable_serialize(copy, arena.ptr(), &len);
+  ASSERT(len == 0);
+}
+
+void TestStats() {
+  upb_stats stats;
+  upb_stats_reset();
+
+  {
+    upb::Arena arena;
+    upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+    size_t size;
+    upb_test_TestMessage_set_i32(msg, 1);
+    upb_test_TestMessage_set_str(msg, upb_strview_makez("hello"));
+    char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+    ASSERT(data);
+
+    /* An unknown varint field, number 99. */
+    std::string input(data, size);
+    input += std::string("\x98\x06\x01", 3);
+    ASSERT(upb_test_TestMessage_parse(input.data(), input.size(),
+                                      arena.ptr()));
+
+    upb_stats_get(&stats);
+    if (upb_stats_enabled()) {
+      ASSERT(stats.encode_bytes == size);
+      ASSERT(stats.decode_bytes == input.size());
+      ASSERT(stats.decode_unknown_fields == 1);
+      ASSERT(stats.decode_unknown_bytes == 3);
+    } else {
+      ASSERT(stats.encode_bytes == 0 && stats.decode_bytes == 0);
+    }
+  }
+
+  upb_stats_reset();
+  upb_stats_get(&stats);
+  ASSERT(stats.encode_bytes == 0 && stats.decode_bytes == 0);
+}
+
+extern "C" {
+
+int run_tests(int argc, char *argv[]) {
+  TestLazySubmsg();
+  TestDecodeMask();
+  TestDecodeRepeatedSubmsg();
+  TestDecodeUnknown();
+  TestDecodeLimits();
+  TestFieldLookup();
+  TestFieldOrder();
+  TestDecodeStream();
+  TestDecodeBatch();
+  TestDecodeSplit();
+  TestScan();
+  TestMaps();
+  TestExtensions();
+  TestStats();
+
+  return 0;
+}
+
+}
@@ -0,0 +1,301 @@
+/*
+ * Tests for upb_encode() and the other encoders in upb/encode.h.
+ */
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tests/test_cpp.upb.h"
+#include "tests/upb_test.h"
+#include "upb/encode.h"
+#include "upb/upb.h"
+
+/* A message with strings of several lengths at each level, and nested and
+ * repeated submessages, for comparing the encoders with upb_encode(). */
+static upb_test_TestMessage *NewEncodeTestMessage(upb_arena *arena) {
+  static const char kLong[] = "a string long enough to be worth aliasing";
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena);
+  upb_test_TestMessage_set_i32(msg, -1);
+  upb_test_TestMessage_set_str(msg, upb_strview_makez(kLong));
+  for (int i = 0; i < 3; i++) {
+    upb_test_TestMessage *sub = upb_test_TestMessage_add_r_msg(msg, arena);
+    ASSERT(sub);
+    ASSERT(upb_test_TestMessage_add_r_i32(msg, i * 1000, arena));
+    ASSERT(upb_test_TestMessage_add_r_str(msg, upb_strview_makez("r"), arena));
+    ASSERT(upb_test_TestMessage_add_r_str(msg, upb_strview_makez(kLong),
+                                          arena));
+    ASSERT(upb_test_TestMessage_add_r_i32(sub, i, arena));
+    upb_test_TestMessage_set_str(sub, upb_strview_makez(kLong + i));
+    upb_test_TestMessage *leaf = upb_test_TestMessage_mutable_msg(sub, arena);
+    ASSERT(leaf);
+    upb_test_TestMessage_set_str(leaf, upb_strview_makez(i ? kLong : ""));
+  }
+  ASSERT(upb_test_TestMessage_mutable_msg(msg, arena));
+  return msg;
+}
+
+void TestEncodeInto() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb_test_TestMessage *msg = NewEncodeTestMessage(arena.ptr());
+  size_t size;
+  char *data = upb_encode(msg, l, arena.ptr(), &size);
+  ASSERT(data);
+  const std::string expected(data, size);
+
+  /* Exactly the room needed, then one byte less. */
+  std::string buf(expected.size() + 16, '\xaa');
+  size_t written = 0;
+  ASSERT(upb_encode_into(msg, l, &buf[0], expected.size(), &written));
+  ASSERT(written == expected.size());
+  ASSERT(buf.substr(0, written) == expected);
+  ASSERT(buf.substr(written) == std::string(16, '\xaa'));
+
+  buf.assign(expected.size() + 16, '\xaa');
+  written = 0;
+  ASSERT(!upb_encode_into(msg, l, &buf[0], expected.size() - 1, &written));
+  ASSERT(written == expected.size());
+  ASSERT(buf == std::string(expected.size() + 16, '\xaa'));
+
+  ASSERT(!upb_encode_into(msg, l, NULL, 0, &written));
+  ASSERT(written == expected.size());
+
+  /* The segments join up to the same bytes whatever gets aliased. */
+  const upb_strview str = upb_test_TestMessage_str(msg);
+  const size_t min_alias[] = {0, 1, 2, 16, 1000};
+  for (size_t i = 0; i < sizeof(min_alias) / sizeof(min_alias[0]); i++) {
+    size_t count;
+    const upb_strview *iov =
+        upb_encode_iov(msg, l, arena.ptr(), min_alias[i], &count, &size);
+    ASSERT(iov);
+    ASSERT(size == expected.size());
+    std::string joined;
+    bool aliased = false;
+    for (size_t j = 0; j < count; j++) {
+      joined.append(iov[j].data, iov[j].size);
+      if (iov[j].data == str.data) aliased = true;
+    }
+    ASSERT(joined == expected);
+    ASSERT(aliased == (str.size >= min_alias[i]));
+  }
+
+  /* An empty message. */
+  upb_test_TestMessage *empty = upb_test_TestMessage_new(arena.ptr());
+  ASSERT(upb_encode_into(empty, l, NULL, 0, &written));
+  ASSERT(written == 0);
+  size_t count;
+  ASSERT(upb_encode_iov(empty, l, arena.ptr(), 1, &count, &size));
+  ASSERT(size == 0);
+}
+
+void TestEncodedSizes() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb_encsizes sizes;
+  size_t size;
+
+  /* msg { r_i32: [1, 2, 3] msg { i32: 5 } }: the lengths of the submessage,
+   * its packed field and its own submessage, in the order they are written
+   * out. */
+  upb_test_TestMessage *msg = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage *sub =
+      upb_test_TestMessage_mutable_msg(msg, arena.ptr());
+  for (int i = 1; i <= 3; i++) {
+    ASSERT(upb_test_TestMessage_add_r_i32(sub, i, arena.ptr()));
+  }
+  upb_test_TestMessage_set_i32(
+      upb_test_TestMessage_mutable_msg(sub, arena.ptr()), 5);
+  ASSERT(upb_encoded_sizes(msg, l, arena.ptr(), &sizes));
+  ASSERT(sizes.size == 11);
+  ASSERT(sizes.count == 3);
+  ASSERT(sizes.lengths[0] == 9);
+  ASSERT(sizes.lengths[1] == 3);
+  ASSERT(sizes.lengths[2] == 2);
+
+  /* Each repeated submessage has the length it encodes to on its own. */
+  msg = NewEncodeTestMessage(arena.ptr());
+  char *data = upb_encode(msg, l, arena.ptr(), &size);
+  ASSERT(data);
+  ASSERT(upb_encoded_size(msg, l) == size);
+  ASSERT(upb_encoded_sizes(msg, l, arena.ptr(), &sizes));
+  ASSERT(sizes.size == size);
+
+  size_t r_msg_count;
+  const upb_test_TestMessage *const *r_msg =
+      upb_test_TestMessage_r_msg(msg, &r_msg_count);
+  size_t next = 0;
+  for (size_t i = 0; i < r_msg_count; i++) {
+    size_t sub_size = upb_encoded_size(r_msg[i], l);
+    while (next < sizes.count && sizes.lengths[next] != sub_size) next++;
+    ASSERT(next < sizes.count);
+    next++;
+  }
+
+  std::string buf(sizes.size, '\0');
+  upb_encode_sized(msg, l, &sizes, &buf[0]);
+  ASSERT(buf == std::string(data, size));
+
+  /* An empty message has no lengths. */
+  ASSERT(upb_encoded_sizes(upb_test_TestMessage_new(arena.ptr()), l,
+                           arena.ptr(), &sizes));
+  ASSERT(sizes.size == 0 && sizes.count == 0);
+}
+
+void TestDeterministicEncode() {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestMaps_msginit;
+  upb_test_TestMaps *maps[2];
+  std::vector<std::pair<std::string, int32_t> > keys;
+  for (int i = 0; i < 100; i++) {
+    keys.push_back(std::make_pair(std::to_string(i * 37 % 100), i * 37 % 100));
+  }
+  keys.push_back(std::make_pair(std::string(), 100));
+  keys.push_back(std::make_pair(std::string("1\0", 2), 101));
+
+  for (int i = 0; i < 2; i++) {
+    maps[i] = upb_test_TestMaps_new(arena.ptr());
+    for (size_t j = 0; j < keys.size(); j++) {
+      const std::string& key = keys[i ? keys.size() - 1 - j : j].first;
+      int32_t num = keys[i ? keys.size() - 1 - j : j].second;
+      upb_test_TestMessage *sub = upb_test_TestMessage_new(arena.ptr());
+      upb_test_TestMessage_set_i32(sub, num);
+      ASSERT(upb_test_TestMaps_str_i32_set(
+          maps[i], upb_strview_make(key.data(), key.size()), num,
+          arena.ptr()));
+      ASSERT(upb_test_TestMaps_i32_msg_set(maps[i], num - 50, sub,
+                                           arena.ptr()));
+    }
+  }
+
+  std::string encoded[2];
+  for (int i = 0; i < 2; i++) {
+    size_t size, fwd_size;
+    char *data = upb_encode_ex(maps[i], l, arena.ptr(),
+                               UPB_ENCODE_DETERMINISTIC, &size);
+    char *fwd = upb_encode_ex(maps[i], l, arena.ptr(),
+                              UPB_ENCODE_DETERMINISTIC | UPB_ENCODE_FORWARD,
+                              &fwd_size);
+    ASSERT(data && fwd);
+    encoded[i].assign(data, size);
+    ASSERT(encoded[i] == std::string(fwd, fwd_size));
+  }
+  ASSERT(encoded[0] == encoded[1]);
+
+  /* Entries come in key order: strings bytewise, integers by value. */
+  const char *ptr = encoded[0].data();
+  const char *end = ptr + encoded[0].size();
+  std::string prev_key;
+  int32_t prev_num = -51;
+  bool first = true;
+  while (ptr < end) {
+    uint8_t tag = ptr[0];
+    uint8_t len = ptr[1];
+    if (tag == 0x0a) {
+      std::string key(ptr + 4, (uint8_t)ptr[3]);
+      ASSERT(first || prev_key < key);
+      prev_key = key;
+      first = false;
+    } else {
+      upb_test_TestMaps *entry = upb_test_TestMaps_parse(ptr, len + 2,
+                                                         arena.ptr());
+      const upb_test_TestMessage *msg;
+      ASSERT(entry);
+      size_t iter = UPB_MAP_BEGIN;
+      int32_t num;
+      ASSERT(upb_test_TestMaps_i32_msg_next(entry, &iter, &num, &msg));
+      ASSERT(num > prev_num);
+      prev_num = num;
+    }
+    ptr += len + 2;
+  }
+  ASSERT(ptr == end && !first && prev_num == 51);
+}
+
+/* Appends field |n| of upb.test.TestSparse to |out|, in the form upb_encode()
+ * writes it: repeated fields packed, with a single element. */
+static void AppendSparseField(std::string *out, int n) {
+  bool delimited = n == 11 || n == 22 || n == 31;
+  uint32_t tag = n << 3 | (delimited ? 2 : 0);
+  do {
+    out->push_back((char)((tag & 0x7f) | (tag > 0x7f ? 0x80 : 0)));
+    tag >>= 7;
+  } while (tag);
+  if (n == 11) {
+    *out += "\x01\x0b";
+  } else if (delimited) {
+    *out += "\x01s";
+  } else {
+    out->push_back((char)n);
+  }
+}
+
+/* Parses a TestSparse with the fields in |numbers| set, which must be in
+ * number order, and checks that both encoders give back the same bytes. */
+static void CheckSparse(const std::vector<int> &numbers) {
+  upb::Arena arena;
+  const upb_msglayout *l = &upb_test_TestSparse_msginit;
+  std::string input;
+  for (size_t i = 0; i < numbers.size(); i++) {
+    AppendSparseField(&input, numbers[i]);
+  }
+  upb_test_TestSparse *msg = upb_test_TestSparse_parse_ex(
+      input.data(), input.size(), arena.ptr(), 0);
+  ASSERT(msg);
+  size_t size, fwd_size;
+  char *data = upb_encode(msg, l, arena.ptr(), &size);
+  char *fwd = upb_encode_ex(msg, l, arena.ptr(), UPB_ENCODE_FORWARD,
+                            &fwd_size);
+  ASSERT(data && fwd);
+  ASSERT(std::string(data, size) == input);
+  ASSERT(std::string(fwd, fwd_size) == input);
+}
+
+void TestSkipAbsent() {
+  /* TestSparse has hasbit fields 1-72, except for repeated fields 11 and 31
+   * and oneof fields 21 and 22.  Single fields and pairs leave runs of every
+   * length absent before, between and after them, the first and last fields
+   * included. */
+  std::vector<int> numbers;
+  CheckSparse(numbers);
+  for (int i = 1; i <= 72; i++) {
+    numbers.assign(1, i);
+    CheckSparse(numbers);
+    for (int j = i + 1; j <= 72; j++) {
+      if (i == 21 && j == 22) continue;  /* Only one of a oneof. */
+      numbers.assign(1, i);
+      numbers.push_back(j);
+      CheckSparse(numbers);
+    }
+  }
+
+  /* Sparse random sets, and every field but the first of the oneof. */
+  uint32_t seed = 1;
+  for (int round = 0; round <= 200; round++) {
+    numbers.clear();
+    for (int i = 1; i <= 72; i++) {
+      seed = seed * 1103515245 + 12345;
+      if (round == 200 ? i != 21 : (seed >> 16) % 8 == 0) {
+        if (i == 22 && !numbers.empty() && numbers.back() == 21) {
+          numbers.pop_back();
+        }
+        numbers.push_back(i);
+      }
+    }
+    CheckSparse(numbers);
+  }
+}
+
+extern "C" {
+
+int run_tests(int argc, char *argv[]) {
+  TestEncodeInto();
+  TestEncodedSizes();
+  TestDeterministicEncode();
+  TestSkipAbsent();
+  return 0;
+}
+
+}
@@ -0,0 +1,255 @@
+/*
+ * Tests for copying, merging and clearing messages, and for their layout.
+ */
+
+#include <string.h>
+
+#include <string>
+
+#include "google/protobuf/descriptor.upb.h"
+#include "tests/test_cpp.upb.h"
+#include "tests/test_cpp.upbdefs.h"
+#include "tests/upb_test.h"
+#include "upb/msg.h"
+#include "upb/upb.h"
+
+static std::string Serialize(const upb_test_TestMessage *msg) {
+  upb::Arena arena;
+  size_t size;
+  char *data = upb_test_TestMessage_serialize(msg, arena.ptr(), &size);
+  ASSERT(data);
+  return std::string(data, size);
+}
+
+void TestMsgCopyMerge() {
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  upb::Arena arena;
+  /* i32: 1, str: "abc", r_i32: [1, 2], msg {i32: 2}, r_msg [{str: "x"}],
+   * lazy_msg {i32: 3}, and unknown field 15. */
+  std::string src_data(
+      "\x08\x01\x1a\x03" "abc" "\x10\x01\x10\x02\x2a\x02\x08\x02"
+      "\x32\x03\x1a\x01" "x" "\x3a\x02\x08\x03\x78\x07", 26);
+  /* i32: 5, r_i32: [9], msg {str: "d"}, lazy_msg {str: "e"}. */
+  std::string dst_data(
+      "\x08\x05\x10\x09\x2a\x03\x1a\x01" "d" "\x3a\x03\x1a\x01" "e", 14);
+
+  upb_test_TestMessage *copy;
+  std::string encoded;
+  {
+    upb::Arena src_arena;
+    upb_test_TestMessage *src = upb_test_TestMessage_parse_ex(
+        src_data.data(), src_data.size(), src_arena.ptr(), 0);
+    ASSERT(src);
+    copy = (upb_test_TestMessage*)upb_msg_copy(src, l, arena.ptr(), 0);
+    ASSERT(copy);
+    encoded = Serialize(src);
+  }
+  /* Nothing in the copy points into the freed source. */
+  ASSERT(Serialize(copy) == encoded);
+  upb_test_TestMessage_set_i32(
+      upb_test_TestMessage_mutable_msg(copy, arena.ptr()), 4);
+  ASSERT(upb_test_TestMessage_i32(upb_test_TestMessage_lazy_msg(copy)) == 3);
+
+  /* Merging gives what parsing both encodings in turn gives, with or without
+   * the lazy submessages parsed on either side. */
+  for (int parsed = 0; parsed < 4; parsed++) {
+    for (int options = 0; options <= UPB_MSG_ALIAS; options++) {
+      upb::Arena merge_arena;
+      upb_test_TestMessage *src = upb_test_TestMessage_parse(
+          src_data.data(), src_data.size(), merge_arena.ptr());
+      upb_test_TestMessage *dst = upb_test_TestMessage_parse(
+          dst_data.data(), dst_data.size(), merge_arena.ptr());
+      if (parsed & 1) upb_test_TestMessage_lazy_msg(src);
+      if (parsed & 2) upb_test_TestMessage_lazy_msg(dst);
+      ASSERT(upb_msg_merge(dst, src, l, merge_arena.ptr(), options));
+      std::string both = dst_data + src_data;
+      upb_test_TestMessage *expected = upb_test_TestMessage_parse(
+          both.data(), both.size(), merge_arena.ptr());
+      ASSERT(upb_test_TestMessage_i32(dst) == 1);
+      const upb_test_TestMessage *lazy = upb_test_TestMessage_lazy_msg(dst);
+      ASSERT(upb_test_TestMessage_i32(lazy) == 3);
+      ASSERT(upb_strview_eql(upb_test_TestMessage_str(lazy),
+                             upb_strview_makez("e")));
+      upb_test_TestMessage_lazy_msg(expected);
+      ASSERT(Serialize(dst) == Serialize(expected));
+    }
+  }
+
+  upb_msg_clear(copy, l);
+  ASSERT(!upb_test_TestMessage_has_i32(copy));
+  ASSERT(!upb_test_TestMessage_has_lazy_msg(copy));
+  ASSERT(Serialize(copy).empty());
+
+  upb_test_TestMaps *maps = upb_test_TestMaps_new(arena.ptr());
+  upb_test_TestMessage *sub = upb_test_TestMessage_new(arena.ptr());
+  upb_test_TestMessage_set_i32(sub, 5);
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("a"), 1,
+                                       arena.ptr()));
+  ASSERT(upb_test_TestMaps_i32_msg_set(maps, 7, sub, arena.ptr()));
+  upb_test_TestMaps *maps2 = (upb_test_TestMaps*)upb_msg_copy(
+      maps, &upb_test_TestMaps_msginit, arena.ptr(), 0);
+  ASSERT(maps2);
+  upb_test_TestMessage_set_i32(sub, 6);
+  int32_t i32;
+  const upb_test_TestMessage *msg;
+  ASSERT(upb_test_TestMaps_str_i32_get(maps2, upb_strview_makez("a"), &i32));
+  ASSERT(i32 == 1);
+  ASSERT(upb_test_TestMaps_i32_msg_get(maps2, 7, &msg));
+  ASSERT(msg != sub && upb_test_TestMessage_i32(msg) == 5);
+  ASSERT(upb_test_TestMaps_str_i32_set(maps, upb_strview_makez("a"), 2,
+                                       arena.ptr()));
+  ASSERT(upb_msg_merge(maps2, maps, &upb_test_TestMaps_msginit, arena.ptr(),
+                       0));
+  ASSERT(upb_test_TestMaps_str_i32_get(maps2, upb_strview_makez("a"), &i32));
+  ASSERT(i32 == 2);
+  ASSERT(upb_test_TestMaps_i32_msg_get(maps2, 7, &msg));
+  ASSERT(upb_test_TestMessage_i32(msg) == 6);
+}
+
+void TestArrayInline() {
+  const upb_msglayout *l = &upb_test_TestMessage_msginit;
+  const upb_msglayout_field *r_i32 = NULL;
+  upb::Arena arena;
+  for (int i = 0; i < l->field_count; i++) {
+    if (l->fields[i].number == 2) r_i32 = &l->fields[i];
+  }
+  ASSERT(r_i32);
+
+  /* r_i32: [1, 2, 3], not packed and interrupted by i32, then [4]. */
+  std::string data("\x10\x01\x10\x02\x10\x03\x08\x07\x10\x04", 10);
+  for (int options = 0; options <= UPB_DECODE_FASTTABLE;
+       options += UPB_DECODE_FASTTABLE) {
+    upb_test_TestMessage *msg = upb_test_TestMessage_parse_ex(
+        data.data(), data.size(), arena.ptr(), options);
+    ASSERT(msg);
+    const upb_array *arr = *(upb_array**)((char*)msg + r_i32->offset);
+    /* Sized for the first run, with the elements right after the header. */
+    ASSERT(arr->len == 4 && arr->size >= 4);
+    size_t len;
+    const int32_t *elems = upb_test_TestMessage_r_i32(msg, &len);
+    ASSERT(len == 4);
+    for (int i = 0; i < 4; i++) ASSERT(elems[i] == i + 1);
+
+    msg = upb_test_TestMessage_parse_ex(data.data(), 6, arena.ptr(), options);
+    arr = *(upb_array**)((char*)msg + r_i32->offset);
+    ASSERT(arr->len == 3 && arr->size == 3);
+    ASSERT((char*)arr->data >= (char*)(arr + 1) &&
+           (char*)arr->data < (char*)(arr + 1) + 8);
+  }
+
+  const upb_array *arr;
+
+  /* A run longer than the decoder looks ahead grows the array as it goes. */
+  std::string run;
+  for (int i = 0; i < 100; i++) {
+    run += '\x10';
+    run += (char)i;
+  }
+  upb_test_TestMessage *msg =
+      upb_test_TestMessage_parse(run.data(), run.size(), arena.ptr());
+  size_t len;
+  const int32_t *elems = upb_test_TestMessage_r_i32(msg, &len);
+  ASSERT(len == 100);
+  for (int i = 0; i < 100; i++) ASSERT(elems[i] == i);
+
+  /* Runs cut short by the end of the input, or of the submessage. */
+  std::string submsg("\x32\x04\x10\x05\x10\x06\x10", 7);
+  ASSERT(!upb_test_TestMessage_parse(submsg.data(), submsg.size(),
+                                     arena.ptr()));
+  submsg = std::string("\x32\x04\x10\x05\x10\x06\x10\x07", 8);
+  msg = upb_test_TestMessage_parse(submsg.data(), submsg.size(), arena.ptr());
+  ASSERT(msg);
+  elems = upb_test_TestMessage_r_i32(msg, &len);
+  ASSERT(len == 1 && elems[0] == 7);
+  const upb_test_TestMessage *const *subs =
+      upb_test_TestMessage_r_msg(msg, &len);
+  ASSERT(len == 1);
+  arr = *(upb_array**)((char*)subs[0] + r_i32->offset);
+  ASSERT(arr->len == 2 && arr->size == 2);
+
+  /* The generated accessors start with upbc's inline capacity. */
+  msg = upb_test_TestMessage_new(arena.ptr());
+  for (int i = 0; i < 20; i++) {
+    ASSERT(upb_test_TestMessage_add_r_i32(msg, i, arena.ptr()));
+    if (i == 0) {
+      arr = *(upb_array**)((char*)msg + r_i32->offset);
+      ASSERT(arr->size == 8);
+    }
+  }
+  elems = upb_test_TestMessage_r_i32(msg, &len);
+  ASSERT(len == 20);
+  for (int i = 0; i < 20; i++) ASSERT(elems[i] == i);
+
+  /* Copies are sized exactly. */
+  upb_test_TestMessage *copy =
+      (upb_test_TestMessage*)upb_msg_copy(msg, l, arena.ptr(), 0);
+  arr = *(upb_array**)((char*)copy + r_i32->offset);
+  ASSERT(arr->len == 20 && arr->size == 20);
+  ASSERT(memcmp(arr->data, elems, 20 * sizeof(int32_t)) == 0);
+}
+
+void TestSparseInit() {
+  /* FileDescriptorProto is large enough that upb_msg_new() only zeroes its
+   * hasbits and repeated fields.  The arena's memory starts out as garbage to
+   * check that nothing reads the rest before setting it. */
+  const upb_msglayout *l = &google_protobuf_FileDescriptorProto_msginit;
+  static char mem[1 << 18];
+  memset(mem, 0xab, sizeof(mem));
+  upb_arena *arena = upb_arena_init(mem, sizeof(mem), NULL);
+  ASSERT(l->zero_ranges);
+
+  google_protobuf_FileDescriptorProto *file =
+      google_protobuf_FileDescriptorProto_new(arena);
+  ASSERT(!google_protobuf_FileDescriptorProto_has_name(file));
+  ASSERT(google_protobuf_FileDescriptorProto_name(file).size == 0);
+  ASSERT(google_protobuf_FileDescriptorProto_options(file) == NULL);
+  size_t len;
+  google_protobuf_FileDescriptorProto_message_type(file, &len);
+  ASSERT(len == 0);
+  google_protobuf_FileDescriptorProto_serialize(file, arena, &len);
+  ASSERT(len == 0);
+
+  /* A new submessage is sparse too. */
+  google_protobuf_FileOptions *opts =
+      google_protobuf_FileDescriptorProto_mutable_options(file, arena);
+  ASSERT(opts && google_protobuf_FileDescriptorProto_options(file) == opts);
+  ASSERT(!google_protobuf_FileOptions_has_java_package(opts));
+  ASSERT(!google_protobuf_FileOptions_cc_enable_arenas(opts));
+
+  /* Parsing, copying and merging into garbage memory give the same bytes. */
+  upb_strview input = tests_test_cpp_proto_upbdefinit.descriptor;
+  file = google_protobuf_FileDescriptorProto_parse(input.data, input.size,
+                                                   arena);
+  ASSERT(file);
+  char *out = google_protobuf_FileDescriptorProto_serialize(file, arena, &len);
+  ASSERT(len == input.size && memcmp(out, input.data, len) == 0);
+
+  google_protobuf_FileDescriptorProto *copy =
+      (google_protobuf_FileDescriptorProto*)upb_msg_copy(file, l, arena, 0);
+  out = google_protobuf_FileDescriptorProto_serialize(copy, arena, &len);
+  ASSERT(len == input.size && memcmp(out, input.data, len) == 0);
+
+  copy = google_protobuf_FileDescriptorProto_new(arena);
+  ASSERT(upb_msg_merge(copy, file, l, arena, 0));
+  out = google_protobuf_FileDescriptorProto_serialize(copy, arena, &len);
+  ASSERT(len == input.size && memcmp(out, input.data, len) == 0);
+
+  upb_msg_clear(copy, l);
+  ASSERT(!google_protobuf_FileDescriptorProto_has_package(copy));
+  google_protobuf_FileDescriptorProto_serialize(copy, arena, &len);
+  ASSERT(len == 0);
+
+  upb_arena_free(arena);
+}
+
+extern "C" {
+
+int run_tests(int argc, char *argv[]) {
+  TestMsgCopyMerge();
+  TestArrayInline();
+  TestSparseInit();
+
+  return 0;
+}
+
+}
@@ -366,6 +366,11 @@ void test_strtable(const vector<std::string>& keys, uint32_t num_to_insert) {
     } else {
       ASSERT(!found.first);
     }
+
+    upb_value v;
+    uint64_t hash = upb_strhash(key.data(), key.size());
+    ASSERT(upb_strtable_lookup_hashed(&table.table_.table_, key.data(),
+                                      key.size(), hash, &v) == found.first);
   }
 
   for (Table::iterator it = table.begin(); it != table.end(); ++it) {
@@ -384,7 +389,7 @@ void test_strtable(const vector<std::string>& keys, uint32_t num_to_insert) {
 
       // Force a resize even though the size isn't changing.
       // Also forces the table size to grow so some new buckets end up empty.
-      int new_lg2 = table.table_.table_.t.size_lg2 + 1;
+      int new_lg2 = table.table_.table_.size_lg2 + 1;
       // Don't use more than 64k tables, to avoid exhausting memory.
       new_lg2 = UPB_MIN(new_lg2, 16);
       table.Resize(new_lg2);
@@ -393,6 +398,57 @@ void test_strtable(const vector<std::string>& keys, uint32_t num_to_insert) {
 
 }
 
+// Inserts and removes keys at random, so that the table fills up with deleted
+// slots, and checks it against std::map after each step.
+void test_strtable_churn() {
+  typedef upb::TypedStrTable<int32_t> Table;
+  Table table;
+  std::map<std::string, int32_t> m;
+
+  for (int i = 0; i < 20000; i++) {
+    int32_t n = random() % 600;
+    std::string key = "key" + std::to_string(n);
+    if (random() % 2) {
+      if (m.find(key) == m.end()) {
+        ASSERT(table.Insert(key, n));
+        m[key] = n;
+      }
+    } else {
+      std::pair<bool, int32_t> found = table.Remove(key);
+      ASSERT(found.first == (m.erase(key) == 1));
+      if (found.first) ASSERT(found.second == n);
+    }
+    ASSERT(table.count() == m.size());
+  }
+
+  for (int32_t n = 0; n < 600; n++) {
+    std::string key = "key" + std::to_string(n);
+    std::pair<bool, int32_t> found = table.Lookup(key);
+    ASSERT(found.first == (m.find(key) != m.end()));
+    if (found.first) ASSERT(found.second == n);
+  }
+
+  std::map<std::string, int32_t> seen;
+  for (Table::iterator it = table.begin(); it != table.end(); ++it) {
+    ASSERT(seen.insert(*it).second);
+  }
+  ASSERT(seen == m);
+
+  // Reverse iteration visits the same entries in the opposite order.
+  std::vector<std::string> forward;
+  for (Table::iterator it = table.begin(); it != table.end(); ++it) {
+    forward.push_back((*it).first);
+  }
+  upb_strtable_iter iter;
+  upb_strtable_rbegin(&iter, &table.table_.table_);
+  for (size_t i = forward.size(); i > 0; i--) {
+    ASSERT(!upb_strtable_done(&iter));
+    ASSERT(forward[i - 1] == upb_strtable_iter_key(&iter));
+    upb_strtable_prev(&iter);
+  }
+  ASSERT(upb_strtable_done(&iter));
+}
+
 /* num_entries must be a power of 2. */
 void test_inttable(int32_t *keys, uint16_t num_entries, const char *desc) {
   /* Initialize structures. */
@@ -574,6 +630,110 @@ void test_inttable(int32_t *keys, uint16_t num_entries, const char *desc) {
   delete[] rand_order;
 }
 
+// Compares upb_strtable lookups of symbol-like names against the standard
+// containers.  Only runs when benchmarking.
+void test_strtable_benchmark(uint32_t num_keys) {
+  if (!benchmark) {
+    return;
+  }
+
+  typedef upb::TypedStrTable<uint32_t> Table;
+  Table table;
+  std::map<std::string, uint32_t> m;
+  std::unordered_map<std::string, uint32_t> hm;
+  vector<std::string> keys;
+  for (uint32_t i = 0; i < num_keys; i++) {
+    keys.push_back("google.protobuf.Message" + std::to_string(i) + ".field");
+    table.Insert(keys[i], i);
+    m[keys[i]] = i;
+    hm[keys[i]] = i;
+  }
+
+  vector<uint32_t> rand_order;
+  for (uint32_t i = 0; i < num_keys; i++) {
+    rand_order.push_back(i);
+  }
+  for (uint32_t i = num_keys - 1; i >= 1; i--) {
+    uint32_t rand_i = random() % (i + 1);
+    std::swap(rand_order[i], rand_order[rand_i]);
+  }
+
+  printf("Table size: %u, string keys ====\n\n", num_keys);
+
+  uintptr_t x = 0;
+  const uint32_t mask = num_keys - 1;
+  int time_mask = 0xffff;
+  const upb_strtable *t = &table.table_.table_;
+
+  printf("upb_strtable(seq): ");
+  fflush(stdout);
+  double before = get_usertime();
+  unsigned int i;
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    const std::string& key = keys[i & mask];
+    upb_value v;
+    x += upb_strtable_lookup2(t, key.data(), key.size(), &v);
+  }
+  double total = get_usertime() - before;
+  printf("%ld/s\n", (long)(i/total));
+  double upb_seq_i = i / 100;  // For later percentage calculation.
+
+  printf("upb_strtable(rand): ");
+  fflush(stdout);
+  before = get_usertime();
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    const std::string& key = keys[rand_order[i & mask]];
+    upb_value v;
+    x += upb_strtable_lookup2(t, key.data(), key.size(), &v);
+  }
+  total = get_usertime() - before;
+  printf("%ld/s\n", (long)(i/total));
+  double upb_rand_i = i / 100;  // For later percentage calculation.
+
+  printf("std::map<std::string, uint32_t>(seq): ");
+  fflush(stdout);
+  before = get_usertime();
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    x += m.find(keys[i & mask])->second;
+  }
+  total = get_usertime() - before;
+  printf("%ld/s (%0.1f%% of upb)\n", (long)(i/total), i / upb_seq_i);
+
+  printf("std::map<std::string, uint32_t>(rand): ");
+  fflush(stdout);
+  before = get_usertime();
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    x += m.find(keys[rand_order[i & mask]])->second;
+  }
+  total = get_usertime() - before;
+  printf("%ld/s (%0.1f%% of upb)\n", (long)(i/total), i / upb_rand_i);
+
+  printf("std::unordered_map<std::string, uint32_t>(seq): ");
+  fflush(stdout);
+  before = get_usertime();
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    x += hm.find(keys[i & mask])->second;
+  }
+  total = get_usertime() - before;
+  printf("%ld/s (%0.1f%% of upb)\n", (long)(i/total), i / upb_seq_i);
+
+  printf("std::unordered_map<std::string, uint32_t>(rand): ");
+  fflush(stdout);
+  before = get_usertime();
+  for(i = 0; true; i++) {
+    MAYBE_BREAK;
+    x += hm.find(keys[rand_order[i & mask]])->second;
+  }
+  total = get_usertime() - before;
+  if (x == INT_MAX) abort();
+  printf("%ld/s (%0.1f%% of upb)\n\n", (long)(i/total), i / upb_rand_i);
+}
+
 /*
  * This test can't pass right now because the table can't store a value of
  * (uint64_t)-1.
@@ -597,6 +757,58 @@ int32_t *get_contiguous_keys(int32_t num) {
   return buf;
 }
 
+void test_freeze() {
+  upb_arena *arena = upb_arena_new();
+  upb_alloc *alloc = upb_arena_alloc(arena);
+  upb_strtable st;
+  upb_inttable it;
+  std::map<std::string, int32_t> m;
+
+  upb_strtable_init(&st, UPB_CTYPE_INT32);
+  upb_inttable_init(&it, UPB_CTYPE_INT32);
+  for (int32_t i = 0; i < 300; i++) {
+    std::string key = "name" + std::to_string(i);
+    upb_strtable_insert2(&st, key.data(), key.size(), upb_value_int32(i));
+    upb_inttable_insert(&it, i * 7, upb_value_int32(i));
+    m[key] = i;
+  }
+  for (int32_t i = 0; i < 300; i += 3) {
+    std::string key = "name" + std::to_string(i);
+    upb_strtable_remove2(&st, key.data(), key.size(), NULL);
+    m.erase(key);
+  }
+  upb_inttable_compact(&it);
+
+  ASSERT(upb_strtable_freeze(&st, &upb_alloc_global, alloc));
+  ASSERT(upb_inttable_freeze(&it, &upb_alloc_global, alloc));
+
+  ASSERT(upb_strtable_count(&st) == m.size());
+  for (int32_t i = 0; i < 300; i++) {
+    std::string key = "name" + std::to_string(i);
+    upb_value v;
+    bool found = upb_strtable_lookup2(&st, key.data(), key.size(), &v);
+    ASSERT(found == (i % 3 != 0));
+    if (found) ASSERT(upb_value_getint32(v) == i);
+    ASSERT(upb_inttable_lookup(&it, i * 7, &v));
+    ASSERT(upb_value_getint32(v) == i);
+    ASSERT(!upb_inttable_lookup(&it, i * 7 + 1, &v));
+  }
+
+  std::map<std::string, int32_t> seen;
+  upb_strtable_iter iter;
+  upb_strtable_begin(&iter, &st);
+  for (; !upb_strtable_done(&iter); upb_strtable_next(&iter)) {
+    std::string key(upb_strtable_iter_key(&iter),
+                    upb_strtable_iter_keylength(&iter));
+    seen[key] = upb_value_getint32(upb_strtable_iter_value(&iter));
+  }
+  ASSERT(seen == m);
+  ASSERT(upb_inttable_count(&it) == 300);
+
+  // Frozen tables belong to the arena, so there is nothing else to free.
+  upb_arena_free(arena);
+}
+
 void test_delete() {
   upb_inttable t;
   upb_inttable_init(&t, UPB_CTYPE_BOOL);
@@ -670,6 +882,11 @@ int run_tests(int argc, char *argv[]) {
   test_inttable(keys4, 64, "Table size: 64, keys: 1-32 and 10133-10164 ====\n");
   delete[] keys4;
 
+  test_strtable_churn();
+  test_strtable_benchmark(128);
+  test_strtable_benchmark(8192);
+
+  test_freeze();
   test_delete();
   test_int64_max_value();
 
@@ -0,0 +1,434 @@
+/*
+ * Tests for the code that upbc generates with the options in the BUILD rule
+ * for tests/test_upbc_options.proto: each message must decode and encode the
+ * same whether it goes through the generated parsers and serializers or the
+ * generic decoder and encoder.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tests/test_upbc_options.upb.h"
+#include "tests/upb_test.h"
+#include "upb/decode.h"
+#include "upb/encode.h"
+#include "upb/upb.h"
+
+static void PutVarint(std::string* s, uint64_t val) {
+  do {
+    char byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    s->push_back(byte);
+  } while (val);
+}
+
+static void PutTag(std::string* s, uint32_t number, int wire_type) {
+  PutVarint(s, (number << 3) | wire_type);
+}
+
+static void PutVarintField(std::string* s, uint32_t number, uint64_t val) {
+  PutTag(s, number, UPB_WIRE_TYPE_VARINT);
+  PutVarint(s, val);
+}
+
+static void PutFixed64Field(std::string* s, uint32_t number, uint64_t val) {
+  int i;
+  PutTag(s, number, UPB_WIRE_TYPE_64BIT);
+  for (i = 0; i < 8; i++) {
+    s->push_back((char)(val >> (i * 8)));
+  }
+}
+
+static void PutDelimitedField(std::string* s, uint32_t number,
+                              const std::string& data) {
+  PutTag(s, number, UPB_WIRE_TYPE_DELIMITED);
+  PutVarint(s, data.size());
+  s->append(data);
+}
+
+/* An Item with |name| last, so that it ends with the tag of
+ * Request.payload. */
+static std::string EncodedItem(int id, const char* name) {
+  std::string item;
+  PutVarintField(&item, 1, id);
+  PutDelimitedField(&item, 4, name);
+  return item;
+}
+
+/* Decodes |buf| as a Request with |options|, and returns whether it worked
+ * and, if so, the message encoded again in |out|. */
+static bool DecodeRequest(const std::string& buf, int options,
+                          upb_arena* arena, std::string* out) {
+  upb_test_options_Request* msg = upb_test_options_Request_new(arena);
+  char* data;
+  size_t size;
+
+  if (!upb_decode_ex(buf.data(), buf.size(), msg,
+                     &upb_test_options_Request_msginit, arena, options)) {
+    return false;
+  }
+
+  data = upb_encode(msg, &upb_test_options_Request_msginit, arena, &size);
+  ASSERT(data);
+  out->assign(data, size);
+  return true;
+}
+
+/* Checks that the generated fast table and hot parsers decode |buf| just like
+ * the generic decoder, and returns the re-encoded message ("" on failure). */
+static std::string AssertSameDecode(const std::string& buf) {
+  upb::Arena arena;
+  std::string generic;
+  std::string fast;
+  bool generic_ok = DecodeRequest(buf, 0, arena.ptr(), &generic);
+  bool fast_ok = DecodeRequest(buf, UPB_DECODE_FASTTABLE, arena.ptr(), &fast);
+
+  ASSERT(generic_ok == fast_ok);
+  ASSERT(generic == fast);
+  return fast;
+}
+
+/* The fields of the profile, in order, with two items.  The deltas are
+ * packed if |packed|, as upb_encode() writes them. */
+static std::string HotRequest(bool packed) {
+  std::string buf;
+  std::string deltas;
+
+  PutVarintField(&buf, 1, 123456789012ull);
+  PutDelimitedField(&buf, 2, EncodedItem(1, "a"));
+  PutDelimitedField(&buf, 2, EncodedItem(2, "b"));
+  PutVarintField(&buf, 3, 1);
+  PutDelimitedField(&buf, 4, "payload");
+  PutFixed64Field(&buf, 9, 0x3ff8000000000000ull);  /* 1.5 */
+  if (packed) {
+    PutVarint(&deltas, 3);  /* -2, zigzag. */
+    PutVarint(&deltas, 4);  /* 2 */
+    PutDelimitedField(&buf, 10, deltas);
+  } else {
+    PutVarintField(&buf, 10, 3);
+    PutVarintField(&buf, 10, 4);
+  }
+  PutDelimitedField(&buf, 20, EncodedItem(3, "c"));
+  return buf;
+}
+
+static void TestHotParserSequence() {
+  upb::Arena arena;
+  std::string buf = HotRequest(false);
+  upb_test_options_Request* msg = upb_test_options_Request_new(arena.ptr());
+  const upb_test_options_Item* const* items;
+  const int32_t* deltas;
+  size_t size;
+
+  ASSERT(AssertSameDecode(buf) == HotRequest(true));
+  ASSERT(AssertSameDecode(HotRequest(true)) == HotRequest(true));
+
+  ASSERT(upb_decode_ex(buf.data(), buf.size(), msg,
+                       &upb_test_options_Request_msginit, arena.ptr(),
+                       UPB_DECODE_FASTTABLE));
+  ASSERT(upb_test_options_Request_id(msg) == 123456789012ll);
+  items = upb_test_options_Request_items(msg, &size);
+  ASSERT(size == 2);
+  ASSERT(upb_test_options_Item_id(items[0]) == 1);
+  ASSERT(upb_strview_eql(upb_test_options_Item_name(items[0]),
+                         upb_strview_makez("a")));
+  ASSERT(upb_test_options_Item_id(items[1]) == 2);
+  ASSERT(upb_strview_eql(upb_test_options_Item_name(items[1]),
+                         upb_strview_makez("b")));
+  ASSERT(upb_test_options_Request_flag(msg));
+  ASSERT(upb_test_options_Request_ratio(msg) == 1.5);
+  deltas = upb_test_options_Request_deltas(msg, &size);
+  ASSERT(size == 2);
+  ASSERT(deltas[0] == -2);
+  ASSERT(deltas[1] == 2);
+  ASSERT(upb_test_options_Item_id(upb_test_options_Request_extra(msg)) == 3);
+}
+
+static void TestHotParserRepeatedSubmsg() {
+  /* Each item ends with the tag of the payload that follows them, so the
+   * parser has to compare the next tag with the one that started the item,
+   * not with the last one read inside it.  Many items in a row also take the
+   * array past its first allocation. */
+  std::string buf;
+  std::string name_only;
+  int i;
+
+  PutVarintField(&buf, 1, 1);
+  for (i = 0; i < 40; i++) {
+    PutDelimitedField(&buf, 2, EncodedItem(i, "xy"));
+  }
+  PutDelimitedField(&buf, 4, "payload");
+  ASSERT(AssertSameDecode(buf) == buf);
+
+  /* The same with items that are empty, or have only the colliding field. */
+  buf.clear();
+  PutDelimitedField(&buf, 2, "");
+  PutDelimitedField(&name_only, 4, "");
+  PutDelimitedField(&buf, 2, name_only);
+  PutDelimitedField(&buf, 2, name_only);
+  PutDelimitedField(&buf, 4, "p");
+  ASSERT(AssertSameDecode(buf) == buf);
+}
+
+static void TestHotParserOtherOrders() {
+  std::string buf;
+  std::string item;
+  std::string entry;
+  std::string packed;
+
+  /* Fields the hot parser doesn't handle, between the ones it does. */
+  PutVarintField(&buf, 1, 7);
+  PutVarint(&packed, 1);
+  PutVarint(&packed, 300);
+  PutDelimitedField(&buf, 5, packed);
+  PutDelimitedField(&entry, 1, "key");
+  PutVarintField(&entry, 2, 5);
+  PutDelimitedField(&buf, 6, entry);
+  PutDelimitedField(&buf, 7, "text");
+  PutFixed64Field(&buf, 9, 0);
+  PutDelimitedField(&buf, 20, EncodedItem(1, "z"));
+  ASSERT(AssertSameDecode(buf) == buf);
+
+  /* Fields out of order, repeated singular fields and an unknown field,
+   * which upb_encode() does not write back the same. */
+  buf.clear();
+  PutDelimitedField(&buf, 20, EncodedItem(1, "z"));
+  PutVarintField(&buf, 3, 1);
+  PutVarintField(&buf, 1, 1);
+  PutVarintField(&buf, 1, 2);
+  PutDelimitedField(&buf, 2, EncodedItem(1, "a"));
+  PutVarintField(&buf, 99, 1);
+  PutDelimitedField(&buf, 2, EncodedItem(2, "b"));
+  PutDelimitedField(&buf, 8, EncodedItem(3, "c"));
+  PutDelimitedField(&buf, 7, "text");
+  PutVarintField(&buf, 1, 3);
+  PutFixed64Field(&item, 3, 42);
+  PutVarintField(&item, 1, 4);
+  PutDelimitedField(&buf, 20, item);
+  ASSERT(AssertSameDecode(buf) != "");
+}
+
+static void TestHotParserTruncated() {
+  /* Both decoders fail, or succeed alike, wherever the input is cut off. */
+  std::string buf = HotRequest(false);
+  size_t i;
+
+  for (i = 0; i < buf.size(); i++) {
+    AssertSameDecode(buf.substr(0, i));
+  }
+}
+
+/* Copies of the generated layouts without their serializers, so that
+ * upb_encode() walks their fields instead. */
+class GenericLayouts {
+ public:
+  const upb_msglayout* Get(const upb_msglayout* l) {
+    std::map<const upb_msglayout*, upb_msglayout>::iterator it =
+        copies_.find(l);
+    upb_msglayout* copy;
+    size_t count = 0;
+    size_t i;
+
+    if (it != copies_.end()) return &it->second;
+
+    /* Added before the submessages, which may refer back to it. */
+    copy = &copies_[l];
+    *copy = *l;
+    copy->encode = NULL;
+
+    for (i = 0; i < l->field_count; i++) {
+      const upb_msglayout_field* f = &l->fields[i];
+      if (f->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+          f->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP) {
+        count = std::max<size_t>(count, f->submsg_index + 1);
+      }
+    }
+
+    submsgs_.push_back(std::vector<const upb_msglayout*>(count));
+    std::vector<const upb_msglayout*>& submsgs = submsgs_.back();
+    for (i = 0; i < count; i++) {
+      submsgs[i] = Get(l->submsgs[i]);
+    }
+    copy->submsgs = count ? &submsgs[0] : NULL;
+    return copy;
+  }
+
+ private:
+  std::map<const upb_msglayout*, upb_msglayout> copies_;
+  std::list<std::vector<const upb_msglayout*> > submsgs_;
+};
+
+/* Checks that the generated serializers encode |buf|, decoded as a Request,
+ * to the same bytes as the generic encoder, and returns them. */
+static std::string AssertSameEncode(const std::string& buf) {
+  static const int kOptions[] = {0, UPB_ENCODE_DETERMINISTIC};
+  upb::Arena arena;
+  GenericLayouts layouts;
+  const upb_msglayout* l = &upb_test_options_Request_msginit;
+  upb_test_options_Request* msg = upb_test_options_Request_new(arena.ptr());
+  std::string generated;
+  size_t i;
+
+  ASSERT(upb_decode_ex(buf.data(), buf.size(), msg, l, arena.ptr(), 0));
+
+  for (i = 0; i < sizeof(kOptions) / sizeof(kOptions[0]); i++) {
+    size_t size;
+    char* data = upb_encode_ex(msg, l, arena.ptr(), kOptions[i], &size);
+    ASSERT(data);
+    generated.assign(data, size);
+    data = upb_encode_ex(msg, layouts.Get(l), arena.ptr(), kOptions[i], &size);
+    ASSERT(data);
+    ASSERT(generated == std::string(data, size));
+  }
+
+  return generated;
+}
+
+static void TestSerializers() {
+  std::string buf;
+  std::string item;
+  std::string entry;
+  std::string packed;
+
+  /* Without these the generic encoder would be compared with itself. */
+  ASSERT(upb_test_options_Request_msginit.encode);
+  ASSERT(upb_test_options_Item_msginit.encode);
+
+  ASSERT(AssertSameEncode("") == "");
+  ASSERT(AssertSameEncode(HotRequest(false)) == HotRequest(true));
+
+  /* Packed fields, including a negative value, which takes ten bytes. */
+  PutVarint(&packed, 0);
+  PutVarint(&packed, 300);
+  PutVarint(&packed, (uint64_t)-1);
+  PutDelimitedField(&buf, 5, packed);
+  ASSERT(AssertSameEncode(buf) == buf);
+
+  /* A map with a few entries, one of them without a value. */
+  buf.clear();
+  PutDelimitedField(&entry, 1, "b");
+  PutVarintField(&entry, 2, 2);
+  PutDelimitedField(&buf, 6, entry);
+  entry.clear();
+  PutDelimitedField(&entry, 1, "a");
+  PutVarintField(&entry, 2, 1);
+  PutDelimitedField(&buf, 6, entry);
+  entry.clear();
+  PutDelimitedField(&entry, 1, "c");
+  PutDelimitedField(&buf, 6, entry);
+  AssertSameEncode(buf);
+
+  /* Each member of the oneof, the submessage with all its fields. */
+  buf.clear();
+  PutVarintField(&buf, 1, 1);
+  PutDelimitedField(&buf, 7, "text");
+  ASSERT(AssertSameEncode(buf) == buf);
+  buf.clear();
+  PutVarintField(&item, 1, 5);
+  PutFixed64Field(&item, 3, 0x0102030405060708ull);
+  PutDelimitedField(&item, 4, "name");
+  PutDelimitedField(&buf, 8, item);
+  PutFixed64Field(&buf, 9, 0);
+  ASSERT(AssertSameEncode(buf) == buf);
+
+  /* Fields that are set to zero or empty, and unknown fields in the message
+   * and in its submessages. */
+  buf.clear();
+  PutVarintField(&buf, 1, 0);
+  PutVarintField(&buf, 3, 0);
+  PutDelimitedField(&buf, 4, "");
+  PutVarintField(&buf, 99, 1);
+  item.clear();
+  PutVarintField(&item, 1, 0);
+  PutFixed64Field(&item, 50, 7);
+  PutDelimitedField(&buf, 2, item);
+  PutDelimitedField(&buf, 2, "");
+  PutDelimitedField(&buf, 1000, "unknown");
+  PutDelimitedField(&buf, 20, item);
+  AssertSameEncode(buf);
+}
+
+/* Returns how many bytes |f| takes in the message. */
+static size_t FieldSize(const upb_msglayout_field* f) {
+  if (f->label == UPB_LABEL_REPEATED || f->label == _UPB_LABEL_MAP) {
+    return sizeof(void*);
+  }
+  switch (f->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      return 1;
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      return 4;
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES:
+      return sizeof(upb_strview);
+    case UPB_DESCRIPTOR_TYPE_MESSAGE:
+    case UPB_DESCRIPTOR_TYPE_GROUP:
+      return sizeof(void*);
+    default:
+      return 8;
+  }
+}
+
+static void TestHotLayout() {
+  /* The seven most accessed fields of Request fit in the 64 bytes right
+   * after the hasbits, and the oneof, which the profile doesn't count, comes
+   * after them with its case right after its data. */
+  const upb_msglayout* l = &upb_test_options_Request_msginit;
+  size_t hot_begin = l->size;
+  size_t hot_end = 0;
+  size_t oneof_begin = l->size;
+  size_t i;
+  size_t j;
+
+  for (i = 0; i < l->field_count; i++) {
+    const upb_msglayout_field* f = &l->fields[i];
+    size_t end = f->offset + FieldSize(f);
+
+    ASSERT(f->offset % std::min(FieldSize(f), sizeof(void*)) == 0);
+    ASSERT(end <= l->size);
+    if (f->presence < 0) {
+      ASSERT((size_t)~f->presence == f->offset + sizeof(upb_strview));
+      oneof_begin = std::min<size_t>(oneof_begin, f->offset);
+    } else if (f->number != 10 && f->number != 20) {
+      hot_begin = std::min<size_t>(hot_begin, f->offset);
+      hot_end = std::max(hot_end, end);
+    }
+
+    /* Fields outside the oneof don't overlap. */
+    for (j = 0; j < i && f->presence >= 0; j++) {
+      const upb_msglayout_field* g = &l->fields[j];
+      ASSERT(g->presence < 0 || end <= g->offset ||
+             g->offset + FieldSize(g) <= f->offset);
+    }
+  }
+
+  ASSERT(hot_begin <= 8);  /* One byte of hasbits, aligned. */
+  ASSERT(hot_end - hot_begin <= 64);
+  ASSERT(hot_end <= oneof_begin);
+}
+
+extern "C" {
+
+int run_tests(int argc, char *argv[]) {
+  TestHotParserSequence();
+  TestHotParserRepeatedSubmsg();
+  TestHotParserOtherOrders();
+  TestHotParserTruncated();
+  TestSerializers();
+  TestHotLayout();
+  return 0;
+}
+
+}
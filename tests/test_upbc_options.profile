@@ -0,0 +1,13 @@
+# Request is the hottest message, and Item the next; both get hot parsers.
+upb.test.options.Request.id 1000
+upb.test.options.Request.items 900
+upb.test.options.Request.flag 800
+upb.test.options.Request.payload 700
+upb.test.options.Request.packed 600
+upb.test.options.Request.counts 500
+upb.test.options.Request.ratio 400
+upb.test.options.Request.deltas 300
+upb.test.options.Request.extra 200
+upb.test.options.Item.id 900
+upb.test.options.Item.name 900
+upb.test.options.Item.stamp 100
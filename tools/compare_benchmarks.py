@@ -0,0 +1,79 @@
+#!/usr/bin/python
+"""Compares two runs of the benchmark binary and reports regressions.
+
+Usage:
+  bazel run -c opt :benchmark -- --benchmark_format=json > baseline.json
+  (make the change)
+  bazel run -c opt :benchmark -- --benchmark_format=json > new.json
+  tools/compare_benchmarks.py baseline.json new.json
+
+A benchmark regresses if its throughput (bytes or items per second, else
+CPU time) got worse by more than --threshold percent, or if it makes more
+allocations per iteration than before.  Exits with status 1 if any did.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+  with open(filename) as f:
+    benchmarks = json.load(f)["benchmarks"]
+  # Aggregates (with --benchmark_repetitions) replace the single runs.
+  runs = {}
+  for b in benchmarks:
+    if b.get("run_type") == "aggregate" and b.get("aggregate_name") != "median":
+      continue
+    runs[b.get("run_name", b["name"])] = b
+  return runs
+
+
+def speed(b):
+  """Returns the benchmark's speed, where higher is better."""
+  for key in ("bytes_per_second", "items_per_second"):
+    if key in b:
+      return b[key]
+  return 1.0 / b["cpu_time"]
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+  parser.add_argument("baseline")
+  parser.add_argument("new")
+  parser.add_argument("--threshold", type=float, default=5.0,
+                      help="Allowed slowdown, in percent.")
+  args = parser.parse_args()
+
+  baseline = load(args.baseline)
+  new = load(args.new)
+  regressions = 0
+
+  for name in sorted(new):
+    if name not in baseline:
+      print("%-50s (new)" % name)
+      continue
+    old_b, new_b = baseline[name], new[name]
+    change = (speed(new_b) / speed(old_b) - 1) * 100
+    note = ""
+    if change < -args.threshold:
+      note = "  SLOWER"
+      regressions += 1
+    if new_b.get("allocs", 0) > old_b.get("allocs", 0):
+      note += "  MORE ALLOCS (%g -> %g)" % (old_b["allocs"], new_b["allocs"])
+      regressions += 1
+    print("%-50s %+7.1f%%%s" % (name, change, note))
+
+  for name in sorted(set(baseline) - set(new)):
+    print("%-50s (removed)" % name)
+
+  if regressions:
+    print("%d regression(s)." % regressions)
+    return 1
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -122,6 +122,9 @@ class BuildFileFunctions(object):
   def proto_library(self, **kwargs):
     pass
 
+  def cc_proto_library(self, **kwargs):
+    pass
+
   def generated_file_staleness_test(self, **kwargs):
     pass
 
@@ -244,6 +247,10 @@ class Converter(object):
       set(CMAKE_SHARED_LINKER_FLAGS "${CMAKE_SHARED_LINKER_FLAGS} -fsanitize=address")
     endif()
 
+    if(UPB_ENABLE_STATS)
+      add_definitions(-DUPB_STATS)
+    endif()
+
     include_directories(.)
     include_directories(generated_for_cmake)
     include_directories(${CMAKE_CURRENT_BINARY_DIR})
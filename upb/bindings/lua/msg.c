@@ -52,7 +52,7 @@
 #define LUPB_MSG "lupb.msg"
 #define LUPB_STRING "lupb.string"
 
-static int lupb_msg_pushnew(lua_State *L, int narg);
+int lupb_msg_pushnew(lua_State *L, int narg);
 
 /* Lazily creates the uservalue if it doesn't exist. */
 static void lupb_getuservalue(lua_State *L, int index) {
@@ -268,15 +268,34 @@ static const struct luaL_Reg lupb_msgfactory_mm[] = {
 
 /* Userval contains a map of:
  *   [1] -> MessageFactory (to keep GC-reachable)
+ *   [2] -> slot table: [field name] -> [upb_fielddef_index(f)]
  *   [const upb_msgdef*] -> [lupb_msgclass userdata]
+ *
+ * Every message of the class keeps a reference to the slot table, so that
+ * msg.foo is a rawget on a Lua table (whose string keys are already hashed)
+ * followed by an index into |slots|, instead of a upb_msgdef_ntof() lookup
+ * and a search of the layout on every access.
  */
 
 #define LUPB_MSGCLASS_FACTORY 1
+#define LUPB_MSGCLASS_SLOTS 2
+
+/* What lupb_msg_index() and lupb_msg_newindex() need to know about a field,
+ * computed once when the class is created. */
+typedef struct {
+  const upb_fielddef *f;
+  upb_fieldtype_t type;
+  int layout_index;   /* Index of the field in layout->fields. */
+  int userval_index;  /* lupb_fieldindex(f). */
+  bool in_userval;
+} lupb_fieldslot;
 
 struct lupb_msgclass {
   const upb_msglayout *layout;
   const upb_msgdef *msgdef;
   const lupb_msgfactory *lfactory;
+  /* Indexed by upb_fielddef_index(), allocated right after the struct. */
+  const lupb_fieldslot *slots;
 };
 
 /* Type-checks for assigning to a message field. */
@@ -288,11 +307,19 @@ static const lupb_msgclass *lupb_msg_getsubmsgclass(lua_State *L, int narg,
                                                     const upb_fielddef *f);
 static const lupb_msgclass *lupb_msg_msgclassfor(lua_State *L, int narg,
                                                  const upb_msgdef *md);
+static int lupb_layoutindex(const upb_msglayout *l, const upb_fielddef *f);
+static bool in_userval(const upb_fielddef *f);
+int lupb_fieldindex(const upb_fielddef *f);
 
 const lupb_msgclass *lupb_msgclass_check(lua_State *L, int narg) {
   return luaL_checkudata(L, narg, LUPB_MSGCLASS);
 }
 
+/* Like lupb_msgclass_check(), but returns NULL instead of raising an error. */
+const lupb_msgclass *lupb_msgclass_test(lua_State *L, int narg) {
+  return luaL_testudata(L, narg, LUPB_MSGCLASS);
+}
+
 const upb_msglayout *lupb_msgclass_getlayout(lua_State *L, int narg) {
   return lupb_msgclass_check(L, narg)->layout;
 }
@@ -351,12 +378,37 @@ static const lupb_msgclass *lupb_msgclass_getsubmsgclass(lua_State *L, int narg,
 static int lupb_msgclass_pushnew(lua_State *L, int factory,
                                  const upb_msgdef *md) {
   const lupb_msgfactory *lfactory = lupb_msgfactory_check(L, factory);
-  lupb_msgclass *lmc = lupb_newuserdata(L, sizeof(*lmc), LUPB_MSGCLASS);
+  int n = upb_msgdef_numfields(md);
+  lupb_msgclass *lmc = lupb_newuserdata(
+      L, sizeof(*lmc) + n * sizeof(lupb_fieldslot), LUPB_MSGCLASS);
+  lupb_fieldslot *slots = (lupb_fieldslot*)(lmc + 1);
+  int lmc_index = lua_gettop(L);
+  upb_msg_field_iter i;
 
   lupb_uservalseti(L, -1, LUPB_MSGCLASS_FACTORY, factory);
   lmc->layout = upb_msgfactory_getlayout(lfactory->factory, md);
   lmc->lfactory = lfactory;
   lmc->msgdef = md;
+  lmc->slots = slots;
+
+  lua_createtable(L, 0, n);
+  for (upb_msg_field_begin(&i, md);
+       !upb_msg_field_done(&i);
+       upb_msg_field_next(&i)) {
+    const upb_fielddef *f = upb_msg_iter_field(&i);
+    lupb_fieldslot *slot = &slots[upb_fielddef_index(f)];
+    slot->f = f;
+    slot->type = upb_fielddef_type(f);
+    slot->layout_index = lupb_layoutindex(lmc->layout, f);
+    slot->userval_index = lupb_fieldindex(f);
+    slot->in_userval = in_userval(f);
+
+    lua_pushstring(L, upb_fielddef_name(f));
+    lua_pushnumber(L, upb_fielddef_index(f));
+    lua_rawset(L, -3);
+  }
+  lupb_uservalseti(L, lmc_index, LUPB_MSGCLASS_SLOTS, lua_gettop(L));
+  lua_pop(L, 1);  /* Slot table. */
 
   return 1;
 }
@@ -585,6 +637,82 @@ static int lupb_array_len(lua_State *L) {
   return 1;
 }
 
+/* Raises a Lua error unless the array holds numbers or bools, which are the
+ * only arrays that toarray()/fromtable() handle. */
+static void lupb_array_checkscalar(lua_State *L, const lupb_array *larray) {
+  if (lupb_istypewrapped(larray->type)) {
+    luaL_error(L, "Array must have a numeric or bool element type, got: %d",
+               (int)larray->type);
+  }
+}
+
+/**
+ * lupb_array_toarray()
+ *
+ * Handles:
+ *   t = upb.toarray(array)
+ *
+ * Returns a new Lua table holding the elements of a numeric or bool array.
+ * This converts the whole array in one call, instead of one __index call per
+ * element.
+ */
+static int lupb_array_toarray(lua_State *L) {
+  lupb_array *larray = lupb_array_check(L, 1);
+  size_t size = upb_array_size(larray->arr);
+  size_t i;
+
+  lupb_array_checkscalar(L, larray);
+  if (size > INT_MAX) {
+    luaL_error(L, "Array too big for a Lua table: %d", (int)size);
+  }
+
+  lua_createtable(L, (int)size, 0);
+  for (i = 0; i < size; i++) {
+    lupb_pushmsgval(L, larray->type, upb_array_get(larray->arr, larray->type,
+                                                     i));
+    lua_rawseti(L, -2, (int)i + 1);
+  }
+
+  return 1;
+}
+
+/**
+ * lupb_array_fromtable()
+ *
+ * Handles:
+ *   upb.fromtable(array, {1, 2, 3})
+ *
+ * Appends t[1] through t[#t] to a numeric or bool array in one call and
+ * returns the array.  Each element is checked like in array[#array + 1] = x,
+ * so the elements before a bad one have already been appended when the error
+ * is raised.
+ */
+static int lupb_array_fromtable(lua_State *L) {
+  lupb_array *larray = lupb_array_check(L, 1);
+  upb_arena *arena = lupb_arena_get(L);
+  size_t size = upb_array_size(larray->arr);
+  int n;
+  int i;
+
+  lupb_array_checkscalar(L, larray);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 2);
+  n = lua_rawlen(L, 2);
+
+  for (i = 1; i <= n; i++) {
+    upb_msgval val;
+    lua_rawgeti(L, 2, i);
+    val = lupb_tomsgval(L, larray->type, 3, NULL);
+    if (!upb_array_set(larray->arr, larray->type, size++, val, arena)) {
+      luaL_error(L, "Out of memory");
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 static const struct luaL_Reg lupb_array_mm[] = {
   {"__index", lupb_array_index},
   {"__len", lupb_array_len},
@@ -836,6 +964,7 @@ static const struct luaL_Reg lupb_map_mm[] = {
  * Our userval contains:
  *
  * - [0] -> our message class
+ * - [-2] -> the slot table of our message class
  * - [lupb_fieldindex(f)] -> [lupb_{string,array,map,msg} userdata]
  *
  * Fields with scalar number/bool types don't go in the userval.
@@ -843,11 +972,32 @@ static const struct luaL_Reg lupb_map_mm[] = {
 
 #define LUPB_MSG_MSGCLASSINDEX 0
 #define LUPB_MSG_ARENA -1
+#define LUPB_MSG_SLOTS -2
 
 int lupb_fieldindex(const upb_fielddef *f) {
   return upb_fielddef_index(f) + 1;  /* 1-based Lua arrays. */
 }
 
+/* Layout fields are sorted by number, which differs from the order of
+ * upb_fielddef_index(). */
+static int lupb_layoutindex(const upb_msglayout *l, const upb_fielddef *f) {
+  uint32_t number = upb_fielddef_number(f);
+  int lo = 0;
+  int hi = l->field_count - 1;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (l->fields[mid].number < number) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  UPB_ASSERT(l->fields[lo].number == number);
+  return lo;
+}
+
 
 typedef struct {
   const lupb_msgclass *lmsgclass;
@@ -902,6 +1052,42 @@ static const upb_fielddef *lupb_msg_checkfield(lua_State *L,
   return f;
 }
 
+/**
+ * lupb_msg_checkslot()
+ *
+ * Returns the slot of the field named by the key at |fieldarg|, or raises a
+ * Lua error if there is no such field.  The message must be at index 1, as it
+ * is for our metamethods.
+ */
+static const lupb_fieldslot *lupb_msg_checkslot(lua_State *L,
+                                                const lupb_msg *lmsg,
+                                                int fieldarg) {
+  const lupb_fieldslot *slot;
+
+  lupb_uservalgeti(L, 1, LUPB_MSG_SLOTS);
+  lua_pushvalue(L, fieldarg);
+  lua_rawget(L, -2);
+
+  if (lua_isnil(L, -1)) {
+    lupb_msg_checkfield(L, lmsg, fieldarg);  /* Raises the error. */
+    UPB_UNREACHABLE();
+  }
+
+  slot = &lmsg->lmsgclass->slots[(int)lua_tonumber(L, -1)];
+  lua_pop(L, 2);  /* Slot index, slot table. */
+  return slot;
+}
+
+/* Sets the message class at |msgclass| and its slot table in the userval of
+ * the new message on top of the stack. */
+static void lupb_msg_setclass(lua_State *L, int msgclass) {
+  int msg = lua_gettop(L);
+  lupb_uservalseti(L, msg, LUPB_MSG_MSGCLASSINDEX, msgclass);
+  lupb_uservalgeti(L, msgclass, LUPB_MSGCLASS_SLOTS);
+  lupb_uservalseti(L, msg, LUPB_MSG_SLOTS, lua_gettop(L));
+  lua_pop(L, 1);  /* Slot table. */
+}
+
 static const lupb_msgclass *lupb_msg_msgclassfor(lua_State *L, int narg,
                                                  const upb_msgdef *md) {
   lupb_uservalgeti(L, narg, LUPB_MSG_MSGCLASSINDEX);
@@ -921,12 +1107,28 @@ int lupb_msg_pushref(lua_State *L, int msgclass, upb_msg *msg) {
   lmsg->lmsgclass = lmsgclass;
   lmsg->msg = msg;
 
-  lupb_uservalseti(L, -1, LUPB_MSG_MSGCLASSINDEX, msgclass);
+  lupb_msg_setclass(L, msgclass);
   lupb_uservalseti(L, -1, LUPB_MSG_ARENA, -2);
 
   return 1;
 }
 
+/**
+ * lupb_msg_keepalive()
+ *
+ * Keeps the value at |val| alive for as long as the message at |msg|, for
+ * example a Lua string that the message was decoded from with
+ * UPB_DECODE_ALIAS.  The value is a key of the userval, so it can't collide
+ * with the integer keys.
+ */
+void lupb_msg_keepalive(lua_State *L, int msg, int val) {
+  lupb_getuservalue(L, msg);
+  lua_pushvalue(L, val);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);  /* Uservalue. */
+}
+
 /* lupb_msg Public API */
 
 /**
@@ -935,14 +1137,14 @@ int lupb_msg_pushref(lua_State *L, int msgclass, upb_msg *msg) {
  * Handles:
  *   new_msg = MessageClass()
  */
-static int lupb_msg_pushnew(lua_State *L, int narg) {
+int lupb_msg_pushnew(lua_State *L, int narg) {
   const lupb_msgclass *lmsgclass = lupb_msgclass_check(L, narg);
   lupb_msg *lmsg = lupb_newuserdata(L, sizeof(lupb_msg), LUPB_MSG);
 
   lmsg->lmsgclass = lmsgclass;
   lmsg->msg = upb_msg_new(lmsgclass->layout, lupb_arena_get(L));
 
-  lupb_uservalseti(L, -1, LUPB_MSG_MSGCLASSINDEX, narg);
+  lupb_msg_setclass(L, narg);
 
   return 1;
 }
@@ -957,12 +1159,13 @@ static int lupb_msg_pushnew(lua_State *L, int narg) {
  */
 static int lupb_msg_index(lua_State *L) {
   lupb_msg *lmsg = lupb_msg_check(L, 1);
-  const upb_fielddef *f = lupb_msg_checkfield(L, lmsg, 2);
+  const lupb_fieldslot *slot = lupb_msg_checkslot(L, lmsg, 2);
+  const upb_fielddef *f = slot->f;
   const upb_msglayout *l = lmsg->lmsgclass->layout;
-  int field_index = upb_fielddef_index(f);
+  int field_index = slot->layout_index;
 
-  if (in_userval(f)) {
-    lupb_uservalgeti(L, 1, lupb_fieldindex(f));
+  if (slot->in_userval) {
+    lupb_uservalgeti(L, 1, slot->userval_index);
 
     if (lua_isnil(L, -1)) {
       /* Check if we need to lazily create wrapper. */
@@ -976,13 +1179,13 @@ static int lupb_msg_index(lua_State *L) {
           upb_msgval val = upb_msg_get(lmsg->msg, field_index, l);
           lua_pop(L, 1);
           lua_pushlstring(L, val.str.data, val.str.size);
-          lupb_uservalseti(L, 1, lupb_fieldindex(f), -1);
+          lupb_uservalseti(L, 1, slot->userval_index, -1);
         }
       }
     }
   } else {
     upb_msgval val = upb_msg_get(lmsg->msg, field_index, l);
-    lupb_pushmsgval(L, upb_fielddef_type(f), val);
+    lupb_pushmsgval(L, slot->type, val);
   }
 
   return 1;
@@ -998,9 +1201,10 @@ static int lupb_msg_index(lua_State *L) {
  */
 static int lupb_msg_newindex(lua_State *L) {
   lupb_msg *lmsg = lupb_msg_check(L, 1);
-  const upb_fielddef *f = lupb_msg_checkfield(L, lmsg, 2);
-  upb_fieldtype_t type = upb_fielddef_type(f);
-  int field_index = upb_fielddef_index(f);
+  const lupb_fieldslot *slot = lupb_msg_checkslot(L, lmsg, 2);
+  const upb_fielddef *f = slot->f;
+  upb_fieldtype_t type = slot->type;
+  int field_index = slot->layout_index;
   upb_msgval msgval;
 
   /* Typecheck and get msgval. */
@@ -1023,8 +1227,8 @@ static int lupb_msg_newindex(lua_State *L) {
 
   upb_msg_set(lmsg->msg, field_index, msgval, lmsg->lmsgclass->layout);
 
-  if (in_userval(f)) {
-    lupb_uservalseti(L, 1, lupb_fieldindex(f), 3);
+  if (slot->in_userval) {
+    lupb_uservalseti(L, 1, slot->userval_index, 3);
   }
 
   return 0;  /* 1 for chained assignments? */
@@ -1043,6 +1247,8 @@ static const struct luaL_Reg lupb_msg_toplevel_m[] = {
   {"Array", lupb_array_new},
   {"Map", lupb_map_new},
   {"MessageFactory", lupb_msgfactory_new},
+  {"fromtable", lupb_array_fromtable},
+  {"toarray", lupb_array_toarray},
   {NULL, NULL}
 };
 
@@ -113,12 +113,15 @@ upb_arena *lupb_arena_check(lua_State *L, int narg);
 int lupb_arena_new(lua_State *L);
 upb_arena *lupb_arena_get(lua_State *L);
 int lupb_msg_pushref(lua_State *L, int msgclass, void *msg);
+int lupb_msg_pushnew(lua_State *L, int msgclass);
+void lupb_msg_keepalive(lua_State *L, int msg, int val);
 const upb_msg *lupb_msg_checkmsg(lua_State *L, int narg,
                                  const lupb_msgclass *lmsgclass);
 upb_msg *lupb_msg_checkmsg2(lua_State *L, int narg,
                             const upb_msglayout **layout);
 
 const lupb_msgclass *lupb_msgclass_check(lua_State *L, int narg);
+const lupb_msgclass *lupb_msgclass_test(lua_State *L, int narg);
 const upb_msglayout *lupb_msgclass_getlayout(lua_State *L, int narg);
 const upb_msgdef *lupb_msgclass_getmsgdef(const lupb_msgclass *lmsgclass);
 upb_msgfactory *lupb_msgclass_getfactory(const lupb_msgclass *lmsgclass);
@@ -3,6 +3,9 @@
 **
 ** Exposes all the types defined in upb/pb/{*}.h
 ** Also defines a few convenience functions on top.
+**
+** decode() and encode() go straight through the table-driven upb_decode_ex()
+** and upb_encode_ex(), with the layouts from the message's MessageFactory.
 */
 
 #include "upb/bindings/lua/upb.h"
@@ -11,31 +14,114 @@
 
 #define LUPB_PBDECODERMETHOD "lupb.pb.decodermethod"
 
+/* Scratch arena for encode(), reset after every call.  Once it has grown to
+ * the size of the messages being encoded, encoding allocates nothing. */
+static char lupb_pb_encarena_key;
+
+static upb_arena *lupb_pb_encarena(lua_State *L) {
+  upb_arena *arena;
+
+  lua_pushlightuserdata(L, &lupb_pb_encarena_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  arena = lupb_arena_check(L, -1);
+  lua_pop(L, 1);
+
+  return arena;
+}
+
+/* Returns whether the options table at |narg| (which may be absent) has a true
+ * value for |name|. */
+static bool lupb_pb_getopt(lua_State *L, int narg, const char *name) {
+  bool ret;
+
+  if (lua_isnoneornil(L, narg)) return false;
+  luaL_checktype(L, narg, LUA_TTABLE);
+  lua_getfield(L, narg, name);
+  ret = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+
+  return ret;
+}
+
+/**
+ * lupb_pb_decode()
+ *
+ * Handles:
+ *   msg = pb.decode(MessageClass, str [, options])
+ *   msg = pb.decode(msg, str [, options])
+ *
+ * Decodes |str| into a new message of the given class, or merges it into an
+ * existing message, and returns the message.  Raises an error if |str| is not
+ * a valid message.  Options:
+ *
+ *   alias = true            strings in the message point into |str| instead
+ *                           of being copied; the message keeps |str| alive.
+ *   discard_unknown = true  unknown fields are dropped.
+ */
 static int lupb_pb_decode(lua_State *L) {
   size_t len;
   const upb_msglayout *layout;
-  upb_msg *msg = lupb_msg_checkmsg2(L, 1, &layout);
-  const char *pb = lua_tolstring(L, 2, &len);
+  upb_msg *msg;
+  const char *pb;
+  int options = 0;
+
+  if (lupb_msgclass_test(L, 1)) {
+    lupb_msg_pushnew(L, 1);
+    lua_replace(L, 1);
+  }
 
-  upb_decode(pb, len, msg, layout, lupb_arena_get(L));
-  /* TODO(haberman): check for error. */
+  msg = lupb_msg_checkmsg2(L, 1, &layout);
+  pb = luaL_checklstring(L, 2, &len);
 
-  return 0;
+  /* Without aliasing, the Lua string can be collected before the message, so
+   * strings must be copied. */
+  if (lupb_pb_getopt(L, 3, "alias")) {
+    options |= UPB_DECODE_ALIAS;
+    lupb_msg_keepalive(L, 1, 2);
+  }
+  if (lupb_pb_getopt(L, 3, "discard_unknown")) {
+    options |= UPB_DECODE_DISCARDUNKNOWN;
+  }
+
+  if (!upb_decode_ex(pb, len, msg, layout, lupb_arena_get(L), options)) {
+    luaL_error(L, "Error decoding protobuf.");
+  }
+
+  lua_settop(L, 1);
+  return 1;
 }
 
+/**
+ * lupb_pb_encode()
+ *
+ * Handles:
+ *   str = pb.encode(msg [, options])
+ *
+ * Options:
+ *
+ *   deterministic = true  map entries are written in key order.
+ */
 static int lupb_pb_encode(lua_State *L) {
   const upb_msglayout *layout;
   const upb_msg *msg = lupb_msg_checkmsg2(L, 1, &layout);
-  upb_arena *arena = upb_arena_new();
+  upb_arena *arena = lupb_pb_encarena(L);
+  int options = 0;
   size_t size;
   char *result;
 
-  result = upb_encode(msg, (const void*)layout, arena, &size);
+  if (lupb_pb_getopt(L, 2, "deterministic")) {
+    options |= UPB_ENCODE_DETERMINISTIC;
+  }
+
+  result = upb_encode_ex(msg, layout, arena, options, &size);
 
-  /* Free resources before we potentially bail on error. */
-  lua_pushlstring(L, result, size);
-  upb_arena_free(arena);
-  /* TODO(haberman): check for error. */
+  /* Reset the arena before we potentially bail on error. */
+  if (result) lua_pushlstring(L, result, size);
+  upb_arena_reset(arena);
+
+  if (!result) {
+    luaL_error(L, "Error encoding protobuf.");
+  }
 
   return 1;
 }
@@ -52,5 +138,9 @@ int luaopen_upb_pb_c(lua_State *L) {
     return 1;
   }
 
+  lua_pushlightuserdata(L, &lupb_pb_encarena_key);
+  lupb_arena_new(L);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
   return 1;
 }
@@ -2,6 +2,11 @@
 #ifndef UPB_STDCPP_H_
 #define UPB_STDCPP_H_
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "upb/encode.h"
 #include "upb/sink.h"
 
 #include "upb/port_def.inc"
@@ -22,10 +27,15 @@ class FillStringHandler {
   // can be prettier callbacks.
   static void* StartString(void *c, const void *hd, size_t size) {
     UPB_UNUSED(hd);
-    UPB_UNUSED(size);
 
     T* str = static_cast<T*>(c);
     str->clear();
+    try {
+      // Grow once up front instead of on the way, if the caller knows.
+      str->reserve(size);
+    } catch (const std::exception&) {
+      // Only the hint failed; appending can still work.
+    }
     return c;
   }
 
@@ -62,6 +72,132 @@ class StringSink {
   BytesSink input_;
 };
 
+// Encodes |msg| into |out|, replacing its contents, and returns false on
+// allocation failure.  The encoder's size pass gives the exact size, so |out|
+// grows at most once, and not at all when it is reused for messages that are
+// no bigger than the ones before.
+inline bool EncodeToString(const void* msg, const upb_msglayout* l,
+                           std::string* out) {
+  size_t size;
+  try {
+    out->resize(out->capacity());
+    if (!upb_encode_into(msg, l, &(*out)[0], out->size(), &size)) {
+      if (size == 0) return false;  // Allocation failure.
+      out->resize(size);
+      if (!upb_encode_into(msg, l, &(*out)[0], out->size(), &size)) {
+        return false;
+      }
+    }
+    out->resize(size);
+    return true;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+// A sink that writes into a chain of fixed-size chunks instead of one string,
+// so the output never moves as it grows and can be handed to writev() as it
+// is.  Chunks are pooled: each string written to the sink starts over in the
+// chunks of the previous one, so a sink that is reused for similar output
+// stops allocating.
+//
+//   upb::BufferSink sink;
+//   (write to sink.input())
+//   for (size_t i = 0; i < sink.chunk_count(); i++) {
+//     upb_strview chunk = sink.chunk(i);
+//     (add chunk.data, chunk.size to the iovec)
+//   }
+class BufferSink {
+ public:
+  explicit BufferSink(size_t chunk_size = 4096)
+      : chunk_size_(chunk_size), used_(0), last_size_(0) {
+    upb_byteshandler_init(&handler_);
+    upb_byteshandler_setstartstr(&handler_, &BufferSink::StartString, NULL);
+    upb_byteshandler_setstring(&handler_, &BufferSink::StringBuf, NULL);
+    input_.Reset(&handler_, this);
+  }
+
+  BytesSink input() { return input_; }
+
+  // The chunks holding the output, in order.  Only the last one may be
+  // partly filled.
+  size_t chunk_count() const { return used_; }
+  upb_strview chunk(size_t i) const {
+    return upb_strview_make(chunks_[i].get(),
+                            i + 1 == used_ ? last_size_ : chunk_size_);
+  }
+
+  // Total size of the output.
+  size_t size() const {
+    return used_ == 0 ? 0 : (used_ - 1) * chunk_size_ + last_size_;
+  }
+
+  // Discards the output but keeps the chunks for the next one.
+  void Clear() {
+    used_ = 0;
+    last_size_ = 0;
+  }
+
+ private:
+  BufferSink(const BufferSink&) = delete;
+  BufferSink& operator=(const BufferSink&) = delete;
+
+  // Makes sure that |n| chunks are allocated.
+  void Reserve(size_t n) {
+    while (chunks_.size() < n) {
+      chunks_.emplace_back(new char[chunk_size_]);
+    }
+  }
+
+  static void* StartString(void* c, const void* hd, size_t size) {
+    UPB_UNUSED(hd);
+
+    BufferSink* sink = static_cast<BufferSink*>(c);
+    sink->Clear();
+    try {
+      sink->Reserve((size + sink->chunk_size_ - 1) / sink->chunk_size_);
+    } catch (const std::exception&) {
+      // Only the hint failed; appending can still work.
+    }
+    return c;
+  }
+
+  static size_t StringBuf(void* c, const void* hd, const char* buf, size_t n,
+                          const upb_bufhandle* h) {
+    UPB_UNUSED(hd);
+    UPB_UNUSED(h);
+
+    BufferSink* sink = static_cast<BufferSink*>(c);
+    size_t left = n;
+    try {
+      while (left > 0) {
+        size_t copy;
+        if (sink->used_ == 0 || sink->last_size_ == sink->chunk_size_) {
+          sink->Reserve(sink->used_ + 1);
+          sink->used_++;
+          sink->last_size_ = 0;
+        }
+        copy = UPB_MIN(left, sink->chunk_size_ - sink->last_size_);
+        memcpy(sink->chunks_[sink->used_ - 1].get() + sink->last_size_, buf,
+               copy);
+        sink->last_size_ += copy;
+        buf += copy;
+        left -= copy;
+      }
+      return n;
+    } catch (const std::exception&) {
+      return n - left;
+    }
+  }
+
+  const size_t chunk_size_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t used_;       // Chunks holding output.
+  size_t last_size_;  // Bytes of output in the last of those.
+  upb_byteshandler handler_;
+  BytesSink input_;
+};
+
 }  // namespace upb
 
 #include "upb/port_undef.inc"
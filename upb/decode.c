@@ -1,7 +1,9 @@
 
+#include <stdlib.h>
 #include <string.h>
 #include "upb/upb.h"
-#include "upb/decode.h"
+#include "upb/decode.int.h"
+#include "upb/stats.h"
 
 #include "upb/port_def.inc"
 
@@ -28,52 +30,23 @@ const uint8_t upb_desctype_to_fieldtype[] = {
   UPB_TYPE_INT64,           /* SINT64 */
 };
 
-/* Data pertaining to the parse. */
-typedef struct {
-  const char *ptr;           /* Current parsing position. */
-  const char *field_start;   /* Start of this field. */
-  const char *limit;         /* End of delimited region or end of buffer. */
-  upb_arena *arena;
-  int depth;
-  uint32_t end_group;  /* Set to field number of END_GROUP tag, if any. */
-} upb_decstate;
-
 /* Data passed by value to each parsing function. */
 typedef struct {
   char *msg;
   const upb_msglayout *layout;
+  const upb_decmask *mask;  /* Fields to decode, or NULL for all of them. */
   upb_decstate *state;
+  int last_field;  /* Index of the last field we matched, or -1. */
 } upb_decframe;
 
 #define CHK(x) if (!(x)) { return 0; }
 
 static bool upb_skip_unknowngroup(upb_decstate *d, int field_number);
-static bool upb_decode_message(upb_decstate *d, char *msg,
-                               const upb_msglayout *l);
-
-static bool upb_decode_varint(const char **ptr, const char *limit,
-                              uint64_t *val) {
-  uint8_t byte;
-  int bitpos = 0;
-  const char *p = *ptr;
-  *val = 0;
-
-  do {
-    CHK(bitpos < 70 && p < limit);
-    byte = *p;
-    *val |= (uint64_t)(byte & 0x7F) << bitpos;
-    p++;
-    bitpos += 7;
-  } while (byte & 0x80);
-
-  *ptr = p;
-  return true;
-}
 
 static bool upb_decode_varint32(const char **ptr, const char *limit,
                                 uint32_t *val) {
   uint64_t u64;
-  CHK(upb_decode_varint(ptr, limit, &u64) && u64 <= UINT32_MAX);
+  CHK(_upb_decode_varint(ptr, limit, &u64) && u64 <= UINT32_MAX);
   *val = (uint32_t)u64;
   return true;
 }
@@ -119,9 +92,19 @@ static void upb_set32(void *msg, size_t ofs, uint32_t val) {
 }
 
 static bool upb_append_unknown(upb_decstate *d, upb_decframe *frame) {
-  upb_msg_addunknown(frame->msg, d->field_start, d->ptr - d->field_start,
-                     d->arena);
-  return true;
+  size_t len = d->ptr - d->field_start;
+  d->stats.unknown_fields++;
+  d->stats.unknown_bytes += len;
+  _UPB_STATS_ADD(decode_unknown_fields, 1);
+  _UPB_STATS_ADD(decode_unknown_bytes, len);
+  if (d->options & (UPB_DECODE_DISCARDUNKNOWN | _UPB_DECODE_MAPENTRY)) {
+    return true;
+  } else if (d->options & UPB_DECODE_ALIAS) {
+    return _upb_msg_addunknown_alias(frame->msg, d->field_start, len,
+                                     d->arena);
+  } else {
+    return upb_msg_addunknown(frame->msg, d->field_start, len, d->arena);
+  }
 }
 
 
@@ -130,7 +113,7 @@ static bool upb_skip_unknownfielddata(upb_decstate *d, uint32_t tag,
   switch (tag & 7) {
     case UPB_WIRE_TYPE_VARINT: {
       uint64_t val;
-      return upb_decode_varint(&d->ptr, d->limit, &val);
+      return _upb_decode_varint(&d->ptr, d->limit, &val);
     }
     case UPB_WIRE_TYPE_32BIT: {
       uint32_t val;
@@ -155,15 +138,61 @@ static bool upb_skip_unknownfielddata(upb_decstate *d, uint32_t tag,
 }
 
 static bool upb_skip_unknowngroup(upb_decstate *d, int field_number) {
-  while (d->ptr < d->limit && d->end_group == 0) {
+  while (d->ptr < d->limit) {
     uint32_t tag = 0;
     CHK(upb_decode_varint32(&d->ptr, d->limit, &tag));
+    if ((tag & 7) == UPB_WIRE_TYPE_END_GROUP) {
+      return (tag >> 3) == (uint32_t)field_number;
+    }
     CHK(upb_skip_unknownfielddata(d, tag, field_number));
   }
 
-  CHK(d->end_group == field_number);
-  d->end_group = 0;
-  return true;
+  return false;  /* Group was not terminated. */
+}
+
+/* Repeated fields usually have all their entries in a row, so a new array
+ * can be sized for all of them at once. */
+size_t _upb_decode_countrun(const char *ptr, const char *limit) {
+  const char *tag = ptr;
+  size_t taglen;
+  size_t count = 0;
+  uint32_t tagval;
+
+  if (!upb_decode_varint32(&ptr, limit, &tagval)) return 1;
+  taglen = ptr - tag;
+
+  while (count < UPB_ARRAY_RUNMAX) {
+    count++;
+    switch (tagval & 7) {
+      case UPB_WIRE_TYPE_VARINT: {
+        uint64_t val;
+        if (!_upb_decode_varint(&ptr, limit, &val)) return count;
+        break;
+      }
+      case UPB_WIRE_TYPE_32BIT:
+        if (limit - ptr < 4) return count;
+        ptr += 4;
+        break;
+      case UPB_WIRE_TYPE_64BIT:
+        if (limit - ptr < 8) return count;
+        ptr += 8;
+        break;
+      case UPB_WIRE_TYPE_DELIMITED: {
+        int len;
+        if (!upb_decode_string(&ptr, limit, &len)) return count;
+        ptr += len;
+        break;
+      }
+      default:
+        return count;  /* Groups aren't worth skipping over. */
+    }
+    if ((size_t)(limit - ptr) < taglen || memcmp(ptr, tag, taglen) != 0) {
+      break;
+    }
+    ptr += taglen;
+  }
+
+  return count;
 }
 
 static bool upb_array_grow(upb_array *arr, size_t elements, size_t elem_size,
@@ -179,7 +208,7 @@ static bool upb_array_grow(upb_array *arr, size_t elements, size_t elem_size,
     new_size *= 2;
   }
 
-  old_bytes = arr->len * elem_size;
+  old_bytes = arr->size * elem_size;
   new_bytes = new_size * elem_size;
   new_data = upb_realloc(alloc, arr->data, old_bytes, new_bytes);
   CHK(new_data);
@@ -214,12 +243,15 @@ static upb_array *upb_getarr(upb_decframe *frame,
   return *(upb_array**)&frame->msg[field->offset];
 }
 
-static upb_array *upb_getorcreatearr(upb_decframe *frame,
-                                     const upb_msglayout_field *field) {
+/* Returns the array of a packed field, creating it with room for |elements|
+ * elements if it doesn't exist yet. */
+static upb_array *upb_getorcreatepacked(upb_decframe *frame,
+                                        const upb_msglayout_field *field,
+                                        size_t elements, size_t elem_size) {
   upb_array *arr = upb_getarr(frame, field);
 
   if (!arr) {
-    arr = upb_array_new(frame->state->arena);
+    arr = _upb_array_new(frame->state->arena, elements, elem_size);
     CHK(arr);
     *(upb_array**)&frame->msg[field->offset] = arr;
   }
@@ -227,6 +259,22 @@ static upb_array *upb_getorcreatearr(upb_decframe *frame,
   return arr;
 }
 
+/* Returns the array of a field whose entries each hold one element, creating
+ * it with room for the entries that follow the current one in a row. */
+static upb_array *upb_getorcreatearr(upb_decframe *frame,
+                                     const upb_msglayout_field *field,
+                                     size_t elem_size) {
+  upb_array *arr = upb_getarr(frame, field);
+
+  if (!arr) {
+    upb_decstate *d = frame->state;
+    size_t entries = _upb_decode_countrun(d->field_start, d->limit);
+    arr = upb_getorcreatepacked(frame, field, entries, elem_size);
+  }
+
+  return arr;
+}
+
 static upb_msg *upb_getorcreatemsg(upb_decframe *frame,
                                    const upb_msglayout_field *field,
                                    const upb_msglayout **subm) {
@@ -235,7 +283,7 @@ static upb_msg *upb_getorcreatemsg(upb_decframe *frame,
 
   UPB_ASSERT(field->label != UPB_LABEL_REPEATED);
 
-  if (!*submsg) {
+  if (!_upb_msg_hasmem(frame->msg, field) || !*submsg) {
     *submsg = upb_msg_new(*subm, frame->state->arena);
     CHK(*submsg);
   }
@@ -247,8 +295,9 @@ static upb_msg *upb_addmsg(upb_decframe *frame,
                            const upb_msglayout_field *field,
                            const upb_msglayout **subm) {
   upb_msg *submsg;
-  upb_array *arr = upb_getorcreatearr(frame, field);
+  upb_array *arr = upb_getorcreatearr(frame, field, sizeof(submsg));
 
+  CHK(arr);
   *subm = frame->layout->submsgs[field->submsg_index];
   submsg = upb_msg_new(*subm, frame->state->arena);
   CHK(submsg);
@@ -277,7 +326,7 @@ static bool upb_decode_addval(upb_decframe *frame,
   upb_array *arr;
 
   if (field->label == UPB_LABEL_REPEATED) {
-    arr = upb_getorcreatearr(frame, field);
+    arr = upb_getorcreatearr(frame, field, size);
     CHK(arr);
     field_mem = upb_array_reserve(arr, 1, size, frame->state->arena);
     CHK(field_mem);
@@ -300,23 +349,34 @@ static void upb_decode_setpresent(upb_decframe *frame,
   }
 }
 
-static bool upb_decode_msgfield(upb_decstate *d, upb_msg *msg,
-                                const upb_msglayout *layout, int limit) {
+static bool upb_decode_delimited(upb_decstate *d, upb_msg *msg,
+                                 const upb_msglayout *layout, int limit) {
   const char* saved_limit = d->limit;
+  const char* saved_field_start = d->field_start;
   d->limit = d->ptr + limit;
   CHK(--d->depth >= 0);
-  upb_decode_message(d, msg, layout);
+  CHK(_upb_decode_message(d, msg, layout));
   d->depth++;
   d->limit = saved_limit;
+  d->field_start = saved_field_start;
   CHK(d->end_group == 0);
   return true;
 }
 
+bool _upb_decode_msgfield(upb_decstate *d, upb_msg *msg,
+                          const upb_msglayout *layout, int limit) {
+  int options = d->options;
+  d->options &= ~_UPB_DECODE_MAPENTRY;
+  CHK(upb_decode_delimited(d, msg, layout, limit));
+  d->options = options;
+  return true;
+}
+
 static bool upb_decode_groupfield(upb_decstate *d, upb_msg *msg,
                                   const upb_msglayout *layout,
                                   int field_number) {
   CHK(--d->depth >= 0);
-  upb_decode_message(d, msg, layout);
+  CHK(_upb_decode_message(d, msg, layout));
   d->depth++;
   CHK(d->end_group == field_number);
   d->end_group = 0;
@@ -326,7 +386,7 @@ static bool upb_decode_groupfield(upb_decstate *d, upb_msg *msg,
 static bool upb_decode_varintfield(upb_decstate *d, upb_decframe *frame,
                                    const upb_msglayout_field *field) {
   uint64_t val;
-  CHK(upb_decode_varint(&d->ptr, d->limit, &val));
+  CHK(_upb_decode_varint(&d->ptr, d->limit, &val));
 
   switch (field->descriptortype) {
     case UPB_DESCRIPTOR_TYPE_INT64:
@@ -401,44 +461,50 @@ static bool upb_decode_32bitfield(upb_decstate *d, upb_decframe *frame,
   return true;
 }
 
-static bool upb_decode_fixedpacked(upb_decstate *d, upb_array *arr,
+static bool upb_decode_fixedpacked(upb_decstate *d, upb_decframe *frame,
+                                   const upb_msglayout_field *field,
                                    uint32_t len, int elem_size) {
   size_t elements = len / elem_size;
+  upb_array *arr;
 
   CHK((size_t)(elements * elem_size) == len);
+  if (elements == 0) return true;
+  arr = upb_getorcreatepacked(frame, field, elements, elem_size);
+  CHK(arr);
   CHK(upb_array_add(arr, elements, elem_size, d->ptr, d->arena));
   d->ptr += len;
 
   return true;
 }
 
-static upb_strview upb_decode_strfield(upb_decstate *d, uint32_t len) {
-  upb_strview ret;
-  ret.data = d->ptr;
-  ret.size = len;
-  d->ptr += len;
-  return ret;
-}
-
 static bool upb_decode_toarray(upb_decstate *d, upb_decframe *frame,
                                const upb_msglayout_field *field, int len) {
-  upb_array *arr = upb_getorcreatearr(frame, field);
-  CHK(arr);
+  upb_array *arr;
 
 #define VARINT_CASE(ctype, decode) \
   VARINT_CASE_EX(ctype, decode, decode)
 
+/* We count the elements first, so the array grows at most once and the
+ * values are decoded straight into it. */
 #define VARINT_CASE_EX(ctype, decode, dtype)                           \
   {                                                                    \
     const char *ptr = d->ptr;                                          \
     const char *limit = ptr + len;                                     \
+    size_t count = _upb_vcount(ptr, limit);                            \
+    ctype *out;                                                        \
+    if (count == 0) {                                                  \
+      return len == 0;                                                 \
+    }                                                                  \
+    arr = upb_getorcreatepacked(frame, field, count, sizeof(ctype));   \
+    CHK(arr);                                                          \
+    out = upb_array_reserve(arr, count, sizeof(ctype), d->arena);      \
+    CHK(out);                                                          \
     while (ptr < limit) {                                              \
       uint64_t val;                                                    \
-      ctype decoded;                                                   \
-      CHK(upb_decode_varint(&ptr, limit, &val));                       \
-      decoded = (decode)((dtype)val);                                  \
-      CHK(upb_array_add(arr, 1, sizeof(decoded), &decoded, d->arena)); \
+      CHK(_upb_decode_varint(&ptr, limit, &val));                       \
+      *out++ = (decode)((dtype)val);                                   \
     }                                                                  \
+    arr->len += count;                                                 \
     d->ptr = ptr;                                                      \
     return true;                                                       \
   }
@@ -446,17 +512,20 @@ static bool upb_decode_toarray(upb_decstate *d, upb_decframe *frame,
   switch (field->descriptortype) {
     case UPB_DESCRIPTOR_TYPE_STRING:
     case UPB_DESCRIPTOR_TYPE_BYTES: {
-      upb_strview str = upb_decode_strfield(d, len);
+      upb_strview str;
+      arr = upb_getorcreatearr(frame, field, sizeof(str));
+      CHK(arr);
+      CHK(_upb_decode_str(d, len, &str));
       return upb_array_add(arr, 1, sizeof(str), &str, d->arena);
     }
     case UPB_DESCRIPTOR_TYPE_FLOAT:
     case UPB_DESCRIPTOR_TYPE_FIXED32:
     case UPB_DESCRIPTOR_TYPE_SFIXED32:
-      return upb_decode_fixedpacked(d, arr, len, sizeof(int32_t));
+      return upb_decode_fixedpacked(d, frame, field, len, sizeof(int32_t));
     case UPB_DESCRIPTOR_TYPE_DOUBLE:
     case UPB_DESCRIPTOR_TYPE_FIXED64:
     case UPB_DESCRIPTOR_TYPE_SFIXED64:
-      return upb_decode_fixedpacked(d, arr, len, sizeof(int64_t));
+      return upb_decode_fixedpacked(d, frame, field, len, sizeof(int64_t));
     case UPB_DESCRIPTOR_TYPE_INT32:
     case UPB_DESCRIPTOR_TYPE_UINT32:
     case UPB_DESCRIPTOR_TYPE_ENUM:
@@ -474,7 +543,7 @@ static bool upb_decode_toarray(upb_decstate *d, upb_decframe *frame,
       const upb_msglayout *subm;
       upb_msg *submsg = upb_addmsg(frame, field, &subm);
       CHK(submsg);
-      return upb_decode_msgfield(d, submsg, subm, len);
+      return _upb_decode_msgfield(d, submsg, subm, len);
     }
     case UPB_DESCRIPTOR_TYPE_GROUP:
       return upb_append_unknown(d, frame);
@@ -483,6 +552,86 @@ static bool upb_decode_toarray(upb_decstate *d, upb_decframe *frame,
   UPB_UNREACHABLE();
 }
 
+/* Keeps a lazy field as bytes.  A second occurrence is merged into the first,
+ * which for unparsed data means appending it. */
+static bool upb_decode_lazyfield(upb_decstate *d, upb_decframe *frame,
+                                 const upb_msglayout_field *field, int len) {
+  void **slot = (void**)(frame->msg + field->offset);
+  const upb_msglayout *subm = frame->layout->submsgs[field->submsg_index];
+  _upb_lazymsg *lazy;
+  upb_strview data;
+
+  if (!_upb_msg_hasmem(frame->msg, field)) *slot = NULL;
+
+  if (*slot && !_upb_islazy(*slot)) {
+    /* Already parsed. */
+    return _upb_decode_msgfield(d, *slot, subm, len);
+  }
+
+  CHK(_upb_decode_str(d, len, &data));
+
+  if (*slot) {
+    upb_strview prev;
+    char *buf;
+    lazy = _upb_getlazy(*slot);
+    prev = lazy->data;
+    buf = upb_arena_malloc(d->arena, prev.size + data.size);
+    CHK(buf);
+    memcpy(buf, prev.data, prev.size);
+    memcpy(buf + prev.size, data.data, data.size);
+    lazy->data.data = buf;
+    lazy->data.size = prev.size + data.size;
+    return true;
+  }
+
+  lazy = upb_arena_malloc(d->arena, sizeof(*lazy));
+  CHK(lazy);
+  lazy->data = data;
+  lazy->arena = d->arena;
+  lazy->options = d->options;
+  *slot = (void*)((uintptr_t)lazy | 1);
+  return true;
+}
+
+/* Decodes a map entry into a scratch entry message on the stack, then copies
+ * the key and value into the map. */
+static bool upb_decode_mapentry(upb_decstate *d, upb_decframe *frame,
+                                const upb_msglayout_field *field, int len) {
+  const upb_msglayout *entry = frame->layout->submsgs[field->submsg_index];
+  const upb_msglayout_field *val_field = &entry->fields[1];
+  upb_map *map = _upb_msg_getmap(frame->msg, field->offset, entry, true,
+                                 d->arena);
+  int options = d->options;
+  union {
+    void *align;
+    char data[64];
+  } ent;
+  char *val;
+
+  /* Layouts built by hand could have a bigger entry than any upbc or
+   * upb_msgfactory makes. */
+  CHK(entry->size <= sizeof(ent));
+  CHK(map);
+  memset(&ent, 0, sizeof(ent));
+
+  /* The scratch entry has no room for unknown fields. */
+  d->options |= _UPB_DECODE_MAPENTRY;
+  CHK(upb_decode_delimited(d, ent.data, entry, len));
+  d->options = options;
+
+  val = ent.data + val_field->offset;
+  if (val_field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE &&
+      *(void**)val == NULL) {
+    /* A missing message value is an empty message. */
+    void *submsg = upb_msg_new(entry->submsgs[val_field->submsg_index],
+                               d->arena);
+    CHK(submsg);
+    memcpy(val, &submsg, sizeof(submsg));
+  }
+
+  return _upb_map_set(map, ent.data + entry->fields[0].offset, val);
+}
+
 static bool upb_decode_delimitedfield(upb_decstate *d, upb_decframe *frame,
                                       const upb_msglayout_field *field) {
   int len;
@@ -491,19 +640,27 @@ static bool upb_decode_delimitedfield(upb_decstate *d, upb_decframe *frame,
 
   if (field->label == UPB_LABEL_REPEATED) {
     return upb_decode_toarray(d, frame, field, len);
+  } else if (field->label == _UPB_LABEL_MAP) {
+    return upb_decode_mapentry(d, frame, field, len);
   } else {
     switch (field->descriptortype) {
       case UPB_DESCRIPTOR_TYPE_STRING:
       case UPB_DESCRIPTOR_TYPE_BYTES: {
-        upb_strview str = upb_decode_strfield(d, len);
+        upb_strview str;
+        CHK(_upb_decode_str(d, len, &str));
         CHK(upb_decode_addval(frame, field, &str, sizeof(str)));
         break;
       }
       case UPB_DESCRIPTOR_TYPE_MESSAGE: {
         const upb_msglayout *subm;
-        upb_msg *submsg = upb_getorcreatemsg(frame, field, &subm);
+        upb_msg *submsg;
+        if (field->label == _UPB_LABEL_LAZY) {
+          CHK(upb_decode_lazyfield(d, frame, field, len));
+          break;
+        }
+        submsg = upb_getorcreatemsg(frame, field, &subm);
         CHK(submsg);
-        CHK(upb_decode_msgfield(d, submsg, subm, len));
+        CHK(_upb_decode_msgfield(d, submsg, subm, len));
         break;
       }
       default:
@@ -516,57 +673,181 @@ static bool upb_decode_delimitedfield(upb_decstate *d, upb_decframe *frame,
   }
 }
 
-static const upb_msglayout_field *upb_find_field(const upb_msglayout *l,
+static const upb_msglayout_field *upb_find_field(upb_decframe *frame,
                                                  uint32_t field_number) {
-  /* Lots of optimization opportunities here. */
-  int i;
-  for (i = 0; i < l->field_count; i++) {
-    if (l->fields[i].number == field_number) {
-      return &l->fields[i];
+  /* Fields are almost always serialized in field number order, so we first
+   * try the field after the one we matched last.  Otherwise field numbers are
+   * usually small and dense, so most lookups are a single index.  The rest
+   * binary search the (sorted) remainder of the table. */
+  const upb_msglayout *l = frame->layout;
+  size_t idx = (size_t)field_number - 1;  /* 0 wraps to SIZE_MAX. */
+  size_t next = (size_t)(frame->last_field + 1);
+  int lo = l->dense_below;
+  int hi = l->field_count - 1;
+
+  if (UPB_LIKELY(next < l->field_count &&
+                 l->fields[next].number == field_number)) {
+    frame->last_field = next;
+    _UPB_STATS_ADD(decode_next_fields, 1);
+    return &l->fields[next];
+  }
+
+  if (idx < l->dense_below) {
+    frame->last_field = idx;
+    _UPB_STATS_ADD(decode_dense_fields, 1);
+    return &l->fields[idx];
+  }
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    uint32_t num = l->fields[mid].number;
+    if (num < field_number) {
+      lo = mid + 1;
+    } else if (num > field_number) {
+      hi = mid - 1;
+    } else {
+      frame->last_field = mid;
+      _UPB_STATS_ADD(decode_search_fields, 1);
+      return &l->fields[mid];
     }
   }
 
   return NULL;  /* Unknown field. */
 }
 
+/* Decodes the value of known field |field|, whose tag |tag| has been read. */
+static bool upb_decode_knownfield(upb_decstate *d, upb_decframe *frame,
+                                  const upb_msglayout_field *field,
+                                  uint32_t tag) {
+  int field_number = tag >> 3;
+
+  switch (tag & 7) {
+    case UPB_WIRE_TYPE_VARINT:
+      return upb_decode_varintfield(d, frame, field);
+    case UPB_WIRE_TYPE_32BIT:
+      return upb_decode_32bitfield(d, frame, field);
+    case UPB_WIRE_TYPE_64BIT:
+      return upb_decode_64bitfield(d, frame, field);
+    case UPB_WIRE_TYPE_DELIMITED:
+      return upb_decode_delimitedfield(d, frame, field);
+    case UPB_WIRE_TYPE_START_GROUP: {
+      const upb_msglayout *layout;
+      upb_msg *group;
+
+      if (field->label == _UPB_LABEL_MAP ||
+          (field->descriptortype != UPB_DESCRIPTOR_TYPE_GROUP &&
+           field->descriptortype != UPB_DESCRIPTOR_TYPE_MESSAGE)) {
+        /* Not a submessage, so there is no layout to decode it with. */
+        CHK(upb_skip_unknowngroup(d, field_number));
+        return upb_append_unknown(d, frame);
+      } else if (field->label == UPB_LABEL_REPEATED) {
+        group = upb_addmsg(frame, field, &layout);
+      } else {
+        group = upb_getorcreatemsg(frame, field, &layout);
+      }
+
+      CHK(group);
+      CHK(upb_decode_groupfield(d, group, layout, field_number));
+      /* upb_addmsg() has already counted a repeated group. */
+      if (field->label != UPB_LABEL_REPEATED) {
+        upb_decode_setpresent(frame, field);
+      }
+      return true;
+    }
+    default:
+      CHK(false);
+  }
+}
+
+/* The wire type of each descriptor type. */
+static const int8_t upb_desctype_to_wiretype[] = {
+  -1,                         /* ENDGROUP */
+  UPB_WIRE_TYPE_64BIT,        /* DOUBLE */
+  UPB_WIRE_TYPE_32BIT,        /* FLOAT */
+  UPB_WIRE_TYPE_VARINT,       /* INT64 */
+  UPB_WIRE_TYPE_VARINT,       /* UINT64 */
+  UPB_WIRE_TYPE_VARINT,       /* INT32 */
+  UPB_WIRE_TYPE_64BIT,        /* FIXED64 */
+  UPB_WIRE_TYPE_32BIT,        /* FIXED32 */
+  UPB_WIRE_TYPE_VARINT,       /* BOOL */
+  UPB_WIRE_TYPE_DELIMITED,    /* STRING */
+  UPB_WIRE_TYPE_START_GROUP,  /* GROUP */
+  UPB_WIRE_TYPE_DELIMITED,    /* MESSAGE */
+  UPB_WIRE_TYPE_DELIMITED,    /* BYTES */
+  UPB_WIRE_TYPE_VARINT,       /* UINT32 */
+  UPB_WIRE_TYPE_VARINT,       /* ENUM */
+  UPB_WIRE_TYPE_32BIT,        /* SFIXED32 */
+  UPB_WIRE_TYPE_64BIT,        /* SFIXED64 */
+  UPB_WIRE_TYPE_VARINT,       /* SINT32 */
+  UPB_WIRE_TYPE_VARINT,       /* SINT64 */
+};
+
+/* Decodes extension |ext| of the message in |frame| into the message's
+ * extensions.  A value of the wrong wire type is an unknown field of the
+ * message, as it would be for a regular field. */
+static bool upb_decode_extfield(upb_decstate *d, upb_decframe *frame,
+                                const upb_msglayout_ext *ext, uint32_t tag) {
+  const upb_msglayout_field *field = &ext->field;
+  int wire_type = upb_desctype_to_wiretype[field->descriptortype];
+  upb_msglayout layout;
+  upb_decframe ext_frame;
+  upb_msg_ext *val;
+
+  if ((int)(tag & 7) != wire_type &&
+      !(field->label == UPB_LABEL_REPEATED &&
+        (tag & 7) == UPB_WIRE_TYPE_DELIMITED &&
+        wire_type != UPB_WIRE_TYPE_START_GROUP)) {
+    CHK(upb_skip_unknownfielddata(d, tag, -1));
+    return upb_append_unknown(d, frame);
+  }
+
+  val = _upb_msg_getorcreateext(frame->msg, ext, d->arena);
+  CHK(val);
+  _upb_msglayout_forext(&layout, ext);
+  ext_frame.msg = (char*)&val->data;
+  ext_frame.layout = &layout;
+  ext_frame.mask = NULL;
+  ext_frame.state = d;
+  ext_frame.last_field = -1;
+  d->mask = NULL;
+  return upb_decode_knownfield(d, &ext_frame, field, tag);
+}
+
 static bool upb_decode_field(upb_decstate *d, upb_decframe *frame) {
   uint32_t tag;
   const upb_msglayout_field *field;
+  const upb_msglayout_ext *ext;
   int field_number;
 
   d->field_start = d->ptr;
   CHK(upb_decode_varint32(&d->ptr, d->limit, &tag));
   field_number = tag >> 3;
-  field = upb_find_field(frame->layout, field_number);
 
-  if (field) {
-    switch (tag & 7) {
-      case UPB_WIRE_TYPE_VARINT:
-        return upb_decode_varintfield(d, frame, field);
-      case UPB_WIRE_TYPE_32BIT:
-        return upb_decode_32bitfield(d, frame, field);
-      case UPB_WIRE_TYPE_64BIT:
-        return upb_decode_64bitfield(d, frame, field);
-      case UPB_WIRE_TYPE_DELIMITED:
-        return upb_decode_delimitedfield(d, frame, field);
-      case UPB_WIRE_TYPE_START_GROUP: {
-        const upb_msglayout *layout;
-        upb_msg *group;
-
-        if (field->label == UPB_LABEL_REPEATED) {
-          group = upb_addmsg(frame, field, &layout);
-        } else {
-          group = upb_getorcreatemsg(frame, field, &layout);
-        }
+  if ((tag & 7) == UPB_WIRE_TYPE_END_GROUP) {
+    /* Terminates the group we are in, which is a field of our parent. */
+    CHK(field_number != 0);
+    d->end_group = field_number;
+    return true;
+  }
 
-        return upb_decode_groupfield(d, group, layout, field_number);
-      }
-      case UPB_WIRE_TYPE_END_GROUP:
-        d->end_group = field_number;
-        return true;
-      default:
-        CHK(false);
+  field = upb_find_field(frame, field_number);
+
+  if (field && frame->mask) {
+    const upb_decmask *mask = frame->mask;
+    int idx = frame->last_field;
+    if ((mask->wanted[idx / 32] & (1U << (idx % 32))) == 0) {
+      return upb_skip_unknownfielddata(d, tag, -1);
     }
+    /* For the submessage, if this field is one. */
+    d->mask = mask->submasks ? mask->submasks[idx] : NULL;
+  }
+
+  if (field) {
+    return upb_decode_knownfield(d, frame, field, tag);
+  } else if (d->extreg && frame->layout->extendable && !frame->mask &&
+             (ext = _upb_extreg_get(d->extreg, frame->layout,
+                                    field_number))) {
+    return upb_decode_extfield(d, frame, ext, tag);
   } else {
     CHK(field_number != 0);
     CHK(upb_skip_unknownfielddata(d, tag, -1));
@@ -575,14 +856,54 @@ static bool upb_decode_field(upb_decstate *d, upb_decframe *frame) {
   }
 }
 
-static bool upb_decode_message(upb_decstate *d, char *msg, const upb_msglayout *l) {
+bool _upb_decode_field(upb_decstate *d, char *msg, const upb_msglayout *l) {
   upb_decframe frame;
   frame.msg = msg;
   frame.layout = l;
+  frame.mask = d->mask;
   frame.state = d;
+  frame.last_field = -1;
+  return upb_decode_field(d, &frame);
+}
 
-  while (d->ptr < d->limit) {
+/* Counts the field that was just decoded against d->limits, and sets
+ * d->status and returns false if that goes over one of them. */
+static bool upb_decode_checklimits(upb_decstate *d) {
+  const upb_declimits *limits = d->limits;
+
+  if (limits->max_elements && ++d->elements > limits->max_elements) {
+    d->status = UPB_DECSTATUS_ELEMENTLIMIT;
+  } else if (limits->max_unknown_bytes &&
+             d->stats.unknown_bytes > limits->max_unknown_bytes) {
+    d->status = UPB_DECSTATUS_UNKNOWNLIMIT;
+  } else if (limits->max_arena_bytes &&
+             upb_arena_bytesallocated(d->arena) - d->arena_start >
+                 limits->max_arena_bytes) {
+    d->status = UPB_DECSTATUS_ARENALIMIT;
+  } else {
+    return true;
+  }
+
+  return false;
+}
+
+bool _upb_decode_message(upb_decstate *d, char *msg, const upb_msglayout *l) {
+  upb_decframe frame;
+
+  if ((d->options & UPB_DECODE_FASTTABLE) && l->fasttable && !d->mask &&
+      !d->limits) {
+    return _upb_fastdecode_message(d, msg, l);
+  }
+
+  frame.msg = msg;
+  frame.layout = l;
+  frame.mask = d->mask;
+  frame.state = d;
+  frame.last_field = -1;
+
+  while (d->ptr < d->limit && d->end_group == 0) {
     CHK(upb_decode_field(d, &frame));
+    if (d->limits) CHK(upb_decode_checklimits(d));
   }
 
   return true;
@@ -590,15 +911,818 @@ static bool upb_decode_message(upb_decstate *d, char *msg, const upb_msglayout *
 
 bool upb_decode(const char *buf, size_t size, void *msg, const upb_msglayout *l,
                 upb_arena *arena) {
+  return upb_decode_ex(buf, size, msg, l, arena, UPB_DECODE_ALIAS);
+}
+
+bool upb_decode_ex(const char *buf, size_t size, void *msg,
+                   const upb_msglayout *l, upb_arena *arena, int options) {
+  return upb_decode_masked(buf, size, msg, l, NULL, arena, options);
+}
+
+bool upb_decode_masked(const char *buf, size_t size, upb_msg *msg,
+                       const upb_msglayout *l, const upb_decmask *mask,
+                       upb_arena *arena, int options) {
+  upb_decstats stats;
+  return upb_decode_withstats(buf, size, msg, l, mask, arena, options, &stats);
+}
+
+static bool upb_decode_top(const char *buf, size_t size, upb_msg *msg,
+                           const upb_msglayout *l, const upb_decmask *mask,
+                           const upb_extreg *extreg,
+                           const upb_declimits *limits, upb_arena *arena,
+                           int options, upb_decstats *stats,
+                           upb_decstatus *status) {
   upb_decstate state;
+  bool ok;
   state.ptr = buf;
+  state.field_start = buf;
   state.limit = buf + size;
   state.arena = arena;
   state.depth = 64;
+  state.options = options;
+  state.mask = mask;
+  state.extreg = extreg;
+  state.limits = limits;
+  state.elements = 0;
+  state.arena_start = limits ? upb_arena_bytesallocated(arena) : 0;
+  state.status = UPB_DECSTATUS_OK;
+  state.stats.unknown_fields = 0;
+  state.stats.unknown_bytes = 0;
   state.end_group = 0;
 
-  CHK(upb_decode_message(&state, msg, l));
-  return state.end_group == 0;
+  UPB_ASSERT(!mask || mask->layout == l);
+
+  /* The decoded message takes about as much memory as its encoding. */
+  upb_arena_sizehint(arena, size);
+  _UPB_STATS_ADD(decode_bytes, size);
+
+  ok = _upb_decode_message(&state, msg, l) && state.end_group == 0;
+  *stats = state.stats;
+  if (status) {
+    *status = ok ? UPB_DECSTATUS_OK
+                 : state.status ? state.status : UPB_DECSTATUS_MALFORMED;
+  }
+  return ok;
+}
+
+bool upb_decode_withstats(const char *buf, size_t size, upb_msg *msg,
+                          const upb_msglayout *l, const upb_decmask *mask,
+                          upb_arena *arena, int options, upb_decstats *stats) {
+  return upb_decode_top(buf, size, msg, l, mask, NULL, NULL, arena, options,
+                        stats, NULL);
+}
+
+bool upb_decode_withexts(const char *buf, size_t size, upb_msg *msg,
+                         const upb_msglayout *l, const upb_extreg *extreg,
+                         upb_arena *arena, int options) {
+  upb_decstats stats;
+  return upb_decode_top(buf, size, msg, l, NULL, extreg, NULL, arena, options,
+                        &stats, NULL);
+}
+
+upb_decstatus upb_decode_limited(const char *buf, size_t size, upb_msg *msg,
+                                 const upb_msglayout *l,
+                                 const upb_declimits *limits, upb_arena *arena,
+                                 int options) {
+  upb_decstats stats;
+  upb_decstatus status;
+  upb_decode_top(buf, size, msg, l, NULL, NULL, limits, arena, options, &stats,
+                 &status);
+  return status;
+}
+
+size_t upb_decode_batch(const char *const *bufs, const size_t *sizes, size_t n,
+                        const upb_msglayout *l, upb_arena *arena, int options,
+                        upb_msg **msgs) {
+  upb_decstate state;
+  size_t total = 0;
+  size_t ok = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    total += sizes[i];
+  }
+
+  /* One block for the messages and what they decode to, which takes about as
+   * much memory as the input. */
+  upb_arena_sizehint(arena, total + n * l->size);
+  if (!_upb_msg_newbatch(l, n, msgs, arena)) {
+    for (i = 0; i < n; i++) msgs[i] = NULL;
+    return 0;
+  }
+
+  state.arena = arena;
+  state.options = options;
+  state.mask = NULL;
+  state.extreg = NULL;
+  state.limits = NULL;
+  state.stats.unknown_fields = 0;
+  state.stats.unknown_bytes = 0;
+
+  for (i = 0; i < n; i++) {
+    if (i + 1 < n) UPB_PREFETCH(bufs[i + 1]);
+
+    state.ptr = bufs[i];
+    state.field_start = bufs[i];
+    state.limit = bufs[i] + sizes[i];
+    state.depth = 64;
+    state.end_group = 0;
+
+    if (_upb_decode_message(&state, msgs[i], l) && state.end_group == 0) {
+      ok++;
+    } else {
+      msgs[i] = NULL;
+    }
+  }
+
+  _UPB_STATS_ADD(decode_bytes, total);
+  return ok;
+}
+
+/* upb_decstream **************************************************************/
+
+#define UPB_DECSTREAM_MAXDEPTH 64
+
+/* A submessage or group that the input has entered but not yet finished. */
+typedef struct {
+  char *msg;
+  const upb_msglayout *layout;
+  uint64_t end;        /* Input offset where it ends; groups inherit it. */
+  uint32_t group;      /* Field number for a group, otherwise 0. */
+  int last_field;
+} upb_decstream_frame;
+
+struct upb_decstream {
+  upb_decstate state;  /* Options and stats; ptr and limit are per call. */
+  upb_decstream_frame stack[UPB_DECSTREAM_MAXDEPTH];
+  int top;
+  uint64_t offset;     /* Bytes of input decoded so far. */
+  bool failed;
+
+  /* The start of a field that the last chunk ended in the middle of. */
+  char *buf;
+  size_t len;
+  size_t size;
+};
+
+static void upb_decstream_cleanup(void *ud) {
+  upb_decstream *s = ud;
+  upb_gfree(s->buf);
+}
+
+upb_decstream *upb_decstream_new(upb_msg *msg, const upb_msglayout *l,
+                                 upb_arena *arena, int options) {
+  upb_decstream *s = upb_arena_malloc(arena, sizeof(*s));
+  if (!s || !upb_arena_addcleanup(arena, s, &upb_decstream_cleanup)) {
+    return NULL;
+  }
+
+  s->state.arena = arena;
+  s->state.options = options & ~UPB_DECODE_ALIAS;
+  s->state.mask = NULL;
+  s->state.extreg = NULL;
+  s->state.limits = NULL;
+  s->state.stats.unknown_fields = 0;
+  s->state.stats.unknown_bytes = 0;
+  s->state.end_group = 0;
+  s->stack[0].msg = msg;
+  s->stack[0].layout = l;
+  s->stack[0].end = UINT64_MAX;
+  s->stack[0].group = 0;
+  s->stack[0].last_field = -1;
+  s->top = 0;
+  s->offset = 0;
+  s->failed = false;
+  s->buf = NULL;
+  s->len = 0;
+  s->size = 0;
+  return s;
+}
+
+/* Reads a varint that the end of the chunk may cut off.  Returns false if it
+ * is malformed, and sets |*ptr| to NULL if it is incomplete. */
+static bool upb_decstream_varint(const char **ptr, const char *limit,
+                                 uint64_t *val) {
+  const char *p = _upb_vdecode(*ptr, limit, val);
+  /* Anything shorter than the longest varint can only be incomplete. */
+  CHK(p || limit - *ptr < 10);
+  *ptr = p;
+  return true;
+}
+
+/* Moves past |n| bytes of input, leaving the submessages that end there. */
+static bool upb_decstream_advance(upb_decstream *s, size_t n) {
+  s->offset += n;
+  while (s->top > 0 && s->stack[s->top].end == s->offset) {
+    /* A group has to end with its END_GROUP tag. */
+    CHK(s->stack[s->top].group == 0);
+    s->top--;
+  }
+  return true;
+}
+
+/* Enters submessage or group |field| of the current message. */
+static bool upb_decstream_push(upb_decstream *s, upb_decframe *frame,
+                               const upb_msglayout_field *field, uint64_t end,
+                               uint32_t group) {
+  upb_decstream_frame *f;
+  const upb_msglayout *subm;
+  upb_msg *submsg;
+
+  CHK(s->top + 1 < UPB_DECSTREAM_MAXDEPTH);
+  if (field->label == UPB_LABEL_REPEATED) {
+    submsg = upb_addmsg(frame, field, &subm);
+  } else {
+    submsg = upb_getorcreatemsg(frame, field, &subm);
+    CHK(submsg);
+    upb_decode_setpresent(frame, field);
+  }
+  CHK(submsg);
+
+  f = &s->stack[++s->top];
+  f->msg = submsg;
+  f->layout = subm;
+  f->end = end;
+  f->group = group;
+  f->last_field = -1;
+  return true;
+}
+
+/* Decodes what it can of the next field in the |avail| bytes at |ptr|, which
+ * is either the whole field, or just the tag and length of a submessage that
+ * is entered.  Sets |consumed| to the bytes used, or to 0 if more input is
+ * needed first, in which case |need| is set to the size of the field (or 0 if
+ * that isn't known yet). */
+static bool upb_decstream_next(upb_decstream *s, const char *ptr,
+                               size_t avail, size_t *consumed, size_t *need) {
+  upb_decstate *d = &s->state;
+  upb_decstream_frame *f = &s->stack[s->top];
+  uint64_t left = f->end - s->offset;
+  bool bounded = left <= avail;  /* The message ends within |avail|. */
+  const char *limit = ptr + (bounded ? left : avail);
+  const char *p = ptr;
+  const upb_msglayout_field *field;
+  upb_decframe frame;
+  uint64_t tag;
+  uint64_t len;
+  bool ok;
+
+/* Waits for more input, unless the message ends before it. */
+#define NEED(n) { CHK(!bounded); *need = (n); return true; }
+
+  *consumed = 0;
+  *need = 0;
+  d->depth = UPB_DECSTREAM_MAXDEPTH - s->top;
+
+  if (bounded && f->group == 0) {
+    /* The rest of the submessage is here, so decode all of it. */
+    d->ptr = ptr;
+    d->field_start = ptr;
+    d->limit = limit;
+    CHK(_upb_decode_message(d, f->msg, f->layout) && d->end_group == 0);
+    *consumed = left;
+    return upb_decstream_advance(s, left);
+  }
+
+  CHK(upb_decstream_varint(&p, limit, &tag));
+  if (!p) NEED(0);
+  CHK(tag <= UINT32_MAX && (tag >> 3) != 0);
+
+  frame.msg = f->msg;
+  frame.layout = f->layout;
+  frame.mask = NULL;
+  frame.state = d;
+  frame.last_field = f->last_field;
+  field = upb_find_field(&frame, (uint32_t)tag >> 3);
+  f->last_field = frame.last_field;
+
+  /* upb_decstream_push() sizes a new array from the entries that are here. */
+  d->field_start = ptr;
+  d->limit = limit;
+
+  switch (tag & 7) {
+    case UPB_WIRE_TYPE_VARINT:
+      CHK(upb_decstream_varint(&p, limit, &len));
+      if (!p) NEED(0);
+      break;
+    case UPB_WIRE_TYPE_32BIT:
+      if (limit - p < 4) NEED(p - ptr + 4);
+      p += 4;
+      break;
+    case UPB_WIRE_TYPE_64BIT:
+      if (limit - p < 8) NEED(p - ptr + 8);
+      p += 8;
+      break;
+    case UPB_WIRE_TYPE_DELIMITED:
+      CHK(upb_decstream_varint(&p, limit, &len));
+      if (!p) NEED(0);
+      CHK(len < INT32_MAX && len <= f->end - s->offset - (p - ptr));
+      if ((uint64_t)(limit - p) >= len) {
+        p += len;
+      } else if (field &&
+                 field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE &&
+                 field->label != _UPB_LABEL_LAZY &&
+                 field->label != _UPB_LABEL_MAP) {
+        /* Only part of the submessage is here: enter it. */
+        *consumed = p - ptr;
+        CHK(upb_decstream_push(s, &frame, field, s->offset + *consumed + len,
+                               0));
+        return upb_decstream_advance(s, *consumed);
+      } else {
+        NEED(p - ptr + len);
+      }
+      break;
+    case UPB_WIRE_TYPE_START_GROUP:
+      if (field && field->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP &&
+          field->label != _UPB_LABEL_MAP) {
+        *consumed = p - ptr;
+        CHK(upb_decstream_push(s, &frame, field, f->end, (uint32_t)tag >> 3));
+        return upb_decstream_advance(s, *consumed);
+      }
+      /* Unknown groups are kept whole, so wait until all of it is here. */
+      d->ptr = p;
+      d->limit = limit;
+      if (!upb_skip_unknowngroup(d, (uint32_t)tag >> 3)) NEED(0);
+      p = d->ptr;
+      break;
+    case UPB_WIRE_TYPE_END_GROUP:
+      CHK(f->group == tag >> 3);
+      s->top--;
+      *consumed = p - ptr;
+      return upb_decstream_advance(s, *consumed);
+    default:
+      return false;
+  }
+
+#undef NEED
+
+  /* The whole field is here. */
+  d->ptr = ptr;
+  d->limit = p;
+  ok = upb_decode_field(d, &frame);
+  f->last_field = frame.last_field;
+  CHK(ok && d->ptr == p && d->end_group == 0);
+  *consumed = p - ptr;
+  return upb_decstream_advance(s, *consumed);
+}
+
+static bool upb_decstream_reserve(upb_decstream *s, size_t size) {
+  size_t new_size = UPB_MAX(s->size, 64);
+  char *new_buf;
+
+  if (s->size - s->len >= size) return true;
+  while (new_size - s->len < size) {
+    new_size *= 2;
+  }
+  new_buf = upb_grealloc(s->buf, s->size, new_size);
+  CHK(new_buf);
+  s->buf = new_buf;
+  s->size = new_size;
+  return true;
+}
+
+static bool upb_decstream_save(upb_decstream *s, const char *buf,
+                               size_t size) {
+  CHK(upb_decstream_reserve(s, size));
+  memcpy(s->buf + s->len, buf, size);
+  s->len += size;
+  return true;
+}
+
+static bool upb_decstream_dofeed(upb_decstream *s, const char *buf,
+                                 const char *end) {
+  size_t consumed;
+  size_t need;
+
+  /* First finish the field that the last chunk ended in the middle of. */
+  while (s->len > 0) {
+    size_t add;
+    CHK(upb_decstream_next(s, s->buf, s->len, &consumed, &need));
+    if (consumed > 0) {
+      s->len -= consumed;
+      memmove(s->buf, s->buf + consumed, s->len);
+      continue;
+    } else if (buf == end) {
+      return true;
+    }
+    /* Take as much as the field needs, if that's known yet. */
+    add = need > s->len ? need - s->len : UPB_MAX(s->len, 16);
+    add = UPB_MIN(add, (size_t)(end - buf));
+    CHK(upb_decstream_save(s, buf, add));
+    buf += add;
+  }
+
+  while (buf < end) {
+    CHK(upb_decstream_next(s, buf, end - buf, &consumed, &need));
+    if (consumed == 0) {
+      /* Keep the start of the field, with room for all of it if we know how
+       * much that is. */
+      CHK(upb_decstream_reserve(s, need));
+      return upb_decstream_save(s, buf, end - buf);
+    }
+    buf += consumed;
+  }
+
+  return true;
+}
+
+bool upb_decstream_feed(upb_decstream *s, const char *buf, size_t size) {
+  _UPB_STATS_ADD(decode_bytes, size);
+  if (s->failed || !upb_decstream_dofeed(s, buf, buf + size)) {
+    s->failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool upb_decstream_finish(upb_decstream *s) {
+  return !s->failed && s->top == 0 && s->len == 0;
+}
+
+/* upb_decmask ****************************************************************/
+
+static int upb_decmask_find(const upb_decmask *m, uint32_t number) {
+  int i;
+  for (i = 0; i < m->layout->field_count; i++) {
+    if (m->layout->fields[i].number == number) return i;
+  }
+  return -1;
+}
+
+upb_decmask *upb_decmask_new(const upb_msglayout *l, upb_arena *a) {
+  size_t words = (l->field_count + 31) / 32;
+  upb_decmask *m = upb_arena_malloc(a, sizeof(*m));
+  if (!m) return NULL;
+  m->layout = l;
+  m->wanted = upb_arena_malloc(a, UPB_MAX(words, 1) * sizeof(uint32_t));
+  m->submasks = NULL;
+  if (!m->wanted) return NULL;
+  memset(m->wanted, 0, UPB_MAX(words, 1) * sizeof(uint32_t));
+  return m;
+}
+
+bool upb_decmask_add(upb_decmask *m, uint32_t number) {
+  int idx = upb_decmask_find(m, number);
+  if (idx < 0) return false;
+  m->wanted[idx / 32] |= 1U << (idx % 32);
+  if (m->submasks) m->submasks[idx] = NULL;
+  return true;
+}
+
+upb_decmask *upb_decmask_addsub(upb_decmask *m, uint32_t number,
+                                upb_arena *a) {
+  int idx = upb_decmask_find(m, number);
+  const upb_msglayout_field *f;
+  upb_decmask *sub;
+
+  if (idx < 0) return NULL;
+  f = &m->layout->fields[idx];
+  if (f->descriptortype != UPB_DESCRIPTOR_TYPE_MESSAGE &&
+      f->descriptortype != UPB_DESCRIPTOR_TYPE_GROUP) {
+    return NULL;
+  }
+
+  if (!m->submasks) {
+    size_t bytes = m->layout->field_count * sizeof(*m->submasks);
+    m->submasks = upb_arena_malloc(a, bytes);
+    if (!m->submasks) return NULL;
+    memset(m->submasks, 0, bytes);
+  }
+
+  if (!m->submasks[idx]) {
+    sub = upb_decmask_new(m->layout->submsgs[f->submsg_index], a);
+    if (!sub) return NULL;
+    m->submasks[idx] = sub;
+  }
+
+  m->wanted[idx / 32] |= 1U << (idx % 32);
+  return m->submasks[idx];
+}
+
+/* upb_decsplit ***************************************************************/
+
+typedef struct {
+  const char *begin;  /* From the tag of the first element... */
+  const char *end;    /* ...to the end of the last one. */
+  size_t count;       /* Of elements. */
+  upb_msg **elems;    /* Once decoded. */
+  upb_arena *arena;   /* Where they were decoded, or NULL until then. */
+} upb_decsplit_run;
+
+struct upb_decsplit {
+  const char *buf;
+  size_t size;
+  const upb_msglayout *layout;
+  const upb_msglayout_field *field;
+  upb_decsplit_run *runs;
+  size_t run_count;
+};
+
+/* Finds the next element of the field from d->ptr on, skipping other fields.
+ * Sets |start| to its tag and leaves d->ptr at its |len| bytes of data, or
+ * sets |start| to NULL if there are no more. */
+static bool upb_decsplit_next(const upb_decsplit *s, upb_decstate *d,
+                              const char **start, int *len) {
+  uint32_t number = s->field->number;
+
+  while (d->ptr < d->limit) {
+    uint32_t tag;
+    *start = d->ptr;
+    CHK(upb_decode_varint32(&d->ptr, d->limit, &tag));
+    if (tag == (number << 3 | UPB_WIRE_TYPE_DELIMITED)) {
+      return upb_decode_string(&d->ptr, d->limit, len);
+    }
+    CHK((tag >> 3) != 0 && (tag >> 3) != number);
+    CHK(upb_skip_unknownfielddata(d, tag, -1));
+  }
+
+  *start = NULL;
+  return true;
+}
+
+upb_decsplit *upb_decsplit_new(const char *buf, size_t size,
+                               const upb_msglayout *l, uint32_t number,
+                               size_t runs, upb_arena *arena) {
+  upb_decsplit *s = upb_arena_malloc(arena, sizeof(*s));
+  upb_decstate d;
+  const char *start;
+  int len;
+  size_t count = 0;
+  size_t total = 0;
+  size_t done = 0;
+  int i;
+
+  CHK(s);
+  s->buf = buf;
+  s->size = size;
+  s->layout = l;
+  s->field = NULL;
+  s->run_count = 0;
+  for (i = 0; i < l->field_count; i++) {
+    if (l->fields[i].number == number) s->field = &l->fields[i];
+  }
+  CHK(s->field && s->field->label == UPB_LABEL_REPEATED &&
+      s->field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE);
+
+  /* Once to size the elements, then again to divide them up. */
+  d.ptr = buf;
+  d.limit = buf + size;
+  do {
+    CHK(upb_decsplit_next(s, &d, &start, &len));
+    if (start) {
+      d.ptr += len;
+      total += d.ptr - start;
+      count++;
+    }
+  } while (start);
+
+  runs = UPB_MIN(UPB_MAX(runs, 1), count);
+  s->runs = upb_arena_malloc(arena, UPB_MAX(runs, 1) * sizeof(*s->runs));
+  CHK(s->runs);
+
+  d.ptr = buf;
+  do {
+    upb_decsplit_run *run;
+    CHK(upb_decsplit_next(s, &d, &start, &len));
+    if (!start) break;
+    d.ptr += len;
+    if (s->run_count < runs && done >= total / runs * s->run_count) {
+      run = &s->runs[s->run_count++];
+      run->begin = start;
+      run->count = 0;
+      run->elems = NULL;
+      run->arena = NULL;
+    } else {
+      run = &s->runs[s->run_count - 1];
+    }
+    run->end = d.ptr;
+    run->count++;
+    done += d.ptr - start;
+  } while (true);
+
+  return s;
+}
+
+size_t upb_decsplit_runs(const upb_decsplit *s) {
+  return s->run_count;
+}
+
+bool upb_decsplit_decode(upb_decsplit *s, size_t i, upb_arena *arena,
+                         int options) {
+  upb_decsplit_run *run = &s->runs[i];
+  const upb_msglayout *subl = s->layout->submsgs[s->field->submsg_index];
+  upb_decstate d;
+  size_t n;
+
+  UPB_ASSERT(i < s->run_count);
+  d.ptr = run->begin;
+  d.field_start = run->begin;
+  d.limit = run->end;
+  d.arena = arena;
+  d.depth = 64;
+  d.options = options;
+  d.mask = NULL;
+  d.extreg = NULL;
+  d.limits = NULL;
+  d.stats.unknown_fields = 0;
+  d.stats.unknown_bytes = 0;
+  d.end_group = 0;
+
+  upb_arena_sizehint(arena, run->end - run->begin);
+  _UPB_STATS_ADD(decode_bytes, run->end - run->begin);
+  run->elems = upb_arena_malloc(arena, run->count * sizeof(*run->elems));
+  CHK(run->elems);
+
+  for (n = 0; n < run->count; n++) {
+    const char *start;
+    int len;
+    upb_msg *elem;
+    CHK(upb_decsplit_next(s, &d, &start, &len) && start);
+    elem = upb_msg_new(subl, arena);
+    CHK(elem);
+    CHK(_upb_decode_msgfield(&d, elem, subl, len));
+    run->elems[n] = elem;
+  }
+
+  run->arena = arena;
+  return true;
+}
+
+bool upb_decsplit_finish(upb_decsplit *s, upb_msg *msg, upb_arena *arena,
+                         int options) {
+  const upb_msglayout *l = s->layout;
+  upb_decmask *mask = upb_decmask_new(l, arena);
+  upb_array **arr = (upb_array**)((char*)msg + s->field->offset);
+  size_t i;
+
+  CHK(mask);
+  for (i = 0; i < (size_t)l->field_count; i++) {
+    if (&l->fields[i] != s->field) upb_decmask_add(mask, l->fields[i].number);
+  }
+  CHK(upb_decode_masked(s->buf, s->size, msg, l, mask, arena, options));
+
+  if (s->run_count > 0 && !*arr) {
+    size_t total = 0;
+    for (i = 0; i < s->run_count; i++) total += s->runs[i].count;
+    *arr = _upb_array_new(arena, total, sizeof(*s->runs[0].elems));
+    CHK(*arr);
+  }
+
+  for (i = 0; i < s->run_count; i++) {
+    upb_decsplit_run *run = &s->runs[i];
+    CHK(run->arena && upb_arena_fuse(arena, run->arena));
+    CHK(upb_array_add(*arr, run->count, sizeof(*run->elems), run->elems,
+                      arena));
+  }
+
+  return true;
+}
+
+/* upb_scan *******************************************************************/
+
+struct upb_scan {
+  upb_scanfield *fields;
+  size_t count;
+};
+
+/* Like upb_skip_unknowngroup(), but also finds where the group's end tag
+ * starts. */
+static bool upb_scan_group(upb_decstate *d, uint32_t number,
+                           const char **end) {
+  while (d->ptr < d->limit) {
+    uint32_t tag;
+    *end = d->ptr;
+    CHK(upb_decode_varint32(&d->ptr, d->limit, &tag));
+    CHK((tag >> 3) != 0);
+    if ((tag & 7) == UPB_WIRE_TYPE_END_GROUP) {
+      return (tag >> 3) == number;
+    }
+    CHK(upb_skip_unknownfielddata(d, tag, number));
+  }
+
+  return false;  /* Group was not terminated. */
+}
+
+static bool upb_scan_field(upb_decstate *d, upb_scanfield *f) {
+  uint32_t tag;
+  const char *end;
+
+  f->field = d->ptr;
+  CHK(upb_decode_varint32(&d->ptr, d->limit, &tag));
+  f->number = tag >> 3;
+  f->wire_type = tag & 7;
+  f->data = d->ptr;
+  CHK(f->number != 0);
+
+  switch (f->wire_type) {
+    case UPB_WIRE_TYPE_DELIMITED: {
+      int len;
+      CHK(upb_decode_string(&d->ptr, d->limit, &len));
+      f->data = d->ptr;
+      d->ptr += len;
+      end = d->ptr;
+      break;
+    }
+    case UPB_WIRE_TYPE_START_GROUP:
+      CHK(upb_scan_group(d, f->number, &end));
+      break;
+    case UPB_WIRE_TYPE_END_GROUP:
+      return false;  /* Not in a group. */
+    default:
+      CHK(upb_skip_unknownfielddata(d, tag, -1));
+      end = d->ptr;
+      break;
+  }
+
+  f->field_size = d->ptr - f->field;
+  f->size = end - f->data;
+  return true;
+}
+
+static int upb_scan_cmp(const void *a, const void *b) {
+  const upb_scanfield *f1 = a;
+  const upb_scanfield *f2 = b;
+  if (f1->number != f2->number) return f1->number < f2->number ? -1 : 1;
+  return f1->field < f2->field ? -1 : f1->field > f2->field;
+}
+
+upb_scan *upb_scan_new(const char *buf, size_t size, upb_arena *arena) {
+  upb_scan *s = upb_arena_malloc(arena, sizeof(*s));
+  upb_decstate d;
+  upb_scanfield f;
+  bool sorted = true;
+  size_t i;
+
+  CHK(s);
+  s->count = 0;
+
+  /* Once to count the fields, then again to record them. */
+  d.ptr = buf;
+  d.limit = buf + size;
+  while (d.ptr < d.limit) {
+    CHK(upb_scan_field(&d, &f));
+    s->count++;
+  }
+
+  s->fields = upb_arena_malloc(arena, UPB_MAX(s->count, 1) * sizeof(f));
+  CHK(s->fields);
+
+  d.ptr = buf;
+  for (i = 0; i < s->count; i++) {
+    upb_scan_field(&d, &s->fields[i]);
+    if (i > 0 && s->fields[i].number < s->fields[i - 1].number) {
+      sorted = false;
+    }
+  }
+
+  /* Fields are usually encoded in order already. */
+  if (!sorted) {
+    qsort(s->fields, s->count, sizeof(f), upb_scan_cmp);
+  }
+
+  return s;
+}
+
+const upb_scanfield *upb_scan_fields(const upb_scan *s, size_t *count) {
+  *count = s->count;
+  return s->fields;
+}
+
+const upb_scanfield *upb_scan_find(const upb_scan *s, uint32_t number,
+                                   size_t *count) {
+  size_t lo = 0;
+  size_t hi = s->count;
+  size_t end;
+
+  /* The first field numbered |number| or more. */
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (s->fields[mid].number < number) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for (end = lo; end < s->count && s->fields[end].number == number; end++) {}
+  *count = end - lo;
+  return *count ? &s->fields[lo] : NULL;
+}
+
+upb_msg *_upb_decode_lazy(upb_msg *msg, size_t ofs, const upb_msglayout *l) {
+  void **slot = (void**)((char*)msg + ofs);
+  const _upb_lazymsg *lazy = _upb_getlazy(*slot);
+  upb_msg *sub = upb_msg_new(l, lazy->arena);
+
+  /* The data is either in the arena or in an input that outlives it, so the
+   * submessage can alias it. */
+  if (!sub || !upb_decode_ex(lazy->data.data, lazy->data.size, sub, l,
+                             lazy->arena, lazy->options | UPB_DECODE_ALIAS)) {
+    return NULL;
+  }
+
+  *slot = sub;
+  return sub;
 }
 
 #undef CHK
@@ -11,9 +11,225 @@
 extern "C" {
 #endif
 
+/* Options for upb_decode_ex(), to be OR'd together. */
+enum {
+  /* Decode with the per-message fast tables emitted by upbc, where the
+   * layout has one.  Layouts without a fast table (eg. those built by
+   * upb_msgfactory) are still decoded with the generic decoder. */
+  UPB_DECODE_FASTTABLE = 1,
+
+  /* String and bytes fields point into |buf| instead of being copied into
+   * |arena|.  The caller must keep |buf| alive and unchanged for as long as
+   * the message is used, normally by making it outlive the arena.  Without
+   * this option every string is copied, so |buf| may be freed or reused as
+   * soon as upb_decode_ex() returns.  Unknown fields alias the input too. */
+  UPB_DECODE_ALIAS = 2,
+
+  /* Unknown fields are skipped instead of being kept in the message, so they
+   * will be missing when it is encoded again. */
+  UPB_DECODE_DISCARDUNKNOWN = 4
+};
+
+/* Decodes with UPB_DECODE_ALIAS: strings in |msg| point into |buf|. */
 bool upb_decode(const char *buf, size_t size, upb_msg *msg,
                 const upb_msglayout *l, upb_arena *arena);
 
+bool upb_decode_ex(const char *buf, size_t size, upb_msg *msg,
+                   const upb_msglayout *l, upb_arena *arena, int options);
+
+/* A field mask for upb_decode_masked(): the fields of one message type that
+ * should be decoded, and for submessage fields optionally a mask for the
+ * submessage.  Masks are allocated in an arena and can be reused for any
+ * number of decodes. */
+typedef struct upb_decmask upb_decmask;
+
+/* Returns an empty mask for messages of layout |l|. */
+upb_decmask *upb_decmask_new(const upb_msglayout *l, upb_arena *a);
+
+/* Adds field |number| to the mask; a submessage field is then decoded in
+ * full.  Returns false if the message has no such field. */
+bool upb_decmask_add(upb_decmask *m, uint32_t number);
+
+/* Adds submessage field |number| to the mask, and returns the (initially
+ * empty) mask for the fields to decode in the submessage.  Returns NULL if
+ * the message has no such submessage field, or on allocation failure. */
+upb_decmask *upb_decmask_addsub(upb_decmask *m, uint32_t number,
+                                upb_arena *a);
+
+/* Like upb_decode_ex(), but only decodes the fields selected by |mask|, which
+ * must have been created for |l|.  Other known fields are skipped without
+ * being stored, not even as unknown fields. */
+bool upb_decode_masked(const char *buf, size_t size, upb_msg *msg,
+                       const upb_msglayout *l, const upb_decmask *mask,
+                       upb_arena *arena, int options);
+
+/* What a decode came across, for monitoring. */
+typedef struct {
+  size_t unknown_fields;  /* Kept or discarded. */
+  size_t unknown_bytes;   /* Including their tags. */
+} upb_decstats;
+
+/* Like upb_decode_masked(), with a NULL |mask| to decode every field, and
+ * sets |stats| (even if decoding fails partway). */
+bool upb_decode_withstats(const char *buf, size_t size, upb_msg *msg,
+                          const upb_msglayout *l, const upb_decmask *mask,
+                          upb_arena *arena, int options, upb_decstats *stats);
+
+/* Like upb_decode_ex(), but parses the extensions in |extreg| (see
+ * upb/msg.h) into the extensions of |msg| and its submessages, instead of
+ * keeping them as unknown fields. */
+bool upb_decode_withexts(const char *buf, size_t size, upb_msg *msg,
+                         const upb_msglayout *l, const upb_extreg *extreg,
+                         upb_arena *arena, int options);
+
+/* Budgets for upb_decode_limited(), to bound the memory and time that a
+ * hostile or malformed input can take.  0 means no limit. */
+typedef struct {
+  /* Bytes allocated from the arena during the decode. */
+  size_t max_arena_bytes;
+  /* Fields decoded, counting each element of a repeated field that isn't
+   * packed, each map entry and every field of every submessage.  A packed
+   * field counts once. */
+  size_t max_elements;
+  /* Bytes of unknown fields, kept or discarded. */
+  size_t max_unknown_bytes;
+} upb_declimits;
+
+typedef enum {
+  UPB_DECSTATUS_OK = 0,
+  UPB_DECSTATUS_MALFORMED = 1,     /* Invalid input or allocation failure. */
+  UPB_DECSTATUS_ARENALIMIT = 2,
+  UPB_DECSTATUS_ELEMENTLIMIT = 3,
+  UPB_DECSTATUS_UNKNOWNLIMIT = 4
+} upb_decstatus;
+
+/* Like upb_decode_ex(), but stops as soon as the decode goes over one of the
+ * |limits| and says which one in the result.  The limits are checked after
+ * every field, so the budget is exceeded by at most one field.  The fast
+ * table decoder isn't used: UPB_DECODE_FASTTABLE is ignored.  |msg| is left
+ * partly decoded when this fails. */
+upb_decstatus upb_decode_limited(const char *buf, size_t size, upb_msg *msg,
+                                 const upb_msglayout *l,
+                                 const upb_declimits *limits, upb_arena *arena,
+                                 int options);
+
+/* Decodes |n| messages of the same type, bufs[i] being sizes[i] bytes, into
+ * new messages that are stored in msgs[i].  This is cheaper than creating and
+ * decoding each message on its own when there are many small ones: the
+ * messages are allocated together from one block of |arena|, the decoder is
+ * set up once and the next input is prefetched while the current one is
+ * decoded.  Strings are copied unless |options| has UPB_DECODE_ALIAS.
+ *
+ * A message that fails to decode is set to NULL in |msgs| and the others are
+ * still decoded.  Returns the number of messages decoded successfully, which
+ * is 0 (with every msgs[i] NULL) if the messages couldn't be allocated. */
+size_t upb_decode_batch(const char *const *bufs, const size_t *sizes, size_t n,
+                        const upb_msglayout *l, upb_arena *arena, int options,
+                        upb_msg **msgs);
+
+/* upb_decstream: decoding a message that arrives in pieces, eg. from a
+ * socket, without first collecting it into one buffer.  Any split of the
+ * input into chunks gives the same result as upb_decode_ex() on the whole.
+ *
+ * Submessages are decoded as their data arrives, so only a field that spans
+ * two chunks is held back, until the rest of it is fed.  Strings are always
+ * copied, since the chunks need not outlive upb_decstream_feed(). */
+typedef struct upb_decstream upb_decstream;
+
+/* Returns a stream that decodes into |msg|, which has layout |l|, or NULL on
+ * allocation failure.  The stream is allocated from |arena|, which the
+ * message is also decoded into.  UPB_DECODE_ALIAS is ignored. */
+upb_decstream *upb_decstream_new(upb_msg *msg, const upb_msglayout *l,
+                                 upb_arena *arena, int options);
+
+/* Decodes the next |size| bytes of the input.  Returns false if the input is
+ * malformed or on allocation failure, after which the stream only fails. */
+bool upb_decstream_feed(upb_decstream *s, const char *buf, size_t size);
+
+/* Ends the input, returning false if it stopped in the middle of a field or
+ * submessage, or if decoding failed earlier. */
+bool upb_decstream_finish(upb_decstream *s);
+
+/* upb_decsplit: decoding a message with a large repeated message field on
+ * several threads.
+ *
+ * upb_decsplit_new() scans the encoded message for the elements of the field
+ * and divides them into runs of about the same size.  Each run is decoded into
+ * an arena of its own with upb_decsplit_decode(), which may be called for
+ * different runs at the same time from different threads.  Then
+ * upb_decsplit_finish() decodes the rest of the message and appends the
+ * elements of the runs to the field in their original order, fusing the run
+ * arenas with the message's (see upb_arena_fuse()).  The message ends up just
+ * as upb_decode_ex() would leave it. */
+typedef struct upb_decsplit upb_decsplit;
+
+/* Splits the elements of repeated message field |number| of |buf|, a message
+ * with layout |l|, into at most |runs| runs.  Returns NULL if |l| has no such
+ * field, if an element is not length-delimited, if the message is malformed,
+ * or on allocation failure.  The split is allocated from |arena|; |buf| must
+ * outlive it. */
+upb_decsplit *upb_decsplit_new(const char *buf, size_t size,
+                               const upb_msglayout *l, uint32_t number,
+                               size_t runs, upb_arena *arena);
+
+/* The number of runs, which is fewer than were asked for if the field has
+ * fewer elements. */
+size_t upb_decsplit_runs(const upb_decsplit *s);
+
+/* Decodes the elements of run |i| into |arena|.  |arena| must be fusable (not
+ * created with an initial block) and must not be used for anything else until
+ * upb_decsplit_finish() returns. */
+bool upb_decsplit_decode(upb_decsplit *s, size_t i, upb_arena *arena,
+                         int options);
+
+/* Decodes the other fields of the message into |msg| and appends the decoded
+ * elements.  Returns false if decoding fails, or if any run was not
+ * decoded.  The run arenas may be freed afterwards: they live on as long as
+ * |arena|. */
+bool upb_decsplit_finish(upb_decsplit *s, upb_msg *msg, upb_arena *arena,
+                         int options);
+
+/* upb_scan: an index of the fields of an encoded message, built without
+ * decoding it.
+ *
+ * upb_scan_new() checks the wire format of the message's own fields (tags,
+ * varints, lengths and group nesting) and records where each field occurs,
+ * allocating nothing but the index.  Length-delimited fields are not looked
+ * into, since without a layout they may be strings as well as submessages:
+ * to read one, decode its data with upb_decode() or scan it in turn. */
+typedef struct {
+  uint32_t number;
+  uint8_t wire_type;    /* UPB_WIRE_TYPE_* */
+  const char *field;    /* The whole field, from its tag... */
+  size_t field_size;    /* ...to its end, ready to be copied as it is. */
+  /* The value: the bytes of a varint or fixed-size value, the payload of a
+   * delimited field, or the fields between the tags of a group. */
+  const char *data;
+  size_t size;
+} upb_scanfield;
+
+typedef struct upb_scan upb_scan;
+
+/* Scans |buf|, which must outlive the scan.  Returns NULL if it is malformed
+ * or on allocation failure. */
+upb_scan *upb_scan_new(const char *buf, size_t size, upb_arena *arena);
+
+/* All the fields, ordered by field number and then by position, so that the
+ * occurrences of one field number are adjacent. */
+const upb_scanfield *upb_scan_fields(const upb_scan *s, size_t *count);
+
+/* The occurrences of field |number| in the order they appear in the input,
+ * or NULL with *count == 0 if there are none.  The last one is the value of
+ * a singular field. */
+const upb_scanfield *upb_scan_find(const upb_scan *s, uint32_t number,
+                                   size_t *count);
+
+/* Internal, for generated code: parses the lazy submessage with layout |l|
+ * held by the field at offset |ofs| of |msg|, and stores the result in the
+ * field.  Returns NULL if it is malformed or on allocation failure, leaving
+ * the field unparsed. */
+upb_msg *_upb_decode_lazy(upb_msg *msg, size_t ofs, const upb_msglayout *l);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -0,0 +1,98 @@
+/*
+** Internal interface shared by the generic decoder (decode.c) and the fast
+** table decoder (decode_fast.c).
+**
+** The definitions in this file are internal to upb.
+*/
+
+#ifndef UPB_DECODE_INT_H_
+#define UPB_DECODE_INT_H_
+
+#include "upb/decode.h"
+#include "upb/varint_decode.int.h"
+
+#include "upb/port_def.inc"
+
+/* Set in upb_decstate.options, next to the UPB_DECODE_* flags, while the
+ * fields of a map entry are decoded into scratch memory that has no room for
+ * unknown fields.  It is cleared again for the entry's value message. */
+#define _UPB_DECODE_MAPENTRY (1 << 30)
+
+/* Data pertaining to the parse. */
+typedef struct upb_decstate {
+  const char *ptr;           /* Current parsing position. */
+  const char *field_start;   /* Start of this field. */
+  const char *limit;         /* End of delimited region or end of buffer. */
+  upb_arena *arena;
+  int depth;
+  int options;         /* UPB_DECODE_* flags passed to upb_decode_ex(). */
+  const struct upb_decmask *mask;  /* For the next message entered, or NULL. */
+  const upb_extreg *extreg;  /* Extensions to parse, or NULL for none. */
+  const upb_declimits *limits;  /* Budgets to enforce, or NULL for none. */
+  size_t elements;             /* Fields decoded so far, if |limits|. */
+  size_t arena_start;          /* Arena bytes allocated at the start. */
+  upb_decstatus status;        /* Set when a limit is exceeded. */
+  upb_decstats stats;
+  uint32_t end_group;  /* Set to field number of END_GROUP tag, if any. */
+} upb_decstate;
+
+UPB_INLINE bool _upb_decode_varint(const char **ptr, const char *limit,
+                                   uint64_t *val) {
+  const char *p = _upb_vdecode(*ptr, limit, val);
+  if (!p) return false;
+  *ptr = p;
+  return true;
+}
+
+struct upb_decmask {
+  const upb_msglayout *layout;
+  uint32_t *wanted;             /* Bitset over the indexes of l->fields. */
+  struct upb_decmask **submasks;  /* By field index; NULL until one is set. */
+};
+
+/* Reads a string of |len| bytes at d->ptr, copying it into the arena unless
+ * the options allow aliasing the input.  The caller has checked |len|. */
+UPB_INLINE bool _upb_decode_str(upb_decstate *d, int len, upb_strview *str) {
+  if ((d->options & UPB_DECODE_ALIAS) || len == 0) {
+    str->data = d->ptr;
+  } else {
+    char *data = (char*)upb_arena_malloc(d->arena, len);
+    if (!data) return false;
+    memcpy(data, d->ptr, len);
+    str->data = data;
+  }
+  str->size = len;
+  d->ptr += len;
+  return true;
+}
+
+/* Decodes fields into |msg| until the end of the current delimited region or
+ * an END_GROUP tag.  Uses the fast table for |l| if the options allow it. */
+bool _upb_decode_message(upb_decstate *d, char *msg, const upb_msglayout *l);
+
+/* Decodes a single field (tag and value) with the generic decoder. */
+bool _upb_decode_field(upb_decstate *d, char *msg, const upb_msglayout *l);
+
+/* Decodes a submessage of |len| bytes starting at d->ptr.  d->field_start is
+ * left at the submessage's own tag, which the fast decoder compares with the
+ * next one to stay in a repeated field. */
+bool _upb_decode_msgfield(upb_decstate *d, upb_msg *msg,
+                          const upb_msglayout *l, int len);
+
+bool _upb_fastdecode_message(upb_decstate *d, char *msg,
+                             const upb_msglayout *l);
+
+bool upb_array_add(upb_array *arr, size_t elements, size_t elem_size,
+                   const void *data, upb_arena *arena);
+
+/* The most entries _upb_decode_countrun() looks ahead at.  Longer runs grow
+ * their array by doubling as they are decoded. */
+#define UPB_ARRAY_RUNMAX 16
+
+/* Returns how many entries in a row, starting with the one at |ptr|, have
+ * the same tag, counting at least 1 and at most UPB_ARRAY_RUNMAX. */
+size_t _upb_decode_countrun(const char *ptr, const char *limit);
+
+#include "upb/port_undef.inc"
+
+#endif  /* UPB_DECODE_INT_H_ */
@@ -0,0 +1,72 @@
+/*
+** The fast table decoder.  Instead of looking up every tag in the layout and
+** switching on its wire type and descriptor type, we index the message's fast
+** table with the first tag byte and call the specialized parser found there.
+** See decode_fast.h for the parsers and the table format.
+*/
+
+#include "upb/decode_fast.int.h"
+#include "upb/stats.h"
+
+#include "upb/port_def.inc"
+
+#define CHK(x) if (!(x)) { return 0; }
+
+bool _upb_fastdecode_message(upb_decstate *d, char *msg,
+                             const upb_msglayout *l) {
+  const _upb_fasttable_entry *table = l->fasttable;
+  uint8_t mask = l->table_mask;
+  uint64_t tag;
+
+  while (_upb_fastdecode_peektag(d, &tag)) {
+    const _upb_fasttable_entry *ent = &table[(tag & mask) >> 3];
+    _UPB_STATS_ADD(decode_fast_dispatches, 1);
+    CHK(ent->field_parser(d, msg, l, ent->field_data ^ tag));
+  }
+
+  return true;
+}
+
+bool _upb_fastdecode_generic(struct upb_decstate *d, upb_msg *msg,
+                             const upb_msglayout *l, uint64_t data) {
+  UPB_UNUSED(data);
+  return _upb_decode_field(d, msg, l);
+}
+
+/* The specialized parsers. */
+
+#define F(card, type, tagbytes, body)                                   \
+  bool upb_p##card##type##_##tagbytes##bt(struct upb_decstate *d,        \
+                                          upb_msg *msg,                  \
+                                          const upb_msglayout *l,        \
+                                          uint64_t data) {               \
+    return body;                                                         \
+  }
+
+#define SCALAR(type, kind)                                                 \
+  F(s, type, 1, _upb_fastdecode_scalar(d, msg, l, data, 1, kind, false))   \
+  F(s, type, 2, _upb_fastdecode_scalar(d, msg, l, data, 2, kind, false))   \
+  F(r, type, 1, _upb_fastdecode_scalar(d, msg, l, data, 1, kind, true))    \
+  F(r, type, 2, _upb_fastdecode_scalar(d, msg, l, data, 2, kind, true))
+
+SCALAR(b1, _UPB_FASTDECODE_B1)
+SCALAR(v4, _UPB_FASTDECODE_V4)
+SCALAR(v8, _UPB_FASTDECODE_V8)
+SCALAR(z4, _UPB_FASTDECODE_Z4)
+SCALAR(z8, _UPB_FASTDECODE_Z8)
+SCALAR(f4, _UPB_FASTDECODE_F4)
+SCALAR(f8, _UPB_FASTDECODE_F8)
+
+F(s, s, 1, _upb_fastdecode_string(d, msg, l, data, 1, false))
+F(s, s, 2, _upb_fastdecode_string(d, msg, l, data, 2, false))
+F(r, s, 1, _upb_fastdecode_string(d, msg, l, data, 1, true))
+F(r, s, 2, _upb_fastdecode_string(d, msg, l, data, 2, true))
+
+F(s, m, 1, _upb_fastdecode_submsg(d, msg, l, data, 1, false))
+F(s, m, 2, _upb_fastdecode_submsg(d, msg, l, data, 2, false))
+F(r, m, 1, _upb_fastdecode_submsg(d, msg, l, data, 1, true))
+F(r, m, 2, _upb_fastdecode_submsg(d, msg, l, data, 2, true))
+
+#undef SCALAR
+#undef F
+#undef CHK
@@ -0,0 +1,74 @@
+/*
+** Field parsers for the fast table decoder (UPB_DECODE_FASTTABLE).
+**
+** upbc emits a table of _upb_fasttable_entry for each message, indexed by the
+** low bits of the first tag byte.  Each entry points at one of the parsers
+** below, specialized for one kind of field, and carries the tag it expects.
+** If the tag on the wire doesn't match, the parser hands the field to the
+** generic decoder instead.
+**
+** Parser names are upb_p{card}{type}_{tagbytes}bt, where:
+**
+**   card:      s = singular (hasbit or no presence), r = repeated, unpacked
+**   type:      b1 = bool, v4/v8 = 32/64-bit varint,
+**              z4/z8 = 32/64-bit zigzag varint, f4/f8 = 32/64-bit fixed,
+**              s = string or bytes, m = message
+**   tagbytes:  length of the encoded tag, 1 or 2.
+**
+** Given a profile, upbc also emits a parser for the usual field sequence of
+** each of the hottest messages, built from the inline functions in
+** decode_fast.int.h, and puts it in the slot of the sequence's first field.
+**
+** The definitions in this file are internal to upb.
+*/
+
+#ifndef UPB_DECODE_FAST_H_
+#define UPB_DECODE_FAST_H_
+
+#include "upb/msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Builds _upb_fasttable_entry.field_data: the expected tag bytes in bits
+ * 0-15, the submessage index in bits 16-23, the hasbit (0 for none) in bits
+ * 24-31 and the field offset in bits 48-63. */
+#define UPB_FASTDATA(tag, submsg_index, hasbit, offset) \
+  ((uint64_t)(tag) | ((uint64_t)(submsg_index) << 16) | \
+   ((uint64_t)(hasbit) << 24) | ((uint64_t)(offset) << 48))
+
+/* Parses the field with the generic decoder.  Used for empty slots. */
+_upb_field_parser _upb_fastdecode_generic;
+
+#define UPB_FASTPARSERS(card, type)     \
+  _upb_field_parser upb_p##card##type##_1bt; \
+  _upb_field_parser upb_p##card##type##_2bt;
+
+UPB_FASTPARSERS(s, b1)
+UPB_FASTPARSERS(s, v4)
+UPB_FASTPARSERS(s, v8)
+UPB_FASTPARSERS(s, z4)
+UPB_FASTPARSERS(s, z8)
+UPB_FASTPARSERS(s, f4)
+UPB_FASTPARSERS(s, f8)
+UPB_FASTPARSERS(s, s)
+UPB_FASTPARSERS(s, m)
+
+UPB_FASTPARSERS(r, b1)
+UPB_FASTPARSERS(r, v4)
+UPB_FASTPARSERS(r, v8)
+UPB_FASTPARSERS(r, z4)
+UPB_FASTPARSERS(r, z8)
+UPB_FASTPARSERS(r, f4)
+UPB_FASTPARSERS(r, f8)
+UPB_FASTPARSERS(r, s)
+UPB_FASTPARSERS(r, m)
+
+#undef UPB_FASTPARSERS
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_DECODE_FAST_H_ */
@@ -0,0 +1,284 @@
+/*
+** The field parsers of the fast table decoder, as inline functions.
+**
+** decode_fast.c instantiates these for each kind of field (see
+** decode_fast.h), and the code upbc generates from a profile calls them
+** directly with constant field data, so that the offsets and hasbits fold
+** into the code.
+**
+** The definitions in this file are internal to upb.
+*/
+
+#ifndef UPB_DECODE_FAST_INT_H_
+#define UPB_DECODE_FAST_INT_H_
+
+#include <string.h>
+#include "upb/decode_fast.h"
+#include "upb/decode.int.h"
+
+#include "upb/port_def.inc"
+
+#define CHK(x) if (!(x)) { return 0; }
+
+/* Kinds of value handled by the specialized parsers. */
+typedef enum {
+  _UPB_FASTDECODE_B1,
+  _UPB_FASTDECODE_V4,
+  _UPB_FASTDECODE_V8,
+  _UPB_FASTDECODE_Z4,
+  _UPB_FASTDECODE_Z8,
+  _UPB_FASTDECODE_F4,
+  _UPB_FASTDECODE_F8
+} _upb_fastdecode_type;
+
+typedef union {
+  bool b;
+  uint32_t u32;
+  uint64_t u64;
+} _upb_fastdecode_val;
+
+/* Field data accessors, see UPB_FASTDATA(). */
+
+UPB_INLINE uint16_t _upb_fastdecode_ofs(uint64_t data) {
+  return (uint16_t)(data >> 48);
+}
+
+UPB_INLINE uint8_t _upb_fastdecode_hasbit(uint64_t data) {
+  return (uint8_t)(data >> 24);
+}
+
+UPB_INLINE uint8_t _upb_fastdecode_submsgindex(uint64_t data) {
+  return (uint8_t)(data >> 16);
+}
+
+/* The entry's expected tag was XOR'd into |data|, so the low bytes are zero
+ * if and only if the tag on the wire is the one this entry is for. */
+UPB_INLINE bool _upb_fastdecode_tagmatch(uint64_t data, int tagbytes) {
+  return tagbytes == 1 ? (uint8_t)data == 0 : (uint16_t)data == 0;
+}
+
+/* Repeated fields usually have all their elements in a row, so after each
+ * element we check whether the next tag is the same as the one we just
+ * parsed. */
+UPB_INLINE bool _upb_fastdecode_nexttag(upb_decstate *d, int tagbytes) {
+  return d->limit - d->ptr >= tagbytes &&
+         memcmp(d->ptr, d->field_start, tagbytes) == 0;
+}
+
+UPB_INLINE void _upb_fastdecode_sethasbit(char *msg, uint64_t data) {
+  uint8_t hasbit = _upb_fastdecode_hasbit(data);
+  if (hasbit) {
+    msg[hasbit / 8] |= (1 << (hasbit % 8));
+  }
+}
+
+/* Whether the field's hasbit is set, or true if it doesn't have one. */
+UPB_INLINE bool _upb_fastdecode_hasbitset(const char *msg, uint64_t data) {
+  uint8_t hasbit = _upb_fastdecode_hasbit(data);
+  return hasbit == 0 || (msg[hasbit / 8] & (1 << (hasbit % 8))) != 0;
+}
+
+/* Called with d->ptr at the first entry's tag, which a new array gets room
+ * for along with the entries that follow it in a row. */
+UPB_INLINE upb_array *_upb_fastdecode_getarr(upb_decstate *d, char *msg,
+                                             uint64_t data, size_t elem_size) {
+  upb_array **arr = (upb_array**)&msg[_upb_fastdecode_ofs(data)];
+
+  if (!*arr) {
+    size_t entries = _upb_decode_countrun(d->ptr, d->limit);
+    *arr = _upb_array_new(d->arena, entries, elem_size);
+  }
+
+  return *arr;
+}
+
+UPB_INLINE size_t _upb_fastdecode_valsize(_upb_fastdecode_type type) {
+  switch (type) {
+    case _UPB_FASTDECODE_B1:
+      return sizeof(bool);
+    case _UPB_FASTDECODE_V4:
+    case _UPB_FASTDECODE_Z4:
+    case _UPB_FASTDECODE_F4:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+static UPB_FORCEINLINE bool _upb_fastdecode_readval(upb_decstate *d,
+                                                    _upb_fastdecode_val *val,
+                                                    _upb_fastdecode_type type) {
+  uint64_t v;
+
+  switch (type) {
+    case _UPB_FASTDECODE_F4:
+      CHK(d->limit - d->ptr >= 4);
+      memcpy(&val->u32, d->ptr, 4);
+      d->ptr += 4;
+      return true;
+    case _UPB_FASTDECODE_F8:
+      CHK(d->limit - d->ptr >= 8);
+      memcpy(&val->u64, d->ptr, 8);
+      d->ptr += 8;
+      return true;
+    default:
+      break;
+  }
+
+  CHK(_upb_decode_varint(&d->ptr, d->limit, &v));
+
+  switch (type) {
+    case _UPB_FASTDECODE_B1:
+      val->b = v != 0;
+      break;
+    case _UPB_FASTDECODE_V4:
+      val->u32 = (uint32_t)v;
+      break;
+    case _UPB_FASTDECODE_Z4:
+      val->u32 = ((uint32_t)v >> 1) ^ -(int32_t)(v & 1);
+      break;
+    case _UPB_FASTDECODE_Z8:
+      val->u64 = (v >> 1) ^ -(int64_t)(v & 1);
+      break;
+    default:
+      val->u64 = v;
+      break;
+  }
+
+  return true;
+}
+
+static UPB_FORCEINLINE bool _upb_fastdecode_scalar(upb_decstate *d, char *msg,
+                                                   const upb_msglayout *l,
+                                                   uint64_t data, int tagbytes,
+                                                   _upb_fastdecode_type type,
+                                                   bool repeated) {
+  size_t size = _upb_fastdecode_valsize(type);
+  upb_array *arr = NULL;
+  _upb_fastdecode_val val;
+
+  if (UPB_UNLIKELY(!_upb_fastdecode_tagmatch(data, tagbytes))) {
+    return _upb_decode_field(d, msg, l);
+  }
+
+  if (repeated) {
+    arr = _upb_fastdecode_getarr(d, msg, data, size);
+    CHK(arr);
+  }
+
+  do {
+    d->field_start = d->ptr;
+    d->ptr += tagbytes;
+    CHK(_upb_fastdecode_readval(d, &val, type));
+    if (repeated) {
+      CHK(upb_array_add(arr, 1, size, &val, d->arena));
+    } else {
+      memcpy(&msg[_upb_fastdecode_ofs(data)], &val, size);
+      _upb_fastdecode_sethasbit(msg, data);
+    }
+  } while (repeated && _upb_fastdecode_nexttag(d, tagbytes));
+
+  return true;
+}
+
+static UPB_FORCEINLINE bool _upb_fastdecode_readlen(upb_decstate *d, int *len) {
+  uint64_t v;
+  CHK(_upb_decode_varint(&d->ptr, d->limit, &v) &&
+      v < INT32_MAX && (int64_t)v <= d->limit - d->ptr);
+  *len = (int)v;
+  return true;
+}
+
+static UPB_FORCEINLINE bool _upb_fastdecode_string(upb_decstate *d, char *msg,
+                                                   const upb_msglayout *l,
+                                                   uint64_t data, int tagbytes,
+                                                   bool repeated) {
+  upb_array *arr = NULL;
+  upb_strview str;
+  int len;
+
+  if (UPB_UNLIKELY(!_upb_fastdecode_tagmatch(data, tagbytes))) {
+    return _upb_decode_field(d, msg, l);
+  }
+
+  if (repeated) {
+    arr = _upb_fastdecode_getarr(d, msg, data, sizeof(str));
+    CHK(arr);
+  }
+
+  do {
+    d->field_start = d->ptr;
+    d->ptr += tagbytes;
+    CHK(_upb_fastdecode_readlen(d, &len));
+    CHK(_upb_decode_str(d, len, &str));
+    if (repeated) {
+      CHK(upb_array_add(arr, 1, sizeof(str), &str, d->arena));
+    } else {
+      memcpy(&msg[_upb_fastdecode_ofs(data)], &str, sizeof(str));
+      _upb_fastdecode_sethasbit(msg, data);
+    }
+  } while (repeated && _upb_fastdecode_nexttag(d, tagbytes));
+
+  return true;
+}
+
+static UPB_FORCEINLINE bool _upb_fastdecode_submsg(upb_decstate *d, char *msg,
+                                                   const upb_msglayout *l,
+                                                   uint64_t data, int tagbytes,
+                                                   bool repeated) {
+  const upb_msglayout *subl = l->submsgs[_upb_fastdecode_submsgindex(data)];
+  upb_array *arr = NULL;
+  upb_msg *submsg;
+  int len;
+
+  if (UPB_UNLIKELY(!_upb_fastdecode_tagmatch(data, tagbytes))) {
+    return _upb_decode_field(d, msg, l);
+  }
+
+  if (repeated) {
+    arr = _upb_fastdecode_getarr(d, msg, data, sizeof(submsg));
+    CHK(arr);
+  }
+
+  do {
+    d->field_start = d->ptr;
+    d->ptr += tagbytes;
+    CHK(_upb_fastdecode_readlen(d, &len));
+    if (repeated) {
+      submsg = upb_msg_new(subl, d->arena);
+      CHK(submsg);
+      CHK(upb_array_add(arr, 1, sizeof(submsg), &submsg, d->arena));
+    } else {
+      upb_msg **field = (upb_msg**)&msg[_upb_fastdecode_ofs(data)];
+      if (!_upb_fastdecode_hasbitset(msg, data) || !*field) {
+        *field = upb_msg_new(subl, d->arena);
+        CHK(*field);
+      }
+      submsg = *field;
+      _upb_fastdecode_sethasbit(msg, data);
+    }
+    CHK(_upb_decode_msgfield(d, submsg, subl, len));
+  } while (repeated && _upb_fastdecode_nexttag(d, tagbytes));
+
+  return true;
+}
+
+/* Sets |tag| to the next two bytes of input, first byte in the low bits, and
+ * returns true, unless the message or group being parsed has ended. */
+static UPB_FORCEINLINE bool _upb_fastdecode_peektag(upb_decstate *d,
+                                                    uint64_t *tag) {
+  if (d->ptr >= d->limit || d->end_group != 0) return false;
+
+  *tag = (uint8_t)d->ptr[0];
+  if (d->limit - d->ptr > 1) {
+    *tag |= (uint64_t)(uint8_t)d->ptr[1] << 8;
+  }
+
+  return true;
+}
+
+#undef CHK
+
+#include "upb/port_undef.inc"
+
+#endif  /* UPB_DECODE_FAST_INT_H_ */
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "google/protobuf/descriptor.upb.h"
+#include "upb/varint_decode.int.h"
 
 #include "upb/port_def.inc"
 
@@ -111,8 +112,29 @@ struct upb_symtab {
   upb_arena *arena;
   upb_strtable syms;  /* full_name -> packed def ptr */
   upb_strtable files;  /* file_name -> upb_filedef* */
+
+  /* Files added with upb_symtab_addfile_lazy(), which are built on first use.
+   * A name stays in these tables once its file is built, but is found in the
+   * tables above first. */
+  upb_strtable lazy_syms;  /* full_name -> lazyfile* */
+  upb_strtable lazy_files;  /* file_name -> lazyfile* */
 };
 
+typedef enum {
+  LAZY_PENDING,
+  LAZY_BUILDING,
+  LAZY_BUILT,
+  LAZY_FAILED
+} lazystate;
+
+typedef struct {
+  const char *buf;  /* Serialized FileDescriptorProto, owned by the caller. */
+  size_t size;
+  lazystate state;
+} lazyfile;
+
+static bool symtab_buildlazy(upb_symtab *s, lazyfile *lf, upb_status *status);
+
 /* Inside a symtab we store tagged pointers to specific def types. */
 typedef enum {
   UPB_DEFTYPE_MSG = 0,
@@ -216,9 +238,27 @@ static uint32_t upb_handlers_selectorbaseoffset(const upb_fielddef *f) {
   return upb_fielddef_isseq(f) ? 2 : 0;
 }
 
+/* Warning: also in upb/handlers.c. */
+static bool upb_handlers_isfixedwidth(const upb_fielddef *f) {
+  switch (upb_fielddef_descriptortype(f)) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      return true;
+    default:
+      return false;
+  }
+}
+
 static uint32_t upb_handlers_selectorcount(const upb_fielddef *f) {
   uint32_t ret = 1;
   if (upb_fielddef_isseq(f)) ret += 2;    /* STARTSEQ/ENDSEQ */
+  if (upb_fielddef_isseq(f) && upb_handlers_isfixedwidth(f)) {
+    ret += 1;  /* BULK */
+  }
   if (upb_fielddef_isstring(f)) ret += 2; /* [STRING]/STARTSTR/ENDSTR */
   if (upb_fielddef_issubmsg(f)) {
     /* ENDSUBMSG (STARTSUBMSG is at table beginning) */
@@ -833,8 +873,10 @@ typedef struct {
   const upb_symtab *symtab;
   upb_filedef *file;  /* File we are building. */
   upb_alloc *alloc;    /* Allocate defs here. */
-  upb_alloc *tmp;      /* Alloc for addtab and any other tmp data. */
+  upb_alloc *tmp;      /* Alloc for addtab and any other tmp data, including
+                        * the defs' tables until freeze_tables(). */
   upb_strtable *addtab;  /* full_name -> packed def ptr for new defs. */
+  const lazyfile *lazy;  /* The lazily added file being built, if any. */
   upb_status *status;  /* Record errors here. */
 } symtab_addctx;
 
@@ -869,21 +911,27 @@ static const char *makefullname(const symtab_addctx *ctx, const char *prefix,
 
 static bool symtab_add(const symtab_addctx *ctx, const char *name,
                        upb_value v) {
-  upb_value tmp;
-  if (upb_strtable_lookup(ctx->addtab, name, &tmp) ||
-      upb_strtable_lookup(&ctx->symtab->syms, name, &tmp)) {
+  size_t len = strlen(name);
+  uint64_t hash = upb_strhash(name, len);
+  upb_value lazy;
+  if (upb_strtable_lookup_hashed(ctx->addtab, name, len, hash, NULL) ||
+      upb_strtable_lookup_hashed(&ctx->symtab->syms, name, len, hash, NULL) ||
+      (upb_strtable_lookup_hashed(&ctx->symtab->lazy_syms, name, len, hash,
+                                  &lazy) &&
+       upb_value_getptr(lazy) != ctx->lazy)) {
     upb_status_seterrf(ctx->status, "duplicate symbol '%s'", name);
     return false;
   }
 
-  CHK_OOM(upb_strtable_insert3(ctx->addtab, name, strlen(name), v, ctx->tmp));
+  CHK_OOM(upb_strtable_insert3(ctx->addtab, name, len, v, ctx->tmp));
   return true;
 }
 
 /* Given a symbol and the base symbol inside which it is defined, find the
- * symbol's definition in t. */
+ * symbol's definition in t.  |hash| is the upb_strhash() of an absolute
+ * symbol without its leading '.'. */
 static bool resolvename(const upb_strtable *t, const upb_fielddef *f,
-                        const char *base, upb_strview sym,
+                        const char *base, upb_strview sym, uint64_t hash,
                         upb_deftype_t type, upb_status *status,
                         const void **def) {
   if(sym.size == 0) return NULL;
@@ -891,7 +939,7 @@ static bool resolvename(const upb_strtable *t, const upb_fielddef *f,
     /* Symbols starting with '.' are absolute, so we do a single lookup.
      * Slice to omit the leading '.' */
     upb_value v;
-    if (!upb_strtable_lookup2(t, sym.data + 1, sym.size - 1, &v)) {
+    if (!upb_strtable_lookup_hashed(t, sym.data + 1, sym.size - 1, hash, &v)) {
       return false;
     }
 
@@ -918,8 +966,10 @@ const void *symtab_resolve(const symtab_addctx *ctx, const upb_fielddef *f,
                            const char *base, upb_strview sym,
                            upb_deftype_t type) {
   const void *ret;
-  if (!resolvename(ctx->addtab, f, base, sym, type, ctx->status, &ret) &&
-      !resolvename(&ctx->symtab->syms, f, base, sym, type, ctx->status, &ret)) {
+  uint64_t hash = sym.size > 0 ? upb_strhash(sym.data + 1, sym.size - 1) : 0;
+  if (!resolvename(ctx->addtab, f, base, sym, hash, type, ctx->status, &ret) &&
+      !resolvename(&ctx->symtab->syms, f, base, sym, hash, type, ctx->status,
+                   &ret)) {
     if (upb_ok(ctx->status)) {
       upb_status_seterrf(ctx->status, "couldn't resolve name '%s'", sym.data);
     }
@@ -941,10 +991,10 @@ static bool create_oneofdef(
 
   v = pack_def(o, UPB_DEFTYPE_ONEOF);
   CHK_OOM(symtab_add(ctx, o->full_name, v));
-  CHK_OOM(upb_strtable_insert3(&m->ntof, name.data, name.size, v, ctx->alloc));
+  CHK_OOM(upb_strtable_insert3(&m->ntof, name.data, name.size, v, ctx->tmp));
 
-  CHK_OOM(upb_inttable_init2(&o->itof, UPB_CTYPE_CONSTPTR, ctx->alloc));
-  CHK_OOM(upb_strtable_init2(&o->ntof, UPB_CTYPE_CONSTPTR, ctx->alloc));
+  CHK_OOM(upb_inttable_init2(&o->itof, UPB_CTYPE_CONSTPTR, ctx->tmp));
+  CHK_OOM(upb_strtable_init2(&o->ntof, UPB_CTYPE_CONSTPTR, ctx->tmp));
 
   return true;
 }
@@ -1075,7 +1125,6 @@ static void set_default_default(const symtab_addctx *ctx, upb_fielddef *f) {
 static bool create_fielddef(
     const symtab_addctx *ctx, const char *prefix, upb_msgdef *m,
     const google_protobuf_FieldDescriptorProto *field_proto) {
-  upb_alloc *alloc = ctx->alloc;
   upb_fielddef *f;
   const google_protobuf_FieldOptions *options;
   upb_strview name;
@@ -1111,12 +1160,13 @@ static bool create_fielddef(
     packed_v = pack_def(f, UPB_DEFTYPE_FIELD);
     v = upb_value_constptr(f);
 
-    if (!upb_strtable_insert3(&m->ntof, name.data, name.size, packed_v, alloc)) {
+    if (!upb_strtable_insert3(&m->ntof, name.data, name.size, packed_v,
+                              ctx->tmp)) {
       upb_status_seterrf(ctx->status, "duplicate field name (%s)", shortname);
       return false;
     }
 
-    if (!upb_inttable_insert2(&m->itof, field_number, v, alloc)) {
+    if (!upb_inttable_insert2(&m->itof, field_number, v, ctx->tmp)) {
       upb_status_seterrf(ctx->status, "duplicate field number (%u)",
                          field_number);
       return false;
@@ -1175,8 +1225,8 @@ static bool create_fielddef(
     oneof = (upb_oneofdef*)&m->oneofs[oneof_index];
     f->oneof = oneof;
 
-    CHK(upb_inttable_insert2(&oneof->itof, f->number_, v, alloc));
-    CHK(upb_strtable_insert3(&oneof->ntof, name.data, name.size, v, alloc));
+    CHK(upb_inttable_insert2(&oneof->itof, f->number_, v, ctx->tmp));
+    CHK(upb_strtable_insert3(&oneof->ntof, name.data, name.size, v, ctx->tmp));
   } else {
     f->oneof = NULL;
   }
@@ -1208,8 +1258,8 @@ static bool create_enumdef(
   e->full_name = makefullname(ctx, prefix, name);
   CHK_OOM(symtab_add(ctx, e->full_name, pack_def(e, UPB_DEFTYPE_ENUM)));
 
-  CHK_OOM(upb_strtable_init2(&e->ntoi, UPB_CTYPE_INT32, ctx->alloc));
-  CHK_OOM(upb_inttable_init2(&e->iton, UPB_CTYPE_CSTR, ctx->alloc));
+  CHK_OOM(upb_strtable_init2(&e->ntoi, UPB_CTYPE_INT32, ctx->tmp));
+  CHK_OOM(upb_inttable_init2(&e->iton, UPB_CTYPE_CSTR, ctx->tmp));
 
   e->file = ctx->file;
   e->defaultval = 0;
@@ -1244,15 +1294,15 @@ static bool create_enumdef(
 
     CHK_OOM(name2)
     CHK_OOM(
-        upb_strtable_insert3(&e->ntoi, name2, strlen(name2), v, ctx->alloc));
+        upb_strtable_insert3(&e->ntoi, name2, strlen(name2), v, ctx->tmp));
 
     if (!upb_inttable_lookup(&e->iton, num, NULL)) {
       upb_value v = upb_value_cstr(name2);
-      CHK_OOM(upb_inttable_insert2(&e->iton, num, v, ctx->alloc));
+      CHK_OOM(upb_inttable_insert2(&e->iton, num, v, ctx->tmp));
     }
   }
 
-  upb_inttable_compact2(&e->iton, ctx->alloc);
+  upb_inttable_compact2(&e->iton, ctx->tmp);
 
   return true;
 }
@@ -1275,8 +1325,8 @@ static bool create_msgdef(const symtab_addctx *ctx, const char *prefix,
   m->full_name = makefullname(ctx, prefix, name);
   CHK_OOM(symtab_add(ctx, m->full_name, pack_def(m, UPB_DEFTYPE_MSG)));
 
-  CHK_OOM(upb_inttable_init2(&m->itof, UPB_CTYPE_CONSTPTR, ctx->alloc));
-  CHK_OOM(upb_strtable_init2(&m->ntof, UPB_CTYPE_CONSTPTR, ctx->alloc));
+  CHK_OOM(upb_inttable_init2(&m->itof, UPB_CTYPE_CONSTPTR, ctx->tmp));
+  CHK_OOM(upb_strtable_init2(&m->ntof, UPB_CTYPE_CONSTPTR, ctx->tmp));
 
   m->file = ctx->file;
   m->map_entry = false;
@@ -1303,7 +1353,7 @@ static bool create_msgdef(const symtab_addctx *ctx, const char *prefix,
 
   CHK(assign_msg_indices(m, ctx->status));
   assign_msg_wellknowntype(m);
-  upb_inttable_compact2(&m->itof, ctx->alloc);
+  upb_inttable_compact2(&m->itof, ctx->tmp);
 
   /* This message is built.  Now build nested messages and enums. */
 
@@ -1563,6 +1613,33 @@ static bool build_filedef(
   return true;
  }
 
+/* Moves the tables of the new defs out of the temporary arena, packing each
+ * one into a single block of the symtab's arena. */
+static bool freeze_tables(const symtab_addctx *ctx) {
+  const upb_filedef *file = ctx->file;
+  int i, j;
+
+  for (i = 0; i < file->msg_count; i++) {
+    upb_msgdef *m = (upb_msgdef*)&file->msgs[i];
+    CHK_OOM(upb_inttable_freeze(&m->itof, ctx->tmp, ctx->alloc));
+    CHK_OOM(upb_strtable_freeze(&m->ntof, ctx->tmp, ctx->alloc));
+    for (j = 0; j < m->oneof_count; j++) {
+      upb_oneofdef *o = (upb_oneofdef*)&m->oneofs[j];
+      upb_inttable_compact2(&o->itof, ctx->tmp);
+      CHK_OOM(upb_inttable_freeze(&o->itof, ctx->tmp, ctx->alloc));
+      CHK_OOM(upb_strtable_freeze(&o->ntof, ctx->tmp, ctx->alloc));
+    }
+  }
+
+  for (i = 0; i < file->enum_count; i++) {
+    upb_enumdef *e = (upb_enumdef*)&file->enums[i];
+    CHK_OOM(upb_strtable_freeze(&e->ntoi, ctx->tmp, ctx->alloc));
+    CHK_OOM(upb_inttable_freeze(&e->iton, ctx->tmp, ctx->alloc));
+  }
+
+  return true;
+}
+
 static bool upb_symtab_addtotabs(upb_symtab *s, symtab_addctx *ctx,
                                  upb_status *status) {
   const upb_filedef *file = ctx->file;
@@ -1646,7 +1723,9 @@ upb_symtab *upb_symtab_new(void) {
   alloc = upb_arena_alloc(s->arena);
 
   if (!upb_strtable_init2(&s->syms, UPB_CTYPE_CONSTPTR, alloc) ||
-      !upb_strtable_init2(&s->files, UPB_CTYPE_CONSTPTR, alloc)) {
+      !upb_strtable_init2(&s->files, UPB_CTYPE_CONSTPTR, alloc) ||
+      !upb_strtable_init2(&s->lazy_syms, UPB_CTYPE_PTR, alloc) ||
+      !upb_strtable_init2(&s->lazy_files, UPB_CTYPE_PTR, alloc)) {
     upb_arena_free(s->arena);
     upb_gfree(s);
     s = NULL;
@@ -1654,57 +1733,346 @@ upb_symtab *upb_symtab_new(void) {
   return s;
 }
 
+/* Looks |key| up in |t|, or, failing that, builds the file that |lazy| says
+ * defines it and looks again.  Building a lazily added file changes |s|, but
+ * not what callers of the const lookup functions can observe. */
+static bool symtab_lookup(const upb_symtab *s, const upb_strtable *t,
+                          const upb_strtable *lazy, const char *key,
+                          size_t len, upb_value *v) {
+  uint64_t hash = upb_strhash(key, len);
+  upb_value lf;
+  upb_status status;
+
+  if (upb_strtable_lookup_hashed(t, key, len, hash, v)) return true;
+  if (!upb_strtable_lookup_hashed(lazy, key, len, hash, &lf) ||
+      !symtab_buildlazy((upb_symtab*)s, upb_value_getptr(lf), &status)) {
+    return false;
+  }
+  return upb_strtable_lookup_hashed(t, key, len, hash, v);
+}
+
 const upb_msgdef *upb_symtab_lookupmsg(const upb_symtab *s, const char *sym) {
-  upb_value v;
-  return upb_strtable_lookup(&s->syms, sym, &v) ?
-      unpack_def(v, UPB_DEFTYPE_MSG) : NULL;
+  return upb_symtab_lookupmsg2(s, sym, strlen(sym));
 }
 
 const upb_msgdef *upb_symtab_lookupmsg2(const upb_symtab *s, const char *sym,
                                         size_t len) {
   upb_value v;
-  return upb_strtable_lookup2(&s->syms, sym, len, &v) ?
+  return symtab_lookup(s, &s->syms, &s->lazy_syms, sym, len, &v) ?
       unpack_def(v, UPB_DEFTYPE_MSG) : NULL;
 }
 
 const upb_enumdef *upb_symtab_lookupenum(const upb_symtab *s, const char *sym) {
   upb_value v;
-  return upb_strtable_lookup(&s->syms, sym, &v) ?
+  return symtab_lookup(s, &s->syms, &s->lazy_syms, sym, strlen(sym), &v) ?
       unpack_def(v, UPB_DEFTYPE_ENUM) : NULL;
 }
 
 const upb_filedef *upb_symtab_lookupfile(const upb_symtab *s, const char *name) {
   upb_value v;
-  return upb_strtable_lookup(&s->files, name, &v) ? upb_value_getconstptr(v)
-                                                  : NULL;
+  return symtab_lookup(s, &s->files, &s->lazy_files, name, strlen(name), &v) ?
+      upb_value_getconstptr(v) : NULL;
 }
 
-const upb_filedef *upb_symtab_addfile(
+static const upb_filedef *symtab_addfile(
     upb_symtab *s, const google_protobuf_FileDescriptorProto *file_proto,
-    upb_status *status) {
-  upb_arena *tmparena = upb_arena_new();
+    const lazyfile *lazy, upb_status *status) {
+  upb_arena *tmparena;
   upb_strtable addtab;
   upb_alloc *alloc = upb_arena_alloc(s->arena);
-  upb_filedef *file = upb_malloc(alloc, sizeof(*file));
+  upb_filedef *file;
+  const upb_strview *deps;
+  size_t i, n;
   bool ok;
   symtab_addctx ctx;
 
+  /* Lazily added dependencies are built first.  If one fails to build, this
+   * file fails below for depending on a file that isn't loaded. */
+  deps = google_protobuf_FileDescriptorProto_dependency(file_proto, &n);
+  for (i = 0; i < n; i++) {
+    upb_value v;
+    if (!upb_strtable_lookup2(&s->files, deps[i].data, deps[i].size, NULL) &&
+        upb_strtable_lookup2(&s->lazy_files, deps[i].data, deps[i].size, &v)) {
+      symtab_buildlazy(s, upb_value_getptr(v), status);
+      upb_status_clear(status);
+    }
+  }
+
+  tmparena = upb_arena_new();
+  file = upb_malloc(alloc, sizeof(*file));
   ctx.file = file;
   ctx.symtab = s;
   ctx.alloc = alloc;
   ctx.tmp = upb_arena_alloc(tmparena);
   ctx.addtab = &addtab;
+  ctx.lazy = lazy;
   ctx.status = status;
 
   ok = file &&
       upb_strtable_init2(&addtab, UPB_CTYPE_CONSTPTR, ctx.tmp) &&
       build_filedef(&ctx, file, file_proto) &&
+      freeze_tables(&ctx) &&
       upb_symtab_addtotabs(s, &ctx, status);
 
   upb_arena_free(tmparena);
   return ok ? file : NULL;
 }
 
+const upb_filedef *upb_symtab_addfile(
+    upb_symtab *s, const google_protobuf_FileDescriptorProto *file_proto,
+    upb_status *status) {
+  return symtab_addfile(s, file_proto, NULL, status);
+}
+
+/* Lazily added files *********************************************************/
+
+typedef struct {
+  upb_symtab *symtab;
+  lazyfile *file;
+  upb_alloc *tmp;
+  upb_strtable *names;  /* The file's symbols, to add to lazy_syms at the end. */
+  upb_status *status;
+} lazy_indexctx;
+
+/* Records the symbol |prefix|.|name|, and returns its full name (allocated from
+ * ctx->tmp) or NULL on error. */
+static const char *lazy_addname(lazy_indexctx *ctx, const char *prefix,
+                                upb_strview name) {
+  size_t n = prefix ? strlen(prefix) + 1 : 0;
+  char *full = upb_malloc(ctx->tmp, n + name.size + 1);
+  size_t len = n + name.size;
+
+  if (!full) {
+    upb_status_setoom(ctx->status);
+    return NULL;
+  }
+  if (prefix) {
+    memcpy(full, prefix, n - 1);
+    full[n - 1] = '.';
+  }
+  memcpy(full + n, name.data, name.size);
+  full[len] = '\0';
+
+  if (upb_strtable_lookup2(ctx->names, full, len, NULL) ||
+      upb_strtable_lookup2(&ctx->symtab->syms, full, len, NULL) ||
+      upb_strtable_lookup2(&ctx->symtab->lazy_syms, full, len, NULL)) {
+    upb_status_seterrf(ctx->status, "duplicate symbol '%s'", full);
+    return NULL;
+  }
+  if (!upb_strtable_insert3(ctx->names, full, len, upb_value_ptr(ctx->file),
+                            ctx->tmp)) {
+    upb_status_setoom(ctx->status);
+    return NULL;
+  }
+  return full;
+}
+
+static bool lazy_indexenums(
+    lazy_indexctx *ctx, const char *prefix,
+    const google_protobuf_EnumDescriptorProto *const *enums, size_t n) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    upb_strview name = google_protobuf_EnumDescriptorProto_name(enums[i]);
+    if (!lazy_addname(ctx, prefix, name)) return false;
+  }
+  return true;
+}
+
+static bool lazy_indexmsgs(
+    lazy_indexctx *ctx, const char *prefix,
+    const google_protobuf_DescriptorProto *const *msgs, size_t n) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    const google_protobuf_DescriptorProto *msg = msgs[i];
+    const google_protobuf_DescriptorProto *const *nested;
+    const google_protobuf_EnumDescriptorProto *const *enums;
+    size_t nested_count, enum_count;
+    const char *full = lazy_addname(
+        ctx, prefix, google_protobuf_DescriptorProto_name(msg));
+
+    if (!full) return false;
+    nested = google_protobuf_DescriptorProto_nested_type(msg, &nested_count);
+    enums = google_protobuf_DescriptorProto_enum_type(msg, &enum_count);
+    if (!lazy_indexmsgs(ctx, full, nested, nested_count) ||
+        !lazy_indexenums(ctx, full, enums, enum_count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upb_symtab_addfile_lazy(upb_symtab *s, const char *buf, size_t size,
+                             upb_status *status) {
+  upb_arena *tmparena = upb_arena_new();
+  upb_alloc *alloc = upb_arena_alloc(s->arena);
+  const google_protobuf_FileDescriptorProto *file_proto;
+  const google_protobuf_DescriptorProto *const *msgs;
+  const google_protobuf_EnumDescriptorProto *const *enums;
+  upb_strtable names;
+  upb_strtable_iter iter;
+  lazy_indexctx ctx;
+  const char *package = NULL;
+  upb_strview name;
+  size_t n;
+  bool ok = false;
+
+  ctx.symtab = s;
+  ctx.file = upb_malloc(alloc, sizeof(*ctx.file));
+  ctx.tmp = upb_arena_alloc(tmparena);
+  ctx.names = &names;
+  ctx.status = status;
+
+  if (!ctx.file || !upb_strtable_init2(&names, UPB_CTYPE_PTR, ctx.tmp)) {
+    upb_status_setoom(status);
+    goto done;
+  }
+
+  ctx.file->buf = buf;
+  ctx.file->size = size;
+  ctx.file->state = LAZY_PENDING;
+
+  file_proto = google_protobuf_FileDescriptorProto_parse(buf, size, tmparena);
+  if (!file_proto) {
+    upb_status_seterrmsg(status, "Failed to parse FileDescriptorProto");
+    goto done;
+  }
+
+  if (!google_protobuf_FileDescriptorProto_has_name(file_proto)) {
+    upb_status_seterrmsg(status, "File has no name");
+    goto done;
+  }
+
+  name = google_protobuf_FileDescriptorProto_name(file_proto);
+  if (upb_strtable_lookup2(&s->files, name.data, name.size, NULL) ||
+      upb_strtable_lookup2(&s->lazy_files, name.data, name.size, NULL)) {
+    upb_status_seterrf(status, "duplicate file name '" UPB_STRVIEW_FORMAT "'",
+                       UPB_STRVIEW_ARGS(name));
+    goto done;
+  }
+
+  if (google_protobuf_FileDescriptorProto_has_package(file_proto)) {
+    upb_strview pkg = google_protobuf_FileDescriptorProto_package(file_proto);
+    char *p = upb_strdup2(pkg.data, pkg.size, ctx.tmp);
+    if (!p) {
+      upb_status_setoom(status);
+      goto done;
+    }
+    package = p;
+  }
+
+  msgs = google_protobuf_FileDescriptorProto_message_type(file_proto, &n);
+  if (!lazy_indexmsgs(&ctx, package, msgs, n)) goto done;
+  enums = google_protobuf_FileDescriptorProto_enum_type(file_proto, &n);
+  if (!lazy_indexenums(&ctx, package, enums, n)) goto done;
+
+  if (!upb_strtable_insert3(&s->lazy_files, name.data, name.size,
+                            upb_value_ptr(ctx.file), alloc)) {
+    upb_status_setoom(status);
+    goto done;
+  }
+
+  upb_strtable_begin(&iter, &names);
+  for (; !upb_strtable_done(&iter); upb_strtable_next(&iter)) {
+    if (!upb_strtable_insert3(&s->lazy_syms, upb_strtable_iter_key(&iter),
+                              upb_strtable_iter_keylength(&iter),
+                              upb_strtable_iter_value(&iter), alloc)) {
+      upb_status_setoom(status);
+      goto done;
+    }
+  }
+
+  ok = true;
+
+done:
+  upb_arena_free(tmparena);
+  return ok;
+}
+
+bool upb_symtab_addset_lazy(upb_symtab *s, const char *buf, size_t size,
+                            upb_status *status) {
+  /* A FileDescriptorSet is nothing but "repeated FileDescriptorProto file = 1",
+   * so each file's bytes can be found without parsing the set. */
+  const char *p = buf;
+  const char *end = buf + size;
+
+  while (p < end) {
+    uint64_t tag, len;
+    p = _upb_vdecode_slow(p, end, &tag);
+    if (!p || tag != ((1 << 3) | UPB_WIRE_TYPE_DELIMITED)) goto err;
+    p = _upb_vdecode_slow(p, end, &len);
+    if (!p || len > (size_t)(end - p)) goto err;
+    if (!upb_symtab_addfile_lazy(s, p, len, status)) return false;
+    p += len;
+  }
+
+  return true;
+
+err:
+  upb_status_seterrmsg(status, "Failed to parse FileDescriptorSet");
+  return false;
+}
+
+static bool symtab_buildlazy(upb_symtab *s, lazyfile *lf, upb_status *status) {
+  upb_arena *arena;
+  const google_protobuf_FileDescriptorProto *file_proto;
+
+  upb_status_clear(status);
+  if (lf->state == LAZY_BUILT) return true;
+  if (lf->state != LAZY_PENDING) {
+    upb_status_seterrmsg(status, lf->state == LAZY_BUILDING ?
+        "Lazily added files depend on each other in a cycle" :
+        "Lazily added file failed to build");
+    return false;
+  }
+
+  lf->state = LAZY_BUILDING;
+  arena = upb_arena_new();
+  file_proto = google_protobuf_FileDescriptorProto_parse(lf->buf, lf->size,
+                                                         arena);
+  if (!file_proto) {
+    upb_status_seterrmsg(status, "Failed to parse FileDescriptorProto");
+  }
+  lf->state = file_proto && symtab_addfile(s, file_proto, lf, status) ?
+      LAZY_BUILT : LAZY_FAILED;
+  upb_arena_free(arena);
+
+  return lf->state == LAZY_BUILT;
+}
+
+bool upb_symtab_buildall(upb_symtab *s, upb_status *status) {
+  upb_strtable_iter i;
+  bool ok = true;
+
+  for (upb_strtable_begin(&i, &s->lazy_files); !upb_strtable_done(&i);
+       upb_strtable_next(&i)) {
+    lazyfile *lf = upb_value_getptr(upb_strtable_iter_value(&i));
+    if (lf->state == LAZY_BUILT) continue;
+    if (ok) {
+      ok = symtab_buildlazy(s, lf, status);
+    } else {
+      /* Keep the first error, but build everything that can be built. */
+      upb_status tmp;
+      symtab_buildlazy(s, lf, &tmp);
+    }
+  }
+
+  return ok;
+}
+
+void upb_symtab_begin(upb_symtab_iter *iter, const upb_symtab *s) {
+  upb_strtable_begin(iter, &s->files);
+}
+
+void upb_symtab_next(upb_symtab_iter *iter) { upb_strtable_next(iter); }
+
+bool upb_symtab_done(const upb_symtab_iter *iter) {
+  return upb_strtable_done(iter);
+}
+
+const upb_filedef *upb_symtab_iter_file(const upb_symtab_iter *iter) {
+  return upb_value_getconstptr(upb_strtable_iter_value(iter));
+}
+
 /* Include here since we want most of this file to be stdio-free. */
 #include <stdio.h>
 
@@ -1718,7 +2086,7 @@ bool _upb_symtab_loaddefinit(upb_symtab *s, const upb_def_init *init) {
 
   upb_status_clear(&status);
 
-  if (upb_strtable_lookup(&s->files, init->filename, NULL)) {
+  if (upb_symtab_lookupfile(s, init->filename)) {
     return true;
   }
 
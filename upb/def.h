@@ -849,6 +849,38 @@ const upb_filedef *upb_symtab_addfile(
     upb_symtab *s, const google_protobuf_FileDescriptorProto *file,
     upb_status *status);
 
+/* Adds a serialized FileDescriptorProto without building its defs.  Only the
+ * names of its messages and enums are indexed now; the file is built, after
+ * any lazily added files it depends on, when one of them or the file itself
+ * is first looked up.  Errors found at that point make the lookup return NULL.
+ *
+ * |buf| is not copied and must outlive the symtab.  Since lookups may then
+ * build defs, a symtab with lazily added files must not be used from several
+ * threads at once until upb_symtab_buildall() has been called. */
+bool upb_symtab_addfile_lazy(upb_symtab *s, const char *buf, size_t size,
+                             upb_status *status);
+
+/* Like upb_symtab_addfile_lazy() for each file of a serialized
+ * FileDescriptorSet, which may list them in any order.  Files before one that
+ * fails to be added stay added. */
+bool upb_symtab_addset_lazy(upb_symtab *s, const char *buf, size_t size,
+                            upb_status *status);
+
+/* Builds every lazily added file that hasn't been built yet, returning false
+ * with the first error if any of them fails.  Afterwards lookups never change
+ * the symtab, so once nothing more is added it may be shared by any number of
+ * threads. */
+bool upb_symtab_buildall(upb_symtab *s, upb_status *status);
+
+/* Iteration over the files that have been built, in no particular order.
+ * Lazily added files appear once they have been built. */
+typedef upb_strtable_iter upb_symtab_iter;
+
+void upb_symtab_begin(upb_symtab_iter *iter, const upb_symtab *s);
+void upb_symtab_next(upb_symtab_iter *iter);
+bool upb_symtab_done(const upb_symtab_iter *iter);
+const upb_filedef *upb_symtab_iter_file(const upb_symtab_iter *iter);
+
 /* For generated code only: loads a generated descriptor. */
 typedef struct upb_def_init {
   struct upb_def_init **deps;
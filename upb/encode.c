@@ -1,38 +1,19 @@
-/* We encode backwards, to avoid pre-computing lengths (one-pass encode). */
+/* By default we encode backwards, to avoid pre-computing lengths (one-pass
+ * encode).  UPB_ENCODE_FORWARD computes the lengths first instead, see below. */
 
-#include "upb/encode.h"
+#include "upb/encode.int.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "upb/msg.h"
+#include "upb/stats.h"
 #include "upb/upb.h"
 
 #include "upb/port_def.inc"
 
-#define UPB_PB_VARINT_MAX_LEN 10
 #define CHK(x) do { if (!(x)) { return false; } } while(0)
 
-static size_t upb_encode_varint(uint64_t val, char *buf) {
-  size_t i;
-  if (val < 128) { buf[0] = val; return 1; }
-  i = 0;
-  while (val) {
-    uint8_t byte = val & 0x7fU;
-    val >>= 7;
-    if (val) byte |= 0x80U;
-    buf[i++] = byte;
-  }
-  return i;
-}
-
-static uint32_t upb_zzencode_32(int32_t n) { return ((uint32_t)n << 1) ^ (n >> 31); }
-static uint64_t upb_zzencode_64(int64_t n) { return ((uint64_t)n << 1) ^ (n >> 63); }
-
-typedef struct {
-  upb_alloc *alloc;
-  char *buf, *ptr, *limit;
-} upb_encstate;
-
 static size_t upb_roundup_pow2(size_t bytes) {
   size_t ret = 128;
   while (ret < bytes) {
@@ -41,11 +22,12 @@ static size_t upb_roundup_pow2(size_t bytes) {
   return ret;
 }
 
-static bool upb_encode_growbuffer(upb_encstate *e, size_t bytes) {
+bool _upb_encode_growbuffer(upb_encstate *e, size_t bytes) {
   size_t old_size = e->limit - e->buf;
   size_t new_size = upb_roundup_pow2(bytes + (e->limit - e->ptr));
   char *new_buf = upb_realloc(e->alloc, e->buf, old_size, new_size);
   CHK(new_buf);
+  _UPB_STATS_ADD(encode_buffer_grows, 1);
 
   /* We want previous data at the end, realloc() put it at the beginning. */
   if (old_size > 0) {
@@ -58,83 +40,123 @@ static bool upb_encode_growbuffer(upb_encstate *e, size_t bytes) {
   return true;
 }
 
-/* Call to ensure that at least "bytes" bytes are available for writing at
- * e->ptr.  Returns false if the bytes could not be allocated. */
-static bool upb_encode_reserve(upb_encstate *e, size_t bytes) {
-  CHK(UPB_LIKELY((size_t)(e->ptr - e->buf) >= bytes) ||
-      upb_encode_growbuffer(e, bytes));
-
-  e->ptr -= bytes;
-  return true;
+static uint32_t upb_readcase(const char *msg, const upb_msglayout_field *f) {
+  uint32_t ret;
+  uint32_t offset = ~f->presence;
+  memcpy(&ret, msg + offset, sizeof(ret));
+  return ret;
 }
 
-/* Writes the given bytes to the buffer, handling reserve/advance. */
-static bool upb_put_bytes(upb_encstate *e, const void *data, size_t len) {
-  CHK(upb_encode_reserve(e, len));
-  memcpy(e->ptr, data, len);
-  return true;
+static bool upb_readhasbit(const char *msg, const upb_msglayout_field *f) {
+  uint32_t hasbit = f->presence;
+  UPB_ASSERT(f->presence > 0);
+  return msg[hasbit / 8] & (1 << (hasbit % 8));
 }
 
-static bool upb_put_fixed64(upb_encstate *e, uint64_t val) {
-  /* TODO(haberman): byte-swap for big endian. */
-  return upb_put_bytes(e, &val, sizeof(uint64_t));
-}
+/* Returns the highest hasbit below |hasbit| that is set in |msg|, or 0 if
+ * there is none. */
+static uint32_t upb_prevhasbit(const char *msg, uint32_t hasbit) {
+  uint32_t byte = hasbit / 8;
+  uint32_t bits = (uint8_t)msg[byte] & ((1U << (hasbit % 8)) - 1);
 
-static bool upb_put_fixed32(upb_encstate *e, uint32_t val) {
-  /* TODO(haberman): byte-swap for big endian. */
-  return upb_put_bytes(e, &val, sizeof(uint32_t));
-}
+  while (bits == 0) {
+    uint64_t word;
+    if (byte == 0) return 0;
+    if (byte >= sizeof(word)) {
+      /* Skip a word of clear hasbits at a time. */
+      memcpy(&word, msg + byte - sizeof(word), sizeof(word));
+      if (word == 0) {
+        byte -= sizeof(word);
+        continue;
+      }
+    }
+    bits = (uint8_t)msg[--byte];
+  }
 
-static bool upb_put_varint(upb_encstate *e, uint64_t val) {
-  size_t len;
-  char *start;
-  CHK(upb_encode_reserve(e, UPB_PB_VARINT_MAX_LEN));
-  len = upb_encode_varint(val, e->ptr);
-  start = e->ptr + UPB_PB_VARINT_MAX_LEN - len;
-  memmove(start, e->ptr, len);
-  e->ptr = start;
-  return true;
+#if defined(__GNUC__) || defined(__clang__)
+  return byte * 8 + (31 - __builtin_clz(bits));
+#else
+  hasbit = byte * 8;
+  while (bits >>= 1) hasbit++;
+  return hasbit;
+#endif
 }
 
-static bool upb_put_double(upb_encstate *e, double d) {
-  uint64_t u64;
-  UPB_ASSERT(sizeof(double) == sizeof(uint64_t));
-  memcpy(&u64, &d, sizeof(uint64_t));
-  return upb_put_fixed64(e, u64);
-}
+/* Called for field |i| of |m|, whose hasbit is clear.  Returns the index of
+ * the first field of the run of absent hasbit fields that ends at |i|, or of
+ * the part of it after the last field without a hasbit, which the caller
+ * must still visit.  Since hasbits are numbered in field order, a run
+ * without such fields starts right at the distance given by the previous set
+ * hasbit. */
+static int upb_skipabsent(const char *msg, const upb_msglayout *m, int i) {
+  int32_t hasbit = m->fields[i].presence;
+  int32_t prev = upb_prevhasbit(msg, hasbit);
+  int first = i - (hasbit - prev) + 1;
 
-static bool upb_put_float(upb_encstate *e, float d) {
-  uint32_t u32;
-  UPB_ASSERT(sizeof(float) == sizeof(uint32_t));
-  memcpy(&u32, &d, sizeof(uint32_t));
-  return upb_put_fixed32(e, u32);
-}
+  if (first >= 0 && m->fields[first].presence == prev + 1) {
+    return first;
+  }
 
-static uint32_t upb_readcase(const char *msg, const upb_msglayout_field *f) {
-  uint32_t ret;
-  uint32_t offset = ~f->presence;
-  memcpy(&ret, msg + offset, sizeof(ret));
-  return ret;
+  while (i > 0 && m->fields[i - 1].presence > prev) {
+    i--;
+  }
+
+  return i;
 }
 
-static bool upb_readhasbit(const char *msg, const upb_msglayout_field *f) {
-  uint32_t hasbit = f->presence;
-  UPB_ASSERT(f->presence > 0);
-  return msg[hasbit / 8] & (1 << (hasbit % 8));
+/* Returns whether |f| should be encoded.  Sets |skip_zero_value| for fields
+ * without presence, whose zero value is not encoded either. */
+static bool upb_encode_hasfield(const char *msg, const upb_msglayout_field *f,
+                                bool *skip_zero_value) {
+  *skip_zero_value = false;
+  if (f->presence == 0) {
+    /* Proto3 presence. */
+    *skip_zero_value = true;
+    return true;
+  } else if (f->presence > 0) {
+    /* Proto2 presence: hasbit. */
+    return upb_readhasbit(msg, f);
+  } else {
+    /* Field is in a oneof. */
+    return upb_readcase(msg, f) == f->number;
+  }
 }
 
 static bool upb_put_tag(upb_encstate *e, int field_number, int wire_type) {
-  return upb_put_varint(e, (field_number << 3) | wire_type);
+  return _upb_encode_varint(e, ((uint32_t)field_number << 3) | wire_type);
 }
 
 static bool upb_put_fixedarray(upb_encstate *e, const upb_array *arr,
                                size_t size) {
   size_t bytes = arr->len * size;
-  return upb_put_bytes(e, arr->data, bytes) && upb_put_varint(e, bytes);
+  return _upb_encode_bytes(e, arr->data, bytes) && _upb_encode_varint(e, bytes);
 }
 
-bool upb_encode_message(upb_encstate *e, const char *msg,
-                        const upb_msglayout *m, size_t *size);
+/* Messages that were built up over time rather than parsed into a fresh arena
+ * have their submessages all over memory, and encoding them is mostly waiting
+ * for cache misses, one submessage after the other.  So while we encode an
+ * element of an array of messages, we ask for the one this many elements
+ * further on to be loaded.  A singular submessage is needed as soon as its
+ * pointer is read, so there is nothing to overlap it with. */
+#define UPB_ENCODE_PREFETCH 2
+
+/* Prefetches the lines of |msg| that are read first: the end, where the last
+ * field is, and the start, with the hasbits and unknown fields. */
+UPB_INLINE void upb_prefetch_msg(const void *msg, const upb_msglayout *m) {
+  UPB_PREFETCH((const char*)msg + m->size - 1);
+  UPB_PREFETCH(msg);
+}
+
+/* Prefetches the |count| messages at |msgs|, or UPB_ENCODE_PREFETCH of them
+ * if there are more: the first ones an array loop gets to.  The loop then
+ * prefetches one more per element that it encodes. */
+UPB_INLINE void upb_prefetch_msgs(void *const *msgs, size_t count,
+                                  const upb_msglayout *subm) {
+  size_t i;
+  for (i = 0; i < count && i < UPB_ENCODE_PREFETCH; i++) {
+    upb_prefetch_msg(msgs[i], subm);
+  }
+}
 
 static bool upb_encode_array(upb_encstate *e, const char *field_mem,
                              const upb_msglayout *m,
@@ -151,9 +173,9 @@ static bool upb_encode_array(upb_encstate *e, const char *field_mem,
   size_t pre_len = e->limit - e->ptr; \
   do { \
     ptr--; \
-    CHK(upb_put_varint(e, encode)); \
+    CHK(_upb_encode_varint(e, encode)); \
   } while (ptr != start); \
-  CHK(upb_put_varint(e, e->limit - e->ptr - pre_len)); \
+  CHK(_upb_encode_varint(e, e->limit - e->ptr - pre_len)); \
 } \
 break; \
 do { ; } while(0)
@@ -184,17 +206,17 @@ do { ; } while(0)
     case UPB_DESCRIPTOR_TYPE_BOOL:
       VARINT_CASE(bool, *ptr);
     case UPB_DESCRIPTOR_TYPE_SINT32:
-      VARINT_CASE(int32_t, upb_zzencode_32(*ptr));
+      VARINT_CASE(int32_t, _upb_zzencode_32(*ptr));
     case UPB_DESCRIPTOR_TYPE_SINT64:
-      VARINT_CASE(int64_t, upb_zzencode_64(*ptr));
+      VARINT_CASE(int64_t, _upb_zzencode_64(*ptr));
     case UPB_DESCRIPTOR_TYPE_STRING:
     case UPB_DESCRIPTOR_TYPE_BYTES: {
       upb_strview *start = arr->data;
       upb_strview *ptr = start + arr->len;
       do {
         ptr--;
-        CHK(upb_put_bytes(e, ptr->data, ptr->size) &&
-            upb_put_varint(e, ptr->size) &&
+        CHK(_upb_encode_bytes(e, ptr->data, ptr->size) &&
+            _upb_encode_varint(e, ptr->size) &&
             upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED));
       } while (ptr != start);
       return true;
@@ -203,11 +225,16 @@ do { ; } while(0)
       void **start = arr->data;
       void **ptr = start + arr->len;
       const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr - UPB_MIN(arr->len, UPB_ENCODE_PREFETCH),
+                        arr->len, subm);
       do {
         size_t size;
         ptr--;
+        if (ptr - start >= UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[-UPB_ENCODE_PREFETCH], subm);
+        }
         CHK(upb_put_tag(e, f->number, UPB_WIRE_TYPE_END_GROUP) &&
-            upb_encode_message(e, *ptr, subm, &size) &&
+            _upb_encode_message(e, *ptr, subm, &size) &&
             upb_put_tag(e, f->number, UPB_WIRE_TYPE_START_GROUP));
       } while (ptr != start);
       return true;
@@ -216,11 +243,16 @@ do { ; } while(0)
       void **start = arr->data;
       void **ptr = start + arr->len;
       const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr - UPB_MIN(arr->len, UPB_ENCODE_PREFETCH),
+                        arr->len, subm);
       do {
         size_t size;
         ptr--;
-        CHK(upb_encode_message(e, *ptr, subm, &size) &&
-            upb_put_varint(e, size) &&
+        if (ptr - start >= UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[-UPB_ENCODE_PREFETCH], subm);
+        }
+        CHK(_upb_encode_message(e, *ptr, subm, &size) &&
+            _upb_encode_varint(e, size) &&
             upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED));
       } while (ptr != start);
       return true;
@@ -243,7 +275,7 @@ static bool upb_encode_scalarfield(upb_encstate *e, const char *field_mem,
   if (skip_zero_value && val == 0) { \
     return true; \
   } \
-  return upb_put_ ## type(e, encodeval) && \
+  return _upb_encode_ ## type(e, encodeval) && \
       upb_put_tag(e, f->number, wire_type); \
 } while(0)
 
@@ -269,17 +301,17 @@ static bool upb_encode_scalarfield(upb_encstate *e, const char *field_mem,
     case UPB_DESCRIPTOR_TYPE_BOOL:
       CASE(bool, varint, UPB_WIRE_TYPE_VARINT, val);
     case UPB_DESCRIPTOR_TYPE_SINT32:
-      CASE(int32_t, varint, UPB_WIRE_TYPE_VARINT, upb_zzencode_32(val));
+      CASE(int32_t, varint, UPB_WIRE_TYPE_VARINT, _upb_zzencode_32(val));
     case UPB_DESCRIPTOR_TYPE_SINT64:
-      CASE(int64_t, varint, UPB_WIRE_TYPE_VARINT, upb_zzencode_64(val));
+      CASE(int64_t, varint, UPB_WIRE_TYPE_VARINT, _upb_zzencode_64(val));
     case UPB_DESCRIPTOR_TYPE_STRING:
     case UPB_DESCRIPTOR_TYPE_BYTES: {
       upb_strview view = *(upb_strview*)field_mem;
       if (skip_zero_value && view.size == 0) {
         return true;
       }
-      return upb_put_bytes(e, view.data, view.size) &&
-          upb_put_varint(e, view.size) &&
+      return _upb_encode_bytes(e, view.data, view.size) &&
+          _upb_encode_varint(e, view.size) &&
           upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
     }
     case UPB_DESCRIPTOR_TYPE_GROUP: {
@@ -290,7 +322,7 @@ static bool upb_encode_scalarfield(upb_encstate *e, const char *field_mem,
         return true;
       }
       return upb_put_tag(e, f->number, UPB_WIRE_TYPE_END_GROUP) &&
-          upb_encode_message(e, submsg, subm, &size) &&
+          _upb_encode_message(e, submsg, subm, &size) &&
           upb_put_tag(e, f->number, UPB_WIRE_TYPE_START_GROUP);
     }
     case UPB_DESCRIPTOR_TYPE_MESSAGE: {
@@ -300,8 +332,14 @@ static bool upb_encode_scalarfield(upb_encstate *e, const char *field_mem,
       if (submsg == NULL) {
         return true;
       }
-      return upb_encode_message(e, submsg, subm, &size) &&
-          upb_put_varint(e, size) &&
+      if (_upb_islazy(submsg)) {
+        upb_strview data = _upb_getlazy(submsg)->data;
+        return _upb_encode_bytes(e, data.data, data.size) &&
+            _upb_encode_varint(e, data.size) &&
+            upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+      }
+      return _upb_encode_message(e, submsg, subm, &size) &&
+          _upb_encode_varint(e, size) &&
           upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
     }
   }
@@ -309,62 +347,1185 @@ static bool upb_encode_scalarfield(upb_encstate *e, const char *field_mem,
   UPB_UNREACHABLE();
 }
 
-bool upb_encode_message(upb_encstate *e, const char *msg,
-                        const upb_msglayout *m, size_t *size) {
+/* A map key or value, in the form of a message field of its type. */
+typedef union {
+  upb_strview str;
+  uint64_t num;
+  void *msg;
+} upb_mapval;
+
+/* Deterministic maps *********************************************************/
+
+/* A map entry along with a prefix of its key that sorts like the key: an
+ * integer key as an unsigned number, or eight bytes of a string key, read
+ * big-endian and padded with zeros. */
+typedef struct {
+  uint64_t prefix;
+  upb_mapval key;
+  upb_mapval val;
+} upb_mapent;
+
+/* Runs of at most this many entries are sorted by insertion. */
+#define UPB_MAPSORT_MIN 16
+
+/* String keys that are still tied after this many bytes are left to qsort(),
+ * which bounds the recursion of upb_mapsort(). */
+#define UPB_MAPSORT_MAXOFS 32
+
+static uint64_t upb_mapkey_prefix(const upb_map *map, const upb_mapval *key,
+                                  size_t ofs) {
+  const uint64_t sign = (uint64_t)1 << 63;
+  switch (map->key_type) {
+    case UPB_TYPE_STRING: {
+      uint64_t ret = 0;
+      size_t i;
+      for (i = ofs; i < ofs + 8; i++) {
+        ret <<= 8;
+        if (i < key->str.size) ret |= (uint8_t)key->str.data[i];
+      }
+      return ret;
+    }
+    case UPB_TYPE_BOOL: {
+      bool b;
+      memcpy(&b, key, sizeof(b));
+      return b;
+    }
+    case UPB_TYPE_INT32: {
+      int32_t i32;
+      memcpy(&i32, key, sizeof(i32));
+      return (uint64_t)(int64_t)i32 ^ sign;
+    }
+    case UPB_TYPE_UINT32: {
+      uint32_t u32;
+      memcpy(&u32, key, sizeof(u32));
+      return u32;
+    }
+    case UPB_TYPE_INT64:
+      return key->num ^ sign;
+    case UPB_TYPE_UINT64:
+      return key->num;
+    default:
+      UPB_UNREACHABLE();
+  }
+}
+
+static int upb_mapent_strcmp(const void *_a, const void *_b) {
+  const upb_strview *a = &((const upb_mapent*)_a)->key.str;
+  const upb_strview *b = &((const upb_mapent*)_b)->key.str;
+  size_t n = UPB_MIN(a->size, b->size);
+  int cmp = n ? memcmp(a->data, b->data, n) : 0;
+  if (cmp) return cmp;
+  return a->size < b->size ? -1 : a->size > b->size;
+}
+
+static int upb_mapent_cmp(const upb_map *map, const upb_mapent *a,
+                          const upb_mapent *b) {
+  if (map->key_type == UPB_TYPE_STRING) return upb_mapent_strcmp(a, b);
+  return a->prefix < b->prefix ? -1 : a->prefix > b->prefix;
+}
+
+static void upb_mapsort_insertion(const upb_map *map, upb_mapent *ents,
+                                  size_t n) {
+  size_t i, j;
+  for (i = 1; i < n; i++) {
+    upb_mapent ent = ents[i];
+    for (j = i; j > 0 && upb_mapent_cmp(map, &ent, &ents[j - 1]) < 0; j--) {
+      ents[j] = ents[j - 1];
+    }
+    ents[j] = ent;
+  }
+}
+
+/* Sorts |ents| by key, with |tmp| as scratch space for as many entries.  This
+ * is an LSD radix sort of the prefixes, which for string keys were taken at
+ * offset |ofs|; entries whose prefixes tie are then sorted on the next
+ * eight bytes of their keys. */
+static void upb_mapsort(const upb_map *map, upb_mapent *ents, upb_mapent *tmp,
+                        size_t n, size_t ofs) {
+  size_t count[256];
+  upb_mapent *from = ents;
+  upb_mapent *to = tmp;
+  size_t i, start;
+  int shift;
+
+  if (n <= UPB_MAPSORT_MIN) {
+    upb_mapsort_insertion(map, ents, n);
+    return;
+  }
+
+  for (shift = 0; shift < 64; shift += 8) {
+    size_t sum = 0;
+    upb_mapent *swap;
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++) count[(uint8_t)(from[i].prefix >> shift)]++;
+    /* Bytes that all the entries share don't need a pass. */
+    if (count[(uint8_t)(from[0].prefix >> shift)] == n) continue;
+    for (i = 0; i < 256; i++) {
+      size_t c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++) {
+      to[count[(uint8_t)(from[i].prefix >> shift)]++] = from[i];
+    }
+    swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if (from != ents) memcpy(ents, from, n * sizeof(*ents));
+  if (map->key_type != UPB_TYPE_STRING) return;
+
+  for (start = 0; start < n; start = i) {
+    bool longer = false;
+    for (i = start; i < n && ents[i].prefix == ents[start].prefix; i++) {
+      longer |= ents[i].key.str.size > ofs + 8;
+    }
+    if (i - start == 1) {
+      continue;
+    } else if (!longer) {
+      /* Keys that differ only in trailing zeros. */
+      upb_mapsort_insertion(map, ents + start, i - start);
+    } else if (ofs + 8 >= UPB_MAPSORT_MAXOFS) {
+      qsort(ents + start, i - start, sizeof(*ents), &upb_mapent_strcmp);
+    } else {
+      size_t j;
+      for (j = start; j < i; j++) {
+        ents[j].prefix = upb_mapkey_prefix(map, &ents[j].key, ofs + 8);
+      }
+      upb_mapsort(map, ents + start, tmp, i - start, ofs + 8);
+    }
+  }
+}
+
+/* Returns the entries of |map|, which has at least one, in key order.  The
+ * array comes from upb_gmalloc() and is the caller's to upb_gfree().  Returns
+ * NULL on allocation failure. */
+static upb_mapent *upb_sortmap(const upb_map *map) {
+  size_t n = _upb_map_size(map);
+  size_t iter = UPB_MAP_BEGIN;
+  size_t i = 0;
+  bool sorted = true;
+  upb_mapent *ents = upb_gmalloc(n * sizeof(*ents));
+
+  if (!ents) return NULL;
+
+  while (_upb_map_next(map, &iter, &ents[i].key, &ents[i].val)) {
+    ents[i].prefix = upb_mapkey_prefix(map, &ents[i].key, 0);
+    if (sorted && i > 0 && upb_mapent_cmp(map, &ents[i - 1], &ents[i]) > 0) {
+      sorted = false;
+    }
+    i++;
+  }
+
+  if (!sorted) {
+    upb_mapent *tmp = upb_gmalloc(n * sizeof(*tmp));
+    if (!tmp) {
+      upb_gfree(ents);
+      return NULL;
+    }
+    upb_mapsort(map, ents, tmp, n, 0);
+    upb_gfree(tmp);
+  }
+
+  return ents;
+}
+
+#undef UPB_MAPSORT_MIN
+#undef UPB_MAPSORT_MAXOFS
+
+static bool upb_encode_mapentry(upb_encstate *e, const upb_msglayout *entry,
+                                const upb_msglayout_field *f,
+                                const upb_mapval *key, const upb_mapval *val) {
+  size_t pre_len = e->limit - e->ptr;
+  return upb_encode_scalarfield(e, (const char*)val, entry, &entry->fields[1],
+                                false) &&
+         upb_encode_scalarfield(e, (const char*)key, entry, &entry->fields[0],
+                                false) &&
+         _upb_encode_varint(e, (e->limit - e->ptr) - pre_len) &&
+         upb_put_tag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+}
+
+/* Entries are visited backwards, so that they come out in the order that the
+ * forward encoder writes them. */
+static bool upb_encode_map(upb_encstate *e, const char *field_mem,
+                           const upb_msglayout *m,
+                           const upb_msglayout_field *f) {
+  const upb_map *map = *(const upb_map**)field_mem;
+  const upb_msglayout *entry = m->submsgs[f->submsg_index];
+  size_t iter = UPB_MAP_BEGIN;
+  upb_mapval key, val;
+
+  if ((e->options & UPB_ENCODE_DETERMINISTIC) && _upb_map_size(map) > 1) {
+    upb_mapent *ents = upb_sortmap(map);
+    size_t i = _upb_map_size(map);
+    bool ok = ents != NULL;
+    while (ok && i > 0) {
+      i--;
+      ok = upb_encode_mapentry(e, entry, f, &ents[i].key, &ents[i].val);
+    }
+    upb_gfree(ents);
+    return ok;
+  }
+
+  while (_upb_map_prev(map, &iter, &key, &val)) {
+    CHK(upb_encode_mapentry(e, entry, f, &key, &val));
+  }
+
+  return true;
+}
+
+bool _upb_encode_field(upb_encstate *e, const char *msg,
+                       const upb_msglayout *m, const upb_msglayout_field *f) {
+  bool skip_empty;
+
+  if (f->label == UPB_LABEL_REPEATED) {
+    return upb_encode_array(e, msg + f->offset, m, f);
+  } else if (f->label == _UPB_LABEL_MAP) {
+    return upb_encode_map(e, msg + f->offset, m, f);
+  } else if (upb_encode_hasfield(msg, f, &skip_empty)) {
+    return upb_encode_scalarfield(e, msg + f->offset, m, f, skip_empty);
+  }
+
+  return true;
+}
+
+/* Encodes the value of an extension, which is present even if it is zero. */
+static bool upb_encode_ext(upb_encstate *e, const upb_msg_ext *ext) {
+  const upb_msglayout_field *f = &ext->ext->field;
+  const char *mem = (const char*)&ext->data;
+  upb_msglayout l;
+
+  _upb_msglayout_forext(&l, ext->ext);
+  if (f->label == UPB_LABEL_REPEATED) {
+    return upb_encode_array(e, mem, &l, f);
+  }
+  return upb_encode_scalarfield(e, mem, &l, f, false);
+}
+
+bool _upb_encode_exts(upb_encstate *e, const char *msg,
+                      const upb_msglayout *m) {
+  size_t count;
+  const upb_msg_ext *exts = _upb_msg_getexts(msg, m, &count);
+
+  /* Last to first, so that they come out in the order they were set. */
+  while (count > 0) {
+    CHK(upb_encode_ext(e, &exts[--count]));
+  }
+
+  return true;
+}
+
+bool _upb_encode_message(upb_encstate *e, const char *msg,
+                         const upb_msglayout *m, size_t *size) {
   int i;
   size_t pre_len = e->limit - e->ptr;
-  const char *unknown;
-  size_t unknown_size;
+
+  if (m->encode) {
+    return m->encode(e, msg, m, size);
+  }
 
   for (i = m->field_count - 1; i >= 0; i--) {
     const upb_msglayout_field *f = &m->fields[i];
+    if (f->presence > 0 && !upb_readhasbit(msg, f)) {
+      i = upb_skipabsent(msg, m, i);
+      continue;
+    }
+    CHK(_upb_encode_field(e, msg, m, f));
+  }
 
-    if (f->label == UPB_LABEL_REPEATED) {
-      CHK(upb_encode_array(e, msg + f->offset, m, f));
+  CHK(_upb_encode_exts(e, msg, m));
+  CHK(_upb_encode_unknown(e, msg));
+
+  *size = (e->limit - e->ptr) - pre_len;
+  return true;
+}
+
+/* Forward encoding ***********************************************************/
+
+/* The forward encoder makes two passes.  The first computes the exact size of
+ * the message, recording the length of every submessage and packed varint
+ * array in |sizes| in the order they are visited.  The second allocates
+ * exactly that much and writes front to back, taking the lengths from |sizes|
+ * in the same order, without any bounds checks or moving of data. */
+
+#define UPB_FWD_INITIAL_SIZES 64
+
+typedef struct {
+  size_t *sizes;
+  size_t count;  /* Number of lengths recorded by the size pass. */
+  size_t cap;
+  size_t next;   /* Next length to be used by the write pass. */
+  bool record;   /* False if only the total size is wanted. */
+  char *ptr;
+
+  /* For upb_encode_iov(): strings of at least |alias_min| bytes are
+   * referenced instead of copied.  The size pass counts them. */
+  size_t alias_min;
+  size_t alias_count;
+  size_t alias_bytes;
+  upb_strview *iov;     /* Next segment to be filled in. */
+  const char *seg_start;  /* Start of the current segment of copied data. */
+
+  /* For UPB_ENCODE_DETERMINISTIC: the size pass sorts each map of more than
+   * one entry, and keeps the sorted entries here for the write pass. */
+  bool deterministic;
+  upb_mapent **maps;
+  size_t map_count;
+  size_t map_cap;
+  size_t map_next;
+
+  size_t initial[UPB_FWD_INITIAL_SIZES];
+} upb_fwdstate;
+
+static void upb_fwd_init(upb_fwdstate *e, size_t alias_min) {
+  e->sizes = e->initial;
+  e->count = 0;
+  e->cap = UPB_FWD_INITIAL_SIZES;
+  e->next = 0;
+  e->record = true;
+  e->alias_min = alias_min;
+  e->alias_count = 0;
+  e->alias_bytes = 0;
+  e->iov = NULL;
+  e->deterministic = false;
+  e->maps = NULL;
+  e->map_count = 0;
+  e->map_cap = 0;
+  e->map_next = 0;
+}
+
+static void upb_fwd_uninit(upb_fwdstate *e) {
+  size_t i;
+  if (e->sizes != e->initial) {
+    upb_gfree(e->sizes);
+  }
+  for (i = 0; i < e->map_count; i++) {
+    upb_gfree(e->maps[i]);
+  }
+  upb_gfree(e->maps);
+}
+
+static void upb_fwd_countstr(upb_fwdstate *e, size_t size) {
+  if (size >= e->alias_min) {
+    e->alias_count++;
+    e->alias_bytes += size;
+  }
+}
+
+static size_t upb_varint_size(uint64_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+  return ((63 - __builtin_clzll(val | 1)) * 9 + 73) / 64;
+#else
+  size_t i = 1;
+  while (val >= 128) {
+    val >>= 7;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static size_t upb_tag_size(const upb_msglayout_field *f) {
+  return upb_varint_size((uint64_t)f->number << 3);
+}
+
+/* Reserves the next slot of |sizes|, to be filled in once the length of the
+ * field is known. */
+static bool upb_fwd_addsize(upb_fwdstate *e, size_t *slot) {
+  if (!e->record) {
+    *slot = 0;  /* Scratch space. */
+    return true;
+  }
+
+  if (e->count == e->cap) {
+    size_t new_cap = e->cap * 2;
+    size_t *new_sizes;
+    if (e->sizes == e->initial) {
+      new_sizes = upb_gmalloc(new_cap * sizeof(size_t));
+      if (new_sizes) memcpy(new_sizes, e->sizes, e->cap * sizeof(size_t));
     } else {
-      bool skip_empty = false;
-      if (f->presence == 0) {
-        /* Proto3 presence. */
-        skip_empty = true;
-      } else if (f->presence > 0) {
-        /* Proto2 presence: hasbit. */
-        if (!upb_readhasbit(msg, f)) {
-          continue;
+      new_sizes = upb_grealloc(e->sizes, e->cap * sizeof(size_t),
+                               new_cap * sizeof(size_t));
+    }
+    CHK(new_sizes);
+    e->sizes = new_sizes;
+    e->cap = new_cap;
+  }
+  *slot = e->count++;
+  return true;
+}
+
+static bool upb_fwd_msgsize(upb_fwdstate *e, const char *msg,
+                            const upb_msglayout *m, size_t *size);
+
+static bool upb_fwd_submsgsize(upb_fwdstate *e, const char *msg,
+                               const upb_msglayout *subm, size_t *size) {
+  size_t slot;
+  CHK(upb_fwd_addsize(e, &slot) && upb_fwd_msgsize(e, msg, subm, size));
+  e->sizes[slot] = *size;
+  *size += upb_varint_size(*size);
+  return true;
+}
+
+static bool upb_fwd_arraysize(upb_fwdstate *e, const char *field_mem,
+                              const upb_msglayout *m,
+                              const upb_msglayout_field *f, size_t *size) {
+  const upb_array *arr = *(const upb_array**)field_mem;
+  size_t bytes = 0;
+
+  *size = 0;
+
+  if (arr == NULL || arr->len == 0) {
+    return true;
+  }
+
+#define VARINT_CASE(ctype, encode) { \
+  const ctype *ptr = arr->data; \
+  const ctype *end = ptr + arr->len; \
+  size_t slot; \
+  CHK(upb_fwd_addsize(e, &slot)); \
+  for (; ptr < end; ptr++) { \
+    bytes += upb_varint_size(encode); \
+  } \
+  e->sizes[slot] = bytes; \
+} \
+break; \
+do { ; } while(0)
+
+  switch (f->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      bytes = arr->len * sizeof(uint64_t);
+      break;
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      bytes = arr->len * sizeof(uint32_t);
+      break;
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+      VARINT_CASE(uint64_t, *ptr);
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+      VARINT_CASE(uint32_t, *ptr);
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      bytes = arr->len;
+      break;
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+      VARINT_CASE(int32_t, _upb_zzencode_32(*ptr));
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      VARINT_CASE(int64_t, _upb_zzencode_64(*ptr));
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES: {
+      const upb_strview *ptr = arr->data;
+      const upb_strview *end = ptr + arr->len;
+      for (; ptr < end; ptr++) {
+        *size += upb_varint_size(ptr->size) + ptr->size;
+        upb_fwd_countstr(e, ptr->size);
+      }
+      *size += arr->len * upb_tag_size(f);
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_GROUP: {
+      void *const *ptr = arr->data;
+      void *const *end = ptr + arr->len;
+      const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr, arr->len, subm);
+      for (; ptr < end; ptr++) {
+        if (end - ptr > UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[UPB_ENCODE_PREFETCH], subm);
         }
-      } else {
-        /* Field is in a oneof. */
-        if (upb_readcase(msg, f) != f->number) {
-          continue;
+        CHK(upb_fwd_msgsize(e, *ptr, subm, &bytes));
+        *size += bytes;
+      }
+      *size += arr->len * 2 * upb_tag_size(f);
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_MESSAGE: {
+      void *const *ptr = arr->data;
+      void *const *end = ptr + arr->len;
+      const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr, arr->len, subm);
+      for (; ptr < end; ptr++) {
+        if (end - ptr > UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[UPB_ENCODE_PREFETCH], subm);
         }
+        CHK(upb_fwd_submsgsize(e, *ptr, subm, &bytes));
+        *size += bytes;
       }
-      CHK(upb_encode_scalarfield(e, msg + f->offset, m, f, skip_empty));
+      *size += arr->len * upb_tag_size(f);
+      return true;
     }
   }
+#undef VARINT_CASE
+
+  /* Packed, like the backward encoder. */
+  *size = upb_tag_size(f) + upb_varint_size(bytes) + bytes;
+  return true;
+}
 
-  unknown = upb_msg_getunknown(msg, &unknown_size);
+static bool upb_fwd_scalarsize(upb_fwdstate *e, const char *field_mem,
+                               const upb_msglayout *m,
+                               const upb_msglayout_field *f,
+                               bool skip_zero_value, size_t *size) {
+#define CASE(ctype, valsize) do { \
+  ctype val = *(ctype*)field_mem; \
+  *size = (skip_zero_value && val == 0) ? 0 : upb_tag_size(f) + (valsize); \
+  return true; \
+} while(0)
 
-  if (unknown) {
-    upb_put_bytes(e, unknown, unknown_size);
+  switch (f->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+      CASE(double, 8);
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+      CASE(float, 4);
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+      CASE(uint64_t, upb_varint_size(val));
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+      CASE(uint32_t, upb_varint_size(val));
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      CASE(int32_t, upb_varint_size((int64_t)val));
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      CASE(uint64_t, 8);
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      CASE(uint32_t, 4);
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      CASE(bool, 1);
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+      CASE(int32_t, upb_varint_size(_upb_zzencode_32(val)));
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      CASE(int64_t, upb_varint_size(_upb_zzencode_64(val)));
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES: {
+      upb_strview view = *(upb_strview*)field_mem;
+      if (skip_zero_value && view.size == 0) {
+        *size = 0;
+      } else {
+        *size = upb_tag_size(f) + upb_varint_size(view.size) + view.size;
+        upb_fwd_countstr(e, view.size);
+      }
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_GROUP: {
+      void *submsg = *(void **)field_mem;
+      *size = 0;
+      if (submsg == NULL) {
+        return true;
+      }
+      CHK(upb_fwd_msgsize(e, submsg, m->submsgs[f->submsg_index], size));
+      *size += 2 * upb_tag_size(f);
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_MESSAGE: {
+      void *submsg = *(void **)field_mem;
+      *size = 0;
+      if (submsg == NULL) {
+        return true;
+      }
+      if (_upb_islazy(submsg)) {
+        size_t len = _upb_getlazy(submsg)->data.size;
+        *size = upb_tag_size(f) + upb_varint_size(len) + len;
+        upb_fwd_countstr(e, len);
+        return true;
+      }
+      CHK(upb_fwd_submsgsize(e, submsg, m->submsgs[f->submsg_index], size));
+      *size += upb_tag_size(f);
+      return true;
+    }
+  }
+#undef CASE
+  UPB_UNREACHABLE();
+}
+
+/* Adds the size of one map entry to |size|. */
+static bool upb_fwd_mapentrysize(upb_fwdstate *e, const upb_msglayout *entry,
+                                 const upb_msglayout_field *f,
+                                 const upb_mapval *key, const upb_mapval *val,
+                                 size_t *size) {
+  size_t slot, key_size, val_size;
+  CHK(upb_fwd_addsize(e, &slot) &&
+      upb_fwd_scalarsize(e, (const char*)key, entry, &entry->fields[0], false,
+                         &key_size) &&
+      upb_fwd_scalarsize(e, (const char*)val, entry, &entry->fields[1], false,
+                         &val_size));
+  e->sizes[slot] = key_size + val_size;
+  *size += upb_tag_size(f) + upb_varint_size(key_size + val_size) + key_size +
+           val_size;
+  return true;
+}
+
+/* Sorts |map| and keeps its entries for the write pass. */
+static upb_mapent *upb_fwd_sortmap(upb_fwdstate *e, const upb_map *map) {
+  upb_mapent *ents;
+
+  if (e->map_count == e->map_cap) {
+    size_t new_cap = UPB_MAX(e->map_cap * 2, 8);
+    upb_mapent **new_maps =
+        upb_grealloc(e->maps, e->map_cap * sizeof(*e->maps),
+                     new_cap * sizeof(*e->maps));
+    if (!new_maps) return NULL;
+    e->maps = new_maps;
+    e->map_cap = new_cap;
+  }
+
+  ents = upb_sortmap(map);
+  if (ents) e->maps[e->map_count++] = ents;
+  return ents;
+}
+
+static bool upb_fwd_mapsize(upb_fwdstate *e, const char *field_mem,
+                            const upb_msglayout *m,
+                            const upb_msglayout_field *f, size_t *size) {
+  const upb_map *map = *(const upb_map**)field_mem;
+  const upb_msglayout *entry = m->submsgs[f->submsg_index];
+  size_t iter = UPB_MAP_BEGIN;
+  upb_mapval key, val;
+
+  *size = 0;
+
+  if (e->deterministic && _upb_map_size(map) > 1) {
+    upb_mapent *ents = upb_fwd_sortmap(e, map);
+    size_t i;
+    CHK(ents);
+    for (i = 0; i < _upb_map_size(map); i++) {
+      CHK(upb_fwd_mapentrysize(e, entry, f, &ents[i].key, &ents[i].val, size));
+    }
+    return true;
+  }
+
+  while (_upb_map_next(map, &iter, &key, &val)) {
+    CHK(upb_fwd_mapentrysize(e, entry, f, &key, &val, size));
+  }
+
+  return true;
+}
+
+static bool upb_fwd_msgsize(upb_fwdstate *e, const char *msg,
+                            const upb_msglayout *m, size_t *size) {
+  int i;
+  size_t unknown_size, ext_count;
+  const upb_msg_ext *exts = _upb_msg_getexts(msg, m, &ext_count);
+
+  upb_msg_getunknown(msg, &unknown_size);
+  *size = unknown_size;
+
+  for (i = 0; i < (int)ext_count; i++) {
+    const upb_msglayout_field *f = &exts[i].ext->field;
+    const char *mem = (const char*)&exts[i].data;
+    upb_msglayout l;
+    size_t ext_size;
+
+    _upb_msglayout_forext(&l, exts[i].ext);
+    if (f->label == UPB_LABEL_REPEATED) {
+      CHK(upb_fwd_arraysize(e, mem, &l, f, &ext_size));
+    } else {
+      CHK(upb_fwd_scalarsize(e, mem, &l, f, false, &ext_size));
+    }
+    *size += ext_size;
+  }
+
+  for (i = 0; i < m->field_count; i++) {
+    const upb_msglayout_field *f = &m->fields[i];
+    bool skip_empty;
+    size_t field_size = 0;
+
+    if (f->label == UPB_LABEL_REPEATED) {
+      CHK(upb_fwd_arraysize(e, msg + f->offset, m, f, &field_size));
+    } else if (f->label == _UPB_LABEL_MAP) {
+      CHK(upb_fwd_mapsize(e, msg + f->offset, m, f, &field_size));
+    } else if (upb_encode_hasfield(msg, f, &skip_empty)) {
+      CHK(upb_fwd_scalarsize(e, msg + f->offset, m, f, skip_empty,
+                             &field_size));
+    }
+
+    *size += field_size;
   }
 
-  *size = (e->limit - e->ptr) - pre_len;
   return true;
 }
 
+static void upb_fwd_putvarint(upb_fwdstate *e, uint64_t val) {
+  e->ptr += _upb_vencode(val, e->ptr);
+}
+
+static void upb_fwd_puttag(upb_fwdstate *e, int field_number, int wire_type) {
+  upb_fwd_putvarint(e, ((uint32_t)field_number << 3) | wire_type);
+}
+
+static void upb_fwd_putbytes(upb_fwdstate *e, const void *data, size_t len) {
+  memcpy(e->ptr, data, len);
+  e->ptr += len;
+}
+
+/* Writes the contents of a string field, or references them if they are long
+ * enough to be aliased. */
+static void upb_fwd_putstr(upb_fwdstate *e, const char *data, size_t len) {
+  if (e->iov && len >= e->alias_min) {
+    if (e->ptr != e->seg_start) {
+      e->iov->data = e->seg_start;
+      e->iov->size = e->ptr - e->seg_start;
+      e->iov++;
+    }
+    e->iov->data = data;
+    e->iov->size = len;
+    e->iov++;
+    e->seg_start = e->ptr;
+  } else {
+    upb_fwd_putbytes(e, data, len);
+  }
+}
+
+static void upb_fwd_putfixed64(upb_fwdstate *e, uint64_t val) {
+  /* TODO(haberman): byte-swap for big endian. */
+  upb_fwd_putbytes(e, &val, sizeof(uint64_t));
+}
+
+static void upb_fwd_putfixed32(upb_fwdstate *e, uint32_t val) {
+  /* TODO(haberman): byte-swap for big endian. */
+  upb_fwd_putbytes(e, &val, sizeof(uint32_t));
+}
+
+static void upb_fwd_putdouble(upb_fwdstate *e, double d) {
+  upb_fwd_putbytes(e, &d, sizeof(double));
+}
+
+static void upb_fwd_putfloat(upb_fwdstate *e, float f) {
+  upb_fwd_putbytes(e, &f, sizeof(float));
+}
+
+static void upb_fwd_msg(upb_fwdstate *e, const char *msg,
+                        const upb_msglayout *m);
+
+static void upb_fwd_submsg(upb_fwdstate *e, const char *msg,
+                           const upb_msglayout *subm) {
+  upb_fwd_putvarint(e, e->sizes[e->next++]);
+  upb_fwd_msg(e, msg, subm);
+}
+
+static void upb_fwd_array(upb_fwdstate *e, const char *field_mem,
+                          const upb_msglayout *m,
+                          const upb_msglayout_field *f) {
+  const upb_array *arr = *(const upb_array**)field_mem;
+
+  if (arr == NULL || arr->len == 0) {
+    return;
+  }
+
+#define FIXED_CASE(size) \
+  upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED); \
+  upb_fwd_putvarint(e, arr->len * size); \
+  upb_fwd_putbytes(e, arr->data, arr->len * size); \
+  return
+
+#define VARINT_CASE(ctype, encode) { \
+  const ctype *ptr = arr->data; \
+  const ctype *end = ptr + arr->len; \
+  upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED); \
+  upb_fwd_putvarint(e, e->sizes[e->next++]); \
+  for (; ptr < end; ptr++) { \
+    upb_fwd_putvarint(e, encode); \
+  } \
+  return; \
+}
+
+  switch (f->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      FIXED_CASE(sizeof(uint64_t));
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      FIXED_CASE(sizeof(uint32_t));
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+      VARINT_CASE(uint64_t, *ptr);
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+      VARINT_CASE(uint32_t, *ptr);
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case UPB_DESCRIPTOR_TYPE_BOOL: {
+      const bool *ptr = arr->data;
+      const bool *end = ptr + arr->len;
+      upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+      upb_fwd_putvarint(e, arr->len);
+      for (; ptr < end; ptr++) {
+        *e->ptr++ = *ptr;
+      }
+      return;
+    }
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+      VARINT_CASE(int32_t, _upb_zzencode_32(*ptr));
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      VARINT_CASE(int64_t, _upb_zzencode_64(*ptr));
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES: {
+      const upb_strview *ptr = arr->data;
+      const upb_strview *end = ptr + arr->len;
+      for (; ptr < end; ptr++) {
+        upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+        upb_fwd_putvarint(e, ptr->size);
+        upb_fwd_putstr(e, ptr->data, ptr->size);
+      }
+      return;
+    }
+    case UPB_DESCRIPTOR_TYPE_GROUP: {
+      void *const *ptr = arr->data;
+      void *const *end = ptr + arr->len;
+      const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr, arr->len, subm);
+      for (; ptr < end; ptr++) {
+        if (end - ptr > UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[UPB_ENCODE_PREFETCH], subm);
+        }
+        upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_START_GROUP);
+        upb_fwd_msg(e, *ptr, subm);
+        upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_END_GROUP);
+      }
+      return;
+    }
+    case UPB_DESCRIPTOR_TYPE_MESSAGE: {
+      void *const *ptr = arr->data;
+      void *const *end = ptr + arr->len;
+      const upb_msglayout *subm = m->submsgs[f->submsg_index];
+      upb_prefetch_msgs(ptr, arr->len, subm);
+      for (; ptr < end; ptr++) {
+        if (end - ptr > UPB_ENCODE_PREFETCH) {
+          upb_prefetch_msg(ptr[UPB_ENCODE_PREFETCH], subm);
+        }
+        upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+        upb_fwd_submsg(e, *ptr, subm);
+      }
+      return;
+    }
+  }
+#undef VARINT_CASE
+#undef FIXED_CASE
+}
+
+static void upb_fwd_scalarfield(upb_fwdstate *e, const char *field_mem,
+                                const upb_msglayout *m,
+                                const upb_msglayout_field *f,
+                                bool skip_zero_value) {
+#define CASE(ctype, type, wire_type, encodeval) do { \
+  ctype val = *(ctype*)field_mem; \
+  if (skip_zero_value && val == 0) { \
+    return; \
+  } \
+  upb_fwd_puttag(e, f->number, wire_type); \
+  upb_fwd_put ## type(e, encodeval); \
+  return; \
+} while(0)
+
+  switch (f->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+      CASE(double, double, UPB_WIRE_TYPE_64BIT, val);
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+      CASE(float, float, UPB_WIRE_TYPE_32BIT, val);
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+      CASE(uint64_t, varint, UPB_WIRE_TYPE_VARINT, val);
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+      CASE(uint32_t, varint, UPB_WIRE_TYPE_VARINT, val);
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      CASE(int32_t, varint, UPB_WIRE_TYPE_VARINT, (int64_t)val);
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      CASE(uint64_t, fixed64, UPB_WIRE_TYPE_64BIT, val);
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      CASE(uint32_t, fixed32, UPB_WIRE_TYPE_32BIT, val);
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      CASE(bool, varint, UPB_WIRE_TYPE_VARINT, val);
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+      CASE(int32_t, varint, UPB_WIRE_TYPE_VARINT, _upb_zzencode_32(val));
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      CASE(int64_t, varint, UPB_WIRE_TYPE_VARINT, _upb_zzencode_64(val));
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES: {
+      upb_strview view = *(upb_strview*)field_mem;
+      if (skip_zero_value && view.size == 0) {
+        return;
+      }
+      upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+      upb_fwd_putvarint(e, view.size);
+      upb_fwd_putstr(e, view.data, view.size);
+      return;
+    }
+    case UPB_DESCRIPTOR_TYPE_GROUP: {
+      void *submsg = *(void **)field_mem;
+      if (submsg == NULL) {
+        return;
+      }
+      upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_START_GROUP);
+      upb_fwd_msg(e, submsg, m->submsgs[f->submsg_index]);
+      upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_END_GROUP);
+      return;
+    }
+    case UPB_DESCRIPTOR_TYPE_MESSAGE: {
+      void *submsg = *(void **)field_mem;
+      if (submsg == NULL) {
+        return;
+      }
+      upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+      if (_upb_islazy(submsg)) {
+        upb_strview data = _upb_getlazy(submsg)->data;
+        upb_fwd_putvarint(e, data.size);
+        upb_fwd_putstr(e, data.data, data.size);
+        return;
+      }
+      upb_fwd_submsg(e, submsg, m->submsgs[f->submsg_index]);
+      return;
+    }
+  }
+#undef CASE
+  UPB_UNREACHABLE();
+}
+
+static void upb_fwd_mapentry(upb_fwdstate *e, const upb_msglayout *entry,
+                             const upb_msglayout_field *f,
+                             const upb_mapval *key, const upb_mapval *val) {
+  upb_fwd_puttag(e, f->number, UPB_WIRE_TYPE_DELIMITED);
+  upb_fwd_putvarint(e, e->sizes[e->next++]);
+  upb_fwd_scalarfield(e, (const char*)key, entry, &entry->fields[0], false);
+  upb_fwd_scalarfield(e, (const char*)val, entry, &entry->fields[1], false);
+}
+
+static void upb_fwd_map(upb_fwdstate *e, const char *field_mem,
+                        const upb_msglayout *m, const upb_msglayout_field *f) {
+  const upb_map *map = *(const upb_map**)field_mem;
+  const upb_msglayout *entry = m->submsgs[f->submsg_index];
+  size_t iter = UPB_MAP_BEGIN;
+  upb_mapval key, val;
+
+  if (e->deterministic && _upb_map_size(map) > 1) {
+    const upb_mapent *ents = e->maps[e->map_next++];
+    size_t i;
+    for (i = 0; i < _upb_map_size(map); i++) {
+      upb_fwd_mapentry(e, entry, f, &ents[i].key, &ents[i].val);
+    }
+    return;
+  }
+
+  while (_upb_map_next(map, &iter, &key, &val)) {
+    upb_fwd_mapentry(e, entry, f, &key, &val);
+  }
+}
+
+static void upb_fwd_msg(upb_fwdstate *e, const char *msg,
+                        const upb_msglayout *m) {
+  int i;
+  size_t unknown_size, ext_count;
+  const char *unknown = upb_msg_getunknown(msg, &unknown_size);
+  const upb_msg_ext *exts = _upb_msg_getexts(msg, m, &ext_count);
+
+  /* The backward encoder puts unknown fields first and then extensions, so
+   * we do too. */
+  if (unknown_size) {
+    upb_fwd_putbytes(e, unknown, unknown_size);
+  }
+
+  for (i = 0; i < (int)ext_count; i++) {
+    const upb_msglayout_field *f = &exts[i].ext->field;
+    const char *mem = (const char*)&exts[i].data;
+    upb_msglayout l;
+
+    _upb_msglayout_forext(&l, exts[i].ext);
+    if (f->label == UPB_LABEL_REPEATED) {
+      upb_fwd_array(e, mem, &l, f);
+    } else {
+      upb_fwd_scalarfield(e, mem, &l, f, false);
+    }
+  }
+
+  for (i = 0; i < m->field_count; i++) {
+    const upb_msglayout_field *f = &m->fields[i];
+    bool skip_empty;
+
+    if (f->label == UPB_LABEL_REPEATED) {
+      upb_fwd_array(e, msg + f->offset, m, f);
+    } else if (f->label == _UPB_LABEL_MAP) {
+      upb_fwd_map(e, msg + f->offset, m, f);
+    } else if (upb_encode_hasfield(msg, f, &skip_empty)) {
+      upb_fwd_scalarfield(e, msg + f->offset, m, f, skip_empty);
+    }
+  }
+}
+
+static char *upb_encode_forward(const void *msg, const upb_msglayout *m,
+                                upb_arena *arena, int options, size_t *size) {
+  upb_fwdstate e;
+  char *buf = NULL;
+
+  upb_fwd_init(&e, SIZE_MAX);
+  e.deterministic = (options & UPB_ENCODE_DETERMINISTIC) != 0;
+
+  if (upb_fwd_msgsize(&e, msg, m, size)) {
+    if (*size == 0) {
+      static char ch;
+      buf = &ch;
+    } else if ((buf = upb_arena_malloc(arena, *size)) != NULL) {
+      e.ptr = buf;
+      upb_fwd_msg(&e, msg, m);
+      UPB_ASSERT(e.ptr == buf + *size);
+      UPB_ASSERT(e.next == e.count);
+      UPB_ASSERT(e.map_next == e.map_count);
+    }
+  }
+
+  upb_fwd_uninit(&e);
+
+  if (!buf) {
+    *size = 0;
+  }
+
+  _UPB_STATS_ADD(encode_bytes, *size);
+  return buf;
+}
+
+#undef UPB_FWD_INITIAL_SIZES
+
+/* Public API *****************************************************************/
+
+size_t upb_encoded_size(const void *msg, const upb_msglayout *m) {
+  upb_fwdstate e;
+  size_t size;
+  bool ok;
+
+  upb_fwd_init(&e, SIZE_MAX);
+  e.record = false;
+  ok = upb_fwd_msgsize(&e, msg, m, &size);
+  UPB_ASSERT(ok);  /* Nothing to allocate. */
+  UPB_UNUSED(ok);
+
+  return size;
+}
+
+bool upb_encoded_sizes(const void *msg, const upb_msglayout *m,
+                       upb_arena *arena, upb_encsizes *sizes) {
+  upb_fwdstate e;
+  size_t *lengths = NULL;
+
+  upb_fwd_init(&e, SIZE_MAX);
+
+  if (upb_fwd_msgsize(&e, msg, m, &sizes->size) &&
+      (lengths = upb_arena_malloc(arena, e.count * sizeof(size_t) + 1))) {
+    memcpy(lengths, e.sizes, e.count * sizeof(size_t));
+    sizes->lengths = lengths;
+    sizes->count = e.count;
+  }
+
+  upb_fwd_uninit(&e);
+  return lengths != NULL;
+}
+
+void upb_encode_sized(const void *msg, const upb_msglayout *m,
+                      const upb_encsizes *sizes, char *buf) {
+  upb_fwdstate e;
+
+  upb_fwd_init(&e, SIZE_MAX);
+  e.sizes = (size_t*)sizes->lengths;  /* Only read by the write pass. */
+  e.count = sizes->count;
+  e.ptr = buf;
+  upb_fwd_msg(&e, msg, m);
+  UPB_ASSERT(e.ptr == buf + sizes->size);
+  UPB_ASSERT(e.next == e.count);
+  _UPB_STATS_ADD(encode_bytes, sizes->size);
+}
+
+bool upb_encode_into(const void *msg, const upb_msglayout *m, char *buf,
+                     size_t cap, size_t *size) {
+  upb_fwdstate e;
+  bool ok;
+
+  upb_fwd_init(&e, SIZE_MAX);
+
+  if (upb_fwd_msgsize(&e, msg, m, size)) {
+    ok = *size <= cap;
+  } else {
+    *size = 0;
+    ok = false;
+  }
+
+  if (ok) {
+    e.ptr = buf;
+    upb_fwd_msg(&e, msg, m);
+    UPB_ASSERT(e.ptr == buf + *size);
+    _UPB_STATS_ADD(encode_bytes, *size);
+  }
+
+  upb_fwd_uninit(&e);
+  return ok;
+}
+
+upb_strview *upb_encode_iov(const void *msg, const upb_msglayout *m,
+                            upb_arena *arena, size_t min_alias, size_t *count,
+                            size_t *size) {
+  upb_fwdstate e;
+  upb_strview *iov = NULL;
+  char *buf;
+
+  upb_fwd_init(&e, UPB_MAX(min_alias, 1));
+  *count = 0;
+
+  if (upb_fwd_msgsize(&e, msg, m, size) &&
+      (buf = upb_arena_malloc(arena, *size - e.alias_bytes + 1)) != NULL &&
+      (iov = upb_arena_malloc(arena, (e.alias_count * 2 + 1) *
+                                         sizeof(upb_strview))) != NULL) {
+    e.ptr = buf;
+    e.seg_start = buf;
+    e.iov = iov;
+    upb_fwd_msg(&e, msg, m);
+    if (e.ptr != e.seg_start) {
+      e.iov->data = e.seg_start;
+      e.iov->size = e.ptr - e.seg_start;
+      e.iov++;
+    }
+    *count = e.iov - iov;
+    UPB_ASSERT(e.ptr == buf + *size - e.alias_bytes);
+    _UPB_STATS_ADD(encode_bytes, *size);
+  }
+
+  upb_fwd_uninit(&e);
+  return iov;
+}
+
 char *upb_encode(const void *msg, const upb_msglayout *m, upb_arena *arena,
                  size_t *size) {
+  return upb_encode_ex(msg, m, arena, 0, size);
+}
+
+char *upb_encode_ex(const void *msg, const upb_msglayout *m, upb_arena *arena,
+                    int options, size_t *size) {
   upb_encstate e;
+
+  if (options & UPB_ENCODE_FORWARD) {
+    return upb_encode_forward(msg, m, arena, options, size);
+  }
+
   e.alloc = upb_arena_alloc(arena);
   e.buf = NULL;
   e.limit = NULL;
   e.ptr = NULL;
+  e.options = options;
 
-  if (!upb_encode_message(&e, msg, m, size)) {
+  if (!_upb_encode_message(&e, msg, m, size)) {
     *size = 0;
     return NULL;
   }
 
   *size = e.limit - e.ptr;
+  _UPB_STATS_ADD(encode_bytes, *size);
 
   if (*size == 0) {
     static char ch;
@@ -14,6 +14,64 @@ extern "C" {
 char *upb_encode(const void *msg, const upb_msglayout *l, upb_arena *arena,
                  size_t *size);
 
+enum {
+  /* Computes the exact size first and writes the output front to back into a
+   * single allocation of that size, instead of writing backwards into a
+   * buffer that is grown (and moved) as needed.  The output is the same. */
+  UPB_ENCODE_FORWARD = 1,
+
+  /* Writes map entries in the order of their keys, so that equal messages
+   * always encode to the same bytes.  Without it they come in the map's
+   * internal order, which depends on the history of the map.  Fields are
+   * always written in field number order, and unknown fields as they were
+   * received.  This only costs anything for maps with more than one entry,
+   * and not much when their entries are already in order. */
+  UPB_ENCODE_DETERMINISTIC = 2
+};
+
+char *upb_encode_ex(const void *msg, const upb_msglayout *l, upb_arena *arena,
+                    int options, size_t *size);
+
+/* Returns the encoded size of |msg|, without encoding it. */
+size_t upb_encoded_size(const void *msg, const upb_msglayout *l);
+
+/* The encoded size of a message, along with the lengths of its submessages
+ * and packed fields that the encoder would otherwise compute again. */
+typedef struct {
+  size_t size;
+  const size_t *lengths;
+  size_t count;
+} upb_encsizes;
+
+/* Like upb_encoded_size(), but also keeps the lengths in |arena| so that a
+ * following upb_encode_sized() doesn't need a size pass of its own.  Returns
+ * false on allocation failure. */
+bool upb_encoded_sizes(const void *msg, const upb_msglayout *l,
+                       upb_arena *arena, upb_encsizes *sizes);
+
+/* Writes the sizes->size bytes encoding |msg| to |buf|.  |msg| must not have
+ * changed since |sizes| was computed. */
+void upb_encode_sized(const void *msg, const upb_msglayout *l,
+                      const upb_encsizes *sizes, char *buf);
+
+/* Encodes |msg| into the caller's buffer, front to back.  Sets |size| to the
+ * encoded size and returns false if that is more than |cap| (or on allocation
+ * failure), in which case nothing is written. */
+bool upb_encode_into(const void *msg, const upb_msglayout *l, char *buf,
+                     size_t cap, size_t *size);
+
+/* Encodes |msg| as a list of segments to be written out in order, eg. with
+ * writev().  String and bytes fields of at least |min_alias| bytes are not
+ * copied: their segment points into the message, which must stay alive and
+ * unchanged as long as the segments are used.  Everything else is encoded
+ * into a single buffer in |arena| that the other segments point into.
+ *
+ * Returns the |count| segments, allocated from |arena|, and sets |size| to the
+ * total encoded size.  Returns NULL on allocation failure. */
+upb_strview *upb_encode_iov(const void *msg, const upb_msglayout *l,
+                            upb_arena *arena, size_t min_alias, size_t *count,
+                            size_t *size);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
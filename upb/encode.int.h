@@ -0,0 +1,183 @@
+/*
+** Internal interface of the encoder (encode.c), shared with the serializers
+** that upbc generates with the "serializers" option.  Like the generic
+** encoder, these write backwards: each field's value is written before its
+** tag, and fields are visited from the highest number to the lowest.
+**
+** The definitions in this file are internal to upb.
+*/
+
+#ifndef UPB_ENCODE_INT_H_
+#define UPB_ENCODE_INT_H_
+
+#include <string.h>
+
+#include "upb/encode.h"
+
+#include "upb/port_def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPB_PB_VARINT_MAX_LEN 10
+
+typedef struct upb_encstate {
+  upb_alloc *alloc;
+  char *buf, *ptr, *limit;
+  int options;  /* As passed to upb_encode_ex(). */
+} upb_encstate;
+
+/* Writes |val| as a varint to |buf|, which has room for
+ * UPB_PB_VARINT_MAX_LEN bytes, and returns its length. */
+UPB_INLINE size_t _upb_vencode(uint64_t val, char *buf) {
+  size_t i;
+  if (val < 128) { buf[0] = val; return 1; }
+  i = 0;
+  while (val) {
+    uint8_t byte = val & 0x7fU;
+    val >>= 7;
+    if (val) byte |= 0x80U;
+    buf[i++] = byte;
+  }
+  return i;
+}
+
+UPB_INLINE uint32_t _upb_zzencode_32(int32_t n) {
+  return ((uint32_t)n << 1) ^ (n >> 31);
+}
+
+UPB_INLINE uint64_t _upb_zzencode_64(int64_t n) {
+  return ((uint64_t)n << 1) ^ (n >> 63);
+}
+
+/* Grows the buffer so that at least |bytes| more bytes fit before e->ptr. */
+bool _upb_encode_growbuffer(upb_encstate *e, size_t bytes);
+
+/* Call to ensure that at least "bytes" bytes are available for writing at
+ * e->ptr.  Returns false if the bytes could not be allocated. */
+UPB_INLINE bool _upb_encode_reserve(upb_encstate *e, size_t bytes) {
+  if (UPB_UNLIKELY((size_t)(e->ptr - e->buf) < bytes) &&
+      !_upb_encode_growbuffer(e, bytes)) {
+    return false;
+  }
+
+  e->ptr -= bytes;
+  return true;
+}
+
+/* Writes the given bytes to the buffer, handling reserve/advance. */
+UPB_INLINE bool _upb_encode_bytes(upb_encstate *e, const void *data,
+                                  size_t len) {
+  if (!_upb_encode_reserve(e, len)) return false;
+  memcpy(e->ptr, data, len);
+  return true;
+}
+
+UPB_INLINE bool _upb_encode_fixed64(upb_encstate *e, uint64_t val) {
+  /* TODO(haberman): byte-swap for big endian. */
+  return _upb_encode_bytes(e, &val, sizeof(uint64_t));
+}
+
+UPB_INLINE bool _upb_encode_fixed32(upb_encstate *e, uint32_t val) {
+  /* TODO(haberman): byte-swap for big endian. */
+  return _upb_encode_bytes(e, &val, sizeof(uint32_t));
+}
+
+UPB_INLINE bool _upb_encode_varint(upb_encstate *e, uint64_t val) {
+  size_t len;
+  char *start;
+  if (val < 128) {
+    if (!_upb_encode_reserve(e, 1)) return false;
+    *e->ptr = val;
+    return true;
+  }
+  if (!_upb_encode_reserve(e, UPB_PB_VARINT_MAX_LEN)) return false;
+  len = _upb_vencode(val, e->ptr);
+  start = e->ptr + UPB_PB_VARINT_MAX_LEN - len;
+  memmove(start, e->ptr, len);
+  e->ptr = start;
+  return true;
+}
+
+UPB_INLINE bool _upb_encode_double(upb_encstate *e, double d) {
+  uint64_t u64;
+  UPB_ASSERT(sizeof(double) == sizeof(uint64_t));
+  memcpy(&u64, &d, sizeof(uint64_t));
+  return _upb_encode_fixed64(e, u64);
+}
+
+UPB_INLINE bool _upb_encode_float(upb_encstate *e, float d) {
+  uint32_t u32;
+  UPB_ASSERT(sizeof(float) == sizeof(uint32_t));
+  memcpy(&u32, &d, sizeof(uint32_t));
+  return _upb_encode_fixed32(e, u32);
+}
+
+/* Writes a tag that is already encoded as the |len| bytes in |tag|. */
+UPB_INLINE bool _upb_encode_tag(upb_encstate *e, const char *tag, size_t len) {
+  return _upb_encode_bytes(e, tag, len);
+}
+
+/* A string or bytes field: its data, length and tag. */
+UPB_INLINE bool _upb_encode_strfield(upb_encstate *e, upb_strview str,
+                                     const char *tag, size_t len) {
+  return _upb_encode_bytes(e, str.data, str.size) &&
+         _upb_encode_varint(e, str.size) && _upb_encode_tag(e, tag, len);
+}
+
+/* A repeated string or bytes field, elements last to first. */
+UPB_INLINE bool _upb_encode_strarray(upb_encstate *e, const upb_array *arr,
+                                     const char *tag, size_t len) {
+  const upb_strview *start, *ptr;
+  if (arr == NULL || arr->len == 0) return true;
+  start = (const upb_strview*)arr->data;
+  ptr = start + arr->len;
+  do {
+    ptr--;
+    if (!_upb_encode_strfield(e, *ptr, tag, len)) return false;
+  } while (ptr != start);
+  return true;
+}
+
+/* A packed array of fixed-size elements, with its length and tag. */
+UPB_INLINE bool _upb_encode_fixedarray(upb_encstate *e, const upb_array *arr,
+                                       size_t elem_size, const char *tag,
+                                       size_t len) {
+  size_t bytes;
+  if (arr == NULL || arr->len == 0) return true;
+  bytes = arr->len * elem_size;
+  return _upb_encode_bytes(e, arr->data, bytes) &&
+         _upb_encode_varint(e, bytes) && _upb_encode_tag(e, tag, len);
+}
+
+/* Writes the unknown fields of |msg|, which come before all of its other
+ * fields. */
+UPB_INLINE bool _upb_encode_unknown(upb_encstate *e, const char *msg) {
+  size_t size;
+  const char *unknown = upb_msg_getunknown(msg, &size);
+  return size == 0 || _upb_encode_bytes(e, unknown, size);
+}
+
+/* Writes the extensions of |msg|, which come after its unknown fields and
+ * before its other fields.  Nothing if |m| is not extendable. */
+bool _upb_encode_exts(upb_encstate *e, const char *msg,
+                      const upb_msglayout *m);
+
+/* Encodes |msg| and sets |size| to the number of bytes written, using the
+ * generated serializer of |m| if it has one. */
+bool _upb_encode_message(upb_encstate *e, const char *msg,
+                         const upb_msglayout *m, size_t *size);
+
+/* Encodes field |f| of |msg|, if it is present, with the generic encoder.
+ * Generated serializers use this for the field kinds they leave to it. */
+bool _upb_encode_field(upb_encstate *e, const char *msg,
+                       const upb_msglayout *m, const upb_msglayout_field *f);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#include "upb/port_undef.inc"
+
+#endif  /* UPB_ENCODE_INT_H_ */
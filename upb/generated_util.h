@@ -7,6 +7,7 @@
 #define UPB_GENERATED_UTIL_H_
 
 #include <stdint.h>
+#include "upb/decode.h"
 #include "upb/msg.h"
 
 #include "upb/port_def.inc"
@@ -39,14 +40,16 @@ UPB_INLINE void *_upb_array_mutable_accessor(void *msg, size_t ofs,
 
 /* TODO(haberman): this is a mess.  It will improve when upb_array no longer
  * carries reflective state (type, elem_size). */
+/* A new array holds UPB_MAX(size, init_size) elements inline (see
+ * _upb_array_new()), where upbc chooses init_size for each field. */
 UPB_INLINE void *_upb_array_resize_accessor(void *msg, size_t ofs, size_t size,
-                                            size_t elem_size,
+                                            size_t elem_size, size_t init_size,
                                             upb_fieldtype_t type,
                                             upb_arena *arena) {
   upb_array *arr = *PTR_AT(msg, ofs, upb_array*);
 
   if (!arr) {
-    arr = upb_array_new(arena);
+    arr = _upb_array_new(arena, UPB_MAX(size, init_size), elem_size);
     if (!arr) return NULL;
     *PTR_AT(msg, ofs, upb_array*) = arr;
   }
@@ -69,19 +72,53 @@ UPB_INLINE void *_upb_array_resize_accessor(void *msg, size_t ofs, size_t size,
 }
 
 UPB_INLINE bool _upb_array_append_accessor(void *msg, size_t ofs,
-                                           size_t elem_size,
+                                           size_t elem_size, size_t init_size,
                                            upb_fieldtype_t type,
                                            const void *value,
                                            upb_arena *arena) {
   upb_array *arr = *PTR_AT(msg, ofs, upb_array*);
   size_t i = arr ? arr->len : 0;
-  void *data =
-      _upb_array_resize_accessor(msg, ofs, i + 1, elem_size, type, arena);
+  void *data = _upb_array_resize_accessor(msg, ofs, i + 1, elem_size,
+                                          init_size, type, arena);
   if (!data) return false;
   memcpy(PTR_AT(data, i * elem_size, char), value, elem_size);
   return true;
 }
 
+UPB_INLINE const void *_upb_lazymsg_accessor(const void *msg, size_t ofs,
+                                             const upb_msglayout *l) {
+  const void *sub = *PTR_AT(msg, ofs, const void*);
+  if (UPB_UNLIKELY(_upb_islazy(sub))) {
+    return _upb_decode_lazy((upb_msg*)msg, ofs, l);
+  }
+  return sub;
+}
+
+UPB_INLINE size_t _upb_msg_map_size(const void *msg, size_t ofs) {
+  return _upb_map_size(*PTR_AT(msg, ofs, const upb_map*));
+}
+
+UPB_INLINE bool _upb_msg_map_get(const void *msg, size_t ofs, const void *key,
+                                 void *val) {
+  return _upb_map_get(*PTR_AT(msg, ofs, const upb_map*), key, val);
+}
+
+UPB_INLINE bool _upb_msg_map_next(const void *msg, size_t ofs, size_t *iter,
+                                  void *key, void *val) {
+  return _upb_map_next(*PTR_AT(msg, ofs, const upb_map*), iter, key, val);
+}
+
+UPB_INLINE bool _upb_msg_map_set(void *msg, size_t ofs, const void *key,
+                                 const void *val, const upb_msglayout *entry,
+                                 upb_arena *arena) {
+  upb_map *map = _upb_msg_getmap(msg, ofs, entry, true, arena);
+  return map && _upb_map_set(map, key, val);
+}
+
+UPB_INLINE bool _upb_msg_map_delete(void *msg, size_t ofs, const void *key) {
+  return _upb_map_delete(*PTR_AT(msg, ofs, upb_map*), key);
+}
+
 UPB_INLINE bool _upb_has_field(const void *msg, size_t idx) {
   return (*PTR_AT(msg, idx / 8, const char) & (1 << (idx % 8))) != 0;
 }
@@ -223,6 +223,7 @@ SETTER(startseq,    upb_startfield_handlerfunc*,  UPB_HANDLER_STARTSEQ)
 SETTER(startsubmsg, upb_startfield_handlerfunc*,  UPB_HANDLER_STARTSUBMSG)
 SETTER(endsubmsg,   upb_endfield_handlerfunc*,    UPB_HANDLER_ENDSUBMSG)
 SETTER(endseq,      upb_endfield_handlerfunc*,    UPB_HANDLER_ENDSEQ)
+SETTER(bulk,        upb_bulk_handlerfunc*,        UPB_HANDLER_BULK)
 
 #undef SETTER
 
@@ -305,6 +306,21 @@ upb_handlertype_t upb_handlers_getprimitivehandlertype(const upb_fielddef *f) {
   }
 }
 
+/* Warning: also in upb/def.c. */
+static bool upb_handlers_isfixedwidth(const upb_fielddef *f) {
+  switch (upb_fielddef_descriptortype(f)) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      return true;
+    default:
+      return false;
+  }
+}
+
 bool upb_handlers_getselector(const upb_fielddef *f, upb_handlertype_t type,
                               upb_selector_t *s) {
   uint32_t selector_base = upb_fielddef_selectorbase(f);
@@ -364,6 +380,12 @@ bool upb_handlers_getselector(const upb_fielddef *f, upb_handlertype_t type,
       if (!upb_fielddef_issubmsg(f)) return false;
       *s = selector_base;
       break;
+    case UPB_HANDLER_BULK:
+      if (!upb_fielddef_isseq(f) || !upb_handlers_isfixedwidth(f)) {
+        return false;
+      }
+      *s = selector_base + 1;
+      break;
   }
   UPB_ASSERT((size_t)*s < upb_msgdef_selectorcount(upb_fielddef_containingtype(f)));
   return true;
@@ -376,6 +398,7 @@ struct upb_handlercache {
   upb_inttable tab;  /* maps upb_msgdef* -> upb_handlers*. */
   upb_handlers_callback *callback;
   const void *closure;
+  bool frozen;  /* If set, |tab| is no longer modified. */
 };
 
 const upb_handlers *upb_handlercache_get(upb_handlercache *c,
@@ -386,6 +409,8 @@ const upb_handlers *upb_handlercache_get(upb_handlercache *c,
 
   if (upb_inttable_lookupptr(&c->tab, md, &v)) {
     return upb_value_getptr(v);
+  } else if (c->frozen) {
+    return NULL;
   }
 
   h = upb_handlers_new(md, c, c->arena);
@@ -427,6 +452,7 @@ upb_handlercache *upb_handlercache_new(upb_handlers_callback *callback,
 
   cache->callback = callback;
   cache->closure = closure;
+  cache->frozen = false;
 
   if (!upb_inttable_init(&cache->tab, UPB_CTYPE_PTR)) goto oom;
 
@@ -448,6 +474,31 @@ bool upb_handlercache_addcleanup(upb_handlercache *c, void *p,
   return upb_arena_addcleanup(c->arena, p, func);
 }
 
+bool upb_handlercache_addsymtab(upb_handlercache *c, const upb_symtab *s) {
+  upb_symtab_iter iter;
+
+  UPB_ASSERT(!c->frozen);
+
+  for (upb_symtab_begin(&iter, s); !upb_symtab_done(&iter);
+       upb_symtab_next(&iter)) {
+    const upb_filedef *f = upb_symtab_iter_file(&iter);
+    int i;
+    for (i = 0; i < upb_filedef_msgcount(f); i++) {
+      if (!upb_handlercache_get(c, upb_filedef_msg(f, i))) return false;
+    }
+  }
+
+  return true;
+}
+
+void upb_handlercache_freeze(upb_handlercache *c) {
+  c->frozen = true;
+}
+
+bool upb_handlercache_isfrozen(const upb_handlercache *c) {
+  return c->frozen;
+}
+
 /* upb_byteshandler ***********************************************************/
 
 bool upb_byteshandler_setstartstr(upb_byteshandler *h,
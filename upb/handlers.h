@@ -59,10 +59,11 @@ typedef enum {
   UPB_HANDLER_STARTSUBMSG,
   UPB_HANDLER_ENDSUBMSG,
   UPB_HANDLER_STARTSEQ,
-  UPB_HANDLER_ENDSEQ
+  UPB_HANDLER_ENDSEQ,
+  UPB_HANDLER_BULK
 } upb_handlertype_t;
 
-#define UPB_HANDLER_MAX (UPB_HANDLER_ENDSEQ+1)
+#define UPB_HANDLER_MAX (UPB_HANDLER_BULK+1)
 
 #define UPB_BREAK NULL
 
@@ -119,6 +120,12 @@ typedef struct {
   const void *obj;
   const void *objtype;
 
+  /* If not NULL, the arena that owns the buffer: it stays valid for as long
+   * as the arena does.  A string handler can then keep pointers into the
+   * buffer after it returns, instead of copying, by tying the lifetime of its
+   * own data to this arena with upb_bufhandle_retain(). */
+  upb_arena *arena;
+
 #ifdef __cplusplus
   template <class T>
   void SetAttachedObject(const T* _obj) {
@@ -134,7 +141,15 @@ typedef struct {
 #endif
 } upb_bufhandle;
 
-#define UPB_BUFHANDLE_INIT {NULL, 0, NULL, NULL}
+#define UPB_BUFHANDLE_INIT {NULL, 0, NULL, NULL, NULL}
+
+/* Makes the buffer of |h| live at least as long as |a|, by fusing |a| with the
+ * arena that owns it (see upb_arena_fuse()).  Returns false if the buffer has
+ * no arena (or there is no handle at all) or the arenas can't be fused: then
+ * the data must be copied to be kept past the handler call. */
+UPB_INLINE bool upb_bufhandle_retain(const upb_bufhandle *h, upb_arena *a) {
+  return h && h->arena && upb_arena_fuse(a, h->arena);
+}
 
 /* Handler function typedefs. */
 typedef void upb_handlerfree(void *d);
@@ -156,6 +171,14 @@ typedef void *upb_startstr_handlerfunc(void *c, const void *hd,
 typedef size_t upb_string_handlerfunc(void *c, const void *hd, const char *buf,
                                       size_t n, const upb_bufhandle* handle);
 
+/* Receives a run of values of a repeated double, float, [s]fixed32 or
+ * [s]fixed64 field as they appear on the wire: |n| bytes (a whole number of
+ * values) of little-endian values, not necessarily aligned.  Sources that can
+ * deliver packed data in spans call this instead of the per-value handler when
+ * it is set, so a little-endian sink can consume whole arrays with memcpy(). */
+typedef bool upb_bulk_handlerfunc(void *c, const void *hd, const char *buf,
+                                  size_t n);
+
 struct upb_handlers;
 typedef struct upb_handlers upb_handlers;
 
@@ -216,6 +239,9 @@ bool upb_handlers_setendsubmsg(upb_handlers *h, const upb_fielddef *f,
 bool upb_handlers_setendseq(upb_handlers *h, const upb_fielddef *f,
                             upb_endfield_handlerfunc *func,
                             const upb_handlerattr *attr);
+bool upb_handlers_setbulk(upb_handlers *h, const upb_fielddef *f,
+                          upb_bulk_handlerfunc *func,
+                          const upb_handlerattr *attr);
 
 /* Read-only accessors. */
 const upb_handlers *upb_handlers_getsubhandlers(const upb_handlers *h,
@@ -594,7 +620,12 @@ class upb::HandlersPtr {
 
 /* A upb_handlercache lazily builds and caches upb_handlers.  You pass it a
  * function (with optional closure) that can build handlers for a given
- * message on-demand, and the cache maintains a map of msgdef->handlers. */
+ * message on-demand, and the cache maintains a map of msgdef->handlers.
+ *
+ * Building handlers modifies the cache, so a cache must not be used from
+ * several threads at once until it is frozen.  To share one, build the
+ * handlers that will be needed (eg. with upb_handlercache_addsymtab()), then
+ * call upb_handlercache_freeze(). */
 
 #ifdef __cplusplus
 extern "C" {
@@ -613,6 +644,17 @@ const upb_handlers *upb_handlercache_get(upb_handlercache *cache,
 bool upb_handlercache_addcleanup(upb_handlercache *h, void *p,
                                  upb_handlerfree *hfree);
 
+/* Builds the handlers for every message of every file in |s| that has been
+ * built (see upb_symtab_buildall()).  Returns false on allocation failure. */
+bool upb_handlercache_addsymtab(upb_handlercache *cache, const upb_symtab *s);
+
+/* Stops building handlers: afterwards upb_handlercache_get() returns the
+ * handlers built so far, and NULL for any other message, without modifying
+ * the cache.  A frozen cache and its handlers may be shared by any number of
+ * threads, until it is freed. */
+void upb_handlercache_freeze(upb_handlercache *cache);
+bool upb_handlercache_isfrozen(const upb_handlercache *cache);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 
@@ -630,6 +672,13 @@ class upb::HandlerCache {
     return upb_handlercache_get(ptr_.get(), md.ptr());
   }
 
+  bool AddSymtab(const SymbolTable& s) {
+    return upb_handlercache_addsymtab(ptr_.get(), s.ptr());
+  }
+
+  void Freeze() { upb_handlercache_freeze(ptr_.get()); }
+  bool frozen() const { return upb_handlercache_isfrozen(ptr_.get()); }
+
  private:
   std::unique_ptr<upb_handlercache, decltype(&upb_handlercache_free)> ptr_;
 };
@@ -0,0 +1,1384 @@
+/*
+** upb_json_decode: a recursive descent JSON parser that stores each value in
+** the message as soon as it is parsed, with upb_decode()'s representation of
+** fields and presence.  It accepts what upb_json_parser accepts.
+*/
+
+#include "upb/json/decode.h"
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "upb/decode.int.h"
+#include "upb/json/escape.int.h"
+
+#include "upb/port_def.inc"
+
+#define CHK(x) do { if (!(x)) { return false; } } while(0)
+
+/* Objects and arrays can nest this deep, counting every level of
+ * well-known types like Struct. */
+#define UPB_JSONDEC_MAXDEPTH 64
+
+/* Bounds the size of a message's name table.  Finding a collision-free seed
+ * for a table that is at most half full takes a few tries at most. */
+#define UPB_JSONDEC_MAXSLOTS (1 << 20)
+#define UPB_JSONDEC_SEEDS 32
+
+/* The arrays and fields of each descriptortype keep their values in this many
+ * bytes. */
+static const uint8_t jsondec_elemsize[] = {
+  0,
+  8,                   /* DOUBLE */
+  4,                   /* FLOAT */
+  8,                   /* INT64 */
+  8,                   /* UINT64 */
+  4,                   /* INT32 */
+  8,                   /* FIXED64 */
+  4,                   /* FIXED32 */
+  1,                   /* BOOL */
+  sizeof(upb_strview), /* STRING */
+  sizeof(void*),       /* GROUP */
+  sizeof(void*),       /* MESSAGE */
+  sizeof(upb_strview), /* BYTES */
+  4,                   /* UINT32 */
+  4,                   /* ENUM */
+  4,                   /* SFIXED32 */
+  8,                   /* SFIXED64 */
+  4,                   /* SINT32 */
+  8,                   /* SINT64 */
+};
+
+/* upb_jsondeccache ***********************************************************/
+
+struct jsondec_type;
+
+typedef struct {
+  const upb_msglayout_field *field;
+  const upb_fielddef *f;
+  /* For message and map fields, the type of the submessage or map entry.
+   * NULL until the field is first parsed. */
+  const struct jsondec_type *sub;
+} jsondec_field;
+
+/* A slot in a message's perfect hash table of field names. */
+typedef struct {
+  const char *name;  /* NULL for an empty slot. */
+  size_t len;
+  const jsondec_field *field;
+} jsondec_slot;
+
+typedef struct jsondec_type {
+  const upb_msgdef *m;
+  const upb_msglayout *l;
+  upb_wellknowntype_t wkt;
+  jsondec_field *fields;  /* In layout order, l->field_count of them. */
+  /* Every field's JSON name and (if it differs) .proto name hashes with
+   * |seed| to a different one of the mask + 1 slots, so a lookup is one hash
+   * and one string comparison. */
+  jsondec_slot *slots;
+  uint32_t seed;
+  uint32_t mask;
+} jsondec_type;
+
+struct upb_jsondeccache {
+  upb_arena *arena;  /* Where the types and names live. */
+  upb_inttable types;  /* upb_msglayout* -> jsondec_type* */
+};
+
+upb_jsondeccache *upb_jsondeccache_new(void) {
+  upb_jsondeccache *c = upb_gmalloc(sizeof(*c));
+  if (!c) return NULL;
+
+  c->arena = upb_arena_new();
+  if (!c->arena ||
+      !upb_inttable_init2(&c->types, UPB_CTYPE_CONSTPTR,
+                          upb_arena_alloc(c->arena))) {
+    if (c->arena) upb_arena_free(c->arena);
+    upb_gfree(c);
+    return NULL;
+  }
+
+  return c;
+}
+
+void upb_jsondeccache_free(upb_jsondeccache *c) {
+  /* The table is in the arena too. */
+  upb_arena_free(c->arena);
+  upb_gfree(c);
+}
+
+static uint32_t jsondec_hash(const char *name, size_t len, uint32_t seed) {
+  /* FNV-1a, seeded, with the high bits folded into the low ones that pick
+   * the slot. */
+  uint32_t h = 2166136261U ^ seed;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619U;
+  }
+  return h ^ (h >> 16);
+}
+
+/* Finds a seed and table size for which no two of the |count| names share a
+ * slot. */
+static bool jsondec_placenames(jsondec_type *t, const jsondec_slot *names,
+                               size_t count, upb_arena *a) {
+  size_t size = 1;
+  while (size < count * 2) size *= 2;
+
+  for (; size <= UPB_JSONDEC_MAXSLOTS; size *= 2) {
+    jsondec_slot *slots = upb_arena_malloc(a, size * sizeof(*slots));
+    uint32_t seed;
+    if (!slots) return false;
+
+    for (seed = 0; seed < UPB_JSONDEC_SEEDS; seed++) {
+      size_t i;
+      memset(slots, 0, size * sizeof(*slots));
+      for (i = 0; i < count; i++) {
+        jsondec_slot *slot =
+            &slots[jsondec_hash(names[i].name, names[i].len, seed) &
+                   (size - 1)];
+        if (slot->name) break;
+        *slot = names[i];
+      }
+      if (i == count) {
+        t->slots = slots;
+        t->seed = seed;
+        t->mask = (uint32_t)(size - 1);
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/* Adds |name| to |names| unless some field already has it. */
+static void jsondec_addname(jsondec_slot *names, size_t *count,
+                            const char *name, size_t len,
+                            const jsondec_field *field) {
+  size_t i;
+  for (i = 0; i < *count; i++) {
+    if (names[i].len == len && memcmp(names[i].name, name, len) == 0) return;
+  }
+  names[*count].name = name;
+  names[*count].len = len;
+  names[*count].field = field;
+  (*count)++;
+}
+
+static const jsondec_type *jsondec_gettype(upb_jsondeccache *c,
+                                           const upb_msgdef *m,
+                                           const upb_msglayout *l) {
+  upb_value v;
+  jsondec_type *t;
+  jsondec_slot *names;
+  size_t count = 0;
+  int i;
+
+  if (upb_inttable_lookupptr(&c->types, l, &v)) {
+    return upb_value_getconstptr(v);
+  }
+
+  t = upb_arena_malloc(c->arena, sizeof(*t));
+  if (!t) return NULL;
+  t->m = m;
+  t->l = l;
+  t->wkt = upb_msgdef_wellknowntype(m);
+  t->fields = upb_arena_malloc(c->arena,
+                               UPB_MAX(l->field_count, 1) * sizeof(*t->fields));
+  names = upb_arena_malloc(c->arena,
+                           UPB_MAX(l->field_count, 1) * 2 * sizeof(*names));
+  if (!t->fields || !names) return NULL;
+
+  for (i = 0; i < l->field_count; i++) {
+    jsondec_field *jf = &t->fields[i];
+    const char *name;
+    char *jsonname;
+    size_t jsonlen;
+
+    jf->field = &l->fields[i];
+    jf->f = upb_msgdef_itof(m, jf->field->number);
+    jf->sub = NULL;
+    UPB_ASSERT(jf->f);
+
+    /* The length includes the NUL. */
+    jsonlen = upb_fielddef_getjsonname(jf->f, NULL, 0);
+    jsonname = upb_arena_malloc(c->arena, jsonlen);
+    if (!jsonname) return NULL;
+    upb_fielddef_getjsonname(jf->f, jsonname, jsonlen);
+    jsondec_addname(names, &count, jsonname, jsonlen - 1, jf);
+
+    name = upb_fielddef_name(jf->f);
+    jsondec_addname(names, &count, name, strlen(name), jf);
+  }
+
+  if (!jsondec_placenames(t, names, count, c->arena) ||
+      !upb_inttable_insertptr2(&c->types, l, upb_value_constptr(t),
+                               upb_arena_alloc(c->arena))) {
+    return NULL;
+  }
+
+  return t;
+}
+
+/* The type of |jf|'s submessage or map entry. */
+static const jsondec_type *jsondec_subtype(upb_jsondeccache *c,
+                                           const jsondec_type *t,
+                                           const jsondec_field *jf) {
+  if (!jf->sub) {
+    const upb_msglayout *subl = t->l->submsgs[jf->field->submsg_index];
+    /* Only the cache ever writes this. */
+    ((jsondec_field*)jf)->sub =
+        jsondec_gettype(c, upb_fielddef_msgsubdef(jf->f), subl);
+  }
+  return jf->sub;
+}
+
+static const jsondec_field *jsondec_lookup(const jsondec_type *t,
+                                           const char *name, size_t len) {
+  const jsondec_slot *slot = &t->slots[jsondec_hash(name, len, t->seed) &
+                                       t->mask];
+  if (slot->name && slot->len == len && memcmp(slot->name, name, len) == 0) {
+    return slot->field;
+  }
+  return NULL;
+}
+
+/* The field with |number| of a well-known type. */
+static const jsondec_field *jsondec_wktfield(const jsondec_type *t,
+                                             uint32_t number) {
+  int i;
+  for (i = 0; i < t->l->field_count; i++) {
+    if (t->fields[i].field->number == number) return &t->fields[i];
+  }
+  return NULL;
+}
+
+/* Input **********************************************************************/
+
+typedef struct {
+  const char *ptr, *end;
+  const char *buf;  /* Start of the input, for error messages. */
+  upb_arena *arena;
+  upb_jsondeccache *cache;
+  upb_status *status;
+  int depth;  /* How much deeper objects and arrays may nest. */
+  int options;
+} jsondec;
+
+static bool jsondec_err(jsondec *d, const char *msg) {
+  upb_status_seterrf(d->status, "%s at offset %d", msg,
+                     (int)(d->ptr - d->buf));
+  return false;
+}
+
+static bool jsondec_oom(jsondec *d) {
+  upb_status_setoom(d->status);
+  return false;
+}
+
+static void jsondec_skipws(jsondec *d) {
+  for (; d->ptr != d->end; d->ptr++) {
+    switch (*d->ptr) {
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        break;
+      default:
+        return;
+    }
+  }
+}
+
+/* The first character of the next token, or 0 at the end of the input. */
+static char jsondec_peek(jsondec *d) {
+  jsondec_skipws(d);
+  return d->ptr == d->end ? 0 : *d->ptr;
+}
+
+static bool jsondec_consume(jsondec *d, char c) {
+  if (jsondec_peek(d) != c) {
+    upb_status_seterrf(d->status, "expected '%c' at offset %d", c,
+                       (int)(d->ptr - d->buf));
+    return false;
+  }
+  d->ptr++;
+  return true;
+}
+
+static bool jsondec_literal(jsondec *d, const char *lit) {
+  size_t len = strlen(lit);
+  jsondec_skipws(d);
+  if ((size_t)(d->end - d->ptr) < len || memcmp(d->ptr, lit, len) != 0) {
+    return jsondec_err(d, "unexpected character");
+  }
+  d->ptr += len;
+  return true;
+}
+
+/* Called before each member of an object or element of an array: returns
+ * true if there is another, after consuming the comma before it, and false
+ * after consuming |close|.  Sets |ok| to false on a syntax error. */
+static bool jsondec_seqnext(jsondec *d, char close, bool *first, bool *ok) {
+  char c = jsondec_peek(d);
+  *ok = true;
+  if (c == close) {
+    d->ptr++;
+    return false;
+  }
+  if (!*first) {
+    if (c != ',') {
+      *ok = jsondec_err(d, close == '}' ? "expected ',' or '}'"
+                                        : "expected ',' or ']'");
+      return false;
+    }
+    d->ptr++;
+  }
+  *first = false;
+  return true;
+}
+
+static bool jsondec_push(jsondec *d) {
+  if (--d->depth < 0) return jsondec_err(d, "nesting too deep");
+  return true;
+}
+
+/* Strings ********************************************************************/
+
+static bool jsondec_hex4(const char *p, uint32_t *val) {
+  int i;
+  *val = 0;
+  for (i = 0; i < 4; i++) {
+    char c = p[i];
+    *val <<= 4;
+    if (c >= '0' && c <= '9') {
+      *val |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      *val |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      *val |= c - 'A' + 10;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static size_t jsondec_utf8(uint32_t cp, char *out) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  } else if (cp < 0x800) {
+    out[0] = (char)(0xc0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3f));
+    return 2;
+  } else if (cp < 0x10000) {
+    out[0] = (char)(0xe0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[2] = (char)(0x80 | (cp & 0x3f));
+    return 3;
+  } else {
+    out[0] = (char)(0xf0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+  }
+}
+
+/* Unescapes the string contents [p, end) into |out|, which has room for
+ * end - p bytes: no escape is shorter than what it stands for. */
+static bool jsondec_unescape(jsondec *d, const char *p, const char *end,
+                             char *out, size_t *len) {
+  char *start = out;
+
+  while (p < end) {
+    const char *esc = memchr(p, '\\', end - p);
+    if (!esc) esc = end;
+    memcpy(out, p, esc - p);
+    out += esc - p;
+    p = esc;
+    if (p == end) break;
+
+    /* The scan that found the end of the string made sure a character
+     * follows every backslash. */
+    switch (p[1]) {
+      case '"':  *out++ = '"'; break;
+      case '\\': *out++ = '\\'; break;
+      case '/':  *out++ = '/'; break;
+      case 'b':  *out++ = '\b'; break;
+      case 'f':  *out++ = '\f'; break;
+      case 'n':  *out++ = '\n'; break;
+      case 'r':  *out++ = '\r'; break;
+      case 't':  *out++ = '\t'; break;
+      case 'u': {
+        uint32_t cp;
+        if (end - p < 6 || !jsondec_hex4(p + 2, &cp)) {
+          d->ptr = p;
+          return jsondec_err(d, "invalid \\u escape");
+        }
+        if (cp >= 0xd800 && cp <= 0xdbff) {
+          /* A high surrogate, which must be followed by a low one. */
+          uint32_t low;
+          if (end - p < 12 || p[6] != '\\' || p[7] != 'u' ||
+              !jsondec_hex4(p + 8, &low) || low < 0xdc00 || low > 0xdfff) {
+            d->ptr = p;
+            return jsondec_err(d, "invalid surrogate pair");
+          }
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+          p += 6;
+        } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+          d->ptr = p;
+          return jsondec_err(d, "invalid surrogate pair");
+        }
+        out += jsondec_utf8(cp, out);
+        p += 4;
+        break;
+      }
+      default:
+        d->ptr = p;
+        return jsondec_err(d, "invalid escape");
+    }
+    p += 2;
+  }
+
+  *len = out - start;
+  return true;
+}
+
+/* Parses a string.  Without escapes and with |alias| set, |str| points into
+ * the input; otherwise the string is copied into the arena. */
+static bool jsondec_string(jsondec *d, upb_strview *str, bool alias) {
+  const char *start;
+  const char *p;
+  bool escaped = false;
+
+  CHK(jsondec_consume(d, '"'));
+  start = p = d->ptr;
+
+  for (;;) {
+    p = _upb_json_findescape(p, d->end);
+    if (p == d->end) {
+      return jsondec_err(d, "unterminated string");
+    } else if (*p == '"') {
+      break;
+    } else if (*p == '\\') {
+      escaped = true;
+      if (++p == d->end) return jsondec_err(d, "unterminated string");
+      p++;
+    } else {
+      d->ptr = p;
+      return jsondec_err(d, "control character in string");
+    }
+  }
+
+  if (!escaped && alias) {
+    str->data = start;
+    str->size = p - start;
+  } else {
+    char *data = upb_arena_malloc(d->arena, UPB_MAX(p - start, 1));
+    if (!data) return jsondec_oom(d);
+    if (escaped) {
+      CHK(jsondec_unescape(d, start, p, data, &str->size));
+    } else {
+      memcpy(data, start, p - start);
+      str->size = p - start;
+    }
+    str->data = data;
+  }
+
+  d->ptr = p + 1;
+  return true;
+}
+
+/* Decodes base64 with or without padding into the arena. */
+static bool jsondec_base64(jsondec *d, upb_strview in, upb_strview *out) {
+  const char *p = in.data;
+  const char *end = in.data + in.size;
+  char *data;
+  char *to;
+  size_t decoded;
+
+  if (in.size % 4 == 0 && in.size > 0 && end[-1] == '=') {
+    end--;
+    if (end[-1] == '=') end--;
+  }
+  if ((end - p) % 4 == 1) return jsondec_err(d, "invalid base64");
+
+  data = to = upb_arena_malloc(d->arena, UPB_MAX((end - p) / 4 * 3 + 2, 1));
+  if (!data) return jsondec_oom(d);
+
+  decoded = _upb_json_unbase64(p, (end - p) / 4 * 4, to);
+  if (decoded != (size_t)(end - p) / 4 * 4) {
+    return jsondec_err(d, "invalid base64");
+  }
+  p += decoded;
+  to += decoded / 4 * 3;
+
+  if (p < end) {
+    /* 3 or 2 characters left, giving 2 or 1 bytes. */
+    int n = (int)(end - p);
+    uint32_t bits = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+      int val = i < n ? _upb_json_base64val(p[i]) : 0;
+      if (val < 0) return jsondec_err(d, "invalid base64");
+      bits = bits << 6 | val;
+    }
+    to[0] = (char)(bits >> 16);
+    if (n > 2) to[1] = (char)(bits >> 8);
+    to += n - 1;
+  }
+
+  out->data = data;
+  out->size = to - data;
+  return true;
+}
+
+/* Numbers ********************************************************************/
+
+static bool jsondec_isdigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+/* Returns the end of the JSON number at the start of [p, end), or NULL if
+ * there isn't one. */
+static const char *jsondec_scannum(const char *p, const char *end) {
+  if (p != end && *p == '-') p++;
+  if (p == end || !jsondec_isdigit(*p)) return NULL;
+  if (*p == '0') {
+    p++;
+  } else {
+    while (p != end && jsondec_isdigit(*p)) p++;
+  }
+  if (p != end && *p == '.') {
+    p++;
+    if (p == end || !jsondec_isdigit(*p)) return NULL;
+    while (p != end && jsondec_isdigit(*p)) p++;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p != end && (*p == '+' || *p == '-')) p++;
+    if (p == end || !jsondec_isdigit(*p)) return NULL;
+    while (p != end && jsondec_isdigit(*p)) p++;
+  }
+  return p;
+}
+
+/* The text of a number, which may be in quotes if |quoted| is allowed. */
+static bool jsondec_numtext(jsondec *d, upb_strview *text, bool quoted) {
+  const char *end;
+
+  if (quoted && jsondec_peek(d) == '"') {
+    CHK(jsondec_string(d, text, true));
+    if (jsondec_scannum(text->data, text->data + text->size) !=
+        text->data + text->size) {
+      return jsondec_err(d, "invalid number");
+    }
+    return true;
+  }
+
+  jsondec_skipws(d);
+  end = jsondec_scannum(d->ptr, d->end);
+  if (!end) return jsondec_err(d, "invalid number");
+  text->data = d->ptr;
+  text->size = end - d->ptr;
+  d->ptr = end;
+  return true;
+}
+
+static bool jsondec_strtod(jsondec *d, upb_strview text, double *val) {
+  char buf[64];
+  char *str = buf;
+  char *end;
+
+  /* strtod() needs a NUL-terminated string. */
+  if (text.size >= sizeof(buf)) {
+    str = upb_arena_malloc(d->arena, text.size + 1);
+    if (!str) return jsondec_oom(d);
+  }
+  memcpy(str, text.data, text.size);
+  str[text.size] = '\0';
+
+  errno = 0;
+  *val = strtod(str, &end);
+  if (end != str + text.size) return jsondec_err(d, "invalid number");
+  if (errno == ERANGE && (*val == HUGE_VAL || *val == -HUGE_VAL)) {
+    return jsondec_err(d, "number out of range");
+  }
+  return true;
+}
+
+/* Accumulates the decimal digits [p, end) into |val|.  Returns false if there
+ * is anything else, or on overflow. */
+static bool jsondec_digits(const char *p, const char *end, uint64_t *val) {
+  const uint64_t max = (uint64_t)-1;
+  *val = 0;
+  for (; p < end; p++) {
+    unsigned digit = *p - '0';
+    if (digit > 9 || *val > (max - digit) / 10) return false;
+    *val = *val * 10 + digit;
+  }
+  return true;
+}
+
+/* Integers may be written like 1e3 or 1000.0, as long as they are integral,
+ * or in quotes. */
+static bool jsondec_int64(jsondec *d, int64_t *val) {
+  upb_strview text;
+  bool neg;
+  uint64_t mag;
+  double dbl;
+
+  CHK(jsondec_numtext(d, &text, true));
+  neg = text.data[0] == '-';
+  if (jsondec_digits(text.data + neg, text.data + text.size, &mag)) {
+    if (mag > (uint64_t)INT64_MAX + neg) {
+      return jsondec_err(d, "integer out of range");
+    }
+    *val = neg ? -(int64_t)(mag - 1) - 1 : (int64_t)mag;
+    return true;
+  }
+
+  CHK(jsondec_strtod(d, text, &dbl));
+  if (dbl != floor(dbl) || dbl < -9223372036854775808.0 ||
+      dbl >= 9223372036854775808.0) {
+    return jsondec_err(d, "integer out of range");
+  }
+  *val = (int64_t)dbl;
+  return true;
+}
+
+static bool jsondec_uint64(jsondec *d, uint64_t *val) {
+  upb_strview text;
+  double dbl;
+
+  CHK(jsondec_numtext(d, &text, true));
+  if (jsondec_digits(text.data, text.data + text.size, val)) return true;
+
+  CHK(jsondec_strtod(d, text, &dbl));
+  if (dbl != floor(dbl) || dbl < 0 || dbl >= 18446744073709551616.0) {
+    return jsondec_err(d, "integer out of range");
+  }
+  *val = (uint64_t)dbl;
+  return true;
+}
+
+static bool jsondec_double(jsondec *d, double *val) {
+  upb_strview text;
+
+  if (jsondec_peek(d) == '"') {
+    const char *start = d->ptr;
+    CHK(jsondec_string(d, &text, true));
+    if (text.size == 3 && memcmp(text.data, "NaN", 3) == 0) {
+      *val = UPB_INFINITY - UPB_INFINITY;
+      return true;
+    } else if (text.size == 8 && memcmp(text.data, "Infinity", 8) == 0) {
+      *val = UPB_INFINITY;
+      return true;
+    } else if (text.size == 9 && memcmp(text.data, "-Infinity", 9) == 0) {
+      *val = -UPB_INFINITY;
+      return true;
+    }
+    /* Otherwise a quoted number. */
+    d->ptr = start;
+  }
+
+  CHK(jsondec_numtext(d, &text, true));
+  return jsondec_strtod(d, text, val);
+}
+
+/* Values *********************************************************************/
+
+/* A value in the representation of a message field of its type. */
+typedef union {
+  bool b;
+  int32_t i32;
+  uint32_t u32;
+  int64_t i64;
+  uint64_t u64;
+  float flt;
+  double dbl;
+  upb_strview str;
+  upb_msg *msg;
+} jsondec_val;
+
+static bool jsondec_isnullvalue(const upb_fielddef *f) {
+  return upb_fielddef_descriptortype(f) == UPB_DESCRIPTOR_TYPE_ENUM &&
+         strcmp(upb_enumdef_fullname(upb_fielddef_enumsubdef(f)),
+                "google.protobuf.NullValue") == 0;
+}
+
+static bool jsondec_enum(jsondec *d, const upb_fielddef *f, int32_t *val,
+                         bool *skip) {
+  int64_t num;
+
+  if (jsondec_isnullvalue(f) && jsondec_peek(d) == 'n') {
+    *val = 0;
+    return jsondec_literal(d, "null");
+  }
+
+  if (jsondec_peek(d) == '"') {
+    upb_strview name;
+    CHK(jsondec_string(d, &name, true));
+    if (!upb_enumdef_ntoi(upb_fielddef_enumsubdef(f), name.data, name.size,
+                          val)) {
+      if (d->options & UPB_JSONDEC_IGNOREUNKNOWN) {
+        *skip = true;
+        return true;
+      }
+      return jsondec_err(d, "unknown enum value");
+    }
+    return true;
+  }
+
+  CHK(jsondec_int64(d, &num));
+  if (num < INT32_MIN || num > INT32_MAX) {
+    return jsondec_err(d, "enum value out of range");
+  }
+  *val = (int32_t)num;
+  return true;
+}
+
+/* Parses a value of a non-message type.  Sets |skip| if it is to be left
+ * out. */
+static bool jsondec_scalar(jsondec *d, const jsondec_field *jf,
+                           jsondec_val *val, bool *skip) {
+  switch (jf->field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+      return jsondec_double(d, &val->dbl);
+    case UPB_DESCRIPTOR_TYPE_FLOAT: {
+      double dbl;
+      CHK(jsondec_double(d, &dbl));
+      if ((dbl > FLT_MAX || dbl < -FLT_MAX) && dbl != UPB_INFINITY &&
+          dbl != -UPB_INFINITY) {
+        return jsondec_err(d, "float out of range");
+      }
+      val->flt = (float)dbl;
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32: {
+      int64_t num;
+      CHK(jsondec_int64(d, &num));
+      if (num < INT32_MIN || num > INT32_MAX) {
+        return jsondec_err(d, "integer out of range");
+      }
+      val->i32 = (int32_t)num;
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+    case UPB_DESCRIPTOR_TYPE_FIXED32: {
+      uint64_t num;
+      CHK(jsondec_uint64(d, &num));
+      if (num > UINT32_MAX) return jsondec_err(d, "integer out of range");
+      val->u32 = (uint32_t)num;
+      return true;
+    }
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      return jsondec_int64(d, &val->i64);
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      return jsondec_uint64(d, &val->u64);
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      val->b = jsondec_peek(d) == 't';
+      return jsondec_literal(d, val->b ? "true" : "false");
+    case UPB_DESCRIPTOR_TYPE_STRING:
+      return jsondec_string(d, &val->str, false);
+    case UPB_DESCRIPTOR_TYPE_BYTES: {
+      upb_strview str;
+      CHK(jsondec_string(d, &str, true));
+      return jsondec_base64(d, str, &val->str);
+    }
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      return jsondec_enum(d, jf->f, &val->i32, skip);
+  }
+  UPB_UNREACHABLE();
+}
+
+/* Map keys are always strings, whatever their type. */
+static bool jsondec_mapkey(jsondec *d, const jsondec_field *jf,
+                           jsondec_val *key) {
+  upb_strview str;
+  jsondec sub;
+  const char *start;
+
+  jsondec_skipws(d);
+  start = d->ptr;
+  CHK(jsondec_string(d, &str, true));
+  switch (jf->field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_STRING:
+      key->str = str;
+      return true;
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      if (str.size == 4 && memcmp(str.data, "true", 4) == 0) {
+        key->b = true;
+      } else if (str.size == 5 && memcmp(str.data, "false", 5) == 0) {
+        key->b = false;
+      } else {
+        d->ptr = start;
+        return jsondec_err(d, "invalid map key");
+      }
+      return true;
+    default: {
+      /* Parse the contents as a number, for errors at the right place. */
+      bool skip = false;
+      sub = *d;
+      sub.ptr = str.data;
+      sub.end = str.data + str.size;
+      CHK(jsondec_scalar(&sub, jf, key, &skip));
+      if (sub.ptr != sub.end) {
+        d->ptr = start;
+        return jsondec_err(d, "invalid map key");
+      }
+      return true;
+    }
+  }
+}
+
+/* Skips any value, for unknown fields. */
+static bool jsondec_skipvalue(jsondec *d) {
+  upb_strview str;
+  bool first = true;
+  bool ok;
+
+  switch (jsondec_peek(d)) {
+    case '{':
+      CHK(jsondec_push(d));
+      d->ptr++;
+      while (jsondec_seqnext(d, '}', &first, &ok)) {
+        CHK(jsondec_string(d, &str, true));
+        CHK(jsondec_consume(d, ':'));
+        CHK(jsondec_skipvalue(d));
+      }
+      CHK(ok);
+      d->depth++;
+      return true;
+    case '[':
+      CHK(jsondec_push(d));
+      d->ptr++;
+      while (jsondec_seqnext(d, ']', &first, &ok)) {
+        CHK(jsondec_skipvalue(d));
+      }
+      CHK(ok);
+      d->depth++;
+      return true;
+    case '"':
+      return jsondec_string(d, &str, true);
+    case 't':
+      return jsondec_literal(d, "true");
+    case 'f':
+      return jsondec_literal(d, "false");
+    case 'n':
+      return jsondec_literal(d, "null");
+    default:
+      return jsondec_numtext(d, &str, false);
+  }
+}
+
+/* Messages *******************************************************************/
+
+static bool jsondec_msg(jsondec *d, upb_msg *msg, const jsondec_type *t);
+
+static bool jsondec_issubmsg(const upb_msglayout_field *field) {
+  return field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+         field->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP;
+}
+
+static void jsondec_setpresent(upb_msg *msg,
+                               const upb_msglayout_field *field) {
+  if (field->presence > 0) {
+    uint32_t hasbit = field->presence;
+    ((char*)msg)[hasbit / 8] |= (1 << (hasbit % 8));
+  } else if (field->presence < 0) {
+    uint32_t number = field->number;
+    memcpy((char*)msg + ~field->presence, &number, sizeof(number));
+  }
+}
+
+static void jsondec_setfield(upb_msg *msg, const upb_msglayout_field *field,
+                             const jsondec_val *val) {
+  memcpy((char*)msg + field->offset, val,
+         jsondec_elemsize[field->descriptortype]);
+  jsondec_setpresent(msg, field);
+}
+
+/* The submessage in field |jf| of |msg|, created if it isn't there yet. */
+static bool jsondec_getsubmsg(jsondec *d, upb_msg *msg, const jsondec_type *t,
+                              const jsondec_field *jf, upb_msg **sub,
+                              const jsondec_type **subt) {
+  const upb_msglayout_field *field = jf->field;
+  void **slot = (void**)((char*)msg + field->offset);
+
+  *subt = jsondec_subtype(d->cache, t, jf);
+  if (!*subt) return jsondec_oom(d);
+
+  /* The memory may be uninitialized or used by another member of the oneof. */
+  if (!_upb_msg_hasmem(msg, field)) *slot = NULL;
+
+  if (*slot && _upb_islazy(*slot)) {
+    if (!_upb_decode_lazy(msg, field->offset, (*subt)->l)) {
+      return jsondec_err(d, "error parsing lazy submessage");
+    }
+  } else if (!*slot) {
+    *slot = upb_msg_new((*subt)->l, d->arena);
+    if (!*slot) return jsondec_oom(d);
+  }
+
+  jsondec_setpresent(msg, field);
+  *sub = *slot;
+  return true;
+}
+
+static bool jsondec_array(jsondec *d, upb_msg *msg, const jsondec_type *t,
+                          const jsondec_field *jf) {
+  const upb_msglayout_field *field = jf->field;
+  upb_array **arr = (upb_array**)((char*)msg + field->offset);
+  const jsondec_type *subt = NULL;
+  bool first = true;
+  bool ok;
+
+  if (!*arr && !(*arr = upb_array_new(d->arena))) return jsondec_oom(d);
+  if (jsondec_issubmsg(field)) {
+    subt = jsondec_subtype(d->cache, t, jf);
+    if (!subt) return jsondec_oom(d);
+  }
+
+  CHK(jsondec_push(d));
+  CHK(jsondec_consume(d, '['));
+  while (jsondec_seqnext(d, ']', &first, &ok)) {
+    if (subt) {
+      upb_msg *sub = upb_msg_new(subt->l, d->arena);
+      if (!sub || !upb_array_add(*arr, 1, sizeof(sub), &sub, d->arena)) {
+        return jsondec_oom(d);
+      }
+      CHK(jsondec_msg(d, sub, subt));
+    } else {
+      jsondec_val val;
+      bool skip = false;
+      CHK(jsondec_scalar(d, jf, &val, &skip));
+      if (!skip && !upb_array_add(*arr, 1,
+                                  jsondec_elemsize[field->descriptortype],
+                                  &val, d->arena)) {
+        return jsondec_oom(d);
+      }
+    }
+  }
+  CHK(ok);
+  d->depth++;
+  return true;
+}
+
+static bool jsondec_map(jsondec *d, upb_msg *msg, const jsondec_type *t,
+                        const jsondec_field *jf) {
+  const jsondec_type *entry = jsondec_subtype(d->cache, t, jf);
+  const jsondec_field *keyf;
+  const jsondec_field *valf;
+  const jsondec_type *valt = NULL;
+  upb_map *map;
+  bool first = true;
+  bool ok;
+
+  if (!entry) return jsondec_oom(d);
+  map = _upb_msg_getmap(msg, jf->field->offset, entry->l, true, d->arena);
+  if (!map) return jsondec_oom(d);
+  keyf = &entry->fields[0];
+  valf = &entry->fields[1];
+  if (jsondec_issubmsg(valf->field)) {
+    valt = jsondec_subtype(d->cache, entry, valf);
+    if (!valt) return jsondec_oom(d);
+  }
+
+  CHK(jsondec_push(d));
+  CHK(jsondec_consume(d, '{'));
+  while (jsondec_seqnext(d, '}', &first, &ok)) {
+    jsondec_val key, val;
+    bool skip = false;
+    memset(&key, 0, sizeof(key));
+    memset(&val, 0, sizeof(val));
+    CHK(jsondec_mapkey(d, keyf, &key));
+    CHK(jsondec_consume(d, ':'));
+    if (valt) {
+      val.msg = upb_msg_new(valt->l, d->arena);
+      if (!val.msg) return jsondec_oom(d);
+      CHK(jsondec_msg(d, val.msg, valt));
+    } else {
+      CHK(jsondec_scalar(d, valf, &val, &skip));
+    }
+    if (!skip && !_upb_map_set(map, &key, &val)) return jsondec_oom(d);
+  }
+  CHK(ok);
+  d->depth++;
+  return true;
+}
+
+/* Whether a null for field |jf| is a value, instead of meaning the same as
+ * leaving the field out. */
+static bool jsondec_acceptsnull(jsondec *d, const jsondec_type *t,
+                                const jsondec_field *jf) {
+  const jsondec_type *subt;
+  if (jf->field->label == UPB_LABEL_REPEATED ||
+      jf->field->label == _UPB_LABEL_MAP) {
+    return false;
+  } else if (!jsondec_issubmsg(jf->field)) {
+    return jsondec_isnullvalue(jf->f);
+  }
+  subt = jsondec_subtype(d->cache, t, jf);
+  return subt && subt->wkt == UPB_WELLKNOWN_VALUE;
+}
+
+/* Parses the value of field |jf| into |msg|. */
+static bool jsondec_fieldval(jsondec *d, upb_msg *msg,
+                             const jsondec_type *t, const jsondec_field *jf) {
+  const upb_msglayout_field *field = jf->field;
+
+  if (jsondec_peek(d) == 'n' && !jsondec_acceptsnull(d, t, jf)) {
+    return jsondec_literal(d, "null");
+  }
+
+  if (field->label == _UPB_LABEL_MAP) {
+    return jsondec_map(d, msg, t, jf);
+  } else if (field->label == UPB_LABEL_REPEATED) {
+    return jsondec_array(d, msg, t, jf);
+  } else if (jsondec_issubmsg(field)) {
+    upb_msg *sub;
+    const jsondec_type *subt;
+    CHK(jsondec_getsubmsg(d, msg, t, jf, &sub, &subt));
+    return jsondec_msg(d, sub, subt);
+  } else {
+    jsondec_val val;
+    bool skip = false;
+    CHK(jsondec_scalar(d, jf, &val, &skip));
+    if (!skip) jsondec_setfield(msg, field, &val);
+    return true;
+  }
+}
+
+static bool jsondec_object(jsondec *d, upb_msg *msg, const jsondec_type *t) {
+  bool first = true;
+  bool ok;
+
+  CHK(jsondec_push(d));
+  CHK(jsondec_consume(d, '{'));
+  while (jsondec_seqnext(d, '}', &first, &ok)) {
+    const char *start;
+    const jsondec_field *jf;
+    upb_strview name;
+
+    jsondec_skipws(d);
+    start = d->ptr;
+    CHK(jsondec_string(d, &name, true));
+    CHK(jsondec_consume(d, ':'));
+    jf = jsondec_lookup(t, name.data, name.size);
+    if (jf) {
+      CHK(jsondec_fieldval(d, msg, t, jf));
+    } else if (d->options & UPB_JSONDEC_IGNOREUNKNOWN) {
+      CHK(jsondec_skipvalue(d));
+    } else {
+      upb_status_seterrf(d->status, "no such field: %.*s at offset %d",
+                         (int)name.size, name.data, (int)(start - d->buf));
+      return false;
+    }
+  }
+  CHK(ok);
+  d->depth++;
+  return true;
+}
+
+/* Well-known types ***********************************************************/
+
+#define UPB_DURATION_MAX_SECONDS 315576000000LL
+#define UPB_TIMESTAMP_MIN_SECONDS -62135596800LL  /* 0001-01-01T00:00:00Z */
+#define UPB_TIMESTAMP_MAX_SECONDS 253402300799LL  /* 9999-12-31T23:59:59Z */
+
+static bool jsondec_setseconds(jsondec *d, upb_msg *msg,
+                               const jsondec_type *t, int64_t seconds,
+                               int32_t nanos) {
+  const jsondec_field *s = jsondec_wktfield(t, 1);
+  const jsondec_field *n = jsondec_wktfield(t, 2);
+  jsondec_val val;
+  if (!s || !n) return jsondec_err(d, "malformed well-known type");
+  val.i64 = seconds;
+  jsondec_setfield(msg, s->field, &val);
+  val.i32 = nanos;
+  jsondec_setfield(msg, n->field, &val);
+  return true;
+}
+
+/* Reads exactly |n| digits. */
+static bool jsondec_fixeddigits(const char **p, const char *end, int n,
+                                int *val) {
+  int i;
+  if (end - *p < n) return false;
+  *val = 0;
+  for (i = 0; i < n; i++) {
+    if (!jsondec_isdigit((*p)[i])) return false;
+    *val = *val * 10 + ((*p)[i] - '0');
+  }
+  *p += n;
+  return true;
+}
+
+static bool jsondec_char(const char **p, const char *end, char c) {
+  if (*p == end || **p != c) return false;
+  (*p)++;
+  return true;
+}
+
+/* An optional fraction of 1 to 9 digits, as nanoseconds. */
+static bool jsondec_nanos(const char **p, const char *end, int32_t *nanos) {
+  int digits = 0;
+  *nanos = 0;
+  if (!jsondec_char(p, end, '.')) return true;
+  while (*p != end && jsondec_isdigit(**p)) {
+    if (++digits > 9) return false;
+    *nanos = *nanos * 10 + (*(*p)++ - '0');
+  }
+  if (digits == 0) return false;
+  for (; digits < 9; digits++) *nanos *= 10;
+  return true;
+}
+
+/* Days since the epoch of a proleptic Gregorian date, the inverse of the
+ * conversion in upb_json_encode(). */
+static int64_t jsondec_days(int year, int month, int day) {
+  int64_t era;
+  int yoe, doy, doe;
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = (int)(year - era * 400);
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/* RFC 3339, like "1972-01-01T10:00:20.021Z" or "...T10:00:20-08:00". */
+static bool jsondec_timestamp(jsondec *d, upb_msg *msg,
+                              const jsondec_type *t) {
+  upb_strview str;
+  const char *p, *end;
+  const char *start;
+  int year, month, day, hour, min, sec;
+  int32_t nanos;
+  int64_t seconds;
+
+  jsondec_skipws(d);
+  start = d->ptr;
+  CHK(jsondec_string(d, &str, true));
+  p = str.data;
+  end = p + str.size;
+
+  if (!jsondec_fixeddigits(&p, end, 4, &year) ||
+      !jsondec_char(&p, end, '-') ||
+      !jsondec_fixeddigits(&p, end, 2, &month) ||
+      !jsondec_char(&p, end, '-') ||
+      !jsondec_fixeddigits(&p, end, 2, &day) ||
+      !jsondec_char(&p, end, 'T') ||
+      !jsondec_fixeddigits(&p, end, 2, &hour) ||
+      !jsondec_char(&p, end, ':') ||
+      !jsondec_fixeddigits(&p, end, 2, &min) ||
+      !jsondec_char(&p, end, ':') ||
+      !jsondec_fixeddigits(&p, end, 2, &sec) ||
+      !jsondec_nanos(&p, end, &nanos) || month < 1 || month > 12 ||
+      day < 1 || day > 31 || hour > 23 || min > 59 || sec > 59) {
+    goto malformed;
+  }
+
+  seconds = jsondec_days(year, month, day) * 86400 + hour * 3600 + min * 60 +
+            sec;
+
+  if (!jsondec_char(&p, end, 'Z')) {
+    /* A UTC offset. */
+    int sign = p != end && *p == '-' ? -1 : 1;
+    int ofs_hour, ofs_min;
+    if (p == end || (*p != '+' && *p != '-')) goto malformed;
+    p++;
+    if (!jsondec_fixeddigits(&p, end, 2, &ofs_hour) ||
+        !jsondec_char(&p, end, ':') ||
+        !jsondec_fixeddigits(&p, end, 2, &ofs_min)) {
+      goto malformed;
+    }
+    seconds -= sign * (ofs_hour * 3600 + ofs_min * 60);
+  }
+
+  if (p != end) goto malformed;
+  if (seconds < UPB_TIMESTAMP_MIN_SECONDS ||
+      seconds > UPB_TIMESTAMP_MAX_SECONDS) {
+    d->ptr = start;
+    return jsondec_err(d, "timestamp out of range");
+  }
+  return jsondec_setseconds(d, msg, t, seconds, nanos);
+
+malformed:
+  d->ptr = start;
+  return jsondec_err(d, "malformed timestamp");
+}
+
+/* Like "-1.5s". */
+static bool jsondec_duration(jsondec *d, upb_msg *msg,
+                             const jsondec_type *t) {
+  upb_strview str;
+  const char *p, *end, *digits;
+  const char *start;
+  uint64_t seconds;
+  int32_t nanos;
+  bool neg;
+
+  jsondec_skipws(d);
+  start = d->ptr;
+  CHK(jsondec_string(d, &str, true));
+  p = str.data;
+  end = p + str.size;
+
+  neg = jsondec_char(&p, end, '-');
+  digits = p;
+  while (p != end && jsondec_isdigit(*p)) p++;
+  if (p == digits || p - digits > 12 ||
+      !jsondec_digits(digits, p, &seconds) ||
+      !jsondec_nanos(&p, end, &nanos) || !jsondec_char(&p, end, 's') ||
+      p != end) {
+    d->ptr = start;
+    return jsondec_err(d, "malformed duration");
+  }
+
+  if (seconds > UPB_DURATION_MAX_SECONDS) {
+    d->ptr = start;
+    return jsondec_err(d, "duration out of range");
+  }
+
+  return neg ? jsondec_setseconds(d, msg, t, -(int64_t)seconds, -nanos)
+             : jsondec_setseconds(d, msg, t, (int64_t)seconds, nanos);
+}
+
+/* Comma-separated lowerCamelCase paths, stored as snake_case. */
+static bool jsondec_fieldmask(jsondec *d, upb_msg *msg,
+                              const jsondec_type *t) {
+  const jsondec_field *paths = jsondec_wktfield(t, 1);
+  upb_array **arr;
+  upb_strview str;
+  const char *p, *end;
+
+  if (!paths) return jsondec_err(d, "malformed well-known type");
+  arr = (upb_array**)((char*)msg + paths->field->offset);
+  if (!*arr && !(*arr = upb_array_new(d->arena))) return jsondec_oom(d);
+
+  CHK(jsondec_string(d, &str, true));
+  p = str.data;
+  end = p + str.size;
+
+  while (p < end) {
+    const char *comma = memchr(p, ',', end - p);
+    upb_strview path;
+    char *out;
+    if (!comma) comma = end;
+
+    /* Each capital letter becomes two characters. */
+    out = upb_arena_malloc(d->arena, UPB_MAX((comma - p) * 2, 1));
+    if (!out) return jsondec_oom(d);
+    path.data = out;
+    for (; p < comma; p++) {
+      if (*p >= 'A' && *p <= 'Z') {
+        *out++ = '_';
+        *out++ = *p - 'A' + 'a';
+      } else {
+        *out++ = *p;
+      }
+    }
+    path.size = out - path.data;
+    if (!upb_array_add(*arr, 1, sizeof(path), &path, d->arena)) {
+      return jsondec_oom(d);
+    }
+    if (p < end) p++;  /* The comma. */
+  }
+
+  return true;
+}
+
+/* Value: sets the member of the "kind" oneof that matches the JSON. */
+static bool jsondec_anyvalue(jsondec *d, upb_msg *msg,
+                             const jsondec_type *t) {
+  const jsondec_field *jf;
+  uint32_t number;
+
+  switch (jsondec_peek(d)) {
+    case 'n': number = 1; break;  /* null_value */
+    case '"': number = 3; break;  /* string_value */
+    case 't':
+    case 'f': number = 4; break;  /* bool_value */
+    case '{': number = 5; break;  /* struct_value */
+    case '[': number = 6; break;  /* list_value */
+    default:  number = 2; break;  /* number_value */
+  }
+
+  jf = jsondec_wktfield(t, number);
+  if (!jf) return jsondec_err(d, "malformed well-known type");
+  return jsondec_fieldval(d, msg, t, jf);
+}
+
+static bool jsondec_msg(jsondec *d, upb_msg *msg, const jsondec_type *t) {
+  switch (t->wkt) {
+    case UPB_WELLKNOWN_DURATION:
+      return jsondec_duration(d, msg, t);
+    case UPB_WELLKNOWN_TIMESTAMP:
+      return jsondec_timestamp(d, msg, t);
+    case UPB_WELLKNOWN_FIELDMASK:
+      return jsondec_fieldmask(d, msg, t);
+    case UPB_WELLKNOWN_VALUE:
+      return jsondec_anyvalue(d, msg, t);
+    case UPB_WELLKNOWN_DOUBLEVALUE:
+    case UPB_WELLKNOWN_FLOATVALUE:
+    case UPB_WELLKNOWN_INT64VALUE:
+    case UPB_WELLKNOWN_UINT64VALUE:
+    case UPB_WELLKNOWN_INT32VALUE:
+    case UPB_WELLKNOWN_UINT32VALUE:
+    case UPB_WELLKNOWN_STRINGVALUE:
+    case UPB_WELLKNOWN_BYTESVALUE:
+    case UPB_WELLKNOWN_BOOLVALUE:
+    case UPB_WELLKNOWN_LISTVALUE:
+    case UPB_WELLKNOWN_STRUCT: {
+      /* The JSON is the "value", "values" or "fields" field. */
+      const jsondec_field *jf = jsondec_wktfield(t, 1);
+      if (!jf) return jsondec_err(d, "malformed well-known type");
+      return jsondec_fieldval(d, msg, t, jf);
+    }
+    case UPB_WELLKNOWN_ANY:
+      return jsondec_err(d, "google.protobuf.Any is not supported");
+    default:
+      return jsondec_object(d, msg, t);
+  }
+}
+
+bool upb_json_decode(const char *buf, size_t size, upb_msg *msg,
+                     const upb_msgdef *m, const upb_msglayout *l,
+                     upb_jsondeccache *c, upb_arena *arena, int options,
+                     upb_status *status) {
+  jsondec d;
+  const jsondec_type *t = jsondec_gettype(c, m, l);
+
+  d.ptr = buf;
+  d.end = buf + size;
+  d.buf = buf;
+  d.arena = arena;
+  d.cache = c;
+  d.status = status;
+  d.depth = UPB_JSONDEC_MAXDEPTH;
+  d.options = options;
+
+  if (!t) return jsondec_oom(&d);
+  CHK(jsondec_msg(&d, msg, t));
+
+  jsondec_skipws(&d);
+  if (d.ptr != d.end) return jsondec_err(&d, "unexpected trailing characters");
+  return true;
+}
+
+#undef CHK
@@ -0,0 +1,54 @@
+/*
+** upb_json_decode: parsing JSON into a upb_msg, without handlers.
+**
+** Unlike upb_json_parser, which turns JSON into handler calls, this writes
+** each value straight into the message through its upb_msglayout, taking
+** names, enum values and well-known types from the upb_msgdef.  It is the
+** upb_decode() of JSON.
+*/
+
+#ifndef UPB_JSON_DECODE_H_
+#define UPB_JSON_DECODE_H_
+
+#include "upb/def.h"
+#include "upb/msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Options for upb_json_decode(), to be OR'd together. */
+enum {
+  /* Skips the values of fields that the message doesn't have, and of enum
+   * fields set to names the enum doesn't have, instead of failing. */
+  UPB_JSONDEC_IGNOREUNKNOWN = 1
+};
+
+/* The per-type state for upb_json_decode(): a perfect hash table of each
+ * message's field names, in both their JSON and .proto forms, and the layout
+ * and def of its submessages.  It is built on first use of each type, so a
+ * cache must not be used from more than one thread at a time.  Any msgdefs
+ * and layouts used with a cache must outlive it. */
+struct upb_jsondeccache;
+typedef struct upb_jsondeccache upb_jsondeccache;
+
+upb_jsondeccache *upb_jsondeccache_new(void);
+void upb_jsondeccache_free(upb_jsondeccache *c);
+
+/* Parses the JSON object in |buf| into |msg|, of type |m| with layout |l|,
+ * merging it with what |msg| already holds.  Strings and submessages are
+ * allocated from |arena|, and nothing points into |buf|.
+ *
+ * Returns false and sets |status| on malformed input, values out of range for
+ * their field, or an unknown field (unless ignored).  |msg| is then left
+ * partly parsed.  google.protobuf.Any is not supported. */
+bool upb_json_decode(const char *buf, size_t size, upb_msg *msg,
+                     const upb_msgdef *m, const upb_msglayout *l,
+                     upb_jsondeccache *c, upb_arena *arena, int options,
+                     upb_status *status);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_JSON_DECODE_H_ */
@@ -0,0 +1,1269 @@
+/*
+** upb_json_encode: writes JSON straight from the message in memory into a
+** buffer that grows in the caller's arena, with upb_encode()'s view of field
+** presence.  Values are formatted like upb_json_printer formats them.
+**
+** upb_json_transcode writes the same JSON straight from the binary form,
+** with the same keys and value formatting.
+*/
+
+#include "upb/json/encode.h"
+
+#include <string.h>
+
+#include "upb/decode.h"
+#include "upb/json/escape.int.h"
+#include "upb/pb/numfmt.int.h"
+#include "upb/varint_decode.int.h"
+
+#include "upb/port_def.inc"
+
+#define CHK(x) do { if (!(x)) { return false; } } while(0)
+
+/* upb_jsonenccache ***********************************************************/
+
+struct jsonenc_type;
+
+typedef struct {
+  const upb_msglayout_field *field;
+  const upb_fielddef *f;
+  const char *key;  /* "name": */
+  size_t keylen;
+  /* For message and map fields, the type of the submessage or map entry.
+   * NULL until the field is first encoded. */
+  const struct jsonenc_type *sub;
+} jsonenc_field;
+
+typedef struct jsonenc_type {
+  const upb_msgdef *m;
+  const upb_msglayout *l;
+  upb_wellknowntype_t wkt;
+  jsonenc_field *fields;  /* In layout order, l->field_count of them. */
+} jsonenc_type;
+
+struct upb_jsonenccache {
+  upb_arena *arena;  /* Where the types and keys live. */
+  upb_inttable types;  /* upb_msglayout* -> jsonenc_type* */
+  int options;
+};
+
+upb_jsonenccache *upb_jsonenccache_new(int options) {
+  upb_jsonenccache *c = upb_gmalloc(sizeof(*c));
+  if (!c) return NULL;
+
+  c->arena = upb_arena_new();
+  c->options = options;
+  if (!c->arena ||
+      !upb_inttable_init2(&c->types, UPB_CTYPE_CONSTPTR,
+                          upb_arena_alloc(c->arena))) {
+    if (c->arena) upb_arena_free(c->arena);
+    upb_gfree(c);
+    return NULL;
+  }
+
+  return c;
+}
+
+void upb_jsonenccache_free(upb_jsonenccache *c) {
+  /* The table is in the arena too. */
+  upb_arena_free(c->arena);
+  upb_gfree(c);
+}
+
+static const char *jsonenc_makekey(upb_jsonenccache *c, const upb_fielddef *f,
+                                   size_t *len) {
+  const char *name = upb_fielddef_name(f);
+  size_t namelen;
+  char *key;
+
+  if (c->options & UPB_JSONENC_PROTONAMES) {
+    namelen = strlen(name);
+    key = upb_arena_malloc(c->arena, namelen + 3);
+    if (!key) return NULL;
+    memcpy(key + 1, name, namelen);
+  } else {
+    /* The length includes the NUL, which is overwritten below. */
+    namelen = upb_fielddef_getjsonname(f, NULL, 0) - 1;
+    key = upb_arena_malloc(c->arena, namelen + 3);
+    if (!key) return NULL;
+    upb_fielddef_getjsonname(f, key + 1, namelen + 1);
+  }
+
+  /* Field names are identifiers, so there is nothing to escape. */
+  key[0] = '"';
+  key[namelen + 1] = '"';
+  key[namelen + 2] = ':';
+  *len = namelen + 3;
+  return key;
+}
+
+static const jsonenc_type *jsonenc_gettype(upb_jsonenccache *c,
+                                           const upb_msgdef *m,
+                                           const upb_msglayout *l) {
+  upb_value v;
+  jsonenc_type *t;
+  int i;
+
+  if (upb_inttable_lookupptr(&c->types, l, &v)) {
+    return upb_value_getconstptr(v);
+  }
+
+  t = upb_arena_malloc(c->arena, sizeof(*t));
+  if (!t) return NULL;
+  t->m = m;
+  t->l = l;
+  t->wkt = upb_msgdef_wellknowntype(m);
+  t->fields = upb_arena_malloc(c->arena,
+                               UPB_MAX(l->field_count, 1) * sizeof(*t->fields));
+  if (!t->fields) return NULL;
+
+  for (i = 0; i < l->field_count; i++) {
+    jsonenc_field *jf = &t->fields[i];
+    jf->field = &l->fields[i];
+    jf->f = upb_msgdef_itof(m, jf->field->number);
+    jf->sub = NULL;
+    UPB_ASSERT(jf->f);
+    jf->key = jsonenc_makekey(c, jf->f, &jf->keylen);
+    if (!jf->key) return NULL;
+  }
+
+  if (!upb_inttable_insertptr2(&c->types, l, upb_value_constptr(t),
+                               upb_arena_alloc(c->arena))) {
+    return NULL;
+  }
+
+  return t;
+}
+
+/* The type of |jf|'s submessage or map entry. */
+static const jsonenc_type *jsonenc_subtype(upb_jsonenccache *c,
+                                           const jsonenc_type *t,
+                                           const jsonenc_field *jf) {
+  if (!jf->sub) {
+    const upb_msglayout *subl = t->l->submsgs[jf->field->submsg_index];
+    /* Only the cache ever writes this. */
+    ((jsonenc_field*)jf)->sub =
+        jsonenc_gettype(c, upb_fielddef_msgsubdef(jf->f), subl);
+  }
+  return jf->sub;
+}
+
+/* Output *********************************************************************/
+
+typedef struct {
+  char *buf, *ptr, *end;
+  upb_arena *arena;
+  upb_jsonenccache *cache;
+  upb_status *status;
+  int depth;      /* Submessages that may still be entered, when transcoding. */
+  bool fallback;  /* Set when transcoding has to start over; see below. */
+} jsonenc;
+
+static bool jsonenc_oom(jsonenc *e) {
+  upb_status_setoom(e->status);
+  return false;
+}
+
+static bool jsonenc_err(jsonenc *e, const char *msg) {
+  upb_status_seterrmsg(e->status, msg);
+  return false;
+}
+
+static bool jsonenc_growbuffer(jsonenc *e, size_t bytes) {
+  size_t used = e->ptr - e->buf;
+  size_t old_size = e->end - e->buf;
+  size_t new_size = UPB_MAX(old_size, 128);
+  char *new_buf;
+
+  while (new_size - used < bytes) new_size *= 2;
+  new_buf = upb_arena_realloc(e->arena, e->buf, old_size, new_size);
+  if (!new_buf) return jsonenc_oom(e);
+
+  e->buf = new_buf;
+  e->ptr = new_buf + used;
+  e->end = new_buf + new_size;
+  return true;
+}
+
+/* Ensures that at least |bytes| bytes can be written at e->ptr. */
+UPB_INLINE bool jsonenc_reserve(jsonenc *e, size_t bytes) {
+  return UPB_LIKELY((size_t)(e->end - e->ptr) >= bytes) ||
+         jsonenc_growbuffer(e, bytes);
+}
+
+static bool jsonenc_put(jsonenc *e, const char *data, size_t len) {
+  CHK(jsonenc_reserve(e, len));
+  memcpy(e->ptr, data, len);
+  e->ptr += len;
+  return true;
+}
+
+UPB_INLINE bool jsonenc_putc(jsonenc *e, char c) {
+  CHK(jsonenc_reserve(e, 1));
+  *e->ptr++ = c;
+  return true;
+}
+
+#define jsonenc_putlit(e, lit) jsonenc_put(e, lit, sizeof(lit) - 1)
+
+static bool jsonenc_string(jsonenc *e, const char *ptr, size_t len) {
+  const char *end = ptr + len;
+
+  CHK(jsonenc_putc(e, '"'));
+  for (;;) {
+    const char *escaped = _upb_json_findescape(ptr, end);
+    if (escaped > ptr) CHK(jsonenc_put(e, ptr, escaped - ptr));
+    if (escaped == end) break;
+    CHK(jsonenc_reserve(e, UPB_JSON_MAX_ESCAPE_LEN));
+    e->ptr += _upb_json_escape(*escaped, e->ptr);
+    ptr = escaped + 1;
+  }
+  return jsonenc_putc(e, '"');
+}
+
+static bool jsonenc_bytes(jsonenc *e, upb_strview str) {
+  CHK(jsonenc_reserve(e, _upb_json_base64len(str.size) + 2));
+  *e->ptr++ = '"';
+  e->ptr += _upb_json_base64(str.data, str.size, e->ptr);
+  *e->ptr++ = '"';
+  return true;
+}
+
+/* Numbers that JavaScript can't hold exactly are quoted, like 64-bit integers,
+ * and so are map keys, which are always strings. */
+static bool jsonenc_int64(jsonenc *e, int64_t val, bool quote) {
+  CHK(jsonenc_reserve(e, UPB_NUMFMT_MAXLEN + 2));
+  if (quote) *e->ptr++ = '"';
+  e->ptr += upb_fmt_int64(val, e->ptr);
+  if (quote) *e->ptr++ = '"';
+  return true;
+}
+
+static bool jsonenc_uint64(jsonenc *e, uint64_t val, bool quote) {
+  CHK(jsonenc_reserve(e, UPB_NUMFMT_MAXLEN + 2));
+  if (quote) *e->ptr++ = '"';
+  e->ptr += upb_fmt_uint64(val, e->ptr);
+  if (quote) *e->ptr++ = '"';
+  return true;
+}
+
+static bool jsonenc_double(jsonenc *e, double val, bool is_float) {
+  if (val != val) {
+    return jsonenc_putlit(e, "\"NaN\"");
+  } else if (val == UPB_INFINITY) {
+    return jsonenc_putlit(e, "\"Infinity\"");
+  } else if (val == -UPB_INFINITY) {
+    return jsonenc_putlit(e, "\"-Infinity\"");
+  }
+
+  CHK(jsonenc_reserve(e, UPB_NUMFMT_MAXLEN));
+  e->ptr += is_float ? upb_fmt_float((float)val, e->ptr)
+                     : upb_fmt_double(val, e->ptr);
+  return true;
+}
+
+static bool jsonenc_enum(jsonenc *e, const upb_fielddef *f, int32_t val) {
+  const upb_enumdef *ed = upb_fielddef_enumsubdef(f);
+  const char *name;
+
+  if (strcmp(upb_enumdef_fullname(ed), "google.protobuf.NullValue") == 0) {
+    return jsonenc_putlit(e, "null");
+  }
+
+  /* Values that aren't in the enum are written as numbers. */
+  name = upb_enumdef_iton(ed, val);
+  return name ? jsonenc_string(e, name, strlen(name))
+              : jsonenc_int64(e, val, false);
+}
+
+/* Messages *******************************************************************/
+
+static bool jsonenc_msg(jsonenc *e, const char *msg, const jsonenc_type *t);
+
+/* The submessage pointed to from the field memory |mem|.  A lazy submessage is
+ * parsed into the output arena, leaving the message itself untouched. */
+static bool jsonenc_getsub(jsonenc *e, const void *mem,
+                           const jsonenc_type *subt, const char **sub) {
+  const void *ptr = *(const void *const*)mem;
+  if (_upb_islazy(ptr)) {
+    const _upb_lazymsg *lazy = _upb_getlazy(ptr);
+    upb_msg *parsed = upb_msg_new(subt->l, e->arena);
+    if (!parsed) return jsonenc_oom(e);
+    if (!upb_decode_ex(lazy->data.data, lazy->data.size, parsed, subt->l,
+                       e->arena, lazy->options | UPB_DECODE_ALIAS)) {
+      return jsonenc_err(e, "error parsing lazy submessage");
+    }
+    ptr = parsed;
+  }
+  *sub = ptr;
+  return true;
+}
+
+/* A single value in the form of a message field of its type, from a field,
+ * array element or map value. */
+static bool jsonenc_value(jsonenc *e, const void *mem, const jsonenc_type *t,
+                          const jsonenc_field *jf) {
+  switch (jf->field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+      return jsonenc_double(e, *(const double*)mem, false);
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+      return jsonenc_double(e, *(const float*)mem, true);
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      return jsonenc_int64(e, *(const int32_t*)mem, false);
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+      return jsonenc_uint64(e, *(const uint32_t*)mem, false);
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      return jsonenc_int64(e, *(const int64_t*)mem, true);
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      return jsonenc_uint64(e, *(const uint64_t*)mem, true);
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      return *(const bool*)mem ? jsonenc_putlit(e, "true")
+                               : jsonenc_putlit(e, "false");
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      return jsonenc_enum(e, jf->f, *(const int32_t*)mem);
+    case UPB_DESCRIPTOR_TYPE_STRING: {
+      const upb_strview *str = mem;
+      return jsonenc_string(e, str->data, str->size);
+    }
+    case UPB_DESCRIPTOR_TYPE_BYTES:
+      return jsonenc_bytes(e, *(const upb_strview*)mem);
+    case UPB_DESCRIPTOR_TYPE_MESSAGE:
+    case UPB_DESCRIPTOR_TYPE_GROUP: {
+      const jsonenc_type *subt = jsonenc_subtype(e->cache, t, jf);
+      const char *sub;
+      if (!subt) return jsonenc_oom(e);
+      CHK(jsonenc_getsub(e, mem, subt, &sub));
+      return jsonenc_msg(e, sub, subt);
+    }
+  }
+  UPB_UNREACHABLE();
+}
+
+static size_t jsonenc_elemsize(uint8_t descriptortype) {
+  switch (descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      return sizeof(bool);
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_ENUM:
+      return 4;
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      return 8;
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES:
+      return sizeof(upb_strview);
+    case UPB_DESCRIPTOR_TYPE_MESSAGE:
+    case UPB_DESCRIPTOR_TYPE_GROUP:
+      return sizeof(void*);
+  }
+  UPB_UNREACHABLE();
+}
+
+static bool jsonenc_array(jsonenc *e, const upb_array *arr,
+                          const jsonenc_type *t, const jsonenc_field *jf) {
+  size_t size = jsonenc_elemsize(jf->field->descriptortype);
+  const char *ptr = arr ? arr->data : NULL;
+  size_t i;
+
+  CHK(jsonenc_putc(e, '['));
+  for (i = 0; arr && i < arr->len; i++, ptr += size) {
+    if (i > 0) CHK(jsonenc_putc(e, ','));
+    CHK(jsonenc_value(e, ptr, t, jf));
+  }
+  return jsonenc_putc(e, ']');
+}
+
+/* A map key or value, in the form of a message field of its type. */
+typedef union {
+  upb_strview str;
+  uint64_t num;
+  void *msg;
+} jsonenc_mapval;
+
+static bool jsonenc_mapkey(jsonenc *e, const jsonenc_mapval *key,
+                           const jsonenc_field *jf) {
+  switch (jf->field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      CHK(*(const bool*)key ? jsonenc_putlit(e, "\"true\"")
+                            : jsonenc_putlit(e, "\"false\""));
+      break;
+    case UPB_DESCRIPTOR_TYPE_STRING:
+      CHK(jsonenc_string(e, key->str.data, key->str.size));
+      break;
+    case UPB_DESCRIPTOR_TYPE_INT32:
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      CHK(jsonenc_int64(e, *(const int32_t*)key, true));
+      break;
+    case UPB_DESCRIPTOR_TYPE_UINT32:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+      CHK(jsonenc_uint64(e, *(const uint32_t*)key, true));
+      break;
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+      CHK(jsonenc_uint64(e, key->num, true));
+      break;
+    default:
+      CHK(jsonenc_int64(e, (int64_t)key->num, true));
+      break;
+  }
+  return jsonenc_putc(e, ':');
+}
+
+static bool jsonenc_map(jsonenc *e, const upb_map *map,
+                        const jsonenc_type *entry) {
+  size_t iter = UPB_MAP_BEGIN;
+  jsonenc_mapval key, val;
+  bool first = true;
+
+  CHK(jsonenc_putc(e, '{'));
+  while (map && _upb_map_next(map, &iter, &key, &val)) {
+    if (!first) CHK(jsonenc_putc(e, ','));
+    first = false;
+    CHK(jsonenc_mapkey(e, &key, &entry->fields[0]) &&
+        jsonenc_value(e, &val, entry, &entry->fields[1]));
+  }
+  return jsonenc_putc(e, '}');
+}
+
+/* Whether a proto3 field without presence has its zero value, which isn't
+ * written. */
+static bool jsonenc_iszero(const char *mem, const upb_msglayout_field *field) {
+  switch (jsonenc_elemsize(field->descriptortype)) {
+    case 1:
+      return *(const bool*)mem == false;
+    case 4:
+      return *(const uint32_t*)mem == 0;
+    case 8:
+      /* Compares the bits, so -0.0 is written, like upb_encode() does. */
+      return *(const uint64_t*)mem == 0;
+    default:
+      /* Submessages are checked for NULL by the caller. */
+      return ((const upb_strview*)mem)->size == 0;
+  }
+}
+
+static bool jsonenc_hasfield(const char *msg, const upb_msglayout_field *f) {
+  const char *mem = msg + f->offset;
+
+  if (f->label == UPB_LABEL_REPEATED) {
+    const upb_array *arr = *(const upb_array *const*)mem;
+    return arr && arr->len > 0;
+  } else if (f->label == _UPB_LABEL_MAP) {
+    return _upb_map_size(*(const upb_map *const*)mem) > 0;
+  } else if (!_upb_msg_hasmem(msg, f)) {
+    /* Unset hasbit, or another member of the oneof. */
+    return false;
+  } else if (f->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+             f->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP) {
+    return *(const void *const*)mem != NULL;
+  } else {
+    /* Proto3 fields without presence aren't written when they are zero. */
+    return f->presence != 0 || !jsonenc_iszero(mem, f);
+  }
+}
+
+/* The value of field |jf| of |msg|, as a repeated field, a map or a single
+ * value. */
+static bool jsonenc_fieldval(jsonenc *e, const char *msg,
+                             const jsonenc_type *t, const jsonenc_field *jf) {
+  const char *mem = msg + jf->field->offset;
+
+  if (jf->field->label == UPB_LABEL_REPEATED) {
+    return jsonenc_array(e, *(const upb_array *const*)mem, t, jf);
+  } else if (jf->field->label == _UPB_LABEL_MAP) {
+    const jsonenc_type *entry = jsonenc_subtype(e->cache, t, jf);
+    if (!entry) return jsonenc_oom(e);
+    return jsonenc_map(e, *(const upb_map *const*)mem, entry);
+  } else {
+    return jsonenc_value(e, mem, t, jf);
+  }
+}
+
+static bool jsonenc_fields(jsonenc *e, const char *msg,
+                           const jsonenc_type *t) {
+  bool first = true;
+  int i;
+
+  CHK(jsonenc_putc(e, '{'));
+  for (i = 0; i < t->l->field_count; i++) {
+    const jsonenc_field *jf = &t->fields[i];
+    if (!jsonenc_hasfield(msg, jf->field)) continue;
+    if (!first) CHK(jsonenc_putc(e, ','));
+    first = false;
+    CHK(jsonenc_put(e, jf->key, jf->keylen));
+    CHK(jsonenc_fieldval(e, msg, t, jf));
+  }
+  return jsonenc_putc(e, '}');
+}
+
+/* Well-known types ***********************************************************/
+
+/* The field with |number| of a well-known type, which upbc lays out like any
+ * other message. */
+static const jsonenc_field *jsonenc_wktfield(const jsonenc_type *t,
+                                             uint32_t number) {
+  int i;
+  for (i = 0; i < t->l->field_count; i++) {
+    if (t->fields[i].field->number == number) return &t->fields[i];
+  }
+  return NULL;
+}
+
+static bool jsonenc_seconds(const char *msg, const jsonenc_type *t,
+                            int64_t *seconds, int32_t *nanos) {
+  const jsonenc_field *s = jsonenc_wktfield(t, 1);
+  const jsonenc_field *n = jsonenc_wktfield(t, 2);
+  if (!s || !n) return false;
+  memcpy(seconds, msg + s->field->offset, sizeof(*seconds));
+  memcpy(nanos, msg + n->field->offset, sizeof(*nanos));
+  return true;
+}
+
+/* Writes the nanoseconds, if any, as a fraction without trailing zeros. */
+static void jsonenc_nanos(jsonenc *e, int32_t nanos) {
+  char digits[9];
+  int len = 9;
+  int i;
+
+  if (nanos == 0) return;
+  for (i = 8; i >= 0; i--) {
+    digits[i] = '0' + nanos % 10;
+    nanos /= 10;
+  }
+  while (digits[len - 1] == '0') len--;
+
+  *e->ptr++ = '.';
+  memcpy(e->ptr, digits, len);
+  e->ptr += len;
+}
+
+static void jsonenc_digits(jsonenc *e, int val, int width) {
+  int i;
+  for (i = width - 1; i >= 0; i--) {
+    e->ptr[i] = '0' + val % 10;
+    val /= 10;
+  }
+  e->ptr += width;
+}
+
+#define UPB_DURATION_MAX_SECONDS 315576000000LL
+#define UPB_TIMESTAMP_MIN_SECONDS -62135596800LL  /* 0001-01-01T00:00:00Z */
+#define UPB_TIMESTAMP_MAX_SECONDS 253402300799LL  /* 9999-12-31T23:59:59Z */
+
+static bool jsonenc_duration(jsonenc *e, const char *msg,
+                             const jsonenc_type *t) {
+  int64_t seconds;
+  int32_t nanos;
+
+  if (!jsonenc_seconds(msg, t, &seconds, &nanos)) {
+    return jsonenc_err(e, "malformed google.protobuf.Duration");
+  }
+  if (seconds > UPB_DURATION_MAX_SECONDS ||
+      seconds < -UPB_DURATION_MAX_SECONDS || nanos > 999999999 ||
+      nanos < -999999999 || (seconds < 0 && nanos > 0) ||
+      (seconds > 0 && nanos < 0)) {
+    return jsonenc_err(e, "error serializing duration: value out of range");
+  }
+
+  /* "-" seconds "." nanos "s", with quotes. */
+  CHK(jsonenc_reserve(e, 2 + UPB_NUMFMT_MAXLEN + 10 + 1 + 1));
+  *e->ptr++ = '"';
+  if (seconds < 0 || nanos < 0) {
+    *e->ptr++ = '-';
+    seconds = -seconds;
+    nanos = -nanos;
+  }
+  e->ptr += upb_fmt_int64(seconds, e->ptr);
+  jsonenc_nanos(e, nanos);
+  *e->ptr++ = 's';
+  *e->ptr++ = '"';
+  return true;
+}
+
+static bool jsonenc_timestamp(jsonenc *e, const char *msg,
+                              const jsonenc_type *t) {
+  int64_t seconds;
+  int32_t nanos;
+  int64_t days, secs, era;
+  int doe, yoe, doy, mp, year, month, day;
+
+  if (!jsonenc_seconds(msg, t, &seconds, &nanos)) {
+    return jsonenc_err(e, "malformed google.protobuf.Timestamp");
+  }
+  if (seconds < UPB_TIMESTAMP_MIN_SECONDS ||
+      seconds > UPB_TIMESTAMP_MAX_SECONDS || nanos < 0 ||
+      nanos > 999999999) {
+    return jsonenc_err(e, "error serializing timestamp: value out of range");
+  }
+
+  /* Days since the epoch to a proleptic Gregorian date, counting in 400-year
+   * eras from 0000-03-01 so that leap days come last (without gmtime(), which
+   * is neither thread-safe nor able to handle every year on every platform).
+   * The range check above keeps all of this non-negative past the shift. */
+  days = seconds / 86400;
+  secs = seconds % 86400;
+  if (secs < 0) {
+    secs += 86400;
+    days--;
+  }
+  days += 719468;
+  era = days / 146097;
+  doe = (int)(days - era * 146097);
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = (int)(yoe + era * 400) + (month <= 2);
+
+  /* "YYYY-MM-DDTHH:MM:SS" "." nanos "Z", with quotes. */
+  CHK(jsonenc_reserve(e, 2 + 19 + 10 + 1));
+  *e->ptr++ = '"';
+  jsonenc_digits(e, year, 4);
+  *e->ptr++ = '-';
+  jsonenc_digits(e, month, 2);
+  *e->ptr++ = '-';
+  jsonenc_digits(e, day, 2);
+  *e->ptr++ = 'T';
+  jsonenc_digits(e, (int)(secs / 3600), 2);
+  *e->ptr++ = ':';
+  jsonenc_digits(e, (int)(secs / 60 % 60), 2);
+  *e->ptr++ = ':';
+  jsonenc_digits(e, (int)(secs % 60), 2);
+  jsonenc_nanos(e, nanos);
+  *e->ptr++ = 'Z';
+  *e->ptr++ = '"';
+  return true;
+}
+
+/* The paths, converted to lowerCamelCase and separated by commas. */
+static bool jsonenc_fieldmask(jsonenc *e, const char *msg,
+                              const jsonenc_type *t) {
+  const jsonenc_field *paths = jsonenc_wktfield(t, 1);
+  const upb_array *arr;
+  const upb_strview *path;
+  size_t i, j;
+
+  if (!paths) return jsonenc_err(e, "malformed google.protobuf.FieldMask");
+  arr = *(const upb_array *const*)(msg + paths->field->offset);
+  path = arr ? arr->data : NULL;
+
+  CHK(jsonenc_putc(e, '"'));
+  for (i = 0; arr && i < arr->len; i++) {
+    /* Path characters are only letters, digits, dots and underscores, and
+     * camel case is never longer. */
+    CHK(jsonenc_reserve(e, path[i].size + 1));
+    if (i > 0) *e->ptr++ = ',';
+    for (j = 0; j < path[i].size; j++) {
+      char c = path[i].data[j];
+      if (c == '_' && j + 1 < path[i].size && path[i].data[j + 1] >= 'a' &&
+          path[i].data[j + 1] <= 'z') {
+        *e->ptr++ = path[i].data[++j] - 'a' + 'A';
+      } else {
+        *e->ptr++ = c;
+      }
+    }
+  }
+  return jsonenc_putc(e, '"');
+}
+
+/* Value, whose oneof "kind" must be set. */
+static bool jsonenc_anyvalue(jsonenc *e, const char *msg,
+                             const jsonenc_type *t) {
+  int i;
+  for (i = 0; i < t->l->field_count; i++) {
+    const jsonenc_field *jf = &t->fields[i];
+    if (jsonenc_hasfield(msg, jf->field)) {
+      return jsonenc_fieldval(e, msg, t, jf);
+    }
+  }
+  return jsonenc_err(e, "google.protobuf.Value with no kind set");
+}
+
+static bool jsonenc_msg(jsonenc *e, const char *msg, const jsonenc_type *t) {
+  switch (t->wkt) {
+    case UPB_WELLKNOWN_DURATION:
+      return jsonenc_duration(e, msg, t);
+    case UPB_WELLKNOWN_TIMESTAMP:
+      return jsonenc_timestamp(e, msg, t);
+    case UPB_WELLKNOWN_FIELDMASK:
+      return jsonenc_fieldmask(e, msg, t);
+    case UPB_WELLKNOWN_VALUE:
+      return jsonenc_anyvalue(e, msg, t);
+    case UPB_WELLKNOWN_DOUBLEVALUE:
+    case UPB_WELLKNOWN_FLOATVALUE:
+    case UPB_WELLKNOWN_INT64VALUE:
+    case UPB_WELLKNOWN_UINT64VALUE:
+    case UPB_WELLKNOWN_INT32VALUE:
+    case UPB_WELLKNOWN_UINT32VALUE:
+    case UPB_WELLKNOWN_STRINGVALUE:
+    case UPB_WELLKNOWN_BYTESVALUE:
+    case UPB_WELLKNOWN_BOOLVALUE:
+    case UPB_WELLKNOWN_LISTVALUE:
+    case UPB_WELLKNOWN_STRUCT: {
+      /* Just the "value", "values" or "fields" field, even if it is zero. */
+      const jsonenc_field *jf = jsonenc_wktfield(t, 1);
+      if (!jf) return jsonenc_err(e, "malformed well-known type");
+      return jsonenc_fieldval(e, msg, t, jf);
+    }
+    case UPB_WELLKNOWN_ANY:
+      return jsonenc_err(e, "google.protobuf.Any is not supported");
+    default:
+      return jsonenc_fields(e, msg, t);
+  }
+}
+
+char *upb_json_encode(const upb_msg *msg, const upb_msgdef *m,
+                      const upb_msglayout *l, upb_jsonenccache *c,
+                      upb_arena *arena, size_t *size, upb_status *status) {
+  jsonenc e;
+  const jsonenc_type *t = jsonenc_gettype(c, m, l);
+
+  e.buf = NULL;
+  e.ptr = NULL;
+  e.end = NULL;
+  e.arena = arena;
+  e.cache = c;
+  e.status = status;
+  e.depth = 0;
+  e.fallback = false;
+
+  if (!t) {
+    jsonenc_oom(&e);
+    return NULL;
+  }
+  if (!jsonenc_msg(&e, msg, t)) return NULL;
+
+  *size = e.ptr - e.buf;
+  return e.buf;
+}
+
+/* Transcoding ****************************************************************/
+
+/* upb_json_transcode() writes each field as it reads it from the wire, which
+ * gives the same JSON as decoding the message first would as long as every
+ * field comes once, or in one run for a repeated field, in field number
+ * order.  That is how upb_encode() and other serializers write messages.  For
+ * anything else (fields out of order, a singular field that is set twice and
+ * so merged or overwritten, two members of a oneof), and for input that may be
+ * malformed, we set e->fallback and start over the slow way. */
+
+static bool jsontc_fallback(jsonenc *e) {
+  e->fallback = true;
+  return false;
+}
+
+/* The wire type of each descriptor type, for checking that the wire type of
+ * a field is the one we expect.  Packed fields are handled by the caller. */
+static int jsontc_wiretype(uint8_t descriptortype) {
+  switch (descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      return UPB_WIRE_TYPE_64BIT;
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      return UPB_WIRE_TYPE_32BIT;
+    case UPB_DESCRIPTOR_TYPE_STRING:
+    case UPB_DESCRIPTOR_TYPE_BYTES:
+    case UPB_DESCRIPTOR_TYPE_MESSAGE:
+      return UPB_WIRE_TYPE_DELIMITED;
+    case UPB_DESCRIPTOR_TYPE_GROUP:
+      return UPB_WIRE_TYPE_START_GROUP;
+    default:
+      return UPB_WIRE_TYPE_VARINT;
+  }
+}
+
+static bool jsontc_varint(const char **ptr, const char *end, uint64_t *val) {
+  const char *p = _upb_vdecode(*ptr, end, val);
+  if (!p) return false;
+  *ptr = p;
+  return true;
+}
+
+/* Reads a delimited value's length and checks that it is all there. */
+static bool jsontc_len(const char **ptr, const char *end, size_t *len) {
+  uint64_t val;
+  if (!jsontc_varint(ptr, end, &val) || val > (uint64_t)(end - *ptr)) {
+    return false;
+  }
+  *len = (size_t)val;
+  return true;
+}
+
+/* Reads a value of scalar or string type |type| into |val|, in the form it
+ * would have in a message, like the map code has it. */
+static bool jsontc_scalar(const char **ptr, const char *end, uint8_t type,
+                          jsonenc_mapval *val) {
+  uint64_t u64;
+  uint32_t u32;
+
+  val->num = 0;
+  switch (jsontc_wiretype(type)) {
+    case UPB_WIRE_TYPE_64BIT:
+      if (end - *ptr < 8) return false;
+      memcpy(val, *ptr, 8);
+      *ptr += 8;
+      return true;
+    case UPB_WIRE_TYPE_32BIT:
+      if (end - *ptr < 4) return false;
+      memcpy(val, *ptr, 4);
+      *ptr += 4;
+      return true;
+    case UPB_WIRE_TYPE_DELIMITED: {
+      size_t len;
+      if (!jsontc_len(ptr, end, &len)) return false;
+      val->str.data = *ptr;
+      val->str.size = len;
+      *ptr += len;
+      return true;
+    }
+  }
+
+  if (!jsontc_varint(ptr, end, &u64)) return false;
+  switch (type) {
+    case UPB_DESCRIPTOR_TYPE_BOOL: {
+      bool b = u64 != 0;
+      memcpy(val, &b, sizeof(b));
+      break;
+    }
+    case UPB_DESCRIPTOR_TYPE_SINT32:
+      u32 = (uint32_t)u64;
+      u32 = (u32 >> 1) ^ (0U - (u32 & 1));
+      memcpy(val, &u32, sizeof(u32));
+      break;
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      val->num = (u64 >> 1) ^ (0ULL - (u64 & 1));
+      break;
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+      val->num = u64;
+      break;
+    default:
+      u32 = (uint32_t)u64;
+      memcpy(val, &u32, sizeof(u32));
+      break;
+  }
+  return true;
+}
+
+/* Skips an unknown field.  Unknown groups are left to the slow way. */
+static bool jsontc_skip(const char **ptr, const char *end, int wire_type) {
+  switch (wire_type) {
+    case UPB_WIRE_TYPE_VARINT: {
+      uint64_t val;
+      return jsontc_varint(ptr, end, &val);
+    }
+    case UPB_WIRE_TYPE_64BIT:
+    case UPB_WIRE_TYPE_32BIT: {
+      size_t len = wire_type == UPB_WIRE_TYPE_64BIT ? 8 : 4;
+      if ((size_t)(end - *ptr) < len) return false;
+      *ptr += len;
+      return true;
+    }
+    case UPB_WIRE_TYPE_DELIMITED: {
+      size_t len;
+      if (!jsontc_len(ptr, end, &len)) return false;
+      *ptr += len;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+/* The field of |t| with |number|, looked up like upb_decode() does it: the
+ * field after the last one first, then the dense prefix, then a binary
+ * search. */
+static const jsonenc_field *jsontc_find(const jsonenc_type *t,
+                                        uint32_t number, int *last) {
+  const upb_msglayout *l = t->l;
+  size_t idx = (size_t)number - 1;
+  size_t next = (size_t)(*last + 1);
+  int lo = l->dense_below;
+  int hi = l->field_count - 1;
+
+  if (next < l->field_count && l->fields[next].number == number) {
+    *last = (int)next;
+    return &t->fields[next];
+  }
+
+  if (idx < l->dense_below) {
+    *last = (int)idx;
+    return &t->fields[idx];
+  }
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    uint32_t num = l->fields[mid].number;
+    if (num < number) {
+      lo = mid + 1;
+    } else if (num > number) {
+      hi = mid - 1;
+    } else {
+      *last = mid;
+      return &t->fields[mid];
+    }
+  }
+
+  return NULL;
+}
+
+static bool jsontc_fields(jsonenc *e, const char **ptr, const char *end,
+                          uint32_t group, const jsonenc_type *t);
+
+/* A submessage of type |subt|: the |len| bytes at *ptr, or for a group
+ * (|group| != 0) everything up to its END_GROUP tag.  Well-known types, which
+ * need all of their fields before they can be written, are decoded into a
+ * message in the arena first. */
+static bool jsontc_submsg(jsonenc *e, const char **ptr, const char *end,
+                          uint32_t group, const jsonenc_type *subt) {
+  if (!subt) return jsonenc_oom(e);
+  if (--e->depth < 0) return jsontc_fallback(e);
+
+  if (subt->wkt != UPB_WELLKNOWN_UNSPECIFIED) {
+    upb_msg *msg;
+    if (group) return jsontc_fallback(e);
+    msg = upb_msg_new(subt->l, e->arena);
+    if (!msg) return jsonenc_oom(e);
+    if (!upb_decode(*ptr, end - *ptr, msg, subt->l, e->arena)) {
+      return jsontc_fallback(e);
+    }
+    *ptr = end;
+    CHK(jsonenc_msg(e, (const char*)msg, subt));
+  } else {
+    CHK(jsontc_fields(e, ptr, end, group, subt));
+  }
+
+  e->depth++;
+  return true;
+}
+
+/* A value of field |jf| that isn't a map entry: a submessage, or a scalar or
+ * string that has been read into |val|. */
+static bool jsontc_value(jsonenc *e, const char **ptr, const char *end,
+                         int wire_type, uint32_t number, const jsonenc_type *t,
+                         const jsonenc_field *jf) {
+  size_t len;
+
+  switch (jf->field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_MESSAGE:
+      if (!jsontc_len(ptr, end, &len)) return jsontc_fallback(e);
+      return jsontc_submsg(e, ptr, *ptr + len, 0,
+                           jsonenc_subtype(e->cache, t, jf));
+    case UPB_DESCRIPTOR_TYPE_GROUP:
+      UPB_ASSERT(wire_type == UPB_WIRE_TYPE_START_GROUP);
+      return jsontc_submsg(e, ptr, end, number,
+                           jsonenc_subtype(e->cache, t, jf));
+    default: {
+      jsonenc_mapval val;
+      if (!jsontc_scalar(ptr, end, jf->field->descriptortype, &val)) {
+        return jsontc_fallback(e);
+      }
+      return jsonenc_value(e, &val, t, jf);
+    }
+  }
+}
+
+/* Writes what comes before the next value of a repeated or map field: its key
+ * and opening bracket for the first value, or else a comma. */
+static bool jsontc_nextelem(jsonenc *e, const jsonenc_field *jf, bool *first,
+                            bool *open) {
+  if (*open) return jsonenc_putc(e, ',');
+  if (!*first) CHK(jsonenc_putc(e, ','));
+  *first = false;
+  *open = true;
+  CHK(jsonenc_put(e, jf->key, jf->keylen));
+  return jsonenc_putc(e, jf->field->label == _UPB_LABEL_MAP ? '{' : '[');
+}
+
+/* One map entry of |len| bytes, whose key has to be written before its value,
+ * wherever they are in the entry. */
+static bool jsontc_mapentry(jsonenc *e, const char **ptr, size_t len,
+                            const jsonenc_type *entry) {
+  const char *p = *ptr;
+  const char *end = p + len;
+  const jsonenc_field *valf = &entry->fields[1];
+  bool msgval = valf->field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE;
+  jsonenc_mapval key, val;
+  const char *valptr = NULL;
+  size_t vallen = 0;
+  int seen = 0;
+
+  /* Missing keys and values are zero, or empty strings. */
+  memset(&key, 0, sizeof(key));
+  memset(&val, 0, sizeof(val));
+  while (p < end) {
+    uint64_t tag;
+    uint32_t number;
+    int wire_type;
+    const jsonenc_field *jf;
+
+    if (!jsontc_varint(&p, end, &tag) || tag > UINT32_MAX) {
+      return jsontc_fallback(e);
+    }
+    number = (uint32_t)tag >> 3;
+    wire_type = tag & 7;
+    if (number < 1 || number > 2) {
+      if (number == 0 || !jsontc_skip(&p, end, wire_type)) {
+        return jsontc_fallback(e);
+      }
+      continue;
+    }
+
+    jf = &entry->fields[number - 1];
+    if ((seen & number) ||
+        wire_type != jsontc_wiretype(jf->field->descriptortype)) {
+      return jsontc_fallback(e);
+    }
+    seen |= number;
+
+    if (number == 2 && msgval) {
+      if (!jsontc_len(&p, end, &vallen)) return jsontc_fallback(e);
+      valptr = p;
+      p += vallen;
+    } else if (!jsontc_scalar(&p, end, jf->field->descriptortype,
+                              number == 1 ? &key : &val)) {
+      return jsontc_fallback(e);
+    }
+  }
+
+  *ptr = end;
+  CHK(jsonenc_mapkey(e, &key, &entry->fields[0]));
+  if (msgval) {
+    /* A missing message value is an empty message. */
+    if (!valptr) valptr = end;
+    return jsontc_submsg(e, &valptr, valptr + vallen, 0,
+                         jsonenc_subtype(e->cache, entry, valf));
+  }
+  return jsonenc_value(e, &val, entry, valf);
+}
+
+/* The values of repeated or map field |jf| that this tag has: a packed run of
+ * scalars, or a single value. */
+static bool jsontc_elems(jsonenc *e, const char **ptr, const char *end,
+                         int wire_type, uint32_t number, const jsonenc_type *t,
+                         const jsonenc_field *jf, bool *first, bool *open) {
+  uint8_t type = jf->field->descriptortype;
+  int expected = jsontc_wiretype(type);
+
+  if (jf->field->label == _UPB_LABEL_MAP) {
+    const jsonenc_type *entry = jsonenc_subtype(e->cache, t, jf);
+    size_t len;
+    if (!entry) return jsonenc_oom(e);
+    if (wire_type != UPB_WIRE_TYPE_DELIMITED || !jsontc_len(ptr, end, &len)) {
+      return jsontc_fallback(e);
+    }
+    CHK(jsontc_nextelem(e, jf, first, open));
+    return jsontc_mapentry(e, ptr, len, entry);
+  }
+
+  if (wire_type == UPB_WIRE_TYPE_DELIMITED &&
+      expected != UPB_WIRE_TYPE_DELIMITED) {
+    const char *packed_end;
+    size_t len;
+    if (expected == UPB_WIRE_TYPE_START_GROUP ||
+        !jsontc_len(ptr, end, &len)) {
+      return jsontc_fallback(e);
+    }
+    packed_end = *ptr + len;
+    while (*ptr < packed_end) {
+      jsonenc_mapval val;
+      if (!jsontc_scalar(ptr, packed_end, type, &val)) {
+        return jsontc_fallback(e);
+      }
+      CHK(jsontc_nextelem(e, jf, first, open));
+      CHK(jsonenc_value(e, &val, t, jf));
+    }
+    return true;
+  }
+
+  if (wire_type != expected) return jsontc_fallback(e);
+  CHK(jsontc_nextelem(e, jf, first, open));
+  return jsontc_value(e, ptr, end, wire_type, number, t, jf);
+}
+
+/* A singular field, which isn't written if it is a zero without presence, as
+ * upb_json_encode() wouldn't know that it was set. */
+static bool jsontc_single(jsonenc *e, const char **ptr, const char *end,
+                          int wire_type, uint32_t number,
+                          const jsonenc_type *t, const jsonenc_field *jf,
+                          bool *first) {
+  const upb_msglayout_field *field = jf->field;
+
+  if (wire_type != jsontc_wiretype(field->descriptortype)) {
+    return jsontc_fallback(e);
+  }
+
+  if (field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+      field->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP) {
+    if (!*first) CHK(jsonenc_putc(e, ','));
+    *first = false;
+    CHK(jsonenc_put(e, jf->key, jf->keylen));
+    return jsontc_value(e, ptr, end, wire_type, number, t, jf);
+  } else {
+    jsonenc_mapval val;
+    if (!jsontc_scalar(ptr, end, field->descriptortype, &val)) {
+      return jsontc_fallback(e);
+    }
+    if (field->presence == 0 && jsonenc_iszero((const char*)&val, field)) {
+      return true;
+    }
+    if (!*first) CHK(jsonenc_putc(e, ','));
+    *first = false;
+    CHK(jsonenc_put(e, jf->key, jf->keylen));
+    return jsonenc_value(e, &val, t, jf);
+  }
+}
+
+/* The oneofs whose members a message has, to catch a second one, which would
+ * replace the first.  More than this many is left to the slow way. */
+#define JSONTC_MAX_ONEOFS 8
+
+static bool jsontc_fields(jsonenc *e, const char **ptr, const char *end,
+                          uint32_t group, const jsonenc_type *t) {
+  const char *p = *ptr;
+  const jsonenc_field *run = NULL;  /* Repeated or map field being written. */
+  bool open = false;                /* Whether |run| has its bracket out. */
+  bool first = true;
+  uint32_t prev = 0;  /* Number of the last known field. */
+  int last = -1;
+  int16_t oneofs[JSONTC_MAX_ONEOFS];
+  int oneof_count = 0;
+
+  CHK(jsonenc_putc(e, '{'));
+  while (p < end) {
+    uint64_t tag;
+    uint32_t number;
+    int wire_type;
+    const jsonenc_field *jf;
+
+    if (!jsontc_varint(&p, end, &tag) || tag > UINT32_MAX) {
+      return jsontc_fallback(e);
+    }
+    number = (uint32_t)tag >> 3;
+    wire_type = tag & 7;
+    if (number == 0) return jsontc_fallback(e);
+
+    if (wire_type == UPB_WIRE_TYPE_END_GROUP) {
+      if (number != group) return jsontc_fallback(e);
+      group = 0;
+      break;
+    }
+
+    jf = jsontc_find(t, number, &last);
+    if (!jf) {
+      if (!jsontc_skip(&p, end, wire_type)) return jsontc_fallback(e);
+      continue;
+    }
+
+    if (jf != run) {
+      int16_t presence = jf->field->presence;
+      int i;
+
+      if (number <= prev) return jsontc_fallback(e);
+      prev = number;
+
+      if (presence < 0) {
+        for (i = 0; i < oneof_count; i++) {
+          if (oneofs[i] == presence) return jsontc_fallback(e);
+        }
+        if (oneof_count == JSONTC_MAX_ONEOFS) return jsontc_fallback(e);
+        oneofs[oneof_count++] = presence;
+      }
+
+      if (open) {
+        CHK(jsonenc_putc(e, run->field->label == _UPB_LABEL_MAP ? '}' : ']'));
+      }
+      run = NULL;
+      open = false;
+    }
+
+    if (jf->field->label == UPB_LABEL_REPEATED ||
+        jf->field->label == _UPB_LABEL_MAP) {
+      run = jf;
+      CHK(jsontc_elems(e, &p, end, wire_type, number, t, jf, &first, &open));
+    } else {
+      CHK(jsontc_single(e, &p, end, wire_type, number, t, jf, &first));
+    }
+  }
+
+  /* A group that ran out before its END_GROUP tag. */
+  if (group) return jsontc_fallback(e);
+
+  if (open) {
+    CHK(jsonenc_putc(e, run->field->label == _UPB_LABEL_MAP ? '}' : ']'));
+  }
+  *ptr = p;
+  return jsonenc_putc(e, '}');
+}
+
+#undef JSONTC_MAX_ONEOFS
+
+char *upb_json_transcode(const char *buf, size_t size, const upb_msgdef *m,
+                         const upb_msglayout *l, upb_jsonenccache *c,
+                         upb_arena *arena, size_t *outsize,
+                         upb_status *status) {
+  jsonenc e;
+  const jsonenc_type *t = jsonenc_gettype(c, m, l);
+  const char *ptr = buf;
+  bool ok;
+
+  e.buf = NULL;
+  e.ptr = NULL;
+  e.end = NULL;
+  e.arena = arena;
+  e.cache = c;
+  e.status = status;
+  e.depth = 64;
+  e.fallback = false;
+
+  if (!t) {
+    jsonenc_oom(&e);
+    return NULL;
+  }
+
+  if (t->wkt == UPB_WELLKNOWN_UNSPECIFIED) {
+    ok = jsontc_fields(&e, &ptr, buf + size, 0, t);
+  } else {
+    ok = jsontc_fallback(&e);
+  }
+
+  if (!ok && e.fallback) {
+    /* Decode it and encode the message instead, over what we wrote. */
+    upb_msg *msg = upb_msg_new(l, arena);
+    if (!msg) {
+      jsonenc_oom(&e);
+      return NULL;
+    }
+    if (!upb_decode(buf, size, msg, l, arena)) {
+      jsonenc_err(&e, "error parsing protobuf");
+      return NULL;
+    }
+    e.ptr = e.buf;
+    ok = jsonenc_msg(&e, (const char*)msg, t);
+  }
+
+  if (!ok) return NULL;
+  *outsize = e.ptr - e.buf;
+  return e.buf;
+}
+#undef CHK
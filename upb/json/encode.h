@@ -0,0 +1,73 @@
+/*
+** upb_json_encode: JSON from a upb_msg, without handlers.
+**
+** Unlike upb_json_printer, which is driven by a upb_pbdecoder (or any other
+** source of handler calls), this walks a message in memory directly, reading
+** its fields through the upb_msglayout and taking names, enum values and
+** well-known types from the upb_msgdef.  It is the upb_encode() of JSON.
+*/
+
+#ifndef UPB_JSON_ENCODE_H_
+#define UPB_JSON_ENCODE_H_
+
+#include "upb/def.h"
+#include "upb/msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Options for upb_jsonenccache_new(), to be OR'd together. */
+enum {
+  /* Use the field names from the .proto file instead of lowerCamelCase JSON
+   * names. */
+  UPB_JSONENC_PROTONAMES = 1
+};
+
+/* The per-type state for upb_json_encode(): each field's key, already quoted
+ * and followed by a colon, and the layout and def of its submessage.  It is
+ * built on first use of each type, so a cache must not be used from more than
+ * one thread at a time.  Any msgdefs and layouts used with a cache must
+ * outlive it. */
+struct upb_jsonenccache;
+typedef struct upb_jsonenccache upb_jsonenccache;
+
+upb_jsonenccache *upb_jsonenccache_new(int options);
+void upb_jsonenccache_free(upb_jsonenccache *c);
+
+/* Encodes |msg|, of type |m| with layout |l|, as JSON allocated from |arena|
+ * and sets |size| to its length; the output is not NUL-terminated.  Fields
+ * are written in field number order, and map entries in an unspecified
+ * order.  Lazy submessages are parsed into |arena| on the way; |msg| itself
+ * is not modified.
+ *
+ * Returns NULL and sets |status| on allocation failure or on a value that has
+ * no JSON form, like an out of range Timestamp.  google.protobuf.Any is not
+ * supported. */
+char *upb_json_encode(const upb_msg *msg, const upb_msgdef *m,
+                      const upb_msglayout *l, upb_jsonenccache *c,
+                      upb_arena *arena, size_t *size, upb_status *status);
+
+/* Like upb_json_encode() on |buf| parsed with upb_decode(), but without
+ * building the message: fields are written as they are read from the wire,
+ * with the keys from |c|.  Only well-known types, which need all of their
+ * fields at once, are decoded into |arena| on the way.
+ *
+ * This takes input whose fields come in field number order, as upb_encode()
+ * and the other serializers write them.  Other input, and input with errors,
+ * is decoded in full and then encoded, which gives the same output more
+ * slowly.  The one difference from upb_json_encode() is a map key that occurs
+ * twice, which is written twice.
+ *
+ * Returns NULL and sets |status| if |buf| can't be parsed, and otherwise
+ * like upb_json_encode(). */
+char *upb_json_transcode(const char *buf, size_t size, const upb_msgdef *m,
+                         const upb_msglayout *l, upb_jsonenccache *c,
+                         upb_arena *arena, size_t *outsize,
+                         upb_status *status);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_JSON_ENCODE_H_ */
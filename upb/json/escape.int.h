@@ -0,0 +1,344 @@
+/*
+** Internal-only helpers for JSON strings, shared by the JSON printers and
+** parsers.
+*/
+
+#ifndef UPB_JSON_ESCAPE_INT_H_
+#define UPB_JSON_ESCAPE_INT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "upb/port_def.inc"
+
+/* Characters below this need a \uXXXX escape, unless they have a short one. */
+#define UPB_JSON_CONTROLCHAR_LIMIT 0x20
+
+/* The longest escape _upb_json_escape() writes. */
+#define UPB_JSON_MAX_ESCAPE_LEN 6
+
+UPB_INLINE bool _upb_json_isescaped(char c) {
+  /* See RFC 4627. */
+  unsigned char uc = (unsigned char)c;
+  return uc < UPB_JSON_CONTROLCHAR_LIMIT || uc == '"' || uc == '\\';
+}
+
+/* Returns the first character in [ptr, end) that has to be escaped, or end.
+ * Strings are mostly free of such characters, so where SIMD is available we
+ * check a vector of characters at a time, and only look at single characters
+ * to find the one that matched. */
+UPB_INLINE const char *_upb_json_findescape(const char *ptr,
+                                            const char *end) {
+#if defined(__SSE2__)
+  const __m128i limit = _mm_set1_epi8(UPB_JSON_CONTROLCHAR_LIMIT - 1);
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+    /* Unsigned v < 0x20 iff min(v, 0x1f) == v. */
+    __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, limit), v);
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                   _mm_cmpeq_epi8(v, backslash));
+    if (_mm_movemask_epi8(_mm_or_si128(ctrl, special))) break;
+    ptr += 16;
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  const uint8x16_t limit = vdupq_n_u8(UPB_JSON_CONTROLCHAR_LIMIT);
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  while (end - ptr >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t*)ptr);
+    uint8x16_t special = vorrq_u8(vcltq_u8(v, limit),
+                                  vorrq_u8(vceqq_u8(v, quote),
+                                           vceqq_u8(v, backslash)));
+    if (vmaxvq_u8(special)) break;
+    ptr += 16;
+  }
+#endif
+  while (ptr < end && !_upb_json_isescaped(*ptr)) ptr++;
+  return ptr;
+}
+
+/* Writes the escape for |c|, for which _upb_json_isescaped() is true, to
+ * |buf| and returns its length. */
+UPB_INLINE size_t _upb_json_escape(char c, char *buf) {
+  static const char hex[] = "0123456789abcdef";
+  /* Use a "nice" escape, like \n, if one exists for this character. */
+  const char *nice = NULL;
+  unsigned char byte = (unsigned char)c;
+  switch (c) {
+    case '"':  nice = "\\\""; break;
+    case '\\': nice = "\\\\"; break;
+    case '\b': nice = "\\b"; break;
+    case '\f': nice = "\\f"; break;
+    case '\n': nice = "\\n"; break;
+    case '\r': nice = "\\r"; break;
+    case '\t': nice = "\\t"; break;
+  }
+  if (nice) {
+    memcpy(buf, nice, 2);
+    return 2;
+  }
+  /* Otherwise a \uXXXX-style escape; only control characters need one. */
+  memcpy(buf, "\\u00", 4);
+  buf[4] = hex[byte >> 4];
+  buf[5] = hex[byte & 0xf];
+  return 6;
+}
+
+/* Where SSSE3 or NEON is available, base64 goes through vectors of 16
+ * characters at a time (64 for NEON), and the rest through scalar loops. */
+
+/* The length of |len| bytes in base64, with padding. */
+UPB_INLINE size_t _upb_json_base64len(size_t len) {
+  return (len + 2) / 3 * 4;
+}
+
+#if defined(__SSSE3__)
+/* The characters for the 16 6-bit values in |v|, one per byte. */
+UPB_INLINE __m128i _upb_json_base64chars(__m128i v) {
+  /* Maps each range of values to what is added to get its character: values
+   * 0-25 get index 13, 26-51 index 0, and the others 1-12. */
+  const __m128i shift = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i index = _mm_subs_epu8(v, _mm_set1_epi8(51));
+  __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), v);
+  index = _mm_or_si128(index, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  return _mm_add_epi8(v, _mm_shuffle_epi8(shift, index));
+}
+#endif
+
+/* Writes |len| bytes from |from| to |to| in base64, the regular rather than
+ * the "web-safe" version, with padding.  Returns the number of characters
+ * written, _upb_json_base64len(len). */
+UPB_INLINE size_t _upb_json_base64(const char *from, size_t len, char *to) {
+  static const char base64[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const unsigned char *p = (const unsigned char*)from;
+  const unsigned char *end = p + len;
+  char *start = to;
+
+#if defined(__SSSE3__)
+  /* 12 bytes make 16 characters, but the load reads 16 bytes. */
+  for (; end - p >= 16; p += 12, to += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i*)p);
+    __m128i hi, lo;
+    /* Each 32-bit lane gets 3 bytes, as bytes 1, 0, 2, 1 of them... */
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8,
+                                            7, 10, 9, 11, 10));
+    /* ...from which multiplies shift each 6-bit value into its own byte. */
+    hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                         _mm_set1_epi32(0x04000040));
+    lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                         _mm_set1_epi32(0x01000010));
+    _mm_storeu_si128((__m128i*)to, _upb_json_base64chars(_mm_or_si128(hi, lo)));
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  if (end - p >= 48) {
+    uint8x16x4_t table;
+    table.val[0] = vld1q_u8((const uint8_t*)base64);
+    table.val[1] = vld1q_u8((const uint8_t*)base64 + 16);
+    table.val[2] = vld1q_u8((const uint8_t*)base64 + 32);
+    table.val[3] = vld1q_u8((const uint8_t*)base64 + 48);
+    /* 48 bytes make 64 characters, with each load and store interleaving
+     * (3 and 4 ways) so that lane i has group i. */
+    for (; end - p >= 48; p += 48, to += 64) {
+      uint8x16x3_t in = vld3q_u8(p);
+      uint8x16x4_t out;
+      const uint8x16_t mask = vdupq_n_u8(0x3f);
+      out.val[0] = vshrq_n_u8(in.val[0], 2);
+      out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                     vshrq_n_u8(in.val[1], 4)), mask);
+      out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                     vshrq_n_u8(in.val[2], 6)), mask);
+      out.val[3] = vandq_u8(in.val[2], mask);
+      out.val[0] = vqtbl4q_u8(table, out.val[0]);
+      out.val[1] = vqtbl4q_u8(table, out.val[1]);
+      out.val[2] = vqtbl4q_u8(table, out.val[2]);
+      out.val[3] = vqtbl4q_u8(table, out.val[3]);
+      vst4q_u8((uint8_t*)to, out);
+    }
+  }
+#endif
+
+  for (; end - p > 2; p += 3, to += 4) {
+    to[0] = base64[p[0] >> 2];
+    to[1] = base64[((p[0] & 0x3) << 4) | (p[1] >> 4)];
+    to[2] = base64[((p[1] & 0xf) << 2) | (p[2] >> 6)];
+    to[3] = base64[p[2] & 0x3f];
+  }
+
+  switch (end - p) {
+    case 2:
+      to[0] = base64[p[0] >> 2];
+      to[1] = base64[((p[0] & 0x3) << 4) | (p[1] >> 4)];
+      to[2] = base64[(p[1] & 0xf) << 2];
+      to[3] = '=';
+      to += 4;
+      break;
+    case 1:
+      to[0] = base64[p[0] >> 2];
+      to[1] = base64[((p[0] & 0x3) << 4)];
+      to[2] = '=';
+      to[3] = '=';
+      to += 4;
+      break;
+  }
+
+  return to - start;
+}
+
+/* The value of base64 character |c|, of either the regular or the "web-safe"
+ * alphabet, or -1 for anything else, padding included. */
+UPB_INLINE int _upb_json_base64val(char c) {
+  static const signed char vals[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+  };
+  return vals[(unsigned char)c];
+}
+
+#if defined(__SSSE3__)
+/* The values of the 16 base64 characters in |v|, or false if any of them
+ * isn't one. */
+UPB_INLINE bool _upb_json_base64vals(__m128i v, __m128i *vals) {
+  /* Unsigned x <= n iff min(x, n) == x. */
+#define UPB_JSON_INRANGE(lo, hi)                             \
+  _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8(v, _mm_set1_epi8(lo)), \
+                              _mm_set1_epi8(hi - lo)),       \
+                 _mm_sub_epi8(v, _mm_set1_epi8(lo)))
+  __m128i upper = UPB_JSON_INRANGE('A', 'Z');
+  __m128i lower = UPB_JSON_INRANGE('a', 'z');
+  __m128i digit = UPB_JSON_INRANGE('0', '9');
+#undef UPB_JSON_INRANGE
+  __m128i plus = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('+')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+  __m128i slash = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')),
+                               _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  __m128i any = _mm_or_si128(_mm_or_si128(upper, lower),
+                             _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+  if (_mm_movemask_epi8(any) != 0xffff) return false;
+  *vals = _mm_and_si128(upper, _mm_sub_epi8(v, _mm_set1_epi8('A')));
+  *vals = _mm_or_si128(*vals, _mm_and_si128(lower, _mm_sub_epi8(
+                                  v, _mm_set1_epi8('a' - 26))));
+  *vals = _mm_or_si128(*vals, _mm_and_si128(digit, _mm_add_epi8(
+                                  v, _mm_set1_epi8(52 - '0'))));
+  *vals = _mm_or_si128(*vals, _mm_and_si128(plus, _mm_set1_epi8(62)));
+  *vals = _mm_or_si128(*vals, _mm_and_si128(slash, _mm_set1_epi8(63)));
+  return true;
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+/* The values of the 16 base64 characters in |v|; any that isn't one sets its
+ * lane of |bad|. */
+UPB_INLINE uint8x16_t _upb_json_base64vals(uint8x16_t v, uint8x16_t *bad) {
+  uint8x16_t upper_val = vsubq_u8(v, vdupq_n_u8('A'));
+  uint8x16_t lower_val = vsubq_u8(v, vdupq_n_u8('a' - 26));
+  uint8x16_t digit_val = vaddq_u8(v, vdupq_n_u8(52 - '0'));
+  uint8x16_t upper = vcleq_u8(upper_val, vdupq_n_u8(25));
+  uint8x16_t lower = vcleq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8(25));
+  uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+  uint8x16_t plus = vorrq_u8(vceqq_u8(v, vdupq_n_u8('+')),
+                             vceqq_u8(v, vdupq_n_u8('-')));
+  uint8x16_t slash = vorrq_u8(vceqq_u8(v, vdupq_n_u8('/')),
+                              vceqq_u8(v, vdupq_n_u8('_')));
+  uint8x16_t vals = vandq_u8(upper, upper_val);
+  vals = vorrq_u8(vals, vandq_u8(lower, lower_val));
+  vals = vorrq_u8(vals, vandq_u8(digit, digit_val));
+  vals = vorrq_u8(vals, vandq_u8(plus, vdupq_n_u8(62)));
+  vals = vorrq_u8(vals, vandq_u8(slash, vdupq_n_u8(63)));
+  *bad = vorrq_u8(*bad, vmvnq_u8(vorrq_u8(vorrq_u8(upper, lower),
+                                          vorrq_u8(digit,
+                                                   vorrq_u8(plus, slash)))));
+  return vals;
+}
+#endif
+
+/* Decodes groups of four base64 characters, of either alphabet, from the
+ * |len| characters at |from| into |to|, up to the first group with anything
+ * else in it, padding included.  Returns how many characters it decoded, a
+ * multiple of 4 that gives 3/4 as many bytes.  The caller handles what
+ * follows, like a padded or short last group. */
+UPB_INLINE size_t _upb_json_unbase64(const char *from, size_t len, char *to) {
+  const char *p = from;
+  const char *end = from + len;
+
+#if defined(__SSSE3__)
+  for (; end - p >= 16; p += 16, to += 12) {
+    __m128i vals;
+    if (!_upb_json_base64vals(_mm_loadu_si128((const __m128i*)p), &vals)) {
+      break;
+    }
+    /* Each 32-bit lane's four 6-bit values become one 24-bit value, first
+     * value highest, whose bytes are then written high to low. */
+    vals = _mm_maddubs_epi16(vals, _mm_set1_epi32(0x01400140));
+    vals = _mm_madd_epi16(vals, _mm_set1_epi32(0x00011000));
+    vals = _mm_shuffle_epi8(vals, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                                14, 13, 12, -1, -1, -1, -1));
+    _mm_storel_epi64((__m128i*)to, vals);
+    {
+      uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(vals, 8));
+      memcpy(to + 8, &last, 4);
+    }
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  for (; end - p >= 64; p += 64, to += 48) {
+    /* Lane i of each vector has character j of group i. */
+    uint8x16x4_t in = vld4q_u8((const uint8_t*)p);
+    uint8x16_t bad = vdupq_n_u8(0);
+    uint8x16_t a = _upb_json_base64vals(in.val[0], &bad);
+    uint8x16_t b = _upb_json_base64vals(in.val[1], &bad);
+    uint8x16_t c = _upb_json_base64vals(in.val[2], &bad);
+    uint8x16_t d = _upb_json_base64vals(in.val[3], &bad);
+    uint8x16x3_t out;
+    if (vmaxvq_u8(bad)) break;
+    out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+    vst3q_u8((uint8_t*)to, out);
+  }
+#endif
+
+  for (; end - p >= 4; p += 4, to += 3) {
+    int a = _upb_json_base64val(p[0]);
+    int b = _upb_json_base64val(p[1]);
+    int c = _upb_json_base64val(p[2]);
+    int d = _upb_json_base64val(p[3]);
+    uint32_t val;
+    if ((a | b | c | d) < 0) break;
+    val = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+    to[0] = (char)(val >> 16);
+    to[1] = (char)(val >> 8);
+    to[2] = (char)val;
+  }
+
+  return p - from;
+}
+
+#include "upb/port_undef.inc"
+
+#endif  /* UPB_JSON_ESCAPE_INT_H_ */
@@ -30,6 +30,7 @@
 
 #include <time.h>
 
+#include "upb/json/escape.int.h"
 #include "upb/json/parser.h"
 #include "upb/pb/encoder.h"
 
@@ -443,122 +444,65 @@ static size_t saturating_multiply(size_t a, size_t b) {
 
 /* TODO(haberman): make this streaming. */
 
-static const signed char b64table[] = {
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      62/*+*/, -1,      -1,      -1,      63/*/ */,
-  52/*0*/, 53/*1*/, 54/*2*/, 55/*3*/, 56/*4*/, 57/*5*/, 58/*6*/, 59/*7*/,
-  60/*8*/, 61/*9*/, -1,      -1,      -1,      -1,      -1,      -1,
-  -1,       0/*A*/,  1/*B*/,  2/*C*/,  3/*D*/,  4/*E*/,  5/*F*/,  6/*G*/,
-  07/*H*/,  8/*I*/,  9/*J*/, 10/*K*/, 11/*L*/, 12/*M*/, 13/*N*/, 14/*O*/,
-  15/*P*/, 16/*Q*/, 17/*R*/, 18/*S*/, 19/*T*/, 20/*U*/, 21/*V*/, 22/*W*/,
-  23/*X*/, 24/*Y*/, 25/*Z*/, -1,      -1,      -1,      -1,      -1,
-  -1,      26/*a*/, 27/*b*/, 28/*c*/, 29/*d*/, 30/*e*/, 31/*f*/, 32/*g*/,
-  33/*h*/, 34/*i*/, 35/*j*/, 36/*k*/, 37/*l*/, 38/*m*/, 39/*n*/, 40/*o*/,
-  41/*p*/, 42/*q*/, 43/*r*/, 44/*s*/, 45/*t*/, 46/*u*/, 47/*v*/, 48/*w*/,
-  49/*x*/, 50/*y*/, 51/*z*/, -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1,
-  -1,      -1,      -1,      -1,      -1,      -1,      -1,      -1
-};
-
-/* Returns the table value sign-extended to 32 bits.  Knowing that the upper
- * bits will be 1 for unrecognized characters makes it easier to check for
- * this error condition later (see below). */
-int32_t b64lookup(unsigned char ch) { return b64table[ch]; }
-
 /* Returns true if the given character is not a valid base64 character or
  * padding. */
-bool nonbase64(unsigned char ch) { return b64lookup(ch) == -1 && ch != '='; }
+static bool nonbase64(char ch) {
+  return _upb_json_base64val(ch) < 0 && ch != '=';
+}
 
 static bool base64_push(upb_json_parser *p, upb_selector_t sel, const char *ptr,
                         size_t len) {
   const char *limit = ptr + len;
-  for (; ptr < limit; ptr += 4) {
-    uint32_t val;
-    char output[3];
-
-    if (limit - ptr < 4) {
-      upb_status_seterrf(p->status,
-                         "Base64 input for bytes field not a multiple of 4: %s",
-                         upb_fielddef_name(p->top->f));
-      return false;
-    }
-
-    val = b64lookup(ptr[0]) << 18 |
-          b64lookup(ptr[1]) << 12 |
-          b64lookup(ptr[2]) << 6  |
-          b64lookup(ptr[3]);
-
-    /* Test the upper bit; returns true if any of the characters returned -1. */
-    if (val & 0x80000000) {
-      goto otherchar;
+  char output[768];
+  uint32_t val;
+
+  /* Everything up to the padding decodes a chunk at a time. */
+  while (ptr < limit) {
+    size_t chunk = UPB_MIN((size_t)(limit - ptr), sizeof(output) / 3 * 4);
+    size_t decoded = _upb_json_unbase64(ptr, chunk, output);
+    if (decoded > 0) {
+      upb_sink_putstring(p->top->sink, sel, output, decoded / 4 * 3, NULL);
     }
-
-    output[0] = val >> 16;
-    output[1] = (val >> 8) & 0xff;
-    output[2] = val & 0xff;
-    upb_sink_putstring(p->top->sink, sel, output, 3, NULL);
+    ptr += decoded;
+    if (decoded < chunk) break;
   }
-  return true;
 
-otherchar:
-  if (nonbase64(ptr[0]) || nonbase64(ptr[1]) || nonbase64(ptr[2]) ||
-      nonbase64(ptr[3]) ) {
+  if (ptr == limit) {
+    return true;
+  } else if (limit - ptr < 4) {
+    upb_status_seterrf(p->status,
+                       "Base64 input for bytes field not a multiple of 4: %s",
+                       upb_fielddef_name(p->top->f));
+    return false;
+  } else if (nonbase64(ptr[0]) || nonbase64(ptr[1]) || nonbase64(ptr[2]) ||
+             nonbase64(ptr[3])) {
     upb_status_seterrf(p->status,
                        "Non-base64 characters in bytes field: %s",
                        upb_fielddef_name(p->top->f));
     return false;
-  } if (ptr[2] == '=') {
-    uint32_t val;
-    char output;
+  }
 
-    /* Last group contains only two input bytes, one output byte. */
-    if (ptr[0] == '=' || ptr[1] == '=' || ptr[3] != '=') {
-      goto badpadding;
-    }
+  /* The group has padding, so it must be the last one, and end in one or two
+   * padding characters. */
+  if (limit - ptr > 4 || ptr[0] == '=' || ptr[1] == '=' || ptr[3] != '=') {
+    goto badpadding;
+  }
 
-    val = b64lookup(ptr[0]) << 18 |
-          b64lookup(ptr[1]) << 12;
+  val = (uint32_t)_upb_json_base64val(ptr[0]) << 18 |
+        (uint32_t)_upb_json_base64val(ptr[1]) << 12;
 
-    UPB_ASSERT(!(val & 0x80000000));
-    output = val >> 16;
-    upb_sink_putstring(p->top->sink, sel, &output, 1, NULL);
-    return true;
+  if (ptr[2] == '=') {
+    /* Last group contains only two input bytes, one output byte. */
+    output[0] = val >> 16;
+    upb_sink_putstring(p->top->sink, sel, output, 1, NULL);
   } else {
-    uint32_t val;
-    char output[2];
-
     /* Last group contains only three input bytes, two output bytes. */
-    if (ptr[0] == '=' || ptr[1] == '=' || ptr[2] == '=') {
-      goto badpadding;
-    }
-
-    val = b64lookup(ptr[0]) << 18 |
-          b64lookup(ptr[1]) << 12 |
-          b64lookup(ptr[2]) << 6;
-
+    val |= (uint32_t)_upb_json_base64val(ptr[2]) << 6;
     output[0] = val >> 16;
     output[1] = (val >> 8) & 0xff;
     upb_sink_putstring(p->top->sink, sel, output, 2, NULL);
-    return true;
   }
+  return true;
 
 badpadding:
   upb_status_seterrf(p->status,
@@ -868,6 +812,15 @@ static void start_text(upb_json_parser *p, const char *ptr) {
   capture_begin(p, ptr);
 }
 
+/* The machine below consumes string text a character at a time.  When it
+ * starts a run of text at |ptr|, this finds the end of the run with a vector
+ * scan and returns its last character, so the machine can resume there in the
+ * same state.  The run may end early, at a control character, which is still
+ * text to the machine. */
+static const char *skip_text(const char *ptr, const char *pe) {
+  return _upb_json_findescape(ptr + 1, pe) - 1;
+}
+
 static bool end_text(upb_json_parser *p, const char *ptr) {
   return capture_end(p, ptr);
 }
@@ -2605,7 +2558,7 @@ static bool does_fieldmask_end(upb_json_parser *p) {
 
   text =
     /[^\\"]/+
-      >{ start_text(parser, p); }
+      >{ start_text(parser, p); p = skip_text(p, pe); }
       %{ CHECK_RETURN_TOP(end_text(parser, p)); }
     ;
 
@@ -1,6 +1,6 @@
 /*
-** This currently uses snprintf() to format primitives, and could be optimized
-** further.
+** Numbers are formatted with upb_fmt_*(); only timestamps and durations still
+** use snprintf().
 */
 
 #include "upb/json/printer.h"
@@ -10,8 +10,15 @@
 #include <string.h>
 #include <time.h>
 
+#include "upb/json/escape.int.h"
+#include "upb/pb/numfmt.int.h"
+
 #include "upb/port_def.inc"
 
+/* Output is collected here and passed to the output sink in chunks of this
+ * size, rather than a call per token. */
+#define UPB_JSON_PRINTER_BUFSIZE 4096
+
 struct upb_json_printer {
   upb_sink input_;
   /* BytesSink closure. */
@@ -37,6 +44,11 @@ struct upb_json_printer {
    * printer_sethandlers_timestamp for more detail. */
   int64_t seconds;
   int32_t nanos;
+
+  /* Output not yet passed to output_.  It is flushed when full and at the end
+   * of the top-level value. */
+  size_t buflen_;
+  char buf_[UPB_JSON_PRINTER_BUFSIZE];
 };
 
 /* StringPiece; a pointer plus a length. */
@@ -87,11 +99,35 @@ strpc *newstrpc_str(upb_handlers *h, const char * str) {
 
 /* ------------ JSON string printing: values, maps, arrays ------------------ */
 
+static void print_flush(upb_json_printer *p) {
+  if (p->buflen_ > 0) {
+    /* TODO: Will need to change if we support pushback from the sink. */
+    size_t n = upb_bytessink_putbuf(p->output_, p->subc_, p->buf_, p->buflen_,
+                                    NULL);
+    UPB_ASSERT(n == p->buflen_);
+    p->buflen_ = 0;
+  }
+}
+
 static void print_data(
     upb_json_printer *p, const char *buf, unsigned int len) {
-  /* TODO: Will need to change if we support pushback from the sink. */
-  size_t n = upb_bytessink_putbuf(p->output_, p->subc_, buf, len, NULL);
-  UPB_ASSERT(n == len);
+  if (len > sizeof(p->buf_) - p->buflen_) {
+    print_flush(p);
+    if (len >= sizeof(p->buf_)) {
+      /* Too big to be worth copying. */
+      size_t n = upb_bytessink_putbuf(p->output_, p->subc_, buf, len, NULL);
+      UPB_ASSERT(n == len);
+      return;
+    }
+  }
+  memcpy(p->buf_ + p->buflen_, buf, len);
+  p->buflen_ += len;
+}
+
+/* Ends the output, after the top-level value. */
+static void print_end(upb_json_printer *p) {
+  print_flush(p);
+  upb_bytessink_end(p->output_);
 }
 
 static void print_comma(upb_json_printer *p) {
@@ -103,135 +139,97 @@ static void print_comma(upb_json_printer *p) {
 
 /* Helpers that print properly formatted elements to the JSON output stream. */
 
-/* Used for escaping control chars in strings. */
-static const char kControlCharLimit = 0x20;
-
-UPB_INLINE bool is_json_escaped(char c) {
-  /* See RFC 4627. */
-  unsigned char uc = (unsigned char)c;
-  return uc < kControlCharLimit || uc == '"' || uc == '\\';
-}
-
-UPB_INLINE const char* json_nice_escape(char c) {
-  switch (c) {
-    case '"':  return "\\\"";
-    case '\\': return "\\\\";
-    case '\b': return "\\b";
-    case '\f': return "\\f";
-    case '\n': return "\\n";
-    case '\r': return "\\r";
-    case '\t': return "\\t";
-    default:   return NULL;
-  }
+static void print_escape(upb_json_printer *p, char c) {
+  char escape_buf[UPB_JSON_MAX_ESCAPE_LEN];
+  print_data(p, escape_buf, _upb_json_escape(c, escape_buf));
 }
 
 /* Write a properly escaped string chunk. The surrounding quotes are *not*
  * printed; this is so that the caller has the option of emitting the string
  * content in chunks. */
 static void putstring(upb_json_printer *p, const char *buf, unsigned int len) {
-  const char* unescaped_run = NULL;
-  unsigned int i;
-  for (i = 0; i < len; i++) {
-    char c = buf[i];
-    /* Handle escaping. */
-    if (is_json_escaped(c)) {
-      /* Use a "nice" escape, like \n, if one exists for this character. */
-      const char* escape = json_nice_escape(c);
-      /* If we don't have a specific 'nice' escape code, use a \uXXXX-style
-       * escape. */
-      char escape_buf[8];
-      if (!escape) {
-        unsigned char byte = (unsigned char)c;
-        _upb_snprintf(escape_buf, sizeof(escape_buf), "\\u%04x", (int)byte);
-        escape = escape_buf;
-      }
-
-      /* N.B. that we assume that the input encoding is equal to the output
-       * encoding (both UTF-8 for  now), so for chars >= 0x20 and != \, ", we
-       * can simply pass the bytes through. */
-
-      /* If there's a current run of unescaped chars, print that run first. */
-      if (unescaped_run) {
-        print_data(p, unescaped_run, &buf[i] - unescaped_run);
-        unescaped_run = NULL;
-      }
-      /* Then print the escape code. */
-      print_data(p, escape, strlen(escape));
-    } else {
-      /* Add to the current unescaped run of characters. */
-      if (unescaped_run == NULL) {
-        unescaped_run = &buf[i];
-      }
-    }
-  }
-
-  /* If the string ended in a run of unescaped characters, print that last run. */
-  if (unescaped_run) {
-    print_data(p, unescaped_run, &buf[len] - unescaped_run);
+  const char *end = buf + len;
+
+  for (;;) {
+    /* N.B. that we assume that the input encoding is equal to the output
+     * encoding (both UTF-8 for  now), so for chars >= 0x20 and != \, ", we
+     * can simply pass the bytes through. */
+    const char *escaped = _upb_json_findescape(buf, end);
+    if (escaped > buf) print_data(p, buf, escaped - buf);
+    if (escaped == end) break;
+    print_escape(p, *escaped);
+    buf = escaped + 1;
   }
 }
 
 #define CHKLENGTH(x) if (!(x)) return -1;
 
-/* Helpers that format floating point values according to our custom formats.
- * Right now we use %.8g and %.17g for float/double, respectively, to match
- * proto2::util::JsonFormat's defaults.  May want to change this later. */
+/* Helpers that format numbers with upb_fmt_*(): floating point values with
+ * the shortest digits that parse back to the same value, rather than the
+ * fixed %.8g and %.17g that proto2::util::JsonFormat uses.  Each needs room
+ * for UPB_NUMFMT_MAXLEN bytes plus quotes. */
 
 const char neginf[] = "\"-Infinity\"";
 const char inf[] = "\"Infinity\"";
 
 static size_t fmt_double(double val, char* buf, size_t length) {
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN + 2);
   if (val == UPB_INFINITY) {
-    CHKLENGTH(length >= strlen(inf));
-    strcpy(buf, inf);
+    memcpy(buf, inf, strlen(inf));
     return strlen(inf);
   } else if (val == -UPB_INFINITY) {
-    CHKLENGTH(length >= strlen(neginf));
-    strcpy(buf, neginf);
+    memcpy(buf, neginf, strlen(neginf));
     return strlen(neginf);
   } else {
-    size_t n = _upb_snprintf(buf, length, "%.17g", val);
-    CHKLENGTH(n > 0 && n < length);
-    return n;
+    return upb_fmt_double(val, buf);
   }
 }
 
 static size_t fmt_float(float val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "%.8g", val);
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+  if (val == UPB_INFINITY || val == -UPB_INFINITY) {
+    return fmt_double(val, buf, length);
+  }
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN);
+  return upb_fmt_float(val, buf);
 }
 
 static size_t fmt_bool(bool val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "%s", (val ? "true" : "false"));
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+  CHKLENGTH(length >= 5);
+  if (val) {
+    memcpy(buf, "true", 4);
+    return 4;
+  } else {
+    memcpy(buf, "false", 5);
+    return 5;
+  }
 }
 
-static size_t fmt_int64_as_number(long long val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "%lld", val);
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+static size_t fmt_int64_as_number(int64_t val, char* buf, size_t length) {
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN);
+  return upb_fmt_int64(val, buf);
 }
 
-static size_t fmt_uint64_as_number(
-    unsigned long long val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "%llu", val);
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+static size_t fmt_uint64_as_number(uint64_t val, char* buf, size_t length) {
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN);
+  return upb_fmt_uint64(val, buf);
 }
 
-static size_t fmt_int64_as_string(long long val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "\"%lld\"", val);
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+static size_t fmt_int64_as_string(int64_t val, char* buf, size_t length) {
+  size_t n;
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN + 2);
+  n = upb_fmt_int64(val, buf + 1);
+  buf[0] = '"';
+  buf[n + 1] = '"';
+  return n + 2;
 }
 
-static size_t fmt_uint64_as_string(
-    unsigned long long val, char* buf, size_t length) {
-  size_t n = _upb_snprintf(buf, length, "\"%llu\"", val);
-  CHKLENGTH(n > 0 && n < length);
-  return n;
+static size_t fmt_uint64_as_string(uint64_t val, char* buf, size_t length) {
+  size_t n;
+  CHKLENGTH(length >= UPB_NUMFMT_MAXLEN + 2);
+  n = upb_fmt_uint64(val, buf + 1);
+  buf[0] = '"';
+  buf[n + 1] = '"';
+  return n + 2;
 }
 
 /* Print a map key given a field name. Called by scalar field handlers and by
@@ -401,7 +399,7 @@ static bool printer_endmsg(void *closure, const void *handler_data, upb_status *
   UPB_UNUSED(s);
   end_frame(p);
   if (p->depth_ == 0) {
-    upb_bytessink_end(p->output_);
+    print_end(p);
   }
   return true;
 }
@@ -454,61 +452,22 @@ static size_t putbytes(void *closure, const void *handler_data, const char *str,
                        size_t len, const upb_bufhandle *handle) {
   upb_json_printer *p = closure;
 
-  /* This is the regular base64, not the "web-safe" version. */
-  static const char base64[] =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-  /* Base64-encode. */
+  /* Encode a whole number of 3-byte groups at a time, so only the end of the
+   * value is padded.  Base64 never needs escaping. */
   char data[16000];
-  const char *limit = data + sizeof(data);
-  const unsigned char *from = (const unsigned char*)str;
-  char *to = data;
+  const size_t chunk = sizeof(data) / 4 * 3;
   size_t remaining = len;
-  size_t bytes;
 
   UPB_UNUSED(handler_data);
   UPB_UNUSED(handle);
 
   print_data(p, "\"", 1);
-
-  while (remaining > 2) {
-    if (limit - to < 4) {
-      bytes = to - data;
-      putstring(p, data, bytes);
-      to = data;
-    }
-
-    to[0] = base64[from[0] >> 2];
-    to[1] = base64[((from[0] & 0x3) << 4) | (from[1] >> 4)];
-    to[2] = base64[((from[1] & 0xf) << 2) | (from[2] >> 6)];
-    to[3] = base64[from[2] & 0x3f];
-
-    remaining -= 3;
-    to += 4;
-    from += 3;
-  }
-
-  switch (remaining) {
-    case 2:
-      to[0] = base64[from[0] >> 2];
-      to[1] = base64[((from[0] & 0x3) << 4) | (from[1] >> 4)];
-      to[2] = base64[(from[1] & 0xf) << 2];
-      to[3] = '=';
-      to += 4;
-      from += 2;
-      break;
-    case 1:
-      to[0] = base64[from[0] >> 2];
-      to[1] = base64[((from[0] & 0x3) << 4)];
-      to[2] = '=';
-      to[3] = '=';
-      to += 4;
-      from += 1;
-      break;
+  while (remaining > 0) {
+    size_t n = UPB_MIN(remaining, chunk);
+    print_data(p, data, _upb_json_base64(str, n, data));
+    str += n;
+    remaining -= n;
   }
-
-  bytes = to - data;
-  putstring(p, data, bytes);
   print_data(p, "\"", 1);
   return len;
 }
@@ -901,7 +860,7 @@ static bool printer_enddurationmsg(void *closure, const void *handler_data,
   print_data(p, "\"", 1);
 
   if (p->depth_ == 0) {
-    upb_bytessink_end(p->output_);
+    print_end(p);
   }
 
   UPB_UNUSED(handler_data);
@@ -975,7 +934,7 @@ static bool printer_endtimestampmsg(void *closure, const void *handler_data,
   print_data(p, "\"", 1);
 
   if (p->depth_ == 0) {
-    upb_bytessink_end(p->output_);
+    print_end(p);
   }
 
   UPB_UNUSED(handler_data);
@@ -998,7 +957,7 @@ static bool printer_endmsg_noframe(
   UPB_UNUSED(handler_data);
   UPB_UNUSED(s);
   if (p->depth_ == 0) {
-    upb_bytessink_end(p->output_);
+    print_end(p);
   }
   return true;
 }
@@ -1021,7 +980,7 @@ static bool printer_endmsg_fieldmask(
   UPB_UNUSED(s);
   print_data(p, "\"", 1);
   if (p->depth_ == 0) {
-    upb_bytessink_end(p->output_);
+    print_end(p);
   }
   return true;
 }
@@ -1365,6 +1324,7 @@ void printer_sethandlers(const void *closure, upb_handlers *h) {
 
 static void json_printer_reset(upb_json_printer *p) {
   p->depth_ = 0;
+  p->buflen_ = 0;
 }
 
 
@@ -19,7 +19,7 @@ class PrinterPtr;
 
 /* upb_json_printer ***********************************************************/
 
-#define UPB_JSON_PRINTER_SIZE 192
+#define UPB_JSON_PRINTER_SIZE 4304
 
 struct upb_json_printer;
 typedef struct upb_json_printer upb_json_printer;
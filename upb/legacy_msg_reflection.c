@@ -2,6 +2,7 @@
 #include "upb/legacy_msg_reflection.h"
 
 #include <string.h>
+#include "upb/decode.h"
 #include "upb/table.int.h"
 #include "upb/msg.h"
 
@@ -60,48 +61,13 @@ static size_t upb_msgval_sizeof(upb_fieldtype_t type) {
 }
 
 static uint8_t upb_msg_fieldsize(const upb_msglayout_field *field) {
-  if (field->label == UPB_LABEL_REPEATED) {
+  if (field->label == UPB_LABEL_REPEATED || field->label == _UPB_LABEL_MAP) {
     return sizeof(void*);
   } else {
     return upb_msgval_sizeof(upb_desctype_to_fieldtype[field->descriptortype]);
   }
 }
 
-/* TODO(haberman): this is broken right now because upb_msgval can contain
- * a char* / size_t pair, which is too big for a upb_value.  To fix this
- * we'll probably need to dynamically allocate a upb_msgval and store a
- * pointer to that in the tables for extensions/maps. */
-static upb_value upb_toval(upb_msgval val) {
-  upb_value ret;
-  UPB_UNUSED(val);
-  memset(&ret, 0, sizeof(upb_value));  /* XXX */
-  return ret;
-}
-
-static upb_msgval upb_msgval_fromval(upb_value val) {
-  upb_msgval ret;
-  UPB_UNUSED(val);
-  memset(&ret, 0, sizeof(upb_msgval));  /* XXX */
-  return ret;
-}
-
-static upb_ctype_t upb_fieldtotabtype(upb_fieldtype_t type) {
-  switch (type) {
-    case UPB_TYPE_FLOAT: return UPB_CTYPE_FLOAT;
-    case UPB_TYPE_DOUBLE: return UPB_CTYPE_DOUBLE;
-    case UPB_TYPE_BOOL: return UPB_CTYPE_BOOL;
-    case UPB_TYPE_BYTES:
-    case UPB_TYPE_MESSAGE:
-    case UPB_TYPE_STRING: return UPB_CTYPE_CONSTPTR;
-    case UPB_TYPE_ENUM:
-    case UPB_TYPE_INT32: return UPB_CTYPE_INT32;
-    case UPB_TYPE_UINT32: return UPB_CTYPE_UINT32;
-    case UPB_TYPE_INT64: return UPB_CTYPE_INT64;
-    case UPB_TYPE_UINT64: return UPB_CTYPE_UINT64;
-    default: UPB_ASSERT(false); return 0;
-  }
-}
-
 
 /** upb_msg *******************************************************************/
 
@@ -140,7 +106,7 @@ bool upb_msg_has(const upb_msg *msg,
   } else {
     /* Other fields are set when their hasbit is set. */
     uint32_t hasbit = field->presence;
-    return DEREF(msg, hasbit / 8, char) | (1 << (hasbit % 8));
+    return (DEREF(msg, hasbit / 8, char) & (1 << (hasbit % 8))) != 0;
   }
 }
 
@@ -148,7 +114,19 @@ upb_msgval upb_msg_get(const upb_msg *msg, int field_index,
                        const upb_msglayout *l) {
   const upb_msglayout_field *field = upb_msg_checkfield(field_index, l);
   int size = upb_msg_fieldsize(field);
-  return upb_msgval_read(msg, field->offset, size);
+  upb_msgval val;
+  if (field->label != UPB_LABEL_REPEATED && field->label != _UPB_LABEL_MAP &&
+      !_upb_msg_hasmem(msg, field)) {
+    /* An unset field reads as zero. */
+    memset(&val, 0, sizeof(val));
+    return val;
+  }
+  val = upb_msgval_read(msg, field->offset, size);
+  if (field->label == _UPB_LABEL_LAZY && _upb_islazy(val.msg)) {
+    val.msg = _upb_decode_lazy((upb_msg*)msg, field->offset,
+                               l->submsgs[field->submsg_index]);
+  }
+  return val;
 }
 
 void upb_msg_set(upb_msg *msg, int field_index, upb_msgval val,
@@ -207,87 +185,17 @@ bool upb_array_set(upb_array *arr, upb_fieldtype_t type, size_t i,
 
 /** upb_map *******************************************************************/
 
-struct upb_map {
-  upb_fieldtype_t key_type;
-  upb_fieldtype_t val_type;
-  /* We may want to optimize this to use inttable where possible, for greater
-   * efficiency and lower memory footprint. */
-  upb_strtable strtab;
-  upb_arena *arena;
-};
-
-static void upb_map_tokey(upb_fieldtype_t type, upb_msgval *key,
-                          const char **out_key, size_t *out_len) {
-  switch (type) {
-    case UPB_TYPE_STRING:
-      /* Point to string data of the input key. */
-      *out_key = key->str.data;
-      *out_len = key->str.size;
-      return;
-    case UPB_TYPE_BOOL:
-    case UPB_TYPE_INT32:
-    case UPB_TYPE_UINT32:
-    case UPB_TYPE_INT64:
-    case UPB_TYPE_UINT64:
-      /* Point to the key itself.  XXX: big-endian. */
-      *out_key = (const char*)key;
-      *out_len = upb_msgval_sizeof(type);
-      return;
-    case UPB_TYPE_BYTES:
-    case UPB_TYPE_DOUBLE:
-    case UPB_TYPE_ENUM:
-    case UPB_TYPE_FLOAT:
-    case UPB_TYPE_MESSAGE:
-      break;  /* Cannot be a map key. */
-  }
-  UPB_UNREACHABLE();
-}
-
-static upb_msgval upb_map_fromkey(upb_fieldtype_t type, const char *key,
-                                  size_t len) {
-  switch (type) {
-    case UPB_TYPE_STRING:
-      return upb_msgval_makestr(key, len);
-    case UPB_TYPE_BOOL:
-    case UPB_TYPE_INT32:
-    case UPB_TYPE_UINT32:
-    case UPB_TYPE_INT64:
-    case UPB_TYPE_UINT64:
-      return upb_msgval_read(key, 0, upb_msgval_sizeof(type));
-    case UPB_TYPE_BYTES:
-    case UPB_TYPE_DOUBLE:
-    case UPB_TYPE_ENUM:
-    case UPB_TYPE_FLOAT:
-    case UPB_TYPE_MESSAGE:
-      break;  /* Cannot be a map key. */
-  }
-  UPB_UNREACHABLE();
-}
+/* A upb_msgval holds a key or value in the same form as a message field, which
+ * is what the _upb_map functions take. */
 
 upb_map *upb_map_new(upb_fieldtype_t ktype, upb_fieldtype_t vtype,
                      upb_arena *a) {
-  upb_ctype_t vtabtype = upb_fieldtotabtype(vtype);
-  upb_alloc *alloc = upb_arena_alloc(a);
-  upb_map *map = upb_malloc(alloc, sizeof(upb_map));
-
-  if (!map) {
-    return NULL;
-  }
-
   UPB_ASSERT(upb_fieldtype_mapkeyok(ktype));
-  map->key_type = ktype;
-  map->val_type = vtype;
-  map->arena = a;
-
-  if (!upb_strtable_init2(&map->strtab, vtabtype, alloc)) {
-    return NULL;
-  }
-
-  return map;
+  return _upb_map_new(a, ktype, vtype);
 }
 
 size_t upb_map_size(const upb_map *map) {
-  return upb_strtable_count(&map->strtab);
+  return _upb_map_size(map);
 }
 
 upb_fieldtype_t upb_map_keytype(const upb_map *map) {
@@ -299,54 +207,30 @@ upb_fieldtype_t upb_map_valuetype(const upb_map *map) {
 }
 
 bool upb_map_get(const upb_map *map, upb_msgval key, upb_msgval *val) {
-  upb_value tabval;
-  const char *key_str;
-  size_t key_len;
-  bool ret;
-
-  upb_map_tokey(map->key_type, &key, &key_str, &key_len);
-  ret = upb_strtable_lookup2(&map->strtab, key_str, key_len, &tabval);
-  if (ret) {
-    memcpy(val, &tabval, sizeof(tabval));
-  }
-
-  return ret;
+  return _upb_map_get(map, &key, val);
 }
 
 bool upb_map_set(upb_map *map, upb_msgval key, upb_msgval val,
                  upb_msgval *removed) {
-  const char *key_str;
-  size_t key_len;
-  upb_value tabval = upb_toval(val);
-  upb_value removedtabval;
-  upb_alloc *a = upb_arena_alloc(map->arena);
-
-  upb_map_tokey(map->key_type, &key, &key_str, &key_len);
-
-  /* TODO(haberman): add overwrite operation to minimize number of lookups. */
-  if (upb_strtable_lookup2(&map->strtab, key_str, key_len, NULL)) {
-    upb_strtable_remove3(&map->strtab, key_str, key_len, &removedtabval, a);
-    memcpy(&removed, &removedtabval, sizeof(removed));
+  if (removed) {
+    _upb_map_get(map, &key, removed);
   }
-
-  return upb_strtable_insert3(&map->strtab, key_str, key_len, tabval, a);
+  return _upb_map_set(map, &key, &val);
 }
 
 bool upb_map_del(upb_map *map, upb_msgval key) {
-  const char *key_str;
-  size_t key_len;
-  upb_alloc *a = upb_arena_alloc(map->arena);
-
-  upb_map_tokey(map->key_type, &key, &key_str, &key_len);
-  return upb_strtable_remove3(&map->strtab, key_str, key_len, NULL, a);
+  return _upb_map_delete(map, &key);
 }
 
 
 /** upb_mapiter ***************************************************************/
 
 struct upb_mapiter {
-  upb_strtable_iter iter;
-  upb_fieldtype_t key_type;
+  const upb_map *map;
+  size_t iter;
+  bool done;
+  upb_msgval key;
+  upb_msgval val;
 };
 
 size_t upb_mapiter_sizeof(void) {
@@ -354,8 +238,9 @@ size_t upb_mapiter_sizeof(void) {
 }
 
 void upb_mapiter_begin(upb_mapiter *i, const upb_map *map) {
-  upb_strtable_begin(&i->iter, &map->strtab);
-  i->key_type = map->key_type;
+  i->map = map;
+  i->iter = UPB_MAP_BEGIN;
+  upb_mapiter_next(i);
 }
 
 upb_mapiter *upb_mapiter_new(const upb_map *t, upb_alloc *a) {
@@ -374,26 +259,26 @@ void upb_mapiter_free(upb_mapiter *i, upb_alloc *a) {
 }
 
 void upb_mapiter_next(upb_mapiter *i) {
-  upb_strtable_next(&i->iter);
+  i->done = !_upb_map_next(i->map, &i->iter, &i->key, &i->val);
 }
 
 bool upb_mapiter_done(const upb_mapiter *i) {
-  return upb_strtable_done(&i->iter);
+  return i->done;
 }
 
 upb_msgval upb_mapiter_key(const upb_mapiter *i) {
-  return upb_map_fromkey(i->key_type, upb_strtable_iter_key(&i->iter),
-                         upb_strtable_iter_keylength(&i->iter));
+  return i->key;
 }
 
 upb_msgval upb_mapiter_value(const upb_mapiter *i) {
-  return upb_msgval_fromval(upb_strtable_iter_value(&i->iter));
+  return i->val;
 }
 
 void upb_mapiter_setdone(upb_mapiter *i) {
-  upb_strtable_iter_setdone(&i->iter);
+  i->done = true;
 }
 
 bool upb_mapiter_isequal(const upb_mapiter *i1, const upb_mapiter *i2) {
-  return upb_strtable_iter_isequal(&i1->iter, &i2->iter);
+  if (i1->done || i2->done) return i1->done == i2->done;
+  return i1->map == i2->map && i1->iter == i2->iter;
 }
@@ -7,9 +7,6 @@
 
 #include "upb/port_def.inc"
 
-struct upb_map;
-typedef struct upb_map upb_map;
-
 struct upb_mapiter;
 typedef struct upb_mapiter upb_mapiter;
 
@@ -70,6 +67,9 @@ UPB_INLINE upb_msgval upb_msgval_makestr(const char *data, size_t size) {
 /* A upb_msg represents a protobuf message.  It always corresponds to a specific
  * upb_msglayout, which describes how it is laid out in memory.  */
 
+/* In these functions |field_index| is an index into the layout's field table,
+ * which is ordered by field number (not by upb_fielddef_index()). */
+
 /* Read-only message API.  Can be safely called by anyone. */
 
 /* Returns the value associated with this field:
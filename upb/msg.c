@@ -1,6 +1,8 @@
 
 #include "upb/msg.h"
 
+#include "upb/decode.h"
+#include "upb/decode.int.h"
 #include "upb/table.int.h"
 
 #include "upb/port_def.inc"
@@ -15,17 +17,20 @@
 typedef struct {
   char *unknown;
   size_t unknown_len;
-  size_t unknown_size;
+  size_t unknown_size;  /* 0 if |unknown| aliases data we don't own. */
 } upb_msg_internal;
 
 /* Used when a message is extendable. */
 typedef struct {
-  upb_inttable *extdict;
+  upb_msg_ext *exts;  /* In the order they were first set. */
+  size_t ext_count;
+  size_t ext_size;
   upb_msg_internal base;
 } upb_msg_internal_withext;
 
 static int upb_msg_internalsize(const upb_msglayout *l) {
-  return sizeof(upb_msg_internal) - l->extendable * sizeof(void *);
+  return l->extendable ? sizeof(upb_msg_internal_withext)
+                       : sizeof(upb_msg_internal);
 }
 
 static size_t upb_msg_sizeof(const upb_msglayout *l) {
@@ -46,20 +51,31 @@ static upb_msg_internal_withext *upb_msg_getinternalwithext(
   return VOIDPTR_AT(msg, -sizeof(upb_msg_internal_withext));
 }
 
-upb_msg *upb_msg_new(const upb_msglayout *l, upb_arena *a) {
-  upb_alloc *alloc = upb_arena_alloc(a);
-  void *mem = upb_malloc(alloc, upb_msg_sizeof(l));
-  upb_msg_internal *in;
-  upb_msg *msg;
+static const upb_msg_internal_withext *upb_msg_getinternalwithext_const(
+    const upb_msg *msg, const upb_msglayout *l) {
+  UPB_ASSERT(l->extendable);
+  return VOIDPTR_AT(msg, -sizeof(upb_msg_internal_withext));
+}
 
-  if (!mem) {
-    return NULL;
+/* Zeroes what must be zero in a message that has nothing set. */
+static void upb_msg_zero(upb_msg *msg, const upb_msglayout *l) {
+  const _upb_zerorange *r = l->zero_ranges;
+  if (!r) {
+    memset(msg, 0, l->size);
+    return;
+  }
+  for (; r->size; r++) {
+    memset((char*)msg + r->offset, 0, r->size);
   }
+}
 
-  msg = VOIDPTR_AT(mem, upb_msg_internalsize(l));
+/* Initializes a message in |mem|, which has upb_msg_sizeof(l) bytes. */
+static upb_msg *upb_msg_init(void *mem, const upb_msglayout *l) {
+  upb_msg *msg = VOIDPTR_AT(mem, upb_msg_internalsize(l));
+  upb_msg_internal *in;
 
   /* Initialize normal members. */
-  memset(msg, 0, l->size);
+  upb_msg_zero(msg, l);
 
   /* Initialize internal members. */
   in = upb_msg_getinternal(msg);
@@ -68,38 +84,105 @@ upb_msg *upb_msg_new(const upb_msglayout *l, upb_arena *a) {
   in->unknown_size = 0;
 
   if (l->extendable) {
-    upb_msg_getinternalwithext(msg, l)->extdict = NULL;
+    upb_msg_internal_withext *ext = upb_msg_getinternalwithext(msg, l);
+    ext->exts = NULL;
+    ext->ext_count = 0;
+    ext->ext_size = 0;
   }
 
   return msg;
 }
 
+upb_msg *upb_msg_new(const upb_msglayout *l, upb_arena *a) {
+  void *mem = upb_arena_malloc(a, upb_msg_sizeof(l));
+
+  if (!mem) {
+    return NULL;
+  }
+
+  return upb_msg_init(mem, l);
+}
+
+bool _upb_msg_newbatch(const upb_msglayout *l, size_t n, upb_msg **msgs,
+                       upb_arena *a) {
+  size_t stride = UPB_ALIGN_MALLOC(upb_msg_sizeof(l));
+  char *mem;
+  size_t i;
+
+  if (n > SIZE_MAX / stride || !(mem = upb_arena_malloc(a, n * stride))) {
+    return false;
+  }
+
+  for (i = 0; i < n; i++) {
+    msgs[i] = upb_msg_init(mem + i * stride, l);
+  }
+
+  return true;
+}
+
+/* Inline elements start here, so that 8-byte elements are aligned on 32-bit
+ * platforms too. */
+#define UPB_ARRAY_HDRSIZE ((sizeof(upb_array) + 7) / 8 * 8)
+
 upb_array *upb_array_new(upb_arena *a) {
-  upb_array *ret = upb_arena_malloc(a, sizeof(upb_array));
+  return _upb_array_new(a, 0, 0);
+}
+
+upb_array *_upb_array_new(upb_arena *a, size_t size, size_t elem_size) {
+  upb_array *ret = upb_arena_malloc(a, UPB_ARRAY_HDRSIZE + size * elem_size);
 
   if (!ret) {
     return NULL;
   }
 
-  ret->data = NULL;
+  ret->data = size ? (char*)ret + UPB_ARRAY_HDRSIZE : NULL;
   ret->len = 0;
-  ret->size = 0;
+  ret->size = size;
 
   return ret;
 }
 
-void upb_msg_addunknown(upb_msg *msg, const char *data, size_t len,
+bool upb_msg_addunknown(upb_msg *msg, const char *data, size_t len,
                         upb_arena *arena) {
   upb_msg_internal *in = upb_msg_getinternal(msg);
-  if (len > in->unknown_size - in->unknown_len) {
+  if (len > in->unknown_size - in->unknown_len || in->unknown_size == 0) {
     upb_alloc *alloc = upb_arena_alloc(arena);
-    size_t need = in->unknown_size + len;
+    size_t need = in->unknown_len + len;
     size_t newsize = UPB_MAX(in->unknown_size * 2, need);
-    in->unknown = upb_realloc(alloc, in->unknown, in->unknown_size, newsize);
+    char *unknown;
+    if (in->unknown_size == 0) {
+      /* Nothing yet, or aliased data we don't own. */
+      unknown = upb_malloc(alloc, newsize);
+      if (unknown && in->unknown_len) {
+        memcpy(unknown, in->unknown, in->unknown_len);
+      }
+    } else {
+      unknown = upb_realloc(alloc, in->unknown, in->unknown_size, newsize);
+    }
+    if (!unknown) return false;
+    in->unknown = unknown;
     in->unknown_size = newsize;
   }
   memcpy(in->unknown + in->unknown_len, data, len);
   in->unknown_len += len;
+  return true;
+}
+
+bool _upb_msg_addunknown_alias(upb_msg *msg, const char *data, size_t len,
+                               upb_arena *arena) {
+  upb_msg_internal *in = upb_msg_getinternal(msg);
+  if (in->unknown_len == 0) {
+    in->unknown = (char*)data;
+    in->unknown_len = len;
+    in->unknown_size = 0;
+    return true;
+  } else if (in->unknown_size == 0 && in->unknown + in->unknown_len == data) {
+    /* Extends the aliased run. */
+    in->unknown_len += len;
+    return true;
+  } else {
+    return upb_msg_addunknown(msg, data, len, arena);
+  }
 }
 
 const char *upb_msg_getunknown(const upb_msg *msg, size_t *len) {
@@ -108,4 +191,599 @@ const char *upb_msg_getunknown(const upb_msg *msg, size_t *len) {
   return in->unknown;
 }
 
+/** Extensions ****************************************************************/
+
+const upb_msg_ext *_upb_msg_getexts(const upb_msg *msg, const upb_msglayout *l,
+                                    size_t *count) {
+  const upb_msg_internal_withext *in;
+  if (!l->extendable) {
+    *count = 0;
+    return NULL;
+  }
+  in = upb_msg_getinternalwithext_const(msg, l);
+  *count = in->ext_count;
+  return in->exts;
+}
+
+const upb_msg_ext *_upb_msg_getext(const upb_msg *msg,
+                                   const upb_msglayout_ext *e) {
+  size_t i, count;
+  const upb_msg_ext *exts = _upb_msg_getexts(msg, e->extendee, &count);
+  for (i = 0; i < count; i++) {
+    if (exts[i].ext == e) return &exts[i];
+  }
+  return NULL;
+}
+
+upb_msg_ext *_upb_msg_getorcreateext(upb_msg *msg, const upb_msglayout_ext *e,
+                                     upb_arena *arena) {
+  upb_msg_internal_withext *in = upb_msg_getinternalwithext(msg, e->extendee);
+  upb_msg_ext *ext = (upb_msg_ext*)_upb_msg_getext(msg, e);
+
+  if (ext) return ext;
+
+  if (in->ext_count == in->ext_size) {
+    size_t size = UPB_MAX(4, in->ext_size * 2);
+    upb_msg_ext *exts = upb_arena_realloc(arena, in->exts,
+                                          in->ext_size * sizeof(upb_msg_ext),
+                                          size * sizeof(upb_msg_ext));
+    if (!exts) return NULL;
+    in->exts = exts;
+    in->ext_size = size;
+  }
+
+  ext = &in->exts[in->ext_count++];
+  ext->ext = e;
+  memset(&ext->data, 0, sizeof(ext->data));
+  return ext;
+}
+
+void _upb_msg_clearext(upb_msg *msg, const upb_msglayout_ext *e) {
+  upb_msg_internal_withext *in = upb_msg_getinternalwithext(msg, e->extendee);
+  const upb_msg_ext *ext = _upb_msg_getext(msg, e);
+  if (ext) {
+    size_t i = ext - in->exts;
+    memmove(&in->exts[i], &in->exts[i + 1],
+            (in->ext_count - i - 1) * sizeof(upb_msg_ext));
+    in->ext_count--;
+  }
+}
+
+/* The registry's keys are the bytes of the extendee's address followed by
+ * those of the field number. */
+#define UPB_EXTREG_KEYSIZE (sizeof(void*) + sizeof(uint32_t))
+
+struct upb_extreg {
+  upb_arena *arena;
+  upb_strtable exts;  /* Values are const upb_msglayout_ext*. */
+};
+
+static void upb_extreg_key(char *buf, const upb_msglayout *l, uint32_t num) {
+  memcpy(buf, &l, sizeof(void*));
+  memcpy(buf + sizeof(void*), &num, sizeof(uint32_t));
+}
+
+upb_extreg *upb_extreg_new(upb_arena *arena) {
+  upb_extreg *r = upb_arena_malloc(arena, sizeof(*r));
+  if (!r || !upb_strtable_init2(&r->exts, UPB_CTYPE_CONSTPTR,
+                                upb_arena_alloc(arena))) {
+    return NULL;
+  }
+  r->arena = arena;
+  return r;
+}
+
+bool upb_extreg_add(upb_extreg *r, const upb_msglayout_ext *e) {
+  char key[UPB_EXTREG_KEYSIZE];
+  const upb_msglayout_ext *existing;
+  UPB_ASSERT(e->extendee->extendable);
+  existing = _upb_extreg_get(r, e->extendee, e->field.number);
+  if (existing) return existing == e;
+  upb_extreg_key(key, e->extendee, e->field.number);
+  return upb_strtable_insert3(&r->exts, key, UPB_EXTREG_KEYSIZE,
+                              upb_value_constptr(e),
+                              upb_arena_alloc(r->arena));
+}
+
+const upb_msglayout_ext *_upb_extreg_get(const upb_extreg *r,
+                                         const upb_msglayout *l, uint32_t num) {
+  char key[UPB_EXTREG_KEYSIZE];
+  upb_value v;
+  upb_extreg_key(key, l, num);
+  if (!upb_strtable_lookup2(&r->exts, key, UPB_EXTREG_KEYSIZE, &v)) {
+    return NULL;
+  }
+  return upb_value_getconstptr(v);
+}
+
+#undef UPB_EXTREG_KEYSIZE
+
+/** upb_map *******************************************************************/
+
+static size_t upb_map_valsize(upb_fieldtype_t type) {
+  switch (type) {
+    case UPB_TYPE_BOOL:
+      return 1;
+    case UPB_TYPE_FLOAT:
+    case UPB_TYPE_INT32:
+    case UPB_TYPE_UINT32:
+    case UPB_TYPE_ENUM:
+      return 4;
+    case UPB_TYPE_DOUBLE:
+    case UPB_TYPE_INT64:
+    case UPB_TYPE_UINT64:
+      return 8;
+    case UPB_TYPE_MESSAGE:
+      return sizeof(void*);
+    case UPB_TYPE_STRING:
+    case UPB_TYPE_BYTES:
+      return sizeof(upb_strview);
+  }
+  UPB_UNREACHABLE();
+}
+
+static upb_strview upb_map_tokey(const upb_map *map, const void *key) {
+  if (map->key_type == UPB_TYPE_STRING) {
+    return *(const upb_strview*)key;
+  } else {
+    return upb_strview_make(key, upb_map_valsize(map->key_type));
+  }
+}
+
+static void upb_map_fromkey(const upb_map *map, const char *data, size_t len,
+                            void *key) {
+  if (map->key_type == UPB_TYPE_STRING) {
+    *(upb_strview*)key = upb_strview_make(data, len);
+  } else {
+    memcpy(key, data, len);
+  }
+}
+
+static bool upb_map_isstr(upb_fieldtype_t type) {
+  return type == UPB_TYPE_STRING || type == UPB_TYPE_BYTES;
+}
+
+static void upb_map_fromval(const upb_map *map, upb_value tabval, void *val) {
+  if (upb_map_isstr(map->val_type)) {
+    const upb_strview *str = (const upb_strview*)(uintptr_t)tabval.val;
+    memcpy(val, str, sizeof(*str));
+  } else {
+    memcpy(val, &tabval.val, upb_map_valsize(map->val_type));
+  }
+}
+
+upb_map *_upb_map_new(upb_arena *a, upb_fieldtype_t key_type,
+                      upb_fieldtype_t val_type) {
+  upb_map *map = upb_arena_malloc(a, sizeof(upb_map));
+
+  if (!map ||
+      !upb_strtable_init2(&map->table, UPB_CTYPE_UINT64, upb_arena_alloc(a))) {
+    return NULL;
+  }
+
+  map->key_type = key_type;
+  map->val_type = val_type;
+  map->arena = a;
+  return map;
+}
+
+bool _upb_map_get(const upb_map *map, const void *key, void *val) {
+  upb_strview k;
+  upb_value tabval;
+
+  if (!map) return false;
+  k = upb_map_tokey(map, key);
+  if (!upb_strtable_lookup2(&map->table, k.data, k.size, &tabval)) {
+    return false;
+  }
+  upb_map_fromval(map, tabval, val);
+  return true;
+}
+
+bool _upb_map_set(upb_map *map, const void *key, const void *val) {
+  upb_alloc *a = upb_arena_alloc(map->arena);
+  upb_strview k = upb_map_tokey(map, key);
+  upb_value tabval;
+
+  tabval.val = 0;
+  if (upb_map_isstr(map->val_type)) {
+    upb_strview *str = upb_arena_malloc(map->arena, sizeof(*str));
+    if (!str) return false;
+    memcpy(str, val, sizeof(*str));
+    tabval.val = (uintptr_t)str;
+  } else {
+    memcpy(&tabval.val, val, upb_map_valsize(map->val_type));
+  }
+  _upb_value_setval(&tabval, tabval.val, UPB_CTYPE_UINT64);
+
+  /* TODO(haberman): add overwrite operation to minimize number of lookups. */
+  upb_strtable_remove3(&map->table, k.data, k.size, NULL, a);
+  return upb_strtable_insert3(&map->table, k.data, k.size, tabval, a);
+}
+
+bool _upb_map_delete(upb_map *map, const void *key) {
+  upb_strview k;
+  if (!map) return false;
+  k = upb_map_tokey(map, key);
+  return upb_strtable_remove3(&map->table, k.data, k.size, NULL,
+                              upb_arena_alloc(map->arena));
+}
+
+bool _upb_map_next(const upb_map *map, size_t *iter, void *key, void *val) {
+  upb_strtable_iter i;
+
+  if (!map) return false;
+  if (*iter == UPB_MAP_BEGIN) {
+    upb_strtable_begin(&i, &map->table);
+  } else {
+    i.t = &map->table;
+    i.index = *iter;
+    upb_strtable_next(&i);
+  }
+
+  if (upb_strtable_done(&i)) return false;
+  upb_map_fromkey(map, upb_strtable_iter_key(&i),
+                  upb_strtable_iter_keylength(&i), key);
+  upb_map_fromval(map, upb_strtable_iter_value(&i), val);
+  *iter = i.index;
+  return true;
+}
+
+bool _upb_map_prev(const upb_map *map, size_t *iter, void *key, void *val) {
+  upb_strtable_iter i;
+
+  if (!map) return false;
+  if (*iter == UPB_MAP_BEGIN) {
+    upb_strtable_rbegin(&i, &map->table);
+  } else {
+    i.t = &map->table;
+    i.index = *iter;
+    upb_strtable_prev(&i);
+  }
+
+  if (upb_strtable_done(&i)) return false;
+  upb_map_fromkey(map, upb_strtable_iter_key(&i),
+                  upb_strtable_iter_keylength(&i), key);
+  upb_map_fromval(map, upb_strtable_iter_value(&i), val);
+  *iter = i.index;
+  return true;
+}
+
+upb_map *_upb_msg_getmap(upb_msg *msg, size_t ofs, const upb_msglayout *entry,
+                         bool create, upb_arena *a) {
+  upb_map **slot = VOIDPTR_AT(msg, ofs);
+  if (!*slot && create) {
+    *slot = _upb_map_new(
+        a, upb_desctype_to_fieldtype[entry->fields[0].descriptortype],
+        upb_desctype_to_fieldtype[entry->fields[1].descriptortype]);
+  }
+  return *slot;
+}
+
+/** upb_msg copy, merge and clear *********************************************/
+
+#define CHK(x) if (!(x)) return false
+
+static size_t upb_msg_fieldsize(const upb_msglayout_field *f) {
+  return upb_map_valsize(upb_desctype_to_fieldtype[f->descriptortype]);
+}
+
+static bool upb_msg_isstrfield(const upb_msglayout_field *f) {
+  return f->descriptortype == UPB_DESCRIPTOR_TYPE_STRING ||
+         f->descriptortype == UPB_DESCRIPTOR_TYPE_BYTES;
+}
+
+static bool upb_msg_issubfield(const upb_msglayout_field *f) {
+  return f->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+         f->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP;
+}
+
+/* Whether |f| is set in |msg|, for a field that is not repeated.  Fields
+ * without presence count as set when they are not zero. */
+static bool upb_msg_fieldisset(const upb_msg *msg,
+                               const upb_msglayout_field *f) {
+  const char *mem = (const char*)msg + f->offset;
+  if (f->presence != 0) {
+    return _upb_msg_hasmem(msg, f);
+  } else if (upb_msg_isstrfield(f)) {
+    return ((const upb_strview*)mem)->size != 0;
+  } else {
+    static const char zero[sizeof(upb_strview)] = {0};
+    return memcmp(mem, zero, upb_msg_fieldsize(f)) != 0;
+  }
+}
+
+/* Makes |str| point to a copy of its data in |a|, unless aliasing. */
+static bool upb_msg_copystr(upb_strview *str, upb_arena *a, int options) {
+  char *data;
+  if ((options & UPB_MSG_ALIAS) || str->size == 0) return true;
+  data = upb_arena_malloc(a, str->size);
+  CHK(data);
+  memcpy(data, str->data, str->size);
+  str->data = data;
+  return true;
+}
+
+static _upb_lazymsg *upb_msg_newlazy(upb_arena *a) {
+  return upb_arena_malloc(a, sizeof(_upb_lazymsg));
+}
+
+static void *upb_msg_tagged(_upb_lazymsg *lazy) {
+  return (void*)((uintptr_t)lazy | 1);
+}
+
+/* Replaces the submessage pointer in |slot| with a pointer to a copy of it.
+ * An unparsed lazy submessage stays unparsed in the copy. */
+static bool upb_msg_copysub(void **slot, const upb_msglayout *l, upb_arena *a,
+                            int options) {
+  const void *src = *slot;
+  if (src == NULL) return true;
+  if (_upb_islazy(src)) {
+    _upb_lazymsg *lazy = upb_msg_newlazy(a);
+    CHK(lazy);
+    *lazy = *_upb_getlazy(src);
+    lazy->arena = a;
+    CHK(upb_msg_copystr(&lazy->data, a, options));
+    *slot = upb_msg_tagged(lazy);
+    return true;
+  }
+  *slot = upb_msg_copy(src, l, a, options);
+  return *slot != NULL;
+}
+
+/* Appends copies of the elements of |src| to |dst|. */
+static bool upb_msg_appendarray(upb_array *dst, const upb_array *src,
+                                const upb_msglayout *l,
+                                const upb_msglayout_field *f, upb_arena *a,
+                                int options) {
+  size_t i = dst->len;
+  if (src == NULL || src->len == 0) return true;
+  CHK(upb_array_add(dst, src->len, upb_msg_fieldsize(f), src->data, a));
+  if (upb_msg_isstrfield(f)) {
+    upb_strview *elems = dst->data;
+    for (; i < dst->len; i++) CHK(upb_msg_copystr(&elems[i], a, options));
+  } else if (upb_msg_issubfield(f)) {
+    const upb_msglayout *subl = l->submsgs[f->submsg_index];
+    void **elems = dst->data;
+    for (; i < dst->len; i++) CHK(upb_msg_copysub(&elems[i], subl, a, options));
+  }
+  return true;
+}
+
+/* Adds copies of the entries of |src| to |dst|, replacing existing ones. */
+static bool upb_msg_mergemap(upb_map *dst, const upb_map *src,
+                             const upb_msglayout *entry, upb_arena *a,
+                             int options) {
+  const upb_msglayout_field *val_f = &entry->fields[1];
+  size_t iter = UPB_MAP_BEGIN;
+  union {
+    upb_strview str;
+    void *msg;
+    uint64_t u64;
+  } key, val;
+
+  while (_upb_map_next(src, &iter, &key, &val)) {
+    if (upb_msg_isstrfield(val_f)) {
+      CHK(upb_msg_copystr(&val.str, a, options));
+    } else if (upb_msg_issubfield(val_f)) {
+      CHK(upb_msg_copysub(&val.msg, entry->submsgs[val_f->submsg_index], a,
+                          options));
+    }
+    CHK(_upb_map_set(dst, &key, &val));
+  }
+  return true;
+}
+
+static bool upb_msg_copyunknown(upb_msg *dst, const upb_msg *src,
+                                upb_arena *a, int options) {
+  size_t len;
+  const char *unknown = upb_msg_getunknown(src, &len);
+  if (len == 0) return true;
+  return (options & UPB_MSG_ALIAS)
+             ? _upb_msg_addunknown_alias(dst, unknown, len, a)
+             : upb_msg_addunknown(dst, unknown, len, a);
+}
+
+static bool upb_msg_mergeexts(upb_msg *dst, const upb_msg *src,
+                              const upb_msglayout *l, upb_arena *a,
+                              int options);
+
+upb_msg *upb_msg_copy(const upb_msg *src, const upb_msglayout *l, upb_arena *a,
+                      int options) {
+  upb_msg *msg = upb_msg_new(l, a);
+  size_t i;
+
+  if (!msg) return NULL;
+
+  /* Scalars, hasbits and oneof cases come over as they are; then every
+   * pointer is replaced with one to a copy. */
+  memcpy(msg, src, l->size);
+
+  for (i = 0; i < l->field_count; i++) {
+    const upb_msglayout_field *f = &l->fields[i];
+    void **slot = VOIDPTR_AT(msg, f->offset);
+
+    if (f->label == _UPB_LABEL_MAP) {
+      const upb_map *map = *slot;
+      const upb_msglayout *entry = l->submsgs[f->submsg_index];
+      if (!map) continue;
+      *slot = NULL;
+      if (!_upb_msg_getmap(msg, f->offset, entry, true, a) ||
+          !upb_msg_mergemap(*slot, map, entry, a, options)) {
+        return NULL;
+      }
+    } else if (f->label == UPB_LABEL_REPEATED) {
+      const upb_array *arr = *slot;
+      if (!arr) continue;
+      if (!(*slot = _upb_array_new(a, arr->len, upb_msg_fieldsize(f))) ||
+          !upb_msg_appendarray(*slot, arr, l, f, a, options)) {
+        return NULL;
+      }
+    } else if (!_upb_msg_hasmem(src, f)) {
+      /* Unset, or another member of the oneof owns the memory. */
+      continue;
+    } else if (upb_msg_isstrfield(f)) {
+      if (!upb_msg_copystr((upb_strview*)slot, a, options)) return NULL;
+    } else if (upb_msg_issubfield(f)) {
+      if (!upb_msg_copysub(slot, l->submsgs[f->submsg_index], a, options)) {
+        return NULL;
+      }
+    }
+  }
+
+  return upb_msg_mergeexts(msg, src, l, a, options) &&
+                 upb_msg_copyunknown(msg, src, a, options)
+             ? msg
+             : NULL;
+}
+
+/* Merges the submessage |src| into field |f| of |dst|.  Bytes of an unparsed
+ * lazy submessage are merged the way the decoder would merge them. */
+static bool upb_msg_mergesub(upb_msg *dst, const void *src,
+                             const upb_msglayout_field *f,
+                             const upb_msglayout *l, upb_arena *a,
+                             int options) {
+  void **slot = VOIDPTR_AT(dst, f->offset);
+  void *sub = *slot;
+
+  if (src == NULL) return true;
+
+  if (sub == NULL) {
+    *slot = (void*)src;
+    return upb_msg_copysub(slot, l, a, options);
+  }
+
+  if (_upb_islazy(src)) {
+    const _upb_lazymsg *from = _upb_getlazy(src);
+    if (_upb_islazy(sub)) {
+      /* Both unparsed: concatenated submessages parse as their merge. */
+      const _upb_lazymsg *to = _upb_getlazy(sub);
+      size_t size = to->data.size + from->data.size;
+      _upb_lazymsg *lazy = upb_msg_newlazy(a);
+      char *data = upb_arena_malloc(a, size);
+      CHK(lazy && data);
+      memcpy(data, to->data.data, to->data.size);
+      memcpy(data + to->data.size, from->data.data, from->data.size);
+      *lazy = *to;
+      lazy->data = upb_strview_make(data, size);
+      *slot = upb_msg_tagged(lazy);
+      return true;
+    } else {
+      /* Decoding into a message merges into it. */
+      int decode_options = from->options & ~UPB_DECODE_ALIAS;
+      if (options & UPB_MSG_ALIAS) decode_options |= UPB_DECODE_ALIAS;
+      return upb_decode_ex(from->data.data, from->data.size, sub, l, a,
+                           decode_options);
+    }
+  }
+
+  if (_upb_islazy(sub)) {
+    sub = _upb_decode_lazy(dst, f->offset, l);
+    CHK(sub);
+  }
+  return upb_msg_merge(sub, src, l, a, options);
+}
+
+static bool upb_msg_mergefields(upb_msg *dst, const upb_msg *src,
+                                const upb_msglayout *l, upb_arena *a,
+                                int options) {
+  size_t i;
+
+  for (i = 0; i < l->field_count; i++) {
+    const upb_msglayout_field *f = &l->fields[i];
+    const void *from = (const char*)src + f->offset;
+    void **slot = VOIDPTR_AT(dst, f->offset);
+
+    if (f->label == _UPB_LABEL_MAP) {
+      const upb_map *map = *(const upb_map**)from;
+      const upb_msglayout *entry = l->submsgs[f->submsg_index];
+      if (_upb_map_size(map) == 0) continue;
+      CHK(_upb_msg_getmap(dst, f->offset, entry, true, a));
+      CHK(upb_msg_mergemap(*slot, map, entry, a, options));
+    } else if (f->label == UPB_LABEL_REPEATED) {
+      const upb_array *arr = *(const upb_array**)from;
+      if (!arr || arr->len == 0) continue;
+      if (!*slot) {
+        *slot = _upb_array_new(a, arr->len, upb_msg_fieldsize(f));
+        if (!*slot) return false;
+      }
+      CHK(upb_msg_appendarray(*slot, arr, l, f, a, options));
+    } else if (upb_msg_fieldisset(src, f)) {
+      if (!_upb_msg_hasmem(dst, f)) {
+        /* The memory is uninitialized or belonged to another member of the
+         * oneof. */
+        memset(slot, 0, upb_msg_fieldsize(f));
+      }
+      if (f->presence > 0) {
+        ((char*)dst)[f->presence / 8] |= (1 << (f->presence % 8));
+      } else if (f->presence < 0) {
+        memcpy((char*)dst + ~f->presence, &f->number, sizeof(uint32_t));
+      }
+
+      if (upb_msg_issubfield(f)) {
+        CHK(upb_msg_mergesub(dst, *(void* const*)from, f,
+                             l->submsgs[f->submsg_index], a, options));
+      } else {
+        memcpy(slot, from, upb_msg_fieldsize(f));
+        if (upb_msg_isstrfield(f)) {
+          CHK(upb_msg_copystr((upb_strview*)slot, a, options));
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Merges the value of an extension into |dst|, which holds the same
+ * extension.  Arrays and submessages go through the extension's own layout,
+ * and scalars are set even when they are zero: extensions have presence. */
+static bool upb_msg_mergeext(upb_msg_ext *dst, const upb_msg_ext *src,
+                             upb_arena *a, int options) {
+  const upb_msglayout_field *f = &src->ext->field;
+  upb_msglayout l;
+
+  if (f->label == UPB_LABEL_REPEATED || upb_msg_issubfield(f)) {
+    _upb_msglayout_forext(&l, src->ext);
+    return upb_msg_mergefields(&dst->data, &src->data, &l, a, options);
+  }
+
+  dst->data = src->data;
+  return !upb_msg_isstrfield(f) ||
+         upb_msg_copystr(&dst->data.str, a, options);
+}
+
+static bool upb_msg_mergeexts(upb_msg *dst, const upb_msg *src,
+                              const upb_msglayout *l, upb_arena *a,
+                              int options) {
+  size_t i, count;
+  const upb_msg_ext *exts = _upb_msg_getexts(src, l, &count);
+
+  for (i = 0; i < count; i++) {
+    upb_msg_ext *ext = _upb_msg_getorcreateext(dst, exts[i].ext, a);
+    CHK(ext);
+    CHK(upb_msg_mergeext(ext, &exts[i], a, options));
+  }
+
+  return true;
+}
+
+bool upb_msg_merge(upb_msg *dst, const upb_msg *src, const upb_msglayout *l,
+                   upb_arena *a, int options) {
+  return upb_msg_mergefields(dst, src, l, a, options) &&
+         upb_msg_mergeexts(dst, src, l, a, options) &&
+         upb_msg_copyunknown(dst, src, a, options);
+}
+
+void upb_msg_clear(upb_msg *msg, const upb_msglayout *l) {
+  upb_msg_zero(msg, l);
+  /* Keeps the unknown field and extension buffers, if we own them, for
+   * reuse. */
+  upb_msg_getinternal(msg)->unknown_len = 0;
+  if (l->extendable) {
+    upb_msg_getinternalwithext(msg, l)->ext_count = 0;
+  }
+}
+
+#undef CHK
 #undef VOIDPTR_AT
@@ -11,14 +11,20 @@
 
 #include <stdint.h>
 #include <string.h>
+#include "upb/table.int.h"
 #include "upb/upb.h"
 
+#include "upb/port_def.inc"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef void upb_msg;
 
+struct upb_map;
+typedef struct upb_map upb_map;
+
 /** upb_msglayout *************************************************************/
 
 /* upb_msglayout represents the memory layout of a given upb_msgdef.  The
@@ -34,14 +40,71 @@ typedef struct {
   uint8_t label;
 } upb_msglayout_field;
 
+/* The label upbc gives a singular, non-oneof submessage field marked
+ * [lazy = true].  upb_decode() leaves such a field unparsed (see
+ * _upb_lazymsg below) and it is decoded when first read through the
+ * generated accessors, which stores the result in the message: threads that
+ * share a message must not read a lazy field concurrently.  Everything else
+ * treats this label as UPB_LABEL_OPTIONAL. */
+#define _UPB_LABEL_LAZY 4
+
+/* The label upbc gives map fields.  The field holds a upb_map*, and its
+ * submessage layout is the map entry's, with the key and value as fields[0]
+ * and fields[1]. */
+#define _UPB_LABEL_MAP 5
+
+/* An entry in a message's fast table, used by the table-driven decoder in
+ * decode_fast.c.  |field_data| packs the expected tag together with what the
+ * parser needs to store the value (see UPB_FASTDATA() in decode_fast.h). */
+struct upb_decstate;
+struct upb_msglayout;
+typedef bool _upb_field_parser(struct upb_decstate *d, upb_msg *msg,
+                               const struct upb_msglayout *l, uint64_t data);
+
+typedef struct {
+  _upb_field_parser *field_parser;
+  uint64_t field_data;
+} _upb_fasttable_entry;
+
+/* A serializer that upbc generated for one message type, which upb_encode()
+ * calls instead of walking the layout (see upb/encode.int.h). */
+struct upb_encstate;
+typedef bool _upb_msg_encoder(struct upb_encstate *e, const char *msg,
+                              const struct upb_msglayout *l, size_t *size);
+
+/* A range of bytes of a message that upb_msg_new() zeroes. */
+typedef struct {
+  uint16_t offset;
+  uint16_t size;
+} _upb_zerorange;
+
 typedef struct upb_msglayout {
   const struct upb_msglayout *const* submsgs;
+  /* Sorted by field number.  The fields that have hasbits must have hasbits
+   * 1, 2, 3... in this order, which lets the encoder skip runs of absent
+   * fields. */
   const upb_msglayout_field *fields;
   /* Must be aligned to sizeof(void*).  Doesn't include internal members like
    * unknown fields, extension dict, pointer to msglayout, etc. */
   uint16_t size;
   uint16_t field_count;
+  /* Whether messages have room for extensions (see upb_msglayout_ext). */
   bool extendable;
+  /* fields[0..dense_below) have numbers 1..dense_below, so field number N
+   * (N <= dense_below) is always at fields[N - 1]. */
+  uint8_t dense_below;
+  /* Fast table for UPB_DECODE_FASTTABLE, indexed by (tag & table_mask) >> 3
+   * on the first byte of the tag.  NULL if the message doesn't have one. */
+  const _upb_fasttable_entry *fasttable;
+  uint8_t table_mask;
+  /* Generated serializer, or NULL to use the generic one. */
+  _upb_msg_encoder *encode;
+  /* If not NULL, upb_msg_new() and upb_msg_clear() only zero these ranges,
+   * ending with one of size 0, instead of the whole message.  They must
+   * cover the hasbits, the oneof cases and every field without presence;
+   * the other fields hold garbage until they are set, so they must not be
+   * read unless _upb_msg_hasmem() is true. */
+  const _upb_zerorange *zero_ranges;
 } upb_msglayout;
 
 /** Message internal representation *******************************************/
@@ -53,17 +116,224 @@ typedef struct {
   size_t size;  /* Measured in elements. */
 } upb_array;
 
-upb_msg *upb_msg_new(const upb_msglayout *l, upb_arena *a);
 upb_msg *upb_msg_new(const upb_msglayout *l, upb_arena *a);
 
-void upb_msg_addunknown(upb_msg *msg, const char *data, size_t len,
+/* Creates |n| messages like upb_msg_new(), from a single allocation of |a|,
+ * and stores them in |msgs|.  Returns false on allocation failure. */
+bool _upb_msg_newbatch(const upb_msglayout *l, size_t n, upb_msg **msgs,
+                       upb_arena *a);
+
+/* Options for upb_msg_copy() and upb_msg_merge(), to be OR'd together. */
+enum {
+  /* String and bytes fields, unknown fields and unparsed lazy submessages
+   * point into the source message instead of being copied into the arena.
+   * The source's memory must outlive the result, normally because it is in
+   * the same arena or one that was joined to it with upb_arena_fuse().
+   * Arrays, maps and submessages are always copied, since they can change. */
+  UPB_MSG_ALIAS = 1
+};
+
+/* Returns a deep copy of |src| allocated in |a|, or NULL on allocation
+ * failure.  This copies the message's memory in one go and then copies what
+ * its pointers refer to, which is much cheaper than encoding and decoding. */
+upb_msg *upb_msg_copy(const upb_msg *src, const upb_msglayout *l, upb_arena *a,
+                      int options);
+
+/* Merges |src| into |dst| like protobuf's MergeFrom(): fields set in |src|
+ * replace the same fields in |dst|, except that submessages are merged
+ * recursively, repeated fields are appended, map entries are added or
+ * replaced and unknown fields are appended.  Extensions merge like fields.
+ * Fields without presence (proto3) are only taken from |src| when they are not
+ * zero.  Anything new in |dst| is allocated in |a|.  Returns false on
+ * allocation failure, which can leave |dst| partly merged. */
+bool upb_msg_merge(upb_msg *dst, const upb_msg *src, const upb_msglayout *l,
+                   upb_arena *a, int options);
+
+/* Resets every field of |msg| and drops its extensions and unknown fields.
+ * The memory they used stays in the arena. */
+void upb_msg_clear(upb_msg *msg, const upb_msglayout *l);
+
+/* Appends |data| to the message's unknown fields.  Returns false on
+ * allocation failure. */
+bool upb_msg_addunknown(upb_msg *msg, const char *data, size_t len,
                         upb_arena *arena);
+
+/* Like upb_msg_addunknown(), but may keep a pointer to |data| instead of
+ * copying it; |data| must outlive the message. */
+bool _upb_msg_addunknown_alias(upb_msg *msg, const char *data, size_t len,
+                               upb_arena *arena);
+
 const char *upb_msg_getunknown(const upb_msg *msg, size_t *len);
 
 upb_array *upb_array_new(upb_arena *a);
 
+/* Like upb_array_new(), but with room for |size| elements of |elem_size|
+ * bytes stored inline, right after the header in the same allocation.  Most
+ * repeated fields only have a few elements, which then cost a single
+ * allocation and sit in the same cache line as the header.  If the array
+ * grows past |size|, its elements move to a separate allocation as usual. */
+upb_array *_upb_array_new(upb_arena *a, size_t size, size_t elem_size);
+
+/* An unparsed lazy submessage.  The field holds a pointer to this struct with
+ * the low bit set, instead of a upb_msg*, until it is first accessed.
+ * upb_encode() writes |data| back out as it is. */
+typedef struct {
+  upb_strview data;  /* Serialized submessage, without tag and length. */
+  upb_arena *arena;  /* Arena of the containing message. */
+  int options;       /* The upb_decode_ex() options it was decoded with. */
+} _upb_lazymsg;
+
+/* Whether the memory of field |f| of |msg| holds a value, which for a field
+ * with a hasbit or in a oneof means that the field is present.  Fields
+ * without presence are always zero-initialized.  Not for repeated fields or
+ * maps, which have no presence. */
+UPB_INLINE bool _upb_msg_hasmem(const void *msg,
+                                const upb_msglayout_field *f) {
+  if (f->presence > 0) {
+    return (((const char*)msg)[f->presence / 8] & (1 << (f->presence % 8))) !=
+           0;
+  } else if (f->presence < 0) {
+    uint32_t oneofcase;
+    memcpy(&oneofcase, (const char*)msg + ~f->presence, sizeof(oneofcase));
+    return oneofcase == f->number;
+  } else {
+    return true;
+  }
+}
+
+UPB_INLINE bool _upb_islazy(const void *submsg) {
+  return ((uintptr_t)submsg & 1) != 0;
+}
+
+UPB_INLINE _upb_lazymsg *_upb_getlazy(const void *submsg) {
+  return (_upb_lazymsg*)((uintptr_t)submsg & ~(uintptr_t)1);
+}
+
+/** Extensions ****************************************************************/
+
+/* An extension field of |extendee|, which must be extendable.  |field| has
+ * offset 0, no presence and submsg_index 0: the value lives in a upb_msg_ext,
+ * which has a layout of its own with |field| as the only field and |sub| as
+ * the only submessage (see _upb_msglayout_forext()). */
+typedef struct {
+  upb_msglayout_field field;
+  const upb_msglayout *extendee;
+  const upb_msglayout *sub;  /* NULL unless a message or group. */
+} upb_msglayout_ext;
+
+/* The value of an extension that is set in a message, held the way a field
+ * of its type would be: a upb_array* if repeated, a upb_msg* (possibly lazy)
+ * for a message, otherwise the scalar or string. */
+typedef struct {
+  const upb_msglayout_ext *ext;
+  union {
+    upb_strview str;
+    void *ptr;
+    double dbl;
+    char scalar_data[8];
+  } data;
+} upb_msg_ext;
+
+/* Fills in |l| as the layout of the data of an extension. */
+UPB_INLINE void _upb_msglayout_forext(upb_msglayout *l,
+                                      const upb_msglayout_ext *e) {
+  l->submsgs = &e->sub;
+  l->fields = &e->field;
+  l->size = sizeof(((upb_msg_ext*)0)->data);
+  l->field_count = 1;
+  l->extendable = false;
+  l->dense_below = 0;
+  l->fasttable = NULL;
+  l->table_mask = 0;
+  l->encode = NULL;
+  l->zero_ranges = NULL;
+}
+
+/* The extensions set in |msg|, in the order they were first set.  Empty if
+ * |l| is not extendable. */
+const upb_msg_ext *_upb_msg_getexts(const upb_msg *msg, const upb_msglayout *l,
+                                    size_t *count);
+
+/* The value of extension |e| in |msg|, or NULL if it is not set. */
+const upb_msg_ext *_upb_msg_getext(const upb_msg *msg,
+                                   const upb_msglayout_ext *e);
+
+/* Like _upb_msg_getext(), but adds the extension with a zero value if it is
+ * not set.  Returns NULL on allocation failure.  The result is only valid
+ * until the next extension is added to |msg|. */
+upb_msg_ext *_upb_msg_getorcreateext(upb_msg *msg, const upb_msglayout_ext *e,
+                                     upb_arena *arena);
+
+void _upb_msg_clearext(upb_msg *msg, const upb_msglayout_ext *e);
+
+/* upb_extreg: the extensions that upb_decode_withexts() parses, looked up by
+ * their extendee and field number in a hash table.  Other extensions are
+ * kept as unknown fields.  The registry is allocated from an arena, and the
+ * extensions added to it must outlive that. */
+typedef struct upb_extreg upb_extreg;
+
+upb_extreg *upb_extreg_new(upb_arena *arena);
+
+/* Adds |e|.  Returns false on allocation failure, or if the registry already
+ * has a different extension with the same extendee and number. */
+bool upb_extreg_add(upb_extreg *r, const upb_msglayout_ext *e);
+
+/* The extension of |l| with field number |num|, or NULL. */
+const upb_msglayout_ext *_upb_extreg_get(const upb_extreg *r,
+                                         const upb_msglayout *l, uint32_t num);
+
+/** upb_map *******************************************************************/
+
+/* Our internal representation for map fields.  Keys and values are passed in
+ * and out in the representation of a message field of their type: a
+ * upb_strview for strings and bytes, a upb_msg* for messages.
+ *
+ * All keys are kept in the table's string form: the bytes of a string key,
+ * or the memory of an integer key.  Values are kept in the upb_value, except
+ * for strings, which don't fit and are kept as a pointer to a upb_strview.
+ * Neither string data nor submessages are copied. */
+struct upb_map {
+  upb_fieldtype_t key_type;
+  upb_fieldtype_t val_type;
+  upb_strtable table;
+  upb_arena *arena;
+};
+
+#define UPB_MAP_BEGIN ((size_t)-1)
+
+upb_map *_upb_map_new(upb_arena *a, upb_fieldtype_t key_type,
+                      upb_fieldtype_t val_type);
+
+UPB_INLINE size_t _upb_map_size(const upb_map *map) {
+  return map ? upb_strtable_count(&map->table) : 0;
+}
+
+/* Copies the value for |key| to |val| if there is one. */
+bool _upb_map_get(const upb_map *map, const void *key, void *val);
+
+/* Adds or replaces the entry for |key|.  Returns false on allocation
+ * failure. */
+bool _upb_map_set(upb_map *map, const void *key, const void *val);
+
+/* Returns true if there was an entry for |key|. */
+bool _upb_map_delete(upb_map *map, const void *key);
+
+/* Advances |iter|, which starts at UPB_MAP_BEGIN, to the next entry, and
+ * copies out its key and value.  Returns false when there are no more.
+ * Entries come in an unspecified order, which changes as the map does. */
+bool _upb_map_next(const upb_map *map, size_t *iter, void *key, void *val);
+
+/* Like _upb_map_next(), but visits the entries in the opposite order. */
+bool _upb_map_prev(const upb_map *map, size_t *iter, void *key, void *val);
+
+/* The map in the field at |ofs|, created if |create| is set. */
+upb_map *_upb_msg_getmap(upb_msg *msg, size_t ofs, const upb_msglayout *entry,
+                         bool create, upb_arena *a);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
 
+#include "upb/port_undef.inc"
+
 #endif /* UPB_MSG_H_ */
@@ -1,6 +1,8 @@
 
 #include "upb/msgfactory.h"
 
+#include <stdlib.h>
+
 #include "upb/port_def.inc"
 
 static bool is_power_of_two(size_t val) {
@@ -50,25 +52,39 @@ static uint8_t upb_msg_fielddefsize(const upb_fielddef *f) {
 
 /** upb_msglayout *************************************************************/
 
+static int upb_msglayout_cmpfields(const void *p1, const void *p2) {
+  const upb_msglayout_field *f1 = p1;
+  const upb_msglayout_field *f2 = p2;
+  return f1->number < f2->number ? -1 : f1->number > f2->number;
+}
+
 static void upb_msglayout_free(upb_msglayout *l) {
+  upb_gfree((void*)l->fields);
+  upb_gfree((void*)l->submsgs);
   upb_gfree(l);
 }
 
 static size_t upb_msglayout_place(upb_msglayout *l, size_t size) {
   size_t ret;
 
-  l->size = align_up(l->size, size);
+  /* upb_strview is 2 words but only needs word alignment. */
+  l->size = align_up(l->size, UPB_MIN(size, sizeof(void*)));
   ret = l->size;
   l->size += size;
   return ret;
 }
 
+static const upb_msglayout *msgfactory_getlayout(upb_msgfactory *f,
+                                                const upb_msgdef *m);
+
 static bool upb_msglayout_init(const upb_msgdef *m,
                                upb_msglayout *l,
                                upb_msgfactory *factory) {
   upb_msg_field_iter it;
   upb_msg_oneof_iter oit;
   size_t hasbit;
+  size_t size;
+  size_t i;
   size_t submsg_count = 0;
   const upb_msglayout **submsgs;
   upb_msglayout_field *fields;
@@ -102,15 +118,15 @@ static bool upb_msglayout_init(const upb_msgdef *m,
   /* Allocate data offsets in three stages:
    *
    * 1. hasbits.
-   * 2. regular fields.
-   * 3. oneof fields.
-   *
-   * OPT: There is a lot of room for optimization here to minimize the size.
+   * 2. regular fields, largest first, so that each is aligned without
+   *    padding.
+   * 3. oneof fields, each with its case right after its data.
    */
 
-  /* Allocate hasbits and set basic field attributes. */
+  /* Set basic field attributes, counting the fields that need a hasbit. */
   submsg_count = 0;
-  for (upb_msg_field_begin(&it, m), hasbit = 0;
+  hasbit = 0;
+  for (upb_msg_field_begin(&it, m);
        !upb_msg_field_done(&it);
        upb_msg_field_next(&it)) {
     const upb_fielddef* f = upb_msg_iter_field(&it);
@@ -118,42 +134,43 @@ static bool upb_msglayout_init(const upb_msgdef *m,
 
     field->number = upb_fielddef_number(f);
     field->descriptortype = upb_fielddef_descriptortype(f);
-    field->label = upb_fielddef_label(f);
+    field->label = upb_fielddef_ismap(f) ? _UPB_LABEL_MAP
+                                         : upb_fielddef_label(f);
 
     if (upb_fielddef_issubmsg(f)) {
       const upb_msglayout *sub_layout =
-          upb_msgfactory_getlayout(factory, upb_fielddef_msgsubdef(f));
+          msgfactory_getlayout(factory, upb_fielddef_msgsubdef(f));
+      if (!sub_layout) return false;
       field->submsg_index = submsg_count++;
       submsgs[field->submsg_index] = sub_layout;
     }
 
-    if (upb_fielddef_haspresence(f) && !upb_fielddef_containingoneof(f)) {
-      field->presence = (hasbit++);
-    } else {
-      field->presence = 0;
-    }
+    field->presence =
+        upb_fielddef_haspresence(f) && !upb_fielddef_containingoneof(f);
+    hasbit += field->presence;
   }
 
   /* Account for space used by hasbits. */
-  l->size = div_round_up(hasbit, 8);
+  l->size = hasbit ? div_round_up(hasbit + 1, 8) : 0;
 
-  /* Allocate non-oneof fields. */
-  for (upb_msg_field_begin(&it, m); !upb_msg_field_done(&it);
-       upb_msg_field_next(&it)) {
-    const upb_fielddef* f = upb_msg_iter_field(&it);
-    size_t field_size = upb_msg_fielddefsize(f);
-    size_t index = upb_fielddef_index(f);
+  /* Allocate non-oneof fields, one size at a time. */
+  for (size = sizeof(upb_strview); size > 0; size /= 2) {
+    for (upb_msg_field_begin(&it, m); !upb_msg_field_done(&it);
+         upb_msg_field_next(&it)) {
+      const upb_fielddef* f = upb_msg_iter_field(&it);
 
-    if (upb_fielddef_containingoneof(f)) {
       /* Oneofs are handled separately below. */
-      continue;
-    }
+      if (upb_fielddef_containingoneof(f) ||
+          upb_msg_fielddefsize(f) != size) {
+        continue;
+      }
 
-    fields[index].offset = upb_msglayout_place(l, field_size);
+      fields[upb_fielddef_index(f)].offset = upb_msglayout_place(l, size);
+    }
   }
 
-  /* Allocate oneof fields.  Each oneof field consists of a uint32 for the case
-   * and space for the actual data. */
+  /* Allocate oneof fields.  Each oneof field consists of space for the actual
+   * data and a uint32 for the case. */
   for (upb_msg_oneof_begin(&oit, m); !upb_msg_oneof_done(&oit);
        upb_msg_oneof_next(&oit)) {
     const upb_oneofdef* o = upb_msg_iter_oneof(&oit);
@@ -172,9 +189,9 @@ static bool upb_msglayout_init(const upb_msgdef *m,
       field_size = UPB_MAX(field_size, upb_msg_fielddefsize(f));
     }
 
-    /* Align and allocate case offset. */
-    case_offset = upb_msglayout_place(l, case_size);
+    /* Align and allocate data and case offset. */
     data_offset = upb_msglayout_place(l, field_size);
+    case_offset = upb_msglayout_place(l, case_size);
 
     for (upb_oneof_begin(&fit, o);
          !upb_oneof_done(&fit);
@@ -189,6 +206,25 @@ static bool upb_msglayout_init(const upb_msgdef *m,
    * alignment.  TODO: track overall alignment for real? */
   l->size = align_up(l->size, 8);
 
+  /* The decoder requires fields in number order, which is not the order of
+   * upb_fielddef_index(). */
+  if (l->field_count > 0) {
+    qsort(fields, l->field_count, sizeof(*fields), upb_msglayout_cmpfields);
+  }
+
+  /* Number the hasbits in field order, as upb_msglayout requires.  Hasbit 0 is
+   * not used, since presence 0 means "no hasbit". */
+  for (i = 0, hasbit = 0; i < l->field_count; i++) {
+    if (fields[i].presence > 0) {
+      fields[i].presence = ++hasbit;
+    }
+  }
+
+  while (l->dense_below < l->field_count && l->dense_below < UINT8_MAX &&
+         fields[l->dense_below].number == l->dense_below + 1u) {
+    l->dense_below++;
+  }
+
   return true;
 }
 
@@ -198,13 +234,23 @@ static bool upb_msglayout_init(const upb_msgdef *m,
 struct upb_msgfactory {
   const upb_symtab *symtab;  /* We own a ref. */
   upb_inttable layouts;
+
+  /* The msgdefs whose layouts the current top-level msgfactory_getlayout()
+   * call has added, as a stack, and how deep its recursion is. */
+  upb_inttable pending;
+  int depth;
+
+  bool frozen;
 };
 
 upb_msgfactory *upb_msgfactory_new(const upb_symtab *symtab) {
   upb_msgfactory *ret = upb_gmalloc(sizeof(*ret));
 
   ret->symtab = symtab;
+  ret->depth = 0;
+  ret->frozen = false;
   upb_inttable_init(&ret->layouts, UPB_CTYPE_PTR);
+  upb_inttable_init(&ret->pending, UPB_CTYPE_CONSTPTR);
 
   return ret;
 }
@@ -218,6 +264,7 @@ void upb_msgfactory_free(upb_msgfactory *f) {
   }
 
   upb_inttable_uninit(&f->layouts);
+  upb_inttable_uninit(&f->pending);
   upb_gfree(f);
 }
 
@@ -225,24 +272,75 @@ const upb_symtab *upb_msgfactory_symtab(const upb_msgfactory *f) {
   return f->symtab;
 }
 
-const upb_msglayout *upb_msgfactory_getlayout(upb_msgfactory *f,
-                                              const upb_msgdef *m) {
+/* Ends a top-level msgfactory_getlayout() call.  If it failed, every layout
+ * it added is removed again, not just the one that failed: the others may
+ * already point at it, or at each other, through their submsgs. */
+static void msgfactory_endpending(upb_msgfactory *f, bool ok) {
+  while (upb_inttable_count(&f->pending) > 0) {
+    const upb_msgdef *m = upb_value_getconstptr(upb_inttable_pop(&f->pending));
+    upb_value v;
+    if (!ok && upb_inttable_removeptr(&f->layouts, m, &v)) {
+      upb_msglayout_free(upb_value_getptr(v));
+    }
+  }
+}
+
+/* Like upb_msgfactory_getlayout(), but also gives map entries the layouts
+ * that map fields refer to. */
+static const upb_msglayout *msgfactory_getlayout(upb_msgfactory *f,
+                                                const upb_msgdef *m) {
   upb_value v;
   UPB_ASSERT(upb_symtab_lookupmsg(f->symtab, upb_msgdef_fullname(m)) == m);
-  UPB_ASSERT(!upb_msgdef_mapentry(m));
 
   if (upb_inttable_lookupptr(&f->layouts, m, &v)) {
     UPB_ASSERT(upb_value_getptr(v));
     return upb_value_getptr(v);
+  } else if (f->frozen) {
+    /* m's file was not built yet when f was frozen. */
+    return NULL;
   } else {
     /* In case of circular dependency, layout has to be inserted first. */
     upb_msglayout *l = upb_gmalloc(sizeof(*l));
-    upb_msgfactory *mutable_f = (void*)f;
-    upb_inttable_insertptr(&mutable_f->layouts, m, upb_value_ptr(l));
-    UPB_ASSERT(l);
-    if (!upb_msglayout_init(m, l, f)) {
-      upb_msglayout_free(l);
+    bool ok;
+    if (!l || !upb_inttable_insertptr(&f->layouts, m, upb_value_ptr(l))) {
+      upb_gfree(l);
+      return NULL;
+    }
+    if (!upb_inttable_push(&f->pending, upb_value_constptr(m))) {
+      upb_inttable_removeptr(&f->layouts, m, NULL);
+      upb_gfree(l);
+      return NULL;
     }
-    return l;
+    f->depth++;
+    ok = upb_msglayout_init(m, l, f);
+    if (--f->depth == 0) msgfactory_endpending(f, ok);
+    return ok ? l : NULL;
   }
 }
+
+const upb_msglayout *upb_msgfactory_getlayout(upb_msgfactory *f,
+                                              const upb_msgdef *m) {
+  UPB_ASSERT(!upb_msgdef_mapentry(m));
+  return msgfactory_getlayout(f, m);
+}
+
+bool upb_msgfactory_freeze(upb_msgfactory *f) {
+  upb_symtab_iter i;
+
+  if (f->frozen) return true;
+
+  for (upb_symtab_begin(&i, f->symtab); !upb_symtab_done(&i);
+       upb_symtab_next(&i)) {
+    const upb_filedef *file = upb_symtab_iter_file(&i);
+    int j, n = upb_filedef_msgcount(file);
+    for (j = 0; j < n; j++) {
+      const upb_msgdef *m = upb_filedef_msg(file, j);
+      if (!msgfactory_getlayout(f, m)) {
+        return false;
+      }
+    }
+  }
+
+  f->frozen = true;
+  return true;
+}
@@ -34,13 +34,20 @@ const upb_symtab *upb_msgfactory_symtab(const upb_msgfactory *f);
  * - m is in upb_msgfactory_symtab(f)
  * - upb_msgdef_mapentry(m) == false (since map messages can't have layouts).
  *
- * The returned objects will live for as long as the msgfactory does.
- *
- * TODO(haberman): consider making this thread-safe and take a const
- * upb_msgfactory. */
+ * The returned objects will live for as long as the msgfactory does.  NULL is
+ * returned on OOM, or if the factory is frozen and |m| was not in the symtab
+ * at the time. */
 const upb_msglayout *upb_msgfactory_getlayout(upb_msgfactory *f,
                                               const upb_msgdef *m);
 
+/* Creates the layouts of every message in upb_msgfactory_symtab(f) up front,
+ * so that later upb_msgfactory_getlayout() calls only read the cache.  Call
+ * upb_symtab_buildall() first if the symtab has lazily added files, since
+ * only built files are covered.  After this, the factory and its symtab may be
+ * used from any number of threads at once without locking.  Returns false on
+ * OOM. */
+bool upb_msgfactory_freeze(upb_msgfactory *f);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
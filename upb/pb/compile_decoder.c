@@ -8,6 +8,7 @@
 */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include "upb/pb/decoder.int.h"
 #include "upb/pb/varint.int.h"
 
@@ -24,6 +25,8 @@
 
 static void freemethod(upb_pbdecodermethod *method) {
   upb_inttable_uninit(&method->dispatch);
+  upb_gfree(method->dense_dispatch);
+  upb_gfree(method->msgfields);
   upb_gfree(method);
 }
 
@@ -34,11 +37,55 @@ static upb_pbdecodermethod *newmethod(const upb_handlers *dest_handlers,
 
   ret->group = group;
   ret->dest_handlers_ = dest_handlers;
+  ret->layout = NULL;
+  ret->msgdef = NULL;
+  ret->msgfields = NULL;
   upb_inttable_init(&ret->dispatch, UPB_CTYPE_UINT64);
+  ret->dense_dispatch = NULL;
+  ret->dense_dispatch_size = 0;
 
   return ret;
 }
 
+/* A method that decodes into messages of layout |l|. */
+static upb_pbdecodermethod *newmsgmethod(const upb_msgdef *md,
+                                         const upb_msglayout *l,
+                                         mgroup *group) {
+  upb_pbdecodermethod *ret = newmethod(NULL, group);
+  int i;
+
+  ret->layout = l;
+  ret->msgdef = md;
+  ret->msgfields = upb_gmalloc(l->field_count * sizeof(*ret->msgfields) + 1);
+  for (i = 0; i < l->field_count; i++) {
+    const upb_msglayout_field *field = &l->fields[i];
+    ret->msgfields[i].field = field;
+    ret->msgfields[i].sublayout =
+        (field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE ||
+         field->descriptortype == UPB_DESCRIPTOR_TYPE_GROUP)
+            ? l->submsgs[field->submsg_index]
+            : NULL;
+  }
+
+  return ret;
+}
+
+/* The operand for field |f| of a method that decodes into a upb_msg, or NULL
+ * if the layout doesn't have the field. */
+static const upb_pbdecoder_msgfield *find_msgfield(
+    const upb_pbdecodermethod *method, const upb_fielddef *f) {
+  uint32_t number = upb_fielddef_number(f);
+  int i;
+
+  for (i = 0; i < method->layout->field_count; i++) {
+    if (method->msgfields[i].field->number == number) {
+      return &method->msgfields[i];
+    }
+  }
+
+  return NULL;
+}
+
 const upb_handlers *upb_pbdecodermethod_desthandlers(
     const upb_pbdecodermethod *m) {
   return m->dest_handlers_;
@@ -64,16 +111,25 @@ static void freegroup(mgroup *g) {
     freemethod(upb_value_getptr(upb_inttable_iter_value(&i)));
   }
 
+  upb_inttable_begin(&i, &g->stubs);
+  for(; !upb_inttable_done(&i); upb_inttable_next(&i)) {
+    upb_gfree(upb_value_getptr(upb_inttable_iter_value(&i)));
+  }
+
   upb_inttable_uninit(&g->methods);
+  upb_inttable_uninit(&g->stubs);
   upb_gfree(g->bytecode);
+  if (g->jit) upb_pbdecoder_jit_free(g->jit);
   upb_gfree(g);
 }
 
 mgroup *newgroup(void) {
   mgroup *g = upb_gmalloc(sizeof(*g));
   upb_inttable_init(&g->methods, UPB_CTYPE_PTR);
+  upb_inttable_init(&g->stubs, UPB_CTYPE_PTR);
   g->bytecode = NULL;
   g->bytecode_end = NULL;
+  g->jit = NULL;
   return g;
 }
 
@@ -90,6 +146,10 @@ typedef struct {
 
   /* For fields marked "lazy", parse them lazily or eagerly? */
   bool lazy;
+
+  /* The cache that compiles submessages on demand, or NULL if the group
+   * includes all of them. */
+  upb_pbcodecache *ondemand;
 } compiler;
 
 static compiler *newcompiler(mgroup *group, bool lazy) {
@@ -98,6 +158,7 @@ static compiler *newcompiler(mgroup *group, bool lazy) {
 
   ret->group = group;
   ret->lazy = lazy;
+  ret->ondemand = NULL;
   for (i = 0; i < MAXLABEL; i++) {
     ret->fwd_labels[i] = EMPTYLABEL;
     ret->back_labels[i] = EMPTYLABEL;
@@ -111,27 +172,19 @@ static void freecompiler(compiler *c) {
 
 const size_t ptr_words = sizeof(void*) / sizeof(uint32_t);
 
-/* How many words an instruction is. */
-static int instruction_len(uint32_t instr) {
-  switch (getop(instr)) {
-    case OP_SETDISPATCH: return 1 + ptr_words;
-    case OP_TAGN: return 3;
-    case OP_SETBIGGROUPNUM: return 2;
-    default: return 1;
-  }
-}
-
 bool op_has_longofs(int32_t instruction) {
   switch (getop(instruction)) {
     case OP_CALL:
     case OP_BRANCH:
     case OP_CHECKDELIM:
+    case OP_CHECKDELIM_TAG1:
       return true;
     /* The "tag" instructions only have 8 bytes available for the jump target,
      * but that is ok because these opcodes only require short jumps. */
     case OP_TAG1:
     case OP_TAG2:
     case OP_TAGN:
+    case OP_TAG1_INT32:
       return false;
     default:
       UPB_ASSERT(false);
@@ -170,7 +223,7 @@ static void label(compiler *c, unsigned int label) {
   codep = (val == EMPTYLABEL) ? NULL : c->group->bytecode + val;
   while (codep) {
     int ofs = getofs(*codep);
-    setofs(codep, c->pc - codep - instruction_len(*codep));
+    setofs(codep, c->pc - codep - upb_pbdecoder_instrlen(*codep));
     codep = ofs ? codep + ofs : NULL;
   }
   c->fwd_labels[label] = EMPTYLABEL;
@@ -223,14 +276,20 @@ static void putop(compiler *c, int op, ...) {
   va_start(ap, op);
 
   switch (op) {
-    case OP_SETDISPATCH: {
+    case OP_SETDISPATCH:
+    case OP_MSG_PARSE:
+    case OP_MSG_STARTSTR:
+    case OP_MSG_STARTSUBMSG:
+    case OP_MSG_ENDSUBMSG:
+    case OP_CALLSTUB: {
       uintptr_t ptr = (uintptr_t)va_arg(ap, void*);
-      put32(c, OP_SETDISPATCH);
+      put32(c, op);
       put32(c, ptr);
       if (sizeof(uintptr_t) > sizeof(uint32_t))
         put32(c, (uint64_t)ptr >> 32);
       break;
     }
+    case OP_MSG_STRING:
     case OP_STARTMSG:
     case OP_ENDMSG:
     case OP_PUSHLENDELIM:
@@ -264,6 +323,12 @@ static void putop(compiler *c, int op, ...) {
     case OP_PUSHTAGDELIM:
       put32(c, op | va_arg(ap, upb_selector_t) << 8);
       break;
+    case OP_PARSE_BULK: {
+      upb_selector_t sel = va_arg(ap, upb_selector_t);
+      int is64 = va_arg(ap, int);
+      put32(c, op | sel << 9 | is64 << 8);
+      break;
+    }
     case OP_SETBIGGROUPNUM:
       put32(c, op);
       put32(c, va_arg(ap, int));
@@ -322,7 +387,9 @@ const char *upb_pbdecoder_getopname(unsigned int op) {
     OP(ENDSUBMSG) OP(STARTSTR) OP(STRING) OP(ENDSTR) OP(CALL) OP(RET)
     OP(PUSHLENDELIM) OP(PUSHTAGDELIM) OP(SETDELIM) OP(CHECKDELIM)
     OP(BRANCH) OP(TAG1) OP(TAG2) OP(TAGN) OP(SETDISPATCH) OP(POP)
-    OP(SETBIGGROUPNUM) OP(DISPATCH) OP(HALT)
+    OP(SETBIGGROUPNUM) OP(DISPATCH) OP(HALT) OP(PARSE_BULK)
+    OP(CHECKDELIM_TAG1) OP(TAG1_INT32) OP(MSG_PARSE) OP(MSG_STARTSTR)
+    OP(MSG_STRING) OP(MSG_STARTSUBMSG) OP(MSG_ENDSUBMSG) OP(CALLSTUB)
   }
   return "<unknown op>";
 #undef OP
@@ -344,16 +411,32 @@ static void dumpbc(uint32_t *p, uint32_t *end, FILE *f) {
     fprintf(f, " %s", upb_pbdecoder_getopname(op));
     switch ((opcode)op) {
       case OP_SETDISPATCH: {
-        const upb_inttable *dispatch;
-        memcpy(&dispatch, p, sizeof(void*));
+        const upb_pbdecodermethod *method;
+        memcpy(&method, p, sizeof(void*));
         p += ptr_words;
-        const upb_pbdecodermethod *method =
-            (void *)((char *)dispatch -
-                     offsetof(upb_pbdecodermethod, dispatch));
         fprintf(f, " %s", upb_msgdef_fullname(
+                              method->msgdef ? method->msgdef :
                               upb_handlers_msgdef(method->dest_handlers_)));
         break;
       }
+      case OP_MSG_PARSE:
+      case OP_MSG_STARTSTR:
+      case OP_MSG_STARTSUBMSG:
+      case OP_MSG_ENDSUBMSG: {
+        const upb_pbdecoder_msgfield *mf;
+        memcpy(&mf, p, sizeof(void*));
+        p += ptr_words;
+        fprintf(f, " #%d", (int)mf->field->number);
+        break;
+      }
+      case OP_CALLSTUB: {
+        const upb_pbdecoder_callstub *stub;
+        memcpy(&stub, p, sizeof(void*));
+        p += ptr_words;
+        fprintf(f, " %p", stub->key);
+        break;
+      }
+      case OP_MSG_STRING:
       case OP_DISPATCH:
       case OP_STARTMSG:
       case OP_ENDMSG:
@@ -386,16 +469,21 @@ static void dumpbc(uint32_t *p, uint32_t *end, FILE *f) {
       case OP_PUSHTAGDELIM:
         fprintf(f, " %d", instr >> 8);
         break;
+      case OP_PARSE_BULK:
+        fprintf(f, " %d/%d", instr >> 9, (instr >> 8) & 1 ? 64 : 32);
+        break;
       case OP_SETBIGGROUPNUM:
         fprintf(f, " %d", *p++);
         break;
       case OP_CHECKDELIM:
+      case OP_CHECKDELIM_TAG1:
       case OP_CALL:
       case OP_BRANCH:
         fprintf(f, " =>0x%tx", p + getofs(instr) - begin);
         break;
       case OP_TAG1:
-      case OP_TAG2: {
+      case OP_TAG2:
+      case OP_TAG1_INT32: {
         fprintf(f, " tag:0x%x", instr >> 16);
         if (getofs(instr)) {
           fprintf(f, " =>0x%tx", p + getofs(instr) - begin);
@@ -482,6 +570,67 @@ static void dispatchtarget(compiler *c, upb_pbdecodermethod *method,
   }
 }
 
+static int cmp_fieldnum(const void *a, const void *b) {
+  uint32_t n1 = *(const uint32_t*)a;
+  uint32_t n2 = *(const uint32_t*)b;
+  return n1 < n2 ? -1 : (n1 > n2 ? 1 : 0);
+}
+
+/* Copies the dispatch table entries for the lowest field numbers into an
+ * array, for as far as it stays at least a quarter full. */
+static void set_dense_dispatch(upb_pbdecodermethod *method) {
+  const upb_inttable *t = &method->dispatch;
+  size_t n = upb_inttable_count(t);
+  uint32_t *nums = upb_gmalloc(n * sizeof(*nums) + 1);
+  upb_pbdecoder_dispatchent *dense;
+  upb_inttable_iter i;
+  uint32_t size = 0;
+  size_t count = 0;
+  size_t k;
+
+  if (!nums) return;
+
+  upb_inttable_begin(&i, t);
+  for(; !upb_inttable_done(&i); upb_inttable_next(&i)) {
+    uintptr_t key = upb_inttable_iter_key(&i);
+    if (key != DISPATCH_ENDMSG && key < UPB_MAX_FIELDNUMBER) {
+      nums[count++] = (uint32_t)key;
+    }
+  }
+  qsort(nums, count, sizeof(*nums), &cmp_fieldnum);
+
+  for (k = 0; k < count; k++) {
+    if ((k + 1) * 4 >= (size_t)nums[k] + 1) size = nums[k] + 1;
+  }
+  upb_gfree(nums);
+
+  if (size == 0) return;
+  dense = upb_gmalloc(size * sizeof(*dense));
+  if (!dense) return;
+
+  for (k = 0; k < size; k++) {
+    upb_value v;
+    dense[k].ofs = 0;
+    dense[k].ofs2 = 0;
+    dense[k].wt1 = NO_WIRE_TYPE;
+    dense[k].wt2 = NO_WIRE_TYPE;
+    if (k != DISPATCH_ENDMSG && upb_inttable_lookup(t, k, &v)) {
+      uint64_t ofs;
+      upb_pbdecoder_unpackdispatch(upb_value_getuint64(v), &ofs, &dense[k].wt1,
+                                   &dense[k].wt2);
+      dense[k].ofs = (uint32_t)ofs;
+      if (dense[k].wt2 != NO_WIRE_TYPE) {
+        bool found = upb_inttable_lookup(t, k + UPB_MAX_FIELDNUMBER, &v);
+        UPB_ASSERT(found);
+        dense[k].ofs2 = (uint32_t)upb_value_getuint64(v);
+      }
+    }
+  }
+
+  method->dense_dispatch = dense;
+  method->dense_dispatch_size = size;
+}
+
 static void putpush(compiler *c, const upb_fielddef *f) {
   if (upb_fielddef_descriptortype(f) == UPB_DESCRIPTOR_TYPE_MESSAGE) {
     putop(c, OP_PUSHLENDELIM);
@@ -496,20 +645,59 @@ static void putpush(compiler *c, const upb_fielddef *f) {
   }
 }
 
+/* The key of the method for submessage field |f| of |method|: its handlers,
+ * or its layout for a method that decodes into a upb_msg.  NULL if it has
+ * none. */
+static const void *submethod_key(const upb_pbdecodermethod *method,
+                                 const upb_fielddef *f) {
+  if (method->layout) {
+    const upb_pbdecoder_msgfield *mf = find_msgfield(method, f);
+    return mf ? mf->sublayout : NULL;
+  } else {
+    return upb_handlers_getsubhandlers(method->dest_handlers_, f);
+  }
+}
+
 static upb_pbdecodermethod *find_submethod(const compiler *c,
                                            const upb_pbdecodermethod *method,
                                            const upb_fielddef *f) {
-  const upb_handlers *sub =
-      upb_handlers_getsubhandlers(method->dest_handlers_, f);
+  const void *sub = submethod_key(method, f);
   upb_value v;
   return upb_inttable_lookupptr(&c->group->methods, sub, &v)
              ? upb_value_getptr(v)
              : NULL;
 }
 
+/* Returns the stub through which |method| calls the method for submessage |f|
+ * when that isn't in the group, or NULL if it isn't compiled on demand. */
+static upb_pbdecoder_callstub *find_substub(compiler *c,
+                                            const upb_pbdecodermethod *method,
+                                            const upb_fielddef *f) {
+  const void *sub = submethod_key(method, f);
+  upb_pbdecoder_callstub *stub;
+  upb_value v;
+
+  if (!c->ondemand || !sub) return NULL;
+
+  if (upb_inttable_lookupptr(&c->group->stubs, sub, &v)) {
+    return upb_value_getptr(v);
+  }
+
+  stub = upb_gmalloc(sizeof(*stub));
+  stub->cache = c->ondemand;
+  stub->key = sub;
+  stub->msgdef = method->layout ? upb_fielddef_msgsubdef(f) : NULL;
+  stub->method = upb_inttable_lookupptr(&c->ondemand->methods, sub, &v)
+                     ? upb_value_getconstptr(v)
+                     : NULL;
+  upb_inttable_insertptr(&c->group->stubs, sub, upb_value_ptr(stub));
+  return stub;
+}
+
+/* Methods that decode into a upb_msg have no handlers to call. */
 static void putsel(compiler *c, opcode op, upb_selector_t sel,
                    const upb_handlers *h) {
-  if (upb_handlers_gethandler(h, sel, NULL)) {
+  if (h && upb_handlers_gethandler(h, sel, NULL)) {
     putop(c, op, sel);
   }
 }
@@ -522,7 +710,7 @@ static void maybeput(compiler *c, opcode op, const upb_handlers *h,
 }
 
 static bool haslazyhandlers(const upb_handlers *h, const upb_fielddef *f) {
-  if (!upb_fielddef_lazy(f))
+  if (!h || !upb_fielddef_lazy(f))
     return false;
 
   return upb_handlers_gethandler(h, getsel(f, UPB_HANDLER_STARTSTR), NULL) ||
@@ -539,14 +727,35 @@ static bool haslazyhandlers(const upb_handlers *h, const upb_fielddef *f) {
 #define LABEL_FIELD     3  /* Jump backward to find the most recent field. */
 #define LABEL_ENDMSG    4  /* To reach the OP_ENDMSG instr for this msg. */
 
+static void putstartsubmsg(compiler *c, const upb_fielddef *f,
+                           const upb_pbdecoder_msgfield *mf) {
+  if (mf) {
+    putop(c, OP_MSG_STARTSUBMSG, mf);
+  } else {
+    putop(c, OP_STARTSUBMSG, getsel(f, UPB_HANDLER_STARTSUBMSG));
+  }
+}
+
+static void putcall(compiler *c, const upb_pbdecodermethod *method,
+                    upb_pbdecoder_callstub *stub) {
+  if (method) {
+    putop(c, OP_CALL, method);
+  } else {
+    putop(c, OP_CALLSTUB, stub);
+  }
+}
+
 /* Generates bytecode to parse a single non-lazy message field. */
 static void generate_msgfield(compiler *c, const upb_fielddef *f,
                               upb_pbdecodermethod *method) {
   const upb_handlers *h = upb_pbdecodermethod_desthandlers(method);
   const upb_pbdecodermethod *sub_m = find_submethod(c, method, f);
+  upb_pbdecoder_callstub *stub = sub_m ? NULL : find_substub(c, method, f);
+  const upb_pbdecoder_msgfield *mf =
+      method->layout ? find_msgfield(method, f) : NULL;
   int wire_type;
 
-  if (!sub_m) {
+  if (!sub_m && !stub) {
     /* Don't emit any code for this field at all; it will be parsed as an
      * unknown field.
      *
@@ -572,8 +781,11 @@ static void generate_msgfield(compiler *c, const upb_fielddef *f,
     putop(c, OP_STARTSEQ, getsel(f, UPB_HANDLER_STARTSEQ));
    label(c, LABEL_LOOPSTART);
     putpush(c, f);
-    putop(c, OP_STARTSUBMSG, getsel(f, UPB_HANDLER_STARTSUBMSG));
-    putop(c, OP_CALL, sub_m);
+    putstartsubmsg(c, f, mf);
+    putcall(c, sub_m, stub);
+    if (mf && mf->field->label == _UPB_LABEL_MAP) {
+      putop(c, OP_MSG_ENDSUBMSG, mf);
+    }
     putop(c, OP_POP);
     maybeput(c, OP_ENDSUBMSG, h, f, UPB_HANDLER_ENDSUBMSG);
     if (wire_type == UPB_WIRE_TYPE_DELIMITED) {
@@ -590,8 +802,11 @@ static void generate_msgfield(compiler *c, const upb_fielddef *f,
     putchecktag(c, f, wire_type, LABEL_DISPATCH);
    dispatchtarget(c, method, f, wire_type);
     putpush(c, f);
-    putop(c, OP_STARTSUBMSG, getsel(f, UPB_HANDLER_STARTSUBMSG));
-    putop(c, OP_CALL, sub_m);
+    putstartsubmsg(c, f, mf);
+    putcall(c, sub_m, stub);
+    if (mf && mf->field->label == _UPB_LABEL_MAP) {
+      putop(c, OP_MSG_ENDSUBMSG, mf);
+    }
     putop(c, OP_POP);
     maybeput(c, OP_ENDSUBMSG, h, f, UPB_HANDLER_ENDSUBMSG);
     if (wire_type == UPB_WIRE_TYPE_DELIMITED) {
@@ -600,10 +815,28 @@ static void generate_msgfield(compiler *c, const upb_fielddef *f,
   }
 }
 
+static void putstr(compiler *c, const upb_fielddef *f,
+                   const upb_pbdecoder_msgfield *mf) {
+  if (mf) {
+    putop(c, OP_MSG_STARTSTR, mf);
+    putop(c, OP_MSG_STRING);
+  } else {
+    putop(c, OP_STARTSTR, getsel(f, UPB_HANDLER_STARTSTR));
+    /* Need to emit even if no handler to skip past the string. */
+    putop(c, OP_STRING, getsel(f, UPB_HANDLER_STRING));
+  }
+}
+
 /* Generates bytecode to parse a single string or lazy submessage field. */
 static void generate_delimfield(compiler *c, const upb_fielddef *f,
                                 upb_pbdecodermethod *method) {
   const upb_handlers *h = upb_pbdecodermethod_desthandlers(method);
+  const upb_pbdecoder_msgfield *mf = NULL;
+
+  if (method->layout) {
+    mf = find_msgfield(method, f);
+    if (!mf) return;  /* Not in the layout: skip it as unknown. */
+  }
 
   label(c, LABEL_FIELD);
   if (upb_fielddef_isseq(f)) {
@@ -614,9 +847,7 @@ static void generate_delimfield(compiler *c, const upb_fielddef *f,
     putop(c, OP_STARTSEQ, getsel(f, UPB_HANDLER_STARTSEQ));
    label(c, LABEL_LOOPSTART);
     putop(c, OP_PUSHLENDELIM);
-    putop(c, OP_STARTSTR, getsel(f, UPB_HANDLER_STARTSTR));
-    /* Need to emit even if no handler to skip past the string. */
-    putop(c, OP_STRING, getsel(f, UPB_HANDLER_STRING));
+    putstr(c, f, mf);
     maybeput(c, OP_ENDSTR, h, f, UPB_HANDLER_ENDSTR);
     putop(c, OP_POP);
     putop(c, OP_SETDELIM);
@@ -631,23 +862,38 @@ static void generate_delimfield(compiler *c, const upb_fielddef *f,
     putchecktag(c, f, UPB_WIRE_TYPE_DELIMITED, LABEL_DISPATCH);
    dispatchtarget(c, method, f, UPB_WIRE_TYPE_DELIMITED);
     putop(c, OP_PUSHLENDELIM);
-    putop(c, OP_STARTSTR, getsel(f, UPB_HANDLER_STARTSTR));
-    putop(c, OP_STRING, getsel(f, UPB_HANDLER_STRING));
+    putstr(c, f, mf);
     maybeput(c, OP_ENDSTR, h, f, UPB_HANDLER_ENDSTR);
     putop(c, OP_POP);
     putop(c, OP_SETDELIM);
   }
 }
 
+static void putparse(compiler *c, opcode parse_type, upb_selector_t sel,
+                     const upb_pbdecoder_msgfield *mf) {
+  if (mf) {
+    putop(c, OP_MSG_PARSE, mf);
+  } else {
+    putop(c, parse_type, sel);
+  }
+}
+
 /* Generates bytecode to parse a single primitive field. */
 static void generate_primitivefield(compiler *c, const upb_fielddef *f,
                                     upb_pbdecodermethod *method) {
   const upb_handlers *h = upb_pbdecodermethod_desthandlers(method);
+  const upb_pbdecoder_msgfield *mf = NULL;
   upb_descriptortype_t descriptor_type = upb_fielddef_descriptortype(f);
   opcode parse_type;
   upb_selector_t sel;
+  upb_selector_t bulk_sel;
   int wire_type;
 
+  if (method->layout) {
+    mf = find_msgfield(method, f);
+    if (!mf) return;  /* Not in the layout: skip it as unknown. */
+  }
+
   label(c, LABEL_FIELD);
 
   /* From a decoding perspective, ENUM is the same as INT32. */
@@ -670,14 +916,19 @@ static void generate_primitivefield(compiler *c, const upb_fielddef *f,
     putop(c, OP_PUSHLENDELIM);
     putop(c, OP_STARTSEQ, getsel(f, UPB_HANDLER_STARTSEQ));  /* Packed */
    label(c, LABEL_LOOPSTART);
-    putop(c, parse_type, sel);
+    if (h && upb_handlers_getselector(f, UPB_HANDLER_BULK, &bulk_sel) &&
+        upb_handlers_gethandler(h, bulk_sel, NULL)) {
+      putop(c, OP_PARSE_BULK, bulk_sel, wire_type == UPB_WIRE_TYPE_64BIT);
+    } else {
+      putparse(c, parse_type, sel, mf);
+    }
     putop(c, OP_CHECKDELIM, LABEL_LOOPBREAK);
     putop(c, OP_BRANCH, -LABEL_LOOPSTART);
    dispatchtarget(c, method, f, wire_type);
     putop(c, OP_PUSHTAGDELIM, 0);
     putop(c, OP_STARTSEQ, getsel(f, UPB_HANDLER_STARTSEQ));  /* Non-packed */
    label(c, LABEL_LOOPSTART);
-    putop(c, parse_type, sel);
+    putparse(c, parse_type, sel, mf);
     putop(c, OP_CHECKDELIM, LABEL_LOOPBREAK);
     putchecktag(c, f, wire_type, LABEL_LOOPBREAK);
     putop(c, OP_BRANCH, -LABEL_LOOPSTART);
@@ -689,7 +940,7 @@ static void generate_primitivefield(compiler *c, const upb_fielddef *f,
     putop(c, OP_CHECKDELIM, LABEL_ENDMSG);
     putchecktag(c, f, wire_type, LABEL_DISPATCH);
    dispatchtarget(c, method, f, wire_type);
-    putop(c, parse_type, sel);
+    putparse(c, parse_type, sel, mf);
   }
 }
 
@@ -707,12 +958,15 @@ static void compile_method(compiler *c, upb_pbdecodermethod *method) {
   /* Clear all entries in the dispatch table. */
   upb_inttable_uninit(&method->dispatch);
   upb_inttable_init(&method->dispatch, UPB_CTYPE_UINT64);
+  upb_gfree(method->dense_dispatch);
+  method->dense_dispatch = NULL;
+  method->dense_dispatch_size = 0;
 
   h = upb_pbdecodermethod_desthandlers(method);
-  md = upb_handlers_msgdef(h);
+  md = method->layout ? method->msgdef : upb_handlers_msgdef(h);
 
  method->code_base.ofs = pcofs(c);
-  putop(c, OP_SETDISPATCH, &method->dispatch);
+  putop(c, OP_SETDISPATCH, method);
   putsel(c, OP_STARTMSG, UPB_STARTMSG_SELECTOR, h);
  label(c, LABEL_FIELD);
   start_pc = c->pc;
@@ -755,12 +1009,14 @@ static void compile_method(compiler *c, upb_pbdecodermethod *method) {
   putop(c, OP_RET);
 
   upb_inttable_compact(&method->dispatch);
+  set_dense_dispatch(method);
 }
 
 /* Populate "methods" with new upb_pbdecodermethod objects reachable from "h".
  * Returns the method for these handlers.
  *
- * Generates a new method for every destination handlers reachable from "h". */
+ * Generates a new method for every destination handlers reachable from "h",
+ * or only for "h" itself when submessages are compiled on demand. */
 static void find_methods(compiler *c, const upb_handlers *h) {
   upb_value v;
   upb_msg_field_iter i;
@@ -772,6 +1028,7 @@ static void find_methods(compiler *c, const upb_handlers *h) {
 
   method = newmethod(h, c->group);
   upb_inttable_insertptr(&c->group->methods, h, upb_value_ptr(method));
+  if (c->ondemand) return;
 
   /* Find submethods. */
   md = upb_handlers_msgdef(h);
@@ -789,6 +1046,32 @@ static void find_methods(compiler *c, const upb_handlers *h) {
   }
 }
 
+/* Like find_methods(), for methods that decode into messages of layout "l". */
+static void find_msgmethods(compiler *c, const upb_msgdef *md,
+                            const upb_msglayout *l) {
+  upb_value v;
+  upb_msg_field_iter i;
+  upb_pbdecodermethod *method;
+
+  if (upb_inttable_lookupptr(&c->group->methods, l, &v))
+    return;
+
+  method = newmsgmethod(md, l, c->group);
+  upb_inttable_insertptr(&c->group->methods, l, upb_value_ptr(method));
+  if (c->ondemand) return;
+
+  for(upb_msg_field_begin(&i, md);
+      !upb_msg_field_done(&i);
+      upb_msg_field_next(&i)) {
+    const upb_fielddef *f = upb_msg_iter_field(&i);
+    const upb_pbdecoder_msgfield *mf;
+    if (upb_fielddef_type(f) == UPB_TYPE_MESSAGE &&
+        (mf = find_msgfield(method, f)) != NULL) {
+      find_msgmethods(c, upb_fielddef_msgsubdef(f), mf->sublayout);
+    }
+  }
+}
+
 /* (Re-)compile bytecode for all messages in "msgs."
  * Overwrites any existing bytecode in "c". */
 static void compile_methods(compiler *c) {
@@ -819,16 +1102,30 @@ static void set_bytecode_handlers(mgroup *g) {
   }
 }
 
+/* Replaces common pairs of instructions with the superinstructions for them.
+ * Only the opcode of the first changes, so a jump to the second still finds
+ * it. */
+static void fuse_bytecode(mgroup *g) {
+  uint32_t *p = g->bytecode;
+  while (p < g->bytecode_end) {
+    uint32_t *next = p + upb_pbdecoder_instrlen(*p);
+    if (next < g->bytecode_end) {
+      opcode op = getop(*p);
+      opcode next_op = getop(*next);
+      if (op == OP_CHECKDELIM && next_op == OP_TAG1) {
+        *p = (*p & ~0xffU) | OP_CHECKDELIM_TAG1;
+      } else if (op == OP_TAG1 && next_op == OP_PARSE_INT32) {
+        *p = (*p & ~0xffU) | OP_TAG1_INT32;
+      }
+    }
+    p = next;
+  }
+}
 
-/* TODO(haberman): allow this to be constructed for an arbitrary set of dest
- * handlers and other mgroups (but verify we have a transitive closure). */
-const mgroup *mgroup_new(const upb_handlers *dest, bool lazy) {
-  mgroup *g;
-  compiler *c;
 
-  g = newgroup();
-  c = newcompiler(g, lazy);
-  find_methods(c, dest);
+/* Compiles the methods that "c" found for its group, and frees "c". */
+static const mgroup *compile_group(compiler *c, bool allow_jit) {
+  mgroup *g = c->group;
 
   /* We compile in two passes:
    * 1. all messages are assigned relative offsets from the beginning of the
@@ -841,6 +1138,7 @@ const mgroup *mgroup_new(const upb_handlers *dest, bool lazy) {
   compile_methods(c);
   g->bytecode_end = c->pc;
   freecompiler(c);
+  fuse_bytecode(g);
 
 #ifdef UPB_DUMP_BYTECODE
   {
@@ -858,9 +1156,31 @@ const mgroup *mgroup_new(const upb_handlers *dest, bool lazy) {
 #endif
 
   set_bytecode_handlers(g);
+  if (allow_jit) upb_pbdecoder_jit_compile(g);
   return g;
 }
 
+/* TODO(haberman): allow this to be constructed for an arbitrary set of dest
+ * handlers and other mgroups (but verify we have a transitive closure). */
+const mgroup *mgroup_new(const upb_handlers *dest, bool lazy, bool allow_jit,
+                         upb_pbcodecache *ondemand) {
+  compiler *c = newcompiler(newgroup(), lazy);
+  c->ondemand = ondemand;
+  find_methods(c, dest);
+  return compile_group(c, allow_jit);
+}
+
+/* A group of methods that decode into messages of layout "l" and the layouts
+ * of its submessages.  The JIT only knows how to call handlers. */
+static const mgroup *mgroup_newformsg(const upb_msgdef *md,
+                                      const upb_msglayout *l,
+                                      upb_pbcodecache *ondemand) {
+  compiler *c = newcompiler(newgroup(), false);
+  c->ondemand = ondemand;
+  find_msgmethods(c, md, l);
+  return compile_group(c, false);
+}
+
 
 /* upb_pbcodecache ************************************************************/
 
@@ -870,10 +1190,13 @@ upb_pbcodecache *upb_pbcodecache_new(upb_handlercache *dest) {
   if (!c) return NULL;
 
   c->dest = dest;
+  c->allow_jit = true;
   c->lazy = false;
+  c->ondemand = false;
 
   c->arena = upb_arena_new();
   if (!upb_inttable_init(&c->groups, UPB_CTYPE_CONSTPTR)) return NULL;
+  if (!upb_inttable_init(&c->methods, UPB_CTYPE_CONSTPTR)) return NULL;
 
   return c;
 }
@@ -888,32 +1211,108 @@ void upb_pbcodecache_free(upb_pbcodecache *c) {
   }
 
   upb_inttable_uninit(&c->groups);
+  upb_inttable_uninit(&c->methods);
   upb_arena_free(c->arena);
   upb_gfree(c);
 }
 
-void upb_pbdecodermethodopts_setlazy(upb_pbcodecache *c, bool lazy) {
+bool upb_pbcodecache_allowjit(const upb_pbcodecache *c) {
+  return c->allow_jit;
+}
+
+void upb_pbcodecache_setallowjit(upb_pbcodecache *c, bool allow) {
+  UPB_ASSERT(upb_inttable_count(&c->groups) == 0);
+  c->allow_jit = allow;
+}
+
+void upb_pbcodecache_setlazy(upb_pbcodecache *c, bool lazy) {
   UPB_ASSERT(upb_inttable_count(&c->groups) == 0);
   c->lazy = lazy;
 }
 
+bool upb_pbcodecache_ondemand(const upb_pbcodecache *c) {
+  return c->ondemand;
+}
+
+void upb_pbcodecache_setondemand(upb_pbcodecache *c, bool ondemand) {
+  UPB_ASSERT(upb_inttable_count(&c->groups) == 0);
+  c->ondemand = ondemand;
+}
+
+/* Adds group "g", compiled for "group_key", to the cache and returns its
+ * method for "key". */
+static const upb_pbdecodermethod *addgroup(upb_pbcodecache *c,
+                                           const void *group_key,
+                                           const void *key, const mgroup *g) {
+  upb_value v;
+  bool ok;
+  upb_inttable_iter i;
+
+  ok = upb_inttable_insertptr(&c->groups, group_key, upb_value_constptr(g));
+  UPB_ASSERT(ok);
+
+  /* Methods that an earlier group already has stay in use. */
+  upb_inttable_begin(&i, &g->methods);
+  for(; !upb_inttable_done(&i); upb_inttable_next(&i)) {
+    const void *mkey = (const void*)upb_inttable_iter_key(&i);
+    upb_value method = upb_value_constptr(
+        upb_value_getptr(upb_inttable_iter_value(&i)));
+    if (!upb_inttable_lookupptr(&c->methods, mkey, &v)) {
+      upb_inttable_insertptr(&c->methods, mkey, method);
+    }
+  }
+
+  ok = upb_inttable_lookupptr(&c->methods, key, &v);
+  UPB_ASSERT(ok);
+  return upb_value_getconstptr(v);
+}
+
 const upb_pbdecodermethod *upb_pbcodecache_get(upb_pbcodecache *c,
                                                const upb_msgdef *md) {
   upb_value v;
-  bool ok;
   const upb_handlers *h;
-  const mgroup *g;
 
   h = upb_handlercache_get(c->dest, md);
-  if (upb_inttable_lookupptr(&c->groups, md, &v)) {
-    g = upb_value_getconstptr(v);
+  if (!h) return NULL;
+
+  if (upb_inttable_lookupptr(&c->methods, h, &v)) {
+    return upb_value_getconstptr(v);
+  }
+
+  return addgroup(c, md, h, mgroup_new(h, c->lazy, c->allow_jit,
+                                       c->ondemand ? c : NULL));
+}
+
+const upb_pbdecodermethod *upb_pbcodecache_getformsg(upb_pbcodecache *c,
+                                                     const upb_msgdef *md,
+                                                     const upb_msglayout *l) {
+  upb_value v;
+
+  if (upb_inttable_lookupptr(&c->methods, l, &v)) {
+    return upb_value_getconstptr(v);
+  }
+
+  return addgroup(c, l, l, mgroup_newformsg(md, l, c->ondemand ? c : NULL));
+}
+
+const upb_pbdecodermethod *upb_pbdecoder_resolvestub(
+    upb_pbdecoder_callstub *stub) {
+  upb_pbcodecache *c = stub->cache;
+  upb_value v;
+
+  if (stub->method) return stub->method;
+
+  if (upb_inttable_lookupptr(&c->methods, stub->key, &v)) {
+    stub->method = upb_value_getconstptr(v);
+  } else if (stub->msgdef) {
+    const upb_msglayout *l = stub->key;
+    stub->method = addgroup(c, l, l, mgroup_newformsg(stub->msgdef, l, c));
   } else {
-    g = mgroup_new(h, c->lazy);
-    ok = upb_inttable_insertptr(&c->groups, md, upb_value_constptr(g));
-    UPB_ASSERT(ok);
+    /* Keyed by the handlers; msgdef keys are for upb_pbcodecache_get(). */
+    const upb_handlers *h = stub->key;
+    stub->method =
+        addgroup(c, h, h, mgroup_new(h, c->lazy, c->allow_jit, c));
   }
 
-  ok = upb_inttable_lookupptr(&g->methods, h, &v);
-  UPB_ASSERT(ok);
-  return upb_value_getptr(v);
+  return stub->method;
 }
@@ -0,0 +1,571 @@
+/*
+** x86-64 JIT for the decoder bytecode.
+**
+** Compiles the instructions that make up the inner loop of decoding a message
+** (OP_CHECKDELIM, OP_BRANCH, OP_TAG1, OP_TAG2 and the OP_PARSE_* primitives)
+** into machine code, with calls straight to the handler functions for each
+** value.  Every other instruction, and every slow path of these (values that
+** span buffers, suspending, errors and unexpected tags), is left to the
+** interpreter: the machine code stores the bytecode pc of the instruction it
+** can't handle and returns, and run_decoder_vm() carries on from there.  So the
+** decoder state at any point that the interpreter sees is exactly what the
+** bytecode alone would have produced.
+**
+** While running, registers hold:
+**   rbx: the upb_pbdecoder
+**   r12: d->ptr
+**   r13: d->data_end
+**   r14: d->delim_end
+** None of these change outside of the interpreter, except d->ptr.
+*/
+
+/* For MAP_ANONYMOUS under -std=c89. */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "upb/pb/decoder.int.h"
+
+#ifdef UPB_USE_JIT_X64
+#include <stddef.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#include "upb/port_def.inc"
+
+#ifdef UPB_USE_JIT_X64
+
+/* Upper bounds on the machine code for one instruction, and for the code
+ * that returns to the interpreter at one. */
+#define MAX_INSTR_BYTES 160
+#define MAX_EXIT_BYTES 16
+#define MAX_FIXED_BYTES 64
+
+typedef struct {
+  size_t pos;  /* Of the rel32 to patch. */
+  size_t target;
+  bool exit;   /* To the exit at |target|, even if it has machine code. */
+} fixup;
+
+typedef struct {
+  const mgroup *group;
+  size_t words;
+  char *code;
+  size_t len;
+
+  /* By bytecode word; SIZE_MAX where there is none. */
+  size_t *native;  /* Machine code for the instruction. */
+  size_t *exit;    /* Code that returns to the interpreter there. */
+  const upb_handlers **handlers;
+
+  fixup *fixups;
+  size_t nfixups;
+  size_t exit_label;
+} jitcompiler;
+
+static void put(jitcompiler *j, const char *bytes, size_t n) {
+  memcpy(j->code + j->len, bytes, n);
+  j->len += n;
+}
+
+#define PUT(j, str) put(j, str, sizeof(str) - 1)
+
+static void put8(jitcompiler *j, uint8_t val) {
+  j->code[j->len++] = val;
+}
+
+static void put32(jitcompiler *j, uint32_t val) {
+  memcpy(j->code + j->len, &val, 4);
+  j->len += 4;
+}
+
+static void put64(jitcompiler *j, uint64_t val) {
+  memcpy(j->code + j->len, &val, 8);
+  j->len += 8;
+}
+
+static void patch32(jitcompiler *j, size_t pos, size_t dest) {
+  int32_t rel = (int32_t)(dest - (pos + 4));
+  memcpy(j->code + pos, &rel, 4);
+}
+
+static void patch8(jitcompiler *j, size_t pos, size_t dest) {
+  int8_t rel = (int8_t)(dest - (pos + 1));
+  UPB_ASSERT((ptrdiff_t)dest - (ptrdiff_t)(pos + 1) == rel);
+  j->code[pos] = rel;
+}
+
+static void putjump(jitcompiler *j, int cc, size_t target, bool exit) {
+  UPB_ASSERT(target < j->words);
+  if (cc < 0) {
+    put8(j, 0xe9);
+  } else {
+    put8(j, 0x0f);
+    put8(j, 0x80 | cc);
+  }
+  j->fixups[j->nfixups].pos = j->len;
+  j->fixups[j->nfixups].target = target;
+  j->fixups[j->nfixups].exit = exit;
+  j->nfixups++;
+  put32(j, 0);
+}
+
+/* Emits a jmp (or with |cc| a jcc) to the instruction at word |target|, or to
+ * the exit there if it is only interpreted. */
+static void jump(jitcompiler *j, int cc, size_t target) {
+  putjump(j, cc, target, false);
+}
+
+/* Emits a jmp (or jcc) that returns to the interpreter at word |i|. */
+static void jump_exit(jitcompiler *j, int cc, size_t i) {
+  putjump(j, cc, i, true);
+}
+
+#define JMP -1
+#define JB 0x2
+#define JAE 0x3
+#define JE 0x4
+#define JNE 0x5
+
+/* Jumps to the exit for the instruction at word |i|, if we have run out of
+ * input and the interpreter has to take over. */
+static void exit_unless_left(jitcompiler *j, size_t i, uint8_t bytes) {
+  if (bytes == 1) {
+    PUT(j, "\x4d\x39\xec");      /* cmp r12, r13 */
+    jump_exit(j, JAE, i);
+    return;
+  }
+  PUT(j, "\x4c\x89\xe8");        /* mov rax, r13 */
+  PUT(j, "\x4c\x29\xe0");        /* sub rax, r12 */
+  PUT(j, "\x48\x83\xf8");        /* cmp rax, imm8 */
+  put8(j, bytes);
+  jump_exit(j, JB, i);
+}
+
+/* The superinstructions only need their first part here: the machine code for
+ * the instruction after them does the rest. */
+static uint32_t unfuse(uint32_t instr) {
+  switch (getop(instr)) {
+    case OP_CHECKDELIM_TAG1:
+      return (instr & ~0xffU) | OP_CHECKDELIM;
+    case OP_TAG1_INT32:
+      return (instr & ~0xffU) | OP_TAG1;
+    default:
+      return instr;
+  }
+}
+
+static bool isnative(uint32_t instr) {
+  switch (getop(instr)) {
+    case OP_PARSE_DOUBLE:
+    case OP_PARSE_FLOAT:
+    case OP_PARSE_INT64:
+    case OP_PARSE_UINT64:
+    case OP_PARSE_INT32:
+    case OP_PARSE_FIXED64:
+    case OP_PARSE_FIXED32:
+    case OP_PARSE_BOOL:
+    case OP_PARSE_UINT32:
+    case OP_PARSE_SFIXED32:
+    case OP_PARSE_SFIXED64:
+    case OP_PARSE_SINT32:
+    case OP_PARSE_SINT64:
+    case OP_CHECKDELIM:
+    case OP_BRANCH:
+    case OP_TAG1:
+    case OP_TAG2:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/* Decodes a varint into rax, as the interpreter's decode_varint() does, or
+ * exits to the interpreter if it isn't all in the buffer. */
+static void varint(jitcompiler *j, size_t i) {
+  size_t one, multi, loop, done, have;
+
+  exit_unless_left(j, i, 1);
+  PUT(j, "\x41\x0f\xb6\x04\x24");  /* movzx eax, byte [r12] */
+  PUT(j, "\xa8\x80");              /* test al, 0x80 */
+  PUT(j, "\x74");                  /* jz one */
+  one = j->len;
+  put8(j, 0);
+
+  PUT(j, "\x4c\x89\xe6");          /* mov rsi, r12 */
+  PUT(j, "\x31\xc0");              /* xor eax, eax */
+  PUT(j, "\x31\xc9");              /* xor ecx, ecx */
+  loop = j->len;
+  PUT(j, "\x4c\x39\xee");          /* cmp rsi, r13 */
+  jump_exit(j, JAE, i);
+  PUT(j, "\x0f\xb6\x16");          /* movzx edx, byte [rsi] */
+  PUT(j, "\x48\x83\xc6\x01");      /* add rsi, 1 */
+  PUT(j, "\x41\x89\xd0");          /* mov r8d, edx */
+  PUT(j, "\x41\x83\xe0\x7f");      /* and r8d, 0x7f */
+  PUT(j, "\x49\xd3\xe0");          /* shl r8, cl */
+  PUT(j, "\x4c\x09\xc0");          /* or rax, r8 */
+  PUT(j, "\xf6\xc2\x80");          /* test dl, 0x80 */
+  PUT(j, "\x74");                  /* jz done */
+  done = j->len;
+  put8(j, 0);
+  PUT(j, "\x83\xc1\x07");          /* add ecx, 7 */
+  PUT(j, "\x83\xf9\x46");          /* cmp ecx, 70 */
+  PUT(j, "\x72");                  /* jb loop */
+  put8(j, 0);
+  patch8(j, j->len - 1, loop);
+  jump_exit(j, JMP, i);            /* Unterminated: the interpreter fails. */
+  patch8(j, done, j->len);
+  PUT(j, "\x49\x89\xf4");          /* mov r12, rsi */
+  PUT(j, "\xeb");                  /* jmp have */
+  multi = j->len;
+  put8(j, 0);
+
+  patch8(j, one, j->len);
+  PUT(j, "\x49\x83\xc4\x01");      /* add r12, 1 */
+  have = j->len;
+  patch8(j, multi, have);
+}
+
+/* Parses a value with OP_PARSE_* instruction |instr| at word |i| and passes
+ * it to its handler, if there is one. */
+static void parse(jitcompiler *j, size_t i, uint32_t instr) {
+  const upb_handlers *h = j->handlers[i];
+  const void *hd = NULL;
+  upb_func *func = upb_handlers_gethandler(h, instr >> 8, &hd);
+  uint64_t addr;
+  opcode op = getop(instr);
+
+  switch (op) {
+    case OP_PARSE_FIXED32:
+    case OP_PARSE_SFIXED32:
+    case OP_PARSE_FLOAT:
+      exit_unless_left(j, i, 4);
+      PUT(j, "\x41\x8b\x04\x24");      /* mov eax, [r12] */
+      PUT(j, "\x49\x83\xc4\x04");      /* add r12, 4 */
+      break;
+    case OP_PARSE_FIXED64:
+    case OP_PARSE_SFIXED64:
+    case OP_PARSE_DOUBLE:
+      exit_unless_left(j, i, 8);
+      PUT(j, "\x49\x8b\x04\x24");      /* mov rax, [r12] */
+      PUT(j, "\x49\x83\xc4\x08");      /* add r12, 8 */
+      break;
+    default:
+      varint(j, i);
+      break;
+  }
+
+  if (!func) return;
+
+  /* The value goes in the third argument, as each type's handler takes it. */
+  switch (op) {
+    case OP_PARSE_INT32:
+    case OP_PARSE_UINT32:
+    case OP_PARSE_FIXED32:
+    case OP_PARSE_SFIXED32:
+      PUT(j, "\x89\xc2");              /* mov edx, eax */
+      break;
+    case OP_PARSE_INT64:
+    case OP_PARSE_UINT64:
+    case OP_PARSE_FIXED64:
+    case OP_PARSE_SFIXED64:
+      PUT(j, "\x48\x89\xc2");          /* mov rdx, rax */
+      break;
+    case OP_PARSE_BOOL:
+      PUT(j, "\x48\x85\xc0");          /* test rax, rax */
+      PUT(j, "\x0f\x95\xc2");          /* setne dl */
+      PUT(j, "\x0f\xb6\xd2");          /* movzx edx, dl */
+      break;
+    case OP_PARSE_SINT32:
+      PUT(j, "\x89\xc2");              /* mov edx, eax */
+      PUT(j, "\xd1\xea");              /* shr edx, 1 */
+      PUT(j, "\x83\xe0\x01");          /* and eax, 1 */
+      PUT(j, "\xf7\xd8");              /* neg eax */
+      PUT(j, "\x31\xc2");              /* xor edx, eax */
+      break;
+    case OP_PARSE_SINT64:
+      PUT(j, "\x48\x89\xc2");          /* mov rdx, rax */
+      PUT(j, "\x48\xd1\xea");          /* shr rdx, 1 */
+      PUT(j, "\x83\xe0\x01");          /* and eax, 1 */
+      PUT(j, "\x48\xf7\xd8");          /* neg rax */
+      PUT(j, "\x48\x31\xc2");          /* xor rdx, rax */
+      break;
+    case OP_PARSE_FLOAT:
+      PUT(j, "\x66\x0f\x6e\xc0");      /* movd xmm0, eax */
+      break;
+    case OP_PARSE_DOUBLE:
+      PUT(j, "\x66\x48\x0f\x6e\xc0");  /* movq xmm0, rax */
+      break;
+    default:
+      UPB_UNREACHABLE();
+  }
+
+  /* func(d->top->sink.closure, hd, val).  Like the interpreter, we ignore
+   * what it returns. */
+  PUT(j, "\x48\x8b\xbb");              /* mov rdi, [rbx + top] */
+  put32(j, offsetof(upb_pbdecoder, top));
+  PUT(j, "\x48\x8b\xbf");              /* mov rdi, [rdi + closure] */
+  put32(j, offsetof(upb_pbdecoder_frame, sink) + offsetof(upb_sink, closure));
+  PUT(j, "\x48\xbe");                  /* mov rsi, hd */
+  put64(j, (uintptr_t)hd);
+  PUT(j, "\x48\xb8");                  /* mov rax, func */
+  memcpy(&addr, &func, sizeof(addr));
+  put64(j, addr);
+  PUT(j, "\xff\xd0");                  /* call rax */
+}
+
+/* Matches the tag in OP_TAG1/OP_TAG2 instruction |instr| at word |i|, or on
+ * a mismatch jumps where the bytecode says to. */
+static void tag(jitcompiler *j, size_t i, uint32_t instr, size_t next) {
+  int8_t shortofs = (int8_t)((instr >> 8) & 0xff);
+
+  if (getop(instr) == OP_TAG1) {
+    exit_unless_left(j, i, 1);
+    PUT(j, "\x41\x80\x3c\x24");        /* cmp byte [r12], imm8 */
+    put8(j, (instr >> 16) & 0xff);
+  } else {
+    uint16_t expected = (instr >> 16) & 0xffff;
+    exit_unless_left(j, i, 2);
+    PUT(j, "\x66\x41\x81\x3c\x24");    /* cmp word [r12], imm16 */
+    put(j, (const char*)&expected, 2);
+  }
+
+  /* For field dispatch the interpreter runs this instruction again. */
+  if (shortofs == LABEL_DISPATCH) {
+    jump_exit(j, JNE, i);
+  } else {
+    jump(j, JNE, next + shortofs);
+  }
+  PUT(j, "\x49\x83\xc4");              /* add r12, imm8 */
+  put8(j, getop(instr) == OP_TAG1 ? 1 : 2);
+}
+
+static void compile_instr(jitcompiler *j, size_t i, size_t next) {
+  uint32_t instr = unfuse(j->group->bytecode[i]);
+  int32_t longofs = (int32_t)instr >> 8;
+
+  switch (getop(instr)) {
+    case OP_CHECKDELIM:
+      PUT(j, "\x4d\x39\xf4");          /* cmp r12, r14 */
+      jump(j, JE, next + longofs);
+      break;
+    case OP_BRANCH:
+      jump(j, JMP, next + longofs);
+      return;
+    case OP_TAG1:
+    case OP_TAG2:
+      tag(j, i, instr, next);
+      break;
+    default:
+      parse(j, i, instr);
+      break;
+  }
+
+  UPB_ASSERT(next < j->words);
+  if (j->native[next] == SIZE_MAX) {
+    /* Falls through to an instruction that is only interpreted. */
+    jump(j, JMP, next);
+  }
+}
+
+/* Emits the function that enters the machine code,
+ * enter(upb_pbdecoder *d, const void *entry), and the code that returns from
+ * it with the bytecode pc to continue from in rax. */
+static void compile_enter_exit(jitcompiler *j) {
+  PUT(j, "\x53");                      /* push rbx */
+  PUT(j, "\x41\x54");                  /* push r12 */
+  PUT(j, "\x41\x55");                  /* push r13 */
+  PUT(j, "\x41\x56");                  /* push r14 */
+  PUT(j, "\x41\x57");                  /* push r15, to align the stack */
+  PUT(j, "\x48\x89\xfb");              /* mov rbx, rdi */
+  PUT(j, "\x4c\x8b\xa3");              /* mov r12, [rbx + ptr] */
+  put32(j, offsetof(upb_pbdecoder, ptr));
+  PUT(j, "\x4c\x8b\xab");              /* mov r13, [rbx + data_end] */
+  put32(j, offsetof(upb_pbdecoder, data_end));
+  PUT(j, "\x4c\x8b\xb3");              /* mov r14, [rbx + delim_end] */
+  put32(j, offsetof(upb_pbdecoder, delim_end));
+  PUT(j, "\xff\xe6");                  /* jmp rsi */
+
+  /* Every instruction boundary is also a checkpoint for the interpreter. */
+  j->exit_label = j->len;
+  PUT(j, "\x48\x89\x83");              /* mov [rbx + pc], rax */
+  put32(j, offsetof(upb_pbdecoder, pc));
+  PUT(j, "\x4c\x89\xa3");              /* mov [rbx + ptr], r12 */
+  put32(j, offsetof(upb_pbdecoder, ptr));
+  PUT(j, "\x4c\x89\xa3");              /* mov [rbx + checkpoint], r12 */
+  put32(j, offsetof(upb_pbdecoder, checkpoint));
+  PUT(j, "\x41\x5f");                  /* pop r15 */
+  PUT(j, "\x41\x5e");                  /* pop r14 */
+  PUT(j, "\x41\x5d");                  /* pop r13 */
+  PUT(j, "\x41\x5c");                  /* pop r12 */
+  PUT(j, "\x5b");                      /* pop rbx */
+  PUT(j, "\xc3");                      /* ret */
+}
+
+static int cmp_methods(const void *a, const void *b) {
+  const upb_pbdecodermethod *m1 = *(const upb_pbdecodermethod**)a;
+  const upb_pbdecodermethod *m2 = *(const upb_pbdecodermethod**)b;
+  const char *p1 = m1->code_base.ptr;
+  const char *p2 = m2->code_base.ptr;
+  return p1 < p2 ? -1 : (p1 > p2 ? 1 : 0);
+}
+
+/* Sets the handlers that each word of bytecode runs with: those of the method
+ * whose code it is in. */
+static bool find_handlers(jitcompiler *j) {
+  const mgroup *g = j->group;
+  size_t n = upb_inttable_count(&g->methods);
+  const upb_pbdecodermethod **methods = upb_gmalloc(n * sizeof(*methods));
+  upb_inttable_iter iter;
+  size_t i = 0;
+  size_t k;
+
+  if (!methods) return false;
+  upb_inttable_begin(&iter, &g->methods);
+  for(; !upb_inttable_done(&iter); upb_inttable_next(&iter)) {
+    methods[i++] = upb_value_getptr(upb_inttable_iter_value(&iter));
+  }
+  qsort(methods, n, sizeof(*methods), &cmp_methods);
+
+  for (i = 0, k = 0; i < j->words; i++) {
+    while (k + 1 < n &&
+           (const uint32_t*)methods[k + 1]->code_base.ptr <= g->bytecode + i) {
+      k++;
+    }
+    j->handlers[i] = n > 0 ? upb_pbdecodermethod_desthandlers(methods[k]) : NULL;
+  }
+
+  upb_gfree(methods);
+  return true;
+}
+
+static upb_pbdecoder_jit *compile(jitcompiler *j) {
+  const mgroup *g = j->group;
+  upb_pbdecoder_jit *jit;
+  size_t instrs = 0;
+  size_t size;
+  size_t i;
+  char *mem;
+
+  for (i = 0; i < j->words; i += upb_pbdecoder_instrlen(g->bytecode[i])) {
+    j->native[i] = isnative(unfuse(g->bytecode[i])) ? 0 : SIZE_MAX;
+    instrs++;
+  }
+
+  /* Four jumps at most for each instruction. */
+  size = MAX_FIXED_BYTES + instrs * (MAX_INSTR_BYTES + MAX_EXIT_BYTES);
+  j->code = upb_gmalloc(size);
+  j->fixups = upb_gmalloc(instrs * 4 * sizeof(fixup));
+  if (!j->code || !j->fixups || !find_handlers(j)) return NULL;
+
+  compile_enter_exit(j);
+
+  for (i = 0; i < j->words; i += upb_pbdecoder_instrlen(g->bytecode[i])) {
+    size_t next = i + upb_pbdecoder_instrlen(g->bytecode[i]);
+    if (j->native[i] == SIZE_MAX) continue;
+    j->native[i] = j->len;
+    compile_instr(j, i, next);
+    UPB_ASSERT(j->len - j->native[i] <= MAX_INSTR_BYTES);
+  }
+
+  for (i = 0; i < j->words; i += upb_pbdecoder_instrlen(g->bytecode[i])) {
+    j->exit[i] = j->len;
+    PUT(j, "\x48\xb8");                /* mov rax, pc */
+    put64(j, (uintptr_t)(g->bytecode + i));
+    PUT(j, "\xe9");                    /* jmp exit */
+    put32(j, 0);
+    patch32(j, j->len - 4, j->exit_label);
+  }
+  UPB_ASSERT(j->len <= size);
+
+  for (i = 0; i < j->nfixups; i++) {
+    size_t target = j->fixups[i].target;
+    bool exit = j->fixups[i].exit || j->native[target] == SIZE_MAX;
+    patch32(j, j->fixups[i].pos, exit ? j->exit[target] : j->native[target]);
+  }
+
+  jit = upb_gmalloc(sizeof(*jit));
+  if (!jit) return NULL;
+  jit->entries = upb_gmalloc(j->words * sizeof(*jit->entries));
+  jit->handlers = j->handlers;
+  jit->size = j->len;
+  mem = mmap(NULL, j->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+  if (!jit->entries || mem == MAP_FAILED) {
+    upb_gfree(jit->entries);
+    upb_gfree(jit);
+    return NULL;
+  }
+  memcpy(mem, j->code, j->len);
+  if (mprotect(mem, j->len, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, j->len);
+    upb_gfree(jit->entries);
+    upb_gfree(jit);
+    return NULL;
+  }
+
+  jit->mem = mem;
+  memcpy(&jit->enter, &mem, sizeof(mem));
+  for (i = 0; i < j->words; i++) {
+    jit->entries[i] = NULL;
+  }
+  for (i = 0; i < j->words; i += upb_pbdecoder_instrlen(g->bytecode[i])) {
+    if (j->native[i] != SIZE_MAX) jit->entries[i] = mem + j->native[i];
+  }
+
+  j->handlers = NULL;  /* Now owned by jit. */
+  return jit;
+}
+
+void upb_pbdecoder_jit_compile(mgroup *g) {
+  jitcompiler j;
+  size_t words = g->bytecode_end - g->bytecode;
+
+  if (words == 0) return;
+
+  j.group = g;
+  j.words = words;
+  j.len = 0;
+  j.nfixups = 0;
+  j.code = NULL;
+  j.fixups = NULL;
+  j.native = upb_gmalloc(words * sizeof(size_t));
+  j.exit = upb_gmalloc(words * sizeof(size_t));
+  j.handlers = upb_gmalloc(words * sizeof(*j.handlers));
+
+  if (j.native && j.exit && j.handlers) {
+    g->jit = compile(&j);
+  }
+
+  upb_gfree(j.native);
+  upb_gfree(j.exit);
+  upb_gfree((void*)j.handlers);
+  upb_gfree(j.code);
+  upb_gfree(j.fixups);
+}
+
+void upb_pbdecoder_jit_free(upb_pbdecoder_jit *jit) {
+  munmap(jit->mem, jit->size);
+  upb_gfree(jit->entries);
+  upb_gfree((void*)jit->handlers);
+  upb_gfree(jit);
+}
+
+#else  /* UPB_USE_JIT_X64 */
+
+void upb_pbdecoder_jit_compile(mgroup *g) {
+  UPB_UNUSED(g);
+}
+
+void upb_pbdecoder_jit_free(upb_pbdecoder_jit *jit) {
+  UPB_UNUSED(jit);
+}
+
+#endif  /* UPB_USE_JIT_X64 */
+
+#include "upb/port_undef.inc"
@@ -15,8 +15,11 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include "upb/decode.h"
+#include "upb/decode.int.h"
 #include "upb/pb/decoder.int.h"
 #include "upb/pb/varint.int.h"
+#include "upb/stats.h"
 
 #ifdef UPB_DUMP_BYTECODE
 #include <stdio.h>
@@ -61,8 +64,12 @@ static bool consumes_input(opcode op) {
     case OP_SETBIGGROUPNUM:
     case OP_CHECKDELIM:
     case OP_CALL:
+    case OP_CALLSTUB:
     case OP_RET:
     case OP_BRANCH:
+    case OP_MSG_STARTSTR:
+    case OP_MSG_STARTSUBMSG:
+    case OP_MSG_ENDSUBMSG:
       return false;
     default:
       return true;
@@ -207,6 +214,8 @@ static int32_t skip(upb_pbdecoder *d, size_t bytes) {
 int32_t upb_pbdecoder_resume(upb_pbdecoder *d, void *p, const char *buf,
                              size_t size, const upb_bufhandle *handle) {
   UPB_UNUSED(p);  /* Useless; just for the benefit of the JIT. */
+  _UPB_STATS_ADD(pbdecoder_resumes, 1);
+  _UPB_STATS_ADD(pbdecoder_bytes, size);
 
   /* d->skip and d->residual_end could probably elegantly be represented
    * as a single variable, to more easily represent this invariant. */
@@ -295,6 +304,7 @@ static size_t suspend_save(upb_pbdecoder *d) {
   /* We hit end-of-buffer before we could parse a full value.
    * Save any unconsumed bytes (if any) to the residual buffer. */
   d->pc = d->last;
+  _UPB_STATS_ADD(pbdecoder_suspends, 1);
 
   if (d->checkpoint == d->residual) {
     /* Checkpoint was in residual buf; append user byte(s) to residual buf. */
@@ -494,7 +504,7 @@ static bool decoder_push(upb_pbdecoder *d, uint64_t end) {
 
   fr++;
   fr->end_ofs = end;
-  fr->dispatch = NULL;
+  fr->method = NULL;
   fr->groupnum = 0;
   d->top = fr;
   return true;
@@ -597,7 +607,8 @@ have_tag:
 
 static void goto_endmsg(upb_pbdecoder *d) {
   upb_value v;
-  bool found = upb_inttable_lookup32(d->top->dispatch, DISPATCH_ENDMSG, &v);
+  bool found =
+      upb_inttable_lookup32(&d->top->method->dispatch, DISPATCH_ENDMSG, &v);
   UPB_ASSERT(found);
   d->pc = d->top->base + upb_value_getuint64(v);
 }
@@ -609,7 +620,8 @@ static void goto_endmsg(upb_pbdecoder *d) {
  * unknown.  If the tag is a valid ENDGROUP tag, jumps to the bytecode
  * instruction for the end of message. */
 static int32_t dispatch(upb_pbdecoder *d) {
-  upb_inttable *dispatch = d->top->dispatch;
+  const upb_pbdecodermethod *method = d->top->method;
+  const upb_inttable *dispatch = &method->dispatch;
   uint32_t tag;
   uint8_t wire_type;
   uint32_t fieldnum;
@@ -623,8 +635,17 @@ static int32_t dispatch(upb_pbdecoder *d) {
 
   /* Lookup tag.  Because of packed/non-packed compatibility, we have to
    * check the wire type against two possibilities. */
-  if (fieldnum != DISPATCH_ENDMSG &&
-      upb_inttable_lookup32(dispatch, fieldnum, &val)) {
+  if (fieldnum < method->dense_dispatch_size) {
+    const upb_pbdecoder_dispatchent *e = &method->dense_dispatch[fieldnum];
+    if (wire_type == e->wt1) {
+      d->pc = d->top->base + e->ofs;
+      return DECODE_OK;
+    } else if (wire_type == e->wt2) {
+      d->pc = d->top->base + e->ofs2;
+      return DECODE_OK;
+    }
+  } else if (fieldnum != DISPATCH_ENDMSG &&
+             upb_inttable_lookup32(dispatch, fieldnum, &val)) {
     uint64_t v = upb_value_getuint64(val);
     if (wire_type == (v & 0xff)) {
       d->pc = d->top->base + (v >> 16);
@@ -644,7 +665,8 @@ static int32_t dispatch(upb_pbdecoder *d) {
    * can re-check the delimited end. */
   d->last--;  /* Necessary if we get suspended */
   d->pc = d->last;
-  UPB_ASSERT(getop(*d->last) == OP_CHECKDELIM);
+  UPB_ASSERT(getop(*d->last) == OP_CHECKDELIM ||
+             getop(*d->last) == OP_CHECKDELIM_TAG1);
 
   /* Unknown field or ENDGROUP. */
   retval = upb_pbdecoder_skipunknown(d, fieldnum, wire_type);
@@ -667,15 +689,242 @@ upb_pbdecoder_frame *outer_frame(upb_pbdecoder *d) {
 }
 
 
+/* Decoding into a upb_msg ****************************************************/
+
+/* For methods from upb_pbcodecache_getformsg(), which store what they decode
+ * the way upb_decode() does instead of calling handlers.  The closure of each
+ * frame's sink is the message being decoded into, or while in a string, the
+ * upb_strview being filled. */
+
+static const char *kOutOfMemory = "Out of memory.";
+
+static void msg_setpresent(char *msg, const upb_msglayout_field *field) {
+  if (field->presence > 0) {
+    int32_t hasbit = field->presence;
+    msg[hasbit / 8] |= (1 << (hasbit % 8));
+  } else if (field->presence < 0) {
+    uint32_t number = field->number;
+    memcpy(msg + ~field->presence, &number, sizeof(number));
+  }
+}
+
+/* Returns the memory for a new value of |field|, appending it to the array of
+ * a repeated field, or NULL on allocation failure. */
+static void *msg_addval(upb_pbdecoder *d, char *msg,
+                        const upb_msglayout_field *field, size_t size) {
+  upb_array **arr = (upb_array**)(msg + field->offset);
+  char zero[sizeof(upb_strview)] = {0};
+
+  UPB_ASSERT(size <= sizeof(zero));
+  if (field->label != UPB_LABEL_REPEATED) {
+    msg_setpresent(msg, field);
+    return msg + field->offset;
+  }
+
+  if (!*arr && !(*arr = upb_array_new(d->arena))) return NULL;
+  if (!upb_array_add(*arr, 1, size, zero, d->arena)) return NULL;
+  return (char*)(*arr)->data + ((*arr)->len - 1) * size;
+}
+
+/* Parses a value of the field and stores it in the message on top. */
+static int32_t msg_parse(upb_pbdecoder *d, const upb_msglayout_field *field) {
+  uint64_t u64;
+  uint32_t u32;
+  bool b;
+  const void *val;
+  size_t size;
+  void *mem;
+
+  switch (field->descriptortype) {
+    case UPB_DESCRIPTOR_TYPE_DOUBLE:
+    case UPB_DESCRIPTOR_TYPE_FIXED64:
+    case UPB_DESCRIPTOR_TYPE_SFIXED64:
+      CHECK_RETURN(decode_fixed64(d, &u64));
+      val = &u64;
+      size = 8;
+      break;
+    case UPB_DESCRIPTOR_TYPE_FLOAT:
+    case UPB_DESCRIPTOR_TYPE_FIXED32:
+    case UPB_DESCRIPTOR_TYPE_SFIXED32:
+      CHECK_RETURN(decode_fixed32(d, &u32));
+      val = &u32;
+      size = 4;
+      break;
+    case UPB_DESCRIPTOR_TYPE_INT64:
+    case UPB_DESCRIPTOR_TYPE_UINT64:
+    case UPB_DESCRIPTOR_TYPE_SINT64:
+      CHECK_RETURN(decode_varint(d, &u64));
+      if (field->descriptortype == UPB_DESCRIPTOR_TYPE_SINT64) {
+        u64 = upb_zzdec_64(u64);
+      }
+      val = &u64;
+      size = 8;
+      break;
+    case UPB_DESCRIPTOR_TYPE_BOOL:
+      CHECK_RETURN(decode_varint(d, &u64));
+      b = u64 != 0;
+      val = &b;
+      size = sizeof(b);
+      break;
+    default:  /* INT32, UINT32, ENUM and SINT32. */
+      CHECK_RETURN(decode_varint(d, &u64));
+      u32 = (uint32_t)u64;
+      if (field->descriptortype == UPB_DESCRIPTOR_TYPE_SINT32) {
+        u32 = upb_zzdec_32(u32);
+      }
+      val = &u32;
+      size = 4;
+      break;
+  }
+
+  mem = msg_addval(d, d->top->sink.closure, field, size);
+  if (!mem) {
+    seterr(d, kOutOfMemory);
+    return upb_pbdecoder_suspend(d);
+  }
+  memcpy(mem, val, size);
+  return DECODE_OK;
+}
+
+/* Adds the string that the top frame delimits to the message on the frame
+ * below, with room for its data, and makes it the top frame's closure. */
+static bool msg_startstr(upb_pbdecoder *d, const upb_msglayout_field *field,
+                         size_t len) {
+  upb_strview *str = msg_addval(d, outer_frame(d)->sink.closure, field,
+                                sizeof(upb_strview));
+  char *data = len > 0 ? upb_arena_malloc(d->arena, len) : NULL;
+
+  if (!str || (len > 0 && !data)) return false;
+  str->data = data ? data : &dummy_char;
+  str->size = 0;
+  d->top->sink.handlers = NULL;
+  d->top->sink.closure = str;
+  return true;
+}
+
+/* Copies as much of the string as the buffer has. */
+static size_t msg_putstring(upb_pbdecoder *d) {
+  upb_strview *str = d->top->sink.closure;
+  size_t n = curbufleft(d);
+  memcpy((char*)str->data + str->size, d->ptr, n);
+  str->size += n;
+  return n;
+}
+
+/* Gets or adds the submessage of the message on the frame below, and makes it
+ * the top frame's closure.  For a map field this is a new entry, which
+ * msg_endsubmsg() moves into the map. */
+static bool msg_startsubmsg(upb_pbdecoder *d,
+                            const upb_pbdecoder_msgfield *mf) {
+  char *msg = outer_frame(d)->sink.closure;
+  const upb_msglayout_field *field = mf->field;
+  upb_msg *sub;
+
+  if (field->label == UPB_LABEL_REPEATED) {
+    upb_msg **slot = msg_addval(d, msg, field, sizeof(sub));
+    sub = upb_msg_new(mf->sublayout, d->arena);
+    if (!slot || !sub) return false;
+    *slot = sub;
+  } else if (field->label == _UPB_LABEL_MAP) {
+    sub = upb_msg_new(mf->sublayout, d->arena);
+    if (!sub) return false;
+  } else {
+    upb_msg **slot = (upb_msg**)(msg + field->offset);
+
+    if (!_upb_msg_hasmem(msg, field)) {
+      /* The slot is uninitialized or holds another member of the oneof. */
+      *slot = NULL;
+    } else if (*slot && _upb_islazy(*slot)) {
+      /* Left unparsed by upb_decode(): merge into the parsed message. */
+      if (!_upb_decode_lazy(msg, field->offset, mf->sublayout)) return false;
+    }
+
+    if (!*slot && !(*slot = upb_msg_new(mf->sublayout, d->arena))) {
+      return false;
+    }
+    msg_setpresent(msg, field);
+    sub = *slot;
+  }
+
+  d->top->sink.handlers = NULL;
+  d->top->sink.closure = sub;
+  return true;
+}
+
+/* Moves the map entry on the top frame into the map of the message on the
+ * frame below. */
+static bool msg_endsubmsg(upb_pbdecoder *d,
+                          const upb_pbdecoder_msgfield *mf) {
+  char *msg = outer_frame(d)->sink.closure;
+  char *entry = d->top->sink.closure;
+  const upb_msglayout *l = mf->sublayout;
+  const upb_msglayout_field *val_field = &l->fields[1];
+  upb_map *map = _upb_msg_getmap(msg, mf->field->offset, l, true, d->arena);
+  upb_msg **val = (upb_msg**)(entry + val_field->offset);
+
+  if (!map) return false;
+  if (val_field->descriptortype == UPB_DESCRIPTOR_TYPE_MESSAGE && !*val) {
+    /* A missing message value is an empty message. */
+    *val = upb_msg_new(l->submsgs[val_field->submsg_index], d->arena);
+    if (!*val) return false;
+  }
+
+  return _upb_map_set(map, entry + l->fields[0].offset, val);
+}
+
+
 /* The main decoding loop *****************************************************/
 
-/* The main decoder VM function.  Uses traditional bytecode dispatch loop with a
- * switch() statement. */
+/* The main decoder VM function.  Where the compiler supports labels as values
+ * (GCC and Clang), each instruction jumps straight to the code for the next
+ * one through a table, so the indirect branches are spread out where the
+ * branch predictor can tell them apart.  Elsewhere it is a traditional
+ * bytecode dispatch loop with a switch() statement. */
+#if defined(__GNUC__) && !defined(UPB_NO_THREADED_DISPATCH)
+#define UPB_THREADED_DISPATCH
+/* Labels as values are a GNU extension. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
                       const upb_bufhandle* handle) {
-
+  int32_t instruction;
+  opcode op;
+  uint32_t arg;
+  int32_t longofs;
+
+#ifdef UPB_THREADED_DISPATCH
+  /* Indexed by opcode; keep in sync with the list in decoder.int.h. */
+  static const void *const dispatch_table[] = {
+    &&vm_invalid,       &&OP_PARSE_DOUBLE,    &&OP_PARSE_FLOAT,
+    &&OP_PARSE_INT64,   &&OP_PARSE_UINT64,    &&OP_PARSE_INT32,
+    &&OP_PARSE_FIXED64, &&OP_PARSE_FIXED32,   &&OP_PARSE_BOOL,
+    &&OP_STARTMSG,      &&OP_ENDMSG,          &&OP_STARTSEQ,
+    &&OP_ENDSEQ,        &&OP_PARSE_UINT32,    &&OP_STARTSUBMSG,
+    &&OP_PARSE_SFIXED32, &&OP_PARSE_SFIXED64, &&OP_PARSE_SINT32,
+    &&OP_PARSE_SINT64,  &&OP_ENDSUBMSG,       &&OP_STARTSTR,
+    &&OP_STRING,        &&OP_ENDSTR,          &&OP_PUSHTAGDELIM,
+    &&OP_PUSHLENDELIM,  &&OP_POP,             &&OP_SETDELIM,
+    &&OP_SETBIGGROUPNUM, &&OP_CHECKDELIM,     &&OP_CALL,
+    &&OP_RET,           &&OP_BRANCH,          &&OP_TAG1,
+    &&OP_TAG2,          &&OP_TAGN,            &&OP_SETDISPATCH,
+    &&OP_DISPATCH,      &&OP_HALT,            &&OP_PARSE_BULK,
+    &&OP_CHECKDELIM_TAG1, &&OP_TAG1_INT32, &&OP_MSG_PARSE,
+    &&OP_MSG_STARTSTR,  &&OP_MSG_STRING,      &&OP_MSG_STARTSUBMSG,
+    &&OP_MSG_ENDSUBMSG, &&OP_CALLSTUB,
+  };
 #define VMCASE(op, code) \
-  case op: { code; if (consumes_input(op)) checkpoint(d); break; }
+  op: { code; if (consumes_input(op)) checkpoint(d); VMNEXT; }
+#define VMNEXT VMFETCH(); goto *dispatch_table[op]
+#define VMDISPATCH goto *dispatch_table[op];
+#else
+#define VMCASE(op, code) \
+  case op: { code; if (consumes_input(op)) checkpoint(d); VMNEXT; }
+#define VMNEXT break
+#define VMDISPATCH switch (op)
+#endif
+
 #define PRIMITIVE_OP(type, wt, name, convfunc, ctype) \
   VMCASE(OP_PARSE_ ## type, { \
     ctype val; \
@@ -683,32 +932,60 @@ size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
     upb_sink_put ## name(d->top->sink, arg, (convfunc)(val)); \
   })
 
-  while(1) {
-    int32_t instruction;
-    opcode op;
-    uint32_t arg;
-    int32_t longofs;
-
-    d->last = d->pc;
-    instruction = *d->pc++;
-    op = getop(instruction);
-    arg = instruction >> 8;
-    longofs = arg;
-    UPB_ASSERT(d->ptr != d->residual_end);
-    UPB_UNUSED(group);
+#ifdef UPB_USE_JIT_X64
+/* Runs the machine code from the next instruction, if it was compiled.  That
+ * returns at an instruction it couldn't run, which we interpret next.  Follows
+ * OP_CALLSTUB into other groups by way of the method of the top frame. */
+#define VMJIT() \
+  if (group->jit) { \
+    if ((d->pc < group->bytecode || d->pc >= group->bytecode_end) && \
+        d->top->method) { \
+      group = d->top->method->group; \
+    } \
+    if (group->jit && d->pc >= group->bytecode && \
+        d->pc < group->bytecode_end) { \
+      const upb_pbdecoder_jit *jit = group->jit; \
+      size_t i = d->pc - group->bytecode; \
+      if (jit->entries[i] && jit->handlers[i] == d->top->sink.handlers) { \
+        jit->enter(d, jit->entries[i]); \
+      } \
+    } \
+  }
+#else
+#define VMJIT()
+#endif
+
 #ifdef UPB_DUMP_BYTECODE
-    fprintf(stderr, "s_ofs=%d buf_ofs=%d data_rem=%d buf_rem=%d delim_rem=%d "
-                    "%x %s (%d)\n",
-            (int)offset(d),
-            (int)(d->ptr - d->buf),
-            (int)(d->data_end - d->ptr),
-            (int)(d->end - d->ptr),
-            (int)((d->top->end_ofs - d->bufstart_ofs) - (d->ptr - d->buf)),
-            (int)(d->pc - 1 - group->bytecode),
-            upb_pbdecoder_getopname(op),
-            arg);
+#define VMTRACE() \
+    fprintf(stderr, "s_ofs=%d buf_ofs=%d data_rem=%d buf_rem=%d delim_rem=%d " \
+                    "%x %s (%d)\n", \
+            (int)offset(d), \
+            (int)(d->ptr - d->buf), \
+            (int)(d->data_end - d->ptr), \
+            (int)(d->end - d->ptr), \
+            (int)((d->top->end_ofs - d->bufstart_ofs) - (d->ptr - d->buf)), \
+            (int)(d->pc - 1 - group->bytecode), \
+            upb_pbdecoder_getopname(op), \
+            arg)
+#else
+#define VMTRACE()
 #endif
-    switch (op) {
+
+#define VMFETCH() \
+    VMJIT(); \
+    d->last = d->pc; \
+    instruction = *d->pc++; \
+    op = getop(instruction); \
+    arg = instruction >> 8; \
+    longofs = arg; \
+    UPB_ASSERT(d->ptr != d->residual_end); \
+    VMTRACE()
+
+  UPB_UNUSED(group);
+
+  while(1) {
+    VMFETCH();
+    VMDISPATCH {
       /* Technically, we are losing data if we see a 32-bit varint that is not
        * properly sign-extended.  We could detect this and error about the data
        * loss, but proto2 does not do this, so we pass. */
@@ -726,9 +1003,24 @@ size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
       PRIMITIVE_OP(SINT32,   varint,  int32,  upb_zzdec_32, uint64_t)
       PRIMITIVE_OP(SINT64,   varint,  int64,  upb_zzdec_64, uint64_t)
 
+      VMCASE(OP_PARSE_BULK, {
+        size_t elem_size = (arg & 1) ? 8 : 4;
+        size_t n = curbufleft(d) / elem_size * elem_size;
+        if (d->ptr == d->delim_end) {
+          /* Empty packed field. */
+        } else if (n > 0) {
+          CHECK_SUSPEND(upb_sink_putbulk(d->top->sink, arg >> 1, d->ptr, n));
+          advance(d, n);
+        } else {
+          /* A value straddles two buffers. */
+          char val[8];
+          CHECK_RETURN(getbytes(d, val, elem_size));
+          upb_sink_putbulk(d->top->sink, arg >> 1, val, elem_size);
+        }
+      })
       VMCASE(OP_SETDISPATCH,
         d->top->base = d->pc - 1;
-        memcpy(&d->top->dispatch, d->pc, sizeof(void*));
+        memcpy(&d->top->method, d->pc, sizeof(void*));
         d->pc += sizeof(void*) / sizeof(uint32_t);
       )
       VMCASE(OP_STARTMSG,
@@ -815,6 +1107,19 @@ size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
         d->callstack[d->call_len++] = d->pc;
         d->pc += longofs;
       )
+      VMCASE(OP_CALLSTUB,
+        upb_pbdecoder_callstub *stub;
+        const upb_pbdecodermethod *method;
+        memcpy(&stub, d->pc, sizeof(void*));
+        d->pc += sizeof(void*) / sizeof(uint32_t);
+        method = stub->method ? stub->method : upb_pbdecoder_resolvestub(stub);
+        if (!method) {
+          seterr(d, "Couldn't compile decoder for submessage.");
+          return upb_pbdecoder_suspend(d);
+        }
+        d->callstack[d->call_len++] = d->pc;
+        d->pc = method->code_base.ptr;
+      )
       VMCASE(OP_RET,
         UPB_ASSERT(d->call_len > 0);
         d->pc = d->callstack[--d->call_len];
@@ -836,7 +1141,7 @@ size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
             CHECK_RETURN(dispatch(d));
           } else {
             d->pc += shortofs;
-            break; /* Avoid checkpoint(). */
+            VMNEXT; /* Avoid checkpoint(). */
           }
         }
       )
@@ -873,10 +1178,95 @@ size_t run_decoder_vm(upb_pbdecoder *d, const mgroup *group,
       VMCASE(OP_HALT, {
         return d->size_param;
       })
+      VMCASE(OP_CHECKDELIM_TAG1,
+        UPB_ASSERT(!(d->delim_end && d->ptr > d->delim_end));
+        if (d->ptr == d->delim_end) {
+          d->pc += longofs;
+          VMNEXT; /* Avoid checkpoint(). */
+        } else if (curbufleft(d) > 0 &&
+                   *d->ptr == (uint8_t)((*d->pc >> 16) & 0xff)) {
+          d->pc++;
+          advance(d, 1);
+        } else {
+          /* Leave the OP_TAG1 to deal with it. */
+          VMNEXT;
+        }
+      )
+      VMCASE(OP_TAG1_INT32,
+        uint64_t val;
+        CHECK_SUSPEND(curbufleft(d) > 0);
+        if (*d->ptr != (uint8_t)((arg >> 8) & 0xff)) goto badtag;
+        advance(d, 1);
+        CHECK_RETURN(decode_varint(d, &val));
+        upb_sink_putint32(d->top->sink, *d->pc++ >> 8, (int32_t)val);
+      )
+      VMCASE(OP_MSG_PARSE,
+        const upb_pbdecoder_msgfield *mf;
+        memcpy(&mf, d->pc, sizeof(void*));
+        d->pc += sizeof(void*) / sizeof(uint32_t);
+        CHECK_RETURN(msg_parse(d, mf->field));
+      )
+      VMCASE(OP_MSG_STARTSTR,
+        const upb_pbdecoder_msgfield *mf;
+        uint32_t len = delim_remaining(d);
+        memcpy(&mf, d->pc, sizeof(void*));
+        d->pc += sizeof(void*) / sizeof(uint32_t);
+        if (!msg_startstr(d, mf->field, len)) {
+          seterr(d, kOutOfMemory);
+          return upb_pbdecoder_suspend(d);
+        }
+        if (len == 0) {
+          d->pc++;  /* Skip OP_MSG_STRING. */
+        }
+      )
+      VMCASE(OP_MSG_STRING,
+        size_t n = msg_putstring(d);
+        advance(d, n);
+        if (d->delim_end == NULL) {
+          /* The rest of the string is in the next buffer. */
+          d->pc--;  /* Repeat OP_MSG_STRING. */
+          if (n > 0) checkpoint(d);
+          return upb_pbdecoder_suspend(d);
+        }
+      )
+      VMCASE(OP_MSG_STARTSUBMSG,
+        const upb_pbdecoder_msgfield *mf;
+        memcpy(&mf, d->pc, sizeof(void*));
+        d->pc += sizeof(void*) / sizeof(uint32_t);
+        if (!msg_startsubmsg(d, mf)) {
+          seterr(d, kOutOfMemory);
+          return upb_pbdecoder_suspend(d);
+        }
+      )
+      VMCASE(OP_MSG_ENDSUBMSG,
+        const upb_pbdecoder_msgfield *mf;
+        memcpy(&mf, d->pc, sizeof(void*));
+        d->pc += sizeof(void*) / sizeof(uint32_t);
+        if (!msg_endsubmsg(d, mf)) {
+          seterr(d, kOutOfMemory);
+          return upb_pbdecoder_suspend(d);
+        }
+      )
+#ifdef UPB_THREADED_DISPATCH
+    vm_invalid:
+      UPB_UNREACHABLE();
+#endif
     }
   }
+
+#undef VMCASE
+#undef VMNEXT
+#undef VMDISPATCH
+#undef PRIMITIVE_OP
+#undef VMJIT
+#undef VMTRACE
+#undef VMFETCH
 }
 
+#ifdef UPB_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
 
 /* BytesHandler handlers ******************************************************/
 
@@ -919,18 +1309,24 @@ bool upb_pbdecoder_end(void *closure, const void *handler_data) {
 
   {
     const uint32_t *p = d->pc;
+    const uint32_t *first = method->code_base.ptr;
     d->stack->end_ofs = end;
-    /* Check the previous bytecode, but guard against beginning. */
-    if (p != method->code_base.ptr) p--;
-    if (getop(*p) == OP_CHECKDELIM) {
+    /* Check the previous bytecode, but guard against beginning.  The method
+     * starts with OP_SETDISPATCH, whose operand words hold a pointer and
+     * could pass for any opcode. */
+    first += upb_pbdecoder_instrlen(*first);
+    if (p > first) p--;
+    if (p != d->pc &&
+        (getop(*p) == OP_CHECKDELIM || getop(*p) == OP_CHECKDELIM_TAG1)) {
       /* Rewind from OP_TAG* to OP_CHECKDELIM. */
       UPB_ASSERT(getop(*d->pc) == OP_TAG1 ||
              getop(*d->pc) == OP_TAG2 ||
              getop(*d->pc) == OP_TAGN ||
+             getop(*d->pc) == OP_TAG1_INT32 ||
              getop(*d->pc) == OP_DISPATCH);
       d->pc = p;
     }
-    upb_pbdecoder_decode(closure, handler_data, &dummy, 0, NULL);
+    upb_pbdecoder_decode(closure, method->group, &dummy, 0, NULL);
   }
 
   if (d->call_len != 0) {
@@ -957,42 +1353,46 @@ size_t upb_pbdecoder_decode(void *decoder, const void *group, const char *buf,
 void upb_pbdecoder_reset(upb_pbdecoder *d) {
   d->top = d->stack;
   d->top->groupnum = 0;
+  d->top->method = NULL;
   d->ptr = d->residual;
   d->buf = d->residual;
   d->end = d->residual;
   d->residual_end = d->residual;
 }
 
+/* Whether the decoder can push to |sink| with method |m|. */
+static bool sink_matches(const upb_pbdecodermethod *m, upb_sink sink) {
+  if (m->layout) {
+    return sink.handlers == NULL;
+  } else {
+    return !m->dest_handlers_ || sink.handlers == m->dest_handlers_;
+  }
+}
+
 upb_pbdecoder *upb_pbdecoder_create(upb_arena *a, const upb_pbdecodermethod *m,
                                     upb_sink sink, upb_status *status) {
   const size_t default_max_nesting = 64;
+  upb_pbdecoder *d;
 #ifndef NDEBUG
   size_t size_before = upb_arena_bytesallocated(a);
 #endif
 
-  upb_pbdecoder *d = upb_arena_malloc(a, sizeof(upb_pbdecoder));
-  if (!d) return NULL;
+  if (!sink_matches(m, sink)) return NULL;
 
-  d->method_ = m;
-  d->callstack = upb_arena_malloc(a, callstacksize(d, default_max_nesting));
-  d->stack = upb_arena_malloc(a, stacksize(d, default_max_nesting));
-  if (!d->stack || !d->callstack) {
-    return NULL;
-  }
+  /* The stacks come in the same allocation, right after the decoder; every
+   * member of a frame is at least as aligned as the callstack's pointers. */
+  d = upb_arena_malloc(a, sizeof(upb_pbdecoder) +
+                              stacksize(NULL, default_max_nesting) +
+                              callstacksize(NULL, default_max_nesting));
+  if (!d) return NULL;
 
+  d->stack = (upb_pbdecoder_frame*)(d + 1);
+  d->callstack = (const uint32_t**)(d->stack + default_max_nesting);
   d->arena = a;
   d->limit = d->stack + default_max_nesting - 1;
   d->stack_size = default_max_nesting;
-  d->status = status;
 
-  upb_pbdecoder_reset(d);
-  upb_bytessink_reset(&d->input_, &m->input_handler_, d);
-
-  if (d->method_->dest_handlers_) {
-    if (sink.handlers != d->method_->dest_handlers_)
-      return NULL;
-  }
-  d->top->sink = sink;
+  upb_pbdecoder_rebind(d, m, sink, status);
 
   /* If this fails, increase the value in decoder.h. */
   UPB_ASSERT_DEBUGVAR(upb_arena_bytesallocated(a) - size_before <=
@@ -1000,6 +1400,36 @@ upb_pbdecoder *upb_pbdecoder_create(upb_arena *a, const upb_pbdecodermethod *m,
   return d;
 }
 
+upb_pbdecoder *upb_pbdecoder_createformsg(upb_arena *a,
+                                          const upb_pbdecodermethod *m,
+                                          upb_msg *msg, upb_status *status) {
+  upb_sink sink;
+  if (!m->layout) return NULL;
+  upb_sink_reset(&sink, NULL, msg);
+  return upb_pbdecoder_create(a, m, sink, status);
+}
+
+bool upb_pbdecoder_rebind(upb_pbdecoder *d, const upb_pbdecodermethod *m,
+                          upb_sink sink, upb_status *status) {
+  if (!sink_matches(m, sink)) return false;
+
+  d->method_ = m;
+  d->status = status;
+  upb_bytessink_reset(&d->input_, &m->input_handler_, d);
+  upb_pbdecoder_reset(d);
+  d->top->sink = sink;
+  return true;
+}
+
+bool upb_pbdecoder_rebindformsg(upb_pbdecoder *d,
+                                const upb_pbdecodermethod *m, upb_msg *msg,
+                                upb_status *status) {
+  upb_sink sink;
+  if (!m->layout) return false;
+  upb_sink_reset(&sink, NULL, msg);
+  return upb_pbdecoder_rebind(d, m, sink, status);
+}
+
 uint64_t upb_pbdecoder_bytesparsed(const upb_pbdecoder *d) {
   return offset(d);
 }
@@ -1032,6 +1462,7 @@ bool upb_pbdecoder_setmaxnesting(upb_pbdecoder *d, size_t max) {
     if (!p) {
       return false;
     }
+    d->top = (upb_pbdecoder_frame*)p + (d->top - d->stack);
     d->stack = p;
 
     old_size = callstacksize(d, d->stack_size);
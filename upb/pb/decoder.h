@@ -15,6 +15,7 @@
 #ifndef UPB_DECODER_H_
 #define UPB_DECODER_H_
 
+#include "upb/msg.h"
 #include "upb/sink.h"
 
 #ifdef __cplusplus
@@ -103,6 +104,14 @@ extern "C" {
 upb_pbdecoder *upb_pbdecoder_create(upb_arena *arena,
                                     const upb_pbdecodermethod *method,
                                     upb_sink output, upb_status *status);
+
+/* Creates a decoder that decodes straight into |msg|, for a method from
+ * upb_pbcodecache_getformsg().  Strings, arrays and submessages are allocated
+ * from |arena|, so |msg| should belong to it too.  Like upb_decode() into the
+ * same layout, except that unknown fields are skipped, not kept. */
+upb_pbdecoder *upb_pbdecoder_createformsg(upb_arena *arena,
+                                          const upb_pbdecodermethod *method,
+                                          upb_msg *msg, upb_status *status);
 const upb_pbdecodermethod *upb_pbdecoder_method(const upb_pbdecoder *d);
 upb_bytessink upb_pbdecoder_input(upb_pbdecoder *d);
 uint64_t upb_pbdecoder_bytesparsed(const upb_pbdecoder *d);
@@ -110,6 +119,21 @@ size_t upb_pbdecoder_maxnesting(const upb_pbdecoder *d);
 bool upb_pbdecoder_setmaxnesting(upb_pbdecoder *d, size_t max);
 void upb_pbdecoder_reset(upb_pbdecoder *d);
 
+/* Resets the decoder and binds it to another method and sink, as though it
+ * had just been created with them, but without allocating anything: its stacks
+ * (and max nesting) are kept.  This lets a decoder be kept around and reused
+ * for a stream of short messages, which would otherwise spend much of their
+ * time setting one up.  Returns false, leaving the decoder as it was, if the
+ * sink doesn't match the method. */
+bool upb_pbdecoder_rebind(upb_pbdecoder *d, const upb_pbdecodermethod *method,
+                          upb_sink output, upb_status *status);
+
+/* Like upb_pbdecoder_rebind(), for a method from upb_pbcodecache_getformsg().
+ * |msg| should belong to the arena the decoder was created in. */
+bool upb_pbdecoder_rebindformsg(upb_pbdecoder *d,
+                                const upb_pbdecodermethod *method,
+                                upb_msg *msg, upb_status *status);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 
@@ -133,6 +157,14 @@ class upb::pb::DecoderPtr {
                                            output.sink(), status->ptr()));
   }
 
+  /* Constructs a decoder that decodes into |msg|, which should be allocated
+   * from |arena|, for a method from CodeCache::GetForMsg(). */
+  static DecoderPtr CreateForMsg(Arena *arena, DecoderMethodPtr method,
+                                 upb_msg *msg, Status *status) {
+    return DecoderPtr(upb_pbdecoder_createformsg(arena->ptr(), method.ptr(),
+                                                 msg, status->ptr()));
+  }
+
   /* Returns the DecoderMethod this decoder is parsing from. */
   const DecoderMethodPtr method() const {
     return DecoderMethodPtr(upb_pbdecoder_method(ptr_));
@@ -158,10 +190,23 @@ class upb::pb::DecoderPtr {
    * Setting the limit will fail if the parser is currently suspended at a depth
    * greater than this, or if memory allocation of the stack fails. */
   size_t max_nesting() { return upb_pbdecoder_maxnesting(ptr()); }
-  bool set_max_nesting(size_t max) { return upb_pbdecoder_maxnesting(ptr()); }
+  bool set_max_nesting(size_t max) {
+    return upb_pbdecoder_setmaxnesting(ptr(), max);
+  }
 
   void Reset() { upb_pbdecoder_reset(ptr()); }
 
+  /* Resets the decoder for another method and sink, reusing its memory; see
+   * upb_pbdecoder_rebind(). */
+  bool Rebind(DecoderMethodPtr method, upb::Sink output, Status *status) {
+    return upb_pbdecoder_rebind(ptr(), method.ptr(), output.sink(),
+                                status->ptr());
+  }
+
+  bool RebindForMsg(DecoderMethodPtr method, upb_msg *msg, Status *status) {
+    return upb_pbdecoder_rebindformsg(ptr(), method.ptr(), msg, status->ptr());
+  }
+
   static const size_t kSize = UPB_PB_DECODER_SIZE;
 
  private:
@@ -173,7 +218,14 @@ class upb::pb::DecoderPtr {
 /* upb_pbcodecache ************************************************************/
 
 /* Lazily builds and caches decoder methods that will push data to the given
- * handlers.  The destination handlercache must outlive this object. */
+ * handlers.  The destination handlercache must outlive this object.  It may be
+ * NULL if the cache is only used for upb_pbcodecache_getformsg().
+ *
+ * Methods are compiled once per set of destination handlers and shared by
+ * every decoder created from them.  A method never changes once returned, so
+ * it can be used from any number of threads at once; the cache itself is
+ * not thread-safe.  With upb_pbcodecache_setondemand(), decoders compile
+ * submessage methods into the cache as they go, so that no longer holds. */
 
 struct upb_pbcodecache;
 typedef struct upb_pbcodecache upb_pbcodecache;
@@ -187,9 +239,20 @@ void upb_pbcodecache_free(upb_pbcodecache *c);
 bool upb_pbcodecache_allowjit(const upb_pbcodecache *c);
 void upb_pbcodecache_setallowjit(upb_pbcodecache *c, bool allow);
 void upb_pbcodecache_setlazy(upb_pbcodecache *c, bool lazy);
+bool upb_pbcodecache_ondemand(const upb_pbcodecache *c);
+void upb_pbcodecache_setondemand(upb_pbcodecache *c, bool ondemand);
 const upb_pbdecodermethod *upb_pbcodecache_get(upb_pbcodecache *c,
                                                const upb_msgdef *md);
 
+/* Returns a method that stores what it decodes directly into messages with
+ * layout |l|, which must be the layout of |md| (eg. generated by upbc), with
+ * no handlers in between.  Such a method has no destination handlers and is
+ * never JIT compiled; decoders for it come from upb_pbdecoder_createformsg().
+ * |l| must outlive the cache. */
+const upb_pbdecodermethod *upb_pbcodecache_getformsg(upb_pbcodecache *c,
+                                                     const upb_msgdef *md,
+                                                     const upb_msglayout *l);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 
@@ -200,7 +263,8 @@ const upb_pbdecodermethod *upb_pbcodecache_get(upb_pbcodecache *c,
 class upb::pb::CodeCache {
  public:
   CodeCache(upb::HandlerCache *dest)
-      : ptr_(upb_pbcodecache_new(dest->ptr()), upb_pbcodecache_free) {}
+      : ptr_(upb_pbcodecache_new(dest ? dest->ptr() : nullptr),
+             upb_pbcodecache_free) {}
   CodeCache(CodeCache&&) = default;
   CodeCache& operator=(CodeCache&&) = default;
 
@@ -225,12 +289,29 @@ class upb::pb::CodeCache {
    * in protobuf binary format and the caller wishes to lazy parse it. */
   void set_lazy(bool lazy) { upb_pbcodecache_setlazy(ptr(), lazy); }
 
+  /* Whether to compile the method for each submessage only when a decoder
+   * first calls into it, instead of along with the method for every message
+   * that it is reachable from.  Defaults to false.  This makes getting a
+   * method for a message of a large schema cheap, but then decoders modify
+   * the cache, so they must not be used from other threads than the one that
+   * uses the cache.  May only be set prior to any code generation. */
+  bool on_demand() const { return upb_pbcodecache_ondemand(ptr()); }
+  void set_on_demand(bool on_demand) {
+    upb_pbcodecache_setondemand(ptr(), on_demand);
+  }
+
   /* Returns a DecoderMethod that can push data to the given handlers.
    * If a suitable method already exists, it will be returned from the cache. */
   const DecoderMethodPtr Get(MessageDefPtr md) {
     return DecoderMethodPtr(upb_pbcodecache_get(ptr(), md.ptr()));
   }
 
+  /* Returns a DecoderMethod that decodes into messages with layout |l|, for
+   * DecoderPtr::CreateForMsg(). */
+  const DecoderMethodPtr GetForMsg(MessageDefPtr md, const upb_msglayout *l) {
+    return DecoderMethodPtr(upb_pbcodecache_getformsg(ptr(), md.ptr(), l));
+  }
+
  private:
   std::unique_ptr<upb_pbcodecache, decltype(&upb_pbcodecache_free)> ptr_;
 };
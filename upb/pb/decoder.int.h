@@ -67,10 +67,40 @@ typedef enum {
 
   OP_DISPATCH       = 36,  /* No arg. */
 
-  OP_HALT           = 37   /* No arg. */
+  OP_HALT           = 37,  /* No arg. */
+
+  OP_PARSE_BULK     = 38,  /* | selector (23) | 64-bit (1) | opc (8) | */
+                           /* Hands packed fixed-width values to the BULK
+                            * handler a buffer at a time. */
+
+  /* Superinstructions, which replace the first of a common pair of
+   * instructions in place once a group has been compiled.  Each keeps the arg
+   * of the instruction it replaces, and does the work of the following one too
+   * when it can do so quickly; otherwise it carries on to that instruction,
+   * which is still there, just as the original would have. */
+  OP_CHECKDELIM_TAG1 = 39, /* OP_CHECKDELIM, then the following OP_TAG1. */
+  OP_TAG1_INT32      = 40, /* OP_TAG1, then the following OP_PARSE_INT32. */
+
+  /* In place of the handler calls, for methods that decode into a upb_msg
+   * (see upb_pbcodecache_getformsg()).  The closure of each frame's sink is
+   * the message, and its handlers are NULL.  All but OP_MSG_STRING are N
+   * words, like OP_SETDISPATCH:
+   *   | unused (24)                    | opc | */
+  /*   | upb_pbdecoder_msgfield* (32 or 64)   | */
+  OP_MSG_PARSE       = 41, /* Parses a value and stores or appends it. */
+  OP_MSG_STARTSTR    = 42, /* Adds a string for OP_MSG_STRING to fill. */
+  OP_MSG_STRING      = 43, /* No arg. */
+  OP_MSG_STARTSUBMSG = 44, /* Gets or adds the submessage for its frame. */
+  OP_MSG_ENDSUBMSG   = 45, /* Moves a map entry into the map. */
+
+  /* Like OP_CALL, into the method of another group, which is compiled the
+   * first time it is called (see upb_pbcodecache_setondemand()).  N words:
+   *   | unused (24)                    | opc | */
+  /*   | upb_pbdecoder_callstub* (32 or 64)   | */
+  OP_CALLSTUB        = 46
 } opcode;
 
-#define OP_MAX OP_HALT
+#define OP_MAX OP_CALLSTUB
 
 UPB_INLINE opcode getop(uint32_t instr) { return (opcode)(instr & 0xff); }
 
@@ -80,24 +110,91 @@ struct upb_pbcodecache {
   bool allow_jit;
   bool lazy;
 
-  /* Map of upb_msgdef -> mgroup. */
+  /* Whether to compile a group for each message only when a decoder first
+   * calls into it, instead of with the group of the message that has it as a
+   * submessage.  See upb_pbcodecache_setondemand(). */
+  bool ondemand;
+
+  /* Map of upb_msgdef -> mgroup, for the messages that groups were compiled
+   * for, or of upb_msglayout -> mgroup for groups that decode into a
+   * upb_msg.  Groups compiled on demand are keyed by their upb_handlers
+   * instead.  Owns the groups. */
   upb_inttable groups;
+
+  /* Map of upb_handlers (or upb_msglayout) -> upb_pbdecodermethod, over all
+   * groups.  A group compiled for one message also has methods for all of its
+   * submessages, so these are reused instead of compiling another group for
+   * them.  When compiling on demand, each group has a single method. */
+  upb_inttable methods;
 };
 
+/* How many words an instruction is. */
+UPB_INLINE int upb_pbdecoder_instrlen(uint32_t instr) {
+  switch (getop(instr)) {
+    case OP_SETDISPATCH:
+    case OP_MSG_PARSE:
+    case OP_MSG_STARTSTR:
+    case OP_MSG_STARTSUBMSG:
+    case OP_MSG_ENDSUBMSG:
+    case OP_CALLSTUB:
+      return 1 + sizeof(void*) / sizeof(uint32_t);
+    case OP_TAGN: return 3;
+    case OP_SETBIGGROUPNUM: return 2;
+    default: return 1;
+  }
+}
+
+/* The JIT needs the System V calling convention and mmap().  Define
+ * UPB_NO_JIT to build without it. */
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__)) && \
+    !defined(UPB_NO_JIT)
+#define UPB_USE_JIT_X64
+#endif
+
+/* Machine code for the fast paths of a group's most common instructions; see
+ * compile_decoder_x64.c.  Owned by the group. */
+typedef struct {
+  /* For each word of bytecode: where the machine code for the instruction
+   * starting there begins, or NULL if it is only interpreted. */
+  const void **entries;
+
+  /* For each word of bytecode: the handlers that the machine code calls, which
+   * must be those of the sink in the decoder's top frame. */
+  const upb_handlers **handlers;
+
+  /* Runs the machine code from |entry| up to the first instruction that has to
+   * be interpreted, and leaves d->pc there. */
+  void (*enter)(upb_pbdecoder *d, const void *entry);
+
+  void *mem;
+  size_t size;
+} upb_pbdecoder_jit;
+
 /* Method group; represents a set of decoder methods that had their code
- * emitted together.  Immutable once created.  */
+ * emitted together.  Immutable once created, so its methods can be used by
+ * any number of decoders at once, from any thread.  The exception is the call
+ * stubs of a group compiled on demand, which decoders resolve as they go. */
 typedef struct {
-  /* Maps upb_msgdef/upb_handlers -> upb_pbdecodermethod.  Owned by us.
-   *
-   * Ideally this would be on pbcodecache (if we were actually caching code).
-   * Right now we don't actually cache anything, which is wasteful. */
+  /* Maps upb_msgdef/upb_handlers -> upb_pbdecodermethod.  Owned by us. */
   upb_inttable methods;
 
   /* The bytecode for our methods, if any exists.  Owned by us. */
   uint32_t *bytecode;
   uint32_t *bytecode_end;
+
+  /* Machine code for the bytecode, or NULL if none was generated. */
+  upb_pbdecoder_jit *jit;
+
+  /* Maps upb_handlers/upb_msglayout -> upb_pbdecoder_callstub, for the
+   * submessages that our OP_CALLSTUB instructions call.  Owned by us. */
+  upb_inttable stubs;
 } mgroup;
 
+/* Compiles machine code for |g|, whose bytecode is complete, and sets g->jit.
+ * Leaves it NULL if the platform doesn't allow it. */
+void upb_pbdecoder_jit_compile(mgroup *g);
+void upb_pbdecoder_jit_free(upb_pbdecoder_jit *jit);
+
 /* The maximum that any submessages can be nested.  Matches proto2's limit.
  * This specifies the size of the decoder's statically-sized array and therefore
  * setting it high will cause the upb::pb::Decoder object to be larger.
@@ -108,6 +205,39 @@ typedef struct {
  * the ability to set a custom memory allocation function. */
 #define UPB_DECODER_MAX_NESTING 64
 
+/* An entry of a dense dispatch array.  As in the dispatch table (see below), wt2 is the
+ * other wire type a field may have, if any; either is NO_WIRE_TYPE where there
+ * is none. */
+typedef struct {
+  uint32_t ofs;   /* Of the code for wt1, relative to the method. */
+  uint32_t ofs2;  /* Of the code for wt2. */
+  uint8_t wt1;
+  uint8_t wt2;
+} upb_pbdecoder_dispatchent;
+
+/* The operand of the OP_MSG_* instructions: a field of a message that is
+ * decoded into a upb_msg. */
+typedef struct {
+  const upb_msglayout_field *field;
+  const upb_msglayout *sublayout;  /* For submessage fields. */
+} upb_pbdecoder_msgfield;
+
+/* The operand of OP_CALLSTUB: a submessage whose method is compiled in a
+ * group of its own, the first time that a decoder calls it. */
+typedef struct {
+  upb_pbcodecache *cache;
+  const void *key;             /* The upb_handlers or upb_msglayout. */
+  const upb_msgdef *msgdef;    /* For a upb_msglayout; NULL for handlers. */
+
+  /* The method to call; NULL until it is first called. */
+  const upb_pbdecodermethod *method;
+} upb_pbdecoder_callstub;
+
+/* Returns the method that |stub| calls, compiling it if necessary, or NULL if
+ * that fails.  Called by the decoder, so it modifies the cache. */
+const upb_pbdecodermethod *upb_pbdecoder_resolvestub(
+    upb_pbdecoder_callstub *stub);
+
 /* Internal-only struct used by the decoder. */
 typedef struct {
   /* Space optimization note: we store two pointers here that the JIT
@@ -132,7 +262,9 @@ typedef struct {
    * A positive number indicates a known group.
    * A negative number indicates an unknown group. */
   int32_t groupnum;
-  upb_inttable *dispatch;  /* Not used by the JIT. */
+
+  /* The method whose dispatch tables we use.  Not used by the JIT. */
+  const upb_pbdecodermethod *method;
 } upb_pbdecoder_frame;
 
 struct upb_pbdecodermethod {
@@ -155,10 +287,23 @@ struct upb_pbdecodermethod {
   /* The destination handlers this method is bound to.  We own a ref. */
   const upb_handlers *dest_handlers_;
 
+  /* Instead of handlers, the layout of the upb_msg that this method decodes
+   * into, and the message it is for; both NULL for methods with handlers.
+   * Then |msgfields| holds the operands of the OP_MSG_* instructions, one for
+   * each field of the layout. */
+  const upb_msglayout *layout;
+  const upb_msgdef *msgdef;
+  upb_pbdecoder_msgfield *msgfields;
+
   /* Dispatch table -- used by both bytecode decoder and JIT when encountering a
    * field number that wasn't the one we were expecting to see.  See
    * decoder.int.h for the layout of this table. */
   upb_inttable dispatch;
+
+  /* The same for field numbers below dense_dispatch_size, as an array indexed
+   * by field number, so that those take a single load. */
+  upb_pbdecoder_dispatchent *dense_dispatch;
+  uint32_t dense_dispatch_size;
 };
 
 struct upb_pbdecoder {
@@ -52,6 +52,11 @@
 ** and lengths.  When the top-level submessage ends, we can go beginning to end,
 ** alternating the writing of lengths with memcpy() of the rest of the data.
 ** At the top level though, no buffering is required.
+**
+** When the message can be pushed to us twice, we can avoid buffering
+** altogether: a sizing pass counts bytes without keeping them and records the
+** length of every delimited region, and the writing pass then emits each
+** length up front and flushes after every handler, as at the top level.
 */
 
 #include "upb/pb/encoder.h"
@@ -91,6 +96,16 @@ typedef struct {
   uint32_t seglen;  /* Length of the segment. */
 } upb_pb_encoder_segment;
 
+typedef enum {
+  /* Buffer delimited regions until their length is known (the default). */
+  ENCODER_BUFFER,
+  /* Count the bytes of a message and record the lengths of its regions,
+   * without writing anything. */
+  ENCODER_SIZE,
+  /* Write the recorded lengths up front, without buffering. */
+  ENCODER_STREAM
+} upb_pb_encoder_mode;
+
 struct upb_pb_encoder {
   upb_arena *arena;
 
@@ -120,6 +135,19 @@ struct upb_pb_encoder {
 
   /* Depth of startmsg/endmsg calls. */
   int depth;
+
+  upb_pb_encoder_mode mode;
+
+  /* When sizing or streaming: the bytes counted or written since the start of
+   * the message, and for each enclosing region (parallel to "stack") the
+   * offset where it starts (sizing) or must end (streaming). */
+  size_t offset;
+  size_t *offsets;
+
+  /* When sizing or streaming: the length of each region, in the order the
+   * regions start, and the next one to write. */
+  size_t *lengths;
+  size_t lengths_count, lengths_size, next_length;
 };
 
 /* low-level buffering ********************************************************/
@@ -176,16 +204,22 @@ static void encoder_advance(upb_pb_encoder *e, size_t bytes) {
 /* Call when all of the bytes for a handler have been written.  Flushes the
  * bytes if possible and necessary, returning false if this failed. */
 static bool commit(upb_pb_encoder *e) {
-  if (!e->top) {
-    /* We aren't inside a delimited region.  Flush our accumulated bytes to
-     * the output.
-     *
-     * TODO(haberman): in the future we may want to delay flushing for
-     * efficiency reasons. */
-    putbuf(e, e->buf, e->ptr - e->buf);
-    e->ptr = e->buf;
+  if (e->mode == ENCODER_BUFFER && e->top) {
+    /* Inside a delimited region, whose length we don't know yet. */
+    return true;
   }
 
+  /* We aren't inside a delimited region, or we know all of the lengths ahead.
+   * Flush our accumulated bytes to the output (or only count them, when
+   * sizing).
+   *
+   * TODO(haberman): in the future we may want to delay flushing for
+   * efficiency reasons. */
+  if (e->mode != ENCODER_SIZE) {
+    putbuf(e, e->buf, e->ptr - e->buf);
+  }
+  e->offset += e->ptr - e->buf;
+  e->ptr = e->buf;
   return true;
 }
 
@@ -211,19 +245,125 @@ static void accumulate(upb_pb_encoder *e) {
   e->runbegin = e->ptr;
 }
 
+/* Doubles the size of the stack of enclosing submessages. */
+static bool growstack(upb_pb_encoder *e) {
+  size_t old_count = e->stacklimit - e->stack;
+  size_t new_count = old_count * 2;
+  int *new_stack = upb_arena_realloc(e->arena, e->stack,
+                                     old_count * sizeof(*e->stack),
+                                     new_count * sizeof(*e->stack));
+  if (new_stack == NULL) {
+    return false;
+  }
+
+  if (e->offsets) {
+    size_t *new_offsets = upb_arena_realloc(e->arena, e->offsets,
+                                            old_count * sizeof(*e->offsets),
+                                            new_count * sizeof(*e->offsets));
+    if (new_offsets == NULL) {
+      return false;
+    }
+    e->offsets = new_offsets;
+  }
+
+  if (e->top) {
+    e->top = new_stack + (e->top - e->stack);
+  }
+  e->stacklimit = new_stack + new_count;
+  e->stack = new_stack;
+  return true;
+}
+
+/* Reserves a new entry at the end of e->lengths. */
+static bool addlength(upb_pb_encoder *e) {
+  if (e->lengths_count == e->lengths_size) {
+    size_t new_size = UPB_MAX(e->lengths_size * 2, 16);
+    size_t *new_lengths = upb_arena_realloc(
+        e->arena, e->lengths, e->lengths_size * sizeof(*e->lengths),
+        new_size * sizeof(*e->lengths));
+    if (new_lengths == NULL) {
+      return false;
+    }
+    e->lengths = new_lengths;
+    e->lengths_size = new_size;
+  }
+
+  e->lengths_count++;
+  return true;
+}
+
+/* start_delim() when the lengths are counted rather than buffered.  Sizing
+ * records where the region starts; streaming writes the region's length and
+ * records where the region has to end. */
+static bool start_counted_delim(upb_pb_encoder *e) {
+  size_t depth = e->top ? e->top - e->stack + 1 : 0;
+
+  if (depth == (size_t)(e->stacklimit - e->stack) && !growstack(e)) {
+    return false;
+  }
+
+  if (e->mode == ENCODER_SIZE) {
+    if (!addlength(e)) {
+      return false;
+    }
+    e->stack[depth] = e->lengths_count - 1;
+    e->offsets[depth] = e->offset;
+  } else {
+    size_t len;
+    if (e->next_length == e->lengths_count) {
+      /* More regions than the sizing pass saw. */
+      return false;
+    }
+    len = e->lengths[e->next_length++];
+    if (!reserve(e, UPB_PB_VARINT_MAX_LEN)) {
+      return false;
+    }
+    encoder_advance(e, upb_vencode64(len, e->ptr));
+    commit(e);
+    e->offsets[depth] = e->offset + len;
+  }
+
+  e->top = e->stack + depth;
+  return true;
+}
+
+/* end_delim() when the lengths are counted rather than buffered.  Sizing now
+ * knows the region's length, and counts the varint in front of it as part of
+ * the enclosing regions; streaming checks the length was right. */
+static bool end_counted_delim(upb_pb_encoder *e) {
+  size_t depth = e->top - e->stack;
+  commit(e);
+
+  if (e->mode == ENCODER_SIZE) {
+    size_t len = e->offset - e->offsets[depth];
+    e->lengths[*e->top] = len;
+    e->offset += upb_varint_size(len);
+  } else if (e->offset != e->offsets[depth]) {
+    /* Not the message that was measured. */
+    return false;
+  }
+
+  e->top = depth == 0 ? NULL : e->top - 1;
+  return true;
+}
+
 /* Call to indicate the start of delimited region for which the full length is
  * not yet known.  All data will be buffered until the length is known.
  * Delimited regions may be nested; their lengths will all be tracked properly. */
 static bool start_delim(upb_pb_encoder *e) {
+  if (e->mode != ENCODER_BUFFER) {
+    return start_counted_delim(e);
+  }
+
   if (e->top) {
     /* We are already buffering, advance to the next segment and push it on the
      * stack. */
     accumulate(e);
 
-    if (++e->top == e->stacklimit) {
-      /* TODO(haberman): grow stack? */
+    if (e->top + 1 == e->stacklimit && !growstack(e)) {
       return false;
     }
+    e->top++;
 
     if (++e->segptr == e->seglimit) {
       /* Grow segment buffer. */
@@ -260,6 +400,11 @@ static bool start_delim(upb_pb_encoder *e) {
  * regions, we can now emit all of the buffered data we accumulated. */
 static bool end_delim(upb_pb_encoder *e) {
   size_t msglen;
+
+  if (e->mode != ENCODER_BUFFER) {
+    return end_counted_delim(e);
+  }
+
   accumulate(e);
   msglen = top(e)->msglen;
 
@@ -354,7 +499,10 @@ static bool startmsg(void *c, const void *hd) {
   upb_pb_encoder *e = c;
   UPB_UNUSED(hd);
   if (e->depth++ == 0) {
-    upb_bytessink_start(e->output_, 0, &e->subc);
+    e->offset = 0;
+    if (e->mode != ENCODER_SIZE) {
+      upb_bytessink_start(e->output_, 0, &e->subc);
+    }
   }
   return true;
 }
@@ -364,7 +512,18 @@ static bool endmsg(void *c, const void *hd, upb_status *status) {
   UPB_UNUSED(hd);
   UPB_UNUSED(status);
   if (--e->depth == 0) {
+    if (e->mode == ENCODER_SIZE) {
+      /* Next comes the writing pass. */
+      e->mode = ENCODER_STREAM;
+      e->next_length = 0;
+      return true;
+    }
     upb_bytessink_end(e->output_);
+    if (e->mode == ENCODER_STREAM) {
+      e->mode = ENCODER_BUFFER;
+      /* Fewer regions than the sizing pass saw. */
+      return e->next_length == e->lengths_count;
+    }
   }
   return true;
 }
@@ -402,7 +561,14 @@ static size_t encode_strbuf(void *c, const void *hd, const char *buf,
                             size_t len, const upb_bufhandle *h) {
   UPB_UNUSED(hd);
   UPB_UNUSED(h);
-  return encode_bytes(c, buf, len) ? len : 0;
+  return encode_bytes(c, buf, len) && commit(c) ? len : 0;
+}
+
+/* Packed fixed-width values arrive in wire format already. */
+static bool encode_packed_bulk(void *e, const void *hd, const char *buf,
+                               size_t len) {
+  UPB_UNUSED(hd);
+  return encode_bytes(e, buf, len) && commit(e);
 }
 
 #define T(type, ctype, convert, encode)                                  \
@@ -411,7 +577,7 @@ static size_t encode_strbuf(void *c, const void *hd, const char *buf,
   }                                                                      \
   static bool encode_packed_##type(void *e, const void *hd, ctype val) { \
     UPB_UNUSED(hd);                                                      \
-    return encode(e, (convert)(val));                                    \
+    return encode(e, (convert)(val)) && commit(e);                       \
   }
 
 T(double,   double,   dbl2uint64,   encode_fixed64)
@@ -452,6 +618,7 @@ static void newhandlers_callback(const void *closure, upb_handlers *h) {
     const upb_fielddef *f = upb_msg_iter_field(&i);
     bool packed = upb_fielddef_isseq(f) && upb_fielddef_isprimitive(f) &&
                   upb_fielddef_packed(f);
+    upb_selector_t sel;
     upb_handlerattr attr = UPB_HANDLERATTR_INIT;
     upb_wiretype_t wt =
         packed ? UPB_WIRE_TYPE_DELIMITED
@@ -463,6 +630,10 @@ static void newhandlers_callback(const void *closure, upb_handlers *h) {
     if (packed) {
       upb_handlers_setstartseq(h, f, encode_startdelimfield, &attr);
       upb_handlers_setendseq(h, f, encode_enddelimfield, &attr);
+      /* Fixed-width values can be passed through a buffer at a time. */
+      if (upb_handlers_getselector(f, UPB_HANDLER_BULK, &sel)) {
+        upb_handlers_setbulk(h, f, encode_packed_bulk, &attr);
+      }
     }
 
 #define T(upper, lower, upbtype)                                     \
@@ -519,6 +690,8 @@ void upb_pb_encoder_reset(upb_pb_encoder *e) {
   e->segptr = NULL;
   e->top = NULL;
   e->depth = 0;
+  e->mode = ENCODER_BUFFER;
+  e->lengths_count = 0;
 }
 
 
@@ -557,6 +730,9 @@ upb_pb_encoder *upb_pb_encoder_create(upb_arena *arena, const upb_handlers *h,
   upb_sink_reset(&e->input_, h, e);
 
   e->arena = arena;
+  e->offsets = NULL;
+  e->lengths = NULL;
+  e->lengths_size = 0;
   e->output_ = output;
   e->subc = output.closure;
   e->ptr = e->buf;
@@ -568,3 +744,41 @@ upb_pb_encoder *upb_pb_encoder_create(upb_arena *arena, const upb_handlers *h,
 }
 
 upb_sink upb_pb_encoder_input(upb_pb_encoder *e) { return e->input_; }
+
+/* Allocates the offsets that sizing and streaming keep per enclosing region,
+ * and starts at the top level in |mode|. */
+static bool setmode(upb_pb_encoder *e, upb_pb_encoder_mode mode) {
+  UPB_ASSERT(e->depth == 0);
+  if (!e->offsets) {
+    e->offsets = upb_arena_malloc(
+        e->arena, (e->stacklimit - e->stack) * sizeof(*e->offsets));
+    if (!e->offsets) return false;
+  }
+  e->mode = mode;
+  e->top = NULL;
+  e->ptr = e->buf;
+  return true;
+}
+
+bool upb_pb_encoder_startsizing(upb_pb_encoder *e) {
+  if (!setmode(e, ENCODER_SIZE)) return false;
+  e->lengths_count = 0;
+  return true;
+}
+
+const size_t *upb_pb_encoder_lengths(const upb_pb_encoder *e, size_t *count) {
+  *count = e->lengths_count;
+  return e->lengths;
+}
+
+bool upb_pb_encoder_setlengths(upb_pb_encoder *e, const size_t *lengths,
+                               size_t count) {
+  if (!setmode(e, ENCODER_STREAM)) return false;
+  e->lengths_count = 0;
+  while (e->lengths_count < count) {
+    if (!addlength(e)) return false;
+    e->lengths[e->lengths_count - 1] = lengths[e->lengths_count - 1];
+  }
+  e->next_length = 0;
+  return true;
+}
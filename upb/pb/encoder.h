@@ -4,9 +4,11 @@
 ** Implements a set of upb_handlers that write protobuf data to the binary wire
 ** format.
 **
-** This encoder implementation does not have any access to any out-of-band or
-** precomputed lengths for submessages, so it must buffer submessages internally
-** before it can emit the first byte.
+** By default this encoder has no access to out-of-band or precomputed lengths
+** for submessages, so it must buffer submessages internally before it can emit
+** their first byte.  If the message can be pushed to it twice, a sizing pass
+** lets it stream the second pass to the output instead; see
+** upb_pb_encoder_startsizing().
 */
 
 #ifndef UPB_ENCODER_H_
@@ -30,7 +32,7 @@ class EncoderPtr;
  * constructed.  This hint may be an overestimate for some build configurations.
  * But if the decoder library is upgraded without recompiling the application,
  * it may be an underestimate. */
-#define UPB_PB_ENCODER_SIZE 784
+#define UPB_PB_ENCODER_SIZE 848
 
 struct upb_pb_encoder;
 typedef struct upb_pb_encoder upb_pb_encoder;
@@ -43,6 +45,25 @@ upb_sink upb_pb_encoder_input(upb_pb_encoder *p);
 upb_pb_encoder* upb_pb_encoder_create(upb_arena* a, const upb_handlers* h,
                                       upb_bytessink output);
 
+/* Two-pass encoding, which writes through a small fixed buffer however large
+ * the message is.  After this call, the next message pushed to the input is
+ * measured rather than written: nothing reaches the output, and the encoder
+ * records the length of each submessage, string and packed field in it.
+ * Pushing the same message again then streams it to the output directly.
+ * Returns false if memory could not be allocated.  Must be called between
+ * messages. */
+bool upb_pb_encoder_startsizing(upb_pb_encoder *e);
+
+/* The lengths recorded by the last sizing pass, in the order their fields
+ * started.  Valid until the encoder is used again. */
+const size_t *upb_pb_encoder_lengths(const upb_pb_encoder *e, size_t *count);
+
+/* Streams the next message pushed to the input using |lengths|, as recorded
+ * by the sizing pass of any encoder for the same message, without a sizing
+ * pass of its own.  A field whose length does not match fails the encode. */
+bool upb_pb_encoder_setlengths(upb_pb_encoder *e, const size_t *lengths,
+                               size_t count);
+
 /* Lazily builds and caches handlers that will push encoded data to a bytessink.
  * Any msgdef objects used with this object must outlive it. */
 upb_handlercache *upb_pb_encoder_newcache(void);
@@ -67,6 +88,13 @@ class upb::pb::EncoderPtr {
   /* The input to the encoder. */
   upb::Sink input() { return upb_pb_encoder_input(ptr()); }
 
+  /* Two-pass encoding; see upb_pb_encoder_startsizing() above. */
+  bool StartSizing() { return upb_pb_encoder_startsizing(ptr()); }
+
+  bool SetLengths(const size_t* lengths, size_t count) {
+    return upb_pb_encoder_setlengths(ptr(), lengths, count);
+  }
+
   /* Creates a new set of handlers for this MessageDef. */
   static HandlerCache NewCache() {
     return HandlerCache(upb_pb_encoder_newcache());
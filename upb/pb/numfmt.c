@@ -0,0 +1,380 @@
+/*
+** Number formatting for the printers.  Floating point values are converted
+** with Grisu2, from Florian Loitsch, "Printing Floating-Point Numbers Quickly
+** and Accurately with Integers" (PLDI 2010): it only needs 64-bit integer
+** arithmetic and a table of powers of ten, and its output always reads back
+** as the same value.
+*/
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "upb/pb/numfmt.int.h"
+
+#include "upb/port_def.inc"
+
+/* Integers *******************************************************************/
+
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+size_t upb_fmt_uint64(uint64_t val, char *buf) {
+  char tmp[20];
+  char *p = tmp + sizeof(tmp);
+  size_t n;
+
+  /* Two digits at a time, from the end. */
+  while (val >= 100) {
+    const char *pair = digit_pairs + (val % 100) * 2;
+    val /= 100;
+    p -= 2;
+    p[0] = pair[0];
+    p[1] = pair[1];
+  }
+  if (val >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + val * 2, 2);
+  } else {
+    *--p = (char)('0' + val);
+  }
+
+  n = tmp + sizeof(tmp) - p;
+  memcpy(buf, p, n);
+  return n;
+}
+
+size_t upb_fmt_int64(int64_t val, char *buf) {
+  if (val < 0) {
+    /* Negating as unsigned is well-defined, even for the most negative. */
+    buf[0] = '-';
+    return upb_fmt_uint64(0 - (uint64_t)val, buf + 1) + 1;
+  }
+  return upb_fmt_uint64(val, buf);
+}
+
+/* Grisu2 *********************************************************************/
+
+/* A floating point number f * 2^e, with a 64-bit significand. */
+typedef struct {
+  uint64_t f;
+  int e;
+} diyfp;
+
+static diyfp diyfp_make(uint64_t f, int e) {
+  diyfp ret;
+  ret.f = f;
+  ret.e = e;
+  return ret;
+}
+
+/* Shifts the significand left until its top bit is set. */
+static diyfp diyfp_normalize(diyfp x) {
+  while (!(x.f & ((uint64_t)1 << 63))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/* The upper 64 bits of the 128-bit product, rounded. */
+static diyfp diyfp_mul(diyfp x, diyfp y) {
+  const uint64_t m32 = 0xffffffff;
+  uint64_t a = x.f >> 32, b = x.f & m32;
+  uint64_t c = y.f >> 32, d = y.f & m32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t mid = (bd >> 32) + (ad & m32) + (bc & m32) + ((uint64_t)1 << 31);
+  return diyfp_make(ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64);
+}
+
+/* 10^k for k = -348, -340, ..., 340, normalized and rounded to nearest. */
+#define P(hi, lo, e) {(uint64_t)(hi) << 32 | (lo), e}
+static const diyfp cached_powers[] = {
+  P(0xfa8fd5a0, 0x081c0288, -1220),
+  P(0xbaaee17f, 0xa23ebf76, -1193),
+  P(0x8b16fb20, 0x3055ac76, -1166),
+  P(0xcf42894a, 0x5dce35ea, -1140),
+  P(0x9a6bb0aa, 0x55653b2d, -1113),
+  P(0xe61acf03, 0x3d1a45df, -1087),
+  P(0xab70fe17, 0xc79ac6ca, -1060),
+  P(0xff77b1fc, 0xbebcdc4f, -1034),
+  P(0xbe5691ef, 0x416bd60c, -1007),
+  P(0x8dd01fad, 0x907ffc3c, -980),
+  P(0xd3515c28, 0x31559a83, -954),
+  P(0x9d71ac8f, 0xada6c9b5, -927),
+  P(0xea9c2277, 0x23ee8bcb, -901),
+  P(0xaecc4991, 0x4078536d, -874),
+  P(0x823c1279, 0x5db6ce57, -847),
+  P(0xc2109436, 0x4dfb5637, -821),
+  P(0x9096ea6f, 0x3848984f, -794),
+  P(0xd77485cb, 0x25823ac7, -768),
+  P(0xa086cfcd, 0x97bf97f4, -741),
+  P(0xef340a98, 0x172aace5, -715),
+  P(0xb23867fb, 0x2a35b28e, -688),
+  P(0x84c8d4df, 0xd2c63f3b, -661),
+  P(0xc5dd4427, 0x1ad3cdba, -635),
+  P(0x936b9fce, 0xbb25c996, -608),
+  P(0xdbac6c24, 0x7d62a584, -582),
+  P(0xa3ab6658, 0x0d5fdaf6, -555),
+  P(0xf3e2f893, 0xdec3f126, -529),
+  P(0xb5b5ada8, 0xaaff80b8, -502),
+  P(0x87625f05, 0x6c7c4a8b, -475),
+  P(0xc9bcff60, 0x34c13053, -449),
+  P(0x964e858c, 0x91ba2655, -422),
+  P(0xdff97724, 0x70297ebd, -396),
+  P(0xa6dfbd9f, 0xb8e5b88f, -369),
+  P(0xf8a95fcf, 0x88747d94, -343),
+  P(0xb9447093, 0x8fa89bcf, -316),
+  P(0x8a08f0f8, 0xbf0f156b, -289),
+  P(0xcdb02555, 0x653131b6, -263),
+  P(0x993fe2c6, 0xd07b7fac, -236),
+  P(0xe45c10c4, 0x2a2b3b06, -210),
+  P(0xaa242499, 0x697392d3, -183),
+  P(0xfd87b5f2, 0x8300ca0e, -157),
+  P(0xbce50864, 0x92111aeb, -130),
+  P(0x8cbccc09, 0x6f5088cc, -103),
+  P(0xd1b71758, 0xe219652c, -77),
+  P(0x9c400000, 0x00000000, -50),
+  P(0xe8d4a510, 0x00000000, -24),
+  P(0xad78ebc5, 0xac620000, 3),
+  P(0x813f3978, 0xf8940984, 30),
+  P(0xc097ce7b, 0xc90715b3, 56),
+  P(0x8f7e32ce, 0x7bea5c70, 83),
+  P(0xd5d238a4, 0xabe98068, 109),
+  P(0x9f4f2726, 0x179a2245, 136),
+  P(0xed63a231, 0xd4c4fb27, 162),
+  P(0xb0de6538, 0x8cc8ada8, 189),
+  P(0x83c7088e, 0x1aab65db, 216),
+  P(0xc45d1df9, 0x42711d9a, 242),
+  P(0x924d692c, 0xa61be758, 269),
+  P(0xda01ee64, 0x1a708dea, 295),
+  P(0xa26da399, 0x9aef774a, 322),
+  P(0xf209787b, 0xb47d6b85, 348),
+  P(0xb454e4a1, 0x79dd1877, 375),
+  P(0x865b8692, 0x5b9bc5c2, 402),
+  P(0xc83553c5, 0xc8965d3d, 428),
+  P(0x952ab45c, 0xfa97a0b3, 455),
+  P(0xde469fbd, 0x99a05fe3, 481),
+  P(0xa59bc234, 0xdb398c25, 508),
+  P(0xf6c69a72, 0xa3989f5c, 534),
+  P(0xb7dcbf53, 0x54e9bece, 561),
+  P(0x88fcf317, 0xf22241e2, 588),
+  P(0xcc20ce9b, 0xd35c78a5, 614),
+  P(0x98165af3, 0x7b2153df, 641),
+  P(0xe2a0b5dc, 0x971f303a, 667),
+  P(0xa8d9d153, 0x5ce3b396, 694),
+  P(0xfb9b7cd9, 0xa4a7443c, 720),
+  P(0xbb764c4c, 0xa7a44410, 747),
+  P(0x8bab8eef, 0xb6409c1a, 774),
+  P(0xd01fef10, 0xa657842c, 800),
+  P(0x9b10a4e5, 0xe9913129, 827),
+  P(0xe7109bfb, 0xa19c0c9d, 853),
+  P(0xac2820d9, 0x623bf429, 880),
+  P(0x80444b5e, 0x7aa7cf85, 907),
+  P(0xbf21e440, 0x03acdd2d, 933),
+  P(0x8e679c2f, 0x5e44ff8f, 960),
+  P(0xd433179d, 0x9c8cb841, 986),
+  P(0x9e19db92, 0xb4e31ba9, 1013),
+  P(0xeb96bf6e, 0xbadf77d9, 1039),
+  P(0xaf87023b, 0x9bf0ee6b, 1066)
+};
+#undef P
+
+static const uint32_t pow10_32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/* Returns 10^-k, for the k that brings the product with a normalized value of
+ * binary exponent |e| into the exponent range [-60, -32] that digit_gen()
+ * works in. */
+static diyfp cached_power(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;  /* log10(2) */
+  int ik = (int)dk;
+  int index;
+  if (dk - ik > 0.0) ik++;
+  index = (ik >> 3) + 1;
+  *k = 348 - index * 8;
+  return cached_powers[index];
+}
+
+/* Moves the last digit towards w while that stays inside the interval. */
+static void grisu_round(char *digits, int len, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    digits[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+/* Generates the digits of mp until they are within |delta| of it, which
+ * makes them a value in the rounding interval, and adds the exponent of the
+ * last digit to *k.  Returns the number of digits. */
+static int digit_gen(diyfp w, diyfp mp, uint64_t delta, char *digits, int *k) {
+  const int shift = -mp.e;
+  const uint64_t one = (uint64_t)1 << shift;
+  const uint64_t wp_w = mp.f - w.f;
+  uint32_t p1 = (uint32_t)(mp.f >> shift);
+  uint64_t p2 = mp.f & (one - 1);
+  int kappa = 1;
+  int len = 0;
+
+  while (kappa < 10 && p1 >= pow10_32[kappa]) kappa++;
+
+  /* The integral part. */
+  while (kappa > 0) {
+    uint32_t d = p1 / pow10_32[kappa - 1];
+    uint64_t rest;
+    p1 %= pow10_32[kappa - 1];
+    if (d || len) digits[len++] = (char)('0' + d);
+    kappa--;
+    rest = ((uint64_t)p1 << shift) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisu_round(digits, len, delta, rest, (uint64_t)pow10_32[kappa] << shift,
+                  wp_w);
+      return len;
+    }
+  }
+
+  /* The fractional part. */
+  for (;;) {
+    char d;
+    p2 *= 10;
+    delta *= 10;
+    d = (char)(p2 >> shift);
+    if (d || len) digits[len++] = (char)('0' + d);
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisu_round(digits, len, delta, p2, one,
+                  -kappa < 10 ? wp_w * pow10_32[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/* Sets |digits| (with a return value of their number) and *k so that
+ * digits * 10^k is the shortest decimal in the rounding interval of f * 2^e,
+ * a positive value with |sigbits| bits after the implied leading one.  That
+ * bit is set in |f| unless the value is subnormal. */
+static int grisu2(uint64_t f, int e, int sigbits, char *digits, int *k) {
+  const uint64_t hidden = (uint64_t)1 << sigbits;
+  /* The boundaries halfway to the neighbouring values.  The one below is
+   * nearer if f is a power of two, as the exponent steps down there. */
+  diyfp plus = diyfp_normalize(diyfp_make((f << 1) + 1, e - 1));
+  diyfp minus = f == hidden ? diyfp_make((f << 2) - 1, e - 2)
+                            : diyfp_make((f << 1) - 1, e - 1);
+  diyfp c, w;
+  int len;
+
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  c = cached_power(plus.e, k);
+  w = diyfp_mul(diyfp_normalize(diyfp_make(f, e)), c);
+  plus = diyfp_mul(plus, c);
+  minus = diyfp_mul(minus, c);
+  /* Stay inside the interval, whichever way the products were rounded. */
+  plus.f--;
+  minus.f++;
+  len = digit_gen(w, plus, plus.f - minus.f, digits, k);
+
+  while (len > 1 && digits[len - 1] == '0') {
+    len--;
+    (*k)++;
+  }
+  return len;
+}
+
+/* Lays out digits * 10^k like "%g", with scientific notation if the exponent
+ * is < -4 or >= |sci_limit|. */
+static size_t fmt_digits(const char *digits, int len, int k, int sci_limit,
+                         char *buf) {
+  int x = len - 1 + k;  /* The exponent of the first digit. */
+  char *p = buf;
+
+  if (x < -4 || x >= sci_limit) {
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    *p++ = 'e';
+    *p++ = x < 0 ? '-' : '+';
+    if (x < 0) x = -x;
+    if (x < 10) *p++ = '0';
+    p += upb_fmt_uint64(x, p);
+  } else if (x < 0) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -x - 1);
+    p += -x - 1;
+    memcpy(p, digits, len);
+    p += len;
+  } else if (len <= x + 1) {
+    memcpy(p, digits, len);
+    p += len;
+    memset(p, '0', x + 1 - len);
+    p += x + 1 - len;
+  } else {
+    memcpy(p, digits, x + 1);
+    p += x + 1;
+    *p++ = '.';
+    memcpy(p, digits + x + 1, len - x - 1);
+    p += len - x - 1;
+  }
+
+  return p - buf;
+}
+
+/* Formats sign * sig * 2^exp (with the IEEE |biased| exponent already taken
+ * apart) for a type with |sigbits| significand bits and exponent |bias|. */
+static size_t fmt_ieee(bool neg, uint64_t sig, int biased, int maxbiased,
+                       int sigbits, int bias, int sci_limit, char *buf) {
+  char digits[24];
+  char *p = buf;
+  int len;
+  int k;
+
+  if (biased == maxbiased && sig) {
+    memcpy(buf, "nan", 3);
+    return 3;
+  }
+  if (neg) *p++ = '-';
+  if (biased == maxbiased) {
+    memcpy(p, "inf", 3);
+    return p + 3 - buf;
+  } else if (biased == 0 && sig == 0) {
+    *p = '0';
+    return p + 1 - buf;
+  }
+
+  if (biased == 0) {
+    /* Subnormal. */
+    len = grisu2(sig, 1 - bias - sigbits, sigbits, digits, &k);
+  } else {
+    len = grisu2(sig | (uint64_t)1 << sigbits, biased - bias - sigbits,
+                 sigbits, digits, &k);
+  }
+  return p + fmt_digits(digits, len, k, sci_limit, p) - buf;
+}
+
+size_t upb_fmt_double(double val, char *buf) {
+  uint64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  return fmt_ieee(bits >> 63, bits & (((uint64_t)1 << 52) - 1),
+                  (int)(bits >> 52) & 0x7ff, 0x7ff, 52, 1023, 17, buf);
+}
+
+size_t upb_fmt_float(float val, char *buf) {
+  uint32_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  return fmt_ieee(bits >> 31, bits & ((1UL << 23) - 1),
+                  (int)(bits >> 23) & 0xff, 0xff, 23, 127, 9, buf);
+}
@@ -0,0 +1,38 @@
+/*
+** Internal-only formatting of numbers, shared by the text and JSON printers.
+**
+** Unlike printf() these don't parse a format string, don't depend on the
+** locale, and print floating point values with the fewest digits that read
+** back as the same value.
+*/
+
+#ifndef UPB_PB_NUMFMT_INT_H_
+#define UPB_PB_NUMFMT_INT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Enough for any of the functions below.  No NUL is written. */
+#define UPB_NUMFMT_MAXLEN 32
+
+/* Decimal integers, as "%lld" / "%llu" would print them. */
+size_t upb_fmt_int64(int64_t val, char *buf);
+size_t upb_fmt_uint64(uint64_t val, char *buf);
+
+/* The shortest (with the Grisu2 algorithm: in rare cases one digit longer)
+ * decimal that strtod()/strtof() reads back as exactly |val|, laid out as
+ * "%g" would: in scientific notation like "1.5e-07" if the exponent is less
+ * than -4 or not less than 17 digits (9 for float), otherwise like "0.001" or
+ * "123".  Infinities and NaN are "inf", "-inf" and "nan". */
+size_t upb_fmt_double(double val, char *buf);
+size_t upb_fmt_float(float val, char *buf);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_PB_NUMFMT_INT_H_ */
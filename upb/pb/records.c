@@ -0,0 +1,223 @@
+/*
+** upb_records: reading and writing files of length-delimited records.
+*/
+
+/* For madvise() under -std=c89. */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "upb/encode.h"
+#include "upb/pb/records.h"
+#include "upb/pb/varint.int.h"
+#include "upb/varint_decode.int.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define UPB_RECORDFILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "upb/port_def.inc"
+
+/* upb_recordfile *************************************************************/
+
+struct upb_recordfile {
+  char *data;
+  size_t size;
+};
+
+#ifdef UPB_RECORDFILE_MMAP
+
+upb_recordfile *upb_recordfile_open(const char *path, int hints) {
+  upb_recordfile *f;
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  void *data = NULL;
+
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  /* An empty file can't be mapped, but then there is nothing to map. */
+  if (st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);  /* The mapping keeps the file open. */
+  if (data == MAP_FAILED) return NULL;
+
+  if (data) {
+    if (hints & UPB_RECORDFILE_SEQUENTIAL) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+    if (hints & UPB_RECORDFILE_RANDOM) madvise(data, st.st_size, MADV_RANDOM);
+    if (hints & UPB_RECORDFILE_WILLNEED) {
+      madvise(data, st.st_size, MADV_WILLNEED);
+    }
+  }
+
+  f = upb_gmalloc(sizeof(*f));
+  if (!f) {
+    if (data) munmap(data, st.st_size);
+    return NULL;
+  }
+  f->data = data;
+  f->size = st.st_size;
+  return f;
+}
+
+void upb_recordfile_close(upb_recordfile *f) {
+  if (f->data) munmap(f->data, f->size);
+  upb_gfree(f);
+}
+
+#else
+
+upb_recordfile *upb_recordfile_open(const char *path, int hints) {
+  upb_recordfile *f = NULL;
+  FILE *in = fopen(path, "rb");
+  long size;
+
+  UPB_UNUSED(hints);
+  if (!in) return NULL;
+
+  if (fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 &&
+      fseek(in, 0, SEEK_SET) == 0 && (f = upb_gmalloc(sizeof(*f)))) {
+    f->size = size;
+    f->data = upb_gmalloc(UPB_MAX(f->size, 1));
+    if (!f->data || fread(f->data, 1, f->size, in) != f->size) {
+      upb_gfree(f->data);
+      upb_gfree(f);
+      f = NULL;
+    }
+  }
+
+  fclose(in);
+  return f;
+}
+
+void upb_recordfile_close(upb_recordfile *f) {
+  upb_gfree(f->data);
+  upb_gfree(f);
+}
+
+#endif
+
+const char *upb_recordfile_data(const upb_recordfile *f) {
+  return f->data;
+}
+
+size_t upb_recordfile_size(const upb_recordfile *f) {
+  return f->size;
+}
+
+/* upb_recordreader ***********************************************************/
+
+void upb_recordreader_init(upb_recordreader *r, const char *buf, size_t size) {
+  r->buf = buf;
+  r->ptr = buf;
+  r->end = buf + size;
+  r->ok = true;
+}
+
+bool upb_recordreader_next(upb_recordreader *r, upb_strview *rec) {
+  const char *p;
+  uint64_t len;
+
+  if (!r->ok || r->ptr == r->end) return false;
+
+  p = _upb_vdecode(r->ptr, r->end, &len);
+  if (!p || len > (uint64_t)(r->end - p)) {
+    r->ok = false;
+    return false;
+  }
+
+  rec->data = p;
+  rec->size = len;
+  r->ptr = p + len;
+  return true;
+}
+
+bool upb_recordreader_ok(const upb_recordreader *r) {
+  return r->ok;
+}
+
+size_t upb_recordreader_offset(const upb_recordreader *r) {
+  return r->ptr - r->buf;
+}
+
+bool upb_recordreader_seek(upb_recordreader *r, uint64_t ofs) {
+  if (ofs > (uint64_t)(r->end - r->buf)) return false;
+  r->ptr = r->buf + ofs;
+  r->ok = true;
+  return true;
+}
+
+bool upb_recordreader_decode(upb_recordreader *r, upb_msg *msg,
+                             const upb_msglayout *l, upb_arena *arena) {
+  upb_strview rec;
+  if (!upb_recordreader_next(r, &rec)) return false;
+  if (!upb_decode(rec.data, rec.size, msg, l, arena)) r->ok = false;
+  return r->ok;
+}
+
+bool upb_recordreader_put(upb_recordreader *r, upb_bytessink sink) {
+  upb_strview rec;
+  if (!upb_recordreader_next(r, &rec)) return false;
+  if (!upb_bufsrc_putbuf(rec.data, rec.size, sink)) r->ok = false;
+  return r->ok;
+}
+
+size_t upb_recordindex_count(size_t size) {
+  return size / 8;
+}
+
+uint64_t upb_recordindex_get(const char *index, size_t i) {
+  const unsigned char *p = (const unsigned char*)index + i * 8;
+  uint64_t ofs = 0;
+  int j;
+  for (j = 7; j >= 0; j--) {
+    ofs = ofs << 8 | p[j];
+  }
+  return ofs;
+}
+
+/* upb_recordwriter ***********************************************************/
+
+void upb_recordwriter_init(upb_recordwriter *w, FILE *out, FILE *index) {
+  w->out = out;
+  w->index = index;
+  w->ofs = 0;
+}
+
+bool upb_recordwriter_put(upb_recordwriter *w, const char *data, size_t size) {
+  char len[UPB_PB_VARINT_MAX_LEN];
+  size_t n = upb_vencode64(size, len);
+
+  if (w->index) {
+    unsigned char ofs[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+      ofs[i] = (w->ofs >> (i * 8)) & 0xff;
+    }
+    if (fwrite(ofs, 1, 8, w->index) != 8) return false;
+  }
+
+  if (fwrite(len, 1, n, w->out) != n ||
+      fwrite(data, 1, size, w->out) != size) {
+    return false;
+  }
+
+  w->ofs += n + size;
+  return true;
+}
+
+bool upb_recordwriter_putmsg(upb_recordwriter *w, const void *msg,
+                             const upb_msglayout *l, upb_arena *arena) {
+  size_t size;
+  char *data = upb_encode(msg, l, arena, &size);
+  return data && upb_recordwriter_put(w, data, size);
+}
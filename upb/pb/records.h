@@ -0,0 +1,122 @@
+/*
+** upb_records: files of length-delimited records.
+**
+** Each record is its length as a varint followed by that many bytes, usually
+** an encoded message; this is the framing of protobuf's writeDelimitedTo().
+** The reader works on a buffer, typically a whole file mapped into memory
+** with upb_recordfile, and hands out records that point into it, so they can
+** be decoded with UPB_DECODE_ALIAS or passed to a upb_bytessink without being
+** copied.  The writer appends records to a FILE*.
+**
+** Optionally the writer also writes an index: the offset of every record in
+** the file as a little-endian 64-bit integer, one after the other.  With the
+** index mapped too, the reader can seek to record i directly.
+*/
+
+#ifndef UPB_PB_RECORDS_H_
+#define UPB_PB_RECORDS_H_
+
+#include <stdio.h>
+#include "upb/decode.h"
+#include "upb/sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* upb_recordfile *************************************************************/
+
+/* A file mapped read-only into memory, or where mmap() is not available, read
+ * into a buffer. */
+typedef struct upb_recordfile upb_recordfile;
+
+/* Access pattern hints for upb_recordfile_open(), to be OR'd together.  They
+ * are passed on to madvise() and ignored where it is not available. */
+enum {
+  UPB_RECORDFILE_SEQUENTIAL = 1,  /* Read ahead aggressively. */
+  UPB_RECORDFILE_RANDOM = 2,      /* Seeking with an index: don't. */
+  UPB_RECORDFILE_WILLNEED = 4     /* Start reading the whole file now. */
+};
+
+/* Returns NULL if the file can't be opened or mapped. */
+upb_recordfile *upb_recordfile_open(const char *path, int hints);
+void upb_recordfile_close(upb_recordfile *f);
+
+/* The contents of the file, valid until it is closed. */
+const char *upb_recordfile_data(const upb_recordfile *f);
+size_t upb_recordfile_size(const upb_recordfile *f);
+
+/* upb_recordreader ***********************************************************/
+
+typedef struct {
+  const char *buf;
+  const char *ptr;
+  const char *end;
+  bool ok;
+} upb_recordreader;
+
+/* Reads the records in |buf|, which must outlive the records. */
+void upb_recordreader_init(upb_recordreader *r, const char *buf, size_t size);
+
+/* Sets |rec| to the next record and returns true, or returns false at the end
+ * of the buffer or if the next record is malformed or truncated.  Use
+ * upb_recordreader_ok() to tell these apart. */
+bool upb_recordreader_next(upb_recordreader *r, upb_strview *rec);
+
+/* False once a malformed record has been found. */
+bool upb_recordreader_ok(const upb_recordreader *r);
+
+/* The offset of the next record from the start of the buffer. */
+size_t upb_recordreader_offset(const upb_recordreader *r);
+
+/* Makes the record at |ofs|, eg. from an index, the next one.  Returns false
+ * if |ofs| is past the end of the buffer. */
+bool upb_recordreader_seek(upb_recordreader *r, uint64_t ofs);
+
+/* Decodes the next record into |msg| with UPB_DECODE_ALIAS, so the message
+ * points into the buffer.  Returns false at the end, as for
+ * upb_recordreader_next(), or if the record doesn't decode; in that case the
+ * reader is not ok() either. */
+bool upb_recordreader_decode(upb_recordreader *r, upb_msg *msg,
+                             const upb_msglayout *l, upb_arena *arena);
+
+/* Passes the next record to |sink| with upb_bufsrc_putbuf(), so a sink that
+ * keeps references to its input (like upb_pbdecoder's string handlers with a
+ * upb_bufhandle) points into the buffer.  Returns false at the end or if the
+ * sink fails, which also leaves the reader not ok(). */
+bool upb_recordreader_put(upb_recordreader *r, upb_bytessink sink);
+
+/* An index of record offsets, as written by upb_recordwriter. */
+
+/* The number of records in the index |index| of |size| bytes. */
+size_t upb_recordindex_count(size_t size);
+
+/* The offset of record |i|, for upb_recordreader_seek(). */
+uint64_t upb_recordindex_get(const char *index, size_t i);
+
+/* upb_recordwriter ***********************************************************/
+
+typedef struct {
+  FILE *out;
+  FILE *index;
+  uint64_t ofs;
+} upb_recordwriter;
+
+/* Writes records to |out| and if |index| is not NULL, their offsets to
+ * |index|.  Offsets count from where |out| is when the writer is created, so
+ * it should be at the start of the file for the index to be usable. */
+void upb_recordwriter_init(upb_recordwriter *w, FILE *out, FILE *index);
+
+/* Writes one record.  Returns false if writing fails. */
+bool upb_recordwriter_put(upb_recordwriter *w, const char *data, size_t size);
+
+/* Encodes |msg| with upb_encode() and writes it as one record.  The encoded
+ * message is allocated from |arena|. */
+bool upb_recordwriter_putmsg(upb_recordwriter *w, const void *msg,
+                             const upb_msglayout *l, upb_arena *arena);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_PB_RECORDS_H_ */
@@ -1,124 +1,135 @@
 /*
  * upb::pb::TextPrinter
  *
- * OPT: This is not optimized at all.  It uses printf() which parses the format
- * string every time, and it allocates memory for every put.
+ * Output is collected in a buffer inside the printer and passed to the
+ * bytessink a buffer at a time.  Numbers are formatted with upb_fmt_*(), and
+ * strings are copied in runs between the bytes that need escaping.
  */
 
 #include "upb/pb/textprinter.h"
 
-#include <ctype.h>
-#include <float.h>
-#include <inttypes.h>
-#include <stdarg.h>
-#include <stdio.h>
 #include <string.h>
 
+#include "upb/pb/numfmt.int.h"
 #include "upb/sink.h"
 
 #include "upb/port_def.inc"
 
+#define UPB_TEXTPRINTER_BUFSIZE 4096
+
 struct upb_textprinter {
   upb_sink input_;
   upb_bytessink output_;
   int indent_depth_;
   bool single_line_;
   void *subc;
-};
 
-#define CHECK(x) if ((x) < 0) goto err;
+  /* Output not yet passed to output_ is in [buf, ptr). */
+  char *ptr;
+  char buf[UPB_TEXTPRINTER_BUFSIZE];
+};
 
 static const char *shortname(const char *longname) {
   const char *last = strrchr(longname, '.');
   return last ? last + 1 : longname;
 }
 
-static int indent(upb_textprinter *p) {
-  int i;
-  if (!p->single_line_)
-    for (i = 0; i < p->indent_depth_; i++)
-      upb_bytessink_putbuf(p->output_, p->subc, "  ", 2, NULL);
-  return 0;
-}
 
-static int endfield(upb_textprinter *p) {
-  const char ch = (p->single_line_ ? ' ' : '\n');
-  upb_bytessink_putbuf(p->output_, p->subc, &ch, 1, NULL);
-  return 0;
+/* output buffering ***********************************************************/
+
+static void flush(upb_textprinter *p) {
+  if (p->ptr != p->buf) {
+    upb_bytessink_putbuf(p->output_, p->subc, p->buf, p->ptr - p->buf, NULL);
+    p->ptr = p->buf;
+  }
 }
 
-static int putescaped(upb_textprinter *p, const char *buf, size_t len,
-                      bool preserve_utf8) {
-  /* Based on CEscapeInternal() from Google's protobuf release. */
-  char dstbuf[4096], *dst = dstbuf, *dstend = dstbuf + sizeof(dstbuf);
-  const char *end = buf + len;
+/* Ensures that at least |len| bytes fit at p->ptr; |len| must not be larger
+ * than the buffer. */
+static void reserve(upb_textprinter *p, size_t len) {
+  if ((size_t)(p->buf + UPB_TEXTPRINTER_BUFSIZE - p->ptr) < len) {
+    flush(p);
+  }
+}
 
-  /* I think hex is prettier and more useful, but proto2 uses octal; should
-   * investigate whether it can parse hex also. */
-  const bool use_hex = false;
-  bool last_hex_escape = false; /* true if last output char was \xNN */
+static void put(upb_textprinter *p, const char *data, size_t len) {
+  if ((size_t)(p->buf + UPB_TEXTPRINTER_BUFSIZE - p->ptr) < len) {
+    flush(p);
+    if (len > UPB_TEXTPRINTER_BUFSIZE) {
+      upb_bytessink_putbuf(p->output_, p->subc, data, len, NULL);
+      return;
+    }
+  }
+  memcpy(p->ptr, data, len);
+  p->ptr += len;
+}
 
-  for (; buf < end; buf++) {
-    bool is_hex_escape;
+static void putstr(upb_textprinter *p, const char *str) {
+  put(p, str, strlen(str));
+}
 
-    if (dstend - dst < 4) {
-      upb_bytessink_putbuf(p->output_, p->subc, dstbuf, dst - dstbuf, NULL);
-      dst = dstbuf;
+static void indent(upb_textprinter *p) {
+  int i;
+  if (!p->single_line_) {
+    for (i = 0; i < p->indent_depth_; i++) {
+      reserve(p, 2);
+      *p->ptr++ = ' ';
+      *p->ptr++ = ' ';
     }
+  }
+}
+
+static void endfield(upb_textprinter *p) {
+  reserve(p, 1);
+  *p->ptr++ = p->single_line_ ? ' ' : '\n';
+}
+
+/* Whether |c| has to be escaped inside a string.  Bytes from 0x80 up are left
+ * alone in strings, which hold UTF-8, and escaped in bytes. */
+static bool needs_escape(uint8_t c, bool preserve_utf8) {
+  return c < 0x20 || c == 0x7f || c == '"' || c == '\'' || c == '\\' ||
+         (c >= 0x80 && !preserve_utf8);
+}
+
+static void putescaped(upb_textprinter *p, const char *buf, size_t len,
+                       bool preserve_utf8) {
+  /* Based on CEscapeInternal() from Google's protobuf release.  Like proto2
+   * we escape with octal, never hex, so a digit after an escape needs no
+   * escaping itself. */
+  const char *end = buf + len;
 
-    is_hex_escape = false;
-    switch (*buf) {
-      case '\n': *(dst++) = '\\'; *(dst++) = 'n';  break;
-      case '\r': *(dst++) = '\\'; *(dst++) = 'r';  break;
-      case '\t': *(dst++) = '\\'; *(dst++) = 't';  break;
-      case '\"': *(dst++) = '\\'; *(dst++) = '\"'; break;
-      case '\'': *(dst++) = '\\'; *(dst++) = '\''; break;
-      case '\\': *(dst++) = '\\'; *(dst++) = '\\'; break;
+  while (buf < end) {
+    const char *run = buf;
+    uint8_t c;
+
+    while (buf < end && !needs_escape(*buf, preserve_utf8)) buf++;
+    put(p, run, buf - run);
+    if (buf == end) break;
+
+    c = *buf++;
+    reserve(p, 4);
+    *p->ptr++ = '\\';
+    switch (c) {
+      case '\n': *p->ptr++ = 'n';  break;
+      case '\r': *p->ptr++ = 'r';  break;
+      case '\t': *p->ptr++ = 't';  break;
+      case '"':  *p->ptr++ = '"';  break;
+      case '\'': *p->ptr++ = '\''; break;
+      case '\\': *p->ptr++ = '\\'; break;
       default:
-        /* Note that if we emit \xNN and the buf character after that is a hex
-         * digit then that digit must be escaped too to prevent it being
-         * interpreted as part of the character code by C. */
-        if ((!preserve_utf8 || (uint8_t)*buf < 0x80) &&
-            (!isprint(*buf) || (last_hex_escape && isxdigit(*buf)))) {
-          sprintf(dst, (use_hex ? "\\x%02x" : "\\%03o"), (uint8_t)*buf);
-          is_hex_escape = use_hex;
-          dst += 4;
-        } else {
-          *(dst++) = *buf; break;
-        }
+        *p->ptr++ = '0' + (c >> 6);
+        *p->ptr++ = '0' + ((c >> 3) & 7);
+        *p->ptr++ = '0' + (c & 7);
     }
-    last_hex_escape = is_hex_escape;
   }
-  /* Flush remaining data. */
-  upb_bytessink_putbuf(p->output_, p->subc, dstbuf, dst - dstbuf, NULL);
-  return 0;
 }
 
-bool putf(upb_textprinter *p, const char *fmt, ...) {
-  va_list args;
-  va_list args_copy;
-  char *str;
-  int written;
-  int len;
-  bool ok;
-
-  va_start(args, fmt);
-
-  /* Run once to get the length of the string. */
-  _upb_va_copy(args_copy, args);
-  len = _upb_vsnprintf(NULL, 0, fmt, args_copy);
-  va_end(args_copy);
-
-  /* + 1 for NULL terminator (vsprintf() requires it even if we don't). */
-  str = upb_gmalloc(len + 1);
-  if (!str) return false;
-  written = vsprintf(str, fmt, args);
-  va_end(args);
-  UPB_ASSERT(written == len);
-
-  ok = upb_bytessink_putbuf(p->output_, p->subc, str, len, NULL);
-  upb_gfree(str);
-  return ok;
+/* Puts "name: value". */
+static void putfield(upb_textprinter *p, const upb_fielddef *f,
+                     const char *val, size_t len) {
+  putstr(p, upb_fielddef_name(f));
+  put(p, ": ", 2);
+  put(p, val, len);
 }
 
 
@@ -138,45 +149,40 @@ static bool textprinter_endmsg(void *c, const void *hd, upb_status *s) {
   UPB_UNUSED(hd);
   UPB_UNUSED(s);
   if (p->indent_depth_ == 0) {
+    flush(p);
     upb_bytessink_end(p->output_);
   }
   return true;
 }
 
-#define TYPE(name, ctype, fmt) \
+#define TYPE(name, ctype, fmt_func) \
   static bool textprinter_put ## name(void *closure, const void *handler_data, \
                                       ctype val) {                             \
     upb_textprinter *p = closure;                                              \
     const upb_fielddef *f = handler_data;                                      \
-    CHECK(indent(p));                                                          \
-    putf(p, "%s: " fmt, upb_fielddef_name(f), val);                            \
-    CHECK(endfield(p));                                                        \
+    char buf[UPB_NUMFMT_MAXLEN];                                               \
+    indent(p);                                                                 \
+    putfield(p, f, buf, fmt_func(val, buf));                                   \
+    endfield(p);                                                               \
     return true;                                                               \
-  err:                                                                         \
-    return false;                                                              \
 }
 
 static bool textprinter_putbool(void *closure, const void *handler_data,
                                 bool val) {
   upb_textprinter *p = closure;
   const upb_fielddef *f = handler_data;
-  CHECK(indent(p));
-  putf(p, "%s: %s", upb_fielddef_name(f), val ? "true" : "false");
-  CHECK(endfield(p));
+  indent(p);
+  putfield(p, f, val ? "true" : "false", val ? 4 : 5);
+  endfield(p);
   return true;
-err:
-  return false;
 }
 
-#define STRINGIFY_HELPER(x) #x
-#define STRINGIFY_MACROVAL(x) STRINGIFY_HELPER(x)
-
-TYPE(int32,  int32_t,  "%" PRId32)
-TYPE(int64,  int64_t,  "%" PRId64)
-TYPE(uint32, uint32_t, "%" PRIu32)
-TYPE(uint64, uint64_t, "%" PRIu64)
-TYPE(float,  float,    "%." STRINGIFY_MACROVAL(FLT_DIG) "g")
-TYPE(double, double,   "%." STRINGIFY_MACROVAL(DBL_DIG) "g")
+TYPE(int32,  int32_t,  upb_fmt_int64)
+TYPE(int64,  int64_t,  upb_fmt_int64)
+TYPE(uint32, uint32_t, upb_fmt_uint64)
+TYPE(uint64, uint64_t, upb_fmt_uint64)
+TYPE(float,  float,    upb_fmt_float)
+TYPE(double, double,   upb_fmt_double)
 
 #undef TYPE
 
@@ -189,7 +195,7 @@ static bool textprinter_putenum(void *closure, const void *handler_data,
   const char *label = upb_enumdef_iton(enum_def, val);
   if (label) {
     indent(p);
-    putf(p, "%s: %s", upb_fielddef_name(f), label);
+    putfield(p, f, label, strlen(label));
     endfield(p);
   } else {
     if (!textprinter_putint32(closure, handler_data, val))
@@ -204,14 +210,15 @@ static void *textprinter_startstr(void *closure, const void *handler_data,
   const upb_fielddef *f = handler_data;
   UPB_UNUSED(size_hint);
   indent(p);
-  putf(p, "%s: \"", upb_fielddef_name(f));
+  putstr(p, upb_fielddef_name(f));
+  put(p, ": \"", 3);
   return p;
 }
 
 static bool textprinter_endstr(void *closure, const void *handler_data) {
   upb_textprinter *p = closure;
   UPB_UNUSED(handler_data);
-  putf(p, "\"");
+  put(p, "\"", 1);
   endfield(p);
   return true;
 }
@@ -221,33 +228,28 @@ static size_t textprinter_putstr(void *closure, const void *hd, const char *buf,
   upb_textprinter *p = closure;
   const upb_fielddef *f = hd;
   UPB_UNUSED(handle);
-  CHECK(putescaped(p, buf, len, upb_fielddef_type(f) == UPB_TYPE_STRING));
+  putescaped(p, buf, len, upb_fielddef_type(f) == UPB_TYPE_STRING);
   return len;
-err:
-  return 0;
 }
 
 static void *textprinter_startsubmsg(void *closure, const void *handler_data) {
   upb_textprinter *p = closure;
   const char *name = handler_data;
-  CHECK(indent(p));
-  putf(p, "%s {%c", name, p->single_line_ ? ' ' : '\n');
+  indent(p);
+  putstr(p, name);
+  put(p, p->single_line_ ? " { " : " {\n", 3);
   p->indent_depth_++;
   return p;
-err:
-  return UPB_BREAK;
 }
 
 static bool textprinter_endsubmsg(void *closure, const void *handler_data) {
   upb_textprinter *p = closure;
   UPB_UNUSED(handler_data);
   p->indent_depth_--;
-  CHECK(indent(p));
-  upb_bytessink_putbuf(p->output_, p->subc, "}", 1, NULL);
-  CHECK(endfield(p));
+  indent(p);
+  put(p, "}", 1);
+  endfield(p);
   return true;
-err:
-  return false;
 }
 
 static void onmreg(const void *c, upb_handlers *h) {
@@ -323,6 +325,7 @@ upb_textprinter *upb_textprinter_create(upb_arena *arena, const upb_handlers *h,
   if (!p) return NULL;
 
   p->output_ = output;
+  p->ptr = p->buf;
   upb_sink_reset(&p->input_, h, p);
   textprinter_reset(p, false);
 
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "upb/upb.h"
+#include "upb/varint_decode.int.h"
 
 #include "upb/port_def.inc"
 
@@ -96,13 +97,13 @@ UPB_VARINT_DECODER_CHECK2(branch32, upb_vdecode_max8_branch32)
 UPB_VARINT_DECODER_CHECK2(branch64, upb_vdecode_max8_branch64)
 #undef UPB_VARINT_DECODER_CHECK2
 
-/* Our canonical functions for decoding varints, based on the currently
- * favored best-performing implementations. */
+/* Our canonical function for decoding varints: the kernel shared with
+ * upb_decode (see upb/varint_decode.int.h).  Like the functions above, this
+ * may read up to ten bytes. */
 UPB_INLINE upb_decoderet upb_vdecode_fast(const char *p) {
-  if (sizeof(long) == 8)
-    return upb_vdecode_check2_branch64(p);
-  else
-    return upb_vdecode_check2_branch32(p);
+  upb_decoderet r;
+  r.p = _upb_vdecode(p, p + UPB_PB_VARINT_MAX_LEN, &r.val);
+  return r;
 }
 
 
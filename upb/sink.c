@@ -2,10 +2,16 @@
 #include "upb/sink.h"
 
 bool upb_bufsrc_putbuf(const char *buf, size_t len, upb_bytessink sink) {
+  return upb_bufsrc_putbuf_witharena(buf, len, NULL, sink);
+}
+
+bool upb_bufsrc_putbuf_witharena(const char *buf, size_t len, upb_arena *arena,
+                                 upb_bytessink sink) {
   void *subc;
   bool ret;
   upb_bufhandle handle = UPB_BUFHANDLE_INIT;
   handle.buf = buf;
+  handle.arena = arena;
   ret = upb_bytessink_start(sink, len, &subc);
   if (ret && len != 0) {
     ret = (upb_bytessink_putbuf(sink, subc, buf, len, &handle) >= len);
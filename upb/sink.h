@@ -79,6 +79,18 @@ UPB_INLINE size_t upb_sink_putstring(upb_sink s, upb_selector_t sel,
   return handler(s.closure, hd, buf, n, handle);
 }
 
+UPB_INLINE bool upb_sink_putbulk(upb_sink s, upb_selector_t sel,
+                                 const char *buf, size_t n) {
+  typedef upb_bulk_handlerfunc func;
+  func *handler;
+  const void *hd;
+  if (!s.handlers) return true;
+  handler = (func *)upb_handlers_gethandler(s.handlers, sel, &hd);
+
+  if (!handler) return true;
+  return handler(s.closure, hd, buf, n);
+}
+
 UPB_INLINE bool upb_sink_putunknown(upb_sink s, const char *buf, size_t n) {
   typedef upb_unknown_handlerfunc func;
   func *handler;
@@ -326,6 +338,11 @@ class upb::Sink {
     return upb_sink_putbool(sink_, s, val);
   }
 
+  /* Putting a run of packed fixed-width values, see upb_bulk_handlerfunc. */
+  bool PutBulk(HandlersPtr::Selector s, const char *buf, size_t n) {
+    return upb_sink_putbulk(sink_, s, buf, n);
+  }
+
   /* Putting of string/bytes values.  Each string can consist of zero or more
    * non-contiguous buffers of data.
    *
@@ -465,7 +482,7 @@ class upb::BytesSink {
    * TODO(haberman): once the Handlers know the expected closure type, verify
    * that T matches it. */
   template <class T> BytesSink(const upb_byteshandler* handler, T* closure) {
-    upb_bytessink_reset(sink_, handler, closure);
+    upb_bytessink_reset(&sink_, handler, closure);
   }
 
   /* Resets the value of the sink. */
@@ -500,6 +517,13 @@ extern "C" {
 
 bool upb_bufsrc_putbuf(const char *buf, size_t len, upb_bytessink sink);
 
+/* Like upb_bufsrc_putbuf(), for a buffer allocated from (or otherwise owned
+ * by) |arena|.  The handle passed with the buffer carries the arena, so string
+ * handlers downstream, eg. of upb_pbdecoder, can keep pointers into |buf|
+ * with upb_bufhandle_retain() rather than copying. */
+bool upb_bufsrc_putbuf_witharena(const char *buf, size_t len, upb_arena *arena,
+                                 upb_bytessink sink);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 
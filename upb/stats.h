@@ -0,0 +1,83 @@
+/*
+** upb_stats: counters of what upb does, for monitoring in production.
+**
+** The counters are only kept when upb is compiled with UPB_STATS defined
+** (bazel: --define stats=true, CMake: -DUPB_ENABLE_STATS=ON).  Otherwise they
+** read as zero, and the code that would update them isn't compiled at all.
+**
+** Each thread has its own counters, so updating them needs no
+** synchronization; upb_stats_get() takes a snapshot of the calling thread's.
+*/
+
+#ifndef UPB_STATS_H_
+#define UPB_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  /* upb_decode() and the rest of decode.h. */
+  uint64_t decode_bytes;           /* Input bytes. */
+  uint64_t decode_fast_dispatches; /* Tags looked up in a fast table. */
+  uint64_t decode_next_fields;     /* Fields that followed the previous one. */
+  uint64_t decode_dense_fields;    /* Fields found by index. */
+  uint64_t decode_search_fields;   /* Fields found by binary search. */
+  uint64_t decode_unknown_fields;
+  uint64_t decode_unknown_bytes;   /* Including their tags. */
+
+  /* upb_encode() and the rest of encode.h. */
+  uint64_t encode_bytes;           /* Output bytes. */
+  uint64_t encode_buffer_grows;    /* Of the backward encoder's buffer. */
+
+  /* upb_arena. */
+  uint64_t arena_blocks;           /* Blocks from the block allocator. */
+  uint64_t arena_block_bytes;      /* Their total size. */
+  uint64_t arena_blocks_reused;    /* Blocks kept by upb_arena_reset(). */
+
+  /* upb_pbdecoder. */
+  uint64_t pbdecoder_bytes;        /* Input bytes. */
+  uint64_t pbdecoder_resumes;      /* Buffers passed in. */
+  uint64_t pbdecoder_suspends;     /* Values split between two buffers. */
+} upb_stats;
+
+/* Returns true if upb was compiled with UPB_STATS. */
+bool upb_stats_enabled(void);
+
+/* Copies the calling thread's counters to |stats|. */
+void upb_stats_get(upb_stats *stats);
+
+/* Sets the calling thread's counters to zero. */
+void upb_stats_reset(void);
+
+/* Updating the counters, internal to upb. */
+#ifdef UPB_STATS
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _UPB_STATS_TLS __thread
+#elif defined(_MSC_VER)
+#define _UPB_STATS_TLS __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define _UPB_STATS_TLS _Thread_local
+#else
+#error "UPB_STATS needs thread-local storage."
+#endif
+
+extern _UPB_STATS_TLS upb_stats _upb_stats;
+
+#define _UPB_STATS_ADD(name, n) (_upb_stats.name += (n))
+
+#else
+
+#define _UPB_STATS_ADD(name, n) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* UPB_STATS_H_ */
@@ -1,12 +1,16 @@
 /*
 ** upb_table Implementation
 **
-** Implementation is heavily inspired by Lua's ltable.c.
+** The inttable is heavily inspired by Lua's ltable.c; the strtable by
+** Abseil's SwissTable.
 */
 
 #include "upb/table.int.h"
 
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "upb/port_def.inc"
 
@@ -60,22 +64,11 @@ char *upb_strdup2(const char *s, size_t len, upb_alloc *a) {
   return p;
 }
 
-/* A type to represent the lookup key of either a strtable or an inttable. */
+/* A type to represent the lookup key of an inttable. */
 typedef union {
   uintptr_t num;
-  struct {
-    const char *str;
-    size_t len;
-  } str;
 } lookupkey_t;
 
-static lookupkey_t strkey2(const char *str, size_t len) {
-  lookupkey_t k;
-  k.str.str = str;
-  k.str.len = len;
-  return k;
-}
-
 static lookupkey_t intkey(uintptr_t key) {
   lookupkey_t k;
   k.num = key;
@@ -154,19 +147,6 @@ static upb_tabent *findentry_mutable(upb_table *t, lookupkey_t key,
   return (upb_tabent*)findentry(t, key, hash, eql);
 }
 
-static bool lookup(const upb_table *t, lookupkey_t key, upb_value *v,
-                   uint32_t hash, eqlfunc_t *eql) {
-  const upb_tabent *e = findentry(t, key, hash, eql);
-  if (e) {
-    if (v) {
-      _upb_value_setval(v, e->val.val, t->ctype);
-    }
-    return true;
-  } else {
-    return false;
-  }
-}
-
 /* The given key must not already exist in the table. */
 static void insert(upb_table *t, lookupkey_t key, upb_tabkey tabkey,
                    upb_value val, uint32_t hash,
@@ -269,124 +249,359 @@ static size_t begin(const upb_table *t) {
 
 /* upb_strtable ***************************************************************/
 
-/* A simple "subclass" of upb_table that only adds a hash function for strings. */
+/* An open-addressing table in the style of SwissTable.  Next to the entries is
+ * an array of control bytes, one per slot, holding either a marker for an
+ * empty or deleted slot or the low 7 bits of the hash of the slot's key.  The
+ * entries keep the whole hash too, so resizes don't rehash any keys and most
+ * mismatched keys are rejected without reading them.  A
+ * lookup starts at the slot picked by the rest of the hash and compares a
+ * group of 16 control bytes at once against the key's 7 bits -- a single
+ * vector compare where SSE2 is available -- so that it only has to compare
+ * key strings that are very likely to match.  A group containing an empty
+ * slot ends the probe. */
+
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+#define GROUP_SIZE 16
+
+static bool ctrl_isfull(uint8_t c) { return (c & 0x80) == 0; }
+
+static size_t strtable_size(const upb_strtable *t) {
+  return (size_t)1 << t->size_lg2;
+}
+
+/* The number of entries a table of |size| slots can hold: 7/8 of its slots,
+ * but always leaving at least one empty. */
+static size_t strtable_maxcount(size_t size) {
+  return size - UPB_MAX(size / 8, 1);
+}
+
+/* A table with fewer slots than a group only uses the first ones of what it
+ * loads; the rest are mirrored control bytes or padding. */
+static uint32_t group_valid(const upb_strtable *t) {
+  size_t size = strtable_size(t);
+  return size < GROUP_SIZE ? ((uint32_t)1 << size) - 1 : 0xffff;
+}
+
+/* Returns a bitmask of the control bytes in |g| that equal |c|. */
+static uint32_t group_match(const uint8_t *g, uint8_t c) {
+#ifdef __SSE2__
+  __m128i v = _mm_loadu_si128((const __m128i*)g);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+#else
+  uint32_t ret = 0;
+  int i;
+  for (i = 0; i < GROUP_SIZE; i++) ret |= (uint32_t)(g[i] == c) << i;
+  return ret;
+#endif
+}
+
+/* Returns a bitmask of the empty or deleted slots in |g|: those whose control
+ * byte has its high bit set. */
+static uint32_t group_matchfree(const uint8_t *g) {
+#ifdef __SSE2__
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+#else
+  uint32_t ret = 0;
+  int i;
+  for (i = 0; i < GROUP_SIZE; i++) ret |= (uint32_t)(g[i] >> 7) << i;
+  return ret;
+#endif
+}
+
+static int lowbit(uint32_t bits) {
+#ifdef __GNUC__
+  return __builtin_ctz(bits);
+#else
+  int ret = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    ret++;
+  }
+  return ret;
+#endif
+}
+
+static void setctrl(upb_strtable *t, size_t i, uint8_t c) {
+  t->ctrl[i] = c;
+  if (i < GROUP_SIZE - 1) t->ctrl[strtable_size(t) + i] = c;
+}
+
+/* Group probing is triangular: the nth group starts n(n+1)/2 groups after the
+ * first, which visits every slot of a power-of-two sized table. */
+#define FOR_EACH_GROUP(t, hash, pos)                                   \
+  for (pos = (hash >> 7) & t->mask, probed = 0;                        \
+       probed < strtable_size(t);                                      \
+       probed += GROUP_SIZE, pos = (pos + probed) & t->mask)
+
+static size_t strtable_find(const upb_strtable *t, const char *key, size_t len,
+                            uint64_t hash) {
+  uint32_t valid = group_valid(t);
+  size_t pos;
+  size_t probed;
+
+  FOR_EACH_GROUP(t, hash, pos) {
+    const uint8_t *g = t->ctrl + pos;
+    uint32_t bits = group_match(g, hash & 0x7f) & valid;
+    while (bits) {
+      size_t i = (pos + lowbit(bits)) & t->mask;
+      const upb_strtabent *e = &t->entries[i];
+      if (e->hash == hash) {
+        uint32_t keylen;
+        const char *str = upb_tabstr(e->key, &keylen);
+        if (keylen == len && memcmp(str, key, len) == 0) return i;
+      }
+      bits &= bits - 1;
+    }
+    if (group_match(g, CTRL_EMPTY) & valid) break;
+  }
+
+  return SIZE_MAX;
+}
+
+/* Returns the first empty or deleted slot along |hash|'s probe sequence. */
+static size_t strtable_findfree(const upb_strtable *t, uint64_t hash) {
+  uint32_t valid = group_valid(t);
+  size_t pos;
+  size_t probed;
+
+  FOR_EACH_GROUP(t, hash, pos) {
+    uint32_t bits = group_matchfree(t->ctrl + pos) & valid;
+    if (bits) return (pos + lowbit(bits)) & t->mask;
+  }
+
+  UPB_UNREACHABLE();  /* The table always keeps an empty slot. */
+}
 
-static upb_tabkey strcopy(lookupkey_t k2, upb_alloc *a) {
-  uint32_t len = (uint32_t) k2.str.len;
-  char *str = upb_malloc(a, k2.str.len + sizeof(uint32_t) + 1);
+#undef FOR_EACH_GROUP
+
+static void strtable_place(upb_strtable *t, upb_tabkey key, uint64_t val,
+                           uint64_t hash) {
+  size_t i = strtable_findfree(t, hash);
+  if (t->ctrl[i] == CTRL_EMPTY) t->growth_left--;
+  setctrl(t, i, hash & 0x7f);
+  t->entries[i].key = key;
+  t->entries[i].val.val = val;
+  t->entries[i].hash = hash;
+  t->count++;
+}
+
+static upb_tabkey strcopy(const char *k, size_t len, upb_alloc *a) {
+  uint32_t len32 = (uint32_t)len;
+  char *str = upb_malloc(a, len + sizeof(uint32_t) + 1);
   if (str == NULL) return 0;
-  memcpy(str, &len, sizeof(uint32_t));
-  memcpy(str + sizeof(uint32_t), k2.str.str, k2.str.len);
-  str[sizeof(uint32_t) + k2.str.len] = '\0';
+  memcpy(str, &len32, sizeof(uint32_t));
+  memcpy(str + sizeof(uint32_t), k, len);
+  str[sizeof(uint32_t) + len] = '\0';
   return (uintptr_t)str;
 }
 
-static uint32_t strhash(upb_tabkey key) {
-  uint32_t len;
-  char *str = upb_tabstr(key, &len);
-  return upb_murmur_hash2(str, len, 0);
+/* Allocates the table's block with |extra| bytes at its end, which start at
+ * strtable_extra(t). */
+static bool strinit(upb_strtable *t, upb_ctype_t ctype, uint8_t size_lg2,
+                    size_t extra, upb_alloc *a) {
+  size_t size = (size_t)1 << size_lg2;
+  size_t entbytes = size * sizeof(upb_strtabent);
+  /* Entries and control bytes share one block, the control bytes last. */
+  char *mem = upb_malloc(a, entbytes + size + GROUP_SIZE + extra);
+  if (!mem) return false;
+
+  t->count = 0;
+  t->mask = size - 1;
+  t->growth_left = strtable_maxcount(size);
+  t->ctype = ctype;
+  t->size_lg2 = size_lg2;
+  t->entries = (upb_strtabent*)mem;
+  t->ctrl = (uint8_t*)mem + entbytes;
+#ifndef NDEBUG
+  t->alloc = a;
+#endif
+  memset(t->ctrl, CTRL_EMPTY, size + GROUP_SIZE);
+  return true;
 }
 
-static bool streql(upb_tabkey k1, lookupkey_t k2) {
-  uint32_t len;
-  char *str = upb_tabstr(k1, &len);
-  return len == k2.str.len && memcmp(str, k2.str.str, len) == 0;
+static char *strtable_extra(upb_strtable *t) {
+  return (char*)t->ctrl + strtable_size(t) + GROUP_SIZE;
 }
 
 bool upb_strtable_init2(upb_strtable *t, upb_ctype_t ctype, upb_alloc *a) {
-  return init(&t->t, ctype, 2, a);
+  return strinit(t, ctype, 2, 0, a);
 }
 
 void upb_strtable_uninit2(upb_strtable *t, upb_alloc *a) {
   size_t i;
-  for (i = 0; i < upb_table_size(&t->t); i++)
-    upb_free(a, (void*)t->t.entries[i].key);
-  uninit(&t->t, a);
+  UPB_ASSERT_DEBUGVAR(t->alloc == a);
+  for (i = 0; i < strtable_size(t); i++) {
+    if (ctrl_isfull(t->ctrl[i])) upb_free(a, (void*)t->entries[i].key);
+  }
+  upb_free(a, t->entries);
 }
 
 bool upb_strtable_resize(upb_strtable *t, size_t size_lg2, upb_alloc *a) {
   upb_strtable new_table;
-  upb_strtable_iter i;
+  size_t i;
 
-  upb_check_alloc(&t->t, a);
+  UPB_ASSERT_DEBUGVAR(t->alloc == a);
+  UPB_ASSERT(strtable_maxcount((size_t)1 << size_lg2) >= t->count);
 
-  if (!init(&new_table.t, t->t.ctype, size_lg2, a))
-    return false;
-  upb_strtable_begin(&i, t);
-  for ( ; !upb_strtable_done(&i); upb_strtable_next(&i)) {
-    upb_strtable_insert3(
-        &new_table,
-        upb_strtable_iter_key(&i),
-        upb_strtable_iter_keylength(&i),
-        upb_strtable_iter_value(&i),
-        a);
+  if (!strinit(&new_table, t->ctype, size_lg2, 0, a)) return false;
+
+  /* The new table takes over the old one's keys. */
+  for (i = 0; i < strtable_size(t); i++) {
+    const upb_strtabent *e = &t->entries[i];
+    if (!ctrl_isfull(t->ctrl[i])) continue;
+    strtable_place(&new_table, e->key, e->val.val, e->hash);
   }
-  upb_strtable_uninit2(t, a);
+
+  upb_free(a, t->entries);
   *t = new_table;
   return true;
 }
 
 bool upb_strtable_insert3(upb_strtable *t, const char *k, size_t len,
                           upb_value v, upb_alloc *a) {
-  lookupkey_t key;
   upb_tabkey tabkey;
-  uint32_t hash;
-
-  upb_check_alloc(&t->t, a);
+  uint64_t hash;
 
-  if (isfull(&t->t)) {
-    /* Need to resize.  New table of double the size, add old elements to it. */
-    if (!upb_strtable_resize(t, t->t.size_lg2 + 1, a)) {
-      return false;
-    }
+  UPB_ASSERT_DEBUGVAR(t->alloc == a);
+  UPB_ASSERT_DEBUGVAR(v.ctype == t->ctype);
+  UPB_ASSERT(!upb_strtable_lookup2(t, k, len, NULL));
+
+  if (t->growth_left == 0) {
+    /* Out of empty slots.  If deleted ones make up much of the table, rehash
+     * at the same size to reclaim them; otherwise double the size. */
+    size_t size_lg2 = t->size_lg2;
+    if (t->count >= strtable_maxcount(strtable_size(t)) / 2) size_lg2++;
+    if (!upb_strtable_resize(t, size_lg2, a)) return false;
   }
 
-  key = strkey2(k, len);
-  tabkey = strcopy(key, a);
+  tabkey = strcopy(k, len, a);
   if (tabkey == 0) return false;
 
-  hash = upb_murmur_hash2(key.str.str, key.str.len, 0);
-  insert(&t->t, key, tabkey, v, hash, &strhash, &streql);
+  hash = upb_strhash(k, len);
+  strtable_place(t, tabkey, v.val, hash);
   return true;
 }
 
 bool upb_strtable_lookup2(const upb_strtable *t, const char *key, size_t len,
                           upb_value *v) {
-  uint32_t hash = upb_murmur_hash2(key, len, 0);
-  return lookup(&t->t, strkey2(key, len), v, hash, &streql);
+  return upb_strtable_lookup_hashed(t, key, len, upb_strhash(key, len), v);
+}
+
+bool upb_strtable_lookup_hashed(const upb_strtable *t, const char *key,
+                                size_t len, uint64_t hash, upb_value *v) {
+  size_t i = strtable_find(t, key, len, hash);
+  if (i == SIZE_MAX) return false;
+  if (v) _upb_value_setval(v, t->entries[i].val.val, t->ctype);
+  return true;
 }
 
 bool upb_strtable_remove3(upb_strtable *t, const char *key, size_t len,
                          upb_value *val, upb_alloc *alloc) {
-  uint32_t hash = upb_murmur_hash2(key, len, 0);
-  upb_tabkey tabkey;
-  if (rm(&t->t, strkey2(key, len), val, &tabkey, hash, &streql)) {
-    upb_free(alloc, (void*)tabkey);
-    return true;
+  size_t i = strtable_find(t, key, len, upb_strhash(key, len));
+
+  if (i == SIZE_MAX) return false;
+  if (val) _upb_value_setval(val, t->entries[i].val.val, t->ctype);
+  upb_free(alloc, (void*)t->entries[i].key);
+  t->count--;
+
+  if (strtable_size(t) <= GROUP_SIZE) {
+    /* Every probe sees the whole table in its first group, so no probe relies
+     * on this slot being full to go on to the next one. */
+    setctrl(t, i, CTRL_EMPTY);
+    t->growth_left++;
   } else {
-    return false;
+    setctrl(t, i, CTRL_DELETED);
+  }
+
+  return true;
+}
+
+bool upb_strtable_freeze(upb_strtable *t, upb_alloc *from, upb_alloc *to) {
+  upb_strtable new_table;
+  uint8_t size_lg2 = 0;
+  size_t keybytes = 0;
+  char *keys;
+  size_t i;
+
+  UPB_ASSERT_DEBUGVAR(t->alloc == from);
+
+  while (strtable_maxcount((size_t)1 << size_lg2) < t->count) size_lg2++;
+  for (i = 0; i < strtable_size(t); i++) {
+    uint32_t len;
+    if (!ctrl_isfull(t->ctrl[i])) continue;
+    upb_tabstr(t->entries[i].key, &len);
+    keybytes += sizeof(uint32_t) + len + 1;
+  }
+
+  if (!strinit(&new_table, t->ctype, size_lg2, keybytes, to)) return false;
+
+  /* Copy the keys, in the length-prefixed form strcopy() makes, to the end of
+   * the block, in the order of their old slots. */
+  keys = strtable_extra(&new_table);
+  for (i = 0; i < strtable_size(t); i++) {
+    const upb_strtabent *e = &t->entries[i];
+    uint32_t len;
+    size_t n;
+    if (!ctrl_isfull(t->ctrl[i])) continue;
+    upb_tabstr(e->key, &len);
+    n = sizeof(uint32_t) + len + 1;
+    memcpy(keys, (const char*)e->key, n);
+    upb_free(from, (void*)e->key);
+    strtable_place(&new_table, (uintptr_t)keys, e->val.val, e->hash);
+    keys += n;
   }
+
+  upb_free(from, t->entries);
+#ifndef NDEBUG
+  new_table.alloc = NULL;
+#endif
+  *t = new_table;
+  return true;
 }
 
 /* Iteration */
 
-static const upb_tabent *str_tabent(const upb_strtable_iter *i) {
-  return &i->t->t.entries[i->index];
+static const upb_strtabent *str_tabent(const upb_strtable_iter *i) {
+  return &i->t->entries[i->index];
 }
 
 void upb_strtable_begin(upb_strtable_iter *i, const upb_strtable *t) {
   i->t = t;
-  i->index = begin(&t->t);
+  i->index = SIZE_MAX;
+  upb_strtable_next(i);
 }
 
 void upb_strtable_next(upb_strtable_iter *i) {
-  i->index = next(&i->t->t, i->index);
+  const upb_strtable *t = i->t;
+  while (++i->index < strtable_size(t)) {
+    if (ctrl_isfull(t->ctrl[i->index])) return;
+  }
+  i->index = SIZE_MAX;
+}
+
+/* Returns the last full slot before |i|, or SIZE_MAX if there is none. */
+static size_t strtable_prevfull(const upb_strtable *t, size_t i) {
+  while (i-- > 0) {
+    if (ctrl_isfull(t->ctrl[i])) return i;
+  }
+  return SIZE_MAX;
+}
+
+void upb_strtable_rbegin(upb_strtable_iter *i, const upb_strtable *t) {
+  i->t = t;
+  i->index = strtable_prevfull(t, strtable_size(t));
+}
+
+void upb_strtable_prev(upb_strtable_iter *i) {
+  i->index = i->index < strtable_size(i->t) ?
+      strtable_prevfull(i->t, i->index) : SIZE_MAX;
 }
 
 bool upb_strtable_done(const upb_strtable_iter *i) {
   if (!i->t) return true;
-  return i->index >= upb_table_size(&i->t->t) ||
-         upb_tabent_isempty(str_tabent(i));
+  return i->index >= strtable_size(i->t) ||
+         !ctrl_isfull(i->t->ctrl[i->index]);
 }
 
 const char *upb_strtable_iter_key(const upb_strtable_iter *i) {
@@ -403,7 +618,7 @@ size_t upb_strtable_iter_keylength(const upb_strtable_iter *i) {
 
 upb_value upb_strtable_iter_value(const upb_strtable_iter *i) {
   UPB_ASSERT(!upb_strtable_done(i));
-  return _upb_value_val(str_tabent(i)->val.val, i->t->t.ctype);
+  return _upb_value_val(str_tabent(i)->val.val, i->t->ctype);
 }
 
 void upb_strtable_iter_setdone(upb_strtable_iter *i) {
@@ -662,6 +877,35 @@ void upb_inttable_compact2(upb_inttable *t, upb_alloc *a) {
   *t = new_t;
 }
 
+bool upb_inttable_freeze(upb_inttable *t, upb_alloc *from, upb_alloc *to) {
+  size_t entbytes = upb_table_size(&t->t) * sizeof(upb_tabent);
+  size_t arrbytes = t->array_size * sizeof(upb_tabval);
+  upb_tabent *entries;
+  size_t i;
+
+  upb_check_alloc(&t->t, from);
+
+  /* The hash part first, then the array part. */
+  entries = upb_malloc(to, entbytes + arrbytes);
+  if (!entries) return false;
+  if (entbytes > 0) memcpy(entries, t->t.entries, entbytes);
+  memcpy((char*)entries + entbytes, t->array, arrbytes);
+
+  for (i = 0; i < upb_table_size(&t->t); i++) {
+    if (entries[i].next) {
+      entries[i].next = entries + (entries[i].next - t->t.entries);
+    }
+  }
+
+  upb_inttable_uninit2(t, from);
+  t->t.entries = entbytes > 0 ? entries : NULL;
+  t->array = (const upb_tabval*)((char*)entries + entbytes);
+#ifndef NDEBUG
+  t->t.alloc = NULL;
+#endif
+  return true;
+}
+
 /* Iteration. */
 
 static const upb_tabent *int_tabent(const upb_inttable_iter *i) {
@@ -733,6 +977,100 @@ bool upb_inttable_iter_isequal(const upb_inttable_iter *i1,
          i1->array_part == i2->array_part;
 }
 
+/* -----------------------------------------------------------------------------
+ * wyhash (version 4), by Wang Yi (released into the public domain).
+ * Reformatted for C89.  Like MurmurHash2 below, it gives different results on
+ * little-endian and big-endian machines. */
+
+static const uint64_t wyp0 = 0xa0761d6478bd642fULL;
+static const uint64_t wyp1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t wyp2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t wyp3 = 0x589965cc75374cc3ULL;
+
+/* Sets a and b to the low and high halves of their 128-bit product. */
+static void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 uint128;
+  uint128 r = (uint128)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t lo = t + (rm1 << 32);
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+#endif
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+  wymum(&a, &b);
+  return a ^ b;
+}
+
+static uint64_t wyr8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static uint64_t wyr4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+/* Reads 1-3 bytes. */
+static uint64_t wyr3(const uint8_t *p, size_t k) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t upb_strhash(const void *key, size_t len) {
+  const uint8_t *p = (const uint8_t*)key;
+  uint64_t seed = wymix(wyp0, wyp1);
+  uint64_t a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t mid = (len >> 3) << 2;
+      a = (wyr4(p) << 32) | wyr4(p + mid);
+      b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = wyr3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wymix(wyr8(p) ^ wyp1, wyr8(p + 8) ^ seed);
+        see1 = wymix(wyr8(p + 16) ^ wyp2, wyr8(p + 24) ^ see1);
+        see2 = wymix(wyr8(p + 32) ^ wyp3, wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wymix(wyr8(p) ^ wyp1, wyr8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = wyr8(p + i - 16);
+    b = wyr8(p + i - 8);
+  }
+
+  a ^= wyp1;
+  b ^= seed;
+  wymum(&a, &b);
+  return wymix(a ^ wyp0 ^ len, b ^ wyp1);
+}
+
 #if defined(UPB_UNALIGNED_READS_OK) || defined(__s390x__)
 /* -----------------------------------------------------------------------------
  * MurmurHash2, by Austin Appleby (released as public domain).
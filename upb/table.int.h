@@ -5,9 +5,10 @@
 ** This file defines very fast int->upb_value (inttable) and string->upb_value
 ** (strtable) hash tables.
 **
-** The table uses chained scatter with Brent's variation (inspired by the Lua
-** implementation of hash tables).  The hash function for strings is Austin
-** Appleby's "MurmurHash."
+** The inttable uses chained scatter with Brent's variation (inspired by the Lua
+** implementation of hash tables).  The strtable uses open addressing with a
+** byte of metadata per slot, probed 16 slots at a time (inspired by Abseil's
+** SwissTable).  The hash function for strings is Wang Yi's "wyhash."
 **
 ** The inttable uses uintptr_t as its key, which guarantees it can be used to
 ** store pointers or integers of at least 32 bits (upb isn't really useful on
@@ -213,10 +214,35 @@ typedef struct {
 #endif
 } upb_table;
 
+/* upb_strtable ***************************************************************/
+
+typedef struct {
+  upb_tabkey key;
+  upb_tabval val;
+  uint64_t hash;         /* upb_strhash() of the key. */
+} upb_strtabent;
+
 typedef struct {
-  upb_table t;
+  size_t count;          /* Number of entries. */
+  size_t mask;           /* Number of slots - 1. */
+  size_t growth_left;    /* Empty slots left to fill before a rehash. */
+  upb_ctype_t ctype;     /* Type of all values. */
+  uint8_t size_lg2;      /* The table has 2^size_lg2 slots. */
+
+  /* One control byte per slot, marking it empty or deleted, or holding the low
+   * 7 bits of the hash of its key.  These are followed by copies of the first
+   * 15, so that 16 bytes can be loaded starting at any slot.  The control
+   * bytes live in the same allocation as the entries, just past them. */
+  uint8_t *ctrl;
+  upb_strtabent *entries;
+
+#ifndef NDEBUG
+  upb_alloc *alloc;      /* See upb_table.alloc. */
+#endif
 } upb_strtable;
 
+/* upb_inttable ***************************************************************/
+
 typedef struct {
   upb_table t;              /* For entries that don't fit in the array part. */
   const upb_tabval *array;  /* Array part of the table. See const note above. */
@@ -247,6 +273,10 @@ UPB_INLINE bool upb_tabent_isempty(const upb_tabent *e) {
 /* Used by some of the unit tests for generic hashing functionality. */
 uint32_t upb_murmur_hash2(const void * key, size_t len, uint32_t seed);
 
+/* The hash upb_strtable uses for its keys.  Callers that look one string up in
+ * several tables can compute it once and use upb_strtable_lookup_hashed(). */
+uint64_t upb_strhash(const void *key, size_t len);
+
 UPB_INLINE uintptr_t upb_intkey(uintptr_t key) {
   return key;
 }
@@ -289,15 +319,19 @@ UPB_INLINE void upb_strtable_uninit(upb_strtable *table) {
 /* Returns the number of values in the table. */
 size_t upb_inttable_count(const upb_inttable *t);
 UPB_INLINE size_t upb_strtable_count(const upb_strtable *t) {
-  return t->t.count;
+  return t->count;
 }
 
-void upb_inttable_packedsize(const upb_inttable *t, size_t *size);
-void upb_strtable_packedsize(const upb_strtable *t, size_t *size);
-upb_inttable *upb_inttable_pack(const upb_inttable *t, void *p, size_t *ofs,
-                                size_t size);
-upb_strtable *upb_strtable_pack(const upb_strtable *t, void *p, size_t *ofs,
-                                size_t size);
+/* Repacks a table that is finished being built into a single block from |to|.
+ * A strtable is also shrunk to fit its entries, and its keys move into the
+ * block.  The table's old storage is returned to |from|, the allocator it was
+ * built with.
+ *
+ * A frozen table may still be looked up and iterated, but not modified or
+ * uninitialized: it is meant to live as long as |to|, typically an arena.  If
+ * allocation fails, false is returned and the table is unchanged. */
+bool upb_inttable_freeze(upb_inttable *t, upb_alloc *from, upb_alloc *to);
+bool upb_strtable_freeze(upb_strtable *t, upb_alloc *from, upb_alloc *to);
 
 /* Inserts the given key into the hashtable with the given value.  The key must
  * not already exist in the hash table.  For string tables, the key must be
@@ -333,6 +367,11 @@ bool upb_inttable_lookup(const upb_inttable *t, uintptr_t key, upb_value *v);
 bool upb_strtable_lookup2(const upb_strtable *t, const char *key, size_t len,
                           upb_value *v);
 
+/* Like upb_strtable_lookup2(), but takes upb_strhash(key, len) instead of
+ * computing it. */
+bool upb_strtable_lookup_hashed(const upb_strtable *t, const char *key,
+                                size_t len, uint64_t hash, upb_value *v);
+
 /* For NULL-terminated strings. */
 UPB_INLINE bool upb_strtable_lookup(const upb_strtable *t, const char *key,
                                     upb_value *v) {
@@ -470,6 +509,12 @@ void upb_strtable_iter_setdone(upb_strtable_iter *i);
 bool upb_strtable_iter_isequal(const upb_strtable_iter *i1,
                                const upb_strtable_iter *i2);
 
+/* Iterates in the opposite order: upb_strtable_rbegin() starts at the entry
+ * upb_strtable_begin() would finish at, and upb_strtable_prev() moves back
+ * through the ones before it. */
+void upb_strtable_rbegin(upb_strtable_iter *i, const upb_strtable *t);
+void upb_strtable_prev(upb_strtable_iter *i);
+
 
 /* upb_inttable_iter **********************************************************/
 
@@ -9,6 +9,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "upb/stats.h"
+
 #include "upb/port_def.inc"
 
 /* Guarantee null-termination and provide ellipsis truncation.
@@ -73,37 +75,52 @@ upb_alloc upb_alloc_global = {&upb_global_allocfunc};
 
 /* upb_arena ******************************************************************/
 
-/* Be conservative and choose 16 in case anyone is using SSE. */
-static const size_t maxalign = 16;
-
 static size_t align_up_max(size_t size) {
-  return ((size + maxalign - 1) / maxalign) * maxalign;
+  return UPB_ALIGN_MALLOC(size);
 }
 
 struct upb_arena {
-  /* We implement the allocator interface.
-   * This must be the first member of upb_arena! */
-  upb_alloc alloc;
+  /* We implement the allocator interface, and expose the free space in our
+   * current block for inline allocation.  This must be the first member of
+   * upb_arena! */
+  _upb_arena_head head;
 
   /* Allocator to allocate arena blocks.  We are responsible for freeing these
    * when we are destroyed. */
   upb_alloc *block_alloc;
 
+  /* Bytes used in all blocks except the current one. */
   size_t bytes_allocated;
   size_t next_block_size;
   size_t max_block_size;
+  unsigned growth_factor;
+
+  /* Blocks kept by upb_arena_reset() for reuse, and a bound on their total
+   * size. */
+  void *retained_head;
+  size_t max_retained_size;
 
   /* Linked list of blocks.  Points to an arena_block, defined in env.c */
   void *block_head;
 
   /* Cleanup entries.  Pointer to a cleanup_ent, defined in env.c */
   void *cleanup_head;
+
+  /* Fused arenas form a union-find forest; parent == this for a root.  Only
+   * the root's members below are meaningful: how many arenas of the group
+   * haven't been freed yet, whether any of them uses memory supplied by the
+   * caller, and the list of all arenas in the group (linked through
+   * |group_next|), which the last upb_arena_free() releases together. */
+  struct upb_arena *parent;
+  uint32_t refcount;
+  bool has_initial_block;
+  struct upb_arena *group_next;
+  struct upb_arena *group_tail;
 };
 
 typedef struct mem_block {
   struct mem_block *next;
   size_t size;
-  size_t used;
   bool owned;
   /* Data follows. */
 } mem_block;
@@ -114,67 +131,113 @@ typedef struct cleanup_ent {
   void *ud;
 } cleanup_ent;
 
+static char *upb_arena_blockstart(mem_block *block) {
+  return (char*)block + align_up_max(sizeof(mem_block));
+}
+
 static void upb_arena_addblock(upb_arena *a, void *ptr, size_t size,
                                bool owned) {
   mem_block *block = ptr;
 
+  if (a->block_head) {
+    a->bytes_allocated +=
+        a->head.ptr - upb_arena_blockstart(a->block_head);
+  }
+
   block->next = a->block_head;
   block->size = size;
-  block->used = align_up_max(sizeof(mem_block));
   block->owned = owned;
 
   a->block_head = block;
+  a->head.ptr = upb_arena_blockstart(block);
+  a->head.end = (char*)block + size;
 
   /* TODO(haberman): ASAN poison. */
 }
 
 static mem_block *upb_arena_allocblock(upb_arena *a, size_t size) {
-  size_t block_size = UPB_MAX(size, a->next_block_size) + sizeof(mem_block);
-  mem_block *block = upb_malloc(a->block_alloc, block_size);
+  size_t block_size = UPB_MAX(size, a->next_block_size) +
+                      align_up_max(sizeof(mem_block));
+  mem_block **link = (mem_block**)&a->retained_head;
+  mem_block *block;
+
+  /* Reuse a block retained by upb_arena_reset() if one is big enough. */
+  for (; *link; link = &(*link)->next) {
+    block = *link;
+    if (block->size - align_up_max(sizeof(mem_block)) >= size) {
+      *link = block->next;
+      upb_arena_addblock(a, block, block->size, true);
+      _UPB_STATS_ADD(arena_blocks_reused, 1);
+      return block;
+    }
+  }
+
+  if (!a->block_alloc) {
+    return NULL;  /* Fixed-size arena. */
+  }
+
+  block = upb_malloc(a->block_alloc, block_size);
 
   if (!block) {
     return NULL;
   }
 
   upb_arena_addblock(a, block, block_size, true);
-  a->next_block_size = UPB_MIN(block_size * 2, a->max_block_size);
+  _UPB_STATS_ADD(arena_blocks, 1);
+  _UPB_STATS_ADD(arena_block_bytes, block_size);
+
+  if (block_size > a->max_block_size / a->growth_factor) {
+    a->next_block_size = a->max_block_size;
+  } else {
+    a->next_block_size = block_size * a->growth_factor;
+  }
 
   return block;
 }
 
-static void *upb_arena_doalloc(upb_alloc *alloc, void *ptr, size_t oldsize,
-                               size_t size) {
-  upb_arena *a = (upb_arena*)alloc;  /* upb_alloc is initial member. */
-  mem_block *block = a->block_head;
+void *_upb_arena_slowmalloc(upb_arena *a, size_t size) {
   void *ret;
 
-  if (size == 0) {
-    return NULL;  /* We are an arena, don't need individual frees. */
+  if (!upb_arena_allocblock(a, size)) {
+    return NULL;  /* Out of memory. */
   }
 
-  size = align_up_max(size);
+  UPB_ASSERT((size_t)(a->head.end - a->head.ptr) >= size);
+  ret = a->head.ptr;
+  a->head.ptr += size;
 
-  /* TODO(haberman): special-case if this is a realloc of the last alloc? */
+  /* TODO(haberman): ASAN unpoison. */
+
+  return ret;
+}
+
+static void *upb_arena_doalloc(upb_alloc *alloc, void *ptr, size_t oldsize,
+                               size_t size) {
+  upb_arena *a = (upb_arena*)alloc;  /* upb_alloc is initial member. */
+  void *ret;
 
-  if (!block || block->size - block->used < size) {
-    /* Slow path: have to allocate a new block. */
-    block = upb_arena_allocblock(a, size);
+  size = align_up_max(size);
 
-    if (!block) {
-      return NULL;  /* Out of memory. */
+  if (ptr && (char*)ptr + align_up_max(oldsize) == a->head.ptr) {
+    /* Realloc (or free) of the last allocation: grow or shrink it in place,
+     * so arrays that are grown one step at a time don't copy themselves into
+     * ever larger fresh allocations. */
+    if ((size_t)(a->head.end - (char*)ptr) >= size) {
+      a->head.ptr = (char*)ptr + size;
+      return size == 0 ? NULL : ptr;
     }
   }
 
-  ret = (char*)block + block->used;
-  block->used += size;
+  if (size == 0) {
+    return NULL;  /* We are an arena, don't need individual frees. */
+  }
+
+  ret = _upb_arena_fastmalloc(a, size);
 
-  if (oldsize > 0) {
+  if (ret && oldsize > 0) {
     memcpy(ret, ptr, oldsize);  /* Preserve existing data. */
   }
 
-  /* TODO(haberman): ASAN unpoison. */
-
-  a->bytes_allocated += size;
   return ret;
 }
 
@@ -183,17 +246,34 @@ static void *upb_arena_doalloc(upb_alloc *alloc, void *ptr, size_t oldsize,
 #define upb_alignof(type) offsetof (struct { char c; type member; }, member)
 
 upb_arena *upb_arena_init(void *mem, size_t n, upb_alloc *alloc) {
-  const size_t first_block_overhead = sizeof(upb_arena) + sizeof(mem_block);
+  return upb_arena_initopts(mem, n, alloc, NULL);
+}
+
+upb_arena *upb_arena_initopts(void *mem, size_t n, upb_alloc *alloc,
+                              const upb_arena_options *opts) {
+  const size_t first_block_overhead =
+      sizeof(upb_arena) + align_up_max(sizeof(mem_block));
+  size_t initial_block_size = 256;
+  size_t max_block_size = 16384;
+  unsigned growth_factor = 2;
   upb_arena *a;
   bool owned = false;
 
+  if (opts) {
+    if (opts->initial_block_size) initial_block_size = opts->initial_block_size;
+    if (opts->max_block_size) max_block_size = opts->max_block_size;
+    if (opts->growth_factor) growth_factor = opts->growth_factor;
+  }
+
+  max_block_size = UPB_MAX(max_block_size, initial_block_size);
+
   /* Round block size down to alignof(*a) since we will allocate the arena
    * itself at the end. */
   n &= ~(upb_alignof(upb_arena) - 1);
 
   if (n < first_block_overhead) {
     /* We need to malloc the initial block. */
-    n = first_block_overhead + 256;
+    n = first_block_overhead + initial_block_size;
     owned = true;
     if (!alloc || !(mem = upb_malloc(alloc, n))) {
       return NULL;
@@ -203,14 +283,22 @@ upb_arena *upb_arena_init(void *mem, size_t n, upb_alloc *alloc) {
   a = (void*)((char*)mem + n - sizeof(*a));
   n -= sizeof(*a);
 
-  a->alloc.func = &upb_arena_doalloc;
+  a->head.alloc.func = &upb_arena_doalloc;
   a->block_alloc = &upb_alloc_global;
   a->bytes_allocated = 0;
-  a->next_block_size = 256;
-  a->max_block_size = 16384;
+  a->next_block_size = initial_block_size;
+  a->max_block_size = max_block_size;
+  a->growth_factor = growth_factor;
+  a->retained_head = NULL;
+  a->max_retained_size = 65536;
   a->cleanup_head = NULL;
   a->block_head = NULL;
   a->block_alloc = alloc;
+  a->parent = a;
+  a->refcount = 1;
+  a->has_initial_block = !owned;
+  a->group_next = NULL;
+  a->group_tail = a;
 
   upb_arena_addblock(a, mem, n, owned);
 
@@ -219,17 +307,38 @@ upb_arena *upb_arena_init(void *mem, size_t n, upb_alloc *alloc) {
 
 #undef upb_alignof
 
-void upb_arena_free(upb_arena *a) {
-  cleanup_ent *ent = a->cleanup_head;
-  mem_block *block = a->block_head;
+/* Fusing and freeing take a global lock, so they are safe to call from
+ * different threads on arenas of the same group.  Allocating from a single
+ * arena still must not happen on two threads at once. */
+#if defined(__GNUC__) || defined(__clang__)
+static char upb_arena_grouplock;
 
-  while (ent) {
-    ent->cleanup(ent->ud);
-    ent = ent->next;
+static void upb_arena_lock(void) {
+  while (__atomic_test_and_set(&upb_arena_grouplock, __ATOMIC_ACQUIRE)) {
   }
+}
 
-  /* Must do this after running cleanup functions, because this will delete
-   * the memory we store our cleanup entries in! */
+static void upb_arena_unlock(void) {
+  __atomic_clear(&upb_arena_grouplock, __ATOMIC_RELEASE);
+}
+#else
+/* No atomics available: fusing and freeing are not thread-safe. */
+static void upb_arena_lock(void) {}
+static void upb_arena_unlock(void) {}
+#endif
+
+/* Must be called with the lock held. */
+static upb_arena *upb_arena_findroot(upb_arena *a) {
+  /* Path splitting keeps the trees shallow. */
+  while (a->parent != a) {
+    upb_arena *next = a->parent;
+    a->parent = next->parent;
+    a = next;
+  }
+  return a;
+}
+
+static void upb_arena_freelist(upb_arena *a, mem_block *block) {
   while (block) {
     /* Load first since we are deleting block. */
     mem_block *next = block->next;
@@ -242,8 +351,133 @@ void upb_arena_free(upb_arena *a) {
   }
 }
 
+static void upb_arena_freeblocks(upb_arena *a) {
+  upb_arena_freelist(a, a->retained_head);
+  upb_arena_freelist(a, a->block_head);
+}
+
+static void upb_arena_runcleanups(upb_arena *a) {
+  cleanup_ent *ent = a->cleanup_head;
+
+  while (ent) {
+    ent->cleanup(ent->ud);
+    ent = ent->next;
+  }
+
+  a->cleanup_head = NULL;
+}
+
+void upb_arena_free(upb_arena *a) {
+  upb_arena *member;
+
+  upb_arena_lock();
+  a = upb_arena_findroot(a);
+  if (--a->refcount > 0) {
+    upb_arena_unlock();
+    return;  /* Other arenas of the group are still alive. */
+  }
+  upb_arena_unlock();
+
+  /* Run the cleanup functions of the whole group first, since they may refer
+   * to memory in any of its arenas. */
+  for (member = a; member; member = member->group_next) {
+    upb_arena_runcleanups(member);
+  }
+
+  /* Must do this after running cleanup functions, because this will delete
+   * the memory we store our cleanup entries in!  The arena itself lives in
+   * one of its blocks, too. */
+  while (a) {
+    upb_arena *next = a->group_next;
+    upb_arena_freeblocks(a);
+    a = next;
+  }
+}
+
+void upb_arena_reset(upb_arena *a) {
+  mem_block *block = a->block_head;
+  mem_block *next;
+  mem_block **link;
+  size_t retained_size = 0;
+
+  UPB_ASSERT(a->parent == a && a->group_next == NULL);  /* Not fused. */
+
+  upb_arena_runcleanups(a);
+
+  /* Move every block but the initial one to the retained list.  Only the
+   * initial block can be unowned. */
+  while (block->next) {
+    next = block->next;
+    block->next = a->retained_head;
+    a->retained_head = block;
+    block = next;
+  }
+
+  /* The initial block holds the arena itself; it always stays. */
+  a->block_head = NULL;
+  upb_arena_addblock(a, block, block->size, block->owned);
+  a->bytes_allocated = 0;
+
+  /* Free whatever exceeds the bound. */
+  link = (mem_block**)&a->retained_head;
+  while (*link) {
+    block = *link;
+    if (retained_size + block->size <= a->max_retained_size) {
+      retained_size += block->size;
+      link = &block->next;
+    } else {
+      *link = block->next;
+      upb_free(a->block_alloc, block);
+    }
+  }
+}
+
+void upb_arena_setmaxretained(upb_arena *a, size_t size) {
+  a->max_retained_size = size;
+}
+
+bool upb_arena_fuse(upb_arena *a, upb_arena *b) {
+  upb_arena *ra;
+  upb_arena *rb;
+
+  upb_arena_lock();
+  ra = upb_arena_findroot(a);
+  rb = upb_arena_findroot(b);
+
+  if (ra == rb) {
+    upb_arena_unlock();
+    return true;  /* Already fused. */
+  }
+
+  if (ra->has_initial_block || rb->has_initial_block) {
+    /* We can't extend the lifetime of memory the caller gave us. */
+    upb_arena_unlock();
+    return false;
+  }
+
+  /* Join the group with fewer live arenas to the other. */
+  if (ra->refcount < rb->refcount) {
+    upb_arena *tmp = ra;
+    ra = rb;
+    rb = tmp;
+  }
+
+  rb->parent = ra;
+  ra->refcount += rb->refcount;
+  ra->group_tail->group_next = rb;
+  ra->group_tail = rb->group_tail;
+
+  upb_arena_unlock();
+  return true;
+}
+
+void upb_arena_sizehint(upb_arena *a, size_t size) {
+  a->next_block_size =
+      UPB_MAX(a->next_block_size, UPB_MIN(size, a->max_block_size));
+}
+
 bool upb_arena_addcleanup(upb_arena *a, void *ud, upb_cleanup_func *func) {
-  cleanup_ent *ent = upb_malloc(&a->alloc, sizeof(cleanup_ent));
+  cleanup_ent *ent = upb_arena_malloc(a, sizeof(cleanup_ent));
   if (!ent) {
     return false;  /* Out of memory. */
   }
@@ -257,5 +491,34 @@ bool upb_arena_addcleanup(upb_arena *a, void *ud, upb_cleanup_func *func) {
 }
 
 size_t upb_arena_bytesallocated(const upb_arena *a) {
-  return a->bytes_allocated;
+  return a->bytes_allocated +
+         (a->head.ptr - upb_arena_blockstart(a->block_head));
+}
+
+/* upb_stats ******************************************************************/
+
+#ifdef UPB_STATS
+_UPB_STATS_TLS upb_stats _upb_stats;
+#endif
+
+bool upb_stats_enabled(void) {
+#ifdef UPB_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void upb_stats_get(upb_stats *stats) {
+#ifdef UPB_STATS
+  *stats = _upb_stats;
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+void upb_stats_reset(void) {
+#ifdef UPB_STATS
+  memset(&_upb_stats, 0, sizeof(_upb_stats));
+#endif
 }
@@ -16,11 +16,14 @@
 #include <string.h>
 
 #ifdef __cplusplus
+#include <cstddef>
 #include <memory>
+#include <utility>
 namespace upb {
 class Arena;
 class Status;
 template <int N> class InlinedArena;
+template <class T> class MessageHandle;
 }
 #endif
 
@@ -205,6 +208,18 @@ typedef void upb_cleanup_func(void *ud);
 struct upb_arena;
 typedef struct upb_arena upb_arena;
 
+/* How an arena sizes the blocks it allocates.  Zero members (or passing no
+ * options at all) select the defaults. */
+typedef struct {
+  /* Size of the first block allocated from the block allocator (256). */
+  size_t initial_block_size;
+
+  /* Blocks grow by |growth_factor| (2) each time, up to |max_block_size|
+   * (16kB).  Single allocations larger than that get a block of their own. */
+  size_t max_block_size;
+  unsigned growth_factor;
+} upb_arena_options;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -213,16 +228,79 @@ extern "C" {
  * Additional blocks will be allocated from |alloc|.  If |alloc| is NULL, this
  * is a fixed-size arena and cannot grow. */
 upb_arena *upb_arena_init(void *mem, size_t n, upb_alloc *alloc);
+
+/* Like upb_arena_init(), with the block sizing given by |opts| (may be NULL).
+ * Parsing large messages is cheaper with a larger maximum block size.  Large
+ * blocks can be backed by huge pages with a |alloc| that provides them. */
+upb_arena *upb_arena_initopts(void *mem, size_t n, upb_alloc *alloc,
+                              const upb_arena_options *opts);
 void upb_arena_free(upb_arena *a);
 bool upb_arena_addcleanup(upb_arena *a, void *ud, upb_cleanup_func *func);
+
+/* Runs the cleanup functions and discards everything allocated from |a|, as
+ * upb_arena_free() would, but keeps its blocks (up to the max retained size in
+ * total) to serve later allocations.  An arena that is reset and reused for
+ * similar work stops calling its block allocator once it has grown to size.
+ * |a| must not be fused. */
+void upb_arena_reset(upb_arena *a);
+
+/* Bounds the total size of the blocks upb_arena_reset() keeps (default 64kB).
+ * Pass 0 to keep only the initial block. */
+void upb_arena_setmaxretained(upb_arena *a, size_t size);
+
+/* Joins the lifetimes of |a| and |b|, and of anything already fused to either
+ * of them: none of their memory is freed (and no cleanup functions run) until
+ * upb_arena_free() has been called on every one of them.  This lets messages
+ * in one arena point into another without copying.
+ *
+ * Fails if either group contains an arena created over memory supplied to
+ * upb_arena_init(), since that memory cannot outlive upb_arena_free().  Fusing
+ * and freeing are safe to call from different threads. */
+bool upb_arena_fuse(upb_arena *a, upb_arena *b);
 size_t upb_arena_bytesallocated(const upb_arena *a);
 
+/* Tells |a| that about |size| more bytes will be allocated from it soon, so
+ * its next block can be sized for that at once (up to the max block size). */
+void upb_arena_sizehint(upb_arena *a, size_t size);
+
 UPB_INLINE upb_alloc *upb_arena_alloc(upb_arena *a) { return (upb_alloc*)a; }
 
+/* Arena allocations are aligned to this. */
+#define UPB_MALLOC_ALIGN 16
+#define UPB_ALIGN_MALLOC(size) \
+  (((size) + UPB_MALLOC_ALIGN - 1) / UPB_MALLOC_ALIGN * UPB_MALLOC_ALIGN)
+
+/* The first members of every upb_arena: the free space left in its current
+ * block, so allocations can be inlined.  Internal to upb. */
+typedef struct {
+  upb_alloc alloc;
+  char *ptr;
+  char *end;
+} _upb_arena_head;
+
+void *_upb_arena_slowmalloc(upb_arena *a, size_t size);
+
+/* Bump-pointer allocation from the current block, only calling out to the
+ * arena when the block is exhausted.  Internal to upb. */
+UPB_INLINE void *_upb_arena_fastmalloc(upb_arena *a, size_t size) {
+  _upb_arena_head *h = (_upb_arena_head*)a;
+  void *ret;
+
+  size = UPB_ALIGN_MALLOC(size);
+
+  if (UPB_UNLIKELY((size_t)(h->end - h->ptr) < size)) {
+    return _upb_arena_slowmalloc(a, size);
+  }
+
+  ret = h->ptr;
+  h->ptr += size;
+  return ret;
+}
+
 /* Convenience wrappers around upb_alloc functions. */
 
 UPB_INLINE void *upb_arena_malloc(upb_arena *a, size_t size) {
-  return upb_malloc(upb_arena_alloc(a), size);
+  return _upb_arena_fastmalloc(a, size);
 }
 
 UPB_INLINE void *upb_arena_realloc(upb_arena *a, void *ptr, size_t oldsize,
@@ -257,10 +335,20 @@ class upb::Arena {
     return upb_arena_addcleanup(ptr_.get(), ud, func);
   }
 
+  /* Frees everything allocated so far, see upb_arena_reset(). */
+  void Reset() { upb_arena_reset(ptr_.get()); }
+
+  /* Joins the lifetimes of this arena and |other|, see upb_arena_fuse(). */
+  bool Fuse(Arena& other) { return upb_arena_fuse(ptr_.get(), other.ptr()); }
+
   /* Total number of bytes that have been allocated.  It is undefined what
    * Realloc() does to &arena_ counter. */
   size_t BytesAllocated() const { return upb_arena_bytesallocated(ptr_.get()); }
 
+ protected:
+  /* Takes ownership of |arena|. */
+  explicit Arena(upb_arena *arena) : ptr_(arena, upb_arena_free) {}
+
  private:
   std::unique_ptr<upb_arena, decltype(&upb_arena_free)> ptr_;
 };
@@ -270,24 +358,97 @@ class upb::Arena {
 /* upb::InlinedArena **********************************************************/
 
 /* upb::InlinedArena seeds the arenas with a predefined amount of memory.  No
- * heap memory will be allocated until the initial block is exceeded.
+ * heap memory will be allocated until the initial block is exceeded.  The
+ * block is part of the object, so an InlinedArena on the stack lets a request
+ * be parsed, processed and serialized without touching the heap.  The arena
+ * header itself takes about 100 bytes of the block.
+ *
+ * Because the block moves with the object, an InlinedArena can't be copied or
+ * moved, not even into a upb::Arena.
  *
  * These types only exist in C++ */
 
 #ifdef __cplusplus
 
-template <int N> class upb::InlinedArena : public upb::Arena {
+template <int N> class upb::InlinedArena : private upb::Arena {
  public:
-  InlinedArena() : ptr_(upb_arena_new(&initial_block_, N, &upb_alloc_global)) {}
+  InlinedArena()
+      : Arena(upb_arena_init(initial_block_, N, &upb_alloc_global)) {}
+
+  /* The base is private so that it can't be moved out of an InlinedArena,
+   * for example by passing std::move(arena) as a upb::Arena&&.  Fuse() is
+   * left out because an arena with an initial block can't be fused. */
+  using Arena::ptr;
+  using Arena::allocator;
+  using Arena::AddCleanup;
+  using Arena::Reset;
+  using Arena::BytesAllocated;
 
-  upb_arena* ptr() { return ptr_.get(); }
+ private:
+  InlinedArena(const InlinedArena&) = delete;
+  InlinedArena& operator=(const InlinedArena&) = delete;
+  InlinedArena(InlinedArena&&) = delete;
+  InlinedArena& operator=(InlinedArena&&) = delete;
+
+  /* upb_arena_init() puts the arena at the end of the block, so the block
+   * must be aligned for it. */
+  alignas(alignof(std::max_align_t)) char initial_block_[N];
+};
+
+/* upb::MessageHandle *********************************************************/
+
+/* upb::MessageHandle owns a message of a generated type T (for example
+ * google_protobuf_FileDescriptorProto) together with the arena it lives in,
+ * so the message can be returned from a function or stored without keeping
+ * track of its arena separately.  Handles are move-only; the arena, and with
+ * it the message, is freed with the handle that holds it.
+ *
+ * A message that doesn't outlive a scope is better off with a plain pointer
+ * into an InlinedArena, which can't be moved into a handle:
+ *
+ *   upb::InlinedArena<4096> arena;
+ *   Foo* foo = Foo_parse(buf, size, arena.ptr());
+ *
+ * whereas a handle takes a upb::Arena:
+ *
+ *   upb::Arena arena;
+ *   Foo* foo = Foo_parse(buf, size, arena.ptr());
+ *   return upb::MessageHandle<Foo>(foo, std::move(arena));
+ */
+
+template <class T> class upb::MessageHandle {
+ public:
+  /* |msg| must have been allocated from |arena| (or be NULL, for example when
+   * parsing failed). */
+  MessageHandle(T* msg, Arena&& arena) : arena_(std::move(arena)), msg_(msg) {}
+  template <int N> MessageHandle(T* msg, InlinedArena<N>&& arena) = delete;
+
+  MessageHandle(MessageHandle&& other)
+      : arena_(std::move(other.arena_)), msg_(other.msg_) {
+    other.msg_ = NULL;
+  }
+
+  MessageHandle& operator=(MessageHandle&& other) {
+    arena_ = std::move(other.arena_);
+    msg_ = other.msg_;
+    other.msg_ = NULL;
+    return *this;
+  }
+
+  T* get() const { return msg_; }
+  T* operator->() const { return msg_; }
+  explicit operator bool() const { return msg_ != NULL; }
+
+  /* The arena of the message, for allocating anything that is added to it.
+   * Undefined once the handle has been moved from. */
+  Arena* arena() { return &arena_; }
 
  private:
-  InlinedArena(const InlinedArena*) = delete;
-  InlinedArena& operator=(const InlinedArena*) = delete;
+  MessageHandle(const MessageHandle&) = delete;
+  MessageHandle& operator=(const MessageHandle&) = delete;
 
-  std::unique_ptr<upb_arena, decltype(&upb_arena_free)> ptr_;
-  char initial_block_[N];
+  Arena arena_;
+  T* msg_;
 };
 
 #endif  /* __cplusplus */
@@ -0,0 +1,157 @@
+/*
+** The varint decoding kernel shared by upb_decode (decode.c, decode_fast.c)
+** and upb_pbdecoder (pb/decoder.c).
+**
+** One- and two-byte varints, by far the most common, are decoded with
+** straight-line code.  Longer varints are decoded a 64-bit word at a time when
+** there is enough input left to read it without a bounds check on every byte,
+** and byte by byte otherwise.
+**
+** The definitions in this file are internal to upb.
+*/
+
+#ifndef UPB_VARINT_DECODE_INT_H_
+#define UPB_VARINT_DECODE_INT_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "upb/upb.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "upb/port_def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Byte-at-a-time decoding, for varints near the end of the input. */
+UPB_INLINE const char *_upb_vdecode_slow(const char *p, const char *limit,
+                                         uint64_t *val) {
+  uint8_t byte;
+  int bitpos = 0;
+  *val = 0;
+
+  do {
+    if (bitpos >= 70 || p >= limit) return NULL;
+    byte = *p;
+    *val |= (uint64_t)(byte & 0x7F) << bitpos;
+    p++;
+    bitpos += 7;
+  } while (byte & 0x80);
+
+  return p;
+}
+
+/* Concatenates the low 7 bits of every byte of |w|.  The caller has already
+ * cleared the continuation bits and any bytes past the end of the varint. */
+UPB_INLINE uint64_t _upb_vdecode_compact(uint64_t w) {
+#if defined(__BMI2__)
+  return _pext_u64(w, 0x7f7f7f7f7f7f7f7fULL);
+#else
+  w = ((w & 0x7f007f007f007f00ULL) >> 1) | (w & 0x007f007f007f007fULL);
+  w = ((w & 0x3fff00003fff0000ULL) >> 2) | (w & 0x00003fff00003fffULL);
+  w = ((w & 0x0fffffff00000000ULL) >> 4) | (w & 0x000000000fffffffULL);
+  return w;
+#endif
+}
+
+/* Word-at-a-time decoding.  Requires UPB_VDECODE_WORD_BYTES of input. */
+#define UPB_VDECODE_WORD_BYTES 10
+
+UPB_INLINE const char *_upb_vdecode_word(const char *p, uint64_t *val) {
+  uint64_t w;
+  uint64_t stop;
+  int bytes;
+
+  memcpy(&w, p, 8);
+#ifdef UPB_BIG_ENDIAN
+  w = ((w & 0xff00000000000000ULL) >> 56) | ((w & 0x00ff000000000000ULL) >> 40) |
+      ((w & 0x0000ff0000000000ULL) >> 24) | ((w & 0x000000ff00000000ULL) >> 8) |
+      ((w & 0x00000000ff000000ULL) << 8) | ((w & 0x0000000000ff0000ULL) << 24) |
+      ((w & 0x000000000000ff00ULL) << 40) | ((w & 0x00000000000000ffULL) << 56);
+#endif
+
+  /* One bit set for every byte that terminates a varint. */
+  stop = ~w & 0x8080808080808080ULL;
+
+  if (UPB_UNLIKELY(stop == 0)) {
+    /* More than 8 bytes: the last one or two bytes of a 64-bit value. */
+    uint64_t v = _upb_vdecode_compact(w & 0x7f7f7f7f7f7f7f7fULL);
+    uint8_t b = p[8];
+    v |= (uint64_t)(b & 0x7f) << 56;
+    if (b & 0x80) {
+      b = p[9];
+      if (b & 0x80) return NULL;  /* Longer than 10 bytes. */
+      v |= (uint64_t)b << 63;
+      bytes = 10;
+    } else {
+      bytes = 9;
+    }
+    *val = v;
+    return p + bytes;
+  }
+
+  /* Keep everything up to and including the first terminating byte. */
+  w &= (stop ^ (stop - 1)) & 0x7f7f7f7f7f7f7f7fULL;
+
+#if defined(__GNUC__) || defined(__clang__)
+  bytes = (__builtin_ctzll(stop) + 1) / 8;
+#else
+  for (bytes = 1; !(stop & 0x80); bytes++) stop >>= 8;
+#endif
+
+  *val = _upb_vdecode_compact(w);
+  return p + bytes;
+}
+
+/* Decodes the varint at |p|, reading nothing at or past |limit|.  Returns the
+ * position just past the varint, or NULL if it is truncated or longer than
+ * ten bytes. */
+UPB_INLINE const char *_upb_vdecode(const char *p, const char *limit,
+                                    uint64_t *val) {
+  if (UPB_LIKELY(p < limit) && (*p & 0x80) == 0) {
+    *val = (uint8_t)*p;
+    return p + 1;
+  } else if (limit - p >= 2 && (p[1] & 0x80) == 0) {
+    *val = (p[0] & 0x7fU) | ((uint64_t)(uint8_t)p[1] << 7);
+    return p + 2;
+  } else if (limit - p >= UPB_VDECODE_WORD_BYTES) {
+    return _upb_vdecode_word(p, val);
+  } else {
+    return _upb_vdecode_slow(p, limit, val);
+  }
+}
+
+/* Returns the number of varints that end in [p, limit), ie. the number of
+ * bytes without a continuation bit.  For a packed field this is the element
+ * count.  Counts eight bytes at a time. */
+UPB_INLINE size_t _upb_vcount(const char *p, const char *limit) {
+  size_t n = 0;
+
+  while (limit - p >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    /* Move each terminator's flag to the bottom of its byte, then sum the
+     * bytes into the top byte. */
+    w = (~w & 0x8080808080808080ULL) >> 7;
+    n += (size_t)((w * 0x0101010101010101ULL) >> 56);
+    p += 8;
+  }
+
+  while (p < limit) {
+    n += (*p++ & 0x80) == 0;
+  }
+
+  return n;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#include "upb/port_undef.inc"
+
+#endif  /* UPB_VARINT_DECODE_INT_H_ */
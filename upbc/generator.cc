@@ -3,6 +3,7 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_replace.h"
 #include "absl/strings/substitute.h"
 #include "google/protobuf/compiler/code_generator.h"
@@ -12,6 +13,7 @@
 
 #include "upbc/generator.h"
 #include "upbc/message_layout.h"
+#include "upbc/profile.h"
 
 namespace protoc = ::google::protobuf::compiler;
 namespace protobuf = ::google::protobuf;
@@ -82,6 +84,20 @@ class Output {
 
 namespace upbc {
 
+// Options from the --upb_out parameter, eg. --upb_out=layout_profile=f:out.
+struct Options {
+  // Field access counts, see upbc/profile.h.  Used for layouts and for
+  // specialize below.
+  FieldProfile profile;
+
+  // How many of the profile's hottest messages get a parser for their usual
+  // field sequence.
+  int specialize = 20;
+
+  // Whether to generate a serializer for each message, see WriteEncoder().
+  bool serializers = false;
+};
+
 class Generator : public protoc::CodeGenerator {
   ~Generator() override {}
   bool Generate(const protobuf::FileDescriptor* file,
@@ -123,6 +139,21 @@ std::vector<const protobuf::Descriptor*> SortedMessages(
   return messages;
 }
 
+std::vector<const protobuf::FieldDescriptor*> SortedExtensions(
+    const protobuf::FileDescriptor* file) {
+  std::vector<const protobuf::FieldDescriptor*> exts;
+  for (int i = 0; i < file->extension_count(); i++) {
+    exts.push_back(file->extension(i));
+  }
+  for (auto message : SortedMessages(file)) {
+    for (int i = 0; i < message->extension_count(); i++) {
+      exts.push_back(message->extension(i));
+    }
+  }
+  SortDefs(&exts);
+  return exts;
+}
+
 std::vector<const protobuf::EnumDescriptor*> SortedEnums(
     const protobuf::FileDescriptor* file) {
   std::vector<const protobuf::EnumDescriptor*> enums;
@@ -188,10 +219,41 @@ std::string GetSizeInit(const MessageLayout::Size& size) {
   return absl::Substitute("UPB_SIZE($0, $1)", size.size32, size.size64);
 }
 
+// How many elements a repeated field's array holds inline when the
+// generated accessors create it: as many as fit in 32 bytes, from 1 to 8.
+// The decoder sizes the arrays it creates from the input instead.
+std::string ArrayInitSize(const protobuf::FieldDescriptor* field) {
+  MessageLayout::Size size = MessageLayout::SizeOfUnwrapped(field).size;
+  auto elements = [](int64_t elem_size) {
+    return std::min<int64_t>(8, std::max<int64_t>(1, 32 / elem_size));
+  };
+  return absl::Substitute("UPB_SIZE($0, $1)", elements(size.size32),
+                          elements(size.size64));
+}
+
 std::string MessageName(const protobuf::Descriptor* descriptor) {
   return ToCIdent(descriptor->full_name());
 }
 
+// Accessors of an extension are named like those of a field of the message
+// it is declared in, or with the package as prefix for one at file scope.
+std::string ExtensionPrefix(const protobuf::FieldDescriptor* ext) {
+  std::string scope = ext->extension_scope()
+                          ? ext->extension_scope()->full_name()
+                          : ext->file()->package();
+  return scope.empty() ? "" : ToCIdent(scope) + "_";
+}
+
+std::string ExtensionLayout(const protobuf::FieldDescriptor* ext) {
+  return ToCIdent(ext->full_name()) + "_ext";
+}
+
+std::string ExtendeeType(const protobuf::FieldDescriptor* ext) {
+  const protobuf::Descriptor* extendee = ext->containing_type();
+  return (extendee->file() != ext->file() ? "struct " : "") +
+         MessageName(extendee);
+}
+
 std::string MessageInit(const protobuf::Descriptor* descriptor) {
   return MessageName(descriptor) + "_msginit";
 }
@@ -326,8 +388,44 @@ void EmitFileWarning(const protobuf::FileDescriptor* file, Output& output) {
       file->name());
 }
 
-void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output) {
-  MessageLayout layout(message);
+// Messages at least this big (on 64-bit platforms) are only zeroed where
+// they must be by upb_msg_new(), if that is at most half of them.  Their
+// other fields hold garbage until they are set, so their getters check the
+// hasbit first.
+constexpr int64_t kSparseInitSize = 128;
+
+bool SparseInit(const MessageLayout& layout) {
+  int64_t size = layout.message_size().size64;
+  return size >= kSparseInitSize && layout.zero_size().size64 * 2 <= size;
+}
+
+// What the getter of a field with a hasbit returns when it isn't set: zero,
+// like a zero-initialized field reads.
+std::string FieldZero(const protobuf::FieldDescriptor* field) {
+  switch (field->cpp_type()) {
+    case protobuf::FieldDescriptor::CPPTYPE_MESSAGE:
+      return "NULL";
+    case protobuf::FieldDescriptor::CPPTYPE_STRING:
+      return "upb_strview_make(\"\", 0)";
+    case protobuf::FieldDescriptor::CPPTYPE_BOOL:
+      return "false";
+    default:
+      return "0";
+  }
+}
+
+// Singular submessage fields marked [lazy = true] are left unparsed by
+// upb_decode until they are accessed.
+bool IsLazy(const protobuf::FieldDescriptor* field) {
+  return field->type() == protobuf::FieldDescriptor::TYPE_MESSAGE &&
+         field->options().lazy() && !field->is_repeated() &&
+         !field->containing_oneof();
+}
+
+void GenerateMessageInHeader(const protobuf::Descriptor* message,
+                             const Options& options, Output& output) {
+  MessageLayout layout(message, &options.profile);
+  bool sparse = SparseInit(layout);
 
   output("/* $0 */\n\n", message->full_name());
   std::string msgname = ToCIdent(message->full_name());
@@ -340,6 +438,12 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
       "  $0 *ret = $0_new(arena);\n"
       "  return (ret && upb_decode(buf, size, ret, &$1, arena)) ? ret : NULL;\n"
       "}\n"
+      "UPB_INLINE $0 *$0_parse_ex(const char *buf, size_t size,\n"
+      "                           upb_arena *arena, int options) {\n"
+      "  $0 *ret = $0_new(arena);\n"
+      "  return (ret && upb_decode_ex(buf, size, ret, &$1, arena, options))\n"
+      "      ? ret : NULL;\n"
+      "}\n"
       "UPB_INLINE char *$0_serialize(const $0 *msg, upb_arena *arena, size_t "
       "*len) {\n"
       "  return upb_encode(msg, &$1, arena, len);\n"
@@ -383,7 +487,24 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
           field->number());
     }
 
-    if (field->is_repeated()) {
+    if (field->is_map()) {
+      const protobuf::FieldDescriptor* key = field->message_type()->map_key();
+      const protobuf::FieldDescriptor* val =
+          field->message_type()->map_value();
+      std::string ofs = GetSizeInit(layout.GetFieldOffset(field));
+      output(
+          "UPB_INLINE size_t $0_$1_size(const $0 *msg) { "
+          "return _upb_msg_map_size(msg, $2); }\n",
+          msgname, field->name(), ofs);
+      output(
+          "UPB_INLINE bool $0_$1_get(const $0 *msg, $2 key, $3 *val) { "
+          "return _upb_msg_map_get(msg, $4, &key, val); }\n",
+          msgname, field->name(), CType(key), CTypeConst(val), ofs);
+      output(
+          "UPB_INLINE bool $0_$1_next(const $0 *msg, size_t *iter, $2 *key, "
+          "$3 *val) { return _upb_msg_map_next(msg, $4, iter, key, val); }\n",
+          msgname, field->name(), CType(key), CTypeConst(val), ofs);
+    } else if (field->is_repeated()) {
       output(
           "UPB_INLINE $0 const* $1_$2(const $1 *msg, size_t *len) { "
           "return ($0 const*)_upb_array_accessor(msg, $3, len); }\n",
@@ -397,6 +518,25 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
           GetSizeInit(layout.GetFieldOffset(field)),
           GetSizeInit(layout.GetOneofCaseOffset(field->containing_oneof())),
           field->number(), FieldDefault(field));
+    } else if (sparse && layout.HasHasbit(field)) {
+      std::string value = absl::Substitute(
+          IsLazy(field) ? "($0)_upb_lazymsg_accessor(msg, $1, &$2)"
+                        : "UPB_FIELD_AT(msg, $0, $1)",
+          CTypeConst(field), GetSizeInit(layout.GetFieldOffset(field)),
+          IsLazy(field) ? MessageInit(field->message_type()) : "");
+      output(
+          "UPB_INLINE $0 $1_$2(const $1 *msg) {\n"
+          "  return _upb_has_field(msg, $3) ? $4 : $5;\n"
+          "}\n",
+          CTypeConst(field), msgname, field->name(),
+          layout.GetHasbitIndex(field), value, FieldZero(field));
+    } else if (IsLazy(field)) {
+      output(
+          "UPB_INLINE $0 $1_$2(const $1 *msg) { "
+          "return ($0)_upb_lazymsg_accessor(msg, $3, &$4); }\n",
+          CTypeConst(field), msgname, field->name(),
+          GetSizeInit(layout.GetFieldOffset(field)),
+          MessageInit(field->message_type()));
     } else {
       output(
           "UPB_INLINE $0 $1_$2(const $1 *msg) { "
@@ -409,7 +549,23 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
   output("\n");
 
   for (auto field : FieldNumberOrder(message)) {
-    if (field->is_repeated()) {
+    if (field->is_map()) {
+      const protobuf::FieldDescriptor* key = field->message_type()->map_key();
+      const protobuf::FieldDescriptor* val =
+          field->message_type()->map_value();
+      std::string ofs = GetSizeInit(layout.GetFieldOffset(field));
+      output(
+          "UPB_INLINE bool $0_$1_set($0 *msg, $2 key, $3 val, "
+          "upb_arena *arena) {\n"
+          "  return _upb_msg_map_set(msg, $4, &key, &val, &$5, arena);\n"
+          "}\n",
+          msgname, field->name(), CType(key), CType(val), ofs,
+          MessageInit(field->message_type()));
+      output(
+          "UPB_INLINE bool $0_$1_delete($0 *msg, $2 key) { "
+          "return _upb_msg_map_delete(msg, $3, &key); }\n",
+          msgname, field->name(), CType(key), ofs);
+    } else if (field->is_repeated()) {
       output(
           "UPB_INLINE $0* $1_mutable_$2($1 *msg, size_t *len) {\n"
           "  return ($0*)_upb_array_mutable_accessor(msg, $3, len);\n"
@@ -419,19 +575,19 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
       output(
           "UPB_INLINE $0* $1_resize_$2($1 *msg, size_t len, "
           "upb_arena *arena) {\n"
-          "  return ($0*)_upb_array_resize_accessor(msg, $3, len, $4, $5, "
+          "  return ($0*)_upb_array_resize_accessor(msg, $3, len, $4, $5, $6, "
           "arena);\n"
           "}\n",
           CType(field), msgname, field->name(),
           GetSizeInit(layout.GetFieldOffset(field)),
           GetSizeInit(MessageLayout::SizeOfUnwrapped(field).size),
-          UpbType(field));
+          ArrayInitSize(field), UpbType(field));
       if (field->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
         output(
             "UPB_INLINE struct $0* $1_add_$2($1 *msg, upb_arena *arena) {\n"
             "  struct $0* sub = (struct $0*)upb_msg_new(&$3, arena);\n"
             "  bool ok = _upb_array_append_accessor(\n"
-            "      msg, $4, $5, $6, &sub, arena);\n"
+            "      msg, $4, $5, $6, $7, &sub, arena);\n"
             "  if (!ok) return NULL;\n"
             "  return sub;\n"
             "}\n",
@@ -439,17 +595,17 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
             MessageInit(field->message_type()),
             GetSizeInit(layout.GetFieldOffset(field)),
             GetSizeInit(MessageLayout::SizeOfUnwrapped(field).size),
-            UpbType(field));
+            ArrayInitSize(field), UpbType(field));
       } else {
         output(
             "UPB_INLINE bool $1_add_$2($1 *msg, $0 val, upb_arena *arena) {\n"
             "  return _upb_array_append_accessor(\n"
-            "      msg, $3, $4, $5, &val, arena);\n"
+            "      msg, $3, $4, $5, $6, &val, arena);\n"
             "}\n",
             CType(field), msgname, field->name(),
             GetSizeInit(layout.GetFieldOffset(field)),
             GetSizeInit(MessageLayout::SizeOfUnwrapped(field).size),
-            UpbType(field));
+            ArrayInitSize(field), UpbType(field));
       }
     } else {
       output("UPB_INLINE void $0_set_$1($0 *msg, $2 value) {\n", msgname,
@@ -490,7 +646,94 @@ void GenerateMessageInHeader(const protobuf::Descriptor* message, Output& output
   output("\n");
 }
 
-void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
+void GenerateExtensionInHeader(const protobuf::FieldDescriptor* ext,
+                               Output& output) {
+  std::string prefix = ExtensionPrefix(ext);
+  std::string extendee = ExtendeeType(ext);
+  std::string layout = ExtensionLayout(ext);
+  bool is_message =
+      ext->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE;
+
+  output("/* $0 */\n\n", ext->full_name());
+  output(
+      "UPB_INLINE bool $0has_$1(const $2 *msg) {\n"
+      "  return _upb_msg_getext(msg, &$3) != NULL;\n"
+      "}\n"
+      "UPB_INLINE void $0clear_$1($2 *msg) { _upb_msg_clearext(msg, &$3); }\n",
+      prefix, ext->name(), extendee, layout);
+
+  if (ext->is_repeated()) {
+    output(
+        "UPB_INLINE $0 const* $1$2(const $3 *msg, size_t *len) {\n"
+        "  const upb_msg_ext *ext = _upb_msg_getext(msg, &$4);\n"
+        "  if (!ext) {\n"
+        "    *len = 0;\n"
+        "    return NULL;\n"
+        "  }\n"
+        "  return ($0 const*)_upb_array_accessor(&ext->data, 0, len);\n"
+        "}\n",
+        CTypeConst(ext), prefix, ext->name(), extendee, layout);
+    if (is_message) {
+      output(
+          "UPB_INLINE struct $0* $1add_$2($3 *msg, upb_arena *arena) {\n"
+          "  upb_msg_ext *ext = _upb_msg_getorcreateext(msg, &$4, arena);\n"
+          "  struct $0* sub = (struct $0*)upb_msg_new(&$5, arena);\n"
+          "  if (!ext || !sub ||\n"
+          "      !_upb_array_append_accessor(&ext->data, 0, $6, $7, $8, "
+          "&sub,\n"
+          "                                  arena)) {\n"
+          "    return NULL;\n"
+          "  }\n"
+          "  return sub;\n"
+          "}\n",
+          MessageName(ext->message_type()), prefix, ext->name(), extendee,
+          layout, MessageInit(ext->message_type()),
+          GetSizeInit(MessageLayout::SizeOfUnwrapped(ext).size),
+          ArrayInitSize(ext), UpbType(ext));
+    } else {
+      output(
+          "UPB_INLINE bool $1add_$2($3 *msg, $0 val, upb_arena *arena) {\n"
+          "  upb_msg_ext *ext = _upb_msg_getorcreateext(msg, &$4, arena);\n"
+          "  return ext && _upb_array_append_accessor(&ext->data, 0, $5, $6, "
+          "$7,\n"
+          "                                           &val, arena);\n"
+          "}\n",
+          CType(ext), prefix, ext->name(), extendee, layout,
+          GetSizeInit(MessageLayout::SizeOfUnwrapped(ext).size),
+          ArrayInitSize(ext), UpbType(ext));
+    }
+  } else {
+    output(
+        "UPB_INLINE $0 $1$2(const $3 *msg) {\n"
+        "  const upb_msg_ext *ext = _upb_msg_getext(msg, &$4);\n"
+        "  return ext ? *($0 const*)&ext->data : $5;\n"
+        "}\n"
+        "UPB_INLINE bool $1set_$2($3 *msg, $6 val, upb_arena *arena) {\n"
+        "  upb_msg_ext *ext = _upb_msg_getorcreateext(msg, &$4, arena);\n"
+        "  if (!ext) return false;\n"
+        "  *($6*)&ext->data = val;\n"
+        "  return true;\n"
+        "}\n",
+        CTypeConst(ext), prefix, ext->name(), extendee, layout,
+        FieldDefault(ext), CType(ext));
+    if (is_message) {
+      output(
+          "UPB_INLINE struct $0* $1mutable_$2($3 *msg, upb_arena *arena) {\n"
+          "  upb_msg_ext *ext = _upb_msg_getorcreateext(msg, &$4, arena);\n"
+          "  if (!ext) return NULL;\n"
+          "  if (!ext->data.ptr) ext->data.ptr = upb_msg_new(&$5, arena);\n"
+          "  return (struct $0*)ext->data.ptr;\n"
+          "}\n",
+          MessageName(ext->message_type()), prefix, ext->name(), extendee,
+          layout, MessageInit(ext->message_type()));
+    }
+  }
+
+  output("\n");
+}
+
+void WriteHeader(const protobuf::FileDescriptor* file, const Options& options,
+                 Output& output) {
   EmitFileWarning(file, output);
   output(
       "#ifndef $0_UPB_H_\n"
@@ -533,11 +776,28 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
   for (auto message : this_file_messages) {
     output("extern const upb_msglayout $0;\n", MessageInit(message));
   }
+  std::vector<const protobuf::FieldDescriptor*> this_file_exts =
+      SortedExtensions(file);
+  for (auto ext : this_file_exts) {
+    output("extern const upb_msglayout_ext $0;\n", ExtensionLayout(ext));
+  }
 
-  // Forward-declare types not in this file, but used as submessages.
-  // Order by full name for consistent ordering.
+  // Forward-declare types not in this file, but used as submessages or by
+  // extensions.  Order by full name for consistent ordering.
   std::map<std::string, const protobuf::Descriptor*> forward_messages;
 
+  for (auto ext : this_file_exts) {
+    if (ext->containing_type()->file() != file) {
+      forward_messages[ext->containing_type()->full_name()] =
+          ext->containing_type();
+    }
+    if (ext->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE &&
+        ext->message_type()->file() != file) {
+      forward_messages[ext->message_type()->full_name()] =
+          ext->message_type();
+    }
+  }
+
   for (auto message : SortedMessages(file)) {
     for (int i = 0; i < message->field_count(); i++) {
       const protobuf::FieldDescriptor* field = message->field(i);
@@ -555,7 +815,7 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
     output("extern const upb_msglayout $0;\n", MessageInit(pair.second));
   }
 
-  if (!this_file_messages.empty()) {
+  if (!this_file_messages.empty() || !this_file_exts.empty()) {
     output("\n");
   }
 
@@ -571,7 +831,23 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
   output("\n");
 
   for (auto message : this_file_messages) {
-    GenerateMessageInHeader(message, output);
+    GenerateMessageInHeader(message, options, output);
+  }
+
+  for (auto ext : this_file_exts) {
+    GenerateExtensionInHeader(ext, output);
+  }
+
+  if (!this_file_exts.empty()) {
+    // Registers the extensions of this file for upb_decode_withexts().
+    output("UPB_INLINE bool $0_addexts(upb_extreg *r) {\n",
+           ToCIdent(file->name()));
+    for (size_t i = 0; i < this_file_exts.size(); i++) {
+      output("  $0upb_extreg_add(r, &$1)$2\n", i == 0 ? "return " : "       ",
+             ExtensionLayout(this_file_exts[i]),
+             i == this_file_exts.size() - 1 ? ";" : " &&");
+    }
+    output("}\n\n");
   }
 
   output(
@@ -585,13 +861,493 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
       ToPreproc(file->name()));
 }
 
-void WriteSource(const protobuf::FileDescriptor* file, Output& output) {
+// Returns the type part of the fast table parser name for this field (see
+// upb/decode_fast.h), or "" if the field can't use a specialized parser.
+std::string FastParserType(const protobuf::FieldDescriptor* field) {
+  if (field->containing_oneof() || field->is_packed() || field->is_map() ||
+      IsLazy(field)) {
+    return "";
+  }
+
+  switch (field->type()) {
+    case protobuf::FieldDescriptor::TYPE_BOOL:
+      return "b1";
+    case protobuf::FieldDescriptor::TYPE_INT32:
+    case protobuf::FieldDescriptor::TYPE_UINT32:
+    case protobuf::FieldDescriptor::TYPE_ENUM:
+      return "v4";
+    case protobuf::FieldDescriptor::TYPE_INT64:
+    case protobuf::FieldDescriptor::TYPE_UINT64:
+      return "v8";
+    case protobuf::FieldDescriptor::TYPE_SINT32:
+      return "z4";
+    case protobuf::FieldDescriptor::TYPE_SINT64:
+      return "z8";
+    case protobuf::FieldDescriptor::TYPE_FLOAT:
+    case protobuf::FieldDescriptor::TYPE_FIXED32:
+    case protobuf::FieldDescriptor::TYPE_SFIXED32:
+      return "f4";
+    case protobuf::FieldDescriptor::TYPE_DOUBLE:
+    case protobuf::FieldDescriptor::TYPE_FIXED64:
+    case protobuf::FieldDescriptor::TYPE_SFIXED64:
+      return "f8";
+    case protobuf::FieldDescriptor::TYPE_STRING:
+    case protobuf::FieldDescriptor::TYPE_BYTES:
+      return "s";
+    case protobuf::FieldDescriptor::TYPE_MESSAGE:
+      return "m";
+    default:
+      return "";
+  }
+}
+
+int FastWireType(const std::string& type) {
+  if (type == "f4") return 5;
+  if (type == "f8") return 1;
+  if (type == "s" || type == "m") return 2;
+  return 0;
+}
+
+// A fast table entry for one field: the parser (see upb/decode_fast.h), its
+// field data, and the tag as it appears on the wire, first byte in the low
+// bits.
+struct FastEntry {
+  std::string parser;
+  std::string data;
+  std::string type;  // The type part of the parser name.
+  bool repeated;
+  uint32_t tag;
+  int tagbytes;
+};
+
+// Fills in |entry| for |field|, or returns false if the field can't use a
+// specialized parser.
+bool GetFastEntry(const protobuf::FieldDescriptor* field,
+                  const MessageLayout& layout,
+                  const absl::flat_hash_map<const protobuf::Descriptor*, int>&
+                      submsg_indexes,
+                  FastEntry* entry) {
+  std::string type = FastParserType(field);
+  int submsg_index = 0;
+  int hasbit = 0;
+
+  if (type.empty() || field->number() >= 2048) return false;
+
+  if (field->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+    submsg_index = submsg_indexes.at(field->message_type());
+  }
+
+  if (MessageLayout::HasHasbit(field)) {
+    hasbit = layout.GetHasbitIndex(field);
+  }
+
+  if (submsg_index > 255 || hasbit > 255) return false;
+
+  entry->tag = (field->number() << 3) | FastWireType(type);
+  entry->tagbytes = 1;
+  if (entry->tag > 0x7f) {
+    entry->tag = (entry->tag & 0x7f) | 0x80 | ((entry->tag >> 7) << 8);
+    entry->tagbytes = 2;
+  }
+
+  entry->type = type;
+  entry->repeated = field->is_repeated();
+  entry->parser = absl::Substitute("upb_p$0$1_$2bt",
+                                   field->is_repeated() ? "r" : "s", type,
+                                   entry->tagbytes);
+  entry->data = absl::Substitute("UPB_FASTDATA(0x$0, $1, $2, $3)",
+                                 absl::Hex(entry->tag), submsg_index, hasbit,
+                                 GetSizeInit(layout.GetFieldOffset(field)));
+  return true;
+}
+
+// Builds the fast table entries for this message, as pairs of parser
+// function and field data.  Returns an empty vector if no field can use a
+// specialized parser.
+std::vector<std::pair<std::string, std::string>> FastTable(
+    const protobuf::Descriptor* message, const MessageLayout& layout,
+    const absl::flat_hash_map<const protobuf::Descriptor*, int>&
+        submsg_indexes) {
+  std::vector<std::pair<std::string, std::string>> table(32);
+  size_t size = 0;
+
+  for (auto field : FieldNumberOrder(message)) {
+    FastEntry entry;
+    if (!GetFastEntry(field, layout, submsg_indexes, &entry)) continue;
+
+    // Fields are in number order, so on a collision the lower number wins.
+    size_t slot = (entry.tag & 0xf8) >> 3;
+    if (!table[slot].first.empty()) continue;
+
+    table[slot].first = entry.parser;
+    table[slot].second = entry.data;
+    while (size <= slot) size = size ? size * 2 : 1;
+  }
+
+  table.resize(size);
+  for (auto& entry : table) {
+    if (entry.first.empty()) {
+      entry.first = "_upb_fastdecode_generic";
+      entry.second = "0";
+    }
+  }
+
+  return table;
+}
+
+// Returns a call of the inline parser in upb/decode_fast.int.h that
+// upb_p{card}{type}_{tagbytes}bt() wraps, for |entry| and the tag in |tag|.
+std::string FastParserCall(const FastEntry& entry, const std::string& tag) {
+  std::string args = absl::Substitute("d, msg, l, $0 ^ $1, $2", entry.data, tag,
+                                      entry.tagbytes);
+  std::string repeated = entry.repeated ? "true" : "false";
+  if (entry.type == "s") {
+    return absl::Substitute("_upb_fastdecode_string($0, $1)", args, repeated);
+  } else if (entry.type == "m") {
+    return absl::Substitute("_upb_fastdecode_submsg($0, $1)", args, repeated);
+  } else {
+    return absl::Substitute("_upb_fastdecode_scalar($0, _UPB_FASTDECODE_$1, $2)",
+                            args, absl::AsciiStrToUpper(entry.type), repeated);
+  }
+}
+
+// Writes a parser for the fields that the profile says |message| usually
+// has, in number order, which is the order encoders write them in.  It goes
+// in the fast table slot of the first of them and checks for each of the
+// others in turn, skipping the ones that are absent, with the field data
+// inlined as constants.  The first tag that isn't in the rest of the sequence
+// goes back to the fast table loop.
+void WriteHotParser(const protobuf::Descriptor* message,
+                    const MessageLayout& layout,
+                    const absl::flat_hash_map<const protobuf::Descriptor*,
+                                              int>& submsg_indexes,
+                    const FieldProfile& profile,
+                    std::vector<std::pair<std::string, std::string>>* table,
+                    Output& output) {
+  std::vector<FastEntry> sequence;
+  for (auto field : FieldNumberOrder(message)) {
+    FastEntry entry;
+    if (profile.Count(field) > 0 &&
+        GetFastEntry(field, layout, submsg_indexes, &entry)) {
+      sequence.push_back(entry);
+    }
+  }
+
+  // A single field gains nothing, and the first one has to own its slot.
+  if (sequence.size() < 2) return;
+  auto& slot = (*table)[(sequence[0].tag & 0xf8) >> 3];
+  if (slot.first != sequence[0].parser || slot.second != sequence[0].data) {
+    return;
+  }
+
+  std::string name = ToCIdent(message->full_name()) + "__hotparse";
+  output("/* The usual fields of $0, in a row. */\n", message->full_name());
+  output(
+      "static bool $0(struct upb_decstate *d, upb_msg *msg,\n"
+      "    const upb_msglayout *l, uint64_t data) {\n"
+      "  uint64_t tag = (data ^ $1) & 0xffff;\n"
+      "  if (!$2) return false;\n"
+      "  if (!_upb_fastdecode_peektag(d, &tag)) return true;\n",
+      name, sequence[0].data, FastParserCall(sequence[0], "tag"));
+  for (size_t i = 1; i < sequence.size(); i++) {
+    const FastEntry& entry = sequence[i];
+    output(
+        "  if (($0)(tag ^ 0x$1) == 0) {\n"
+        "    if (!$2) return false;\n",
+        entry.tagbytes == 1 ? "uint8_t" : "uint16_t", absl::Hex(entry.tag),
+        FastParserCall(entry, "tag"));
+    if (i + 1 < sequence.size()) {
+      output("    if (!_upb_fastdecode_peektag(d, &tag)) return true;\n");
+    }
+    output("  }\n");
+  }
+  output(
+      "  return true;\n"
+      "}\n\n");
+
+  slot.first = name;
+}
+
+// The name of the serializer generated for |message| with the "serializers"
+// option.  Map entries don't get one: upb_encode() writes maps itself.
+std::string EncoderName(const protobuf::Descriptor* message) {
+  return ToCIdent(message->full_name()) + "__encode";
+}
+
+bool HasEncoder(const protobuf::Descriptor* message, const Options& options) {
+  return options.serializers && !message->options().map_entry();
+}
+
+// Returns the tag of |field| as a C string literal of its encoded bytes,
+// followed by their count, eg. "\"\\012\", 1".
+std::string EncodedTag(const protobuf::FieldDescriptor* field, int wire_type) {
+  uint64_t tag = (static_cast<uint64_t>(field->number()) << 3) | wire_type;
+  std::string bytes;
+  int len = 0;
+  do {
+    int byte = (tag & 0x7f) | (tag > 0x7f ? 0x80 : 0);
+    tag >>= 7;
+    bytes += absl::StrCat("\\", byte >> 6, (byte >> 3) & 7, byte & 7);
+    len++;
+  } while (tag);
+  return absl::Substitute("\"$0\", $1", bytes, len);
+}
+
+// Returns the C type that a varint field of |type| is stored as, or "" if the
+// type isn't a varint.
+std::string VarintCType(protobuf::FieldDescriptor::Type type) {
+  switch (type) {
+    case protobuf::FieldDescriptor::TYPE_INT64:
+    case protobuf::FieldDescriptor::TYPE_UINT64:
+      return "uint64_t";
+    case protobuf::FieldDescriptor::TYPE_SINT64:
+      return "int64_t";
+    case protobuf::FieldDescriptor::TYPE_UINT32:
+      return "uint32_t";
+    case protobuf::FieldDescriptor::TYPE_INT32:
+    case protobuf::FieldDescriptor::TYPE_SINT32:
+    case protobuf::FieldDescriptor::TYPE_ENUM:
+      return "int32_t";
+    case protobuf::FieldDescriptor::TYPE_BOOL:
+      return "bool";
+    default:
+      return "";
+  }
+}
+
+// Returns the value of the varint field of |type| at |ptr| as the uint64_t
+// that the encoder writes.
+std::string EncodedVarint(protobuf::FieldDescriptor::Type type,
+                          const std::string& ptr) {
+  std::string val =
+      absl::Substitute("*(const $0*)$1", VarintCType(type), ptr);
+  switch (type) {
+    case protobuf::FieldDescriptor::TYPE_INT32:
+    case protobuf::FieldDescriptor::TYPE_ENUM:
+      return "(int64_t)" + val;
+    case protobuf::FieldDescriptor::TYPE_SINT32:
+      return "_upb_zzencode_32(" + val + ")";
+    case protobuf::FieldDescriptor::TYPE_SINT64:
+      return "_upb_zzencode_64(" + val + ")";
+    default:
+      return val;
+  }
+}
+
+// The size of a fixed-width field of |type|, or 0 if it is not one.
+int FixedSize(protobuf::FieldDescriptor::Type type) {
+  switch (type) {
+    case protobuf::FieldDescriptor::TYPE_DOUBLE:
+    case protobuf::FieldDescriptor::TYPE_FIXED64:
+    case protobuf::FieldDescriptor::TYPE_SFIXED64:
+      return 8;
+    case protobuf::FieldDescriptor::TYPE_FLOAT:
+    case protobuf::FieldDescriptor::TYPE_FIXED32:
+    case protobuf::FieldDescriptor::TYPE_SFIXED32:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// Returns the call that encodes the submessage |sub| of field |field| and sets
+// |sub_size|, calling the generated serializer directly when it is in this file.
+std::string SubmsgEncodeCall(const protobuf::FieldDescriptor* field,
+                             const std::string& sub,
+                             const absl::flat_hash_map<
+                                 const protobuf::Descriptor*, int>&
+                                 submsg_indexes,
+                             const Options& options) {
+  const protobuf::Descriptor* type = field->message_type();
+  if (type->file() == field->file() && HasEncoder(type, options)) {
+    return absl::Substitute("$0(e, $1, &$2, &sub_size)", EncoderName(type), sub,
+                            MessageInit(type));
+  }
+  return absl::Substitute(
+      "_upb_encode_message(e, $0, l->submsgs[$1], &sub_size)", sub,
+      submsg_indexes.at(type));
+}
+
+// Writes the serializer for |message|, which upb_encode() calls through its
+// layout.  It writes the fields backwards like the generic encoder, with the
+// same output, but with each field's type, presence check, offset and encoded
+// tag spelled out.  Maps, groups and lazy fields are left to the generic
+// encoder's _upb_encode_field().
+void WriteEncoder(const protobuf::Descriptor* message,
+                  const MessageLayout& layout,
+                  const absl::flat_hash_map<const protobuf::Descriptor*, int>&
+                      submsg_indexes,
+                  const Options& options, Output& output) {
+  std::vector<const protobuf::FieldDescriptor*> fields =
+      FieldNumberOrder(message);
+
+  output(
+      "static bool $0(struct upb_encstate *e, const char *msg,\n"
+      "    const upb_msglayout *l, size_t *size) {\n"
+      "  size_t pre_len = e->limit - e->ptr;\n"
+      "  UPB_UNUSED(l);\n",
+      EncoderName(message));
+
+  for (int i = fields.size() - 1; i >= 0; i--) {
+    const protobuf::FieldDescriptor* field = fields[i];
+    std::string ptr =
+        absl::StrCat("(msg + ", GetSizeInit(layout.GetFieldOffset(field)), ")");
+    std::string ctype = VarintCType(field->type());
+    int fixed = FixedSize(field->type());
+    bool is_string =
+        field->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_STRING;
+
+    if (field->is_map() || IsLazy(field) ||
+        field->type() == protobuf::FieldDescriptor::TYPE_GROUP) {
+      output(
+          "  if (!_upb_encode_field(e, msg, l, &l->fields[$0])) return false;\n",
+          i);
+      continue;
+    }
+
+    if (field->is_repeated()) {
+      std::string arr = absl::StrCat("*(const upb_array**)", ptr);
+      if (is_string) {
+        output(
+            "  if (!_upb_encode_strarray(e, $0, $1)) return false;\n",
+            arr, EncodedTag(field, 2));
+      } else if (fixed) {
+        output(
+            "  if (!_upb_encode_fixedarray(e, $0, $1, $2)) return false;\n",
+            arr, fixed, EncodedTag(field, 2));
+      } else if (!ctype.empty()) {
+        // Packed, like everything the generic encoder writes.
+        output(
+            "  {\n"
+            "    const upb_array *arr = $0;\n"
+            "    if (arr && arr->len) {\n"
+            "      const $1 *start = (const $1*)arr->data;\n"
+            "      const $1 *ptr = start + arr->len;\n"
+            "      size_t arr_start = e->limit - e->ptr;\n"
+            "      do {\n"
+            "        ptr--;\n"
+            "        if (!_upb_encode_varint(e, $2)) return false;\n"
+            "      } while (ptr != start);\n"
+            "      if (!_upb_encode_varint(e, e->limit - e->ptr - arr_start) ||\n"
+            "          !_upb_encode_tag(e, $3)) {\n"
+            "        return false;\n"
+            "      }\n"
+            "    }\n"
+            "  }\n",
+            arr, ctype, EncodedVarint(field->type(), "ptr"),
+            EncodedTag(field, 2));
+      } else {
+        output(
+            "  {\n"
+            "    const upb_array *arr = $0;\n"
+            "    if (arr && arr->len) {\n"
+            "      const char *const *start = (const char *const*)arr->data;\n"
+            "      const char *const *ptr = start + arr->len;\n"
+            "      do {\n"
+            "        size_t sub_size;\n"
+            "        ptr--;\n"
+            "        if (!$1 ||\n"
+            "            !_upb_encode_varint(e, sub_size) ||\n"
+            "            !_upb_encode_tag(e, $2)) {\n"
+            "          return false;\n"
+            "        }\n"
+            "      } while (ptr != start);\n"
+            "    }\n"
+            "  }\n",
+            arr, SubmsgEncodeCall(field, "*ptr", submsg_indexes, options),
+            EncodedTag(field, 2));
+      }
+      continue;
+    }
+
+    // Singular fields: the presence check, then the value and tag.
+    std::string has;
+    if (MessageLayout::HasHasbit(field)) {
+      has = absl::Substitute("_upb_has_field(msg, $0)",
+                             layout.GetHasbitIndex(field));
+    } else if (field->containing_oneof()) {
+      has = absl::Substitute(
+          "_upb_has_oneof_field(msg, $0, $1)",
+          GetSizeInit(layout.GetOneofCaseOffset(field->containing_oneof())),
+          field->number());
+    }
+
+    std::string put;
+    if (field->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+      output(
+          "  {\n"
+          "    const char *sub = *(const char**)$0;\n"
+          "    size_t sub_size;\n"
+          "    if ($1sub &&\n"
+          "        (!$2 ||\n"
+          "         !_upb_encode_varint(e, sub_size) ||\n"
+          "         !_upb_encode_tag(e, $3))) {\n"
+          "      return false;\n"
+          "    }\n"
+          "  }\n",
+          ptr, has.empty() ? "" : has + " && ",
+          SubmsgEncodeCall(field, "sub", submsg_indexes, options),
+          EncodedTag(field, 2));
+      continue;
+    } else if (is_string) {
+      if (has.empty()) {
+        has = absl::StrCat("((const upb_strview*)", ptr, ")->size");
+      }
+      put = absl::Substitute(
+          "_upb_encode_strfield(e, *(const upb_strview*)$0, $1)", ptr,
+          EncodedTag(field, 2));
+    } else if (fixed) {
+      ctype =
+          field->type() == protobuf::FieldDescriptor::TYPE_DOUBLE  ? "double"
+          : field->type() == protobuf::FieldDescriptor::TYPE_FLOAT ? "float"
+          : fixed == 8                                            ? "uint64_t"
+                                                                  : "uint32_t";
+      if (has.empty()) {
+        has = absl::Substitute("*(const $0*)$1 != 0", ctype, ptr);
+      }
+      put = absl::Substitute("_upb_encode_bytes(e, $0, $1) &&\n"
+                             "      _upb_encode_tag(e, $2)",
+                             ptr, fixed, EncodedTag(field, fixed == 8 ? 1 : 5));
+    } else {
+      if (has.empty()) {
+        has = absl::Substitute("*(const $0*)$1 != 0", ctype, ptr);
+      }
+      put = absl::Substitute("_upb_encode_varint(e, $0) &&\n"
+                             "      _upb_encode_tag(e, $1)",
+                             EncodedVarint(field->type(), ptr),
+                             EncodedTag(field, 0));
+    }
+    output(
+        "  if ($0 &&\n"
+        "      !($1)) {\n"
+        "    return false;\n"
+        "  }\n",
+        has, put);
+  }
+
+  if (message->extension_range_count() > 0) {
+    output("  if (!_upb_encode_exts(e, msg, l)) return false;\n");
+  }
+  output(
+      "  if (!_upb_encode_unknown(e, msg)) return false;\n"
+      "  *size = (e->limit - e->ptr) - pre_len;\n"
+      "  return true;\n"
+      "}\n\n");
+}
+
+void WriteSource(const protobuf::FileDescriptor* file, const Options& options,
+                 Output& output) {
   EmitFileWarning(file, output);
 
   output(
       "#include <stddef.h>\n"
       "#include \"upb/msg.h\"\n"
-      "#include \"$0\"\n",
+      "#include \"upb/decode_fast.h\"\n"
+      "$0"
+      "$1"
+      "#include \"$2\"\n",
+      options.profile.empty() ? "" : "#include \"upb/decode_fast.int.h\"\n",
+      options.serializers ? "#include \"upb/encode.int.h\"\n" : "",
       HeaderFilename(file->name()));
 
   for (int i = 0; i < file->dependency_count(); i++) {
@@ -603,6 +1359,17 @@ void WriteSource(const protobuf::FileDescriptor* file, Output& output) {
       "#include \"upb/port_def.inc\"\n"
       "\n");
 
+  // Serializers call each other directly for submessages of this file.
+  bool any_encoder = false;
+  for (auto message : SortedMessages(file)) {
+    if (!HasEncoder(message, options)) continue;
+    output(
+        "static bool $0(struct upb_encstate *e, const char *msg,\n"
+        "    const upb_msglayout *l, size_t *size);\n",
+        EncoderName(message));
+    any_encoder = true;
+  }
+  if (any_encoder) output("\n");
 
   for (auto message : SortedMessages(file)) {
     std::string msgname = ToCIdent(message->full_name());
@@ -610,7 +1377,7 @@ void WriteSource(const protobuf::FileDescriptor* file, Output& output) {
     std::string submsgs_array_ref = "NULL";
     std::string oneofs_array_ref = "NULL";
     absl::flat_hash_map<const protobuf::Descriptor*, int> submsg_indexes;
-    MessageLayout layout(message);
+    MessageLayout layout(message, &options.profile);
     std::vector<const protobuf::FieldDescriptor*> sorted_submsgs =
         SortedSubmessages(message);
 
@@ -668,19 +1435,90 @@ void WriteSource(const protobuf::FileDescriptor* file, Output& output) {
                presence,
                submsg_index,
                field->type(),
-               field->label());
+               field->is_map() ? "_UPB_LABEL_MAP"
+               : IsLazy(field) ? "_UPB_LABEL_LAZY"
+                               : absl::StrCat(field->label()));
+      }
+      output("};\n\n");
+    }
+
+    // Fields numbered 1..dense_below can be found by direct index.
+    size_t dense_below = 0;
+    while (dense_below < field_number_order.size() && dense_below < 255 &&
+           field_number_order[dense_below]->number() ==
+               static_cast<int>(dense_below + 1)) {
+      dense_below++;
+    }
+
+    std::vector<std::pair<std::string, std::string>> fasttable =
+        FastTable(message, layout, submsg_indexes);
+    int rank = options.profile.MessageRank(message);
+    if (rank >= 0 && rank < options.specialize) {
+      WriteHotParser(message, layout, submsg_indexes, options.profile,
+                     &fasttable, output);
+    }
+    std::string fasttable_ref = "NULL";
+    if (!fasttable.empty()) {
+      std::string fasttable_name = msgname + "__fasttable";
+      fasttable_ref = "&" + fasttable_name + "[0]";
+      output("static const _upb_fasttable_entry $0[$1] = {\n",
+             fasttable_name, fasttable.size());
+      for (const auto& entry : fasttable) {
+        output("  {&$0, $1},\n", entry.first, entry.second);
+      }
+      output("};\n\n");
+    }
+
+    std::string encoder_ref = "NULL";
+    if (HasEncoder(message, options)) {
+      WriteEncoder(message, layout, submsg_indexes, options, output);
+      encoder_ref = "&" + EncoderName(message);
+    }
+
+    std::string zero_ranges_ref = "NULL";
+    if (SparseInit(layout)) {
+      std::string zero_ranges_name = msgname + "__zero";
+      zero_ranges_ref = "&" + zero_ranges_name + "[0]";
+      output("static const _upb_zerorange $0[$1] = {\n", zero_ranges_name,
+             layout.zero_ranges().size() + 1);
+      for (const auto& range : layout.zero_ranges()) {
+        output("  {$0, $1},\n", GetSizeInit(range.offset),
+               GetSizeInit(range.size));
       }
+      output("  {0, 0},\n");
       output("};\n\n");
     }
 
+    if (layout.hot_count() > 0) {
+      output("/* Hot fields end at offset $0 of $1. */\n",
+             GetSizeInit(layout.hot_size()),
+             GetSizeInit(layout.message_size()));
+    }
     output("const upb_msglayout $0 = {\n", MessageInit(message));
     output("  $0,\n", submsgs_array_ref);
     output("  $0,\n", fields_array_ref);
-    output("  $0, $1, $2,\n", GetSizeInit(layout.message_size()),
+    output("  $0, $1, $2, $3,\n", GetSizeInit(layout.message_size()),
            field_number_order.size(),
-           "false"  // TODO: extendable
+           message->extension_range_count() > 0 ? "true" : "false",
+           dense_below
     );
+    output("  $0, 0x$1,\n", fasttable_ref,
+           absl::Hex(fasttable.empty() ? 0 : (fasttable.size() - 1) << 3));
+    output("  $0,\n", encoder_ref);
+    output("  $0,\n", zero_ranges_ref);
+
+    output("};\n\n");
+  }
 
+  for (auto ext : SortedExtensions(file)) {
+    output("const upb_msglayout_ext $0 = {\n", ExtensionLayout(ext));
+    output("  {$0, 0, 0, 0, $1, $2},\n", ext->number(), ext->type(),
+           ext->label());
+    output("  &$0,\n", MessageInit(ext->containing_type()));
+    output("  $0,\n",
+           ext->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE
+               ? "&" + MessageInit(ext->message_type())
+               : "NULL");
     output("};\n\n");
   }
 
@@ -803,11 +1641,33 @@ bool Generator::Generate(const protobuf::FileDescriptor* file,
                          const std::string& parameter,
                          protoc::GeneratorContext* context,
                          std::string* error) const {
+  std::vector<std::pair<std::string, std::string>> params;
+  Options options;
+  protoc::ParseGeneratorParameter(parameter, &params);
+  for (const auto& param : params) {
+    if (param.first == "layout_profile") {
+      if (!options.profile.Load(param.second, error)) return false;
+    } else if (param.first == "specialize") {
+      if (!absl::SimpleAtoi(param.second, &options.specialize)) {
+        *error = "Bad value for specialize: " + param.second;
+        return false;
+      }
+    } else if (param.first == "serializers") {
+      if (!absl::SimpleAtob(param.second, &options.serializers)) {
+        *error = "Bad value for serializers: " + param.second;
+        return false;
+      }
+    } else {
+      *error = "Unknown parameter: " + param.first;
+      return false;
+    }
+  }
+
   Output h_output(context->Open(HeaderFilename(file->name())));
-  WriteHeader(file, h_output);
+  WriteHeader(file, options, h_output);
 
   Output c_output(context->Open(SourceFilename(file->name())));
-  WriteSource(file, c_output);
+  WriteSource(file, options, c_output);
 
   Output h_def_output(context->Open(DefHeaderFilename(file->name())));
   WriteDefHeader(file, h_def_output);
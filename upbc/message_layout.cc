@@ -1,6 +1,8 @@
 
 #include "upbc/message_layout.h"
 
+#include <algorithm>
+
 namespace upbc {
 
 namespace protobuf = ::google::protobuf;
@@ -101,34 +103,173 @@ int64_t MessageLayout::FieldLayoutRank(const protobuf::FieldDescriptor* field) {
   return (rank << 29) | field->number();
 }
 
-void MessageLayout::ComputeLayout(const protobuf::Descriptor* descriptor) {
+MessageLayout::SizeAndAlign MessageLayout::SizeOf(
+    const protobuf::OneofDescriptor* oneof) {
+  SizeAndAlign maxsize{{0, 0}, {0, 0}};
+  for (int i = 0; i < oneof->field_count(); i++) {
+    maxsize.MaxFrom(SizeOf(oneof->field(i)));
+  }
+  return maxsize;
+}
+
+void MessageLayout::ComputeLayout(const protobuf::Descriptor* descriptor,
+                                  const FieldProfile* profile) {
+  std::vector<const protobuf::FieldDescriptor*> hot_fields;
+  std::vector<const protobuf::FieldDescriptor*> cold_fields;
+  std::vector<const protobuf::OneofDescriptor*> hot_oneofs;
+  std::vector<const protobuf::OneofDescriptor*> cold_oneofs;
+
+  for (int i = 0; i < descriptor->field_count(); i++) {
+    const protobuf::FieldDescriptor* field = descriptor->field(i);
+    if (!field->containing_oneof()) {
+      cold_fields.push_back(field);
+    }
+  }
+  for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
+    cold_oneofs.push_back(descriptor->oneof_decl(i));
+  }
+
+  if (profile && !profile->empty()) {
+    // Candidates are fields and whole oneofs, hottest first.  We take each one
+    // that still fits, so a big field doesn't keep smaller, colder ones out.
+    struct Candidate {
+      int64_t count;
+      int64_t size;
+      const protobuf::FieldDescriptor* field;
+      const protobuf::OneofDescriptor* oneof;
+    };
+    std::vector<Candidate> candidates;
+    for (auto field : cold_fields) {
+      int64_t count = profile->Count(field);
+      if (count > 0) {
+        candidates.push_back({count, SizeOf(field).size.size64, field,
+                              nullptr});
+      }
+    }
+    for (auto oneof : cold_oneofs) {
+      int64_t count = 0;
+      for (int i = 0; i < oneof->field_count(); i++) {
+        count += profile->Count(oneof->field(i));
+      }
+      if (count > 0) {
+        candidates.push_back({count, SizeOf(oneof).size.size64 + 4, nullptr,
+                              oneof});
+      }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) {
+                       return a.count > b.count;
+                     });
+
+    int hasbit_count = 0;
+    for (auto field : cold_fields) {
+      if (HasHasbit(field)) hasbit_count++;
+    }
+    // Hasbit 0 is unused, see PlaceHasbits().
+    int64_t hot = hasbit_count ? DivRoundUp(hasbit_count + 1, 8) : 0;
+    for (const auto& c : candidates) {
+      if (hot + c.size > kHotBytes) continue;
+      hot += c.size;
+      if (c.field) {
+        hot_fields.push_back(c.field);
+        cold_fields.erase(
+            std::find(cold_fields.begin(), cold_fields.end(), c.field));
+      } else {
+        hot_oneofs.push_back(c.oneof);
+        cold_oneofs.erase(
+            std::find(cold_oneofs.begin(), cold_oneofs.end(), c.oneof));
+      }
+    }
+  }
+
+  auto by_rank = [](const protobuf::FieldDescriptor* a,
+                    const protobuf::FieldDescriptor* b) {
+    return FieldLayoutRank(a) < FieldLayoutRank(b);
+  };
+  auto by_name = [](const protobuf::OneofDescriptor* a,
+                    const protobuf::OneofDescriptor* b) {
+    return a->full_name() < b->full_name();
+  };
+  std::sort(hot_fields.begin(), hot_fields.end(), by_rank);
+  std::sort(cold_fields.begin(), cold_fields.end(), by_rank);
+  std::sort(hot_oneofs.begin(), hot_oneofs.end(), by_name);
+  std::sort(cold_oneofs.begin(), cold_oneofs.end(), by_name);
+
+  std::vector<const protobuf::FieldDescriptor*> field_order = hot_fields;
+  field_order.insert(field_order.end(), cold_fields.begin(),
+                     cold_fields.end());
+
   size_ = Size{0, 0};
   maxalign_ = Size{0, 0};
-  PlaceNonOneofFields(descriptor);
-  PlaceOneofFields(descriptor);
+  PlaceHasbits(field_order);
+  PlaceNonOneofFields(hot_fields);
+  PlaceOneofFields(hot_oneofs);
+  hot_size_ = size_;
+  hot_count_ = hot_fields.size() + hot_oneofs.size();
+  PlaceNonOneofFields(cold_fields);
+  PlaceOneofFields(cold_oneofs);
 
   // Align overall size up to max size.
   size_.AlignUp(maxalign_);
+
+  ComputeZeroRanges(descriptor);
 }
 
-void MessageLayout::PlaceNonOneofFields(
-    const protobuf::Descriptor* descriptor) {
-  std::vector<const protobuf::FieldDescriptor*> field_order;
+void MessageLayout::ComputeZeroRanges(const protobuf::Descriptor* descriptor) {
+  std::vector<ZeroRange> ranges;
+  if (hasbit_bytes_.size64 > 0) {
+    ranges.push_back({Size{0, 0}, hasbit_bytes_});
+  }
   for (int i = 0; i < descriptor->field_count(); i++) {
     const protobuf::FieldDescriptor* field = descriptor->field(i);
-    if (!field->containing_oneof()) {
-      field_order.push_back(descriptor->field(i));
+    if (!HasHasbit(field) && !field->containing_oneof()) {
+      ranges.push_back({GetFieldOffset(field), SizeOf(field).size});
+    }
+  }
+  for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
+    ranges.push_back({GetOneofCaseOffset(descriptor->oneof_decl(i)),
+                      Size{4, 4}});
+  }
+
+  // Fields are placed in the same order on both platforms.
+  std::sort(ranges.begin(), ranges.end(),
+            [](const ZeroRange& a, const ZeroRange& b) {
+              return a.offset.size64 < b.offset.size64;
+            });
+
+  zero_ranges_.clear();
+  zero_size_ = Size{0, 0};
+  for (const auto& range : ranges) {
+    if (!zero_ranges_.empty()) {
+      ZeroRange& last = zero_ranges_.back();
+      int64_t gap32 =
+          range.offset.size32 - last.offset.size32 - last.size.size32;
+      int64_t gap64 =
+          range.offset.size64 - last.offset.size64 - last.size.size64;
+      if (gap32 <= kZeroGap && gap64 <= kZeroGap) {
+        zero_size_.size32 += gap32 + range.size.size32;
+        zero_size_.size64 += gap64 + range.size.size64;
+        last.size.size32 += gap32 + range.size.size32;
+        last.size.size64 += gap64 + range.size.size64;
+        continue;
+      }
     }
+    zero_ranges_.push_back(range);
+    zero_size_.Add(range.size);
   }
-  std::sort(field_order.begin(), field_order.end(),
+}
+
+void MessageLayout::PlaceHasbits(
+    std::vector<const protobuf::FieldDescriptor*> fields) {
+  // Number hasbits in field number order, as upb_msglayout requires: the
+  // encoder relies on it to skip runs of absent fields.
+  std::sort(fields.begin(), fields.end(),
             [](const protobuf::FieldDescriptor* a,
                const protobuf::FieldDescriptor* b) {
-              return FieldLayoutRank(a) < FieldLayoutRank(b);
+              return a->number() < b->number();
             });
-
-  // Place/count hasbits.
   int hasbit_count = 0;
-  for (auto field : field_order) {
+  for (auto field : fields) {
     if (HasHasbit(field)) {
       // We don't use hasbit 0, so that 0 can indicate "no presence" in the
       // table. This wastes one hasbit, but we don't worry about it for now.
@@ -136,36 +277,27 @@ void MessageLayout::PlaceNonOneofFields(
     }
   }
 
-  // Place hasbits at the beginning.
-  int64_t hasbit_bytes = DivRoundUp(hasbit_count, 8);
-  Place(SizeAndAlign{{hasbit_bytes, hasbit_bytes}, {1, 1}});
+  // Place hasbits at the beginning.  Indexes run up to hasbit_count, so the
+  // unused hasbit 0 counts too.  Unlike Place(), this doesn't take the size
+  // as the alignment: hasbits are bytes, and more than 16 of them would
+  // otherwise make the message alignment something other than a power of 2.
+  int64_t hasbit_bytes = hasbit_count ? DivRoundUp(hasbit_count + 1, 8) : 0;
+  hasbit_bytes_ = Size{hasbit_bytes, hasbit_bytes};
+  size_.Add(hasbit_bytes_);
+}
 
-  // Place non-oneof fields.
-  for (auto field : field_order) {
+void MessageLayout::PlaceNonOneofFields(
+    const std::vector<const protobuf::FieldDescriptor*>& fields) {
+  for (auto field : fields) {
     field_offsets_[field] = Place(SizeOf(field));
   }
 }
 
-void MessageLayout::PlaceOneofFields(const protobuf::Descriptor* descriptor) {
-  std::vector<const protobuf::OneofDescriptor*> oneof_order;
-  for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
-    oneof_order.push_back(descriptor->oneof_decl(i));
-  }
-  std::sort(oneof_order.begin(), oneof_order.end(),
-            [](const protobuf::OneofDescriptor* a,
-               const protobuf::OneofDescriptor* b) {
-              return a->full_name() < b->full_name();
-            });
-
-  for (auto oneof : oneof_order) {
-    SizeAndAlign oneof_maxsize{{0, 0}, {0, 0}};
-    // Calculate max size.
-    for (int i = 0; i < oneof->field_count(); i++) {
-      oneof_maxsize.MaxFrom(SizeOf(oneof->field(i)));
-    }
-
+void MessageLayout::PlaceOneofFields(
+    const std::vector<const protobuf::OneofDescriptor*>& oneofs) {
+  for (auto oneof : oneofs) {
     // Place discriminator enum and data.
-    Size data = Place(oneof_maxsize);
+    Size data = Place(SizeOf(oneof));
     Size discriminator = Place(SizeAndAlign{{4, 4}, {4, 4}});
 
     oneof_case_offsets_[oneof] = discriminator;
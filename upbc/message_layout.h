@@ -2,9 +2,12 @@
 #ifndef UPBC_MESSAGE_LAYOUT_H
 #define UPBC_MESSAGE_LAYOUT_H
 
+#include <vector>
+
 #include "absl/base/macros.h"
 #include "absl/container/flat_hash_map.h"
 #include "google/protobuf/descriptor.h"
+#include "upbc/profile.h"
 
 namespace upbc {
 
@@ -40,10 +43,16 @@ class MessageLayout {
     }
   };
 
-  MessageLayout(const google::protobuf::Descriptor* descriptor) {
-    ComputeLayout(descriptor);
+  // With a profile, the most accessed fields and oneofs that fit in
+  // kHotBytes are placed first, right after the hasbits, so that they share
+  // a cache line.  Everything else is placed by size to minimize padding.
+  MessageLayout(const google::protobuf::Descriptor* descriptor,
+                const FieldProfile* profile = nullptr) {
+    ComputeLayout(descriptor, profile);
   }
 
+  static constexpr int64_t kHotBytes = 64;
+
   Size GetFieldOffset(const google::protobuf::FieldDescriptor* field) const {
     return GetMapValue(field_offsets_, field);
   }
@@ -59,14 +68,37 @@ class MessageLayout {
 
   Size message_size() const { return size_; }
 
+  // The end of the hasbits and hot fields, or of the hasbits alone if there
+  // are no hot fields.
+  Size hot_size() const { return hot_size_; }
+  int hot_count() const { return hot_count_; }
+
+  // The bytes that a new message must have zeroed: the hasbits, the oneof
+  // cases and the fields without presence, in offset order.  Ranges that
+  // are at most kZeroGap bytes apart on both platforms are merged.
+  struct ZeroRange {
+    Size offset;
+    Size size;
+  };
+  const std::vector<ZeroRange>& zero_ranges() const { return zero_ranges_; }
+  Size zero_size() const { return zero_size_; }
+
+  static constexpr int64_t kZeroGap = 8;
+
   static bool HasHasbit(const google::protobuf::FieldDescriptor* field);
   static SizeAndAlign SizeOfUnwrapped(
       const google::protobuf::FieldDescriptor* field);
 
  private:
-  void ComputeLayout(const google::protobuf::Descriptor* descriptor);
-  void PlaceNonOneofFields(const google::protobuf::Descriptor* descriptor);
-  void PlaceOneofFields(const google::protobuf::Descriptor* descriptor);
+  void ComputeLayout(const google::protobuf::Descriptor* descriptor,
+                     const FieldProfile* profile);
+  void PlaceHasbits(
+      std::vector<const google::protobuf::FieldDescriptor*> fields);
+  void PlaceNonOneofFields(
+      const std::vector<const google::protobuf::FieldDescriptor*>& fields);
+  void PlaceOneofFields(
+      const std::vector<const google::protobuf::OneofDescriptor*>& oneofs);
+  void ComputeZeroRanges(const google::protobuf::Descriptor* descriptor);
   Size Place(SizeAndAlign size_and_align);
 
   template <class K, class V>
@@ -89,6 +121,7 @@ class MessageLayout {
   }
 
   static SizeAndAlign SizeOf(const google::protobuf::FieldDescriptor* field);
+  static SizeAndAlign SizeOf(const google::protobuf::OneofDescriptor* oneof);
   static int64_t FieldLayoutRank(
       const google::protobuf::FieldDescriptor* field);
 
@@ -100,6 +133,11 @@ class MessageLayout {
       oneof_case_offsets_;
   Size maxalign_;
   Size size_;
+  Size hot_size_;
+  int hot_count_;
+  Size hasbit_bytes_;
+  std::vector<ZeroRange> zero_ranges_;
+  Size zero_size_;
 };
 
 }  // namespace upbc
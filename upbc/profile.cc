@@ -0,0 +1,72 @@
+
+#include "upbc/profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+namespace upbc {
+
+bool FieldProfile::Load(const std::string& filename, std::string* error) {
+  std::ifstream in(filename);
+  if (!in) {
+    *error = absl::StrCat("Can't open profile ", filename);
+    return false;
+  }
+
+  std::string line;
+  int lineno = 0;
+  while (std::getline(in, line)) {
+    std::istringstream words(line);
+    std::string name;
+    int64_t count;
+    std::string rest;
+    lineno++;
+
+    if (!(words >> name) || name[0] == '#') continue;
+    if (!(words >> count) || count < 0 || (words >> rest)) {
+      *error = absl::StrCat(filename, ":", lineno,
+                            ": expected \"<field name> <count>\"");
+      return false;
+    }
+    counts_[name] += count;
+  }
+
+  // Field names are the message name plus one more component.
+  absl::flat_hash_map<std::string, int64_t> message_counts;
+  for (const auto& field : counts_) {
+    size_t dot = field.first.rfind('.');
+    if (dot != std::string::npos) {
+      message_counts[field.first.substr(0, dot)] += field.second;
+    }
+  }
+  std::vector<std::pair<int64_t, std::string>> messages;
+  for (const auto& message : message_counts) {
+    if (message.second > 0) {
+      messages.push_back({-message.second, message.first});
+    }
+  }
+  std::sort(messages.begin(), messages.end());
+  for (size_t i = 0; i < messages.size(); i++) {
+    message_ranks_[messages[i].second] = i;
+  }
+
+  return true;
+}
+
+int64_t FieldProfile::Count(
+    const google::protobuf::FieldDescriptor* field) const {
+  auto iter = counts_.find(field->full_name());
+  return iter == counts_.end() ? 0 : iter->second;
+}
+
+int FieldProfile::MessageRank(
+    const google::protobuf::Descriptor* message) const {
+  auto iter = message_ranks_.find(message->full_name());
+  return iter == message_ranks_.end() ? -1 : iter->second;
+}
+
+}  // namespace upbc
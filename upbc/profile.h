@@ -0,0 +1,39 @@
+
+#ifndef UPBC_PROFILE_H
+#define UPBC_PROFILE_H
+
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "google/protobuf/descriptor.h"
+
+namespace upbc {
+
+// How often each field is accessed, as measured in production.  The file
+// format is text, with one "<field full name> <count>" pair per line, eg.
+//
+//   # Counts from one hour of traffic.
+//   foo.Request.id 982311
+//   foo.Request.payload 12
+//
+// Blank lines and lines starting with '#' are skipped.  Fields that are not
+// listed have a count of zero.
+class FieldProfile {
+ public:
+  bool Load(const std::string& filename, std::string* error);
+
+  bool empty() const { return counts_.empty(); }
+  int64_t Count(const google::protobuf::FieldDescriptor* field) const;
+
+  // Where |message| ranks among the profile's messages by the total count of
+  // their fields, 0 being the hottest, or -1 if none of its fields is listed.
+  int MessageRank(const google::protobuf::Descriptor* message) const;
+
+ private:
+  absl::flat_hash_map<std::string, int64_t> counts_;
+  absl::flat_hash_map<std::string, int> message_ranks_;
+};
+
+}  // namespace upbc
+
+#endif  // UPBC_PROFILE_H